@@ -54,6 +54,10 @@
 //	CACFString
 //=============================================================================
 
+#if DEBUG
+CACFString::RetainHandler	CACFString::sRetainHandler = NULL;
+#endif
+
 UInt32	CACFString::GetStringByteLength(CFStringRef inCFString, CFStringEncoding inEncoding)
 {
 	CFIndex theAnswer = 0;
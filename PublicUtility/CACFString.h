@@ -85,12 +85,28 @@ public:
 	void				AssignWithoutRetain(CFStringRef inCFString) { if (inCFString != mCFString) { Release(); mCFString = inCFString; } mWillRelease = true; }
 
 private:
-	void				Retain() { if(mWillRelease && (mCFString != NULL)) { CFRetain(mCFString); } }
-	void				Release() { if(mWillRelease && (mCFString != NULL)) { CFRelease(mCFString); } }
+	void				Retain() { if(mWillRelease && (mCFString != NULL)) { NoteRetainOrRelease("CFRetain"); CFRetain(mCFString); } }
+	void				Release() { if(mWillRelease && (mCFString != NULL)) { NoteRetainOrRelease("CFRelease"); CFRelease(mCFString); } }
 	
 	CFStringRef			mCFString;
 	bool				mWillRelease;
 
+//	Debugging
+public:
+#if DEBUG
+	//	The handler is called with "CFRetain" or "CFRelease" before a CACFString retains or releases
+	//	its string. Should be set before any other threads are started.
+	typedef void		(*RetainHandler)(const char* inOperation);
+	static void			SetRetainHandler(RetainHandler inHandler) { sRetainHandler = inHandler; }
+
+private:
+	static void			NoteRetainOrRelease(const char* inOperation) { if(sRetainHandler != NULL) { sRetainHandler(inOperation); } }
+	static RetainHandler	sRetainHandler;
+#else
+private:
+	static void			NoteRetainOrRelease(const char*) {}
+#endif
+
 //	Operations
 public:
 	void				AllowRelease() { mWillRelease = true; }
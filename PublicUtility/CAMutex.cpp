@@ -71,6 +71,10 @@
 //	#define LongLatencyThreshholdNS	1000000ULL	// nanoseconds
 #endif
 
+#if DEBUG
+CAMutex::WouldBlockHandler	CAMutex::sWouldBlockHandler = NULL;
+#endif
+
 //==================================================================================================
 //	CAMutex
 //==================================================================================================
@@ -131,7 +135,25 @@ bool	CAMutex::Lock()
 			UInt64 lockTryTime = CAHostTimeBase::GetCurrentTimeInNanos();
 		#endif
 		
-		OSStatus theError = pthread_mutex_lock(&mMutex);
+		#if DEBUG
+			//	Only tell the handler if locking would actually block.
+			OSStatus theError;
+			if(sWouldBlockHandler != NULL)
+			{
+				theError = pthread_mutex_trylock(&mMutex);
+				if(theError == EBUSY)
+				{
+					sWouldBlockHandler(mName);
+					theError = pthread_mutex_lock(&mMutex);
+				}
+			}
+			else
+			{
+				theError = pthread_mutex_lock(&mMutex);
+			}
+		#else
+			OSStatus theError = pthread_mutex_lock(&mMutex);
+		#endif
 		ThrowIf(theError != 0, CAException(theError), "CAMutex::Lock: Could not lock the mutex");
 		mOwner = theCurrentThread;
 		theAnswer = true;
@@ -343,3 +365,91 @@ CAMutex::Unlocker::~Unlocker()
 		mMutex.Lock();
 	}
 }
+
+#if TARGET_OS_MAC
+//==================================================================================================
+//	CAUnfairMutex
+//==================================================================================================
+
+bool	CAUnfairMutex::Lock()
+{
+	if(__builtin_available(macOS 10.12, *))
+	{
+		bool theAnswer = false;
+		
+		pthread_t theCurrentThread = pthread_self();
+		if(!pthread_equal(theCurrentThread, mOwner))
+		{
+			#if DEBUG
+				//	Only tell the handler if locking would actually block.
+				if((sWouldBlockHandler == NULL) || !os_unfair_lock_trylock(&mUnfairLock))
+				{
+					if(sWouldBlockHandler != NULL)
+					{
+						sWouldBlockHandler(mName);
+					}
+					os_unfair_lock_lock(&mUnfairLock);
+				}
+			#else
+				os_unfair_lock_lock(&mUnfairLock);
+			#endif
+			mOwner = theCurrentThread;
+			theAnswer = true;
+		}
+		
+		return theAnswer;
+	}
+	
+	return CAMutex::Lock();
+}
+
+void	CAUnfairMutex::Unlock()
+{
+	if(__builtin_available(macOS 10.12, *))
+	{
+		if(pthread_equal(pthread_self(), mOwner))
+		{
+			mOwner = 0;
+			os_unfair_lock_unlock(&mUnfairLock);
+		}
+		else
+		{
+			DebugMessage("CAUnfairMutex::Unlock: A thread is attempting to unlock a Mutex it doesn't own");
+		}
+		
+		return;
+	}
+	
+	CAMutex::Unlock();
+}
+
+bool	CAUnfairMutex::Try(bool& outWasLocked)
+{
+	if(__builtin_available(macOS 10.12, *))
+	{
+		bool theAnswer = false;
+		outWasLocked = false;
+		
+		pthread_t theCurrentThread = pthread_self();
+		if(!pthread_equal(theCurrentThread, mOwner))
+		{
+			//	the current thread doesn't already own the lock, so see if we can take it
+			if(os_unfair_lock_trylock(&mUnfairLock))
+			{
+				mOwner = theCurrentThread;
+				theAnswer = true;
+				outWasLocked = true;
+			}
+		}
+		else
+		{
+			//	the current thread already owns the lock
+			theAnswer = true;
+		}
+		
+		return theAnswer;
+	}
+	
+	return CAMutex::Try(outWasLocked);
+}
+#endif
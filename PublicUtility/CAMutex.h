@@ -60,6 +60,7 @@
 
 #if TARGET_OS_MAC
 	#include <pthread.h>
+	#include <os/lock.h>
 #elif TARGET_OS_WIN32
 	#include <windows.h>
 #else
@@ -85,6 +86,18 @@ public:
 	
 	virtual bool	IsFree() const;
 	virtual bool	IsOwnedByCurrentThread() const;
+
+#if DEBUG
+//	Debugging
+public:
+	//	The handler is called by the thread that's about to block in Lock, before it blocks, with the
+	//	mutex's name. Should be set before any other threads are started.
+	typedef void	(*WouldBlockHandler)(const char* inName);
+	static void		SetWouldBlockHandler(WouldBlockHandler inHandler) { sWouldBlockHandler = inHandler; }
+
+protected:
+	static WouldBlockHandler	sWouldBlockHandler;
+#endif
 		
 //	Implementation
 protected:
@@ -160,5 +173,32 @@ public:
 	};
 };
 
+#if TARGET_OS_MAC
+//==================================================================================================
+//	A CAMutex that takes an os_unfair_lock instead of its pthread mutex. Taking and releasing one
+//	that's free is cheaper, and a thread waiting for it donates its priority to the thread holding
+//	it. Otherwise it's the same as a CAMutex, so it works with Locker, Unlocker and Tryer and
+//	tracks its owner the same way. Falls back to the pthread mutex before macOS 10.12.
+//==================================================================================================
+
+class	CAUnfairMutex
+:
+	public CAMutex
+{
+//	Construction/Destruction
+public:
+					CAUnfairMutex(const char* inName) : CAMutex(inName), mUnfairLock(OS_UNFAIR_LOCK_INIT) {}
+
+//	Actions
+public:
+	virtual bool	Lock();
+	virtual void	Unlock();
+	virtual bool	Try(bool& outWasLocked);
+
+//	Implementation
+private:
+	os_unfair_lock	mUnfairLock;
+};
+#endif
 
 #endif // __CAMutex_h__
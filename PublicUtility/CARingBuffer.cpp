@@ -51,10 +51,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <algorithm>
-#include <stdatomic.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
 
 CARingBuffer::CARingBuffer() :
-	mBuffers(NULL), mNumberChannels(0), mCapacityFrames(0), mCapacityBytes(0)
+	mBuffers(NULL), mNumberChannels(0), mCapacityFrames(0), mCapacityBytes(0),
+	mAllocationSize(0), mWantsWired(false), mIsWired(false), mWriteHoleStartTime(0), mWriteHoleEndTime(0)
 {
 
 }
@@ -77,35 +80,75 @@ void	CARingBuffer::Allocate(int nChannels, UInt32 bytesPerFrame, UInt32 capacity
 	mCapacityFramesMask = capacityFrames - 1;
 	mCapacityBytes = bytesPerFrame * capacityFrames;
 
-	// put everything in one memory allocation, first the pointers, then the deinterleaved channels
-	UInt32 allocSize = (mCapacityBytes + sizeof(Byte *)) * nChannels;
-	Byte *p = (Byte *)CA_malloc(allocSize);
+	// put everything in one memory allocation, first the pointers, then the deinterleaved channels.
+	// Each channel starts on a cache line, so readers can use aligned vector loads on it, and the
+	// pointers get their own cache line(s). The whole allocation is in whole pages so it can be
+	// wired without wiring anyone else's memory.
+	size_t pageSize = (size_t)getpagesize();
+	UInt32 pointersSize = RoundUpToAlignment(nChannels * sizeof(Byte *));
+	UInt32 channelStride = RoundUpToAlignment(mCapacityBytes);
+	size_t allocSize = pointersSize + (size_t)channelStride * nChannels;
+	allocSize = (allocSize + pageSize - 1) & ~(pageSize - 1);
+	void *allocation = NULL;
+	if (posix_memalign(&allocation, pageSize, allocSize) != 0)
+		throw std::bad_alloc();
+	Byte *p = (Byte *)allocation;
+	// prefault every page, so the first Store doesn't
 	memset(p, 0, allocSize);
+	mAllocationSize = allocSize;
 	mBuffers = (Byte **)p;
-	p += nChannels * sizeof(Byte *);
+	p += pointersSize;
 	for (int i = 0; i < nChannels; ++i) {
 		mBuffers[i] = p;
-		p += mCapacityBytes;
+		p += channelStride;
 	}
 	
 	for (UInt32 i = 0; i<kGeneralRingTimeBoundsQueueSize; ++i)
 	{
 		mTimeBoundsQueue[i].mStartTime = 0;
 		mTimeBoundsQueue[i].mEndTime = 0;
+		mTimeBoundsQueue[i].mSilenceStartTime = 0;
+		mTimeBoundsQueue[i].mHoleStartTime = 0;
+		mTimeBoundsQueue[i].mHoleEndTime = 0;
 		mTimeBoundsQueue[i].mUpdateCounter = 0;
 	}
 	mTimeBoundsQueuePtr = 0;
+
+	if (mWantsWired)
+		mIsWired = (mlock(mBuffers, mAllocationSize) == 0);
 }
 
 void	CARingBuffer::Deallocate()
 {
 	if (mBuffers) {
+		if (mIsWired)
+			munlock(mBuffers, mAllocationSize);
+		mIsWired = false;
 		free(mBuffers);
 		mBuffers = NULL;
 	}
 	mNumberChannels = 0;
 	mCapacityBytes = 0;
 	mCapacityFrames = 0;
+	mAllocationSize = 0;
+}
+
+bool	CARingBuffer::SetWired(bool wired)
+{
+	mWantsWired = wired;
+	if (mBuffers == NULL)
+		return true;	// applied by the next Allocate
+	if (wired && !mIsWired)
+		mIsWired = (mlock(mBuffers, mAllocationSize) == 0);
+	else if (!wired && mIsWired)
+		mIsWired = (munlock(mBuffers, mAllocationSize) != 0);
+	return mIsWired == wired;
+}
+
+void	CARingBuffer::Clear()
+{
+	// Readers will see an empty range. The next Store starts the buffer again from its sample time.
+	SetTimeBounds(0, 0, 0, 0, 0);
 }
 
 inline void ZeroRange(Byte **buffers, int nchannels, int offset, int nbytes)
@@ -116,16 +159,21 @@ inline void ZeroRange(Byte **buffers, int nchannels, int offset, int nbytes)
 	}
 }
 
-inline void StoreABL(Byte **buffers, int destOffset, const AudioBufferList *abl, int srcOffset, int nbytes)
+struct StoreABLContext {
+	const AudioBufferList *	abl;
+	UInt32					bytesPerFrame;
+};
+
+// The StoreFunction Store(abl, ...) uses. Copies one channel's range from the AudioBufferList.
+static void StoreABL(void *context, int channel, Byte *dest, UInt32 srcFrameOffset, UInt32 nFrames)
 {
-	int nchannels = abl->mNumberBuffers;
-	const AudioBuffer *src = abl->mBuffers;
-	while (--nchannels >= 0) {
-		if (srcOffset > (int)src->mDataByteSize) continue;
-		memcpy(*buffers + destOffset, (Byte *)src->mData + srcOffset, std::min(nbytes, (int)src->mDataByteSize - srcOffset));
-		++buffers;
-		++src;
-	}
+	const StoreABLContext *ablContext = static_cast<const StoreABLContext *>(context);
+	if (channel >= (int)ablContext->abl->mNumberBuffers) return;
+	const AudioBuffer *src = &ablContext->abl->mBuffers[channel];
+	int srcOffset = srcFrameOffset * ablContext->bytesPerFrame;
+	int nbytes = nFrames * ablContext->bytesPerFrame;
+	if (srcOffset > (int)src->mDataByteSize) return;
+	memcpy(dest, (Byte *)src->mData + srcOffset, std::min(nbytes, (int)src->mDataByteSize - srcOffset));
 }
 
 inline void FetchABL(AudioBufferList *abl, int destOffset, Byte **buffers, int srcOffset, int nbytes)
@@ -151,9 +199,85 @@ inline void ZeroABL(AudioBufferList *abl, int destOffset, int nbytes)
 	}
 }
 
+// The destinations FetchFrames copies to. Each is inlined into its own instantiation, so Fetch
+// keeps the AudioBufferList's per-buffer loops and size clamps and FetchInterleaved is just memcpy
+// and memset into the caller's frames.
+struct CARingBuffer::ABLDestination {
+	AudioBufferList *	abl;
+	
+	void	Zero(int destOffset, int nbytes) { ZeroABL(abl, destOffset, nbytes); }
+	void	Copy(int destOffset, Byte **buffers, int srcOffset, int nbytes) { FetchABL(abl, destOffset, buffers, srcOffset, nbytes); }
+	void	SetByteSize(int nbytes) {
+		for (UInt32 i = 0; i < abl->mNumberBuffers; ++i)
+			abl->mBuffers[i].mDataByteSize = nbytes;
+	}
+};
+
+struct CARingBuffer::InterleavedDestination {
+	Byte *					frames;
+	Byte **					buffers;
+	
+	void	Zero(int destOffset, int nbytes) { memset(frames + destOffset, 0, nbytes); }
+	void	Copy(int destOffset, Byte **, int srcOffset, int nbytes) { memcpy(frames + destOffset, buffers[0] + srcOffset, nbytes); }
+	void	SetByteSize(int) { }
+};
+
+
+CARingBufferError	CARingBuffer::Store(const AudioBufferList *abl, UInt32 framesToWrite, SampleTime startWrite, UInt32 *outGapFrames)
+{
+	StoreABLContext context = { abl, mBytesPerFrame };
+	return StoreFrames([&context](int channel, Byte *dest, UInt32 srcFrameOffset, UInt32 nFrames) {
+						   StoreABL(&context, channel, dest, srcFrameOffset, nFrames);
+					   },
+					   framesToWrite, startWrite, outGapFrames);
+}
+
+CARingBufferError	CARingBuffer::Store(StoreFunction storeFunction, void *context, UInt32 framesToWrite, SampleTime startWrite, UInt32 *outGapFrames)
+{
+	return StoreFrames([storeFunction, context](int channel, Byte *dest, UInt32 srcFrameOffset, UInt32 nFrames) {
+						   storeFunction(context, channel, dest, srcFrameOffset, nFrames);
+					   },
+					   framesToWrite, startWrite, outGapFrames);
+}
+
+CARingBufferError	CARingBuffer::StoreInterleaved(const void *frames, UInt32 framesToWrite, SampleTime startWrite, UInt32 *outGapFrames)
+{
+	const Byte *src = (const Byte *)frames;
+	UInt32 bytesPerFrame = mBytesPerFrame;
+	return StoreFrames([src, bytesPerFrame](int, Byte *dest, UInt32 srcFrameOffset, UInt32 nFrames) {
+						   memcpy(dest, src + srcFrameOffset * bytesPerFrame, nFrames * bytesPerFrame);
+					   },
+					   framesToWrite, startWrite, outGapFrames);
+}
+
+template <class StoreRange>
+CARingBufferError	CARingBuffer::StoreFrames(const StoreRange &storeRange, UInt32 framesToWrite, SampleTime startWrite, UInt32 *outGapFrames)
+{
+	Regions regions;
+	CARingBufferError err = BeginWrite(framesToWrite, startWrite, regions, outGapFrames);
+	if (err || regions.nFrames[0] == 0)
+		return err;
+	
+	// write the new frames
+	for (int channel = 0; channel < mNumberChannels; ++channel) {
+		storeRange(channel, RegionData(regions, 0, channel), 0, regions.nFrames[0]);
+		if (regions.nFrames[1] > 0)
+			storeRange(channel, RegionData(regions, 1, channel), regions.nFrames[0], regions.nFrames[1]);
+	}
+	
+	EndWrite(regions);
+	
+	return kCARingBufferError_OK;	// success
+}
 
-CARingBufferError	CARingBuffer::Store(const AudioBufferList *abl, UInt32 framesToWrite, SampleTime startWrite)
+CARingBufferError	CARingBuffer::BeginWrite(UInt32 framesToWrite, SampleTime startWrite, Regions &regions, UInt32 *outGapFrames)
 {
+	regions = Regions();
+	regions.startTime = regions.endTime = startWrite;
+	
+	if (outGapFrames)
+		*outGapFrames = 0;
+	
 	if (framesToWrite == 0)
 		return kCARingBufferError_OK;
 	
@@ -161,90 +285,234 @@ CARingBufferError	CARingBuffer::Store(const AudioBufferList *abl, UInt32 framesT
 		return kCARingBufferError_TooMuch;		// too big!
 
 	SampleTime endWrite = startWrite + framesToWrite;
+	SampleTime holeStart = HoleStartTime();
+	SampleTime holeEnd = HoleEndTime();
 	
 	if (startWrite < EndTime()) {
 		// going backwards, throw everything out
-		SetTimeBounds(startWrite, startWrite);
+		SetTimeBounds(startWrite, startWrite, startWrite, startWrite, startWrite);
+		holeStart = holeEnd = startWrite;
 	} else if (endWrite - StartTime() <= mCapacityFrames) {
 		// the buffer has not yet wrapped and will not need to
 	} else {
 		// advance the start time past the region we are about to overwrite
 		SampleTime newStart = endWrite - mCapacityFrames;	// one buffer of time behind where we're writing
 		SampleTime newEnd = std::max(newStart, EndTime());
-		SetTimeBounds(newStart, newEnd);
+		SetTimeBounds(newStart, newEnd, std::max(newStart, SilenceStartTime()), holeStart, holeEnd);
 	}
 	
-	// write the new frames
-	Byte **buffers = mBuffers;
-	int nchannels = mNumberChannels;
-	int offset0, offset1, nbytes;
 	SampleTime curEnd = EndTime();
+	// The silent frames at the end of the buffer (if any) were never written, so they're part of
+	// the gap.
+	SampleTime gapStart = SilenceStartTime();
+	
+	if (startWrite > curEnd && outGapFrames)
+		*outGapFrames = (UInt32)std::min(startWrite - curEnd, (SampleTime)mCapacityFrames);
 	
-	if (startWrite > curEnd) {
-		// we are skipping some samples, so zero the range we are skipping
-		offset0 = FrameOffset(curEnd);
-		offset1 = FrameOffset(startWrite);
-		if (offset0 < offset1)
-			ZeroRange(buffers, nchannels, offset0, offset1 - offset0);
-		else {
-			ZeroRange(buffers, nchannels, offset0, mCapacityBytes - offset0);
-			ZeroRange(buffers, nchannels, 0, offset1);
+	if (startWrite > gapStart) {
+		// We're skipping some samples. Rather than zero them here, make them the hole, unless the
+		// last hole is still in the buffer and is longer. Only the shorter one has to be zeroed.
+		// Readers already treat both as silence, so it doesn't matter if they see this happen.
+		SampleTime liveHoleStart = std::max(holeStart, StartTime());
+		if (liveHoleStart < holeEnd && holeEnd - liveHoleStart > startWrite - gapStart) {
+			ZeroFrames(gapStart, startWrite);
+		} else {
+			if (liveHoleStart < holeEnd)
+				ZeroFrames(liveHoleStart, holeEnd);
+			holeStart = gapStart;
+			holeEnd = startWrite;
 		}
-		offset0 = offset1;
+	}
+	
+	// EndWrite publishes it.
+	mWriteHoleStartTime = holeStart;
+	mWriteHoleEndTime = holeEnd;
+	
+	regions.endTime = endWrite;
+	SetRegions(startWrite, endWrite, regions);
+	
+	return kCARingBufferError_OK;
+}
+
+void	CARingBuffer::EndWrite(const Regions &regions)
+{
+	if (regions.nFrames[0] == 0)
+		return;
+	
+	// now update the end time
+	SetTimeBounds(StartTime(), regions.endTime, regions.endTime, mWriteHoleStartTime, mWriteHoleEndTime);
+}
+
+void	CARingBuffer::SetRegions(SampleTime startTime, SampleTime endTime, Regions &regions)
+{
+	int offset0 = FrameOffset(startTime);
+	int offset1 = FrameOffset(endTime);
+	regions.offset[0] = offset0;
+	if (offset0 < offset1) {
+		regions.nFrames[0] = (offset1 - offset0) / mBytesPerFrame;
+		regions.offset[1] = 0;
+		regions.nFrames[1] = 0;
 	} else {
-		offset0 = FrameOffset(startWrite);
+		regions.nFrames[0] = (mCapacityBytes - offset0) / mBytesPerFrame;
+		regions.offset[1] = 0;
+		regions.nFrames[1] = offset1 / mBytesPerFrame;
 	}
+}
 
-	offset1 = FrameOffset(endWrite);
+void	CARingBuffer::ZeroFrames(SampleTime startTime, SampleTime endTime)
+{
+	// Only called from Store, for fewer than mCapacityFrames frames.
+	int offset0 = FrameOffset(startTime);
+	int offset1 = FrameOffset(endTime);
 	if (offset0 < offset1)
-		StoreABL(buffers, offset0, abl, 0, offset1 - offset0);
+		ZeroRange(mBuffers, mNumberChannels, offset0, offset1 - offset0);
 	else {
-		nbytes = mCapacityBytes - offset0;
-		StoreABL(buffers, offset0, abl, 0, nbytes);
-		StoreABL(buffers, 0, abl, nbytes, offset1);
+		ZeroRange(mBuffers, mNumberChannels, offset0, mCapacityBytes - offset0);
+		ZeroRange(mBuffers, mNumberChannels, 0, offset1);
 	}
+}
+
+CARingBufferError	CARingBuffer::StoreSilence(UInt32 framesToWrite, SampleTime startWrite, UInt32 *outGapFrames)
+{
+	if (outGapFrames)
+		*outGapFrames = 0;
 	
-	// now update the end time
-	SetTimeBounds(StartTime(), endWrite);
+	if (framesToWrite == 0)
+		return kCARingBufferError_OK;
 	
-	return kCARingBufferError_OK;	// success
+	SampleTime endWrite = startWrite + framesToWrite;
+	SampleTime startTime = StartTime();
+	SampleTime endTime = EndTime();
+	SampleTime silenceStart = SilenceStartTime();
+	SampleTime holeStart = HoleStartTime();
+	SampleTime holeEnd = HoleEndTime();
+	
+	if (startWrite < endTime) {
+		// going backwards, throw everything out
+		startTime = endTime = silenceStart = holeStart = holeEnd = startWrite;
+	} else if (startWrite > endTime && outGapFrames) {
+		*outGapFrames = (UInt32)std::min(startWrite - endTime, (SampleTime)mCapacityFrames);
+	}
+	
+	// Nothing is written to the buffers, so the new bounds can be published in one step. Any frames
+	// between the old silence start time and startWrite stay silent, including the gap.
+	SampleTime newStart = std::max(startTime, endWrite - (SampleTime)mCapacityFrames);
+	SetTimeBounds(newStart, endWrite, std::max(newStart, silenceStart), holeStart, holeEnd);
+	
+	return kCARingBufferError_OK;
 }
 
-void	CARingBuffer::SetTimeBounds(SampleTime startTime, SampleTime endTime)
+void	CARingBuffer::SetTimeBounds(SampleTime startTime, SampleTime endTime, SampleTime silenceStartTime,
+									SampleTime holeStartTime, SampleTime holeEndTime)
 {
-	UInt32 nextPtr = mTimeBoundsQueuePtr + 1;
+	// Only called from Store, so the writer is the only thread that modifies the queue pointer.
+	UInt32 nextPtr = mTimeBoundsQueuePtr.load(std::memory_order_relaxed) + 1;
 	UInt32 index = nextPtr & kGeneralRingTimeBoundsQueueMask;
+	CARingBuffer::TimeBounds* bounds = mTimeBoundsQueue + index;
 	
-	mTimeBoundsQueue[index].mStartTime = startTime;
-	mTimeBoundsQueue[index].mEndTime = endTime;
-	mTimeBoundsQueue[index].mUpdateCounter = nextPtr;
-    mTimeBoundsQueuePtr++;
-	//OSAtomicCompareAndSwap32Barrier(mTimeBoundsQueuePtr, mTimeBoundsQueuePtr + 1, (SInt32*)&mTimeBoundsQueuePtr);
+	// Invalidate the entry before changing it. (nextPtr - 1) can never match the entry's index, so
+	// a reader that was lapped by 32 updates and is reading this entry will reject it.
+	bounds->mUpdateCounter.store(nextPtr - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	
+	bounds->mStartTime.store(startTime, std::memory_order_relaxed);
+	bounds->mEndTime.store(endTime, std::memory_order_relaxed);
+	bounds->mSilenceStartTime.store(silenceStartTime, std::memory_order_relaxed);
+	bounds->mHoleStartTime.store(holeStartTime, std::memory_order_relaxed);
+	bounds->mHoleEndTime.store(holeEndTime, std::memory_order_relaxed);
+	
+	// Publish the entry, then the pointer to it.
+	bounds->mUpdateCounter.store(nextPtr, std::memory_order_release);
+	mTimeBoundsQueuePtr.store(nextPtr, std::memory_order_release);
+	
+	// Keep Store's following writes to the buffers from becoming visible before the new bounds, so
+	// a reader re-checking the bounds after copying always notices that it was overwritten.
+	std::atomic_thread_fence(std::memory_order_release);
 }
 
 CARingBufferError	CARingBuffer::GetTimeBounds(SampleTime &startTime, SampleTime &endTime)
+{
+	SampleTime silenceStartTime;
+	return GetTimeBounds(startTime, endTime, silenceStartTime);
+}
+
+CARingBufferError	CARingBuffer::GetTimeBounds(SampleTime &startTime, SampleTime &endTime, SampleTime &silenceStartTime)
+{
+	SampleTime holeStartTime, holeEndTime;
+	return GetTimeBounds(startTime, endTime, silenceStartTime, holeStartTime, holeEndTime);
+}
+
+CARingBufferError	CARingBuffer::GetTimeBounds(SampleTime &startTime, SampleTime &endTime, SampleTime &silenceStartTime,
+												SampleTime &holeStartTime, SampleTime &holeEndTime)
+{
+	UInt32 timeBoundsPtr;
+	return GetTimeBounds(startTime, endTime, silenceStartTime, holeStartTime, holeEndTime, timeBoundsPtr);
+}
+
+CARingBufferError	CARingBuffer::GetTimeBounds(SampleTime &startTime, SampleTime &endTime, SampleTime &silenceStartTime,
+												SampleTime &holeStartTime, SampleTime &holeEndTime, UInt32 &timeBoundsPtr)
 {
 	for (int i=0; i<8; ++i) // fail after a few tries.
 	{
-		UInt32 curPtr = mTimeBoundsQueuePtr;
+		UInt32 curPtr = mTimeBoundsQueuePtr.load(std::memory_order_acquire);
 		UInt32 index = curPtr & kGeneralRingTimeBoundsQueueMask;
 		CARingBuffer::TimeBounds* bounds = mTimeBoundsQueue + index;
 		
-		startTime = bounds->mStartTime;
-		endTime = bounds->mEndTime;
-		UInt32 newPtr = bounds->mUpdateCounter;
+		UInt32 counterBefore = bounds->mUpdateCounter.load(std::memory_order_acquire);
+		startTime = bounds->mStartTime.load(std::memory_order_relaxed);
+		endTime = bounds->mEndTime.load(std::memory_order_relaxed);
+		silenceStartTime = bounds->mSilenceStartTime.load(std::memory_order_relaxed);
+		holeStartTime = bounds->mHoleStartTime.load(std::memory_order_relaxed);
+		holeEndTime = bounds->mHoleEndTime.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		UInt32 counterAfter = bounds->mUpdateCounter.load(std::memory_order_relaxed);
 		
-		if (newPtr == curPtr) 
+		if (counterBefore == curPtr && counterAfter == curPtr) {
+			timeBoundsPtr = curPtr;
 			return kCARingBufferError_OK;
+		}
 	}
 	return kCARingBufferError_CPUOverload;
 }
 
-CARingBufferError	CARingBuffer::ClipTimeBounds(SampleTime& startRead, SampleTime& endRead)
+CARingBufferError	CARingBuffer::CheckReadAfterCopy(SampleTime startRead, SampleTime endRead, UInt32 timeBoundsPtr)
+{
+	// Checking only the latest start time would miss a Store that went backwards and rewrote the
+	// frames, since the start time moves back too. So look at every bounds entry published since the
+	// read started instead. A Store only changes frames in the range if one of its entries has a
+	// start time after startRead (it wrapped around over them) or an end time before endRead (it
+	// threw them out to go backwards). Appending after the range does neither.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	UInt32 curPtr = mTimeBoundsQueuePtr.load(std::memory_order_acquire);
+	
+	// The entries after timeBoundsPtr's may have been reused already.
+	if (curPtr - timeBoundsPtr >= kGeneralRingTimeBoundsQueueSize)
+		return kCARingBufferError_CPUOverload;
+	
+	for (UInt32 ptr = timeBoundsPtr + 1; ptr != curPtr + 1; ++ptr)
+	{
+		CARingBuffer::TimeBounds* bounds = mTimeBoundsQueue + (ptr & kGeneralRingTimeBoundsQueueMask);
+		
+		UInt32 counterBefore = bounds->mUpdateCounter.load(std::memory_order_acquire);
+		SampleTime startTime = bounds->mStartTime.load(std::memory_order_relaxed);
+		SampleTime endTime = bounds->mEndTime.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		UInt32 counterAfter = bounds->mUpdateCounter.load(std::memory_order_relaxed);
+		
+		if (counterBefore != ptr || counterAfter != ptr)
+			return kCARingBufferError_CPUOverload;	// reused while we were checking it
+		if (startTime > startRead || endTime < endRead)
+			return kCARingBufferError_CPUOverload;
+	}
+	return kCARingBufferError_OK;
+}
+
+CARingBufferError	CARingBuffer::ClipTimeBounds(SampleTime& startRead, SampleTime& endRead, SampleTime& silenceStartTime,
+												 SampleTime& holeStartTime, SampleTime& holeEndTime, UInt32& timeBoundsPtr)
 {
 	SampleTime startTime, endTime;
 	
-	CARingBufferError err = GetTimeBounds(startTime, endTime);
+	CARingBufferError err = GetTimeBounds(startTime, endTime, silenceStartTime, holeStartTime, holeEndTime, timeBoundsPtr);
 	if (err) return err;
 	
 	if (startRead > endTime || endRead < startTime) {
@@ -259,7 +527,8 @@ CARingBufferError	CARingBuffer::ClipTimeBounds(SampleTime& startRead, SampleTime
 	return kCARingBufferError_OK;	// success
 }
 
-CARingBufferError	CARingBuffer::Fetch(AudioBufferList *abl, UInt32 nFrames, SampleTime startRead)
+template <class Destination>
+CARingBufferError	CARingBuffer::FetchFrames(Destination &dest, UInt32 nFrames, SampleTime startRead)
 {
 	if (nFrames == 0)
 		return kCARingBufferError_OK;
@@ -271,11 +540,18 @@ CARingBufferError	CARingBuffer::Fetch(AudioBufferList *abl, UInt32 nFrames, Samp
 	SampleTime startRead0 = startRead;
 	SampleTime endRead0 = endRead;
 
-	CARingBufferError err = ClipTimeBounds(startRead, endRead);
+	SampleTime silenceStartTime, holeStartTime, holeEndTime;
+	UInt32 timeBoundsPtr;
+	CARingBufferError err = ClipTimeBounds(startRead, endRead, silenceStartTime, holeStartTime, holeEndTime, timeBoundsPtr);
 	if (err) return err;
+	
+	// Only copy the frames before the silent ones. The silent ones are zeroed with the frames after
+	// the end of the buffer.
+	SampleTime endValid = endRead;
+	endRead = std::max(startRead, std::min(endRead, silenceStartTime));
 
 	if (startRead == endRead) {
-		ZeroABL(abl, 0, nFrames * mBytesPerFrame);
+		dest.Zero(0, nFrames * mBytesPerFrame);
 		return kCARingBufferError_OK;
 	}
 	
@@ -284,12 +560,12 @@ CARingBufferError	CARingBuffer::Fetch(AudioBufferList *abl, UInt32 nFrames, Samp
 	SInt32 destStartByteOffset = std::max((SInt32)0, (SInt32)((startRead - startRead0) * mBytesPerFrame)); 
 		
 	if (destStartByteOffset > 0) {
-		ZeroABL(abl, 0, std::min((SInt32)(nFrames * mBytesPerFrame), destStartByteOffset));
+		dest.Zero(0, std::min((SInt32)(nFrames * mBytesPerFrame), destStartByteOffset));
 	}
 
 	SInt32 destEndSize = std::max((SInt32)0, (SInt32)(endRead0 - endRead)); 
 	if (destEndSize > 0) {
-		ZeroABL(abl, destStartByteOffset + byteSize, destEndSize * mBytesPerFrame);
+		dest.Zero(destStartByteOffset + byteSize, destEndSize * mBytesPerFrame);
 	}
 	
 	Byte **buffers = mBuffers;
@@ -299,21 +575,107 @@ CARingBufferError	CARingBuffer::Fetch(AudioBufferList *abl, UInt32 nFrames, Samp
 	
 	if (offset0 < offset1) {
 		nbytes = offset1 - offset0;
-		FetchABL(abl, destStartByteOffset, buffers, offset0, nbytes);
+		dest.Copy(destStartByteOffset, buffers, offset0, nbytes);
 	} else {
 		nbytes = mCapacityBytes - offset0;
-		FetchABL(abl, destStartByteOffset, buffers, offset0, nbytes);
-		FetchABL(abl, destStartByteOffset + nbytes, buffers, 0, offset1);
+		dest.Copy(destStartByteOffset, buffers, offset0, nbytes);
+		dest.Copy(destStartByteOffset + nbytes, buffers, 0, offset1);
 		nbytes += offset1;
 	}
 
-	int nchannels = abl->mNumberBuffers;
-	AudioBuffer *dest = abl->mBuffers;
-	while (--nchannels >= 0)
-	{
-		dest->mDataByteSize = nbytes;
-		dest++;
+	// The writer may have overwritten some of the range while we were copying it. If so, the data
+	// is torn and the caller has to treat this as a dropout.
+	err = CheckReadAfterCopy(startRead, endRead, timeBoundsPtr);
+	if (err) {
+		dest.Zero(0, nFrames * mBytesPerFrame);
+		return err;
+	}
+
+	// The hole's bytes are stale, so replace whatever was copied from it.
+	SampleTime holeStartRead = std::max(startRead, holeStartTime);
+	SampleTime holeEndRead = std::min(endRead, holeEndTime);
+	if (holeStartRead < holeEndRead) {
+		dest.Zero(destStartByteOffset + (int)((holeStartRead - startRead) * mBytesPerFrame),
+				  (int)((holeEndRead - holeStartRead) * mBytesPerFrame));
 	}
 
+	nbytes = (int)((endValid - startRead) * mBytesPerFrame);
+	dest.SetByteSize(nbytes);
+
 	return noErr;
 }
+
+CARingBufferError	CARingBuffer::Fetch(AudioBufferList *abl, UInt32 nFrames, SampleTime startRead)
+{
+	ABLDestination dest = { abl };
+	return FetchFrames(dest, nFrames, startRead);
+}
+
+CARingBufferError	CARingBuffer::FetchInterleaved(void *frames, UInt32 nFrames, SampleTime startRead)
+{
+	InterleavedDestination dest = { (Byte *)frames, mBuffers };
+	return FetchFrames(dest, nFrames, startRead);
+}
+
+CARingBufferError	CARingBuffer::BeginRead(UInt32 nFrames, SampleTime startRead, Regions &regions)
+{
+	regions = Regions();
+	
+	startRead = std::max(0LL, startRead);
+	
+	SampleTime endRead = startRead + nFrames;
+	SampleTime startRead0 = startRead;
+	SampleTime endRead0 = endRead;
+	
+	SampleTime silenceStartTime, holeStartTime, holeEndTime;
+	UInt32 timeBoundsPtr;
+	CARingBufferError err = ClipTimeBounds(startRead, endRead, silenceStartTime, holeStartTime, holeEndTime, timeBoundsPtr);
+	if (err) return err;
+	
+	// Like Fetch, the silent frames are left out along with the ones after the end of the buffer.
+	endRead = std::max(startRead, std::min(endRead, silenceStartTime));
+	
+	if (startRead == endRead) {
+		regions.startTime = regions.endTime = startRead0;
+		regions.leadingFrames = nFrames;
+		return kCARingBufferError_OK;
+	}
+	
+	// Fetch would zero the hole's stale bytes in its copy, which can't be done in place.
+	if (std::max(startRead, holeStartTime) < std::min(endRead, holeEndTime))
+		return kCARingBufferError_Discontiguous;
+	
+	regions.startTime = startRead;
+	regions.endTime = endRead;
+	regions.leadingFrames = (UInt32)(startRead - startRead0);
+	regions.trailingFrames = (UInt32)(endRead0 - endRead);
+	regions.timeBoundsPtr = timeBoundsPtr;
+	SetRegions(startRead, endRead, regions);
+	
+	return kCARingBufferError_OK;
+}
+
+CARingBufferError	CARingBuffer::EndRead(const Regions &regions)
+{
+	if (regions.nFrames[0] == 0)
+		return kCARingBufferError_OK;
+	
+	// Same as the check at the end of Fetch.
+	return CheckReadAfterCopy(regions.startTime, regions.endTime, regions.timeBoundsPtr);
+}
+
+bool	CARingBuffer::IsSilent(UInt32 nFrames, SampleTime startRead)
+{
+	SampleTime startTime, endTime, silenceStartTime, holeStartTime, holeEndTime;
+	if (GetTimeBounds(startTime, endTime, silenceStartTime, holeStartTime, holeEndTime))
+		return false;
+	
+	startRead = std::max(0LL, startRead);
+	SampleTime endRead = startRead + nFrames;
+	
+	// Fetch only reads the buffers for the frames in [startTime, silenceStartTime) and zeroes the
+	// ones in the hole afterwards.
+	SampleTime startValid = std::max(startRead, startTime);
+	SampleTime endValid = std::min(endRead, silenceStartTime);
+	return startValid >= endValid || (holeStartTime <= startValid && holeEndTime >= endValid);
+}
@@ -10,7 +10,8 @@
 enum {
 	kCARingBufferError_OK = 0,
 	kCARingBufferError_TooMuch = 3, // fetch start time is earlier than buffer start time and fetch end time is later than buffer end time
-	kCARingBufferError_CPUOverload = 4 // the reader is unable to get enough CPU cycles to capture a consistent snapshot of the time bounds
+	kCARingBufferError_CPUOverload = 4, // the reader is unable to get enough CPU cycles to capture a consistent snapshot of the time bounds
+	kCARingBufferError_Discontiguous = 5 // BeginRead's frames include the buffer's hole, which can only be read with Fetch
 };
 
 typedef SInt32 CARingBufferError;
@@ -18,6 +19,9 @@ typedef SInt32 CARingBufferError;
 const UInt32 kGeneralRingTimeBoundsQueueSize = 32;
 const UInt32 kGeneralRingTimeBoundsQueueMask = kGeneralRingTimeBoundsQueueSize - 1;
 
+// A cache line, which is also enough for any SIMD load.
+const size_t kCARingBufferAlignment = 64;
+
 class CARingBuffer {
 public:
 	typedef SInt64 SampleTime;
@@ -26,34 +30,151 @@ public:
 	~CARingBuffer();
 	
 	void					Allocate(int nChannels, UInt32 bytesPerFrame, UInt32 capacityFrames);
-								// capacityFrames will be rounded up to a power of 2
+								// capacityFrames will be rounded up to a power of 2. Each channel's
+								// buffer is aligned to kCARingBufferAlignment bytes. The allocation
+								// is page-aligned, and every page is touched before this returns.
 	void					Deallocate();
+	bool					SetWired(bool wired);
+								// Lock the buffer's pages in memory (mlock), so storing and fetching
+								// never page faults, even after the system has been under memory
+								// pressure. Kept across Allocate calls. Returns false if the pages
+								// couldn't be locked, in which case the buffer isn't wired.
+	bool					IsWired() const { return mBuffers ? mIsWired : mWantsWired; }
+								// Before the buffer is allocated, whether it will be wired.
+	void					Clear();
+								// Empty the buffer without reallocating it. Must not be called
+								// while another thread is storing.
 	
-	CARingBufferError	Store(const AudioBufferList *abl, UInt32 nFrames, SampleTime frameNumber);
+	CARingBufferError	Store(const AudioBufferList *abl, UInt32 nFrames, SampleTime frameNumber, UInt32 *outGapFrames = NULL);
 							// Copy nFrames of data into the ring buffer at the specified sample time.
 							// The sample time should normally increase sequentially, though gaps
-							// are filled with zeroes. A sufficiently large gap effectively empties
-							// the buffer before storing the new data. 
+							// read as zeroes. A sufficiently large gap effectively empties
+							// the buffer before storing the new data. Gaps aren't written to the
+							// buffers; they're recorded as the buffer's hole in the time bounds
+							// and Fetch zero-fills them. There's only one hole, so if the previous
+							// one is still in the buffer, the shorter of the two is zeroed.
 							
 							// If frameNumber is less than the previous frame number, the behavior is undefined.
 							
 							// Return false for failure (buffer not large enough).
+							
+							// If outGapFrames is non-null, it's set to the number of frames that were
+							// zero-filled to cover a gap before frameNumber.
 				
+	typedef void			(*StoreFunction)(void *context, int channel, Byte *dest, UInt32 srcFrameOffset, UInt32 nFrames);
+	CARingBufferError	Store(StoreFunction storeFunction, void *context, UInt32 nFrames, SampleTime frameNumber, UInt32 *outGapFrames = NULL);
+							// Like Store, but storeFunction writes the frames. It's called with each
+							// range of the buffer to fill, at most twice per channel since the range
+							// can wrap around the end, and the offset of that range's first frame in
+							// the caller's data. This lets the caller transform the data as it's
+							// copied in, e.g. by applying gain, rather than in a separate pass. It
+							// must write exactly nFrames * bytesPerFrame bytes to dest.
+	
+	CARingBufferError	StoreInterleaved(const void *frames, UInt32 nFrames, SampleTime frameNumber, UInt32 *outGapFrames = NULL);
+							// Like Store, for a buffer allocated with one channel, from nFrames
+							// contiguous frames. The copies are memcpys of whole ranges, with no
+							// AudioBufferList to build or check.
+	
+	CARingBufferError	StoreSilence(UInt32 nFrames, SampleTime frameNumber, UInt32 *outGapFrames = NULL);
+							// Like Store, but for nFrames of silence. Nothing is written to the
+							// buffers. The frames are marked silent in the time bounds instead and
+							// Fetch zero-fills them. A gap before frameNumber is marked silent too.
+							// If a Store follows, the silent frames become the buffer's hole (see
+							// Store), so a long run of silence usually costs nothing.
+	
 	CARingBufferError	Fetch(AudioBufferList *abl, UInt32 nFrames, SampleTime frameNumber);
 								// will alter mDataByteSize of the buffers
 	
+	CARingBufferError	FetchInterleaved(void *frames, UInt32 nFrames, SampleTime frameNumber);
+								// Like Fetch, for a buffer allocated with one channel. frames must
+								// have room for nFrames frames, all of which are written.
+	
+	bool				IsSilent(UInt32 nFrames, SampleTime frameNumber);
+							// True if Fetch would only output silence for these frames without
+							// reading the buffers, because each frame is either silent (see
+							// StoreSilence) or not in the buffer. Lets the caller skip work it would
+							// do on the fetched frames. Returns false if the bounds couldn't be read.
+	
+							// Store and Fetch never take a lock. One thread may Store while any
+							// number of others Fetch; the time bounds are published with
+							// release/acquire ordering and a Fetch that races with a Store
+							// overwriting the frames it copied returns kCARingBufferError_CPUOverload.
+	
+	// The one or two ranges of the buffer that hold a span of frames, for reading or writing them in
+	// place without copying them through an AudioBufferList. The second range is the part that
+	// wrapped around to the start of the buffer, if any. The ranges are at the same offsets in each
+	// channel's buffer.
+	struct Regions {
+		SampleTime	startTime;			// of the first frame in the ranges
+		SampleTime	endTime;
+		UInt32		leadingFrames;		// BeginRead only: silent frames before the ranges
+		UInt32		trailingFrames;		// BeginRead only: silent frames after the ranges
+		UInt32		offset[2];			// in bytes
+		UInt32		nFrames[2];
+		UInt32		timeBoundsPtr;		// BeginRead only: the time bounds the ranges were found from
+	};
+	
+	Byte *				RegionData(const Regions &regions, int region, int channel) { return mBuffers[channel] + regions.offset[region]; }
+	
+	CARingBufferError	BeginWrite(UInt32 nFrames, SampleTime frameNumber, Regions &regions, UInt32 *outGapFrames = NULL);
+							// Start a Store that the caller does itself: handle the gap and move the
+							// start time like Store, then return the ranges to write the frames to.
+							// Every byte of the ranges must be written before EndWrite, which
+							// publishes the new end time. Only one write can be in progress.
+	void				EndWrite(const Regions &regions);
+	
+	CARingBufferError	BeginRead(UInt32 nFrames, SampleTime frameNumber, Regions &regions);
+							// Like Fetch, but returns where the frames are instead of copying them.
+							// The frames before and after the ranges (see leadingFrames and
+							// trailingFrames) are silent or not in the buffer and read as zeroes.
+							// Returns kCARingBufferError_Discontiguous if the frames include the
+							// hole, in which case the caller has to Fetch them.
+	CARingBufferError	EndRead(const Regions &regions);
+							// Must be called after reading the ranges, before using what was read.
+							// Returns kCARingBufferError_CPUOverload if a Store overwrote any of
+							// the frames in the meantime, in which case they have to be discarded.
+	
 	CARingBufferError	GetTimeBounds(SampleTime &startTime, SampleTime &endTime);
+	CARingBufferError	GetTimeBounds(SampleTime &startTime, SampleTime &endTime, SampleTime &silenceStartTime);
+							// The frames in [silenceStartTime, endTime) are silent.
+	CARingBufferError	GetTimeBounds(SampleTime &startTime, SampleTime &endTime, SampleTime &silenceStartTime,
+									  SampleTime &holeStartTime, SampleTime &holeEndTime);
+							// The frames in [holeStartTime, holeEndTime) are silent too. The hole
+							// can start before startTime.
 	
 protected:
 
 	UInt32					FrameOffset(SampleTime frameNumber) { return (frameNumber & mCapacityFramesMask) * mBytesPerFrame; }
+	static UInt32			RoundUpToAlignment(size_t inBytes) { return (UInt32)((inBytes + kCARingBufferAlignment - 1) & ~(size_t)(kCARingBufferAlignment - 1)); }
 
-	CARingBufferError		ClipTimeBounds(SampleTime& startRead, SampleTime& endRead);
+	CARingBufferError		GetTimeBounds(SampleTime &startTime, SampleTime &endTime, SampleTime &silenceStartTime,
+										  SampleTime &holeStartTime, SampleTime &holeEndTime, UInt32 &timeBoundsPtr);
+	CARingBufferError		ClipTimeBounds(SampleTime& startRead, SampleTime& endRead, SampleTime& silenceStartTime,
+										   SampleTime& holeStartTime, SampleTime& holeEndTime, UInt32& timeBoundsPtr);
+	CARingBufferError		CheckReadAfterCopy(SampleTime startRead, SampleTime endRead, UInt32 timeBoundsPtr);
+							// Returns kCARingBufferError_CPUOverload if any of the time bounds
+							// published after timeBoundsPtr's could mean a Store changed frames in
+							// [startRead, endRead), or if there were too many to check.
+	
+	// The implementations of the Store and Fetch variants. Each variant's copy is a template
+	// parameter rather than a function pointer, so it's inlined into the loops.
+	template <class StoreRange>
+	CARingBufferError		StoreFrames(const StoreRange &storeRange, UInt32 nFrames, SampleTime frameNumber, UInt32 *outGapFrames);
+	struct ABLDestination;
+	struct InterleavedDestination;
+	template <class Destination>
+	CARingBufferError		FetchFrames(Destination &dest, UInt32 nFrames, SampleTime frameNumber);
+	void					ZeroFrames(SampleTime startTime, SampleTime endTime);
+	void					SetRegions(SampleTime startTime, SampleTime endTime, Regions &regions);
 	
 	// these should only be called from Store.
-	SampleTime				StartTime() const { return mTimeBoundsQueue[mTimeBoundsQueuePtr & kGeneralRingTimeBoundsQueueMask].mStartTime; }
-	SampleTime				EndTime()   const { return mTimeBoundsQueue[mTimeBoundsQueuePtr & kGeneralRingTimeBoundsQueueMask].mEndTime; }
-	void					SetTimeBounds(SampleTime startTime, SampleTime endTime);
+	SampleTime				StartTime() const { return mTimeBoundsQueue[mTimeBoundsQueuePtr.load(std::memory_order_relaxed) & kGeneralRingTimeBoundsQueueMask].mStartTime.load(std::memory_order_relaxed); }
+	SampleTime				EndTime()   const { return mTimeBoundsQueue[mTimeBoundsQueuePtr.load(std::memory_order_relaxed) & kGeneralRingTimeBoundsQueueMask].mEndTime.load(std::memory_order_relaxed); }
+	SampleTime				SilenceStartTime() const { return mTimeBoundsQueue[mTimeBoundsQueuePtr.load(std::memory_order_relaxed) & kGeneralRingTimeBoundsQueueMask].mSilenceStartTime.load(std::memory_order_relaxed); }
+	SampleTime				HoleStartTime() const { return mTimeBoundsQueue[mTimeBoundsQueuePtr.load(std::memory_order_relaxed) & kGeneralRingTimeBoundsQueueMask].mHoleStartTime.load(std::memory_order_relaxed); }
+	SampleTime				HoleEndTime() const { return mTimeBoundsQueue[mTimeBoundsQueuePtr.load(std::memory_order_relaxed) & kGeneralRingTimeBoundsQueueMask].mHoleEndTime.load(std::memory_order_relaxed); }
+	void					SetTimeBounds(SampleTime startTime, SampleTime endTime, SampleTime silenceStartTime,
+										  SampleTime holeStartTime, SampleTime holeEndTime);
 	
 protected:
 	Byte **					mBuffers;				// allocated in one chunk of memory
@@ -62,15 +183,35 @@ protected:
 	UInt32					mCapacityFrames;		// per channel, must be a power of 2
 	UInt32					mCapacityFramesMask;
 	UInt32					mCapacityBytes;			// per channel
+	size_t					mAllocationSize;		// the whole chunk, a multiple of the page size
+	bool					mWantsWired;
+	bool					mIsWired;
 	
 	// range of valid sample time in the buffer
-	typedef struct {
-		volatile SampleTime		mStartTime;
-		volatile SampleTime		mEndTime;
-		volatile UInt32			mUpdateCounter;
-	} TimeBounds;
+	//
+	// Each entry is a small seqlock: the writer invalidates mUpdateCounter, writes the bounds, then
+	// publishes the counter with release ordering. A reader only accepts the bounds if it sees the
+	// same counter before and after reading them.
+	//
+	// The frames in [mSilenceStartTime, mEndTime) are silent and haven't been written to the
+	// buffers, so their bytes are stale. StartTime() <= SilenceStartTime() <= EndTime().
+	//
+	// The frames in [mHoleStartTime, mHoleEndTime) are a gap Store skipped over, which is stale in
+	// the same way. The hole is always before SilenceStartTime() and is empty if the two are equal.
+	struct TimeBounds {
+		std::atomic<SampleTime>	mStartTime;
+		std::atomic<SampleTime>	mEndTime;
+		std::atomic<SampleTime>	mSilenceStartTime;
+		std::atomic<SampleTime>	mHoleStartTime;
+		std::atomic<SampleTime>	mHoleEndTime;
+		std::atomic<UInt32>		mUpdateCounter;
+	};
 	
 	CARingBuffer::TimeBounds mTimeBoundsQueue[kGeneralRingTimeBoundsQueueSize];
+	
+	// The hole BeginWrite has worked out for EndWrite to publish. Only used by the writer.
+	SampleTime				mWriteHoleStartTime;
+	SampleTime				mWriteHoleEndTime;
 	std::atomic<UInt32> mTimeBoundsQueuePtr;
 };
 
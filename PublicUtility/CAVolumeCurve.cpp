@@ -51,6 +51,7 @@
 #include "CAVolumeCurve.h"
 #include "CADebugMacros.h"
 #include <math.h>
+#include <algorithm>
 
 //=============================================================================
 //	CAVolumeCurve
@@ -63,7 +64,11 @@ CAVolumeCurve::CAVolumeCurve()
 	mIsApplyingTransferFunction(true),
 	mTransferFunction(kPow2Over1Curve),
 	mRawToScalarExponentNumerator(2.0f),
-	mRawToScalarExponentDenominator(1.0f)
+	mRawToScalarExponentDenominator(1.0f),
+	mTableMinimumRaw(0),
+	mRawToScalarTable(),
+	mRawToDBTable(),
+	mScalarToRawThresholds()
 {
 }
 
@@ -234,6 +239,8 @@ void	CAVolumeCurve::SetTransferFunction(UInt32 inTransferFunction)
 			mRawToScalarExponentDenominator = 1.0f;
 			break;
 	};
+	
+	UpdateTables();
 }
 
 void	CAVolumeCurve::AddRange(SInt32 inMinRaw, SInt32 inMaxRaw, Float32 inMinDB, Float32 inMaxDB)
@@ -258,6 +265,7 @@ void	CAVolumeCurve::AddRange(SInt32 inMinRaw, SInt32 inMaxRaw, Float32 inMinDB,
 	if(!isOverlapped)
 	{
 		mCurveMap.insert(CurveMap::value_type(theRaw, theDB));
+		UpdateTables();
 	}
 	else
 	{
@@ -268,6 +276,7 @@ void	CAVolumeCurve::AddRange(SInt32 inMinRaw, SInt32 inMaxRaw, Float32 inMinDB,
 void	CAVolumeCurve::ResetRange()
 {
 	mCurveMap.clear();
+	UpdateTables();
 }
 
 bool	CAVolumeCurve::CheckForContinuity() const
@@ -364,6 +373,12 @@ SInt32	CAVolumeCurve::ConvertDBToRaw(Float32 inDB) const
 
 Float32	CAVolumeCurve::ConvertRawToDB(SInt32 inRaw) const
 {
+	if(!mRawToDBTable.empty())
+	{
+		SInt32 theIndex = std::min(std::max(inRaw - mTableMinimumRaw, 0), static_cast<SInt32>(mRawToDBTable.size() - 1));
+		return mRawToDBTable[static_cast<size_t>(theIndex)];
+	}
+	
 	Float32 theAnswer = 0;
 	
 	//	clamp the raw value
@@ -414,6 +429,12 @@ Float32	CAVolumeCurve::ConvertRawToDB(SInt32 inRaw) const
 
 Float32	CAVolumeCurve::ConvertRawToScalar(SInt32 inRaw) const
 {
+	if(!mRawToScalarTable.empty())
+	{
+		SInt32 theIndex = std::min(std::max(inRaw - mTableMinimumRaw, 0), static_cast<SInt32>(mRawToScalarTable.size() - 1));
+		return mRawToScalarTable[static_cast<size_t>(theIndex)];
+	}
+	
 	//	get some important values
 	Float32	theDBMin = GetMinimumDB();
 	Float32	theDBMax = GetMaximumDB();
@@ -450,6 +471,13 @@ SInt32	CAVolumeCurve::ConvertScalarToRaw(Float32 inScalar) const
 	//	range the scalar value
 	inScalar = std::min(1.0f, std::max(0.0f, inScalar));
 	
+	if(!mScalarToRawThresholds.empty())
+	{
+		//	the number of thresholds at or below inScalar is the number of raw steps
+		std::vector<Float32>::const_iterator theThreshold = std::upper_bound(mScalarToRawThresholds.begin(), mScalarToRawThresholds.end(), inScalar);
+		return mTableMinimumRaw + static_cast<SInt32>(theThreshold - mScalarToRawThresholds.begin());
+	}
+	
 	//	get some important values
 	Float32	theDBMin = GetMinimumDB();
 	Float32	theDBMax = GetMaximumDB();
@@ -480,3 +508,51 @@ Float32	CAVolumeCurve::ConvertScalarToDB(Float32 inScalar) const
 	Float32 theAnswer = ConvertRawToDB(theRawValue);
 	return theAnswer;
 }
+
+void	CAVolumeCurve::UpdateTables()
+{
+	//	throw out the old tables first, so the conversions below don't use them
+	mRawToScalarTable.clear();
+	mRawToDBTable.clear();
+	mScalarToRawThresholds.clear();
+	
+	if(mCurveMap.empty())
+	{
+		return;
+	}
+	
+	SInt32 theRawMin = GetMinimumRaw();
+	SInt32 theRawRange = GetMaximumRaw() - theRawMin;
+	if((theRawRange <= 0) || (theRawRange >= kMaximumTableSize))
+	{
+		return;
+	}
+	
+	std::vector<Float32> theRawToScalarTable(static_cast<size_t>(theRawRange) + 1);
+	std::vector<Float32> theRawToDBTable(static_cast<size_t>(theRawRange) + 1);
+	for(SInt32 theStep = 0; theStep <= theRawRange; ++theStep)
+	{
+		theRawToScalarTable[static_cast<size_t>(theStep)] = ConvertRawToScalar(theRawMin + theStep);
+		theRawToDBTable[static_cast<size_t>(theStep)] = ConvertRawToDB(theRawMin + theStep);
+	}
+	
+	//	ConvertScalarToRaw rounds to the nearest raw step after undoing the curve, so the threshold
+	//	for each step is the point half way to it with the curve applied. Without a curve it's just a
+	//	multiply, which doesn't need a table.
+	std::vector<Float32> theScalarToRawThresholds;
+	if(mIsApplyingTransferFunction && ((GetMaximumDB() - GetMinimumDB()) > 30.0f))
+	{
+		Float32 theExponent = mRawToScalarExponentNumerator / mRawToScalarExponentDenominator;
+		theScalarToRawThresholds.resize(static_cast<size_t>(theRawRange));
+		for(SInt32 theStep = 0; theStep < theRawRange; ++theStep)
+		{
+			Float32 theThreshold = (static_cast<Float32>(theStep) + 0.5f) / static_cast<Float32>(theRawRange);
+			theScalarToRawThresholds[static_cast<size_t>(theStep)] = powf(theThreshold, theExponent);
+		}
+	}
+	
+	mTableMinimumRaw = theRawMin;
+	mRawToScalarTable.swap(theRawToScalarTable);
+	mRawToDBTable.swap(theRawToDBTable);
+	mScalarToRawThresholds.swap(theScalarToRawThresholds);
+}
@@ -57,6 +57,7 @@
 	#include <CoreAudioTypes.h>
 #endif
 #include <map>
+#include <vector>
 
 //=============================================================================
 //	Types
@@ -145,7 +146,7 @@ public:
 	Float32			GetMinimumDB() const;
 	Float32			GetMaximumDB() const;
 	
-	void			SetIsApplyingTransferFunction(bool inIsApplyingTransferFunction)  { mIsApplyingTransferFunction = inIsApplyingTransferFunction; }
+	void			SetIsApplyingTransferFunction(bool inIsApplyingTransferFunction)  { mIsApplyingTransferFunction = inIsApplyingTransferFunction; UpdateTables(); }
 	UInt32			GetTransferFunction() const { return mTransferFunction; }
 	void			SetTransferFunction(UInt32 inTransferFunction);
 
@@ -164,6 +165,13 @@ public:
 
 //	Implementation
 private:
+	//	The conversions from raw values are looked up in tables, which are rebuilt whenever the curve
+	//	changes, so they don't have to walk the curve map or call powf. Curves with more raw steps
+	//	than this are converted without them.
+	enum			{ kMaximumTableSize = 4096 };
+	
+	void			UpdateTables();
+	
 	typedef	std::map<CARawPoint, CADBPoint>	CurveMap;
 	
 	UInt32			mTag;
@@ -172,6 +180,15 @@ private:
 	UInt32			mTransferFunction;
 	Float32			mRawToScalarExponentNumerator;
 	Float32			mRawToScalarExponentDenominator;
+	
+	//	indexed by the raw value minus mTableMinimumRaw
+	SInt32					mTableMinimumRaw;
+	std::vector<Float32>	mRawToScalarTable;
+	std::vector<Float32>	mRawToDBTable;
+	//	mScalarToRawThresholds[i] is the smallest scalar value that converts to a raw value greater than
+	//	mTableMinimumRaw + i, so it's sorted and a binary search finds the raw value for a scalar value.
+	//	Empty if the curve isn't applied.
+	std::vector<Float32>	mScalarToRawThresholds;
 
 };
 
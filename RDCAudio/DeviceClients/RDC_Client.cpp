@@ -46,5 +46,10 @@ void    RDC_Client::Copy(const RDC_Client& inClient)
     mBundleID = inClient.mBundleID;
     mIsNativeEndian = inClient.mIsNativeEndian;
     mDoingIO = inClient.mDoingIO;
+    mRelativeVolume = inClient.mRelativeVolume;
+    mPanPosition = inClient.mPanPosition;
+    mReadDelayFrames = inClient.mReadDelayFrames;
+    mBundleIDIndex = inClient.mBundleIDIndex;
+    mIOStateSlot = inClient.mIOStateSlot;
 }
 
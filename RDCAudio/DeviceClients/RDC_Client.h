@@ -64,6 +64,63 @@ public:
     // kAudioServerPlugInIOOperationThread, and false again on StopIO or when
     // kAudioServerPlugInIOOperationThread ends
     bool                          mDoingIO = false;
+
+    // The gain to apply to the client's audio, relative to other clients. RDC_Clients converts
+    // kRDCAppVolumesKey_RelativeVolume values to this with its volume curve. 1.0 is unchanged.
+    Float32                       mRelativeVolume = 1.0f;
+    // The client's kRDCAppVolumesKey_PanPosition. 0 is centred.
+    SInt32                        mPanPosition = 0;
+
+    // How many frames behind the HAL's sample time the client reads the input stream. See
+    // kAudioDeviceCustomPropertyReadDelays.
+    UInt32                        mReadDelayFrames = 0;
+
+    // A number RDC_ClientMap assigns to each bundle ID it sees, so clients can be matched by bundle
+    // ID without comparing CFStrings. kRDCNoBundleIDIndex if the client has no bundle ID.
+    UInt32                        mBundleIDIndex = 0;
+
+    // The client's entry in RDC_ClientMap's table of requested IO states, which real-time threads
+    // use to tell when the client starts or stops IO. kRDCNoIOStateSlot if the table was full.
+    UInt32                        mIOStateSlot = UINT32_MAX;
+};
+
+static const UInt32 kRDCNoBundleIDIndex = 0;
+static const UInt32 kRDCNoIOStateSlot = UINT32_MAX;
+// The number of IO state slots, so tables indexed by RDC_Client::mIOStateSlot can be sized.
+static const UInt32 kRDCIOStateSlotCount = 256;
+
+//==================================================================================================
+//	RDC_ClientRecord
+//
+//  The parts of an RDC_Client that real-time threads use. It holds no CF objects, so copying one is
+//  just copying its bytes, and it fits in a fraction of a cache line.
+//==================================================================================================
+
+struct RDC_ClientRecord
+{
+                                  RDC_ClientRecord() = default;
+                                  RDC_ClientRecord(const RDC_Client& inClient)
+                                  :
+                                      mClientID(inClient.mClientID),
+                                      mProcessID(inClient.mProcessID),
+                                      mBundleIDIndex(inClient.mBundleIDIndex),
+                                      mRelativeVolume(inClient.mRelativeVolume),
+                                      mPanPosition(inClient.mPanPosition),
+                                      mReadDelayFrames(inClient.mReadDelayFrames),
+                                      mIsNativeEndian(inClient.mIsNativeEndian),
+                                      mDoingIO(inClient.mDoingIO),
+                                      mIOStateSlot(inClient.mIOStateSlot)
+                                  { }
+
+    UInt32                        mClientID = 0;
+    pid_t                         mProcessID = 0;
+    UInt32                        mBundleIDIndex = kRDCNoBundleIDIndex;
+    Float32                       mRelativeVolume = 1.0f;
+    SInt32                        mPanPosition = 0;
+    UInt32                        mReadDelayFrames = 0;
+    Boolean                       mIsNativeEndian = true;
+    bool                          mDoingIO = false;
+    UInt32                        mIOStateSlot = kRDCNoIOStateSlot;
 };
 
 #pragma clang assume_nonnull end
@@ -0,0 +1,270 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_ClientBuses.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_ClientBuses.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+#include "CACFArray.h"
+
+// STL Includes
+#include <algorithm>
+
+// System Includes
+#include <Accelerate/Accelerate.h>
+
+
+#pragma clang assume_nonnull begin
+
+RDC_ClientBuses::RDC_ClientBuses()
+{
+    for(UInt32 i = 0; i < kMaxRoutes; i++)
+    {
+        mRoutes[i].store(kNoRoute, std::memory_order_relaxed);
+    }
+}
+
+void    RDC_ClientBuses::SetBusBundleIDs(const std::vector<CACFString>& inBundleIDs,
+                                         UInt32 inChannelCount,
+                                         UInt32 inFrameSize)
+{
+    ThrowIf(inBundleIDs.size() > kRDCMaxClientBuses || inBundleIDs.size() * 2 > inChannelCount,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_ClientBuses::SetBusBundleIDs: Too many buses");
+
+    CAMutex::Locker theLocker(mMutex);
+
+    mBundleIDs = inBundleIDs;
+
+    Reallocate(inChannelCount, inFrameSize);
+}
+
+void    RDC_ClientBuses::Reallocate(UInt32 inChannelCount, UInt32 inFrameSize)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    if(mBundleIDs.size() * 2 > inChannelCount)
+    {
+        DebugMsg("RDC_ClientBuses::Reallocate: Dropping %zu buses that don't fit in %u channels",
+                 mBundleIDs.size() - inChannelCount / 2,
+                 inChannelCount);
+        mBundleIDs.resize(inChannelCount / 2);
+    }
+
+    mChannelCount = inChannelCount;
+    mNumberOfBuses = static_cast<UInt32>(mBundleIDs.size());
+    mMixBus = -1;
+
+    for(UInt32 i = 0; i < mNumberOfBuses; i++)
+    {
+        if(CFStringGetLength(mBundleIDs[i].GetCFString()) == 0)
+        {
+            mMixBus = static_cast<SInt32>(i);
+        }
+    }
+
+    if(mNumberOfBuses > 0)
+    {
+        mRingBuffer.Allocate(1, inChannelCount * sizeof(Float32), inFrameSize);
+        mCycleBuffer.assign(static_cast<size_t>(kMaxCycleFrameSize) * inChannelCount, 0.0f);
+    }
+    else
+    {
+        mRingBuffer.Deallocate();
+        std::vector<Float32>().swap(mCycleBuffer);
+    }
+
+    mCycleSampleTime = -1;
+
+    AssignClientsToBuses();
+}
+
+void    RDC_ClientBuses::Clear()
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    if(mNumberOfBuses > 0)
+    {
+        mRingBuffer.Clear();
+    }
+
+    mCycleSampleTime = -1;
+}
+
+CFArrayRef  RDC_ClientBuses::CopyBusBundleIDs() const
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    CACFArray theBundleIDs(static_cast<UInt32>(mBundleIDs.size()), true);
+
+    for(const CACFString& theBundleID : mBundleIDs)
+    {
+        theBundleIDs.AppendString(theBundleID.GetCFString());
+    }
+
+    return theBundleIDs.CopyCFArray();
+}
+
+void    RDC_ClientBuses::AddClient(UInt32 inClientID, CFStringRef __nullable inBundleID)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    // CACFString takes ownership when it's constructed from a CFStringRef, but assigning retains.
+    CACFString theBundleID;
+    if(inBundleID != nullptr)
+    {
+        theBundleID = inBundleID;
+    }
+
+    mClients[inClientID] = theBundleID;
+
+    AssignClientsToBuses();
+}
+
+void    RDC_ClientBuses::RemoveClient(UInt32 inClientID)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    mClients.erase(inClientID);
+
+    AssignClientsToBuses();
+}
+
+void    RDC_ClientBuses::MixClientRT(UInt32 inClientID,
+                                     const Float32* inFrames,
+                                     UInt32 inFrameSize,
+                                     CARingBuffer::SampleTime inSampleTime)
+{
+    if(mNumberOfBuses == 0 || inFrameSize > kMaxCycleFrameSize)
+    {
+        return;
+    }
+
+    // The routes aren't packed, since a route can be removed while we're reading them, so check
+    // all of them.
+    for(UInt32 i = 0; i < kMaxRoutes; i++)
+    {
+        UInt64 theRoute = mRoutes[i].load(std::memory_order_acquire);
+
+        if(theRoute != kNoRoute && static_cast<UInt32>(theRoute >> 32) == inClientID)
+        {
+            BeginCycleRT(inFrameSize, inSampleTime);
+            AddToBusRT(inFrames, inFrameSize, static_cast<UInt32>(theRoute & 0xFFFFFFFF));
+        }
+    }
+}
+
+void    RDC_ClientBuses::StoreRT(const Float32* inMix,
+                                 UInt32 inFrameSize,
+                                 CARingBuffer::SampleTime inSampleTime)
+{
+    if(mNumberOfBuses == 0)
+    {
+        return;
+    }
+
+    if(inFrameSize <= kMaxCycleFrameSize && mMixBus >= 0)
+    {
+        BeginCycleRT(inFrameSize, inSampleTime);
+        AddToBusRT(inMix, inFrameSize, static_cast<UInt32>(mMixBus));
+    }
+
+    // Like the taps, ignore errors here. A failed store just leaves a gap, which the reader will
+    // get as silence.
+    if(inFrameSize > kMaxCycleFrameSize || mCycleSampleTime != inSampleTime)
+    {
+        // Nothing was mixed, e.g. because none of the routed apps are playing.
+        mRingBuffer.StoreSilence(inFrameSize, inSampleTime);
+    }
+    else
+    {
+        mRingBuffer.StoreInterleaved(mCycleBuffer.data(), inFrameSize, inSampleTime);
+    }
+
+    mCycleSampleTime = -1;
+}
+
+void    RDC_ClientBuses::AssignClientsToBuses()
+{
+    UInt32 theNumberOfRoutes = 0;
+
+    for(const auto& theClient : mClients)
+    {
+        if(!theClient.second.IsValid())
+        {
+            continue;
+        }
+
+        for(UInt32 theBus = 0; theBus < mNumberOfBuses; theBus++)
+        {
+            if(static_cast<SInt32>(theBus) == mMixBus || theClient.second != mBundleIDs[theBus])
+            {
+                continue;
+            }
+
+            if(theNumberOfRoutes == kMaxRoutes)
+            {
+                DebugMsg("RDC_ClientBuses::AssignClientsToBuses: Too many clients to route client "
+                         "%u",
+                         theClient.first);
+                continue;
+            }
+
+            UInt64 theRoute = (static_cast<UInt64>(theClient.first) << 32) | theBus;
+            mRoutes[theNumberOfRoutes++].store(theRoute, std::memory_order_release);
+        }
+    }
+
+    for(UInt32 i = theNumberOfRoutes; i < kMaxRoutes; i++)
+    {
+        mRoutes[i].store(kNoRoute, std::memory_order_release);
+    }
+}
+
+void    RDC_ClientBuses::BeginCycleRT(UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime)
+{
+    if(mCycleSampleTime != inSampleTime)
+    {
+        vDSP_vclr(mCycleBuffer.data(), 1, static_cast<vDSP_Length>(inFrameSize) * mChannelCount);
+        mCycleSampleTime = inSampleTime;
+    }
+}
+
+void    RDC_ClientBuses::AddToBusRT(const Float32* inFrames, UInt32 inFrameSize, UInt32 inBus)
+{
+    Float32* theBus = mCycleBuffer.data() + 2 * inBus;
+
+    if(mChannelCount == 2)
+    {
+        // The bus is the whole frame, so add both channels in one contiguous pass.
+        vDSP_vadd(inFrames, 1, theBus, 1, theBus, 1, static_cast<vDSP_Length>(inFrameSize) * 2);
+    }
+    else
+    {
+        vDSP_Stride theStride = static_cast<vDSP_Stride>(mChannelCount);
+        vDSP_vadd(inFrames, theStride, theBus, theStride, theBus, theStride, inFrameSize);
+        vDSP_vadd(inFrames + 1, theStride, theBus + 1, theStride, theBus + 1, theStride, inFrameSize);
+    }
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,173 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_ClientBuses.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_ClientBuses__
+#define __RDCDriver__RDC_ClientBuses__
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CAMutex.h"
+#include "CACFString.h"
+#include "CARingBuffer.h"
+
+// STL Includes
+#include <atomic>
+#include <map>
+#include <vector>
+
+// System Includes
+#include <CoreAudio/AudioServerPlugIn.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_ClientBuses
+//
+//  Sub-mixes of the clients' output, each on its own stereo pair of a ring buffer as wide as the
+//  device. Each bus is assigned a bundle ID, or the mix of all clients, and the output of every
+//  client with that bundle ID is summed into it. See kAudioDeviceCustomPropertyBusBundleIDs.
+//
+//  The HAL calls ProcessOutput for each client and then WriteMix once per IO cycle, all on the
+//  output IO thread. MixClientRT sums the clients into a preallocated interleaved buffer for the
+//  cycle and StoreRT adds the mix and stores that buffer in the ring buffer, so there's one store
+//  per cycle however many clients are playing.
+//
+//  Like RDC_ClientTaps, the buffers are only allocated while IO is stopped and clients are matched
+//  to buses when they're added, so the IO thread only compares client IDs.
+//
+//  Methods whose names end with "RT" should only be called from real-time threads.
+//==================================================================================================
+
+class RDC_ClientBuses
+{
+
+public:
+                                        RDC_ClientBuses();
+                                        ~RDC_ClientBuses() = default;
+                                        // Disallow copying
+                                        RDC_ClientBuses(const RDC_ClientBuses&) = delete;
+                                        RDC_ClientBuses& operator=(const RDC_ClientBuses&) = delete;
+
+    /*!
+     Replace the bus assignments and allocate the buffers. Any audio already stored is dropped. Must
+     only be called while IO is stopped.
+
+     @param inBundleIDs The bundle ID for each bus, or the empty string for the mix. At most
+                        kRDCMaxClientBuses and at most inChannelCount / 2. An empty list disables
+                        the buses and frees the buffers.
+     @param inChannelCount The number of channels in the device's streams and the ring buffer.
+     @param inFrameSize The capacity of the ring buffer in frames.
+     */
+    void                                SetBusBundleIDs(const std::vector<CACFString>& inBundleIDs,
+                                                        UInt32 inChannelCount,
+                                                        UInt32 inFrameSize);
+    /*!
+     Reallocate the buffers for the current buses, e.g. after the device's format changes. Buses
+     that no longer fit in inChannelCount are dropped. Must only be called while IO is stopped.
+     */
+    void                                Reallocate(UInt32 inChannelCount, UInt32 inFrameSize);
+    /*!
+     Empty the ring buffer without reallocating it, e.g. after the sample rate changes. Must only be
+     called while IO is stopped.
+     */
+    void                                Clear();
+
+    /*! @return A new CFArray of the buses' bundle IDs. The caller is responsible for releasing it. */
+    CFArrayRef                          CopyBusBundleIDs() const;
+
+    /*! @return True if there are any buses. Only changes while IO is stopped. */
+    bool                                IsEnabledRT() const { return mNumberOfBuses > 0; }
+
+    void                                AddClient(UInt32 inClientID, CFStringRef __nullable inBundleID);
+    void                                RemoveClient(UInt32 inClientID);
+
+    /*!
+     Sum a client's output into its buses, if it has any. The first client mixed in a cycle clears
+     the cycle's buffer first.
+
+     @param inFrames Interleaved Float32 frames with the device's channel count. Only the first two
+                     channels are used.
+     */
+    void                                MixClientRT(UInt32 inClientID,
+                                                    const Float32* inFrames,
+                                                    UInt32 inFrameSize,
+                                                    CARingBuffer::SampleTime inSampleTime);
+    /*!
+     Add the mix to its bus, if it has one, and store the cycle's buffer in the ring buffer. If
+     nothing was mixed in this cycle, the ring buffer just records silence.
+
+     @param inMix The mix of all clients, in the same format as MixClientRT's frames.
+     */
+    void                                StoreRT(const Float32* inMix,
+                                                UInt32 inFrameSize,
+                                                CARingBuffer::SampleTime inSampleTime);
+
+    /*! @return The ring buffer the input stream reads while the buses are enabled. */
+    CARingBuffer&                       GetRingBufferRT() { return mRingBuffer; }
+
+private:
+    // Route each registered client to the buses for its bundle ID. mMutex must be held.
+    void                                AssignClientsToBuses();
+
+    // Clear the cycle's buffer if this is the first audio mixed in the cycle at inSampleTime.
+    void                                BeginCycleRT(UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime);
+    void                                AddToBusRT(const Float32* inFrames, UInt32 inFrameSize, UInt32 inBus);
+
+private:
+    // Sentinel for mRoutes.
+    static const UInt64                 kNoRoute = UINT64_MAX;
+    // The number of clients that can be routed to buses at once, counting a client once for each
+    // bus it's on.
+    static const UInt32                 kMaxRoutes = 32;
+    // The longest IO cycle the buses handle. Longer cycles are stored as silence.
+    static const UInt32                 kMaxCycleFrameSize = 8192;
+
+    // Guards mBundleIDs and mClients.
+    CAMutex                             mMutex { "Client buses" };
+
+    // The bundle ID for each bus. The empty string means the mix.
+    std::vector<CACFString>             mBundleIDs;
+    // The bundle IDs of all registered clients, ordered by client ID.
+    std::map<UInt32, CACFString>        mClients;
+
+    // These only change while IO is stopped.
+    UInt32                              mChannelCount = 0;
+    UInt32                              mNumberOfBuses = 0;
+    // The bus the mix goes on, or -1.
+    SInt32                              mMixBus = -1;
+    CARingBuffer                        mRingBuffer;
+
+    // Each route is (client ID << 32) | bus index, or kNoRoute. Read by the IO thread.
+    std::atomic<UInt64>                 mRoutes[kMaxRoutes];
+
+    // The interleaved frames of the current cycle and its sample time, or -1 between cycles. Only
+    // used by the IO thread after they're allocated.
+    std::vector<Float32>                mCycleBuffer;
+    CARingBuffer::SampleTime            mCycleSampleTime = -1;
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_ClientBuses__ */
+
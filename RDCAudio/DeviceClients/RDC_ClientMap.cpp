@@ -26,26 +26,106 @@
 
 // Local Includes
 #include "RDC_Types.h"
+#include "RDC_Signposts.h"
 
 // PublicUtility Includes
 #include "CAException.h"
+#include "CADebugMacros.h"
+
+// STL Includes
+#include <algorithm>
+
+// System Includes
+#include <sched.h>
 
 
 //#pragma clang assume_nonnull begin
 
+RDC_ClientMap::RDC_ClientMap()
+:
+    mMapsMutex("Maps mutex"),
+    mSnapshot(new RDC_ClientSnapshot(std::map<UInt32, RDC_Client>()))
+{
+    mReaderCounts[0] = 0;
+    mReaderCounts[1] = 0;
+    
+    // Fill the free list in reverse so the first client gets slot 0.
+    mFreeIOStateSlots.reserve(kIOStateSlotCount);
+    for(UInt32 i = kIOStateSlotCount; i > 0; i--)
+    {
+        mRequestedIOStates[i - 1] = false;
+        mFreeIOStateSlots.push_back(i - 1);
+    }
+}
+
+RDC_ClientMap::~RDC_ClientMap()
+{
+    // Nothing can be reading the snapshot by the time the device is being destroyed.
+    delete mSnapshot.load();
+}
+
 void    RDC_ClientMap::AddClient(RDC_Client inClient)
 {
-    CAMutex::Locker theShadowMapsLocker(mShadowMapsMutex);
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    if(inClient.mBundleID.IsValid())
+    {
+        auto theIndexItr = mBundleIDIndices.find(inClient.mBundleID);
+        if(theIndexItr == mBundleIDIndices.end())
+        {
+            theIndexItr = mBundleIDIndices.emplace(inClient.mBundleID, mNextBundleIDIndex++).first;
+        }
+        
+        inClient.mBundleIDIndex = theIndexItr->second;
+    }
+    else
+    {
+        inClient.mBundleIDIndex = kRDCNoBundleIDIndex;
+    }
+    
+    // Clients without a slot still work. The IO thread just can't filter out their repeated
+    // BeginIOOperation and EndIOOperation calls.
+    if(!mFreeIOStateSlots.empty())
+    {
+        inClient.mIOStateSlot = mFreeIOStateSlots.back();
+        mFreeIOStateSlots.pop_back();
+        mRequestedIOStates[inClient.mIOStateSlot] = inClient.mDoingIO;
         
-    // Add the new client to the shadow maps
-    AddClientToShadowMaps(inClient);
+        IOTimeSlot& theIOTime = mIOTimes[inClient.mIOStateSlot];
+        theIOTime.mTotalHostTicks.store(0, std::memory_order_relaxed);
+        theIOTime.mMaxHostTicks.store(0, std::memory_order_relaxed);
+        theIOTime.mOperations.store(0, std::memory_order_relaxed);
+    }
+    else
+    {
+        LogWarning("RDC_ClientMap::AddClient: No IO state slot left for client %u", inClient.mClientID);
+        inClient.mIOStateSlot = kRDCNoIOStateSlot;
+    }
     
-    // Swap the maps with their shadow maps
-    SwapInShadowMaps();
+    // If a client with the same bundle ID was added before, or its settings were set before it was
+    // added, give the new client the same settings.
+    if(inClient.mBundleID.IsValid())
+    {
+        auto thePastClientItr = mPastClientMap.find(inClient.mBundleID);
+        if(thePastClientItr != mPastClientMap.end())
+        {
+            inClient.mRelativeVolume = thePastClientItr->second.mRelativeVolume;
+            inClient.mPanPosition = thePastClientItr->second.mPanPosition;
+            inClient.mReadDelayFrames = thePastClientItr->second.mReadDelayFrames;
+        }
+    }
+        
+    AddClientToMaps(inClient);
     
-    // The shadow maps (which were the main maps until we swapped them) are now missing the new client. Add it again to
-    // keep the sets of maps identical.
-    AddClientToShadowMaps(inClient);
+    // Let the IO thread see the new client, unless it'll be published with the rest of the batch.
+    if(mBatchDepth == 0)
+    {
+        PublishSnapshot();
+    }
+    else
+    {
+        mSnapshotIsStale = true;
+    }
 
     // Insert the client into the past clients map. We do this here rather than in RemoveClient
     // because some apps add multiple clients with the same bundle ID and we want to give them all
@@ -56,73 +136,143 @@ void    RDC_ClientMap::AddClient(RDC_Client inClient)
     }
 }
 
-void    RDC_ClientMap::AddClientToShadowMaps(RDC_Client inClient)
+void    RDC_ClientMap::AddClientToMaps(RDC_Client inClient)
 {
-    ThrowIf(mClientMapShadow.count(inClient.mClientID) != 0,
+    ThrowIf(mClientMap.count(inClient.mClientID) != 0,
             RDC_InvalidClientException(),
-            "RDC_ClientMap::AddClientToShadowMaps: Tried to add client whose client ID was already in use");
+            "RDC_ClientMap::AddClientToMaps: Tried to add client whose client ID was already in use");
     
-    // Add to the client ID shadow map
-    mClientMapShadow[inClient.mClientID] = inClient;
+    // Add to the client ID map
+    mClientMap[inClient.mClientID] = inClient;
     
     // Get a reference to the client in the map so we can add it to the pointer maps
-    RDC_Client& clientInMap = mClientMapShadow.at(inClient.mClientID);
+    RDC_Client& clientInMap = mClientMap.at(inClient.mClientID);
     
-    // Add to the PID shadow map
-    mClientMapByPIDShadow[inClient.mProcessID].push_back(&clientInMap);
+    // Add to the PID map
+    mClientMapByPID[inClient.mProcessID].push_back(&clientInMap);
     
-    // Add to the bundle ID shadow map
+    // Add to the bundle ID map
     if(inClient.mBundleID.IsValid())
     {
-        mClientMapByBundleIDShadow[inClient.mBundleID].push_back(&clientInMap);
+        mClientMapByBundleID[inClient.mBundleID].push_back(&clientInMap);
     }
 }
 
 RDC_Client    RDC_ClientMap::RemoveClient(UInt32 inClientID)
 {
-    CAMutex::Locker theShadowMapsLocker(mShadowMapsMutex);
+    CAMutex::Locker theMapsLocker(mMapsMutex);
     
-    auto theClientItr = mClientMapShadow.find(inClientID);
+    auto theClientItr = mClientMap.find(inClientID);
     
     // Removing a client that was never added is an error
-    ThrowIf(theClientItr == mClientMapShadow.end(),
+    ThrowIf(theClientItr == mClientMap.end(),
             RDC_InvalidClientException(),
             "RDC_ClientMap::RemoveClient: Could not find client to be removed");
     
     RDC_Client theClient = theClientItr->second;
     
-    // Remove the client from the shadow maps
-    mClientMapShadow.erase(theClientItr);
-    mClientMapByPIDShadow.erase(theClient.mProcessID);
-    if(theClient.mBundleID.IsValid())
+    RemoveClientFromMaps(inClientID);
+    
+    // The slot can't be reused until no real-time thread can still be using it, i.e. after the next
+    // snapshot is published.
+    if(theClient.mIOStateSlot != kRDCNoIOStateSlot)
     {
-        mClientMapByBundleID.erase(theClient.mBundleID);
+        mRetiredIOStateSlots.push_back(theClient.mIOStateSlot);
     }
     
-    // Swap the maps with their shadow maps
-    SwapInShadowMaps();
-    
-    // Erase the client again so the maps and their shadow maps are kept identical
-    mClientMapShadow.erase(inClientID);
-    mClientMapByPIDShadow.erase(theClient.mProcessID);
-    if(theClient.mBundleID.IsValid())
+    if(mBatchDepth == 0)
+    {
+        PublishSnapshot();
+    }
+    else
     {
-        mClientMapByBundleID.erase(theClient.mBundleID);
+        mSnapshotIsStale = true;
     }
     
     return theClient;
 }
 
-bool    RDC_ClientMap::GetClientRT(UInt32 inClientID, RDC_Client* outClient) const
+void    RDC_ClientMap::BeginBatchNonRT()
 {
     CAMutex::Locker theMapsLocker(mMapsMutex);
-    return GetClient(mClientMap, inClientID, outClient);
+    
+    mBatchDepth++;
+}
+
+void    RDC_ClientMap::EndBatchNonRT()
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    ThrowIf(mBatchDepth == 0,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_ClientMap::EndBatchNonRT: No batch to end");
+    
+    mBatchDepth--;
+    
+    if(mBatchDepth == 0 && mSnapshotIsStale)
+    {
+        PublishSnapshot();
+    }
+}
+
+// Removes a client's pointer from its list in one of the pointer maps, and the list if it's empty.
+template <typename T>
+static void RemoveClientPtrFromMap(std::map<T, std::vector<RDC_Client*>>& ioMap, T inKey, RDC_Client* inClient)
+{
+    auto theListItr = ioMap.find(inKey);
+    if(theListItr != ioMap.end())
+    {
+        std::vector<RDC_Client*>& theList = theListItr->second;
+        theList.erase(std::remove(theList.begin(), theList.end(), inClient), theList.end());
+        
+        if(theList.empty())
+        {
+            ioMap.erase(theListItr);
+        }
+    }
+}
+
+void    RDC_ClientMap::RemoveClientFromMaps(UInt32 inClientID)
+{
+    auto theClientItr = mClientMap.find(inClientID);
+    if(theClientItr == mClientMap.end())
+    {
+        return;
+    }
+    
+    RDC_Client* theClient = &theClientItr->second;
+    
+    // Remove the pointers to the client first so they can't be left dangling. Other clients can have
+    // the same PID or bundle ID, so only this client's pointers are removed from the lists.
+    RemoveClientPtrFromMap(mClientMapByPID, theClient->mProcessID, theClient);
+    if(theClient->mBundleID.IsValid())
+    {
+        RemoveClientPtrFromMap(mClientMapByBundleID, theClient->mBundleID, theClient);
+    }
+    
+    mClientMap.erase(theClientItr);
+}
+
+bool    RDC_ClientMap::GetClientRT(UInt32 inClientID, RDC_ClientRecord& outClient) const
+{
+    UInt64 theEpoch;
+    const RDC_ClientSnapshot& theSnapshot = BeginReadRT(theEpoch);
+    
+    const RDC_ClientRecord* theRecord = theSnapshot.Find(inClientID);
+    if(theRecord != nullptr)
+    {
+        outClient = *theRecord;
+    }
+    
+    EndReadRT(theEpoch);
+    
+    return theRecord != nullptr;
 }
 
 bool    RDC_ClientMap::GetClientNonRT(UInt32 inClientID, RDC_Client* outClient) const
 {
-    CAMutex::Locker theShadowMapsLocker(mShadowMapsMutex);
-    return GetClient(mClientMapShadow, inClientID, outClient);
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    return GetClient(mClientMap, inClientID, outClient);
 }
 
 //static
@@ -139,14 +289,69 @@ bool    RDC_ClientMap::GetClient(const std::map<UInt32, RDC_Client>& inClientMap
     return false;
 }
 
+bool    RDC_ClientMap::GetClientRelativeVolumeAndPanRT(UInt32 inClientID,
+                                                       Float32& outRelativeVolume,
+                                                       SInt32& outPanPosition) const
+{
+    UInt64 theEpoch;
+    const RDC_ClientSnapshot& theSnapshot = BeginReadRT(theEpoch);
+    
+    const RDC_ClientRecord* theRecord = theSnapshot.Find(inClientID);
+    if(theRecord != nullptr)
+    {
+        outRelativeVolume = theRecord->mRelativeVolume;
+        outPanPosition = theRecord->mPanPosition;
+    }
+    
+    EndReadRT(theEpoch);
+    
+    return theRecord != nullptr;
+}
+
+bool    RDC_ClientMap::GetClientReadDelayRT(UInt32 inClientID, UInt32& outReadDelayFrames) const
+{
+    UInt64 theEpoch;
+    const RDC_ClientSnapshot& theSnapshot = BeginReadRT(theEpoch);
+    
+    const RDC_ClientRecord* theRecord = theSnapshot.Find(inClientID);
+    if(theRecord != nullptr)
+    {
+        outReadDelayFrames = theRecord->mReadDelayFrames;
+    }
+    
+    EndReadRT(theEpoch);
+    
+    return theRecord != nullptr;
+}
+
+UInt32  RDC_ClientMap::GetClientIOStateSlotRT(UInt32 inClientID) const
+{
+    UInt64 theEpoch;
+    const RDC_ClientRecord* theRecord = BeginReadRT(theEpoch).Find(inClientID);
+    
+    UInt32 theSlot = (theRecord != nullptr) ? theRecord->mIOStateSlot : kRDCNoIOStateSlot;
+    
+    EndReadRT(theEpoch);
+    
+    return theSlot;
+}
+
+UInt32  RDC_ClientMap::GetBundleIDIndexNonRT(const CACFString& inBundleID) const
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    auto theIndexItr = mBundleIDIndices.find(inBundleID);
+    return (theIndexItr != mBundleIDIndices.end()) ? theIndexItr->second : kRDCNoBundleIDIndex;
+}
+
 std::vector<RDC_Client> RDC_ClientMap::GetClientsByPID(pid_t inPID) const
 {
-    CAMutex::Locker theShadowMapsLocker(mShadowMapsMutex);
+    CAMutex::Locker theMapsLocker(mMapsMutex);
     
     std::vector<RDC_Client> theClients;
     
-    auto theMapItr = mClientMapByPIDShadow.find(inPID);
-    if(theMapItr != mClientMapByPIDShadow.end())
+    auto theMapItr = mClientMapByPID.find(inPID);
+    if(theMapItr != mClientMapByPID.end())
     {
         // Found clients with the PID, so copy them into the return vector
         for(auto& theClientPtrsItr : theMapItr->second)
@@ -158,6 +363,82 @@ std::vector<RDC_Client> RDC_ClientMap::GetClientsByPID(pid_t inPID) const
     return theClients;
 }
 
+std::vector<RDC_Client> RDC_ClientMap::GetClientsAndPastClientsNonRT() const
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    std::vector<RDC_Client> theClients;
+    
+    for(auto& theClientItr : mClientMap)
+    {
+        theClients.push_back(theClientItr.second);
+    }
+    
+    for(auto& thePastClientItr : mPastClientMap)
+    {
+        if(mClientMapByBundleID.count(thePastClientItr.first) == 0)
+        {
+            theClients.push_back(thePastClientItr.second);
+        }
+    }
+    
+    return theClients;
+}
+
+bool    RDC_ClientMap::SetClientsRelativeVolume(pid_t inAppPID, Float32 inRelativeVolume)
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    return UpdateClients(inAppPID, [inRelativeVolume](RDC_Client& ioClient) {
+        ioClient.mRelativeVolume = inRelativeVolume;
+    });
+}
+
+bool    RDC_ClientMap::SetClientsRelativeVolume(CACFString inAppBundleID, Float32 inRelativeVolume)
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    auto theUpdate = [inRelativeVolume](RDC_Client& ioClient) {
+        ioClient.mRelativeVolume = inRelativeVolume;
+    };
+    
+    UpdatePastClient(inAppBundleID, theUpdate);
+    return UpdateClients(inAppBundleID, theUpdate);
+}
+
+bool    RDC_ClientMap::SetClientsPanPosition(pid_t inAppPID, SInt32 inPanPosition)
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    return UpdateClients(inAppPID, [inPanPosition](RDC_Client& ioClient) {
+        ioClient.mPanPosition = inPanPosition;
+    });
+}
+
+bool    RDC_ClientMap::SetClientsPanPosition(CACFString inAppBundleID, SInt32 inPanPosition)
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    auto theUpdate = [inPanPosition](RDC_Client& ioClient) {
+        ioClient.mPanPosition = inPanPosition;
+    };
+    
+    UpdatePastClient(inAppBundleID, theUpdate);
+    return UpdateClients(inAppBundleID, theUpdate);
+}
+
+bool    RDC_ClientMap::SetClientsReadDelay(CACFString inAppBundleID, UInt32 inReadDelayFrames)
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    auto theUpdate = [inReadDelayFrames](RDC_Client& ioClient) {
+        ioClient.mReadDelayFrames = inReadDelayFrames;
+    };
+    
+    UpdatePastClient(inAppBundleID, theUpdate);
+    return UpdateClients(inAppBundleID, theUpdate);
+}
+
 template <typename T>
 std::vector<RDC_Client*> * _Nullable GetClientsFromMap(std::map<T, std::vector<RDC_Client*>> & map, T key) {
     auto theClientItr = map.find(key);
@@ -168,44 +449,296 @@ std::vector<RDC_Client*> * _Nullable GetClientsFromMap(std::map<T, std::vector<R
 }
 
 std::vector<RDC_Client*> * _Nullable RDC_ClientMap::GetClients(pid_t inAppPid) {
-    return GetClientsFromMap(mClientMapByPIDShadow, inAppPid);
+    return GetClientsFromMap(mClientMapByPID, inAppPid);
 }
 
 std::vector<RDC_Client*> * _Nullable RDC_ClientMap::GetClients(CACFString inAppBundleID) {
-    return GetClientsFromMap(mClientMapByBundleIDShadow, inAppBundleID);
+    return GetClientsFromMap(mClientMapByBundleID, inAppBundleID);
+}
+
+template <typename T>
+bool    RDC_ClientMap::UpdateClients(T inAppPIDOrBundleID, const std::function<void(RDC_Client&)>& inUpdate)
+{
+    std::vector<RDC_Client*>* theClients = GetClients(inAppPIDOrBundleID);
+    
+    if(theClients == nullptr || theClients->empty())
+    {
+        return false;
+    }
+    
+    for(RDC_Client* theClient : *theClients)
+    {
+        inUpdate(*theClient);
+        
+        // Keep the past clients map up to date so the setting is restored if the app's clients are
+        // removed and added again.
+        if(theClient->mBundleID.IsValid())
+        {
+            UpdatePastClient(theClient->mBundleID, inUpdate);
+        }
+    }
+    
+    PublishSnapshot();
+    
+    return true;
+}
+
+std::vector<RDC_Client> RDC_ClientMap::GetPastClientsNonRT() const
+{
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    std::vector<RDC_Client> thePastClients;
+    thePastClients.reserve(mPastClientMap.size());
+    
+    for(auto& thePastClientItr : mPastClientMap)
+    {
+        thePastClients.push_back(thePastClientItr.second);
+    }
+    
+    return thePastClients;
+}
+
+void    RDC_ClientMap::AddPastClientsNonRT(const std::vector<RDC_Client>& inPastClients)
+{
+    // Build the new map before taking the lock, so the lock is only held for the merge and swap.
+    std::map<CACFString, RDC_Client> theNewPastClientMap;
+    
+    for(const RDC_Client& thePastClient : inPastClients)
+    {
+        if(thePastClient.mBundleID.IsValid())
+        {
+            theNewPastClientMap[thePastClient.mBundleID] = thePastClient;
+        }
+    }
+    
+    CAMutex::Locker theMapsLocker(mMapsMutex);
+    
+    for(auto& thePastClientItr : mPastClientMap)
+    {
+        theNewPastClientMap[thePastClientItr.first] = thePastClientItr.second;
+    }
+    
+    mPastClientMap.swap(theNewPastClientMap);
+}
+
+void    RDC_ClientMap::UpdatePastClient(const CACFString& inAppBundleID,
+                                        const std::function<void(RDC_Client&)>& inUpdate)
+{
+    if(!inAppBundleID.IsValid())
+    {
+        return;
+    }
+    
+    auto thePastClientItr = mPastClientMap.find(inAppBundleID);
+    
+    if(thePastClientItr == mPastClientMap.end())
+    {
+        // The app hasn't been added yet, so this just holds its settings until it is.
+        RDC_Client thePastClient;
+        thePastClient.mClientID = 0;
+        thePastClient.mProcessID = 0;
+        thePastClient.mBundleID = inAppBundleID;
+        
+        thePastClientItr = mPastClientMap.emplace(inAppBundleID, thePastClient).first;
+    }
+    
+    inUpdate(thePastClientItr->second);
 }
 
 void    RDC_ClientMap::UpdateClientIOStateNonRT(UInt32 inClientID, bool inDoingIO)
 {
-    CAMutex::Locker theShadowMapsLocker(mShadowMapsMutex);
+    CAMutex::Locker theMapsLocker(mMapsMutex);
     
-    mClientMapShadow[inClientID].mDoingIO = inDoingIO;
-    SwapInShadowMaps();
-    mClientMapShadow[inClientID].mDoingIO = inDoingIO;
+    mClientMap[inClientID].mDoingIO = inDoingIO;
+    PublishSnapshot();
 }
 
-void    RDC_ClientMap::SwapInShadowMaps()
+bool    RDC_ClientMap::SetRequestedIOStateRT(UInt32 inClientID, bool inDoingIO)
 {
-    mTaskQueue->QueueSync_SwapClientShadowMaps(this);
+    bool didChange = true;
+    
+    UInt64 theEpoch;
+    const RDC_ClientRecord* theRecord = BeginReadRT(theEpoch).Find(inClientID);
+    
+    if(theRecord != nullptr && theRecord->mIOStateSlot != kRDCNoIOStateSlot)
+    {
+        didChange = (mRequestedIOStates[theRecord->mIOStateSlot].exchange(inDoingIO) != inDoingIO);
+    }
+    
+    EndReadRT(theEpoch);
+    
+    return didChange;
 }
 
-void    RDC_ClientMap::SwapInShadowMapsRT()
+void    RDC_ClientMap::AddIOTimeRT(UInt32 inClientID, UInt64 inHostTicks)
 {
-#if DEBUG
-    // This method should only be called by the realtime worker thread in RDC_TaskQueue. The only safe way to call it is on a realtime
-    // thread while a non-realtime thread is holding the shadow maps mutex. (These assertions assume that the realtime worker thread is
-    // the only thread we'll call this on, but we could decide to change that at some point.)
-    mTaskQueue->AssertCurrentThreadIsRTWorkerThread("RDC_ClientMap::SwapInShadowMapsRT");
+    UInt64 theEpoch;
+    const RDC_ClientRecord* theRecord = BeginReadRT(theEpoch).Find(inClientID);
     
-    Assert(!mShadowMapsMutex.IsFree(), "Can't swap in the shadow maps while the shadow maps mutex is free");
-    Assert(!mShadowMapsMutex.IsOwnedByCurrentThread(), "The shadow maps mutex should not be held by a realtime thread");
-#endif
+    if(theRecord != nullptr && theRecord->mIOStateSlot != kRDCNoIOStateSlot)
+    {
+        IOTimeSlot& theIOTime = mIOTimes[theRecord->mIOStateSlot];
+        
+        theIOTime.mTotalHostTicks.fetch_add(inHostTicks, std::memory_order_relaxed);
+        theIOTime.mOperations.fetch_add(1, std::memory_order_relaxed);
+        
+        UInt64 theMax = theIOTime.mMaxHostTicks.load(std::memory_order_relaxed);
+        while(inHostTicks > theMax &&
+              !theIOTime.mMaxHostTicks.compare_exchange_weak(theMax, inHostTicks, std::memory_order_relaxed))
+        {
+            // theMax was updated by compare_exchange_weak, so just try again.
+        }
+    }
     
+    EndReadRT(theEpoch);
+}
+
+std::vector<std::pair<RDC_Client, RDC_ClientMap::RDC_ClientIOTime>>    RDC_ClientMap::GetClientIOTimesNonRT() const
+{
     CAMutex::Locker theMapsLocker(mMapsMutex);
     
-    mClientMap.swap(mClientMapShadow);
-    mClientMapByPID.swap(mClientMapByPIDShadow);
-    mClientMapByBundleID.swap(mClientMapByBundleIDShadow);
+    std::vector<std::pair<RDC_Client, RDC_ClientIOTime>> theIOTimes;
+    
+    for(auto& theClientItr : mClientMap)
+    {
+        const RDC_Client& theClient = theClientItr.second;
+        
+        if(theClient.mIOStateSlot != kRDCNoIOStateSlot)
+        {
+            const IOTimeSlot& theSlot = mIOTimes[theClient.mIOStateSlot];
+            
+            RDC_ClientIOTime theIOTime;
+            theIOTime.mTotalHostTicks = theSlot.mTotalHostTicks.load(std::memory_order_relaxed);
+            theIOTime.mMaxHostTicks = theSlot.mMaxHostTicks.load(std::memory_order_relaxed);
+            theIOTime.mOperations = theSlot.mOperations.load(std::memory_order_relaxed);
+            
+            theIOTimes.emplace_back(theClient, theIOTime);
+        }
+    }
+    
+    return theIOTimes;
+}
+
+void    RDC_ClientMap::ResetIOTimesNonRT()
+{
+    // The IO thread can be adding to them at the same time, so the reset isn't exact, but it doesn't
+    // need to be.
+    for(IOTimeSlot& theIOTime : mIOTimes)
+    {
+        theIOTime.mTotalHostTicks.store(0, std::memory_order_relaxed);
+        theIOTime.mMaxHostTicks.store(0, std::memory_order_relaxed);
+        theIOTime.mOperations.store(0, std::memory_order_relaxed);
+    }
+}
+
+#pragma mark Snapshots
+
+void    RDC_ClientMap::PublishSnapshot()
+{
+    Assert(mMapsMutex.IsOwnedByCurrentThread(), "RDC_ClientMap::PublishSnapshot: The maps mutex must be held");
+    
+    // The interval includes waiting for the readers of the old snapshot.
+    RDCSignpostBegin("PublishClientSnapshot", RDC_Signposts::MakeID(reinterpret_cast<uintptr_t>(this)));
+    
+    RDC_ClientSnapshot* theNewSnapshot = new RDC_ClientSnapshot(mClientMap);
+    
+    const RDC_ClientSnapshot* theOldSnapshot = mSnapshot.exchange(theNewSnapshot);
+    
+    // Readers that register after this can only load the new snapshot, so once the ones in the old
+    // epoch have finished, the old snapshot can be freed. Only writers change the epoch and we hold
+    // the mutex, so no reader can join the old epoch's count now. (One that read the old epoch just
+    // before this will see the epoch change when it checks, and try again.)
+    UInt64 theOldEpoch = mEpoch.fetch_add(1);
+    
+    while(mReaderCounts[theOldEpoch & 1].load() != 0)
+    {
+        sched_yield();
+    }
+    
+    delete theOldSnapshot;
+    
+    mSnapshotIsStale = false;
+    mSnapshotPublishCount.fetch_add(1, std::memory_order_relaxed);
+    
+    // No reader can be using the old snapshot now, so none can be using these slots.
+    mFreeIOStateSlots.insert(mFreeIOStateSlots.end(), mRetiredIOStateSlots.begin(), mRetiredIOStateSlots.end());
+    mRetiredIOStateSlots.clear();
+    
+    RDCSignpostEnd("PublishClientSnapshot", RDC_Signposts::MakeID(reinterpret_cast<uintptr_t>(this)));
+}
+
+RDC_ClientMap::RDC_ClientSnapshot::RDC_ClientSnapshot(const std::map<UInt32, RDC_Client>& inClients)
+{
+    // At least twice as many slots as clients keeps the probe sequences short.
+    UInt32 theSlotCountLog2 = 4;
+    while((1u << theSlotCountLog2) < 2 * inClients.size())
+    {
+        theSlotCountLog2++;
+    }
+    
+    mShift = 32 - theSlotCountLog2;
+    mSlots.resize(1u << theSlotCountLog2);
+    
+    UInt32 theMask = static_cast<UInt32>(mSlots.size() - 1);
+    
+    for(auto& theClientItr : inClients)
+    {
+        UInt32 theIndex = HomeSlot(theClientItr.first);
+        
+        while(mSlots[theIndex].mIsOccupied)
+        {
+            theIndex = (theIndex + 1) & theMask;
+        }
+        
+        mSlots[theIndex].mRecord = RDC_ClientRecord(theClientItr.second);
+        mSlots[theIndex].mIsOccupied = true;
+    }
+}
+
+const RDC_ClientRecord* __nullable RDC_ClientMap::RDC_ClientSnapshot::Find(UInt32 inClientID) const
+{
+    UInt32 theMask = static_cast<UInt32>(mSlots.size() - 1);
+    
+    // The table is never full, so this always reaches an empty slot if the client isn't there.
+    for(UInt32 theIndex = HomeSlot(inClientID); mSlots[theIndex].mIsOccupied; theIndex = (theIndex + 1) & theMask)
+    {
+        if(mSlots[theIndex].mRecord.mClientID == inClientID)
+        {
+            return &mSlots[theIndex].mRecord;
+        }
+    }
+    
+    return nullptr;
+}
+
+UInt32  RDC_ClientMap::RDC_ClientSnapshot::HomeSlot(UInt32 inClientID) const
+{
+    // Fibonacci hashing. The HAL hands out client IDs sequentially, which this spreads over the table.
+    return (inClientID * 2654435769u) >> mShift;
+}
+
+const RDC_ClientMap::RDC_ClientSnapshot&    RDC_ClientMap::BeginReadRT(UInt64& outEpoch) const
+{
+    while(true)
+    {
+        UInt64 theEpoch = mEpoch.load();
+        mReaderCounts[theEpoch & 1].fetch_add(1);
+        
+        // If a writer advanced the epoch before we registered, it might not wait for us, so we have
+        // to register in the new epoch instead.
+        if(mEpoch.load() == theEpoch)
+        {
+            outEpoch = theEpoch;
+            return *mSnapshot.load();
+        }
+        
+        mReaderCounts[theEpoch & 1].fetch_sub(1);
+    }
+}
+
+void    RDC_ClientMap::EndReadRT(UInt64 inEpoch) const
+{
+    mReaderCounts[inEpoch & 1].fetch_sub(1);
 }
 
 //#pragma clang assume_nonnull end
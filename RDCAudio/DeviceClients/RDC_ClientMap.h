@@ -25,20 +25,17 @@
 
 // Local Includes
 #include "RDC_Client.h"
-#include "RDC_TaskQueue.h"
 
 // PublicUtility Includes
 #include "CAMutex.h"
 #include "CAVolumeCurve.h"
 
 // STL Includes
+#include <atomic>
 #include <map>
 #include <vector>
 #include <functional>
-
-
-// Forward Declarations
-class RDC_ClientTasks;
+#include <utility>
 
 
 #pragma clang assume_nonnull begin
@@ -49,19 +46,30 @@ class RDC_ClientTasks;
 //  This class stores the clients (RDC_Client) that have been registered with RDCDevice by the HAL.
 //  It also maintains maps from clients' PIDs and bundle IDs to the clients. When a client is
 //  removed by the HAL we add it to a map of past clients to keep track of settings specific to that
-//  client. (Currently only the client's volume.)
+//  client. (Currently its relative volume, pan position and read delay.)
 //
-//  Since the maps are read from during IO, this class has to to be real-time safe when accessing
-//  them. So each map has an identical "shadow" map, which we use to buffer updates.
+//  The maps are only used by non-real-time threads, which hold mMapsMutex. Real-time threads read
+//  the clients from an immutable snapshot instead. After each change, the writer builds a new
+//  snapshot and publishes it with an atomic pointer, so readers never lock and writers never have
+//  to wait for a real-time thread.
 //
-//  To update the clients we lock the shadow maps, modify them, have RDC_TaskQueue's real-time
-//  thread swap them with the main maps, and then repeat the modification to keep both sets of maps
-//  identical. We have to swap the maps on a real-time thread so we can take the main maps' lock
-//  without risking priority inversion, but this way the actual work doesn't need to be real-time
-//  safe.
+//  A snapshot is an open-addressed hash table of RDC_ClientRecords, keyed by client ID, in one
+//  contiguous array. The table is at most half full and the records hold no CF objects, so a
+//  lookup usually touches a single cache line and copying a client never retains anything. Bundle
+//  IDs are interned as integers (RDC_Client::mBundleIDIndex) for the same reason.
 //
-//  Methods that only read from the maps and are called on non-real-time threads will just read
-//  from the shadow maps because it's easier.
+//  Old snapshots are freed with epoch-based reclamation. A reader registers itself in the current
+//  epoch's reader count (there are two, used for even and odd epochs) before loading the pointer
+//  and unregisters when it's finished. After publishing, the writer advances the epoch, so readers
+//  that start after that can only see the new snapshot, and waits for the old epoch's count to
+//  reach zero. Then no reader can still have the old snapshot and the writer frees it. Readers
+//  only hold a snapshot for one lookup, so the wait is short, and it's on the writer's
+//  (non-real-time) thread.
+//
+//  Publishing means waiting for the real-time threads, so when many clients are added or removed
+//  together the writer can open a batch with BeginBatchNonRT. Until the batch ends, AddClient and
+//  RemoveClient only change the maps and the snapshot is published once, by EndBatchNonRT. Any
+//  other change publishes as usual, which includes whatever the batch has changed so far.
 //
 //  Methods whose names end with "RT" and "NonRT" can only safely be called from real-time and
 //  non-real-time threads respectively. (Methods with neither are most likely non-RT.)
@@ -70,27 +78,43 @@ class RDC_ClientTasks;
 class RDC_ClientMap
 {
     
-    friend class RDC_ClientTasks;
-    
     typedef std::vector<RDC_Client*> RDC_ClientPtrList;
     
 public:
-                                                        RDC_ClientMap(RDC_TaskQueue* inTaskQueue) : mTaskQueue(inTaskQueue), mMapsMutex("Maps mutex"), mShadowMapsMutex("Shadow maps mutex") { };
+                                                        RDC_ClientMap();
+                                                        ~RDC_ClientMap();
+                                                        // Disallow copying
+                                                        RDC_ClientMap(const RDC_ClientMap&) = delete;
+                                                        RDC_ClientMap& operator=(const RDC_ClientMap&) = delete;
 
     void                                                AddClient(RDC_Client inClient);
     
 private:
-    void                                                AddClientToShadowMaps(RDC_Client inClient);
+    void                                                AddClientToMaps(RDC_Client inClient);
+    void                                                RemoveClientFromMaps(UInt32 inClientID);
     
 public:
     // Returns the removed client
     RDC_Client                                          RemoveClient(UInt32 inClientID);
     
-    // These methods are functionally identical except that GetClientRT must only be called from real-time threads and GetClientNonRT
-    // must only be called from non-real-time threads. Both return true if a client was found.
-    bool                                                GetClientRT(UInt32 inClientID, RDC_Client* outClient) const;
+    // Stop AddClient and RemoveClient publishing snapshots until the matching call to EndBatchNonRT,
+    // which publishes one if they changed anything. Batches can be nested. Real-time threads don't
+    // see the clients added in a batch until it ends, and still see the ones removed.
+    void                                                BeginBatchNonRT();
+    void                                                EndBatchNonRT();
+    
+    // The number of snapshots published since the map was created, for the stats.
+    UInt64                                              GetSnapshotPublishCount() const { return mSnapshotPublishCount.load(std::memory_order_relaxed); }
+    
+    // GetClientRT must only be called from real-time threads and GetClientNonRT must only be called from non-real-time threads.
+    // GetClientRT only copies the parts of the client real-time threads can use. Both return true if a client was found.
+    bool                                                GetClientRT(UInt32 inClientID, RDC_ClientRecord& outClient) const;
     bool                                                GetClientNonRT(UInt32 inClientID, RDC_Client* outClient) const;
     
+    // Returns the number interned for the bundle ID, which clients with it have as their mBundleIDIndex, or
+    // kRDCNoBundleIDIndex if no client with the bundle ID has been added.
+    UInt32                                              GetBundleIDIndexNonRT(const CACFString& inBundleID) const;
+    
 private:
     static bool                                         GetClient(const std::map<UInt32, RDC_Client>& inClientMap,
                                                                   UInt32 inClientID,
@@ -98,20 +122,77 @@ private:
     
 public:
     std::vector<RDC_Client>                             GetClientsByPID(pid_t inPID) const;
+    // Returns the registered clients, followed by the past clients for bundle IDs that have no
+    // registered clients.
+    std::vector<RDC_Client>                             GetClientsAndPastClientsNonRT() const;
+    
+    // Copies the relative volume and pan position of a client without copying the rest of it, which
+    // would retain its bundle ID. Returns true if the client was found.
+    bool                                                GetClientRelativeVolumeAndPanRT(UInt32 inClientID,
+                                                                                        Float32& outRelativeVolume,
+                                                                                        SInt32& outPanPosition) const;
+    // Copies the client's read delay. Returns true if the client was found.
+    bool                                                GetClientReadDelayRT(UInt32 inClientID, UInt32& outReadDelayFrames) const;
+    // Returns the client's IO state slot, or kRDCNoIOStateSlot if it wasn't found or has no slot.
+    UInt32                                              GetClientIOStateSlotRT(UInt32 inClientID) const;
+    
+    // These set the relative volume or pan position of every client with the PID or bundle ID and
+    // return true if there were any. The bundle ID versions also store the setting in the past
+    // clients map, so clients added later get it even if there were none.
+    bool                                                SetClientsRelativeVolume(pid_t inAppPID, Float32 inRelativeVolume);
+    bool                                                SetClientsRelativeVolume(CACFString inAppBundleID, Float32 inRelativeVolume);
+    bool                                                SetClientsPanPosition(pid_t inAppPID, SInt32 inPanPosition);
+    bool                                                SetClientsPanPosition(CACFString inAppBundleID, SInt32 inPanPosition);
+    bool                                                SetClientsReadDelay(CACFString inAppBundleID, UInt32 inReadDelayFrames);
+    
+    // Returns the past clients, i.e. the settings remembered for each bundle ID.
+    std::vector<RDC_Client>                             GetPastClientsNonRT() const;
+    // Adds past clients in one go, e.g. with settings saved before coreaudiod restarted, so clients
+    // get them when they're added. Past clients already in the map for the same bundle IDs are
+    // kept. Registered clients aren't changed and no snapshot is published.
+    void                                                AddPastClientsNonRT(const std::vector<RDC_Client>& inPastClients);
+    
+private:
+    // Calls inUpdate on each client with the PID or bundle ID and publishes a new snapshot. Also
+    // updates the clients' entries in the past clients map. The maps mutex must be locked when
+    // calling this method.
+    template <typename T>
+    bool                                                UpdateClients(T inAppPIDOrBundleID,
+                                                                      const std::function<void(RDC_Client&)>& inUpdate);
+    // Calls inUpdate on the past client for the bundle ID, adding one if there isn't one. The maps
+    // mutex must be locked when calling this method.
+    void                                                UpdatePastClient(const CACFString& inAppBundleID,
+                                                                         const std::function<void(RDC_Client&)>& inUpdate);
     
 public:
     void                                                StartIONonRT(UInt32 inClientID) { UpdateClientIOStateNonRT(inClientID, true); }
     void                                                StopIONonRT(UInt32 inClientID) { UpdateClientIOStateNonRT(inClientID, false); }
     
+    // Records whether the HAL has told us the client is doing IO, without locking, and returns true if
+    // that's a change from what was last recorded. mDoingIO only changes when the task queue gets to
+    // the resulting StartIONonRT/StopIONonRT call, so this is what real-time threads compare against
+    // to avoid queueing a task every IO cycle. Also returns true if the client wasn't found or has no
+    // slot in the table, so the non-real-time side can deal with it.
+    bool                                                SetRequestedIOStateRT(UInt32 inClientID, bool inDoingIO);
+    
 private:
     void                                                UpdateClientIOStateNonRT(UInt32 inClientID, bool inDoingIO);
     
-    // Has a real-time thread call SwapInShadowMapsRT. (Synchronously queues the call as a task on mTaskQueue.)
-    // The shadow maps mutex must be locked when calling this method.
-    void                                                SwapInShadowMaps();
-    // Note that this method is called by RDC_TaskQueue through the RDC_ClientTasks interface. The shadow maps
-    // mutex must be locked when calling this method.
-    void                                                SwapInShadowMapsRT();
+public:
+    // The time a client's IO operations have taken since it was added or the times were reset.
+    struct RDC_ClientIOTime
+    {
+        UInt64                                          mTotalHostTicks = 0;
+        UInt64                                          mMaxHostTicks = 0;
+        UInt64                                          mOperations = 0;
+    };
+    
+    // Adds the duration of one of the client's IO operations to its slot in mIOTimes, without
+    // locking. Does nothing if the client wasn't found or has no slot.
+    void                                                AddIOTimeRT(UInt32 inClientID, UInt64 inHostTicks);
+    // Returns each registered client with its IO time. Clients without a slot aren't included.
+    std::vector<std::pair<RDC_Client, RDC_ClientIOTime>> GetClientIOTimesNonRT() const;
+    void                                                ResetIOTimesNonRT();
     
     // Client lookup for PID inAppPID
     std::vector<RDC_Client*> * _Nullable                GetClients(pid_t inAppPid);
@@ -119,35 +200,91 @@ private:
     std::vector<RDC_Client*> * _Nullable                GetClients(CACFString inAppBundleID);
     
 private:
-    RDC_TaskQueue*                                      mTaskQueue;
+    // What real-time threads see of the clients. Never modified after it's published.
+    class RDC_ClientSnapshot
+    {
+    public:
+                                                        RDC_ClientSnapshot(const std::map<UInt32, RDC_Client>& inClients);
+        
+        const RDC_ClientRecord* __nullable              Find(UInt32 inClientID) const;
+        
+    private:
+        struct Slot
+        {
+            RDC_ClientRecord                            mRecord;
+            bool                                        mIsOccupied = false;
+        };
+        
+        UInt32                                          HomeSlot(UInt32 inClientID) const;
+        
+        // The number of slots is a power of two, 1 << (32 - mShift).
+        UInt32                                          mShift;
+        std::vector<Slot>                               mSlots;
+    };
+    
+    // Copies mClientMap into a new snapshot, publishes it and frees the old one once no readers
+    // can be using it. Then returns the IO state slots in mRetiredIOStateSlots to the free list. The
+    // maps mutex must be locked when calling this method.
+    void                                                PublishSnapshot();
     
-    // Must be held to access mClientMap or mClientMapByPID. Code that runs while holding this mutex needs
-    // to be real-time safe. Should probably not be held for most operations on mClientMapByBundleID because,
-    // as far as I can tell, code that works with CFStrings is unlikely to be real-time safe.
-    CAMutex                                             mMapsMutex;
-    // Should only be locked by non-real-time threads. Should not be released until the maps have been
-    // made identical to their shadow maps.
-    CAMutex                                             mShadowMapsMutex;
+    // Register as a reader of the current snapshot and return it. Must be paired with EndReadRT,
+    // passing it outEpoch. The snapshot can't be freed in between.
+    const RDC_ClientSnapshot&                           BeginReadRT(UInt64& outEpoch) const;
+    void                                                EndReadRT(UInt64 inEpoch) const;
+    
+private:
+    // Must be held to access the maps. Should only be locked by non-real-time threads.
+    CAUnfairMutex                                       mMapsMutex;
     
     // The clients currently registered with RDCDevice. Indexed by client ID.
     std::map<UInt32, RDC_Client>                        mClientMap;
-    // We keep this in sync with mClientMap so it can be modified outside of real-time safe sections and
-    // then swapped in on a real-time thread, which is safe.
-    std::map<UInt32, RDC_Client>                        mClientMapShadow;
-    
-    // These maps hold lists of pointers to clients in mClientMap/mClientMapShadow. Lists because a process
-    // can have multiple clients and clients can have the same bundle ID.
     
+    // These maps hold lists of pointers to clients in mClientMap. Lists because a process can have
+    // multiple clients and clients can have the same bundle ID.
     std::map<pid_t, RDC_ClientPtrList>                  mClientMapByPID;
-    std::map<pid_t, RDC_ClientPtrList>                  mClientMapByPIDShadow;
-    
     std::map<CACFString, RDC_ClientPtrList>             mClientMapByBundleID;
-    std::map<CACFString, RDC_ClientPtrList>             mClientMapByBundleIDShadow;
     
     // Clients are added to mPastClientMap so we can restore settings specific to them if they get
     // added again.
     std::map<CACFString, RDC_Client>                    mPastClientMap;
     
+    // The IO state most recently requested for each client, indexed by RDC_Client::mIOStateSlot. A
+    // slot is only returned to mFreeIOStateSlots after a snapshot without its client has been
+    // published, so no real-time thread can still be using it when it's reused.
+    static const UInt32                                 kIOStateSlotCount = kRDCIOStateSlotCount;
+    std::atomic<bool>                                   mRequestedIOStates[kIOStateSlotCount];
+    std::vector<UInt32>                                 mFreeIOStateSlots;
+    // The slots of clients that have been removed since the last snapshot was published.
+    std::vector<UInt32>                                 mRetiredIOStateSlots;
+    
+    // The number of batches open and whether AddClient or RemoveClient has changed mClientMap since
+    // the snapshot was last published. Guarded by mMapsMutex.
+    UInt32                                              mBatchDepth = 0;
+    bool                                                mSnapshotIsStale = false;
+    
+    // The accumulated RDC_ClientIOTime of each client, indexed by mIOStateSlot as well, so the IO
+    // thread can update it with a few relaxed atomic adds. Zeroed when a slot is given to a client.
+    struct IOTimeSlot
+    {
+        std::atomic<UInt64>                             mTotalHostTicks { 0 };
+        std::atomic<UInt64>                             mMaxHostTicks { 0 };
+        std::atomic<UInt64>                             mOperations { 0 };
+    };
+    IOTimeSlot                                          mIOTimes[kIOStateSlotCount];
+    
+    // The interned bundle IDs. Indices aren't reused, so one never refers to a different app.
+    std::map<CACFString, UInt32>                        mBundleIDIndices;
+    UInt32                                              mNextBundleIDIndex = kRDCNoBundleIDIndex + 1;
+    
+    // The snapshot real-time threads read from. Never null.
+    std::atomic<const RDC_ClientSnapshot*>              mSnapshot;
+    // Only advanced by writers, which hold mMapsMutex.
+    std::atomic<UInt64>                                 mEpoch { 0 };
+    // The number of readers registered in even and odd epochs.
+    mutable std::atomic<UInt32>                         mReaderCounts[2];
+    // Only incremented by writers, but read without the mutex.
+    std::atomic<UInt64>                                 mSnapshotPublishCount { 0 };
+    
 };
 
 #pragma clang assume_nonnull end
@@ -0,0 +1,268 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_ClientSettingsCache.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_ClientSettingsCache.h"
+
+// Local Includes
+#include "RDC_Types.h"
+#include "RDC_PlugIn.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+
+// STL Includes
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+
+#pragma clang assume_nonnull begin
+
+static const size_t kHeaderSize = sizeof(UInt32) + sizeof(UInt16) + sizeof(UInt16);
+// Not counting the bundle ID itself.
+static const size_t kEntrySize = sizeof(UInt8) + sizeof(Float32) + sizeof(SInt8) + sizeof(SInt8) + sizeof(UInt16);
+
+template <typename T>
+static void RDC_Append(std::vector<UInt8>& ioBytes, T inValue)
+{
+    const UInt8* theBytes = reinterpret_cast<const UInt8*>(&inValue);
+    ioBytes.insert(ioBytes.end(), theBytes, theBytes + sizeof(T));
+}
+
+// Copies the next value out of the data and advances ioPosition, or returns false if there aren't
+// enough bytes left.
+template <typename T>
+static bool RDC_Read(const UInt8* inBytes, size_t inLength, size_t& ioPosition, T& outValue)
+{
+    if(inLength - ioPosition < sizeof(T))
+    {
+        return false;
+    }
+
+    memcpy(&outValue, inBytes + ioPosition, sizeof(T));
+    ioPosition += sizeof(T);
+    return true;
+}
+
+static CFStringRef RDC_CopyStorageKey(CFStringRef inDeviceUID)
+{
+    CFStringRef theKey = CFStringCreateWithFormat(kCFAllocatorDefault, nullptr, CFSTR("ClientSettings %@"), inDeviceUID);
+    ThrowIfNULL(theKey,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_ClientSettingsCache: failed to create the storage key");
+    return theKey;
+}
+
+CFDataRef   RDC_ClientSettingsCache::CreateData(const RDC_ClientSettingsMap& inSettings)
+{
+    std::vector<UInt8> theBytes;
+    theBytes.reserve(kHeaderSize + inSettings.size() * (kEntrySize + 32));
+
+    RDC_Append<UInt32>(theBytes, kRDCClientSettingsCacheMagic);
+    RDC_Append<UInt16>(theBytes, kRDCClientSettingsCacheVersion);
+    // Filled in below, since some entries can be skipped.
+    RDC_Append<UInt16>(theBytes, 0);
+
+    UInt16 theEntryCount = 0;
+
+    for(const auto& theEntry : inSettings)
+    {
+        char theBundleID[kMaxBundleIDLength + 1];
+        CFIndex theLength = 0;
+        CFStringRef theBundleIDRef = theEntry.first.GetCFString();
+        CFRange theRange = CFRangeMake(0, (theBundleIDRef == nullptr) ? 0 : CFStringGetLength(theBundleIDRef));
+
+        if(theBundleIDRef == nullptr ||
+           CFStringGetBytes(theBundleIDRef,
+                            theRange,
+                            kCFStringEncodingUTF8,
+                            0,
+                            false,
+                            reinterpret_cast<UInt8*>(theBundleID),
+                            kMaxBundleIDLength,
+                            &theLength) != theRange.length ||
+           theEntryCount == UINT16_MAX)
+        {
+            DebugMsg("RDC_ClientSettingsCache::CreateData: Skipping a bundle ID");
+            continue;
+        }
+
+        const RDC_ClientSettings& theSettings = theEntry.second;
+
+        RDC_Append<UInt8>(theBytes, static_cast<UInt8>(theLength));
+        theBytes.insert(theBytes.end(), theBundleID, theBundleID + theLength);
+        RDC_Append<Float32>(theBytes, theSettings.mRelativeVolume);
+        RDC_Append<SInt8>(theBytes, static_cast<SInt8>(theSettings.mPanPosition));
+        RDC_Append<SInt8>(theBytes, static_cast<SInt8>(theSettings.mTapIndex));
+        RDC_Append<UInt16>(theBytes, theSettings.mBusMask);
+
+        theEntryCount++;
+    }
+
+    memcpy(theBytes.data() + sizeof(UInt32) + sizeof(UInt16), &theEntryCount, sizeof(UInt16));
+
+    CFDataRef theData = CFDataCreate(kCFAllocatorDefault, theBytes.data(), static_cast<CFIndex>(theBytes.size()));
+    ThrowIfNULL(theData,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_ClientSettingsCache::CreateData: failed to create the CFData");
+
+    return theData;
+}
+
+RDC_ClientSettingsMap   RDC_ClientSettingsCache::ParseData(CFDataRef inData)
+{
+    const UInt8* theBytes = CFDataGetBytePtr(inData);
+    size_t theLength = static_cast<size_t>(CFDataGetLength(inData));
+    size_t thePosition = 0;
+
+    UInt32 theMagic = 0;
+    UInt16 theVersion = 0;
+    UInt16 theEntryCount = 0;
+
+    if(!RDC_Read(theBytes, theLength, thePosition, theMagic) ||
+       !RDC_Read(theBytes, theLength, thePosition, theVersion) ||
+       !RDC_Read(theBytes, theLength, thePosition, theEntryCount) ||
+       theMagic != kRDCClientSettingsCacheMagic ||
+       theVersion != kRDCClientSettingsCacheVersion)
+    {
+        LogWarning("RDC_ClientSettingsCache::ParseData: Ignoring data with an unknown format");
+        return RDC_ClientSettingsMap();
+    }
+
+    RDC_ClientSettingsMap theSettingsMap;
+
+    for(UInt16 i = 0; i < theEntryCount; i++)
+    {
+        UInt8 theBundleIDLength = 0;
+        Float32 theRelativeVolume = 1.0f;
+        SInt8 thePanPosition = 0;
+        SInt8 theTapIndex = -1;
+        UInt16 theBusMask = 0;
+
+        bool theEntryIsComplete =
+                RDC_Read(theBytes, theLength, thePosition, theBundleIDLength) &&
+                theLength - thePosition >= theBundleIDLength;
+
+        CFStringRef theBundleID = nullptr;
+
+        if(theEntryIsComplete)
+        {
+            theBundleID = CFStringCreateWithBytes(kCFAllocatorDefault,
+                                                  theBytes + thePosition,
+                                                  theBundleIDLength,
+                                                  kCFStringEncodingUTF8,
+                                                  false);
+            thePosition += theBundleIDLength;
+
+            theEntryIsComplete =
+                    RDC_Read(theBytes, theLength, thePosition, theRelativeVolume) &&
+                    RDC_Read(theBytes, theLength, thePosition, thePanPosition) &&
+                    RDC_Read(theBytes, theLength, thePosition, theTapIndex) &&
+                    RDC_Read(theBytes, theLength, thePosition, theBusMask);
+        }
+
+        if(!theEntryIsComplete || theBundleID == nullptr)
+        {
+            LogWarning("RDC_ClientSettingsCache::ParseData: Ignoring truncated data");
+
+            if(theBundleID != nullptr)
+            {
+                CFRelease(theBundleID);
+            }
+
+            return RDC_ClientSettingsMap();
+        }
+
+        // Clamp the values, in case the data was written by a version that allowed others.
+        RDC_ClientSettings theSettings;
+        theSettings.mRelativeVolume = std::max(theRelativeVolume, 0.0f);
+        theSettings.mPanPosition = std::min(std::max(static_cast<SInt32>(thePanPosition), kRDCAppPanLeftRawValue),
+                                            kRDCAppPanRightRawValue);
+        theSettings.mTapIndex = (theTapIndex < static_cast<SInt32>(kRDCMaxClientTaps)) ? theTapIndex : -1;
+        theSettings.mBusMask = static_cast<UInt16>(theBusMask & ((1U << kRDCMaxClientBuses) - 1));
+
+        // The map takes ownership of the bundle ID.
+        theSettingsMap[CACFString(theBundleID)] = theSettings;
+    }
+
+    return theSettingsMap;
+}
+
+RDC_ClientSettingsMap   RDC_ClientSettingsCache::Load(CFStringRef inDeviceUID)
+{
+    CACFString theKey(RDC_CopyStorageKey(inDeviceUID));
+    CFPropertyListRef theData = nullptr;
+
+    OSStatus theError = RDC_PlugIn::Host_CopyFromStorage(theKey.GetCFString(), &theData);
+
+    // The host returns no data, rather than an error, if nothing has been stored yet.
+    if(theError != kAudioHardwareNoError || theData == nullptr)
+    {
+        DebugMsg("RDC_ClientSettingsCache::Load: No settings stored (%d)", theError);
+
+        if(theData != nullptr)
+        {
+            CFRelease(theData);
+        }
+
+        return RDC_ClientSettingsMap();
+    }
+
+    RDC_ClientSettingsMap theSettings;
+
+    if(CFGetTypeID(theData) == CFDataGetTypeID())
+    {
+        theSettings = ParseData(static_cast<CFDataRef>(theData));
+    }
+    else
+    {
+        LogWarning("RDC_ClientSettingsCache::Load: The stored settings aren't a CFData");
+    }
+
+    CFRelease(theData);
+
+    return theSettings;
+}
+
+void    RDC_ClientSettingsCache::Save(CFStringRef inDeviceUID, const RDC_ClientSettingsMap& inSettings)
+{
+    try
+    {
+        CACFString theKey(RDC_CopyStorageKey(inDeviceUID));
+        CFDataRef theData = CreateData(inSettings);
+
+        OSStatus theError = RDC_PlugIn::Host_WriteToStorage(theKey.GetCFString(), theData);
+        CFRelease(theData);
+
+        if(theError != kAudioHardwareNoError)
+        {
+            LogWarning("RDC_ClientSettingsCache::Save: Failed to store the settings (%d)", theError);
+        }
+    }
+    catch(const CAException& e)
+    {
+        LogWarning("RDC_ClientSettingsCache::Save: Failed to encode the settings (%d)", e.GetError());
+    }
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,102 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_ClientSettingsCache.h
+//  RDCDriver
+//
+//  Keeps RDCDevice's per-app settings across coreaudiod restarts. Each device instance stores one
+//  CFData, keyed by its UID, in the host's storage (see CopyFromStorage and WriteToStorage in
+//  AudioServerPlugIn.h), which the HAL keeps on disk. The sandbox doesn't let the driver write
+//  anywhere else that would survive a restart.
+//
+//  The data is a compact binary encoding rather than a property list, so it stays small with many
+//  apps and loading it doesn't create a CF object per setting. All values are in host byte order,
+//  since the data never leaves the machine:
+//
+//      UInt32  kRDCClientSettingsCacheMagic
+//      UInt16  kRDCClientSettingsCacheVersion
+//      UInt16  The number of entries
+//      Then, for each entry:
+//          UInt8   The length of the bundle ID in bytes, at most kMaxBundleIDLength
+//          UInt8[] The bundle ID, in UTF-8, not terminated
+//          Float32 RDC_ClientSettings::mRelativeVolume
+//          SInt8   RDC_ClientSettings::mPanPosition
+//          SInt8   RDC_ClientSettings::mTapIndex
+//          UInt16  RDC_ClientSettings::mBusMask
+//
+//  Data with a different magic number or version, or that's truncated, is ignored as a whole.
+//
+
+#ifndef RDCDriver__RDC_ClientSettingsCache
+#define RDCDriver__RDC_ClientSettingsCache
+
+// PublicUtility Includes
+#include "CACFString.h"
+
+// STL Includes
+#include <map>
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+#include <MacTypes.h>
+
+
+#pragma clang assume_nonnull begin
+
+// The settings remembered for a bundle ID. The empty bundle ID holds the buses the mix of all
+// clients is on.
+struct RDC_ClientSettings
+{
+    // The gain, as in RDC_Client::mRelativeVolume.
+    Float32                         mRelativeVolume = 1.0f;
+    // In [kRDCAppPanLeftRawValue, kRDCAppPanRightRawValue].
+    SInt32                          mPanPosition = 0;
+    // The bundle ID's index in kAudioDeviceCustomPropertyTappedBundleIDs, or -1 if it isn't tapped.
+    SInt32                          mTapIndex = -1;
+    // Bit i is set if the bundle ID is at index i of kAudioDeviceCustomPropertyBusBundleIDs.
+    UInt16                          mBusMask = 0;
+};
+
+typedef std::map<CACFString, RDC_ClientSettings> RDC_ClientSettingsMap;
+
+namespace RDC_ClientSettingsCache
+{
+    static const UInt32             kRDCClientSettingsCacheMagic = 'rdcs';
+    static const UInt16             kRDCClientSettingsCacheVersion = 1;
+    // Longer bundle IDs aren't cached.
+    static const UInt32             kMaxBundleIDLength = UINT8_MAX;
+
+    /*!
+     @return A new CFData with inSettings in the format above. The caller is responsible for
+             releasing it.
+     @throws CAException if it couldn't be created.
+     */
+    CFDataRef                       CreateData(const RDC_ClientSettingsMap& inSettings);
+
+    /*! @return The settings in inData, or none if it isn't valid. */
+    RDC_ClientSettingsMap           ParseData(CFDataRef inData);
+
+    /*! @return The settings last saved for the device, or none if there aren't any. */
+    RDC_ClientSettingsMap           Load(CFStringRef inDeviceUID);
+
+    /*! Replace the settings saved for the device. Failures are logged and otherwise ignored. */
+    void                            Save(CFStringRef inDeviceUID, const RDC_ClientSettingsMap& inSettings);
+}
+
+#pragma clang assume_nonnull end
+
+#endif /* RDCDriver__RDC_ClientSettingsCache */
+
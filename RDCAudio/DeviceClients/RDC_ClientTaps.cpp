@@ -0,0 +1,197 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_ClientTaps.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_ClientTaps.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+#include "CACFArray.h"
+
+
+#pragma clang assume_nonnull begin
+
+RDC_ClientTaps::RDC_ClientTaps()
+{
+    for(UInt32 i = 0; i < kRDCMaxClientTaps; i++)
+    {
+        mTappedClientIDs[i].store(kNoClient, std::memory_order_relaxed);
+    }
+}
+
+void    RDC_ClientTaps::SetTappedBundleIDs(const std::vector<CACFString>& inBundleIDs,
+                                           UInt32 inBytesPerFrame,
+                                           UInt32 inFrameSize)
+{
+    ThrowIf(inBundleIDs.size() > kRDCMaxClientTaps,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_ClientTaps::SetTappedBundleIDs: Too many bundle IDs");
+
+    CAMutex::Locker theLocker(mMutex);
+
+    mBundleIDs = inBundleIDs;
+
+    // Stop the IO thread storing to any of the taps before we free them.
+    mNumberOfTaps = 0;
+
+    for(UInt32 i = 0; i < kRDCMaxClientTaps; i++)
+    {
+        mTappedClientIDs[i].store(kNoClient, std::memory_order_release);
+
+        if(i < mBundleIDs.size())
+        {
+            mRingBuffers[i].Allocate(1, inBytesPerFrame, inFrameSize);
+        }
+        else
+        {
+            mRingBuffers[i].Deallocate();
+        }
+    }
+
+    mNumberOfTaps = static_cast<UInt32>(mBundleIDs.size());
+
+    AssignClientsToTaps();
+}
+
+void    RDC_ClientTaps::Reallocate(UInt32 inBytesPerFrame, UInt32 inFrameSize)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    for(UInt32 i = 0; i < mNumberOfTaps; i++)
+    {
+        mRingBuffers[i].Allocate(1, inBytesPerFrame, inFrameSize);
+    }
+}
+
+void    RDC_ClientTaps::Clear()
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    for(UInt32 i = 0; i < mNumberOfTaps; i++)
+    {
+        mRingBuffers[i].Clear();
+    }
+}
+
+CFArrayRef  RDC_ClientTaps::CopyTappedBundleIDs() const
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    CACFArray theBundleIDs(static_cast<UInt32>(mBundleIDs.size()), true);
+
+    for(const CACFString& theBundleID : mBundleIDs)
+    {
+        theBundleIDs.AppendString(theBundleID.GetCFString());
+    }
+
+    return theBundleIDs.CopyCFArray();
+}
+
+SInt32  RDC_ClientTaps::GetTapIndex(CFStringRef __nullable inBundleID) const
+{
+    if(inBundleID == nullptr)
+    {
+        return -1;
+    }
+
+    CAMutex::Locker theLocker(mMutex);
+
+    for(UInt32 i = 0; i < mBundleIDs.size(); i++)
+    {
+        if(CFEqual(mBundleIDs[i].GetCFString(), inBundleID))
+        {
+            return static_cast<SInt32>(i);
+        }
+    }
+
+    return -1;
+}
+
+void    RDC_ClientTaps::AddClient(UInt32 inClientID, CFStringRef __nullable inBundleID)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    // CACFString takes ownership when it's constructed from a CFStringRef, but assigning retains.
+    CACFString theBundleID;
+    if(inBundleID != nullptr)
+    {
+        theBundleID = inBundleID;
+    }
+
+    mClients[inClientID] = theBundleID;
+
+    AssignClientsToTaps();
+}
+
+void    RDC_ClientTaps::RemoveClient(UInt32 inClientID)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    mClients.erase(inClientID);
+
+    AssignClientsToTaps();
+}
+
+void    RDC_ClientTaps::StoreRT(UInt32 inClientID,
+                                const AudioBufferList* inBufferList,
+                                UInt32 inFrameSize,
+                                CARingBuffer::SampleTime inSampleTime)
+{
+    // mNumberOfTaps only changes while IO is stopped, so it's safe to read here without the mutex.
+    for(UInt32 i = 0; i < mNumberOfTaps; i++)
+    {
+        if(mTappedClientIDs[i].load(std::memory_order_acquire) == inClientID)
+        {
+            // Like the main loopback buffer, ignore errors here. A failed store just leaves a gap,
+            // which the reader will get as silence.
+            mRingBuffers[i].Store(inBufferList, inFrameSize, inSampleTime);
+        }
+    }
+}
+
+CARingBuffer&   RDC_ClientTaps::GetTapRingBufferRT(SInt32 inTapIndex)
+{
+    Assert(inTapIndex >= 0 && static_cast<UInt32>(inTapIndex) < mNumberOfTaps,
+           "RDC_ClientTaps::GetTapRingBufferRT: Invalid tap index");
+    return mRingBuffers[inTapIndex];
+}
+
+void    RDC_ClientTaps::AssignClientsToTaps()
+{
+    for(UInt32 i = 0; i < mNumberOfTaps; i++)
+    {
+        UInt64 theClientID = kNoClient;
+
+        for(const auto& theClient : mClients)
+        {
+            if(theClient.second.IsValid() && theClient.second == mBundleIDs[i])
+            {
+                theClientID = theClient.first;
+                break;
+            }
+        }
+
+        mTappedClientIDs[i].store(theClientID, std::memory_order_release);
+    }
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,142 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_ClientTaps.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_ClientTaps__
+#define __RDCDriver__RDC_ClientTaps__
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CAMutex.h"
+#include "CACFString.h"
+#include "CARingBuffer.h"
+
+// STL Includes
+#include <atomic>
+#include <map>
+#include <vector>
+
+// System Includes
+#include <CoreAudio/AudioServerPlugIn.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_ClientTaps
+//
+//  A pool of ring buffers that capture the output of individual clients, before the HAL mixes it
+//  with the output of the other clients. Each tap is assigned a bundle ID and captures the
+//  audio that clients with that bundle ID send in kAudioServerPlugInIOOperationProcessOutput.
+//
+//  The ring buffers are allocated when the list of tapped bundle IDs is set, which only happens
+//  while the host has IO stopped, so the IO thread never allocates. Clients are matched to taps
+//  when they're added, so the IO thread only has to compare client IDs.
+//
+//  A tap captures one client at a time. If more than one client with the tapped bundle ID is
+//  registered, the tap captures the one that was registered first and moves to the next when that
+//  one is removed. (The HAL calls ProcessOutput for each client separately, so capturing several
+//  would mean mixing them here.)
+//
+//  Methods whose names end with "RT" should only be called from real-time threads.
+//==================================================================================================
+
+class RDC_ClientTaps
+{
+
+public:
+                                        RDC_ClientTaps();
+                                        ~RDC_ClientTaps() = default;
+                                        // Disallow copying
+                                        RDC_ClientTaps(const RDC_ClientTaps&) = delete;
+                                        RDC_ClientTaps& operator=(const RDC_ClientTaps&) = delete;
+
+    /*!
+     Replace the tapped bundle IDs and allocate a ring buffer for each of them. Any audio already
+     captured is dropped. Must only be called while IO is stopped.
+
+     @param inBundleIDs At most kRDCMaxClientTaps bundle IDs. An empty list disables tapping and
+                        frees the ring buffers.
+     @param inBytesPerFrame The size of each frame in the ring buffers.
+     @param inFrameSize The capacity of each ring buffer in frames.
+     */
+    void                                SetTappedBundleIDs(const std::vector<CACFString>& inBundleIDs,
+                                                           UInt32 inBytesPerFrame,
+                                                           UInt32 inFrameSize);
+    /*!
+     Reallocate the ring buffers of the current taps, e.g. after the device's format changes. Must
+     only be called while IO is stopped.
+     */
+    void                                Reallocate(UInt32 inBytesPerFrame, UInt32 inFrameSize);
+    /*!
+     Empty the ring buffers without reallocating them, e.g. after the sample rate changes. Must only
+     be called while IO is stopped.
+     */
+    void                                Clear();
+
+    /*! @return A new CFArray of the tapped bundle IDs. The caller is responsible for releasing it. */
+    CFArrayRef                          CopyTappedBundleIDs() const;
+    /*! @return The index of the tap for inBundleID, or -1 if that bundle ID isn't tapped. */
+    SInt32                              GetTapIndex(CFStringRef __nullable inBundleID) const;
+
+    void                                AddClient(UInt32 inClientID, CFStringRef __nullable inBundleID);
+    void                                RemoveClient(UInt32 inClientID);
+
+    /*! Copy the audio a client is outputting into its tap, if it has one. */
+    void                                StoreRT(UInt32 inClientID,
+                                                const AudioBufferList* inBufferList,
+                                                UInt32 inFrameSize,
+                                                CARingBuffer::SampleTime inSampleTime);
+    /*!
+     @return The ring buffer for the tap at inTapIndex, which must be less than the number of
+             tapped bundle IDs.
+     */
+    CARingBuffer&                       GetTapRingBufferRT(SInt32 inTapIndex);
+
+private:
+    // Point each tap at the earliest registered client with its bundle ID. mMutex must be held.
+    void                                AssignClientsToTaps();
+
+private:
+    // Sentinel for mTappedClientIDs. Wider than a client ID so it can't collide with a real one.
+    static const UInt64                 kNoClient = UINT64_MAX;
+
+    // Guards everything except mTappedClientIDs, which the IO thread reads.
+    CAMutex                             mMutex { "Client taps" };
+
+    // The tapped bundle IDs. The index of a bundle ID is the index of its tap.
+    std::vector<CACFString>             mBundleIDs;
+    // The bundle IDs of all registered clients, so taps can be reassigned when clients are removed.
+    // Ordered by client ID, which the HAL allocates in increasing order.
+    std::map<UInt32, CACFString>        mClients;
+
+    // The number of taps currently allocated. Only changed while IO is stopped.
+    UInt32                              mNumberOfTaps = 0;
+    CARingBuffer                        mRingBuffers[kRDCMaxClientTaps];
+    // The ID of the client each tap is capturing, or kNoClient.
+    std::atomic<UInt64>                 mTappedClientIDs[kRDCMaxClientTaps];
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_ClientTaps__ */
+
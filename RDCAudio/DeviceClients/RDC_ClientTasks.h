@@ -27,7 +27,6 @@
 
 // Local Includes
 #include "RDC_Clients.h"
-#include "RDC_ClientMap.h"
 
 
 // Forward Declarations
@@ -45,8 +44,6 @@ private:
     static bool                            StartIONonRT(RDC_Clients* inClients, UInt32 inClientID) { return inClients->StartIONonRT(inClientID); }
     static bool                            StopIONonRT(RDC_Clients* inClients, UInt32 inClientID) { return inClients->StopIONonRT(inClientID); }
     
-    static void                            SwapInShadowMapsRT(RDC_ClientMap* inClientMap) { inClientMap->SwapInShadowMapsRT(); }
-    
 };
 
 #pragma clang assume_nonnull end
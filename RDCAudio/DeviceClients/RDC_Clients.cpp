@@ -31,15 +31,23 @@
 // PublicUtility Includes
 #include "CAException.h"
 #include "CADispatchQueue.h"
+#include "CACFArray.h"
+#include "CAHostTimeBase.h"
+
+// STL Includes
+#include <vector>
 
 
 #pragma mark Construction/Destruction
 
-RDC_Clients::RDC_Clients(AudioObjectID inOwnerDeviceID, RDC_TaskQueue* inTaskQueue)
+RDC_Clients::RDC_Clients(AudioObjectID inOwnerDeviceID)
 :
-    mOwnerDeviceID(inOwnerDeviceID),
-    mClientMap(inTaskQueue)
+    mOwnerDeviceID(inOwnerDeviceID)
 {
+    mRelativeVolumeCurve.AddRange(kRDCAppRelativeVolumeMinRawValue,
+                                  kRDCAppRelativeVolumeMaxRawValue,
+                                  kRDCAppRelativeVolumeMinDbValue,
+                                  kRDCAppRelativeVolumeMaxDbValue);
 }
 
 #pragma mark Add/Remove Clients
@@ -58,6 +66,20 @@ void    RDC_Clients::RemoveClient(const UInt32 inClientID)
     mClientMap.RemoveClient(inClientID);
 }
 
+void    RDC_Clients::BeginBatch()
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    mClientMap.BeginBatchNonRT();
+}
+
+void    RDC_Clients::EndBatch()
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    mClientMap.EndBatchNonRT();
+}
+
 #pragma mark IO Status
 
 bool    RDC_Clients::StartIONonRT(UInt32 inClientID)
@@ -138,6 +160,294 @@ bool    RDC_Clients::ClientsRunningIO() const
     return mStartCount > 0;
 }
 
+#pragma mark App Volumes
+
+// Gets an SInt32 from one of the app volume dictionaries. Returns false if the key is missing or
+// its value isn't a CFNumber.
+static bool RDC_GetAppVolumesSInt32(CFDictionaryRef inAppVolume, CFStringRef inKey, SInt32& outValue)
+{
+    CFTypeRef theValue = CFDictionaryGetValue(inAppVolume, inKey);
+    
+    return (theValue != nullptr) &&
+           (CFGetTypeID(theValue) == CFNumberGetTypeID()) &&
+           CFNumberGetValue(static_cast<CFNumberRef>(theValue), kCFNumberSInt32Type, &outValue);
+}
+
+bool    RDC_Clients::SetClientsRelativeVolumes(CFArrayRef inAppVolumes)
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    struct AppVolume
+    {
+        bool        mHasPID = false;
+        pid_t       mPID = 0;
+        CACFString  mBundleID;
+        bool        mHasRelativeVolume = false;
+        Float32     mRelativeVolume = 1.0f;
+        bool        mHasPanPosition = false;
+        SInt32      mPanPosition = kRDCAppPanCenterRawValue;
+    };
+    
+    // Check every entry before changing anything, so an invalid one doesn't leave the others
+    // half-applied.
+    CACFArray theAppVolumesArray(inAppVolumes, false);
+    std::vector<AppVolume> theAppVolumes(theAppVolumesArray.GetNumberItems());
+    
+    for(UInt32 i = 0; i < theAppVolumesArray.GetNumberItems(); i++)
+    {
+        AppVolume& theAppVolume = theAppVolumes[i];
+        
+        CFDictionaryRef theDict = nullptr;
+        ThrowIf(!theAppVolumesArray.GetDictionary(i, theDict) || (theDict == nullptr),
+                RDC_InvalidClientRelativeVolumeException(),
+                "RDC_Clients::SetClientsRelativeVolumes: App volume was not a CFDictionary");
+        
+        SInt32 thePID;
+        theAppVolume.mHasPID = RDC_GetAppVolumesSInt32(theDict, CFSTR(kRDCAppVolumesKey_ProcessID), thePID);
+        theAppVolume.mPID = thePID;
+        
+        CFTypeRef theBundleID = CFDictionaryGetValue(theDict, CFSTR(kRDCAppVolumesKey_BundleID));
+        if((theBundleID != nullptr) && (CFGetTypeID(theBundleID) == CFStringGetTypeID()))
+        {
+            // Retain it, since it may be stored in the past clients map.
+            CFRetain(theBundleID);
+            theAppVolume.mBundleID = CACFString(static_cast<CFStringRef>(theBundleID));
+        }
+        
+        ThrowIf(!theAppVolume.mHasPID && !theAppVolume.mBundleID.IsValid(),
+                RDC_InvalidClientRelativeVolumeException(),
+                "RDC_Clients::SetClientsRelativeVolumes: No PID or bundle ID in app volume");
+        
+        SInt32 theRawRelativeVolume;
+        theAppVolume.mHasRelativeVolume =
+                RDC_GetAppVolumesSInt32(theDict, CFSTR(kRDCAppVolumesKey_RelativeVolume), theRawRelativeVolume);
+        
+        if(theAppVolume.mHasRelativeVolume)
+        {
+            ThrowIf(theRawRelativeVolume < kRDCAppRelativeVolumeMinRawValue ||
+                        theRawRelativeVolume > kRDCAppRelativeVolumeMaxRawValue,
+                    RDC_InvalidClientRelativeVolumeException(),
+                    "RDC_Clients::SetClientsRelativeVolumes: Relative volume for app out of valid range");
+            
+            // mRelativeVolumeCurve uses the default kPow2Over1Curve transfer function, so the
+            // midpoint maps to 0.25. Multiplying by 4 makes the midpoint unity gain and lets apps be
+            // boosted by up to 12 dB.
+            theAppVolume.mRelativeVolume =
+                    mRelativeVolumeCurve.ConvertRawToScalar(theRawRelativeVolume) * 4.0f;
+        }
+        
+        theAppVolume.mHasPanPosition =
+                RDC_GetAppVolumesSInt32(theDict, CFSTR(kRDCAppVolumesKey_PanPosition), theAppVolume.mPanPosition);
+        
+        ThrowIf(theAppVolume.mHasPanPosition &&
+                    (theAppVolume.mPanPosition < kRDCAppPanLeftRawValue ||
+                     theAppVolume.mPanPosition > kRDCAppPanRightRawValue),
+                RDC_InvalidClientPanPositionException(),
+                "RDC_Clients::SetClientsRelativeVolumes: Pan position for app out of valid range");
+    }
+    
+    bool didChangeAppVolumes = false;
+    
+    for(const AppVolume& theAppVolume : theAppVolumes)
+    {
+        // Set the app's clients by PID if it has one, since the HAL doesn't always know clients'
+        // bundle IDs. Use its bundle ID as well so the setting is remembered for it.
+        if(theAppVolume.mHasRelativeVolume)
+        {
+            if(theAppVolume.mHasPID)
+            {
+                didChangeAppVolumes |= mClientMap.SetClientsRelativeVolume(theAppVolume.mPID,
+                                                                           theAppVolume.mRelativeVolume);
+            }
+            
+            if(theAppVolume.mBundleID.IsValid())
+            {
+                mClientMap.SetClientsRelativeVolume(theAppVolume.mBundleID, theAppVolume.mRelativeVolume);
+                didChangeAppVolumes = true;
+            }
+        }
+        
+        if(theAppVolume.mHasPanPosition)
+        {
+            if(theAppVolume.mHasPID)
+            {
+                didChangeAppVolumes |= mClientMap.SetClientsPanPosition(theAppVolume.mPID,
+                                                                        theAppVolume.mPanPosition);
+            }
+            
+            if(theAppVolume.mBundleID.IsValid())
+            {
+                mClientMap.SetClientsPanPosition(theAppVolume.mBundleID, theAppVolume.mPanPosition);
+                didChangeAppVolumes = true;
+            }
+        }
+    }
+    
+    return didChangeAppVolumes;
+}
+
+CFArrayRef  RDC_Clients::CopyClientRelativeVolumesAsAppVolumes() const
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    std::vector<RDC_Client> theClients = mClientMap.GetClientsAndPastClientsNonRT();
+    
+    CACFArray theAppVolumes(static_cast<UInt32>(theClients.size()), true);
+    
+    for(const RDC_Client& theClient : theClients)
+    {
+        CFMutableDictionaryRef theAppVolume =
+                CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                          0,
+                                          &kCFTypeDictionaryKeyCallBacks,
+                                          &kCFTypeDictionaryValueCallBacks);
+        ThrowIfNULL(theAppVolume,
+                    CAException(kAudioHardwareUnspecifiedError),
+                    "RDC_Clients::CopyClientRelativeVolumesAsAppVolumes: failed to create a dictionary");
+        
+        auto addSInt32 = [theAppVolume](CFStringRef inKey, SInt32 inValue) {
+            CFNumberRef theNumber = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &inValue);
+            if(theNumber != nullptr)
+            {
+                CFDictionarySetValue(theAppVolume, inKey, theNumber);
+                CFRelease(theNumber);
+            }
+        };
+        
+        // Past clients that have never been added only have a bundle ID.
+        if(theClient.mProcessID != 0)
+        {
+            addSInt32(CFSTR(kRDCAppVolumesKey_ProcessID), theClient.mProcessID);
+        }
+        
+        if(theClient.mBundleID.IsValid())
+        {
+            CFDictionarySetValue(theAppVolume,
+                                 CFSTR(kRDCAppVolumesKey_BundleID),
+                                 theClient.mBundleID.GetCFString());
+        }
+        
+        // Undo the scaling in SetClientsRelativeVolumes.
+        addSInt32(CFSTR(kRDCAppVolumesKey_RelativeVolume),
+                  mRelativeVolumeCurve.ConvertScalarToRaw(theClient.mRelativeVolume / 4.0f));
+        addSInt32(CFSTR(kRDCAppVolumesKey_PanPosition), theClient.mPanPosition);
+        
+        theAppVolumes.AppendDictionary(theAppVolume);
+        CFRelease(theAppVolume);
+    }
+    
+    return theAppVolumes.CopyCFArray();
+}
+
+bool    RDC_Clients::GetClientRelativeVolumeAndPanRT(UInt32 inClientID,
+                                                     Float32& outRelativeVolume,
+                                                     SInt32& outPanPosition) const
+{
+    return mClientMap.GetClientRelativeVolumeAndPanRT(inClientID, outRelativeVolume, outPanPosition);
+}
+
+void    RDC_Clients::SetClientsReadDelay(CFStringRef inBundleID, UInt32 inReadDelayFrames)
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    // Retain it, since it's stored in the past clients map.
+    CFRetain(inBundleID);
+    mClientMap.SetClientsReadDelay(CACFString(inBundleID), inReadDelayFrames);
+}
+
+bool    RDC_Clients::GetClientReadDelayRT(UInt32 inClientID, UInt32& outReadDelayFrames) const
+{
+    return mClientMap.GetClientReadDelayRT(inClientID, outReadDelayFrames);
+}
+
+UInt32  RDC_Clients::GetClientIOStateSlotRT(UInt32 inClientID) const
+{
+    return mClientMap.GetClientIOStateSlotRT(inClientID);
+}
+
+std::vector<RDC_Client>  RDC_Clients::GetPastClientRelativeVolumes() const
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    return mClientMap.GetPastClientsNonRT();
+}
+
+void    RDC_Clients::AddPastClientRelativeVolumes(const std::vector<RDC_Client>& inPastClients)
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    mClientMap.AddPastClientsNonRT(inPastClients);
+}
+
+void    RDC_Clients::AddIOTimeRT(UInt32 inClientID, UInt64 inHostTicks)
+{
+    mClientMap.AddIOTimeRT(inClientID, inHostTicks);
+}
+
+CFArrayRef  RDC_Clients::CopyClientIOTimes() const
+{
+    CAMutex::Locker theLocker(mMutex);
+    
+    auto theIOTimes = mClientMap.GetClientIOTimesNonRT();
+    
+    CACFArray theArray(static_cast<UInt32>(theIOTimes.size()), true);
+    
+    for(const auto& theClientIOTime : theIOTimes)
+    {
+        const RDC_Client& theClient = theClientIOTime.first;
+        const RDC_ClientMap::RDC_ClientIOTime& theIOTime = theClientIOTime.second;
+        
+        CFMutableDictionaryRef theDict =
+                CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                          0,
+                                          &kCFTypeDictionaryKeyCallBacks,
+                                          &kCFTypeDictionaryValueCallBacks);
+        ThrowIfNULL(theDict,
+                    CAException(kAudioHardwareUnspecifiedError),
+                    "RDC_Clients::CopyClientIOTimes: failed to create a dictionary");
+        
+        auto addSInt64 = [theDict](CFStringRef inKey, SInt64 inValue) {
+            CFNumberRef theNumber = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &inValue);
+            if(theNumber != nullptr)
+            {
+                CFDictionarySetValue(theDict, inKey, theNumber);
+                CFRelease(theNumber);
+            }
+        };
+        
+        addSInt64(CFSTR(kRDCClientIOTimesKey_ClientID), theClient.mClientID);
+        addSInt64(CFSTR(kRDCClientIOTimesKey_ProcessID), theClient.mProcessID);
+        
+        if(theClient.mBundleID.IsValid())
+        {
+            CFDictionarySetValue(theDict,
+                                 CFSTR(kRDCClientIOTimesKey_BundleID),
+                                 theClient.mBundleID.GetCFString());
+        }
+        
+        addSInt64(CFSTR(kRDCClientIOTimesKey_TotalTime),
+                  static_cast<SInt64>(CAHostTimeBase::ConvertToNanos(theIOTime.mTotalHostTicks)));
+        addSInt64(CFSTR(kRDCClientIOTimesKey_MaxTime),
+                  static_cast<SInt64>(CAHostTimeBase::ConvertToNanos(theIOTime.mMaxHostTicks)));
+        addSInt64(CFSTR(kRDCClientIOTimesKey_Operations), static_cast<SInt64>(theIOTime.mOperations));
+        
+        theArray.AppendDictionary(theDict);
+        CFRelease(theDict);
+    }
+    
+    return theArray.CopyCFArray();
+}
+
+void    RDC_Clients::ResetClientIOTimes()
+{
+    mClientMap.ResetIOTimesNonRT();
+}
+
+bool    RDC_Clients::SetRequestedIOStateRT(UInt32 inClientID, bool inDoingIO)
+{
+    return mClientMap.SetRequestedIOStateRT(inClientID, inDoingIO);
+}
+
 void    RDC_Clients::SendIORunningNotifications(bool sendIsRunningNotification, bool sendIsRunningSomewhereOtherThanRDCAppNotification) const
 {
     if(sendIsRunningNotification)
@@ -31,6 +31,9 @@
 #include "CAVolumeCurve.h"
 #include "CAMutex.h"
 
+// STL Includes
+#include <atomic>
+
 // System Includes
 #include <CoreAudio/AudioServerPlugIn.h>
 
@@ -57,7 +60,7 @@ class RDC_Clients
     friend class RDC_ClientTasks;
     
 public:
-                                        RDC_Clients(AudioObjectID inOwnerDeviceID, RDC_TaskQueue* inTaskQueue);
+                                        RDC_Clients(AudioObjectID inOwnerDeviceID);
                                         ~RDC_Clients() = default;
     // Disallow copying. (It could make sense to implement these in future, but we don't need them currently.)
                                         RDC_Clients(const RDC_Clients&) = delete;
@@ -66,6 +69,21 @@ public:
     void                                AddClient(RDC_Client inClient);
     void                                RemoveClient(const UInt32 inClientID);
     
+    /*!
+     Start a batch of AddClient and RemoveClient calls. Until the matching EndBatch, their changes
+     aren't handed to the real-time threads, which costs a wait for the IO thread each time, and
+     EndBatch hands them over all at once. Real-time threads meanwhile see the clients as they were
+     before the batch, so a batch shouldn't be held open for long. Batches can be nested.
+     
+     StartIONonRT and StopIONonRT still take effect immediately, including for clients added in the
+     batch.
+     */
+    void                                BeginBatch();
+    void                                EndBatch();
+    
+    /*! @return How many times the clients have been handed to the real-time threads. Real-time safe. */
+    UInt64                              GetSnapshotPublishCount() const { return mClientMap.GetSnapshotPublishCount(); }
+    
 private:
     // Only RDC_TaskQueue is allowed to call these (through the RDC_ClientTasks interface). We get notifications
     // from the HAL when clients start/stop IO and they have to be processed in the order we receive them to
@@ -76,6 +94,85 @@ private:
 public:
     bool                                ClientsRunningIO() const;
     
+    /*!
+     Set the relative volumes and/or pan positions of apps' clients. Apps without clients yet are
+     remembered by bundle ID. See kAudioDeviceCustomPropertyAppVolumes.
+
+     @param inAppVolumes A CFArray of CFDictionaries with the kRDCAppVolumesKey_* keys.
+     @return True if any settings were changed.
+     @throws RDC_InvalidClientRelativeVolumeException If an app has no PID or bundle ID, or an
+                                                      invalid relative volume. Nothing is changed.
+     @throws RDC_InvalidClientPanPositionException If an app has an invalid pan position. Nothing is
+                                                   changed.
+     */
+    bool                                SetClientsRelativeVolumes(CFArrayRef inAppVolumes);
+    /*!
+     @return A new CFArray in the format of kAudioDeviceCustomPropertyAppVolumes with an entry for
+             each client and each remembered bundle ID. The caller is responsible for releasing it.
+     */
+    CFArrayRef                          CopyClientRelativeVolumesAsAppVolumes() const;
+    
+    /*!
+     Get the gain and pan position to apply to a client's audio. Real-time safe.
+
+     @return False if the client wasn't found, in which case the outputs aren't changed.
+     */
+    bool                                GetClientRelativeVolumeAndPanRT(UInt32 inClientID,
+                                                                        Float32& outRelativeVolume,
+                                                                        SInt32& outPanPosition) const;
+    
+    /*!
+     Set how many frames behind the HAL's sample time clients with a bundle ID read the input
+     stream. Apps without clients yet are remembered. See kAudioDeviceCustomPropertyReadDelays.
+     */
+    void                                SetClientsReadDelay(CFStringRef inBundleID, UInt32 inReadDelayFrames);
+    /*!
+     Get a client's read delay. Real-time safe.
+
+     @return False if the client wasn't found, in which case outReadDelayFrames isn't changed.
+     */
+    bool                                GetClientReadDelayRT(UInt32 inClientID, UInt32& outReadDelayFrames) const;
+    /*!
+     Get the client's IO state slot, for state the device keeps per client that real-time threads
+     use. A slot is only reused after its client has been removed. Real-time safe.
+
+     @return The slot, in [0, kRDCIOStateSlotCount), or kRDCNoIOStateSlot if the client wasn't
+             found or has no slot.
+     */
+    UInt32                              GetClientIOStateSlotRT(UInt32 inClientID) const;
+    
+    /*!
+     @return The past clients, which hold the relative volume and pan position remembered for each
+             bundle ID.
+     */
+    std::vector<RDC_Client>             GetPastClientRelativeVolumes() const;
+    /*!
+     Remember the relative volumes and pan positions of apps, e.g. ones saved before coreaudiod
+     restarted, so their clients get them when they're added. Settings already remembered for the
+     same bundle IDs take precedence.
+
+     @param inPastClients Clients with mBundleID, mRelativeVolume and mPanPosition set.
+     */
+    void                                AddPastClientRelativeVolumes(const std::vector<RDC_Client>& inPastClients);
+    
+    /*! Add the time one of a client's IO operations took to its total. Real-time safe. */
+    void                                AddIOTimeRT(UInt32 inClientID, UInt64 inHostTicks);
+    /*!
+     @return A new CFArray in the format of kAudioDeviceCustomPropertyClientIOTimes. The caller is
+             responsible for releasing it.
+     */
+    CFArrayRef                          CopyClientIOTimes() const;
+    void                                ResetClientIOTimes();
+    
+    /*!
+     Record that the HAL has started or stopped IO for a client. Real-time safe. The client's
+     mDoingIO isn't updated until StartIONonRT or StopIONonRT is called.
+
+     @return True if this changes the client's IO state, i.e. the task that calls StartIONonRT or
+             StopIONonRT should be queued.
+     */
+    bool                                SetRequestedIOStateRT(UInt32 inClientID, bool inDoingIO);
+    
 private:
     void                                SendIORunningNotifications(bool sendIsRunningNotification, bool sendIsRunningSomewhereOtherThanRDCAppNotification) const;
             
@@ -89,9 +186,14 @@ private:
     // We need to reference count this rather than just using a bool because the HAL might (but usually
     // doesn't) call our StartIO/StopIO functions for clients other than the first to start and last to
     // stop.
-    UInt64                              mStartCount = 0;
+    //
+    // Only changed with mMutex held, but atomic so ClientsRunningIO can read it without the lock.
+    std::atomic<UInt64>                 mStartCount { 0 };
+    
+    // Converts kRDCAppVolumesKey_RelativeVolume values to gains.
+    CAVolumeCurve                       mRelativeVolumeCurve;
     
-    CAMutex                             mMutex { "Clients" };
+    CAUnfairMutex                       mMutex { "Clients" };
 };
 
 #pragma clang assume_nonnull end
@@ -32,64 +32,414 @@
 
 // Local Includes
 #include "RDC_PlugIn.h"
+#include "RDC_LoopbackRouter.h"
 #include "RDC_Utils.h"
+#include "RDC_SampleConversion.h"
+#include "RDC_Signposts.h"
+#include "RDC_RTSafety.h"
+#include "RDC_ClientSettingsCache.h"
 
 // PublicUtility Includes
 #include "CADispatchQueue.h"
 #include "CACFArray.h"
 #include "CADebugMacros.h"
 #include "CAHostTimeBase.h"
+#include "CABitOperations.h"
 
 // STL Includes
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
 #include <stdexcept>
 
 // System Includes
 #include <CoreAudio/AudioHardwareBase.h>
+#include <Accelerate/Accelerate.h>
 
 
+// Used by the custom properties that are a single number. Returns a new CFNumber (SInt32).
+static CFNumberRef RDC_CreateCFNumber(UInt32 inValue)
+{
+    SInt32 theValue = static_cast<SInt32>(inValue);
+    return CFNumberCreate(nullptr, kCFNumberSInt32Type, &theValue);
+}
+
+// The custom properties RDCDevice reports in kAudioObjectPropertyCustomPropertyInfoList, in the
+// order it reports them. They're all CFPropertyLists without qualifiers.
+const RDC_Device::RDC_CustomProperty RDC_Device::sCustomProperties[] = {
+    { kAudioDeviceCustomPropertyEnabledOutputControls, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyEnabledOutputControls(); } },
+    { kAudioDeviceCustomPropertyChannelCount, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetChannelCount()); } },
+    { kAudioDeviceCustomPropertyLoopbackBufferFrameSize, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetLoopbackBufferFrameSize()); } },
+    { kAudioDeviceCustomPropertyLoopbackBufferDuration, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetLoopbackBufferMilliseconds()); } },
+    { kAudioDeviceCustomPropertyZeroTimeStampPeriod, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetZeroTimeStampPeriod()); } },
+    { kAudioDeviceCustomPropertyLoopbackStats, false,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyLoopbackStats(); } },
+    { kAudioDeviceCustomPropertyTappedBundleIDs, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyTappedBundleIDs(); } },
+    { kAudioDeviceCustomPropertyInputTapBundleID, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyInputTapBundleID(); } },
+    { kAudioDeviceCustomPropertySharedLoopbackName, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopySharedLoopbackName(); } },
+    { kAudioDeviceCustomPropertyLoopbackStorageBitDepth, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetLoopbackStorageBitDepth()); } },
+    { kAudioDeviceCustomPropertyAppVolumes, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.mClients.CopyClientRelativeVolumesAsAppVolumes(); } },
+    // Reading the levels resets the peaks, which is why the meter is mutable.
+    { kAudioDeviceCustomPropertyLoopbackLevels, false,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.mLoopbackLevelMeter.CopyLevels(); } },
+    { kAudioDeviceCustomPropertyBusBundleIDs, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyBusBundleIDs(); } },
+    { kAudioDeviceCustomPropertyTaskLatencies, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.mTaskQueue.CopyTaskLatencies(); } },
+    { kAudioDeviceCustomPropertyClockSource, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyClockSource(); } },
+    { kAudioDeviceCustomPropertyDriftCompensation, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef {
+          return inDevice.mDriftCompensator.IsEnabledRT() ? kCFBooleanTrue : kCFBooleanFalse;
+      } },
+    { kAudioDeviceCustomPropertyLatencyOverrides, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyLatencyOverrides(); } },
+    { kAudioDeviceCustomPropertySignposts, true,
+      [](const RDC_Device&) -> CFPropertyListRef {
+          return RDC_Signposts::IsEnabled() ? kCFBooleanTrue : kCFBooleanFalse;
+      } },
+    { kAudioDeviceCustomPropertyIOTrace, false,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef {
+          UInt64 theNow = CAHostTimeBase::GetTheCurrentTime();
+          UInt64 theSnapshotLength =
+                  CAHostTimeBase::ConvertFromNanos(static_cast<UInt64>(kRDCIOTraceSnapshotSeconds) * NSEC_PER_SEC);
+          return inDevice.mIOTrace.CopySnapshot((theNow > theSnapshotLength) ? theNow - theSnapshotLength : 0);
+      } },
+    { kAudioDeviceCustomPropertyRecordingPath, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyRecordingPath(); } },
+    { kAudioDeviceCustomPropertyRTPSender, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.mRTPSender.CopyConfiguration(); } },
+    { kAudioDeviceCustomPropertyLoopbackStoragePlanar, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef {
+          return inDevice.IsLoopbackStoragePlanar() ? kCFBooleanTrue : kCFBooleanFalse;
+      } },
+    { kAudioDeviceCustomPropertyReadDelays, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyReadDelays(); } },
+    { kAudioDeviceCustomPropertyLoopbackBufferWired, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef {
+          return inDevice.IsLoopbackBufferWired() ? kCFBooleanTrue : kCFBooleanFalse;
+      } },
+    { kAudioDeviceCustomPropertyLoopbackIdleTimeout, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetLoopbackIdleTimeout()); } },
+    { kAudioDeviceCustomPropertyClientIOTimes, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.mClients.CopyClientIOTimes(); } },
+    { kAudioDeviceCustomPropertyRetroCaptureSeconds, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetRetroCaptureSeconds()); } },
+    { kAudioDeviceCustomPropertyRetroCaptureSavePath, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyRetroCaptureSavePath(); } },
+    { kAudioDeviceCustomPropertyRetroCaptureSaveSeconds, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return RDC_CreateCFNumber(inDevice.GetRetroCaptureSaveSeconds()); } },
+    { kAudioDeviceCustomPropertyReducedInputChannels, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef { return inDevice.CopyReducedInputChannels(); } },
+    { kAudioDeviceCustomPropertyLoopbackTimeStamps, false,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef {
+          return RDC_LoopbackTimeStamps::CopyEntries(inDevice.mLoopbackTimeStamps);
+      } },
+    { kAudioDeviceCustomPropertySharedLoopbackWorldReadable, true,
+      [](const RDC_Device& inDevice) -> CFPropertyListRef {
+          return inDevice.IsSharedLoopbackWorldReadable() ? kCFBooleanTrue : kCFBooleanFalse;
+      } }
+};
+
+const UInt32 RDC_Device::kNumberOfCustomProperties = sizeof(sCustomProperties) / sizeof(sCustomProperties[0]);
+
+//static
+const RDC_Device::RDC_CustomProperty* RDC_Device::FindCustomProperty(AudioObjectPropertySelector inSelector)
+{
+    // There are few enough of these that a linear search over the table, which fits in a few cache
+    // lines, is quicker than anything cleverer.
+    for(UInt32 i = 0; i < kNumberOfCustomProperties; i++)
+    {
+        if(sCustomProperties[i].mSelector == inSelector)
+        {
+            return &sCustomProperties[i];
+        }
+    }
+
+    return nullptr;
+}
+
+// Used by the custom properties that take a single positive number. Returns the value of the
+// CFNumber in inData or throws if it isn't a positive CFNumber.
+static UInt32 RDC_GetPositiveCFNumberValue(UInt32 inDataSize, const void* inData)
+{
+    ThrowIf(inDataSize < sizeof(CFNumberRef),
+            CAException(kAudioHardwareBadPropertySizeError),
+            "RDC_Device::Device_SetPropertyData: wrong size for the data for a CFNumber property");
+
+    CFNumberRef theNumberRef = *reinterpret_cast<const CFNumberRef*>(inData);
+
+    ThrowIfNULL(theNumberRef,
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_Device::Device_SetPropertyData: null reference given for a CFNumber property");
+    ThrowIf(CFGetTypeID(theNumberRef) != CFNumberGetTypeID(),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::Device_SetPropertyData: CFType given for a CFNumber property was not a "
+            "CFNumber");
+
+    SInt32 theValue = 0;
+    bool didGetNumber = CFNumberGetValue(theNumberRef, kCFNumberSInt32Type, &theValue);
+    ThrowIf(!didGetNumber || theValue < 1,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::Device_SetPropertyData: Invalid value given for a CFNumber property");
+
+    return static_cast<UInt32>(theValue);
+}
+
 #pragma mark Construction/Destruction
 
 pthread_once_t				RDC_Device::sStaticInitializer = PTHREAD_ONCE_INIT;
-RDC_Device*					RDC_Device::sInstance = nullptr;
+std::atomic<RDC_Device*>	RDC_Device::sInstances[kRDCMaxDeviceCount] = {};
+std::atomic<UInt32>			RDC_Device::sNumberOfInstances { 0 };
+UInt32						RDC_Device::sNumberOfCreatedInstances = 0;
+std::atomic<RDC_Device*>	RDC_Device::sOwnersByObjectID[kMaxObjectID] = {};
+const UInt32				RDC_Device::kLoopbackConversionChunkFrameSize;
 
 RDC_Device&	RDC_Device::GetInstance()
+{
+    return GetInstanceAtIndex(0);
+}
+
+UInt32	RDC_Device::GetNumberOfInstances()
+{
+    pthread_once(&sStaticInitializer, StaticInitializer);
+    // Acquire, so the instances are visible to threads that see them published.
+    return sNumberOfInstances.load(std::memory_order_acquire);
+}
+
+void	RDC_Device::SetNumberOfInstances(UInt32 inNumberOfInstances)
+{
+    ThrowIf(inNumberOfInstances < 1 || inNumberOfInstances > kRDCMaxDeviceCount,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::SetNumberOfInstances: Invalid number of instances");
+
+    UInt32 theCurrentNumber = GetNumberOfInstances();
+
+    // Check there are object IDs left for all of the new instances before creating any, so running
+    // out can't stop it part way through. (The main instance has fixed IDs.)
+    UInt32 theFirstIndexToCreate = std::max(sNumberOfCreatedInstances, 1U);
+    if(inNumberOfInstances > theFirstIndexToCreate)
+    {
+        UInt32 theIDsNeeded = (inNumberOfInstances - theFirstIndexToCreate) * kNumberOfObjectIDsPerInstance;
+        ThrowIf(RDC_PlugIn::GetNextObjectID() + theIDsNeeded > kMaxObjectID,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_Device::SetNumberOfInstances: Not enough object IDs left for the new instances");
+    }
+
+    // Create the new instances, but only add them once they've all been created. If one fails, the
+    // others are destroyed, which is safe because nothing else can have seen them yet.
+    std::vector<RDC_Device*> theNewInstances;
+
+    for(UInt32 theIndex = sNumberOfCreatedInstances; theIndex < inNumberOfInstances; theIndex++)
+    {
+        RDC_Device* theDevice = CreateAndActivateInstance(theIndex);
+
+        if(theDevice == nullptr)
+        {
+            for(RDC_Device* theNewInstance : theNewInstances)
+            {
+                theNewInstance->Deactivate();
+                delete theNewInstance;
+            }
+
+            LogError("RDC_Device::SetNumberOfInstances: Failed to create instance %u", theIndex);
+            Throw(CAException(kAudioHardwareUnspecifiedError));
+        }
+
+        theNewInstances.push_back(theDevice);
+    }
+
+    for(RDC_Device* theNewInstance : theNewInstances)
+    {
+        AddCreatedInstance(theNewInstance);
+    }
+
+    // Hold the state mutexes of the instances being hidden until the new count is published. StartIO
+    // holds its instance's while it checks whether the instance is hidden, so none of them can start
+    // IO in between the check below and being hidden.
+    std::vector<std::unique_ptr<CAMutex::Locker>> theHiddenInstanceLockers;
+
+    for(UInt32 theIndex = inNumberOfInstances; theIndex < theCurrentNumber; theIndex++)
+    {
+        RDC_Device& theDevice = GetInstanceAtIndex(theIndex);
+        theHiddenInstanceLockers.emplace_back(new CAMutex::Locker(theDevice.mStateMutex));
+
+        // The host would keep running IO on a device it can't see any more.
+        ThrowIf(theDevice.mClients.ClientsRunningIO(),
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_Device::SetNumberOfInstances: Can't hide an instance while it's doing IO");
+    }
+
+    if(inNumberOfInstances < theCurrentNumber)
+    {
+        // The hidden instances' UIDs can't be looked up any more, so their routes would be stuck.
+        RDC_LoopbackRouter::GetInstance().RemoveInstancesNonRT(inNumberOfInstances);
+    }
+
+    DebugMsg("RDC_Device::SetNumberOfInstances: Publishing %u instances (was %u)",
+             inNumberOfInstances,
+             theCurrentNumber);
+
+    sNumberOfInstances.store(inNumberOfInstances, std::memory_order_release);
+}
+
+RDC_Device&	RDC_Device::GetInstanceAtIndex(UInt32 inIndex)
 {
     pthread_once(&sStaticInitializer, StaticInitializer);
-    return *sInstance;
+    RDC_Device* theInstance =
+            (inIndex < kRDCMaxDeviceCount) ? sInstances[inIndex].load(std::memory_order_acquire) : nullptr;
+    Assert(theInstance != nullptr, "RDC_Device::GetInstanceAtIndex: No instance at that index");
+    return *theInstance;
+}
+
+RDC_Device*	RDC_Device::LookUpInstance(AudioObjectID inDeviceID)
+{
+    RDC_Device* theOwner = LookUpOwnerOfObject(inDeviceID);
+    return (theOwner != nullptr && theOwner->GetObjectID() == inDeviceID) ? theOwner : nullptr;
+}
+
+RDC_Device*	RDC_Device::LookUpOwnerOfObject(AudioObjectID inObjectID)
+{
+    // Make sure the instances have been created.
+    GetNumberOfInstances();
+
+    return (inObjectID < kMaxObjectID) ? sOwnersByObjectID[inObjectID].load(std::memory_order_acquire) : nullptr;
+}
+
+RDC_Device*	RDC_Device::LookUpInstanceByUID(CFStringRef inDeviceUID)
+{
+    for(UInt32 theIndex = 0; theIndex < GetNumberOfInstances(); theIndex++)
+    {
+        RDC_Device& theInstance = GetInstanceAtIndex(theIndex);
+
+        if(CFEqual(inDeviceUID, theInstance.CopyDeviceUID()))
+        {
+            return &theInstance;
+        }
+    }
+
+    return nullptr;
 }
 
 void	RDC_Device::StaticInitializer()
 {
+    UInt32 theDeviceCount = RDC_PlugIn::GetConfiguredDeviceCount();
+
+    // The instances have to be contiguous in sInstances, so stop at the first that fails.
+    while(sNumberOfCreatedInstances < theDeviceCount)
+    {
+        RDC_Device* theDevice = CreateAndActivateInstance(sNumberOfCreatedInstances);
+
+        if(theDevice == nullptr)
+        {
+            break;
+        }
+
+        AddCreatedInstance(theDevice);
+    }
+
+    sNumberOfInstances.store(sNumberOfCreatedInstances, std::memory_order_release);
+}
+
+RDC_Device*	RDC_Device::CreateAndActivateInstance(UInt32 inIndex)
+{
+    RDC_Device* theDevice = nullptr;
+
     try
     {
-        // The main instance, usually referred to in the code as "RDCDevice". This is the device
-        // that appears in System Preferences as "Background Music".
-        sInstance = new RDC_Device(kObjectID_Device,
-                                   CFSTR(kDeviceName),
-								   CFSTR(kRDCDeviceUID),
-								   CFSTR(kRDCDeviceModelUID),
-                                   kObjectID_Stream_Input,
-                                   kObjectID_Stream_Output,
-								   kObjectID_Volume_Output_Master,
-								   kObjectID_Mute_Output_Master);
-        
-        // Set up the UI sounds device's volume control.
-        RDC_VolumeControl& volumeControl = sInstance->mVolumeControl;
+        theDevice = CreateInstance(inIndex);
+        theDevice->mInstanceIndex = inIndex;
+
+        // Set up the device's volume control.
+        RDC_VolumeControl& volumeControl = theDevice->mVolumeControl;
         // Default to full volume.
         volumeControl.SetVolumeScalar(1.0f);
         // Make the volume curve a bit steeper than the default.
         volumeControl.GetVolumeCurve().SetTransferFunction(CAVolumeCurve::kPow2Over1Curve);
         volumeControl.SetWillApplyVolumeToAudio(true);
 
-        sInstance->Activate();
+        theDevice->Activate();
     }
     catch(...)
     {
-        DebugMsg("RDC_Device::StaticInitializer: failed to create the devices");
+        DebugMsg("RDC_Device::CreateAndActivateInstance: failed to create device %u", inIndex);
+
+        delete theDevice;
+        return nullptr;
+    }
+
+    return theDevice;
+}
+
+void	RDC_Device::AddCreatedInstance(RDC_Device* inDevice)
+{
+    Assert(inDevice->mInstanceIndex == sNumberOfCreatedInstances,
+           "RDC_Device::AddCreatedInstance: Instances have to be added in order");
+
+    for(AudioObjectID theObjectID = 0; theObjectID < kMaxObjectID; theObjectID++)
+    {
+        if(inDevice->IsOwnObjectID(theObjectID))
+        {
+            sOwnersByObjectID[theObjectID].store(inDevice, std::memory_order_release);
+        }
+    }
+
+    sInstances[inDevice->mInstanceIndex].store(inDevice, std::memory_order_release);
+    sNumberOfCreatedInstances++;
+}
 
-        delete sInstance;
-        sInstance = nullptr;
+RDC_Device*	RDC_Device::CreateInstance(UInt32 inIndex)
+{
+    if(inIndex == 0)
+    {
+        // The main instance, usually referred to in the code as "RDCDevice". It keeps the fixed
+        // object IDs and UID so existing clients can still find it.
+        return new RDC_Device(kObjectID_Device,
+                              CFSTR(kDeviceName),
+                              CFSTR(kRDCDeviceUID),
+                              CFSTR(kRDCDeviceModelUID),
+                              kObjectID_Stream_Input,
+                              kObjectID_Stream_Input_Reduced,
+                              kObjectID_Stream_Output,
+                              kObjectID_Volume_Output_Master,
+                              kObjectID_Mute_Output_Master);
     }
+
+    AudioObjectID theFirstID = RDC_PlugIn::AllocateObjectIDs(kNumberOfObjectIDsPerInstance);
+    ThrowIf(theFirstID + kNumberOfObjectIDsPerInstance > kMaxObjectID,
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_Device::CreateInstance: Ran out of object IDs");
+
+    // Number the additional instances from 2 so the main instance is implicitly number 1. These
+    // strings are never released because the instances are never destroyed.
+    CFStringRef theName =
+        CFStringCreateWithFormat(nullptr, nullptr, CFSTR("%s %u"), kDeviceName, inIndex + 1);
+    CFStringRef theUID =
+        CFStringCreateWithFormat(nullptr, nullptr, CFSTR("%s_%u"), kRDCDeviceUID, inIndex + 1);
+    ThrowIf(theName == nullptr || theUID == nullptr,
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_Device::CreateInstance: Failed to create the device's name or UID");
+
+    return new RDC_Device(theFirstID,
+                          theName,
+                          theUID,
+                          CFSTR(kRDCDeviceModelUID),
+                          theFirstID + 1,
+                          theFirstID + 5,
+                          theFirstID + 2,
+                          theFirstID + 3,
+                          theFirstID + 4);
 }
 
 RDC_Device::RDC_Device(AudioObjectID inObjectID,
@@ -97,6 +447,7 @@ RDC_Device::RDC_Device(AudioObjectID inObjectID,
 					   const CFStringRef __nonnull inDeviceUID,
 					   const CFStringRef __nonnull inDeviceModelUID,
                        AudioObjectID inInputStreamID,
+                       AudioObjectID inReducedInputStreamID,
                        AudioObjectID inOutputStreamID,
 					   AudioObjectID inOutputVolumeControlID,
 					   AudioObjectID inOutputMuteControlID)
@@ -108,14 +459,34 @@ RDC_Device::RDC_Device(AudioObjectID inObjectID,
 	mDeviceUID(inDeviceUID),
 	mDeviceModelUID(inDeviceModelUID),
     mWrappedAudioEngine(nullptr),
-    mClients(inObjectID, &mTaskQueue),
+    mClients(inObjectID),
     mInputStream(inInputStreamID, inObjectID, false, kSampleRateDefault),
+    mReducedInputStream(inReducedInputStreamID, inObjectID, true, kSampleRateDefault, kRDCDefaultChannelCount + 1),
     mOutputStream(inOutputStreamID, inObjectID, false, kSampleRateDefault),
     mVolumeControl(inOutputVolumeControlID, GetObjectID()),
     mMuteControl(inOutputMuteControlID, GetObjectID())
 {
+    // Volume changes can come many times a second, so let the task queue merge their notifications.
+    mVolumeControl.SetNotificationTaskQueue(&mTaskQueue);
+
+    std::copy(kRDCAvailableSampleRates,
+              kRDCAvailableSampleRates + kRDCNumberOfAvailableSampleRates,
+              mAvailableSampleRates);
+    mNumberOfAvailableSampleRates = kRDCNumberOfAvailableSampleRates;
+
     // Initialises the loopback clock with the default sample rate and, if there is one, sets the wrapped device to the same sample rate
     SetSampleRate(kSampleRateDefault, true);
+
+    // Set up the loopback clock and everything that depends on the format. The loopback buffer
+    // itself isn't allocated until IO first starts, so loading the driver on a machine that never
+    // uses it costs almost no memory.
+    InitLoopback();
+
+    LoadLatencyOverrides();
+
+    // Apply the apps' settings before any clients are added, so they don't have to be applied to
+    // each client afterwards.
+    LoadClientSettings();
 }
 
 RDC_Device::~RDC_Device()
@@ -132,6 +503,11 @@ void	RDC_Device::Activate()
 	mInputStream.Activate();
 	mOutputStream.Activate();
 
+	if(mNumberOfReducedInputChannels > 0)
+	{
+		mReducedInputStream.Activate();
+	}
+
 	if(mVolumeControl.GetObjectID() != kAudioObjectUnknown)
 	{
 		mVolumeControl.Activate();
@@ -141,6 +517,8 @@ void	RDC_Device::Activate()
 	{
 		mMuteControl.Activate();
 	}
+
+	PublishState();
 	
 	//	Call the super-class, which just marks the object as active
 	RDC_AbstractDevice::Activate();
@@ -156,10 +534,13 @@ void	RDC_Device::Deactivate()
 
     // Mark the device's sub-objects inactive.
 	mInputStream.Deactivate();
+	mReducedInputStream.Deactivate();
 	mOutputStream.Deactivate();
     mVolumeControl.Deactivate();
     mMuteControl.Deactivate();
 
+    PublishState();
+
 	//	mark the object inactive by calling the super-class
 	RDC_AbstractDevice::Deactivate();
 	
@@ -169,14 +550,193 @@ void	RDC_Device::Deactivate()
 
 void    RDC_Device::InitLoopback()
 {
-    // Calculate the number of host clock ticks per frame for our loopback clock.
-    mLoopbackTime.hostTicksPerFrame = CAHostTimeBase::GetFrequency() / mLoopbackSampleRate;
-    
-    //  Allocate (or re-allocate) the loopback buffer.
-    //  2 channels * 32-bit float = bytes in each frame
+    UpdateLoopbackSizes();
+    InitLoopbackClock();
+
+    // Reallocate the buffers if they're allocated. Otherwise, StartIO allocates them with the new
+    // format.
+    if(mLoopbackIsAllocated)
+    {
+        AllocateLoopback();
+    }
+
+    // The shared memory copy has the same capacity as the loopback buffer, if it's enabled.
+    mSharedLoopbackBuffer.Reallocate(mLoopbackSampleRate, mChannelCount, mLoopbackRingBufferFrameSize);
+
+    mLoopbackLevelMeter.SetChannelCount(mChannelCount);
+
+    if(mRecorder.SetFormatNonRT(mLoopbackSampleRate, mChannelCount))
+    {
+        SendRecordingStoppedNotification();
+    }
+
+    mRetroBuffer.SetFormatNonRT(mLoopbackSampleRate, mChannelCount);
+}
+
+void    RDC_Device::AllocateLoopback()
+{
+    // Make sure the RTP sender and the instances this one is routed to aren't reading the ring
+    // while it's reallocated.
+    mRTPSender.DetachSource();
+    RDC_LoopbackRouter::GetInstance().DetachSourceNonRT(mInstanceIndex);
+
+    //  Allocate (or re-allocate) the loopback buffer. Its capacity is in frames, so sample rate
+    //  changes don't need to reallocate it.
+    //  mChannelCount channels * the size of a sample in the storage format = bytes in each frame
     //  Pass 1 for nChannels because it's going to be storing interleaved audio, which means we
-    //  don't need a separate buffer for each channel.
-	mLoopbackRingBuffer.Allocate(1, 2 * sizeof(Float32), kLoopbackRingBufferFrameSize);
+    //  don't need a separate buffer for each channel. Unless it's planar, in which case each
+    //  channel gets its own buffer and a frame in each is one sample.
+    UInt32 theBytesPerSample = RDC_SampleConversion::BytesPerSample(mLoopbackStorageFormat);
+
+    if(mLoopbackStoragePlanar)
+    {
+        mLoopbackRingBuffer.Allocate(static_cast<int>(mChannelCount),
+                                     theBytesPerSample,
+                                     GetLoopbackAllocationFrameSize());
+    }
+    else
+    {
+        mLoopbackRingBuffer.Allocate(1,
+                                     mChannelCount * theBytesPerSample,
+                                     GetLoopbackAllocationFrameSize());
+    }
+
+    // Allocate the buffers the IO functions convert samples in, so they don't have to allocate.
+    // They're only used if the streams or the loopback buffer aren't Float32.
+    UInt32 theChunkSamples = kLoopbackConversionChunkFrameSize * mChannelCount;
+    mReadConversionBuffer.resize(theChunkSamples);
+    mReadScratchBuffer.resize(theChunkSamples);
+    mReadStorageBuffer.resize(theChunkSamples * sizeof(Float32));
+    mWriteConversionBuffer.resize(theChunkSamples);
+    mWriteScratchBuffer.resize(theChunkSamples);
+    mWriteStorageBuffer.resize(theChunkSamples * sizeof(Float32));
+    mDriftCompensator.Allocate(mChannelCount);
+    mReadConcealments.assign(kRDCIOStateSlotCount + 1, RDC_ReadConcealment());
+    mReadConcealmentLastFrames.assign((kRDCIOStateSlotCount + 1) * mChannelCount, 0.0f);
+
+    // Fetching from a planar loopback buffer needs a buffer for each channel to interleave from.
+    if(mLoopbackStoragePlanar)
+    {
+        mReadPlanarBuffer.resize(theChunkSamples * theBytesPerSample);
+        mReadPlanarBufferList.resize(offsetof(AudioBufferList, mBuffers) + mChannelCount * sizeof(AudioBuffer));
+
+        AudioBufferList* theBufferList = reinterpret_cast<AudioBufferList*>(mReadPlanarBufferList.data());
+        theBufferList->mNumberBuffers = mChannelCount;
+
+        for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+        {
+            theBufferList->mBuffers[theChannel].mNumberChannels = 1;
+            theBufferList->mBuffers[theChannel].mDataByteSize = 0;
+            theBufferList->mBuffers[theChannel].mData =
+                    mReadPlanarBuffer.data() + theChannel * kLoopbackConversionChunkFrameSize * theBytesPerSample;
+        }
+    }
+    else
+    {
+        mReadPlanarBuffer.clear();
+        mReadPlanarBufferList.clear();
+    }
+
+    mLoopbackIsAllocated = true;
+    AllocateReducedInputBuffers();
+
+    // The taps and buses use the same format and capacity as the main buffer.
+    mClientTaps.Reallocate(mChannelCount * sizeof(Float32), GetLoopbackAllocationFrameSize());
+    mClientBuses.Reallocate(mChannelCount, GetLoopbackAllocationFrameSize());
+
+    mRTPSender.AttachSource(mLoopbackRingBuffer,
+                            mLoopbackStorageFormat,
+                            mLoopbackStoragePlanar,
+                            mLoopbackSampleRate,
+                            mChannelCount);
+    RDC_LoopbackRouter::GetInstance().AttachSourceNonRT(mInstanceIndex,
+                                                        mLoopbackRingBuffer,
+                                                        mLoopbackStorageFormat == kRDCSampleFormat_Float32 &&
+                                                            !mLoopbackStoragePlanar,
+                                                        mLoopbackSampleRate,
+                                                        mChannelCount);
+}
+
+void    RDC_Device::AllocateReducedInputBuffers()
+{
+    if(mLoopbackIsAllocated && mNumberOfReducedInputChannels > 0)
+    {
+        // The fetched frames are in the streams' format, which is at most four bytes a sample. The
+        // conversion buffer is also the scratch space for converting the reduced frames, so it has
+        // to fit whichever has more channels.
+        UInt32 theChunkSamples = kLoopbackConversionChunkFrameSize * mChannelCount;
+        UInt32 theOutChunkSamples = kLoopbackConversionChunkFrameSize * mNumberOfReducedInputChannels;
+        mReducedReadFetchBuffer.resize(theChunkSamples * sizeof(Float32));
+        mReducedReadConversionBuffer.resize(std::max(theChunkSamples, theOutChunkSamples));
+        mReducedReadOutputBuffer.resize(theOutChunkSamples);
+    }
+    else
+    {
+        std::vector<Byte>().swap(mReducedReadFetchBuffer);
+        std::vector<Float32>().swap(mReducedReadConversionBuffer);
+        std::vector<Float32>().swap(mReducedReadOutputBuffer);
+    }
+}
+
+void    RDC_Device::ReleaseLoopback()
+{
+    DebugMsg("RDC_Device::ReleaseLoopback: Releasing the loopback buffer after %u s without IO",
+             mLoopbackIdleTimeoutSeconds);
+
+    mRTPSender.DetachSource();
+    RDC_LoopbackRouter::GetInstance().DetachSourceNonRT(mInstanceIndex);
+
+    mLoopbackRingBuffer.Deallocate();
+
+    // The conversion buffers are small, but they're only needed while IO is running, so they go
+    // as well.
+    std::vector<Float32>().swap(mReadConversionBuffer);
+    std::vector<Float32>().swap(mReadScratchBuffer);
+    std::vector<Byte>().swap(mReadStorageBuffer);
+    std::vector<RDC_ReadConcealment>().swap(mReadConcealments);
+    std::vector<Float32>().swap(mReadConcealmentLastFrames);
+    std::vector<Float32>().swap(mWriteConversionBuffer);
+    std::vector<Float32>().swap(mWriteScratchBuffer);
+    std::vector<Byte>().swap(mWriteStorageBuffer);
+    std::vector<Byte>().swap(mReadPlanarBuffer);
+    std::vector<Byte>().swap(mReadPlanarBufferList);
+
+    mLoopbackIsAllocated = false;
+    AllocateReducedInputBuffers();
+}
+
+void    RDC_Device::ScheduleLoopbackRelease()
+{
+    RDCAssert(mStateMutex.IsOwnedByCurrentThread(),
+              "RDC_Device::ScheduleLoopbackRelease: Called without taking the state mutex");
+
+    // Cancel any release that's already scheduled.
+    UInt64 theGeneration = ++mLoopbackIdleGeneration;
+
+    if(!mLoopbackIsAllocated || mLoopbackIdleTimeoutSeconds == 0)
+    {
+        return;
+    }
+
+    AudioObjectID theDeviceObjectID = GetObjectID();
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(static_cast<UInt64>(mLoopbackIdleTimeoutSeconds) * NSEC_PER_SEC, ^{
+        RDC_Device* theDevice = LookUpInstance(theDeviceObjectID);
+
+        if(theDevice != nullptr)
+        {
+            CAMutex::Locker theStateLocker(theDevice->mStateMutex);
+
+            // Only release the buffers if IO hasn't started again, and the timeout hasn't been
+            // changed, since this was scheduled.
+            if(theGeneration == theDevice->mLoopbackIdleGeneration &&
+               theDevice->mLoopbackIsAllocated &&
+               !theDevice->mClients.ClientsRunningIO())
+            {
+                theDevice->ReleaseLoopback();
+            }
+        }
+    });
 }
 
 #pragma mark Property Operations
@@ -274,6 +834,19 @@ void	RDC_Device::SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, co
                 const AudioStreamBasicDescription* theNewFormat =
                     reinterpret_cast<const AudioStreamBasicDescription*>(inData);
                 RequestSampleRate(theNewFormat->mSampleRate);
+
+                // The reduced input stream's channels are set with
+                // kAudioDeviceCustomPropertyReducedInputChannels instead, so its channel count
+                // doesn't change the device's.
+                if(inObjectID != mReducedInputStream.GetObjectID())
+                {
+                    RequestChannelCount(theNewFormat->mChannelsPerFrame);
+                }
+
+                // The stream has already checked the format, so this can't fail.
+                RDC_SampleFormat theSampleFormat = kRDCSampleFormat_Float32;
+                RDC_SampleConversion::GetFormatOfStreamDescription(*theNewFormat, theSampleFormat);
+                RequestSampleFormat(theSampleFormat);
             }
 		}
 	}
@@ -287,13 +860,19 @@ bool	RDC_Device::Device_HasProperty(AudioObjectID inObjectID, pid_t inClientPID,
 	//	are useful but not required. There is more detailed commentary about each property in the
 	//	Device_GetPropertyData() method.
 	
+	// The custom properties are all described by sCustomProperties.
+	if(FindCustomProperty(inAddress.mSelector) != nullptr)
+	{
+		return true;
+	}
+
 	bool theAnswer = false;
 	switch(inAddress.mSelector)
 	{
         case kAudioDevicePropertyStreams:
         case kAudioDevicePropertyIcon:
         case kAudioObjectPropertyCustomPropertyInfoList:
-        case kAudioDeviceCustomPropertyEnabledOutputControls:
+        case kAudioDevicePropertyBufferFrameSizeRange:
 			theAnswer = true;
 			break;
 			
@@ -319,6 +898,12 @@ bool	RDC_Device::Device_IsPropertySettable(AudioObjectID inObjectID, pid_t inCli
 	//	are useful but not required. There is more detailed commentary about each property in the
 	//	Device_GetPropertyData() method.
 	
+	const RDC_CustomProperty* theCustomProperty = FindCustomProperty(inAddress.mSelector);
+	if(theCustomProperty != nullptr)
+	{
+		return theCustomProperty->mIsSettable;
+	}
+
 	bool theAnswer = false;
 	switch(inAddress.mSelector)
     {
@@ -331,10 +916,10 @@ bool	RDC_Device::Device_IsPropertySettable(AudioObjectID inObjectID, pid_t inCli
 		case kAudioDevicePropertyDeviceCanBeDefaultSystemDevice:
         case kAudioDevicePropertyIcon:
         case kAudioObjectPropertyCustomPropertyInfoList:
+        case kAudioDevicePropertyBufferFrameSizeRange:
 			break;
             
         case kAudioDevicePropertyNominalSampleRate:
-        case kAudioDeviceCustomPropertyEnabledOutputControls:
 			theAnswer = true;
 			break;
 		
@@ -351,6 +936,12 @@ UInt32	RDC_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t in
 	//	are useful but not required. There is more detailed commentary about each property in the
 	//	Device_GetPropertyData() method.
 	
+	// The custom properties are all CFPropertyLists.
+	if(FindCustomProperty(inAddress.mSelector) != nullptr)
+	{
+		return sizeof(CFPropertyListRef);
+	}
+
 	UInt32 theAnswer = 0;
 
 	switch(inAddress.mSelector)
@@ -364,7 +955,10 @@ UInt32	RDC_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t in
                         break;
                         
                     case kAudioObjectPropertyScopeInput:
-                        theAnswer = kNumberOfInputSubObjects * sizeof(AudioObjectID);
+                        {
+                            AudioObjectID theInputStreamIDs[2];
+                            theAnswer = GetInputStreamIDs(theInputStreamIDs) * sizeof(AudioObjectID);
+                        }
                         break;
                         
                     case kAudioObjectPropertyScopeOutput:
@@ -383,11 +977,18 @@ UInt32	RDC_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t in
                 switch(inAddress.mScope)
                 {
                     case kAudioObjectPropertyScopeGlobal:
-                        theAnswer = kNumberOfStreams * sizeof(AudioObjectID);
+                        {
+                            AudioObjectID theInputStreamIDs[2];
+                            theAnswer = (GetInputStreamIDs(theInputStreamIDs) + kNumberOfOutputStreams) *
+                                    sizeof(AudioObjectID);
+                        }
                         break;
                         
                     case kAudioObjectPropertyScopeInput:
-                        theAnswer = kNumberOfInputStreams * sizeof(AudioObjectID);
+                        {
+                            AudioObjectID theInputStreamIDs[2];
+                            theAnswer = GetInputStreamIDs(theInputStreamIDs) * sizeof(AudioObjectID);
+                        }
                         break;
                         
                     case kAudioObjectPropertyScopeOutput:
@@ -405,7 +1006,10 @@ UInt32	RDC_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t in
             break;
 
 		case kAudioDevicePropertyAvailableNominalSampleRates:
-			theAnswer = 1 * sizeof(AudioValueRange);
+            {
+                Float64 theSampleRates[kRDCMaxAvailableSampleRates];
+                theAnswer = GetAvailableSampleRates(theSampleRates) * sizeof(AudioValueRange);
+            }
 			break;
 
 		case kAudioDevicePropertyPreferredChannelsForStereo:
@@ -413,7 +1017,7 @@ UInt32	RDC_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t in
 			break;
 
 		case kAudioDevicePropertyPreferredChannelLayout:
-			theAnswer = offsetof(AudioChannelLayout, mChannelDescriptions) + (2 * sizeof(AudioChannelDescription));
+			theAnswer = offsetof(AudioChannelLayout, mChannelDescriptions) + (GetChannelCount() * sizeof(AudioChannelDescription));
 			break;
 
         case kAudioDevicePropertyIcon:
@@ -421,11 +1025,11 @@ UInt32	RDC_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t in
             break;
             
         case kAudioObjectPropertyCustomPropertyInfoList:
-            theAnswer = sizeof(AudioServerPlugInCustomPropertyInfo) * 6;
+            theAnswer = sizeof(AudioServerPlugInCustomPropertyInfo) * kNumberOfCustomProperties;
             break;
-            
-        case kAudioDeviceCustomPropertyEnabledOutputControls:
-            theAnswer = sizeof(CFArrayRef);
+
+        case kAudioDevicePropertyBufferFrameSizeRange:
+            theAnswer = sizeof(AudioValueRange);
             break;
 		
 		default:
@@ -443,6 +1047,15 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 	//	Also, since most of the data that will get returned is static, there are few instances where
 	//	it is necessary to lock the state mutex.
 
+	const RDC_CustomProperty* theCustomProperty = FindCustomProperty(inAddress.mSelector);
+	if(theCustomProperty != nullptr)
+	{
+		ThrowIf(inDataSize < sizeof(CFPropertyListRef), CAException(kAudioHardwareBadPropertySizeError), "RDC_Device::Device_GetPropertyData: not enough space for the return value of a custom property for the device");
+		*reinterpret_cast<CFPropertyListRef*>(outData) = theCustomProperty->mCopyValue(*this);
+		outDataSize = sizeof(CFPropertyListRef);
+		return;
+	}
+
 	UInt32 theNumberItemsToFetch;
 	UInt32 theItemIndex;
 
@@ -453,7 +1066,10 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 			//	value that is a key into the localizable strings in this bundle. This allows us to
 			//	return a localized name for the device.
 			ThrowIf(inDataSize < sizeof(AudioObjectID), CAException(kAudioHardwareBadPropertySizeError), "RDC_Device::Device_GetPropertyData: not enough space for the return value of kAudioObjectPropertyName for the device");
-            *reinterpret_cast<CFStringRef*>(outData) = mDeviceName;
+            // The caller releases the string, and the additional instances' names aren't
+            // constants, so retain it for them.
+            *reinterpret_cast<CFStringRef*>(outData) =
+                static_cast<CFStringRef>(CFRetain(mDeviceName));
 			outDataSize = sizeof(CFStringRef);
 			break;
 			
@@ -479,67 +1095,66 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 				case kAudioObjectPropertyScopeGlobal:
 					//	global scope means return all objects
                     {
-                        CAMutex::Locker theStateLocker(mStateMutex);
+                        bool theVolumeEnabled, theMuteEnabled;
+                        GetEnabledOutputControls(theVolumeEnabled, theMuteEnabled);
 
-                        if(theNumberItemsToFetch > GetNumberOfSubObjects())
-                        {
-                            theNumberItemsToFetch = GetNumberOfSubObjects();
-                        }
+                        // The input streams, the output stream and then whichever controls are
+                        // enabled.
+                        AudioObjectID theSubObjects[5];
+                        UInt32 theNumberOfSubObjects = GetInputStreamIDs(theSubObjects);
+                        theSubObjects[theNumberOfSubObjects++] = mOutputStream.GetObjectID();
 
-                        //	fill out the list with as many objects as requested, which is everything
-                        if(theNumberItemsToFetch > 0)
+                        if(theVolumeEnabled)
                         {
-                            reinterpret_cast<AudioObjectID*>(outData)[0] = mInputStream.GetObjectID();
+                            theSubObjects[theNumberOfSubObjects++] = mVolumeControl.GetObjectID();
                         }
 
-                        if(theNumberItemsToFetch > 1)
+                        if(theMuteEnabled)
                         {
-                            reinterpret_cast<AudioObjectID*>(outData)[1] = mOutputStream.GetObjectID();
+                            theSubObjects[theNumberOfSubObjects++] = mMuteControl.GetObjectID();
                         }
 
-                        // If at least one of the controls is enabled, and there's room, return one.
-						if(theNumberItemsToFetch > 2)
-						{
-							if(mVolumeControl.IsActive())
-							{
-								reinterpret_cast<AudioObjectID*>(outData)[2] = mVolumeControl.GetObjectID();
-							}
-							else if(mMuteControl.IsActive())
-							{
-								reinterpret_cast<AudioObjectID*>(outData)[2] = mMuteControl.GetObjectID();
-							}
-						}
-
-						// If both controls are enabled, and there's room, return the mute control as well.
-                        if(theNumberItemsToFetch > 3 && mVolumeControl.IsActive() && mMuteControl.IsActive())
+                        if(theNumberItemsToFetch > theNumberOfSubObjects)
                         {
-							reinterpret_cast<AudioObjectID*>(outData)[3] = mMuteControl.GetObjectID();
+                            theNumberItemsToFetch = theNumberOfSubObjects;
                         }
+
+                        //	fill out the list with as many objects as requested, which is everything
+                        std::copy(theSubObjects,
+                                  theSubObjects + theNumberItemsToFetch,
+                                  reinterpret_cast<AudioObjectID*>(outData));
                     }
 					break;
 					
 				case kAudioObjectPropertyScopeInput:
-					//	input scope means just the objects on the input side
-					if(theNumberItemsToFetch > kNumberOfInputSubObjects)
-					{
-						theNumberItemsToFetch = kNumberOfInputSubObjects;
-					}
-					
-					//	fill out the list with the right objects
-					if(theNumberItemsToFetch > 0)
-					{
-                        reinterpret_cast<AudioObjectID*>(outData)[0] = mInputStream.GetObjectID();
-					}
+					//	input scope means just the objects on the input side, which are the streams
+                    {
+                        AudioObjectID theInputStreamIDs[2];
+                        UInt32 theNumberOfInputStreams = GetInputStreamIDs(theInputStreamIDs);
+
+                        if(theNumberItemsToFetch > theNumberOfInputStreams)
+                        {
+                            theNumberItemsToFetch = theNumberOfInputStreams;
+                        }
+
+                        //	fill out the list with the right objects
+                        std::copy(theInputStreamIDs,
+                                  theInputStreamIDs + theNumberItemsToFetch,
+                                  reinterpret_cast<AudioObjectID*>(outData));
+                    }
 					break;
 					
 				case kAudioObjectPropertyScopeOutput:
 					//	output scope means just the objects on the output side
                     {
-                        CAMutex::Locker theStateLocker(mStateMutex);
+                        bool theVolumeEnabled, theMuteEnabled;
+                        GetEnabledOutputControls(theVolumeEnabled, theMuteEnabled);
+                        UInt32 theNumberOfOutputSubObjects = kNumberOfOutputStreams +
+                                (theVolumeEnabled ? 1 : 0) + (theMuteEnabled ? 1 : 0);
 
-                        if(theNumberItemsToFetch > GetNumberOfOutputControls())
+                        if(theNumberItemsToFetch > theNumberOfOutputSubObjects)
                         {
-                            theNumberItemsToFetch = GetNumberOfOutputControls();
+                            theNumberItemsToFetch = theNumberOfOutputSubObjects;
                         }
 
                         //	fill out the list with the right objects
@@ -551,18 +1166,18 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 						// If at least one of the controls is enabled, and there's room, return one.
 						if(theNumberItemsToFetch > 1)
 						{
-							if(mVolumeControl.IsActive())
+							if(theVolumeEnabled)
 							{
 								reinterpret_cast<AudioObjectID*>(outData)[1] = mVolumeControl.GetObjectID();
 							}
-							else if(mMuteControl.IsActive())
+							else if(theMuteEnabled)
 							{
 								reinterpret_cast<AudioObjectID*>(outData)[1] = mMuteControl.GetObjectID();
 							}
 						}
 
 						// If both controls are enabled, and there's room, return the mute control as well.
-						if(theNumberItemsToFetch > 2 && mVolumeControl.IsActive() && mMuteControl.IsActive())
+						if(theNumberItemsToFetch > 2 && theVolumeEnabled && theMuteEnabled)
 						{
 							reinterpret_cast<AudioObjectID*>(outData)[2] = mMuteControl.GetObjectID();
 						}
@@ -579,7 +1194,8 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 			//	audio device across boot sessions. Note that two instances of the same
 			//	device must have different values for this property.
 			ThrowIf(inDataSize < sizeof(AudioObjectID), CAException(kAudioHardwareBadPropertySizeError), "RDC_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyDeviceUID for the device");
-            *reinterpret_cast<CFStringRef*>(outData) = mDeviceUID;
+            *reinterpret_cast<CFStringRef*>(outData) =
+                static_cast<CFStringRef>(CFRetain(mDeviceUID));
 			outDataSize = sizeof(CFStringRef);
 			break;
 
@@ -618,35 +1234,40 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 			switch(inAddress.mScope)
 			{
 				case kAudioObjectPropertyScopeGlobal:
-					//	global scope means return all streams
-					if(theNumberItemsToFetch > kNumberOfStreams)
-					{
-						theNumberItemsToFetch = kNumberOfStreams;
-					}
-					
-					//	fill out the list with as many objects as requested
-					if(theNumberItemsToFetch > 0)
-					{
-						reinterpret_cast<AudioObjectID*>(outData)[0] = mInputStream.GetObjectID();
-					}
-					if(theNumberItemsToFetch > 1)
-					{
-						reinterpret_cast<AudioObjectID*>(outData)[1] = mOutputStream.GetObjectID();
-					}
+					//	global scope means return all streams, the input streams first
+                    {
+                        AudioObjectID theStreamIDs[3];
+                        UInt32 theNumberOfStreams = GetInputStreamIDs(theStreamIDs);
+                        theStreamIDs[theNumberOfStreams++] = mOutputStream.GetObjectID();
+
+                        if(theNumberItemsToFetch > theNumberOfStreams)
+                        {
+                            theNumberItemsToFetch = theNumberOfStreams;
+                        }
+
+                        //	fill out the list with as many objects as requested
+                        std::copy(theStreamIDs,
+                                  theStreamIDs + theNumberItemsToFetch,
+                                  reinterpret_cast<AudioObjectID*>(outData));
+                    }
 					break;
 					
 				case kAudioObjectPropertyScopeInput:
 					//	input scope means just the objects on the input side
-					if(theNumberItemsToFetch > kNumberOfInputStreams)
-					{
-						theNumberItemsToFetch = kNumberOfInputStreams;
-					}
-					
-					//	fill out the list with as many objects as requested
-					if(theNumberItemsToFetch > 0)
-					{
-						reinterpret_cast<AudioObjectID*>(outData)[0] = mInputStream.GetObjectID();
-					}
+                    {
+                        AudioObjectID theInputStreamIDs[2];
+                        UInt32 theNumberOfInputStreams = GetInputStreamIDs(theInputStreamIDs);
+
+                        if(theNumberItemsToFetch > theNumberOfInputStreams)
+                        {
+                            theNumberItemsToFetch = theNumberOfInputStreams;
+                        }
+
+                        //	fill out the list with as many objects as requested
+                        std::copy(theInputStreamIDs,
+                                  theInputStreamIDs + theNumberItemsToFetch,
+                                  reinterpret_cast<AudioObjectID*>(outData));
+                    }
 					break;
 					
 				case kAudioObjectPropertyScopeOutput:
@@ -681,24 +1302,25 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 
                 UInt32 theNumberOfItemsFetched = 0;
 
-                CAMutex::Locker theStateLocker(mStateMutex);
+                bool theVolumeEnabled, theMuteEnabled;
+                GetEnabledOutputControls(theVolumeEnabled, theMuteEnabled);
                 
                 //	fill out the list with as many objects as requested
                 if(theNumberItemsToFetch > 0)
                 {
-					if(mVolumeControl.IsActive())
+					if(theVolumeEnabled)
                     {
                         reinterpret_cast<AudioObjectID*>(outData)[0] = mVolumeControl.GetObjectID();
                         theNumberOfItemsFetched++;
                     }
-                    else if(mMuteControl.IsActive())
+                    else if(theMuteEnabled)
                     {
                         reinterpret_cast<AudioObjectID*>(outData)[0] = mMuteControl.GetObjectID();
                         theNumberOfItemsFetched++;
                     }
                 }
 
-                if(theNumberItemsToFetch > 1 && mVolumeControl.IsActive() && mMuteControl.IsActive())
+                if(theNumberItemsToFetch > 1 && theVolumeEnabled && theMuteEnabled)
                 {
                     reinterpret_cast<AudioObjectID*>(outData)[1] = mMuteControl.GetObjectID();
                     theNumberOfItemsFetched++;
@@ -709,12 +1331,31 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
             }
 			break;
 
-        // TODO: Should we return the real kAudioDevicePropertyLatency and/or
-        //       kAudioDevicePropertySafetyOffset for the real/wrapped output device?
-        //       If so, should we also add on the extra latency added by Background Music? 
-
-		case kAudioDevicePropertyNominalSampleRate:
-			//	This property returns the nominal sample rate of the device.
+        case kAudioDevicePropertyLatency:
+            //	This property returns the presentation latency of the device. See GetLatency.
+            ThrowIf(inDataSize < sizeof(UInt32),
+                    CAException(kAudioHardwareBadPropertySizeError),
+                    "RDC_Device::Device_GetPropertyData: not enough space for the return value of "
+                    "kAudioDevicePropertyLatency for the device");
+            *reinterpret_cast<UInt32*>(outData) =
+                    GetLatency(inAddress.mScope == kAudioObjectPropertyScopeInput);
+            outDataSize = sizeof(UInt32);
+            break;
+
+        case kAudioDevicePropertySafetyOffset:
+            //	This property returns how close to now the HAL can read and write. See
+            //	GetSafetyOffset.
+            ThrowIf(inDataSize < sizeof(UInt32),
+                    CAException(kAudioHardwareBadPropertySizeError),
+                    "RDC_Device::Device_GetPropertyData: not enough space for the return value of "
+                    "kAudioDevicePropertySafetyOffset for the device");
+            *reinterpret_cast<UInt32*>(outData) =
+                    GetSafetyOffset(inAddress.mScope == kAudioObjectPropertyScopeInput);
+            outDataSize = sizeof(UInt32);
+            break;
+
+		case kAudioDevicePropertyNominalSampleRate:
+			//	This property returns the nominal sample rate of the device.
             ThrowIf(inDataSize < sizeof(Float64),
                     CAException(kAudioHardwareBadPropertySizeError),
                     "RDC_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyNominalSampleRate for the device");
@@ -728,58 +1369,74 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 			//	AudioValueRangeStructs. Note that for discrete sampler rates, the range
 			//	will have the minimum value equal to the maximum value.
             //
-            //  RDCDevice supports any sample rate so it can be set to match the output
-            //  device when in loopback mode.
-			
-			//	Calculate the number of items that have been requested. Note that this
-			//	number is allowed to be smaller than the actual size of the list. In such
-			//	case, only that number of items will be returned
-			theNumberItemsToFetch = inDataSize / sizeof(AudioValueRange);
-			
-			//	clamp it to the number of items we have
-			if(theNumberItemsToFetch > 1)
-			{
-				theNumberItemsToFetch = 1;
-			}
-			
-			//	fill out the return array
-			if(theNumberItemsToFetch > 0)
-			{
-                // 0 would cause divide-by-zero errors in other RDC_Device functions (and
-                // wouldn't make sense anyway).
-                ((AudioValueRange*)outData)[0].mMinimum = 44100.0;
-                // Just in case DBL_MAX would cause problems in a client for some reason,
-                // use an arbitrary very large number instead. (It wouldn't make sense to
-                // actually set the sample rate this high, but I don't know what a
-                // reasonable maximum would be.)
-                ((AudioValueRange*)outData)[0].mMaximum = 192000.0;
-			}
-			
-			//	report how much we wrote
-			outDataSize = theNumberItemsToFetch * sizeof(AudioValueRange);
+            //  RDCDevice reports the common rates in kRDCAvailableSampleRates, or the ones set with
+            //  kRDCConfigurationKey_SampleRates, but still accepts any rate so it can be set to
+            //  match the output device when in loopback mode.
+            {
+                Float64 theSampleRates[kRDCMaxAvailableSampleRates];
+                UInt32 theNumberOfSampleRates = GetAvailableSampleRates(theSampleRates);
+
+                //	Calculate the number of items that have been requested. Note that this
+                //	number is allowed to be smaller than the actual size of the list. In such
+                //	case, only that number of items will be returned
+                theNumberItemsToFetch = inDataSize / sizeof(AudioValueRange);
+
+                //	clamp it to the number of items we have
+                if(theNumberItemsToFetch > theNumberOfSampleRates)
+                {
+                    theNumberItemsToFetch = theNumberOfSampleRates;
+                }
+
+                //	fill out the return array
+                for(UInt32 theItemIndex = 0; theItemIndex < theNumberItemsToFetch; ++theItemIndex)
+                {
+                    ((AudioValueRange*)outData)[theItemIndex].mMinimum = theSampleRates[theItemIndex];
+                    ((AudioValueRange*)outData)[theItemIndex].mMaximum = theSampleRates[theItemIndex];
+                }
+
+                //	report how much we wrote
+                outDataSize = theNumberItemsToFetch * sizeof(AudioValueRange);
+            }
 			break;
 
 		case kAudioDevicePropertyPreferredChannelsForStereo:
 			//	This property returns which two channels to use as left/right for stereo
 			//	data by default. Note that the channel numbers are 1-based.
+			//	A mono device uses its only channel for both.
 			ThrowIf(inDataSize < (2 * sizeof(UInt32)), CAException(kAudioHardwareBadPropertySizeError), "RDC_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyPreferredChannelsForStereo for the device");
 			((UInt32*)outData)[0] = 1;
-			((UInt32*)outData)[1] = 2;
+			((UInt32*)outData)[1] = (GetChannelCount() > 1) ? 2 : 1;
 			outDataSize = 2 * sizeof(UInt32);
 			break;
 
 		case kAudioDevicePropertyPreferredChannelLayout:
 			//	This property returns the default AudioChannelLayout to use for the device
-			//	by default. For this device, we return a stereo ACL.
+			//	by default. For a stereo device, we return a stereo ACL. Otherwise, since the
+			//	channels of a loopback bus don't have any inherent meaning, we label them as
+			//	discrete channels (or mono if there's only one).
 			{
-				UInt32 theACLSize = offsetof(AudioChannelLayout, mChannelDescriptions) + (2 * sizeof(AudioChannelDescription));
+				UInt32 theChannelCount = GetChannelCount();
+				UInt32 theACLSize = offsetof(AudioChannelLayout, mChannelDescriptions) + (theChannelCount * sizeof(AudioChannelDescription));
 				ThrowIf(inDataSize < theACLSize, CAException(kAudioHardwareBadPropertySizeError), "RDC_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyPreferredChannelLayout for the device");
 				((AudioChannelLayout*)outData)->mChannelLayoutTag = kAudioChannelLayoutTag_UseChannelDescriptions;
 				((AudioChannelLayout*)outData)->mChannelBitmap = 0;
-				((AudioChannelLayout*)outData)->mNumberChannelDescriptions = 2;
-				for(theItemIndex = 0; theItemIndex < 2; ++theItemIndex)
+				((AudioChannelLayout*)outData)->mNumberChannelDescriptions = theChannelCount;
+				for(theItemIndex = 0; theItemIndex < theChannelCount; ++theItemIndex)
 				{
-					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mChannelLabel = kAudioChannelLabel_Left + theItemIndex;
+					AudioChannelLabel theLabel;
+					if(theChannelCount == 1)
+					{
+						theLabel = kAudioChannelLabel_Mono;
+					}
+					else if(theChannelCount == 2)
+					{
+						theLabel = kAudioChannelLabel_Left + theItemIndex;
+					}
+					else
+					{
+						theLabel = kAudioChannelLabel_Discrete_0 | theItemIndex;
+					}
+					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mChannelLabel = theLabel;
 					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mChannelFlags = 0;
 					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mCoordinates[0] = 0;
 					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mCoordinates[1] = 0;
@@ -793,9 +1450,20 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
 			//	This property returns how many frames the HAL should expect to see between
 			//	successive sample times in the zero time stamps this device provides.
 			ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "RDC_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyZeroTimeStampPeriod for the device");
-			*reinterpret_cast<UInt32*>(outData) = kLoopbackRingBufferFrameSize;
+			*reinterpret_cast<UInt32*>(outData) = GetZeroTimeStampPeriod();
 			outDataSize = sizeof(UInt32);
             break;
+
+        case kAudioDevicePropertyBufferFrameSizeRange:
+            //	This property returns the smallest and largest IO buffer sizes the HAL can use. See
+            //	GetIOBufferFrameSizeRange.
+            ThrowIf(inDataSize < sizeof(AudioValueRange),
+                    CAException(kAudioHardwareBadPropertySizeError),
+                    "RDC_Device::Device_GetPropertyData: not enough space for the return value of "
+                    "kAudioDevicePropertyBufferFrameSizeRange for the device");
+            *reinterpret_cast<AudioValueRange*>(outData) = GetIOBufferFrameSizeRange();
+            outDataSize = sizeof(AudioValueRange);
+            break;
             
         case kAudioDevicePropertyIcon:
             {
@@ -817,37 +1485,21 @@ void	RDC_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClient
             theNumberItemsToFetch = inDataSize / sizeof(AudioServerPlugInCustomPropertyInfo);
             
             //	clamp it to the number of items we have
-            if(theNumberItemsToFetch > 1)
+            if(theNumberItemsToFetch > kNumberOfCustomProperties)
             {
-                theNumberItemsToFetch = 1;
+                theNumberItemsToFetch = kNumberOfCustomProperties;
             }
             
-            if(theNumberItemsToFetch > 0)
+            for(theItemIndex = 0; theItemIndex < theNumberItemsToFetch; ++theItemIndex)
             {
-                ((AudioServerPlugInCustomPropertyInfo*)outData)[1].mSelector = kAudioDeviceCustomPropertyEnabledOutputControls;
-                ((AudioServerPlugInCustomPropertyInfo*)outData)[1].mPropertyDataType = kAudioServerPlugInCustomPropertyDataTypeCFPropertyList;
-                ((AudioServerPlugInCustomPropertyInfo*)outData)[1].mQualifierDataType = kAudioServerPlugInCustomPropertyDataTypeNone;
+                ((AudioServerPlugInCustomPropertyInfo*)outData)[theItemIndex].mSelector = sCustomProperties[theItemIndex].mSelector;
+                ((AudioServerPlugInCustomPropertyInfo*)outData)[theItemIndex].mPropertyDataType = kAudioServerPlugInCustomPropertyDataTypeCFPropertyList;
+                ((AudioServerPlugInCustomPropertyInfo*)outData)[theItemIndex].mQualifierDataType = kAudioServerPlugInCustomPropertyDataTypeNone;
             }
 
             outDataSize = theNumberItemsToFetch * sizeof(AudioServerPlugInCustomPropertyInfo);
             break;            
             
-        case kAudioDeviceCustomPropertyEnabledOutputControls:
-            {
-                ThrowIf(inDataSize < sizeof(CFArrayRef), CAException(kAudioHardwareBadPropertySizeError), "RDC_Device::Device_GetPropertyData: not enough space for the return value of kAudioDeviceCustomPropertyEnabledOutputControls for the device");
-                CACFArray theEnabledControls(2, true);
-
-				{
-					CAMutex::Locker theStateLocker(mStateMutex);
-					theEnabledControls.AppendCFType(mVolumeControl.IsActive() ? kCFBooleanTrue : kCFBooleanFalse);
-					theEnabledControls.AppendCFType(mMuteControl.IsActive() ? kCFBooleanTrue : kCFBooleanFalse);
-				}
-
-                *reinterpret_cast<CFArrayRef*>(outData) = theEnabledControls.CopyCFArray();
-                outDataSize = sizeof(CFArrayRef);
-            }
-            break;
-
 		default:
 			RDC_AbstractDevice::GetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, outDataSize, outData);
 			break;
@@ -910,515 +1562,4059 @@ void	RDC_Device::Device_SetPropertyData(AudioObjectID inObjectID, pid_t inClient
             }
             break;
 
-		default:
-			RDC_AbstractDevice::SetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, inData);
-			break;
-    };
-}
+        case kAudioDeviceCustomPropertyChannelCount:
+            RequestChannelCount(RDC_GetPositiveCFNumberValue(inDataSize, inData));
+            break;
 
-#pragma mark IO Operations
+        case kAudioDeviceCustomPropertyLoopbackBufferFrameSize:
+            RequestLoopbackBufferFrameSize(RDC_GetPositiveCFNumberValue(inDataSize, inData));
+            break;
 
-void	RDC_Device::StartIO(UInt32 inClientID)
-{
-    CAMutex::Locker theStateLocker(mStateMutex);
-    
-    // An overview of the process this function is part of:
-    //   - A client starts IO.
-    //   - The plugin host (the HAL) calls the StartIO function in RDC_PlugInInterface, which calls this function.
-    //   - RDCDriver sends a message to RDCApp telling it to start the (real) audio hardware.
-    //   - RDCApp starts the hardware and, after the hardware is ready, replies to RDCDriver's message.
-    //   - RDCDriver lets the host know that it's ready to do IO by returning from StartIO.
-    
-    // Update our client data.
-    //
-    // We add the work to the task queue, rather than doing it here, because BeginIOOperation and EndIOOperation
-    // also add this task to the queue and the updates should be done in order.
-    bool didStartIO = mTaskQueue.QueueSync_StartClientIO(&mClients, inClientID);
-    
-    // We only tell the hardware to start if this is the first time IO has been started.
-    if(didStartIO)
-    {
-        kern_return_t theError = _HW_StartIO();
-        ThrowIfKernelError(theError,
-                           CAException(theError),
-                           "RDC_Device::StartIO: Failed to start because of an error calling down to the driver.");
-    }
-}
+        case kAudioDeviceCustomPropertyLoopbackBufferDuration:
+            RequestLoopbackBufferMilliseconds(RDC_GetPositiveCFNumberValue(inDataSize, inData));
+            break;
 
-void	RDC_Device::StopIO(UInt32 inClientID)
-{
-    CAMutex::Locker theStateLocker(mStateMutex);
-    
-    // Update our client data.
-    //
-    // We add the work to the task queue, rather than doing it here, because BeginIOOperation and EndIOOperation also
-    // add this task to the queue and the updates should be done in order.
-    bool didStopIO = mTaskQueue.QueueSync_StopClientIO(&mClients, inClientID);
-	
-	//	we tell the hardware to stop if this is the last stop call
-	if(didStopIO)
-	{
-		_HW_StopIO();
-	}
-}
+        case kAudioDeviceCustomPropertyZeroTimeStampPeriod:
+            RequestZeroTimeStampPeriod(RDC_GetPositiveCFNumberValue(inDataSize, inData));
+            break;
 
-void	RDC_Device::GetZeroTimeStamp(Float64& outSampleTime, UInt64& outHostTime, UInt64& outSeed)
-{
-	// accessing the buffers requires holding the IO mutex
-	CAMutex::Locker theIOLocker(mIOMutex);
-    
-    if(mWrappedAudioEngine != NULL)
-    {
-    }
-    else
-    {
-        // Without a wrapped device, we base our timing on the host. This is mostly from Apple's NullAudio.c sample code
-    	UInt64 theCurrentHostTime;
-    	Float64 theHostTicksPerRingBuffer;
-    	Float64 theHostTickOffset;
-    	UInt64 theNextHostTime;
-    	
-    	//	get the current host time
-        theCurrentHostTime = CAHostTimeBase::GetTheCurrentTime();
-    	
-    	//	calculate the next host time
-    	theHostTicksPerRingBuffer = mLoopbackTime.hostTicksPerFrame * kLoopbackRingBufferFrameSize;
-    	theHostTickOffset = static_cast<Float64>(mLoopbackTime.numberTimeStamps + 1) * theHostTicksPerRingBuffer;
-    	theNextHostTime = mLoopbackTime.anchorHostTime + static_cast<UInt64>(theHostTickOffset);
-    	
-    	//	go to the next time if the next host time is less than the current time
-    	if(theNextHostTime <= theCurrentHostTime)
-    	{
-            mLoopbackTime.numberTimeStamps++;
-    	}
-    	
-    	//	set the return values
-    	outSampleTime = mLoopbackTime.numberTimeStamps * kLoopbackRingBufferFrameSize;
-    	outHostTime = static_cast<UInt64>(mLoopbackTime.anchorHostTime + (static_cast<Float64>(mLoopbackTime.numberTimeStamps) * theHostTicksPerRingBuffer));
-        // TODO: I think we should increment outSeed whenever this device switches to/from having a wrapped engine
-    	outSeed = 1;
-    }
-}
+        case kAudioDeviceCustomPropertyLoopbackStorageBitDepth:
+            RequestLoopbackStorageBitDepth(RDC_GetPositiveCFNumberValue(inDataSize, inData));
+            break;
 
-void	RDC_Device::WillDoIOOperation(UInt32 inOperationID, bool& outWillDo, bool& outWillDoInPlace) const
-{
-	switch(inOperationID)
-	{
-        case kAudioServerPlugInIOOperationThread:
-        case kAudioServerPlugInIOOperationReadInput:
-        case kAudioServerPlugInIOOperationProcessOutput:
-		case kAudioServerPlugInIOOperationWriteMix:
-			outWillDo = true;
-			outWillDoInPlace = true;
-			break;
+        case kAudioDeviceCustomPropertyReducedInputChannels:
+            {
+                ThrowIf(inDataSize < sizeof(CFArrayRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyReducedInputChannels");
 
-        case kAudioServerPlugInIOOperationProcessMix:
-            outWillDo = mVolumeControl.WillApplyVolumeToAudioRT();
-            outWillDoInPlace = true;
-            break;
+                CFArrayRef theChannelsRef = *reinterpret_cast<const CFArrayRef*>(inData);
 
-		case kAudioServerPlugInIOOperationCycle:
-        case kAudioServerPlugInIOOperationConvertInput:
-        case kAudioServerPlugInIOOperationProcessInput:
-		case kAudioServerPlugInIOOperationMixOutput:
-		case kAudioServerPlugInIOOperationConvertMix:
-		default:
-			outWillDo = false;
-			outWillDoInPlace = true;
-			break;
-			
-	};
-}
+                ThrowIfNULL(theChannelsRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyReducedInputChannels");
+                ThrowIf(CFGetTypeID(theChannelsRef) != CFArrayGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyReducedInputChannels was not a CFArray");
 
-void	RDC_Device::BeginIOOperation(UInt32 inOperationID, UInt32 inIOBufferFrameSize, const AudioServerPlugInIOCycleInfo& inIOCycleInfo, UInt32 inClientID)
-{
-	#pragma unused(inIOBufferFrameSize, inIOCycleInfo)
-    
-    if(inOperationID == kAudioServerPlugInIOOperationThread)
-    {
-        // Update this client's IO state and send notifications if that changes the value of
-        // kAudioDeviceCustomPropertyDeviceIsRunning or
-        // kAudioDeviceCustomPropertyDeviceIsRunningSomewhereOtherThanRDCApp. We have to do this here
-        // as well as in StartIO because the HAL only calls StartIO/StopIO with the first/last clients.
-        //
-        // We perform the update async because it isn't real-time safe, but we can't just dispatch it with
-        // dispatch_async because that isn't real-time safe either. (Apparently even constructing a block
-        // isn't.)
-        //
-        // We don't have to hold the IO mutex here because mTaskQueue and mClients don't change and
-        // adding a task to mTaskQueue is thread safe.
-        mTaskQueue.QueueAsync_StartClientIO(&mClients, inClientID);
-    }
-}
+                RequestReducedInputChannels(theChannelsRef);
+            }
+            break;
 
-void	RDC_Device::DoIOOperation(AudioObjectID inStreamObjectID, UInt32 inClientID, UInt32 inOperationID, UInt32 inIOBufferFrameSize, const AudioServerPlugInIOCycleInfo& inIOCycleInfo, void* ioMainBuffer, void* ioSecondaryBuffer)
-{
-    #pragma unused(inStreamObjectID, ioSecondaryBuffer)
-    
-	switch(inOperationID)
-	{
-		case kAudioServerPlugInIOOperationReadInput:
+        case kAudioDeviceCustomPropertyTappedBundleIDs:
             {
-                CAMutex::Locker theIOLocker(mIOMutex);
-
-                // Copy the audio data out of our ring buffer.
-                //
-                // Take the IO mutex because, in testing, not taking it seemed to make this function
-                // occasionally miss its deadline and cause an audio glitch. It's hard to be sure
-                // that was actually the cause, but it's probably not worth the risk anyway.
-                //
-                // If an IO operation misses its deadline, the host will log this message:
-                //     Audio IO Overload inputs: '<private>' outputs: '<private>' cause: 'Unknown'
-                //     prewarming: no recovering: no
-                ReadInputData(inIOBufferFrameSize,
-                              inIOCycleInfo.mInputTime.mSampleTime,
-                              ioMainBuffer);
+                ThrowIf(inDataSize < sizeof(CFArrayRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyTappedBundleIDs");
+
+                CFArrayRef theBundleIDsRef = *reinterpret_cast<const CFArrayRef*>(inData);
+
+                ThrowIfNULL(theBundleIDsRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyTappedBundleIDs");
+                ThrowIf(CFGetTypeID(theBundleIDsRef) != CFArrayGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyTappedBundleIDs was not a CFArray");
+
+                RequestTappedBundleIDs(theBundleIDsRef);
             }
-			break;
-            
-        case kAudioServerPlugInIOOperationProcessOutput:
-            ApplyVolume(inClientID, inIOBufferFrameSize, ioMainBuffer);
             break;
 
-        case kAudioServerPlugInIOOperationProcessMix:
+        case kAudioDeviceCustomPropertyBusBundleIDs:
             {
-                // Check the arguments.
-                ThrowIfNULL(ioMainBuffer,
-                            CAException(kAudioHardwareIllegalOperationError),
-                            "RDC_Device::DoIOOperation: Buffer for "
-                                    "kAudioServerPlugInIOOperationProcessMix must not be null");
+                ThrowIf(inDataSize < sizeof(CFArrayRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyBusBundleIDs");
 
-                CAMutex::Locker theIOLocker(mIOMutex);
+                CFArrayRef theBundleIDsRef = *reinterpret_cast<const CFArrayRef*>(inData);
+
+                ThrowIfNULL(theBundleIDsRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyBusBundleIDs");
+                ThrowIf(CFGetTypeID(theBundleIDsRef) != CFArrayGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyBusBundleIDs was not a CFArray");
 
-                // We ask to do this IO operation so this device can apply its own volume to the
-                // stream. Currently, only the UI sounds device does.
+                RequestBusBundleIDs(theBundleIDsRef);
             }
             break;
 
-        case kAudioServerPlugInIOOperationWriteMix:
+        case kAudioDeviceCustomPropertyTaskLatencies:
             {
-                CAMutex::Locker theIOLocker(mIOMutex);
+                ThrowIf(inDataSize < sizeof(CFBooleanRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyTaskLatencies");
 
-                // Copy the audio data into our ring buffer.
-                WriteOutputData(inIOBufferFrameSize,
-                                inIOCycleInfo.mOutputTime.mSampleTime,
-                                ioMainBuffer);
-            }
-			break;
+                CFBooleanRef theResetRef = *reinterpret_cast<const CFBooleanRef*>(inData);
 
-		default:
-            // Note that this will only log the error in debug builds.
-			DebugMsg("RDC_Device::DoIOOperation: Unexpected IO operation: %u", inOperationID);
-			break;
-	};
-}
+                ThrowIfNULL(theResetRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyTaskLatencies");
+                ThrowIf(CFGetTypeID(theResetRef) != CFBooleanGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyTaskLatencies was not a CFBoolean");
 
-void	RDC_Device::EndIOOperation(UInt32 inOperationID, UInt32 inIOBufferFrameSize, const AudioServerPlugInIOCycleInfo& inIOCycleInfo, UInt32 inClientID)
-{
-    #pragma unused(inIOBufferFrameSize, inIOCycleInfo)
+                if(CFBooleanGetValue(theResetRef))
+                {
+                    mTaskQueue.ResetTaskLatencies();
+                }
+            }
+            break;
 
-    if(inOperationID == kAudioServerPlugInIOOperationThread)
-    {
-        // Tell RDC_Clients that this client has stopped IO. Queued async because we have to be real-time safe here.
-        //
-        // We don't have to hold the IO mutex here because mTaskQueue and mClients don't change and adding a task to
-        // mTaskQueue is thread safe.
-        mTaskQueue.QueueAsync_StopClientIO(&mClients, inClientID);
-    }
-}
+        case kAudioDeviceCustomPropertyClientIOTimes:
+            {
+                ThrowIf(inDataSize < sizeof(CFBooleanRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyClientIOTimes");
 
-void	RDC_Device::ReadInputData(UInt32 inIOBufferFrameSize, Float64 inSampleTime, void* outBuffer)
-{
-    // Wrap the provided buffer in an AudioBufferList.
-    AudioBufferList abl = {
-        .mNumberBuffers = 1,
-        .mBuffers[0] = {
-            .mNumberChannels = 2,
-            // Each frame is 2 Float32 samples (one per channel). The number of frames * the number
-            // of bytes per frame = the size of outBuffer in bytes.
-            .mDataByteSize = static_cast<UInt32>(inIOBufferFrameSize * sizeof(Float32) * 2),
-            .mData = outBuffer
-        }
-    };
+                CFBooleanRef theResetRef = *reinterpret_cast<const CFBooleanRef*>(inData);
 
-    // Copy the audio data from our ring buffer into the provided buffer.
-    CARingBufferError err =
-            mLoopbackRingBuffer.Fetch(&abl,
+                ThrowIfNULL(theResetRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyClientIOTimes");
+                ThrowIf(CFGetTypeID(theResetRef) != CFBooleanGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyClientIOTimes was not a CFBoolean");
+
+                if(CFBooleanGetValue(theResetRef))
+                {
+                    mClients.ResetClientIOTimes();
+                }
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyRetroCaptureSeconds:
+            {
+                ThrowIf(inDataSize < sizeof(CFNumberRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyRetroCaptureSeconds");
+
+                CFNumberRef theSecondsRef = *reinterpret_cast<const CFNumberRef*>(inData);
+
+                ThrowIfNULL(theSecondsRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyRetroCaptureSeconds");
+                ThrowIf(CFGetTypeID(theSecondsRef) != CFNumberGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyRetroCaptureSeconds was not a CFNumber");
+
+                SInt64 theSeconds = -1;
+                CFNumberGetValue(theSecondsRef, kCFNumberSInt64Type, &theSeconds);
+
+                ThrowIf(theSeconds < 0 || theSeconds > kRDCMaxRetroCaptureSeconds,
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: "
+                        "kAudioDeviceCustomPropertyRetroCaptureSeconds out of range");
+
+                SetRetroCaptureSeconds(static_cast<UInt32>(theSeconds));
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCRetroCaptureSecondsAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyRetroCaptureSavePath:
+            {
+                ThrowIf(inDataSize < sizeof(CFStringRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyRetroCaptureSavePath");
+
+                CFStringRef thePathRef = *reinterpret_cast<const CFStringRef*>(inData);
+
+                ThrowIfNULL(thePathRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyRetroCaptureSavePath");
+                ThrowIf(CFGetTypeID(thePathRef) != CFStringGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyRetroCaptureSavePath was not a CFString");
+
+                SaveRetroCapture(thePathRef);
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCRetroCaptureSavePathAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyRetroCaptureSaveSeconds:
+            {
+                ThrowIf(inDataSize < sizeof(CFNumberRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyRetroCaptureSaveSeconds");
+
+                CFNumberRef theSecondsRef = *reinterpret_cast<const CFNumberRef*>(inData);
+
+                ThrowIfNULL(theSecondsRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyRetroCaptureSaveSeconds");
+                ThrowIf(CFGetTypeID(theSecondsRef) != CFNumberGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyRetroCaptureSaveSeconds was not a CFNumber");
+
+                SInt64 theSeconds = -1;
+                CFNumberGetValue(theSecondsRef, kCFNumberSInt64Type, &theSeconds);
+
+                ThrowIf(theSeconds < 0 || theSeconds > kRDCMaxRetroCaptureSeconds,
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: "
+                        "kAudioDeviceCustomPropertyRetroCaptureSaveSeconds out of range");
+
+                SetRetroCaptureSaveSeconds(static_cast<UInt32>(theSeconds));
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCRetroCaptureSaveSecondsAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyAppVolumes:
+            {
+                ThrowIf(inDataSize < sizeof(CFArrayRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyAppVolumes");
+
+                CFArrayRef theAppVolumesRef = *reinterpret_cast<const CFArrayRef*>(inData);
+
+                ThrowIfNULL(theAppVolumesRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyAppVolumes");
+                ThrowIf(CFGetTypeID(theAppVolumesRef) != CFArrayGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyAppVolumes was not a CFArray");
+
+                bool didChangeAppVolumes = false;
+
+                try
+                {
+                    didChangeAppVolumes = mClients.SetClientsRelativeVolumes(theAppVolumesRef);
+                }
+                catch(RDC_InvalidClientRelativeVolumeException)
+                {
+                    DebugMsg("RDC_Device::Device_SetPropertyData: Invalid app volume in "
+                             "kAudioDeviceCustomPropertyAppVolumes");
+                    Throw(CAException(kAudioHardwareIllegalOperationError));
+                }
+                catch(RDC_InvalidClientPanPositionException)
+                {
+                    DebugMsg("RDC_Device::Device_SetPropertyData: Invalid pan position in "
+                             "kAudioDeviceCustomPropertyAppVolumes");
+                    Throw(CAException(kAudioHardwareIllegalOperationError));
+                }
+
+                if(didChangeAppVolumes)
+                {
+                    SaveClientSettingsSoon();
+
+                    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                        AudioObjectPropertyAddress theChangedProperties[] = { kRDCAppVolumesAddress };
+                        RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                    });
+                }
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyInputTapBundleID:
+            {
+                ThrowIf(inDataSize < sizeof(CFStringRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyInputTapBundleID");
+
+                CFStringRef theBundleIDRef = *reinterpret_cast<const CFStringRef*>(inData);
+
+                ThrowIfNULL(theBundleIDRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyInputTapBundleID");
+                ThrowIf(CFGetTypeID(theBundleIDRef) != CFStringGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyInputTapBundleID was not a CFString");
+
+                SetInputTapBundleID(theBundleIDRef);
+            }
+            break;
+
+        case kAudioDeviceCustomPropertySharedLoopbackName:
+            {
+                ThrowIf(inDataSize < sizeof(CFStringRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertySharedLoopbackName");
+
+                CFStringRef theNameRef = *reinterpret_cast<const CFStringRef*>(inData);
+
+                ThrowIfNULL(theNameRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertySharedLoopbackName");
+                ThrowIf(CFGetTypeID(theNameRef) != CFStringGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertySharedLoopbackName was not a CFString");
+
+                RequestSharedLoopbackName(theNameRef);
+            }
+            break;
+
+        case kAudioDeviceCustomPropertySharedLoopbackWorldReadable:
+            {
+                ThrowIf(inDataSize < sizeof(CFBooleanRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertySharedLoopbackWorldReadable");
+
+                CFBooleanRef theWorldReadableRef = *reinterpret_cast<const CFBooleanRef*>(inData);
+
+                ThrowIfNULL(theWorldReadableRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertySharedLoopbackWorldReadable");
+                ThrowIf(CFGetTypeID(theWorldReadableRef) != CFBooleanGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertySharedLoopbackWorldReadable was not a CFBoolean");
+
+                RequestSharedLoopbackWorldReadable(CFBooleanGetValue(theWorldReadableRef));
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyRecordingPath:
+            {
+                ThrowIf(inDataSize < sizeof(CFStringRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyRecordingPath");
+
+                CFStringRef thePathRef = *reinterpret_cast<const CFStringRef*>(inData);
+
+                ThrowIfNULL(thePathRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyRecordingPath");
+                ThrowIf(CFGetTypeID(thePathRef) != CFStringGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyRecordingPath was not a CFString");
+
+                SetRecordingPath(thePathRef);
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCRecordingPathAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyRTPSender:
+            {
+                ThrowIf(inDataSize < sizeof(CFDictionaryRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyRTPSender");
+
+                CFDictionaryRef theConfigurationRef = *reinterpret_cast<const CFDictionaryRef*>(inData);
+
+                ThrowIfNULL(theConfigurationRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyRTPSender");
+                ThrowIf(CFGetTypeID(theConfigurationRef) != CFDictionaryGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyRTPSender was not a CFDictionary");
+
+                mRTPSender.SetConfiguration(theConfigurationRef);
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCRTPSenderAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyClockSource:
+            {
+                ThrowIf(inDataSize < sizeof(CFDictionaryRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyClockSource");
+
+                CFDictionaryRef theClockSourceRef = *reinterpret_cast<const CFDictionaryRef*>(inData);
+
+                ThrowIfNULL(theClockSourceRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyClockSource");
+                ThrowIf(CFGetTypeID(theClockSourceRef) != CFDictionaryGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyClockSource was not a CFDictionary");
+
+                SetClockSource(theClockSourceRef);
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyLoopbackStoragePlanar:
+            {
+                ThrowIf(inDataSize < sizeof(CFBooleanRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyLoopbackStoragePlanar");
+
+                CFBooleanRef thePlanarRef = *reinterpret_cast<const CFBooleanRef*>(inData);
+
+                ThrowIfNULL(thePlanarRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyLoopbackStoragePlanar");
+                ThrowIf(CFGetTypeID(thePlanarRef) != CFBooleanGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyLoopbackStoragePlanar was not a CFBoolean");
+
+                RequestLoopbackStoragePlanar(CFBooleanGetValue(thePlanarRef));
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyReadDelays:
+            {
+                ThrowIf(inDataSize < sizeof(CFDictionaryRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyReadDelays");
+
+                CFDictionaryRef theReadDelaysRef = *reinterpret_cast<const CFDictionaryRef*>(inData);
+
+                ThrowIfNULL(theReadDelaysRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyReadDelays");
+                ThrowIf(CFGetTypeID(theReadDelaysRef) != CFDictionaryGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyReadDelays was not a CFDictionary");
+
+                SetReadDelays(theReadDelaysRef);
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCReadDelaysAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyLoopbackBufferWired:
+            {
+                ThrowIf(inDataSize < sizeof(CFBooleanRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyLoopbackBufferWired");
+
+                CFBooleanRef theWiredRef = *reinterpret_cast<const CFBooleanRef*>(inData);
+
+                ThrowIfNULL(theWiredRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyLoopbackBufferWired");
+                ThrowIf(CFGetTypeID(theWiredRef) != CFBooleanGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyLoopbackBufferWired was not a CFBoolean");
+
+                SetLoopbackBufferWired(CFBooleanGetValue(theWiredRef));
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCLoopbackBufferWiredAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyLoopbackIdleTimeout:
+            {
+                ThrowIf(inDataSize < sizeof(CFNumberRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyLoopbackIdleTimeout");
+
+                CFNumberRef theTimeoutRef = *reinterpret_cast<const CFNumberRef*>(inData);
+
+                ThrowIfNULL(theTimeoutRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyLoopbackIdleTimeout");
+                ThrowIf(CFGetTypeID(theTimeoutRef) != CFNumberGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyLoopbackIdleTimeout was not a CFNumber");
+
+                SInt64 theTimeout = -1;
+                CFNumberGetValue(theTimeoutRef, kCFNumberSInt64Type, &theTimeout);
+
+                ThrowIf(theTimeout < 0 || theTimeout > kRDCMaxLoopbackIdleTimeoutSeconds,
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: "
+                        "kAudioDeviceCustomPropertyLoopbackIdleTimeout out of range");
+
+                SetLoopbackIdleTimeout(static_cast<UInt32>(theTimeout));
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = { kRDCLoopbackIdleTimeoutAddress };
+                    RDC_PlugIn::Host_PropertiesChanged(inObjectID, 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyDriftCompensation:
+            {
+                ThrowIf(inDataSize < sizeof(CFBooleanRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyDriftCompensation");
+
+                CFBooleanRef theEnabledRef = *reinterpret_cast<const CFBooleanRef*>(inData);
+
+                ThrowIfNULL(theEnabledRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyDriftCompensation");
+                ThrowIf(CFGetTypeID(theEnabledRef) != CFBooleanGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyDriftCompensation was not a CFBoolean");
+
+                bool wasEnabled = mDriftCompensator.IsEnabledRT();
+                mDriftCompensator.SetEnabled(CFBooleanGetValue(theEnabledRef));
+
+                // The input safety offset includes drift compensation's look-ahead.
+                if(wasEnabled != mDriftCompensator.IsEnabledRT())
+                {
+                    SendLatencyNotifications(false);
+                }
+            }
+            break;
+
+        case kAudioDeviceCustomPropertySignposts:
+            {
+                ThrowIf(inDataSize < sizeof(CFBooleanRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertySignposts");
+
+                CFBooleanRef theEnabledRef = *reinterpret_cast<const CFBooleanRef*>(inData);
+
+                ThrowIfNULL(theEnabledRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertySignposts");
+                ThrowIf(CFGetTypeID(theEnabledRef) != CFBooleanGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertySignposts was not a CFBoolean");
+
+                RDC_Signposts::SetEnabled(CFBooleanGetValue(theEnabledRef));
+            }
+            break;
+
+        case kAudioDeviceCustomPropertyLatencyOverrides:
+            {
+                ThrowIf(inDataSize < sizeof(CFDictionaryRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_Device::Device_SetPropertyData: wrong size for the data for "
+                        "kAudioDeviceCustomPropertyLatencyOverrides");
+
+                CFDictionaryRef theOverridesRef = *reinterpret_cast<const CFDictionaryRef*>(inData);
+
+                ThrowIfNULL(theOverridesRef,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_Device::Device_SetPropertyData: null reference given for "
+                            "kAudioDeviceCustomPropertyLatencyOverrides");
+                ThrowIf(CFGetTypeID(theOverridesRef) != CFDictionaryGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_Device::Device_SetPropertyData: CFType given for "
+                        "kAudioDeviceCustomPropertyLatencyOverrides was not a CFDictionary");
+
+                SetLatencyOverrides(theOverridesRef);
+                SendLatencyNotifications(true);
+            }
+            break;
+
+		default:
+			RDC_AbstractDevice::SetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, inData);
+			break;
+    };
+}
+
+#pragma mark IO Operations
+
+void	RDC_Device::StartIO(UInt32 inClientID)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    
+    // The host can still try to start IO on an instance SetNumberOfInstances has hidden, until it
+    // sees the device list change. SetNumberOfInstances holds this mutex while it hides instances.
+    ThrowIf(mInstanceIndex >= GetNumberOfInstances(),
+            CAException(kAudioHardwareBadDeviceError),
+            "RDC_Device::StartIO: The instance is hidden");
+    
+    // An overview of the process this function is part of:
+    //   - A client starts IO.
+    //   - The plugin host (the HAL) calls the StartIO function in RDC_PlugInInterface, which calls this function.
+    //   - RDCDriver sends a message to RDCApp telling it to start the (real) audio hardware.
+    //   - RDCApp starts the hardware and, after the hardware is ready, replies to RDCDriver's message.
+    //   - RDCDriver lets the host know that it's ready to do IO by returning from StartIO.
+    
+    // Update our client data.
+    //
+    // We add the work to the task queue, rather than doing it here, because BeginIOOperation and EndIOOperation
+    // also add this task to the queue and the updates should be done in order. They only add it when the
+    // client's requested IO state changes, so we have to record the change here as well.
+    mClients.SetRequestedIOStateRT(inClientID, true);
+    bool didStartIO = mTaskQueue.QueueSync_StartClientIO(&mClients, inClientID);
+    
+    // We only tell the hardware to start if this is the first time IO has been started.
+    if(didStartIO)
+    {
+        // Cancel the release of the loopback buffer, if one is scheduled, or allocate it if it's
+        // the first time IO has started or it was released. Either way, IO can't be running yet.
+        mLoopbackIdleGeneration++;
+
+        if(!mLoopbackIsAllocated)
+        {
+            DebugMsg("RDC_Device::StartIO: Allocating the loopback buffer");
+            AllocateLoopback();
+        }
+
+        // The sample times start again, so the old timestamps would map them to the wrong host
+        // times.
+        RDC_LoopbackTimeStamps::Clear(mLoopbackTimeStamps);
+        mSharedLoopbackBuffer.ClearTimeStamps();
+
+        // SetClockSource ignores the followed device's zero timestamps while we're idle, so the
+        // anchor is out of date.
+        mClockSource.ResetClockAnchor();
+
+        // Nothing was written to the loopback buffer while IO was stopped, so the RTP sender
+        // stopped waking up.
+        mRTPSender.SetSourceIsRunning(true);
+
+        kern_return_t theError = _HW_StartIO();
+        ThrowIfKernelError(theError,
+                           CAException(theError),
+                           "RDC_Device::StartIO: Failed to start because of an error calling down to the driver.");
+    }
+}
+
+void	RDC_Device::StopIO(UInt32 inClientID)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    
+    // Update our client data.
+    //
+    // We add the work to the task queue, rather than doing it here, because BeginIOOperation and EndIOOperation also
+    // add this task to the queue and the updates should be done in order.
+    mClients.SetRequestedIOStateRT(inClientID, false);
+    bool didStopIO = mTaskQueue.QueueSync_StopClientIO(&mClients, inClientID);
+	
+	//	we tell the hardware to stop if this is the last stop call
+	if(didStopIO)
+	{
+		_HW_StopIO();
+
+        // Stop the RTP sender's thread waking up every packet time. It wakes again in StartIO.
+        mRTPSender.SetSourceIsRunning(false);
+
+        // Free the loopback buffer if IO doesn't start again soon.
+        ScheduleLoopbackRelease();
+	}
+}
+
+void	RDC_Device::GetZeroTimeStamp(Float64& outSampleTime, UInt64& outHostTime, UInt64& outSeed)
+{
+	// accessing the buffers requires holding the IO mutex
+	CAMutex::Locker theIOLocker(mIOMutex);
+    
+    if(mWrappedAudioEngine != NULL)
+    {
+    }
+    else
+    {
+        // Without a wrapped device, we base our timing on the host, or on the device mClockSource
+        // follows if there is one. This is mostly from Apple's NullAudio.c sample code
+    	UInt64 theCurrentHostTime;
+    	UInt64 theNextHostTime;
+    	
+    	//	get the current host time
+        theCurrentHostTime = CAHostTimeBase::GetTheCurrentTime();
+
+        RDC_WrappedAudioEngine::ClockAnchor theAnchor;
+        bool isFollowing = mClockSource.GetClockAnchorRT(theAnchor);
+        // The number of our frames per frame of the followed device, in case it runs at a different
+        // nominal rate.
+        Float64 theFrameRatio = isFollowing ? (mLoopbackSampleRate / theAnchor.mSampleRate) : 1.0;
+
+        // If we've started or stopped following a device, or its clock jumped, re-anchor the
+        // timeline at the last timestamp we returned so the HAL doesn't see the clock jump.
+        if(isFollowing != mLoopbackTime.isFollowing ||
+           (isFollowing && theAnchor.mEpoch != mLoopbackTime.followedEpoch))
+        {
+            if(isFollowing)
+            {
+                Float64 theFollowedLastSampleTime =
+                        theAnchor.mSampleTime +
+                        (static_cast<Float64>(mLoopbackTime.lastHostTime) -
+                                static_cast<Float64>(theAnchor.mHostTime)) /
+                                theAnchor.mHostTicksPerFrame;
+                mLoopbackTime.followedStartTime =
+                        theFollowedLastSampleTime -
+                                static_cast<Float64>(mLoopbackTime.lastSampleTime) / theFrameRatio;
+                mLoopbackTime.followedEpoch = theAnchor.mEpoch;
+            }
+            else
+            {
+                mLoopbackTime.clock.SetAnchor(mLoopbackTime.lastSampleTime, mLoopbackTime.lastHostTime);
+            }
+
+            mLoopbackTime.isFollowing = isFollowing;
+        }
+
+        // Converts one of our sample times to a host time, using the followed device's clock if
+        // there is one. The followed device's anchor moves with every zero timestamp it gives us, so
+        // rounding errors in that calculation don't accumulate either.
+        auto theHostTimeForSampleTime = [&](UInt64 inSampleTime) -> UInt64 {
+            if(isFollowing)
+            {
+                Float64 theFollowedSampleTime =
+                        mLoopbackTime.followedStartTime + static_cast<Float64>(inSampleTime) / theFrameRatio;
+                return static_cast<UInt64>(
+                        static_cast<Float64>(theAnchor.mHostTime) +
+                        (theFollowedSampleTime - theAnchor.mSampleTime) * theAnchor.mHostTicksPerFrame);
+            }
+
+            return mLoopbackTime.clock.GetHostTimeForSampleTime(inSampleTime);
+        };
+    	
+    	//	calculate the next host time
+    	theNextHostTime = theHostTimeForSampleTime((mLoopbackTime.numberTimeStamps + 1) * mZeroTimeStampPeriod);
+    	
+    	//	go to the next time if the next host time is less than the current time
+    	if(theNextHostTime <= theCurrentHostTime)
+    	{
+            mLoopbackTime.numberTimeStamps++;
+    	}
+    	
+    	//	set the return values
+        mLoopbackTime.lastSampleTime = mLoopbackTime.numberTimeStamps * mZeroTimeStampPeriod;
+        mLoopbackTime.lastHostTime = theHostTimeForSampleTime(mLoopbackTime.lastSampleTime);
+    	outSampleTime = static_cast<Float64>(mLoopbackTime.lastSampleTime);
+    	outHostTime = mLoopbackTime.lastHostTime;
+        // TODO: I think we should increment outSeed whenever this device switches to/from having a wrapped engine
+    	outSeed = 1;
+    }
+}
+
+void	RDC_Device::WillDoIOOperation(UInt32 inOperationID, bool& outWillDo, bool& outWillDoInPlace) const
+{
+	switch(inOperationID)
+	{
+        case kAudioServerPlugInIOOperationThread:
+        case kAudioServerPlugInIOOperationReadInput:
+        case kAudioServerPlugInIOOperationProcessOutput:
+		case kAudioServerPlugInIOOperationWriteMix:
+			outWillDo = true;
+			outWillDoInPlace = true;
+			break;
+
+        // The master volume is applied in WriteMix, while the mix is copied into the loopback
+        // buffer, so there's nothing to do in ProcessMix.
+        case kAudioServerPlugInIOOperationProcessMix:
+		case kAudioServerPlugInIOOperationCycle:
+        case kAudioServerPlugInIOOperationConvertInput:
+        case kAudioServerPlugInIOOperationProcessInput:
+		case kAudioServerPlugInIOOperationMixOutput:
+		case kAudioServerPlugInIOOperationConvertMix:
+		default:
+			outWillDo = false;
+			outWillDoInPlace = true;
+			break;
+			
+	};
+}
+
+// The sample time an IO operation is for, for the IO trace.
+static Float64 RDC_GetIOOperationSampleTime(UInt32 inOperationID, const AudioServerPlugInIOCycleInfo& inIOCycleInfo)
+{
+    switch(inOperationID)
+    {
+        case kAudioServerPlugInIOOperationReadInput:
+        case kAudioServerPlugInIOOperationConvertInput:
+        case kAudioServerPlugInIOOperationProcessInput:
+            return inIOCycleInfo.mInputTime.mSampleTime;
+
+        case kAudioServerPlugInIOOperationProcessOutput:
+        case kAudioServerPlugInIOOperationMixOutput:
+        case kAudioServerPlugInIOOperationProcessMix:
+        case kAudioServerPlugInIOOperationConvertMix:
+        case kAudioServerPlugInIOOperationWriteMix:
+            return inIOCycleInfo.mOutputTime.mSampleTime;
+
+        default:
+            return inIOCycleInfo.mCurrentTime.mSampleTime;
+    }
+}
+
+void	RDC_Device::BeginIOOperation(UInt32 inOperationID, UInt32 inIOBufferFrameSize, const AudioServerPlugInIOCycleInfo& inIOCycleInfo, UInt32 inClientID)
+{
+    // Report anything that isn't real-time safe, in debug builds.
+    RDC_RTSafety::Scope theRTSafetyScope;
+
+    RDC_IOTrace::Scope theTraceScope(mIOTrace,
+                                     mLoopbackRingBuffer,
+                                     kRDCIOTraceCall_BeginIOOperation,
+                                     inOperationID,
+                                     inClientID,
+                                     inIOBufferFrameSize,
+                                     RDC_GetIOOperationSampleTime(inOperationID, inIOCycleInfo));
+    
+    if(inOperationID == kAudioServerPlugInIOOperationThread)
+    {
+        // Keep the task queue's real-time thread scheduled for the IO cycle, so the work the IO thread hands it isn't left
+        // waiting on an efficiency core. This only does anything when the buffer size or sample rate has changed.
+        mTaskQueue.SetRealTimeThreadIOCycleRT(inIOCycleInfo.mNominalIOBufferFrameSize,
+                                              inIOCycleInfo.mMasterHostTicksPerFrame);
+
+        // Record the largest IO buffer size for GetSafetyOffset.
+        UInt32 theMaxIOBufferFrameSize = mMaxIOBufferFrameSize.load(std::memory_order_relaxed);
+        while(inIOCycleInfo.mNominalIOBufferFrameSize > theMaxIOBufferFrameSize &&
+              !mMaxIOBufferFrameSize.compare_exchange_weak(theMaxIOBufferFrameSize,
+                                                           inIOCycleInfo.mNominalIOBufferFrameSize,
+                                                           std::memory_order_relaxed))
+        {
+            // theMaxIOBufferFrameSize was updated by compare_exchange_weak, so just try again.
+        }
+        
+
+        // Update this client's IO state and send notifications if that changes the value of
+        // kAudioDeviceCustomPropertyDeviceIsRunning or
+        // kAudioDeviceCustomPropertyDeviceIsRunningSomewhereOtherThanRDCApp. We have to do this here
+        // as well as in StartIO because the HAL only calls StartIO/StopIO with the first/last clients.
+        //
+        // We perform the update async because it isn't real-time safe, but we can't just dispatch it with
+        // dispatch_async because that isn't real-time safe either. (Apparently even constructing a block
+        // isn't.)
+        //
+        // The HAL calls this every IO cycle, so we only queue the task when the client wasn't already
+        // doing IO. Otherwise the worker thread would wake up thousands of times a second to find
+        // nothing had changed.
+        //
+        // We don't have to hold the IO mutex here because mTaskQueue and mClients don't change and
+        // adding a task to mTaskQueue is thread safe.
+        //
+        // If the queue is full and the task gets dropped, we put the requested state back so the next
+        // IO cycle tries again. Otherwise the client would never be marked as doing IO.
+        if(mClients.SetRequestedIOStateRT(inClientID, true) &&
+           !mTaskQueue.QueueAsync_StartClientIO(&mClients, inClientID))
+        {
+            mClients.SetRequestedIOStateRT(inClientID, false);
+        }
+    }
+}
+
+void	RDC_Device::DoIOOperation(AudioObjectID inStreamObjectID, UInt32 inClientID, UInt32 inOperationID, UInt32 inIOBufferFrameSize, const AudioServerPlugInIOCycleInfo& inIOCycleInfo, void* ioMainBuffer, void* ioSecondaryBuffer)
+{
+    #pragma unused(ioSecondaryBuffer)
+
+    // Report anything that isn't real-time safe, in debug builds.
+    RDC_RTSafety::Scope theRTSafetyScope;
+
+    RDC_IOTrace::Scope theTraceScope(mIOTrace,
+                                     mLoopbackRingBuffer,
+                                     kRDCIOTraceCall_DoIOOperation,
+                                     inOperationID,
+                                     inClientID,
+                                     inIOBufferFrameSize,
+                                     RDC_GetIOOperationSampleTime(inOperationID, inIOCycleInfo));
+
+    // For kAudioDeviceCustomPropertyClientIOTimes.
+    UInt64 theStartHostTime = mach_absolute_time();
+    
+	switch(inOperationID)
+	{
+		case kAudioServerPlugInIOOperationReadInput:
+            // Copy the audio data out of our ring buffer.
+            //
+            // We don't take the IO mutex here or in WriteMix. The input and output IO can run on
+            // different threads, and if they have to wait for each other one of them can miss its
+            // deadline and cause an audio glitch. In that case the host logs this message:
+            //     Audio IO Overload inputs: '<private>' outputs: '<private>' cause: 'Unknown'
+            //     prewarming: no recovering: no
+            //
+            // The HAL only ever has one thread writing the mix, so the ring buffer is used as a
+            // single-producer ring and CARingBuffer's lock-free time bounds are enough to keep the
+            // reader consistent. If a read races with the writer overwriting the same frames,
+            // ReadInputData treats it as an overload and outputs silence.
+            //
+            // The HAL reads each input stream the client uses separately, so a client that only
+            // uses the reduced input stream is only read once.
+            RDCSignpostBegin("ReadInput", RDC_Signposts::MakeID(inClientID));
+            if(inStreamObjectID == mReducedInputStream.GetObjectID())
+            {
+                ReadReducedInputData(inClientID,
+                                     inIOBufferFrameSize,
+                                     inIOCycleInfo.mInputTime.mSampleTime,
+                                     inIOCycleInfo.mInputTime.mHostTime,
+                                     ioMainBuffer);
+            }
+            else
+            {
+                ReadInputData(inClientID,
+                              inIOBufferFrameSize,
+                              inIOCycleInfo.mInputTime.mSampleTime,
+                              inIOCycleInfo.mInputTime.mHostTime,
+                              ioMainBuffer);
+            }
+            RDCSignpostEnd("ReadInput", RDC_Signposts::MakeID(inClientID));
+			break;
+            
+        case kAudioServerPlugInIOOperationProcessOutput:
+            // The clients' output is in the streams' format here. The per-app volumes, the taps and
+            // the buses only handle Float32, so with the integer formats they're skipped. The master
+            // volume is applied to the mix in WriteOutputData.
+            RDCSignpostBegin("ProcessOutput", RDC_Signposts::MakeID(inClientID));
+            if(mSampleFormat == kRDCSampleFormat_Float32)
+            {
+                ApplyClientRelativeVolume(inClientID, inIOBufferFrameSize, ioMainBuffer);
+                TapClientOutputData(inClientID,
+                                    inIOBufferFrameSize,
+                                    inIOCycleInfo.mOutputTime.mSampleTime,
+                                    ioMainBuffer);
+                mClientBuses.MixClientRT(inClientID,
+                                         static_cast<const Float32*>(ioMainBuffer),
+                                         inIOBufferFrameSize,
+                                         static_cast<CARingBuffer::SampleTime>(inIOCycleInfo.mOutputTime.mSampleTime));
+            }
+            RDCSignpostEnd("ProcessOutput", RDC_Signposts::MakeID(inClientID));
+            break;
+
+        case kAudioServerPlugInIOOperationWriteMix:
+            // Finish this cycle's buses. This has to come first because WriteOutputData returns
+            // early if the mix is silent, but the buses might not be.
+            RDCSignpostBegin("WriteMix", RDC_Signposts::MakeID(inClientID));
+            if(mSampleFormat == kRDCSampleFormat_Float32)
+            {
+                mClientBuses.StoreRT(static_cast<const Float32*>(ioMainBuffer),
+                                     inIOBufferFrameSize,
+                                     static_cast<CARingBuffer::SampleTime>(inIOCycleInfo.mOutputTime.mSampleTime));
+            }
+
+            // Copy the audio data into our ring buffer. Lock-free, see ReadInput above.
+            WriteOutputData(inIOBufferFrameSize,
+                            inIOCycleInfo.mOutputTime.mSampleTime,
+                            ioMainBuffer);
+
+            // Let the instances this one is routed to map their input times to ours.
+            RDC_LoopbackRouter::GetInstance().PublishSourceTimeRT(mInstanceIndex,
+                                                                  inIOCycleInfo.mOutputTime.mSampleTime,
+                                                                  inIOCycleInfo.mOutputTime.mHostTime);
+
+            // Let readers look up the host times of the frames that were just stored.
+            RDC_LoopbackTimeStamps::RecordRT(mLoopbackTimeStamps,
+                                             static_cast<SInt64>(inIOCycleInfo.mOutputTime.mSampleTime),
+                                             inIOCycleInfo.mOutputTime.mHostTime);
+            mSharedLoopbackBuffer.StoreTimeStampRT(static_cast<SInt64>(inIOCycleInfo.mOutputTime.mSampleTime),
+                                                   inIOCycleInfo.mOutputTime.mHostTime);
+
+            // The input is read before the mix is written in each cycle, so this counts the cycles
+            // WriteOutputData has seen without a read.
+            mCyclesSinceInputRead.store(std::min(mCyclesSinceInputRead.load(std::memory_order_relaxed) + 1,
+                                                 kLoopbackInputIdleCycles),
+                                        std::memory_order_relaxed);
+            RDCSignpostEnd("WriteMix", RDC_Signposts::MakeID(inClientID));
+			break;
+
+		default:
+            // Note that this will only log the error in debug builds.
+			DebugMsg("RDC_Device::DoIOOperation: Unexpected IO operation: %u", inOperationID);
+			break;
+	};
+
+    UInt64 theOperationTicks = mach_absolute_time() - theStartHostTime;
+
+    // WriteMix is done once per cycle for every client, so it isn't any one client's time. It's
+    // the last operation in the cycle, so it ends the cycle for the stats.
+    if(inOperationID != kAudioServerPlugInIOOperationWriteMix)
+    {
+        mClients.AddIOTimeRT(inClientID, theOperationTicks);
+        mLoopbackStats.currentIOCycleTicks.fetch_add(theOperationTicks, std::memory_order_relaxed);
+    }
+    else
+    {
+        UInt64 theCycleTicks =
+            mLoopbackStats.currentIOCycleTicks.exchange(0, std::memory_order_relaxed) + theOperationTicks;
+        UInt64 theSlowestTicks = mLoopbackStats.slowestIOCycleTicks.load(std::memory_order_relaxed);
+        while(theCycleTicks > theSlowestTicks &&
+              !mLoopbackStats.slowestIOCycleTicks.compare_exchange_weak(theSlowestTicks,
+                                                                        theCycleTicks,
+                                                                        std::memory_order_relaxed))
+        {
+        }
+
+        mLoopbackStats.ioCycles.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void	RDC_Device::EndIOOperation(UInt32 inOperationID, UInt32 inIOBufferFrameSize, const AudioServerPlugInIOCycleInfo& inIOCycleInfo, UInt32 inClientID)
+{
+    // Report anything that isn't real-time safe, in debug builds.
+    RDC_RTSafety::Scope theRTSafetyScope;
+
+    RDC_IOTrace::Scope theTraceScope(mIOTrace,
+                                     mLoopbackRingBuffer,
+                                     kRDCIOTraceCall_EndIOOperation,
+                                     inOperationID,
+                                     inClientID,
+                                     inIOBufferFrameSize,
+                                     RDC_GetIOOperationSampleTime(inOperationID, inIOCycleInfo));
+
+    if(inOperationID == kAudioServerPlugInIOOperationThread)
+    {
+        // Tell RDC_Clients that this client has stopped IO. Queued async because we have to be real-time safe here,
+        // and only if it hasn't already been stopped since it last started.
+        //
+        // We don't have to hold the IO mutex here because mTaskQueue and mClients don't change and adding a task to
+        // mTaskQueue is thread safe.
+        //
+        // If the task gets dropped, put the requested state back so the next call can try again.
+        if(mClients.SetRequestedIOStateRT(inClientID, false) &&
+           !mTaskQueue.QueueAsync_StopClientIO(&mClients, inClientID))
+        {
+            mClients.SetRequestedIOStateRT(inClientID, true);
+        }
+    }
+}
+
+void	RDC_Device::ReadInputData(UInt32 inClientID,
+                              UInt32 inIOBufferFrameSize,
+                              Float64 inSampleTime,
+                              UInt64 inHostTime,
+                              void* outBuffer)
+{
+    CARingBuffer::SampleTime theSampleTime = static_cast<CARingBuffer::SampleTime>(inSampleTime);
+
+    mCyclesSinceInputRead.store(0, std::memory_order_relaxed);
+
+    // If other instances' output is routed to this input, read the sum of their output instead of
+    // our own. The router only mixes Float32. See kAudioPlugInCustomPropertyLoopbackRoutes.
+    RDC_LoopbackRouter& theRouter = RDC_LoopbackRouter::GetInstance();
+    UInt32 theRoutedSources = theRouter.GetSourcesRT(mInstanceIndex);
+    bool theSucceeded;
+
+    if(theRoutedSources != 0 && mSampleFormat == kRDCSampleFormat_Float32)
+    {
+        theSucceeded = theRouter.MixSourcesRT(mInstanceIndex,
+                                              theRoutedSources,
+                                              mLoopbackSampleRate,
+                                              mChannelCount,
+                                              inHostTime,
+                                              static_cast<Float32*>(outBuffer),
+                                              inIOBufferFrameSize,
+                                              mReadConversionBuffer.data(),
+                                              mReadConversionBuffer.empty() ?
+                                                  0 : kLoopbackConversionChunkFrameSize);
+    }
+    else
+    {
+        theSucceeded = FetchInputData(inClientID, inIOBufferFrameSize, inSampleTime, outBuffer);
+    }
+
+    if(mReadConcealments.empty())
+    {
+        if(!theSucceeded)
+        {
+            mLoopbackStats.silentFetches.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return;
+    }
+
+    UInt32 theConcealment = GetReadConcealmentRT(inClientID);
+
+    if(theSucceeded)
+    {
+        // Fade back in from the silence the client's last failed read left, so it doesn't end in a
+        // click.
+        if(mReadConcealments[theConcealment].needsFadeIn)
+        {
+            FadeInAfterConcealment(outBuffer, inIOBufferFrameSize);
+            mReadConcealments[theConcealment].needsFadeIn = false;
+        }
+
+        RememberLastReadFrame(theConcealment, outBuffer, inIOBufferFrameSize, theSampleTime);
+    }
+    else
+    {
+        mLoopbackStats.silentFetches.fetch_add(1, std::memory_order_relaxed);
+        ConcealFailedRead(theConcealment, outBuffer, inIOBufferFrameSize, theSampleTime);
+    }
+}
+
+UInt32	RDC_Device::GetReadConcealmentRT(UInt32 inClientID)
+{
+    UInt32 theSlot = mClients.GetClientIOStateSlotRT(inClientID);
+    UInt32 theIndex = (theSlot < kRDCIOStateSlotCount) ? theSlot : kRDCIOStateSlotCount;
+    RDC_ReadConcealment& theConcealment = mReadConcealments[theIndex];
+
+    // The slot belonged to a client that's been removed, or the shared entry was last used by
+    // another client without a slot, so the state isn't this client's.
+    if(theConcealment.clientID != inClientID)
+    {
+        theConcealment = RDC_ReadConcealment();
+        theConcealment.clientID = inClientID;
+    }
+
+    return theIndex;
+}
+
+UInt32	RDC_Device::GetReadDelayRT(UInt32 inClientID) const
+{
+    // Delayed clients read further back in the same buffer. A delay that doesn't fit yet, because
+    // the buffer hasn't been resized for it, is shortened until it has. Usually no client has a
+    // delay, so skip looking this one up in that case. With small IO buffers the lookup costs as
+    // much as the copy.
+    UInt32 theReadDelay = 0;
+    if(mReadDelayHeadroomFrames > 0)
+    {
+        mClients.GetClientReadDelayRT(inClientID, theReadDelay);
+        theReadDelay = std::min(theReadDelay, mReadDelayHeadroomFrames);
+    }
+
+    return theReadDelay;
+}
+
+CARingBuffer&	RDC_Device::GetInputRingBufferRT(RDC_SampleFormat& outFormat, bool& outIsPlanar)
+{
+    // Read from one of the client taps instead of the mix if one has been selected, or otherwise
+    // from the buses if they're enabled. The taps and buses always store interleaved Float32.
+    SInt32 theTapIndex = mInputTapIndex.load(std::memory_order_acquire);
+    bool theReadsMix = (theTapIndex < 0) && !mClientBuses.IsEnabledRT();
+
+    outFormat = theReadsMix ? mLoopbackStorageFormat : kRDCSampleFormat_Float32;
+    outIsPlanar = theReadsMix && mLoopbackStoragePlanar;
+
+    return (theTapIndex >= 0) ? mClientTaps.GetTapRingBufferRT(theTapIndex) :
+           theReadsMix        ? mLoopbackRingBuffer :
+                                mClientBuses.GetRingBufferRT();
+}
+
+bool	RDC_Device::FetchInputData(UInt32 inClientID,
+                               UInt32 inIOBufferFrameSize,
+                               Float64 inSampleTime,
+                               void* outBuffer,
+                               bool inAllowDriftCompensation)
+{
+    UInt32 theReadDelay = GetReadDelayRT(inClientID);
+
+    CARingBuffer::SampleTime theStartTime = static_cast<CARingBuffer::SampleTime>(inSampleTime) - theReadDelay;
+    CARingBuffer::SampleTime theEndTime = theStartTime + inIOBufferFrameSize;
+
+    // The stats below are for whichever buffer we read.
+    RDC_SampleFormat theRingFormat;
+    bool theRingIsPlanar;
+    CARingBuffer& theRingBuffer = GetInputRingBufferRT(theRingFormat, theRingIsPlanar);
+
+    // Check where the reader is relative to the data in the buffer, for the stats. This doesn't
+    // need to be exact, so it's fine that the writer might move the bounds before we call Fetch.
+    CARingBuffer::SampleTime theBufferStartTime, theBufferEndTime;
+    if(theRingBuffer.GetTimeBounds(theBufferStartTime, theBufferEndTime) == kCARingBufferError_OK)
+    {
+        if(theStartTime < theBufferStartTime || theEndTime > theBufferEndTime)
+        {
+            mLoopbackStats.underruns.fetch_add(1, std::memory_order_relaxed);
+
+            if(theStartTime < theBufferStartTime)
+            {
+                mLoopbackStats.overruns.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        CARingBuffer::SampleTime theDistance = theBufferEndTime - theStartTime;
+        mLoopbackStats.readWriteDistance.store(theDistance, std::memory_order_relaxed);
+        UInt64 theAbsDistance = static_cast<UInt64>(theDistance < 0 ? -theDistance : theDistance);
+        UInt64 theMaxDistance = mLoopbackStats.maxReadWriteDistance.load(std::memory_order_relaxed);
+        while(theAbsDistance > theMaxDistance &&
+              !mLoopbackStats.maxReadWriteDistance.compare_exchange_weak(theMaxDistance,
+                                                                         theAbsDistance,
+                                                                         std::memory_order_relaxed))
+        {
+            // theMaxDistance was updated by compare_exchange_weak, so just try again.
+        }
+    }
+
+    // If drift compensation is on, let it choose which frames to read. It works on interleaved
+    // Float32, so it's only used while nothing needs converting or interleaving. It also follows a
+    // single reader's timeline, which delayed readers would keep restarting.
+    if(inAllowDriftCompensation &&
+       mDriftCompensator.IsEnabledRT() &&
+       theReadDelay == 0 &&
+       !theRingIsPlanar &&
+       theRingFormat == kRDCSampleFormat_Float32 &&
+       mSampleFormat == kRDCSampleFormat_Float32)
+    {
+        // Not retried, because the compensator has already moved its read position on.
+        CARingBufferError theError = mDriftCompensator.ReadRT(theRingBuffer,
+                                                              static_cast<Float32*>(outBuffer),
+                                                              inIOBufferFrameSize,
+                                                              theStartTime);
+        return (theError == kCARingBufferError_OK);
+    }
+
+    if(theRingFormat == mSampleFormat)
+    {
+        // Nothing to convert, so copy straight from the ring buffer into the provided buffer. Fetch
+        // zero-fills silent frames without reading them.
+        return FetchLoopbackData(theRingBuffer, theRingFormat, outBuffer, inIOBufferFrameSize, theStartTime);
+    }
+
+    UInt32 theBytesPerFrame = mChannelCount * RDC_SampleConversion::BytesPerSample(mSampleFormat);
+
+    // Silence is zero in every format, so if the frames are silent the conversions can be skipped.
+    if(theRingBuffer.IsSilent(inIOBufferFrameSize, theStartTime))
+    {
+        memset(outBuffer, 0, inIOBufferFrameSize * theBytesPerFrame);
+        return true;
+    }
+
+    // Interleaved frames can be converted without copying them out of the ring buffer first.
+    bool theSucceeded = true;
+    if(!theRingIsPlanar &&
+       ConvertLoopbackDataInPlace(theRingBuffer,
+                                  theRingFormat,
+                                  outBuffer,
+                                  inIOBufferFrameSize,
+                                  theStartTime,
+                                  theSucceeded))
+    {
+        return theSucceeded;
+    }
+
+    // Otherwise, fetch and convert in chunks that fit in the conversion buffers. Integer samples
+    // are converted to Float32 first, and then to the streams' format if that's an integer format
+    // as well.
+
+    for(UInt32 theOffset = 0; theOffset < inIOBufferFrameSize; theOffset += kLoopbackConversionChunkFrameSize)
+    {
+        UInt32 theFrames = std::min(kLoopbackConversionChunkFrameSize, inIOBufferFrameSize - theOffset);
+        UInt32 theSamples = theFrames * mChannelCount;
+        void* theOutChunk = static_cast<Byte*>(outBuffer) + theOffset * theBytesPerFrame;
+        Float32* theFloatChunk = mReadConversionBuffer.data();
+
+        if(theRingFormat == kRDCSampleFormat_Float32)
+        {
+            theSucceeded &= FetchLoopbackData(theRingBuffer,
+                                              theRingFormat,
+                                              theFloatChunk,
+                                              theFrames,
+                                              theStartTime + theOffset);
+        }
+        else
+        {
+            theSucceeded &= FetchLoopbackData(theRingBuffer,
+                                              theRingFormat,
+                                              mReadStorageBuffer.data(),
+                                              theFrames,
+                                              theStartTime + theOffset);
+
+            if(mSampleFormat == kRDCSampleFormat_Float32)
+            {
+                RDC_SampleConversion::ConvertToFloat32(theRingFormat,
+                                                       mReadStorageBuffer.data(),
+                                                       static_cast<Float32*>(theOutChunk),
+                                                       theSamples);
+                continue;
+            }
+
+            RDC_SampleConversion::ConvertToFloat32(theRingFormat,
+                                                   mReadStorageBuffer.data(),
+                                                   theFloatChunk,
+                                                   theSamples);
+        }
+
+        RDC_SampleConversion::ConvertFromFloat32(theFloatChunk,
+                                                 mSampleFormat,
+                                                 theOutChunk,
+                                                 theSamples,
+                                                 mReadScratchBuffer.data());
+    }
+
+    return theSucceeded;
+}
+
+void	RDC_Device::ReadReducedInputData(UInt32 inClientID,
+                                     UInt32 inIOBufferFrameSize,
+                                     Float64 inSampleTime,
+                                     UInt64 inHostTime,
+                                     void* outBuffer)
+{
+    mCyclesSinceInputRead.store(0, std::memory_order_relaxed);
+
+    UInt32 theOutChannels = mNumberOfReducedInputChannels;
+    UInt32 theBytesPerSample = RDC_SampleConversion::BytesPerSample(mSampleFormat);
+
+    // The buffers are only empty if the stream was removed, or the loopback buffer freed, since the
+    // HAL started this cycle.
+    if(theOutChannels == 0 || mReducedReadConversionBuffer.empty())
+    {
+        memset(outBuffer, 0, inIOBufferFrameSize * theOutChannels * theBytesPerSample);
+        return;
+    }
+
+    RDC_LoopbackRouter& theRouter = RDC_LoopbackRouter::GetInstance();
+    UInt32 theRoutedSources = theRouter.GetSourcesRT(mInstanceIndex);
+    bool theIsRouted = (theRoutedSources != 0 && mSampleFormat == kRDCSampleFormat_Float32);
+
+    // Usually the frames can be downmixed in one pass straight out of the ring buffer, so only the
+    // reduced channels are ever copied.
+    if(!theIsRouted && mSampleFormat == kRDCSampleFormat_Float32)
+    {
+        RDC_SampleFormat theRingFormat;
+        bool theRingIsPlanar;
+        CARingBuffer& theRingBuffer = GetInputRingBufferRT(theRingFormat, theRingIsPlanar);
+        CARingBuffer::SampleTime theStartTime =
+            static_cast<CARingBuffer::SampleTime>(inSampleTime) - GetReadDelayRT(inClientID);
+        bool theSucceeded = true;
+
+        if(theRingFormat == kRDCSampleFormat_Float32 &&
+           !theRingIsPlanar &&
+           ReduceLoopbackDataInPlace(theRingBuffer,
+                                     static_cast<Float32*>(outBuffer),
+                                     inIOBufferFrameSize,
+                                     theStartTime,
+                                     theSucceeded))
+        {
+            if(!theSucceeded)
+            {
+                mLoopbackStats.silentFetches.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return;
+        }
+    }
+
+    // Otherwise, read the full frames in chunks, the same way the main input stream would, and
+    // reduce each chunk.
+    UInt32 theOutBytesPerFrame = theOutChannels * theBytesPerSample;
+
+    for(UInt32 theOffset = 0; theOffset < inIOBufferFrameSize; theOffset += kLoopbackConversionChunkFrameSize)
+    {
+        UInt32 theFrames = std::min(kLoopbackConversionChunkFrameSize, inIOBufferFrameSize - theOffset);
+        void* theOutChunk = static_cast<Byte*>(outBuffer) + theOffset * theOutBytesPerFrame;
+        bool theSucceeded;
+
+        if(theIsRouted)
+        {
+            // The router finds the sources' frames by host time, so move it on with the chunk.
+            Float64 theOffsetTicks = theOffset * CAHostTimeBase::GetFrequency() / mLoopbackSampleRate;
+            theSucceeded = theRouter.MixSourcesRT(mInstanceIndex,
+                                                  theRoutedSources,
+                                                  mLoopbackSampleRate,
+                                                  mChannelCount,
+                                                  inHostTime + static_cast<UInt64>(theOffsetTicks),
+                                                  reinterpret_cast<Float32*>(mReducedReadFetchBuffer.data()),
+                                                  theFrames,
+                                                  mReadConversionBuffer.data(),
+                                                  kLoopbackConversionChunkFrameSize);
+        }
+        else
+        {
+            theSucceeded = FetchInputData(inClientID,
+                                          theFrames,
+                                          inSampleTime + theOffset,
+                                          mReducedReadFetchBuffer.data(),
+                                          false);
+        }
+
+        if(!theSucceeded)
+        {
+            mLoopbackStats.silentFetches.fetch_add(1, std::memory_order_relaxed);
+            memset(theOutChunk, 0, theFrames * theOutBytesPerFrame);
+            continue;
+        }
+
+        if(mSampleFormat == kRDCSampleFormat_Float32)
+        {
+            RDC_SampleConversion::ReduceChannels(reinterpret_cast<const Float32*>(mReducedReadFetchBuffer.data()),
+                                                 mChannelCount,
+                                                 mReducedInputChannels,
+                                                 theOutChannels,
+                                                 static_cast<Float32*>(theOutChunk),
+                                                 theFrames);
+        }
+        else
+        {
+            RDC_SampleConversion::ConvertToFloat32(mSampleFormat,
+                                                   mReducedReadFetchBuffer.data(),
+                                                   mReducedReadConversionBuffer.data(),
+                                                   theFrames * mChannelCount);
+            RDC_SampleConversion::ReduceChannels(mReducedReadConversionBuffer.data(),
+                                                 mChannelCount,
+                                                 mReducedInputChannels,
+                                                 theOutChannels,
+                                                 mReducedReadOutputBuffer.data(),
+                                                 theFrames);
+            RDC_SampleConversion::ConvertFromFloat32(mReducedReadOutputBuffer.data(),
+                                                     mSampleFormat,
+                                                     theOutChunk,
+                                                     theFrames * theOutChannels,
+                                                     mReducedReadConversionBuffer.data());
+        }
+    }
+}
+
+void	RDC_Device::ConcealFailedRead(UInt32 inConcealment,
+                                      void* outBuffer,
+                                      UInt32 inFrameSize,
+                                      CARingBuffer::SampleTime inStartTime)
+{
+    memset(outBuffer, 0, inFrameSize * mChannelCount * RDC_SampleConversion::BytesPerSample(mSampleFormat));
+
+    RDC_ReadConcealment& theConcealment = mReadConcealments[inConcealment];
+    const Float32* theLastFrame = mReadConcealmentLastFrames.data() + inConcealment * mChannelCount;
+
+    // Rather than cutting straight to silence, fade out from the last frame the client read. Only
+    // if this block follows on from it, since otherwise it's from another position.
+    bool theCanConceal = theConcealment.hasLastFrame &&
+                         theConcealment.lastEndTime == inStartTime &&
+                         mReadConcealmentLastFrames.size() >= (inConcealment + 1) * mChannelCount &&
+                         mReadConversionBuffer.size() >= kReadConcealmentFadeFrames * mChannelCount;
+
+    if(theCanConceal)
+    {
+        UInt32 theFadeFrames = std::min(kReadConcealmentFadeFrames, inFrameSize);
+        Float32* theFade = mReadConversionBuffer.data();
+
+        for(UInt32 theFrame = 0; theFrame < theFadeFrames; theFrame++)
+        {
+            Float32 theGain = static_cast<Float32>(theFadeFrames - theFrame) /
+                              static_cast<Float32>(theFadeFrames + 1);
+
+            for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+            {
+                theFade[theFrame * mChannelCount + theChannel] = theLastFrame[theChannel] * theGain;
+            }
+        }
+
+        RDC_SampleConversion::ConvertFromFloat32(theFade,
+                                                 mSampleFormat,
+                                                 outBuffer,
+                                                 theFadeFrames * mChannelCount,
+                                                 mReadScratchBuffer.data());
+
+        mLoopbackStats.concealedFetches.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    theConcealment.hasLastFrame = false;
+    theConcealment.needsFadeIn = true;
+}
+
+void	RDC_Device::FadeInAfterConcealment(void* ioBuffer, UInt32 inFrameSize)
+{
+    if(mReadConversionBuffer.size() < kReadConcealmentFadeFrames * mChannelCount)
+    {
+        return;
+    }
+
+    UInt32 theFadeFrames = std::min(kReadConcealmentFadeFrames, inFrameSize);
+    UInt32 theSamples = theFadeFrames * mChannelCount;
+    bool theIsFloat = (mSampleFormat == kRDCSampleFormat_Float32);
+    Float32* theFloats = theIsFloat ? static_cast<Float32*>(ioBuffer) : mReadConversionBuffer.data();
+
+    if(!theIsFloat)
+    {
+        RDC_SampleConversion::ConvertToFloat32(mSampleFormat, ioBuffer, theFloats, theSamples);
+    }
+
+    for(UInt32 theFrame = 0; theFrame < theFadeFrames; theFrame++)
+    {
+        Float32 theGain = static_cast<Float32>(theFrame + 1) / static_cast<Float32>(theFadeFrames + 1);
+
+        for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+        {
+            theFloats[theFrame * mChannelCount + theChannel] *= theGain;
+        }
+    }
+
+    if(!theIsFloat)
+    {
+        RDC_SampleConversion::ConvertFromFloat32(theFloats,
+                                                 mSampleFormat,
+                                                 ioBuffer,
+                                                 theSamples,
+                                                 mReadScratchBuffer.data());
+    }
+}
+
+void	RDC_Device::RememberLastReadFrame(UInt32 inConcealment,
+                                          const void* inBuffer,
+                                          UInt32 inFrameSize,
+                                          CARingBuffer::SampleTime inStartTime)
+{
+    if(inFrameSize == 0 || mReadConcealmentLastFrames.size() < (inConcealment + 1) * mChannelCount)
+    {
+        return;
+    }
+
+    RDC_ReadConcealment& theConcealment = mReadConcealments[inConcealment];
+
+    UInt32 theBytesPerFrame = mChannelCount * RDC_SampleConversion::BytesPerSample(mSampleFormat);
+    const Byte* theLastFrame = static_cast<const Byte*>(inBuffer) + (inFrameSize - 1) * theBytesPerFrame;
+
+    RDC_SampleConversion::ConvertToFloat32(mSampleFormat,
+                                           theLastFrame,
+                                           mReadConcealmentLastFrames.data() + inConcealment * mChannelCount,
+                                           mChannelCount);
+
+    theConcealment.lastEndTime = inStartTime + inFrameSize;
+    theConcealment.hasLastFrame = true;
+}
+
+bool	RDC_Device::FetchLoopbackData(CARingBuffer& inRingBuffer,
+                                      RDC_SampleFormat inRingFormat,
+                                      void* outBuffer,
+                                      UInt32 inFrameSize,
+                                      CARingBuffer::SampleTime inStartTime)
+{
+    // Each frame is mChannelCount samples (one per channel). The number of frames * the number of
+    // bytes per frame = the size of outBuffer in bytes.
+    UInt32 theByteSize = inFrameSize * mChannelCount * RDC_SampleConversion::BytesPerSample(inRingFormat);
+    CARingBufferError err = kCARingBufferError_OK;
+
+    // kCARingBufferError_CPUOverload usually only means the writer changed the buffer's time bounds
+    // while we were reading them, so trying again normally works. If the writer overwrote the
+    // frames, the next attempt gets the ones it didn't and reads the rest as silence.
+    for(UInt32 theAttempt = 0; theAttempt < kLoopbackFetchAttempts; theAttempt++)
+    {
+        if(mLoopbackStoragePlanar && &inRingBuffer == &mLoopbackRingBuffer)
+        {
+            err = FetchPlanarLoopbackData(outBuffer, inFrameSize, inStartTime);
+        }
+        else
+        {
+            // Copy the audio data from the ring buffer into the buffer.
+            err = inRingBuffer.FetchInterleaved(outBuffer, inFrameSize, inStartTime);
+        }
+
+        if(err != kCARingBufferError_CPUOverload)
+        {
+            if(err == kCARingBufferError_OK && theAttempt > 0)
+            {
+                mLoopbackStats.recoveredFetches.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            break;
+        }
+    }
+
+    // Handle errors.
+    switch (err)
+    {
+        case kCARingBufferError_CPUOverload:
+            // Write silence to the buffer. ReadInputData conceals it.
+            memset(outBuffer, 0, theByteSize);
+            return false;
+        case kCARingBufferError_TooMuch:
+            // Should be impossible, but handle it just in case. Write silence to the buffer and
+            // return an error code.
+            memset(outBuffer, 0, theByteSize);
+            mLoopbackStats.silentFetches.fetch_add(1, std::memory_order_relaxed);
+            Throw(CAException(kAudioHardwareIllegalOperationError));
+        case kCARingBufferError_OK:
+            return true;
+        default:
+            throw CAException(kAudioHardwareUnspecifiedError);
+    }
+}
+
+bool	RDC_Device::ConvertLoopbackDataInPlace(CARingBuffer& inRingBuffer,
+                                               RDC_SampleFormat inRingFormat,
+                                               void* outBuffer,
+                                               UInt32 inFrameSize,
+                                               CARingBuffer::SampleTime inStartTime,
+                                               bool& outSucceeded)
+{
+    UInt32 theBytesPerFrame = mChannelCount * RDC_SampleConversion::BytesPerSample(mSampleFormat);
+    UInt32 theRingBytesPerFrame = mChannelCount * RDC_SampleConversion::BytesPerSample(inRingFormat);
+    CARingBufferError err = kCARingBufferError_CPUOverload;
+
+    // Retry if the writer got in the way, like FetchLoopbackData.
+    for(UInt32 theAttempt = 0;
+        theAttempt < kLoopbackFetchAttempts && err == kCARingBufferError_CPUOverload;
+        theAttempt++)
+    {
+        CARingBuffer::Regions theRegions;
+        err = inRingBuffer.BeginRead(inFrameSize, inStartTime, theRegions);
+
+        if(err == kCARingBufferError_Discontiguous)
+        {
+            return false;
+        }
+
+        if(err == kCARingBufferError_OK)
+        {
+            Byte* theOut = static_cast<Byte*>(outBuffer);
+
+            memset(theOut, 0, theRegions.leadingFrames * theBytesPerFrame);
+            theOut += theRegions.leadingFrames * theBytesPerFrame;
+
+            for(int theRegion = 0; theRegion < 2; theRegion++)
+            {
+                const Byte* theIn = inRingBuffer.RegionData(theRegions, theRegion, 0);
+
+                // In chunks that fit in the conversion buffers, like the fetched frames.
+                for(UInt32 theOffset = 0;
+                    theOffset < theRegions.nFrames[theRegion];
+                    theOffset += kLoopbackConversionChunkFrameSize)
+                {
+                    UInt32 theFrames = std::min(kLoopbackConversionChunkFrameSize,
+                                                theRegions.nFrames[theRegion] - theOffset);
+                    UInt32 theSamples = theFrames * mChannelCount;
+
+                    if(inRingFormat == kRDCSampleFormat_Float32)
+                    {
+                        RDC_SampleConversion::ConvertFromFloat32(reinterpret_cast<const Float32*>(theIn),
+                                                                 mSampleFormat,
+                                                                 theOut,
+                                                                 theSamples,
+                                                                 mReadScratchBuffer.data());
+                    }
+                    else if(mSampleFormat == kRDCSampleFormat_Float32)
+                    {
+                        RDC_SampleConversion::ConvertToFloat32(inRingFormat,
+                                                               theIn,
+                                                               reinterpret_cast<Float32*>(theOut),
+                                                               theSamples);
+                    }
+                    else
+                    {
+                        RDC_SampleConversion::ConvertToFloat32(inRingFormat,
+                                                               theIn,
+                                                               mReadConversionBuffer.data(),
+                                                               theSamples);
+                        RDC_SampleConversion::ConvertFromFloat32(mReadConversionBuffer.data(),
+                                                                 mSampleFormat,
+                                                                 theOut,
+                                                                 theSamples,
+                                                                 mReadScratchBuffer.data());
+                    }
+
+                    theIn += theFrames * theRingBytesPerFrame;
+                    theOut += theFrames * theBytesPerFrame;
+                }
+            }
+
+            memset(theOut, 0, theRegions.trailingFrames * theBytesPerFrame);
+
+            // Check the writer didn't overwrite the frames while we were converting them.
+            err = inRingBuffer.EndRead(theRegions);
+
+            if(err == kCARingBufferError_OK && theAttempt > 0)
+            {
+                mLoopbackStats.recoveredFetches.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    outSucceeded = (err == kCARingBufferError_OK);
+
+    if(!outSucceeded)
+    {
+        memset(outBuffer, 0, inFrameSize * theBytesPerFrame);
+    }
+
+    return true;
+}
+
+bool	RDC_Device::ReduceLoopbackDataInPlace(CARingBuffer& inRingBuffer,
+                                              Float32* outBuffer,
+                                              UInt32 inFrameSize,
+                                              CARingBuffer::SampleTime inStartTime,
+                                              bool& outSucceeded)
+{
+    UInt32 theOutChannels = mNumberOfReducedInputChannels;
+    CARingBufferError err = kCARingBufferError_CPUOverload;
+
+    // Retry if the writer got in the way, like FetchLoopbackData.
+    for(UInt32 theAttempt = 0;
+        theAttempt < kLoopbackFetchAttempts && err == kCARingBufferError_CPUOverload;
+        theAttempt++)
+    {
+        CARingBuffer::Regions theRegions;
+        err = inRingBuffer.BeginRead(inFrameSize, inStartTime, theRegions);
+
+        if(err == kCARingBufferError_Discontiguous)
+        {
+            return false;
+        }
+
+        if(err == kCARingBufferError_OK)
+        {
+            Float32* theOut = outBuffer;
+
+            memset(theOut, 0, theRegions.leadingFrames * theOutChannels * sizeof(Float32));
+            theOut += theRegions.leadingFrames * theOutChannels;
+
+            for(int theRegion = 0; theRegion < 2; theRegion++)
+            {
+                RDC_SampleConversion::ReduceChannels(
+                        reinterpret_cast<const Float32*>(inRingBuffer.RegionData(theRegions, theRegion, 0)),
+                        mChannelCount,
+                        mReducedInputChannels,
+                        theOutChannels,
+                        theOut,
+                        theRegions.nFrames[theRegion]);
+                theOut += theRegions.nFrames[theRegion] * theOutChannels;
+            }
+
+            memset(theOut, 0, theRegions.trailingFrames * theOutChannels * sizeof(Float32));
+
+            // Check the writer didn't overwrite the frames while we were reading them.
+            err = inRingBuffer.EndRead(theRegions);
+
+            if(err == kCARingBufferError_OK && theAttempt > 0)
+            {
+                mLoopbackStats.recoveredFetches.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    outSucceeded = (err == kCARingBufferError_OK);
+
+    if(!outSucceeded)
+    {
+        memset(outBuffer, 0, inFrameSize * theOutChannels * sizeof(Float32));
+    }
+
+    return true;
+}
+
+CARingBufferError	RDC_Device::FetchPlanarLoopbackData(void* outBuffer,
+                                                        UInt32 inFrameSize,
+                                                        CARingBuffer::SampleTime inStartTime)
+{
+    UInt32 theBytesPerSample = RDC_SampleConversion::BytesPerSample(mLoopbackStorageFormat);
+    AudioBufferList* theBufferList = reinterpret_cast<AudioBufferList*>(mReadPlanarBufferList.data());
+
+    // Fetch each chunk into the per-channel buffers and interleave it into outBuffer.
+    for(UInt32 theOffset = 0; theOffset < inFrameSize; theOffset += kLoopbackConversionChunkFrameSize)
+    {
+        UInt32 theFrames = std::min(kLoopbackConversionChunkFrameSize, inFrameSize - theOffset);
+
+        // Fetch changes the sizes, so they have to be set every time.
+        for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+        {
+            theBufferList->mBuffers[theChannel].mDataByteSize = theFrames * theBytesPerSample;
+        }
+
+        CARingBufferError err = mLoopbackRingBuffer.Fetch(theBufferList, theFrames, inStartTime + theOffset);
+        if(err != kCARingBufferError_OK)
+        {
+            return err;
+        }
+
+        Byte* theOutChunk = static_cast<Byte*>(outBuffer) + theOffset * mChannelCount * theBytesPerSample;
+
+        for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+        {
+            RDC_SampleConversion::InterleaveChannel(mLoopbackStorageFormat,
+                                                    theBufferList->mBuffers[theChannel].mData,
+                                                    theChannel,
+                                                    mChannelCount,
+                                                    theOutChunk,
+                                                    theFrames);
+        }
+    }
+
+    return kCARingBufferError_OK;
+}
+
+void	RDC_Device::WriteOutputData(UInt32 inIOBufferFrameSize, Float64 inSampleTime, const void* inBuffer)
+{
+    CARingBuffer::SampleTime theSampleTime = static_cast<CARingBuffer::SampleTime>(inSampleTime);
+
+    // Most of the time nothing is playing, so check for silence before doing anything else. If the
+    // mix is silent or muted, the loopback buffer just records that instead of storing the frames.
+    // The check stops at the first sample that isn't zero, so it's cheap when audio is playing.
+    if((mMuteControl.IsActive() && mMuteControl.IsMutedRT()) ||
+       RDC_SampleConversion::IsSilent(mSampleFormat, inBuffer, inIOBufferFrameSize * mChannelCount))
+    {
+        StoreLoopbackSilence(inIOBufferFrameSize, theSampleTime);
+        return;
+    }
+
+    bool theAppliesVolume = mVolumeControl.WillApplyVolumeToAudioRT();
+    // Usually nothing reads the loopback buffer, e.g. while the device is only used as an output,
+    // in which case only the other copies are made.
+    bool theStoresLoopback = LoopbackBufferHasReadersRT();
+
+    if(!theStoresLoopback)
+    {
+        SkipLoopbackStore(inIOBufferFrameSize, theSampleTime);
+    }
+
+    // Get the master volume's gain ramp for the whole buffer. When the buffer is stored in chunks,
+    // each chunk continues the ramp from where the last one stopped.
+    Float32 theStartGain = 1.0f;
+    Float32 theGainStep = 0.0f;
+
+    if(theAppliesVolume)
+    {
+        mVolumeControl.GetGainRampRT(inIOBufferFrameSize, inSampleTime, theStartGain, theGainStep);
+    }
+
+    if(mSampleFormat == kRDCSampleFormat_Float32 &&
+       mLoopbackStorageFormat == kRDCSampleFormat_Float32 &&
+       !mSharedLoopbackBuffer.IsEnabled() &&
+       !mRecorder.IsRecordingRT() &&
+       !mRetroBuffer.IsEnabledRT())
+    {
+        // Nothing to convert and only one copy to make, so apply the master volume as the mix is
+        // copied into the ring buffer. That way each sample is only read and written once.
+        if(theStoresLoopback)
+        {
+            StoreLoopbackDataWithGain(static_cast<const Float32*>(inBuffer),
+                                      inIOBufferFrameSize,
+                                      theSampleTime,
+                                      theStartGain,
+                                      theGainStep);
+        }
+
+        // Measure it while it's still in the cache. The levels are scaled by the gain at the end of
+        // the buffer, which is only approximate while the volume is ramping.
+        mLoopbackLevelMeter.MeasureRT(static_cast<const Float32*>(inBuffer),
                                       inIOBufferFrameSize,
-                                      static_cast<CARingBuffer::SampleTime>(inSampleTime));
+                                      theStartGain + theGainStep * inIOBufferFrameSize);
+        return;
+    }
+
+    // Otherwise, convert and store in chunks that fit in the conversion buffers. Everything goes
+    // through Float32, which is also the format of the shared memory copy. The master volume is
+    // applied as the chunk is converted or copied into the conversion buffer.
+    UInt32 theBytesPerFrame = mChannelCount * RDC_SampleConversion::BytesPerSample(mSampleFormat);
+
+    for(UInt32 theOffset = 0; theOffset < inIOBufferFrameSize; theOffset += kLoopbackConversionChunkFrameSize)
+    {
+        UInt32 theFrames = std::min(kLoopbackConversionChunkFrameSize, inIOBufferFrameSize - theOffset);
+        UInt32 theSamples = theFrames * mChannelCount;
+        const void* theInChunk = static_cast<const Byte*>(inBuffer) + theOffset * theBytesPerFrame;
+        const Float32* theFloatChunk = static_cast<const Float32*>(theInChunk);
+        Float32 theChunkStartGain = theStartGain + theGainStep * theOffset;
+
+        if(mSampleFormat != kRDCSampleFormat_Float32)
+        {
+            RDC_SampleConversion::ConvertToFloat32(mSampleFormat,
+                                                   theInChunk,
+                                                   mWriteConversionBuffer.data(),
+                                                   theSamples);
+
+            if(theAppliesVolume)
+            {
+                RDC_VolumeControl::ApplyGainRT(mWriteConversionBuffer.data(),
+                                               mWriteConversionBuffer.data(),
+                                               theFrames,
+                                               mChannelCount,
+                                               theChunkStartGain,
+                                               theGainStep);
+            }
+
+            theFloatChunk = mWriteConversionBuffer.data();
+        }
+        else if(theAppliesVolume)
+        {
+            // The mix buffer belongs to the HAL, so copy the chunk and apply the volume at the same
+            // time.
+            RDC_VolumeControl::ApplyGainRT(theFloatChunk,
+                                           mWriteConversionBuffer.data(),
+                                           theFrames,
+                                           mChannelCount,
+                                           theChunkStartGain,
+                                           theGainStep);
+
+            theFloatChunk = mWriteConversionBuffer.data();
+        }
+
+        mSharedLoopbackBuffer.StoreRT(theFloatChunk, theFrames, theSampleTime + theOffset);
+        mLoopbackLevelMeter.MeasureRT(theFloatChunk, theFrames);
+
+        if(mRecorder.StoreRT(theFloatChunk, theFrames))
+        {
+            mTaskQueue.QueueAsync_DrainRecorder(&mRecorder);
+        }
+
+        if(mRetroBuffer.StoreRT(theFloatChunk, theFrames))
+        {
+            mTaskQueue.QueueAsync_DrainRetroBuffer(&mRetroBuffer);
+        }
+
+        if(theStoresLoopback)
+        {
+            if(mLoopbackStorageFormat == kRDCSampleFormat_Float32)
+            {
+                StoreLoopbackData(theFloatChunk, theFrames, theSampleTime + theOffset);
+            }
+            else
+            {
+                StoreConvertedLoopbackData(theFloatChunk, theFrames, theSampleTime + theOffset);
+            }
+        }
+    }
+}
+
+// The context for RDC_StoreDeinterleaved.
+struct RDC_StoreDeinterleavedContext
+{
+    const Byte*         mFrames;
+    RDC_SampleFormat    mFormat;
+    UInt32              mChannelCount;
+};
+
+// The CARingBuffer::StoreFunction for storing interleaved frames in a planar loopback buffer. Copies
+// one channel of one of the (up to) two ranges a store fills.
+static void RDC_StoreDeinterleaved(void* inContext,
+                                   int inChannel,
+                                   Byte* outDest,
+                                   UInt32 inSrcFrameOffset,
+                                   UInt32 inFrames)
+{
+    const RDC_StoreDeinterleavedContext* theContext = static_cast<const RDC_StoreDeinterleavedContext*>(inContext);
+    UInt32 theBytesPerFrame = theContext->mChannelCount * RDC_SampleConversion::BytesPerSample(theContext->mFormat);
+
+    RDC_SampleConversion::DeinterleaveChannel(theContext->mFormat,
+                                              theContext->mFrames + inSrcFrameOffset * theBytesPerFrame,
+                                              static_cast<UInt32>(inChannel),
+                                              theContext->mChannelCount,
+                                              outDest,
+                                              inFrames);
+}
+
+void	RDC_Device::StoreLoopbackData(const void* inBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime)
+{
+    if(mLoopbackStoragePlanar)
+    {
+        // Deinterleave the frames as they're copied into the channels' buffers.
+        RDC_StoreDeinterleavedContext theContext = {
+            static_cast<const Byte*>(inBuffer),
+            mLoopbackStorageFormat,
+            mChannelCount
+        };
+
+        UInt32 theGapFrames = 0;
+        CARingBufferError err =
+                mLoopbackRingBuffer.Store(RDC_StoreDeinterleaved,
+                                          &theContext,
+                                          inFrameSize,
+                                          inSampleTime,
+                                          &theGapFrames);
+
+        HandleLoopbackStoreResult(err, theGapFrames);
+        return;
+    }
+
+    // Copy the audio data from the buffer into our ring buffer. Each frame is mChannelCount samples
+    // in the storage format, which is the ring buffer's frame size.
+    UInt32 theGapFrames = 0;
+    CARingBufferError err =
+            mLoopbackRingBuffer.StoreInterleaved(inBuffer,
+                                                 inFrameSize,
+                                                 inSampleTime,
+                                                 &theGapFrames);
+
+    HandleLoopbackStoreResult(err, theGapFrames);
+}
+
+void	RDC_Device::StoreConvertedLoopbackData(const Float32* inBuffer,
+                                               UInt32 inFrameSize,
+                                               CARingBuffer::SampleTime inSampleTime)
+{
+    UInt32 theSamples = inFrameSize * mChannelCount;
+
+    if(mLoopbackStoragePlanar)
+    {
+        // Convert into the storage buffer and let StoreLoopbackData deinterleave it.
+        RDC_SampleConversion::ConvertFromFloat32(inBuffer,
+                                                 mLoopbackStorageFormat,
+                                                 mWriteStorageBuffer.data(),
+                                                 theSamples,
+                                                 mWriteScratchBuffer.data());
+        StoreLoopbackData(mWriteStorageBuffer.data(), inFrameSize, inSampleTime);
+        return;
+    }
+
+    CARingBuffer::Regions theRegions;
+    UInt32 theGapFrames = 0;
+    CARingBufferError err = mLoopbackRingBuffer.BeginWrite(inFrameSize, inSampleTime, theRegions, &theGapFrames);
+
+    if(err == kCARingBufferError_OK)
+    {
+        // The frames fit in the scratch buffer, so each region can be converted in one call.
+        const Float32* theIn = inBuffer;
+
+        for(int theRegion = 0; theRegion < 2; theRegion++)
+        {
+            UInt32 theRegionSamples = theRegions.nFrames[theRegion] * mChannelCount;
+
+            RDC_SampleConversion::ConvertFromFloat32(theIn,
+                                                     mLoopbackStorageFormat,
+                                                     mLoopbackRingBuffer.RegionData(theRegions, theRegion, 0),
+                                                     theRegionSamples,
+                                                     mWriteScratchBuffer.data());
+            theIn += theRegionSamples;
+        }
+
+        mLoopbackRingBuffer.EndWrite(theRegions);
+    }
+
+    HandleLoopbackStoreResult(err, theGapFrames);
+}
+
+// The context for RDC_StoreWithGain.
+struct RDC_StoreWithGainContext
+{
+    const Float32*  mFrames;
+    UInt32          mChannelCount;
+    Float32         mStartGain;
+    Float32         mGainStep;
+};
+
+// The CARingBuffer::StoreFunction for StoreLoopbackDataWithGain. Copies one of the (up to) two
+// ranges of the loopback buffer that a store fills, with the part of the gain ramp for that range.
+static void RDC_StoreWithGain(void* inContext,
+                              int inChannel,
+                              Byte* outDest,
+                              UInt32 inSrcFrameOffset,
+                              UInt32 inFrames)
+{
+    #pragma unused(inChannel)
+
+    const RDC_StoreWithGainContext* theContext = static_cast<const RDC_StoreWithGainContext*>(inContext);
+
+    RDC_VolumeControl::ApplyGainRT(theContext->mFrames + inSrcFrameOffset * theContext->mChannelCount,
+                                   reinterpret_cast<Float32*>(outDest),
+                                   inFrames,
+                                   theContext->mChannelCount,
+                                   theContext->mStartGain + theContext->mGainStep * inSrcFrameOffset,
+                                   theContext->mGainStep);
+}
+
+// The CARingBuffer::StoreFunction for StoreLoopbackDataWithGain when the loopback buffer is planar.
+// Each channel is read with a stride of the number of channels and written contiguously, so the
+// frames are deinterleaved in the same pass that applies the gain.
+static void RDC_StoreDeinterleavedWithGain(void* inContext,
+                                           int inChannel,
+                                           Byte* outDest,
+                                           UInt32 inSrcFrameOffset,
+                                           UInt32 inFrames)
+{
+    const RDC_StoreWithGainContext* theContext = static_cast<const RDC_StoreWithGainContext*>(inContext);
+    const Float32* theFirstSample =
+            theContext->mFrames + inSrcFrameOffset * theContext->mChannelCount + static_cast<UInt32>(inChannel);
+    // vDSP_vrampmul updates the gain as it goes.
+    Float32 theGain = theContext->mStartGain + theContext->mGainStep * inSrcFrameOffset;
+
+    vDSP_vrampmul(theFirstSample,
+                  static_cast<vDSP_Stride>(theContext->mChannelCount),
+                  &theGain,
+                  &theContext->mGainStep,
+                  reinterpret_cast<Float32*>(outDest),
+                  1,
+                  inFrames);
+}
+
+void	RDC_Device::StoreLoopbackDataWithGain(const Float32* inBuffer,
+                                              UInt32 inFrameSize,
+                                              CARingBuffer::SampleTime inSampleTime,
+                                              Float32 inStartGain,
+                                              Float32 inGainStep)
+{
+    Assert(mLoopbackStorageFormat == kRDCSampleFormat_Float32,
+           "RDC_Device::StoreLoopbackDataWithGain: The loopback buffer must store Float32");
+
+    RDC_StoreWithGainContext theContext = { inBuffer, mChannelCount, inStartGain, inGainStep };
+
+    UInt32 theGapFrames = 0;
+    CARingBufferError err =
+            mLoopbackRingBuffer.Store(mLoopbackStoragePlanar ? RDC_StoreDeinterleavedWithGain : RDC_StoreWithGain,
+                                      &theContext,
+                                      inFrameSize,
+                                      inSampleTime,
+                                      &theGapFrames);
+
+    HandleLoopbackStoreResult(err, theGapFrames);
+}
+
+void	RDC_Device::StoreLoopbackSilence(UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime)
+{
+    UInt32 theGapFrames = 0;
+    CARingBufferError err = mLoopbackRingBuffer.StoreSilence(inFrameSize, inSampleTime, &theGapFrames);
+
+    // The shared memory copy is read in place by other processes, so it still gets zeros.
+    mSharedLoopbackBuffer.StoreRT(nullptr, inFrameSize, inSampleTime);
+    mLoopbackLevelMeter.MeasureSilenceRT();
+
+    // Recordings keep the silence, so they stay in time with the device.
+    if(mRecorder.StoreRT(nullptr, inFrameSize))
+    {
+        mTaskQueue.QueueAsync_DrainRecorder(&mRecorder);
+    }
+
+    if(mRetroBuffer.StoreRT(nullptr, inFrameSize))
+    {
+        mTaskQueue.QueueAsync_DrainRetroBuffer(&mRetroBuffer);
+    }
+
+    mLoopbackStats.silentFramesSkipped.fetch_add(inFrameSize, std::memory_order_relaxed);
+
+    HandleLoopbackStoreResult(err, theGapFrames);
+}
+
+bool	RDC_Device::LoopbackBufferHasReadersRT() const
+{
+    return mCyclesSinceInputRead.load(std::memory_order_relaxed) < kLoopbackInputIdleCycles ||
+           mRTPSender.IsSendingRT() ||
+           RDC_LoopbackRouter::GetInstance().IsSourceRoutedRT(mInstanceIndex);
+}
+
+void	RDC_Device::SkipLoopbackStore(UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime)
+{
+    // Storing silence only moves the time bounds, so it costs the same however many frames there
+    // are. The buffer stays continuous, so readers don't see a gap when storing resumes.
+    UInt32 theGapFrames = 0;
+    CARingBufferError err = mLoopbackRingBuffer.StoreSilence(inFrameSize, inSampleTime, &theGapFrames);
+
+    mLoopbackStats.unreadFramesSkipped.fetch_add(inFrameSize, std::memory_order_relaxed);
+
+    HandleLoopbackStoreResult(err, theGapFrames);
+}
+
+void	RDC_Device::HandleLoopbackStoreResult(CARingBufferError inError, UInt32 inGapFrames)
+{
+    if(inGapFrames > 0)
+    {
+        mLoopbackStats.gaps.fetch_add(1, std::memory_order_relaxed);
+        mLoopbackStats.gapFramesZeroFilled.fetch_add(inGapFrames, std::memory_order_relaxed);
+    }
+
+    if(inError != kCARingBufferError_OK)
+    {
+        mLoopbackStats.storeErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Return an error code if we failed to store the data. (But ignore CPU overload, which would be
+    // temporary.)
+    if (inError != kCARingBufferError_OK && inError != kCARingBufferError_CPUOverload)
+    {
+        Throw(CAException(inError));
+    }
+}
+
+void	RDC_Device::TapClientOutputData(UInt32 inClientID, UInt32 inIOBufferFrameSize, Float64 inSampleTime, const void* inBuffer)
+{
+    AudioBufferList abl = {
+        .mNumberBuffers = 1,
+        .mBuffers[0] = {
+            .mNumberChannels = mChannelCount,
+            .mDataByteSize = static_cast<UInt32>(inIOBufferFrameSize * sizeof(Float32) * mChannelCount),
+            .mData = const_cast<void *>(inBuffer)
+        }
+    };
+
+    mClientTaps.StoreRT(inClientID,
+                        &abl,
+                        inIOBufferFrameSize,
+                        static_cast<CARingBuffer::SampleTime>(inSampleTime));
+}
+
+#pragma mark Accessors
+
+void    RDC_Device::RequestEnabledControls(bool inVolumeEnabled, bool inMuteEnabled)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    bool changeVolume = (mVolumeControl.IsActive() != inVolumeEnabled);
+    bool changeMute = (mMuteControl.IsActive() != inMuteEnabled);
+
+    if(changeVolume)
+    {
+        DebugMsg("RDC_Device::RequestEnabledControls: %s volume control",
+                 (inVolumeEnabled ? "Enabling" : "Disabling"));
+        mPendingOutputVolumeControlEnabled = inVolumeEnabled;
+    }
+
+    if(changeMute)
+    {
+        DebugMsg("RDC_Device::RequestEnabledControls: %s mute control",
+                 (inMuteEnabled ? "Enabling" : "Disabling"));
+        mPendingOutputMuteControlEnabled = inMuteEnabled;
+    }
+
+    if(changeVolume || changeMute)
+    {
+        // Ask the host to stop IO (and whatever else) so we can safely update the device's list of
+        // controls. See RequestDeviceConfigurationChange in AudioServerPlugIn.h.
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetEnabledControls);
+        
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+Float64	RDC_Device::GetSampleRate() const
+{
+    // Read the published copy so this doesn't have to wait for the state lock, since it's called for
+    // every kAudioDevicePropertyNominalSampleRate query. The copy is updated in SetSampleRate.
+    Float64 theSampleRate;
+
+    // Report the sample rate from the wrapped device if we have one. Note that _HW_GetSampleRate
+    // the device's nominal sample rate, not one calculated from its timestamps.
+    if(mWrappedAudioEngine == nullptr)
+    {
+        theSampleRate = mPublishedSampleRate.load(std::memory_order_acquire);
+    }
+    else
+    {
+        theSampleRate = _HW_GetSampleRate();
+    }
+
+    return theSampleRate;
+}
+
+void	RDC_Device::RequestSampleRate(Float64 inRequestedSampleRate)
+{
+    // Changing the sample rate needs to be handled via the RequestConfigChange/PerformConfigChange
+    // machinery. See RequestDeviceConfigurationChange in AudioServerPlugIn.h.
+
+	// We try to support any sample rate a real output device might.
+    ThrowIf(inRequestedSampleRate < 1.0,
+            CAException(kAudioDeviceUnsupportedFormatError),
+            "RDC_Device::RequestSampleRate: unsupported sample rate");
+
+    DebugMsg("RDC_Device::RequestSampleRate: Sample rate change requested: %f",
+             inRequestedSampleRate);
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(inRequestedSampleRate != GetSampleRate())  // Check the sample rate will actually be changed.
+    {
+        mPendingSampleRate = inRequestedSampleRate;
+
+        // Dispatch this so the change can happen asynchronously.
+        auto requestSampleRate = ^{
+			UInt64 action = static_cast<UInt64>(ChangeAction::SetSampleRate);
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(GetObjectID(), action, nullptr);
+        };
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, requestSampleRate);
+    }
+}
+
+UInt32	RDC_Device::GetChannelCount() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return mChannelCount;
+}
+
+void	RDC_Device::RequestChannelCount(UInt32 inRequestedChannelCount)
+{
+    // Like the sample rate, the channel count can only be changed via the
+    // RequestConfigChange/PerformConfigChange machinery.
+    ThrowIf(inRequestedChannelCount < 1 || inRequestedChannelCount > kRDCMaxChannelCount,
+            CAException(kAudioDeviceUnsupportedFormatError),
+            "RDC_Device::RequestChannelCount: unsupported channel count");
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(inRequestedChannelCount != mChannelCount)
+    {
+        DebugMsg("RDC_Device::RequestChannelCount: Channel count change requested: %u",
+                 inRequestedChannelCount);
+
+        mPendingChannelCount = inRequestedChannelCount;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetChannelCount);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+UInt32	RDC_Device::GetAvailableSampleRates(Float64 outRates[kRDCMaxAvailableSampleRates]) const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    std::copy(mAvailableSampleRates, mAvailableSampleRates + mNumberOfAvailableSampleRates, outRates);
+    return mNumberOfAvailableSampleRates;
+}
+
+void	RDC_Device::RequestAvailableSampleRates(const Float64* inRates, UInt32 inNumberOfRates)
+{
+    ThrowIf(inNumberOfRates < 1 || inNumberOfRates > kRDCMaxAvailableSampleRates,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::RequestAvailableSampleRates: Invalid number of rates");
+    ThrowIf(std::any_of(inRates, inRates + inNumberOfRates, [](Float64 inRate) { return !(inRate >= 1.0); }),
+            CAException(kAudioDeviceUnsupportedFormatError),
+            "RDC_Device::RequestAvailableSampleRates: unsupported sample rate");
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(!std::equal(inRates,
+                   inRates + inNumberOfRates,
+                   mAvailableSampleRates,
+                   mAvailableSampleRates + mNumberOfAvailableSampleRates))
+    {
+        DebugMsg("RDC_Device::RequestAvailableSampleRates: Change to %u sample rates requested",
+                 inNumberOfRates);
+
+        std::copy(inRates, inRates + inNumberOfRates, mPendingAvailableSampleRates);
+        mPendingNumberOfAvailableSampleRates = inNumberOfRates;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetAvailableSampleRates);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+UInt32	RDC_Device::GetLoopbackBufferFrameSize() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return mLoopbackRingBufferFrameSize;
+}
+
+void	RDC_Device::RequestLoopbackBufferFrameSize(UInt32 inRequestedFrameSize)
+{
+    // CARingBuffer rounds its capacity up to a power of two, so do the same here to report the
+    // capacity we'll actually have.
+    UInt32 theFrameSize = std::min(std::max(inRequestedFrameSize, kRDCMinLoopbackBufferFrameSize),
+                                   kRDCMaxLoopbackBufferFrameSize);
+    theFrameSize = NextPowerOfTwo(theFrameSize);
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    // Also apply it if it's the current capacity but that was set by duration, to fix it.
+    if((theFrameSize != mLoopbackRingBufferFrameSize) || (mLoopbackBufferMilliseconds != 0))
+    {
+        DebugMsg("RDC_Device::RequestLoopbackBufferFrameSize: Loopback buffer size change "
+                 "requested: %u frames",
+                 theFrameSize);
+
+        mPendingLoopbackRingBufferFrameSize = theFrameSize;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetLoopbackBufferFrameSize);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+UInt32	RDC_Device::GetLoopbackBufferMilliseconds() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return mLoopbackBufferMilliseconds;
+}
+
+void	RDC_Device::RequestLoopbackBufferMilliseconds(UInt32 inRequestedMilliseconds)
+{
+    UInt32 theMilliseconds = std::min(std::max(inRequestedMilliseconds,
+                                               kRDCMinLoopbackBufferMilliseconds),
+                                      kRDCMaxLoopbackBufferMilliseconds);
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(theMilliseconds != mLoopbackBufferMilliseconds)
+    {
+        DebugMsg("RDC_Device::RequestLoopbackBufferMilliseconds: Loopback buffer duration change "
+                 "requested: %u ms",
+                 theMilliseconds);
+
+        mPendingLoopbackBufferMilliseconds = theMilliseconds;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetLoopbackBufferMilliseconds);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+UInt32	RDC_Device::GetZeroTimeStampPeriod() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return mZeroTimeStampPeriod;
+}
+
+void	RDC_Device::RequestZeroTimeStampPeriod(UInt32 inRequestedPeriod)
+{
+    UInt32 thePeriod = std::min(std::max(inRequestedPeriod, kRDCMinZeroTimeStampPeriod),
+                                kRDCMaxZeroTimeStampPeriod);
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    // Setting the current period still stops it following the loopback buffer's capacity.
+    if((thePeriod != mZeroTimeStampPeriod) || mZeroTimeStampPeriodIsDerived)
+    {
+        DebugMsg("RDC_Device::RequestZeroTimeStampPeriod: Zero timestamp period change requested: "
+                 "%u frames",
+                 thePeriod);
+
+        mPendingZeroTimeStampPeriod = thePeriod;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetZeroTimeStampPeriod);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+CFArrayRef	RDC_Device::CopyTappedBundleIDs() const
+{
+    return mClientTaps.CopyTappedBundleIDs();
+}
+
+// Used by the custom properties that take an array of bundle IDs. Returns the strings in
+// inBundleIDs or throws if it has more than inMaxBundleIDs elements or any of them isn't a CFString.
+static std::vector<CACFString> RDC_GetBundleIDs(CFArrayRef inBundleIDs, UInt32 inMaxBundleIDs)
+{
+    CACFArray theBundleIDsArray(inBundleIDs, false);
+
+    ThrowIf(theBundleIDsArray.GetNumberItems() > inMaxBundleIDs,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::Device_SetPropertyData: Too many bundle IDs");
+
+    std::vector<CACFString> theBundleIDs;
+
+    for(UInt32 i = 0; i < theBundleIDsArray.GetNumberItems(); i++)
+    {
+        CFStringRef theBundleID = nullptr;
+        bool didGetString = theBundleIDsArray.GetString(i, theBundleID);
+        ThrowIf(!didGetString || theBundleID == nullptr,
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_Device::Device_SetPropertyData: Expected an array of CFStrings");
+
+        CACFString theBundleIDString;
+        theBundleIDString = theBundleID;  // Retains it.
+        theBundleIDs.push_back(theBundleIDString);
+    }
+
+    return theBundleIDs;
+}
+
+void	RDC_Device::RequestTappedBundleIDs(CFArrayRef inBundleIDs)
+{
+    std::vector<CACFString> theBundleIDs = RDC_GetBundleIDs(inBundleIDs, kRDCMaxClientTaps);
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    DebugMsg("RDC_Device::RequestTappedBundleIDs: Tapped bundle IDs change requested: %zu bundle IDs",
+             theBundleIDs.size());
+
+    mPendingTappedBundleIDs = theBundleIDs;
+
+    AudioObjectID theDeviceObjectID = GetObjectID();
+    UInt64 action = static_cast<UInt64>(ChangeAction::SetTappedBundleIDs);
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+    });
+}
+
+CFArrayRef	RDC_Device::CopyBusBundleIDs() const
+{
+    return mClientBuses.CopyBusBundleIDs();
+}
+
+void	RDC_Device::RequestBusBundleIDs(CFArrayRef inBundleIDs)
+{
+    std::vector<CACFString> theBundleIDs = RDC_GetBundleIDs(inBundleIDs, kRDCMaxClientBuses);
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    ThrowIf(theBundleIDs.size() * 2 > mChannelCount,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::RequestBusBundleIDs: Each bus needs two of the device's channels");
+
+    DebugMsg("RDC_Device::RequestBusBundleIDs: Bus bundle IDs change requested: %zu buses",
+             theBundleIDs.size());
+
+    mPendingBusBundleIDs = theBundleIDs;
+
+    AudioObjectID theDeviceObjectID = GetObjectID();
+    UInt64 action = static_cast<UInt64>(ChangeAction::SetBusBundleIDs);
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+    });
+}
+
+CFStringRef	RDC_Device::CopyInputTapBundleID() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(mInputTapBundleID.IsValid())
+    {
+        return static_cast<CFStringRef>(CFRetain(mInputTapBundleID.GetCFString()));
+    }
+
+    return CFSTR("");
+}
+
+void	RDC_Device::SetInputTapBundleID(CFStringRef inBundleID)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(CFStringGetLength(inBundleID) == 0)
+    {
+        DebugMsg("RDC_Device::SetInputTapBundleID: Reading the mix");
+        mInputTapBundleID = CACFString();
+        mInputTapIndex.store(-1, std::memory_order_release);
+        return;
+    }
+
+    SInt32 theTapIndex = mClientTaps.GetTapIndex(inBundleID);
+
+    ThrowIf(theTapIndex < 0,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::SetInputTapBundleID: The bundle ID isn't tapped");
+
+    DebugMsg("RDC_Device::SetInputTapBundleID: Reading tap %d", theTapIndex);
+
+    mInputTapBundleID = inBundleID;
+    mInputTapIndex.store(theTapIndex, std::memory_order_release);
+}
+
+CFStringRef	RDC_Device::CopySharedLoopbackName() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    return mSharedLoopbackBuffer.CopyName();
+}
+
+void	RDC_Device::RequestSharedLoopbackName(CFStringRef inName)
+{
+    // Check the name now so the caller gets the error, rather than it being logged during the
+    // config change.
+    char theName[kRDCSharedLoopbackMaxNameLength + 1];
+    ThrowIf(CFStringGetLength(inName) > 0 &&
+            (!CFStringGetCString(inName, theName, sizeof(theName), kCFStringEncodingUTF8) ||
+             theName[0] != '/'),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::RequestSharedLoopbackName: Invalid shared memory name");
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    DebugMsg("RDC_Device::RequestSharedLoopbackName: Shared loopback name change requested");
+
+    mPendingSharedLoopbackName = inName;
+
+    AudioObjectID theDeviceObjectID = GetObjectID();
+    UInt64 action = static_cast<UInt64>(ChangeAction::SetSharedLoopbackName);
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+    });
+}
+
+CFDictionaryRef	RDC_Device::CopyClockSource() const
+{
+    CFMutableDictionaryRef theClockSource =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      3,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theClockSource,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_Device::CopyClockSource: failed to create the dictionary");
+
+    CFStringRef theDeviceUID = mClockSource.CopyClockDeviceUID();
+    CFDictionarySetValue(theClockSource, CFSTR(kRDCClockSourceKey_DeviceUID), theDeviceUID);
+    CFRelease(theDeviceUID);
+
+    Float64 theActualSampleRate = mClockSource.GetClockActualSampleRate();
+    CFNumberRef theActualSampleRateRef =
+            CFNumberCreate(kCFAllocatorDefault, kCFNumberFloat64Type, &theActualSampleRate);
+    if(theActualSampleRateRef != nullptr)
+    {
+        CFDictionarySetValue(theClockSource,
+                             CFSTR(kRDCClockSourceKey_ActualSampleRate),
+                             theActualSampleRateRef);
+        CFRelease(theActualSampleRateRef);
+    }
+
+    CFNumberRef theLatencyRef = RDC_CreateCFNumber(mClockSource.GetClockLatency());
+    if(theLatencyRef != nullptr)
+    {
+        CFDictionarySetValue(theClockSource, CFSTR(kRDCClockSourceKey_Latency), theLatencyRef);
+        CFRelease(theLatencyRef);
+    }
+
+    return theClockSource;
+}
+
+// Gets a number from a kAudioDeviceCustomPropertyClockSource dictionary. Returns false if the key is
+// missing and throws if its value isn't a CFNumber.
+static bool RDC_GetClockSourceNumber(CFDictionaryRef inClockSource,
+                                     CFStringRef inKey,
+                                     CFNumberType inType,
+                                     void* inValue)
+{
+    CFTypeRef theValue = CFDictionaryGetValue(inClockSource, inKey);
+
+    if(theValue == nullptr)
+    {
+        return false;
+    }
+
+    ThrowIf(CFGetTypeID(theValue) != CFNumberGetTypeID() ||
+            !CFNumberGetValue(static_cast<CFNumberRef>(theValue), inType, inValue),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::SetClockSource: A timestamp value wasn't a CFNumber");
+
+    return true;
+}
+
+void	RDC_Device::SetClockSource(CFDictionaryRef inClockSource)
+{
+    CFTypeRef theDeviceUID = CFDictionaryGetValue(inClockSource, CFSTR(kRDCClockSourceKey_DeviceUID));
+    ThrowIf(theDeviceUID == nullptr || CFGetTypeID(theDeviceUID) != CFStringGetTypeID(),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::SetClockSource: Missing the device UID");
+
+    Float64 theSampleTime = 0.0;
+    SInt64 theHostTime = 0;
+    Float64 theSampleRate = 0.0;
+    bool hasSampleTime = RDC_GetClockSourceNumber(inClockSource,
+                                                  CFSTR(kRDCClockSourceKey_SampleTime),
+                                                  kCFNumberFloat64Type,
+                                                  &theSampleTime);
+    bool hasHostTime = RDC_GetClockSourceNumber(inClockSource,
+                                                CFSTR(kRDCClockSourceKey_HostTime),
+                                                kCFNumberSInt64Type,
+                                                &theHostTime);
+    bool hasSampleRate = RDC_GetClockSourceNumber(inClockSource,
+                                                  CFSTR(kRDCClockSourceKey_SampleRate),
+                                                  kCFNumberFloat64Type,
+                                                  &theSampleRate);
+
+    ThrowIf(hasSampleTime != hasHostTime || hasSampleTime != hasSampleRate,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::SetClockSource: A timestamp needs a sample time, host time and sample rate");
+    ThrowIf(hasSampleTime && (theHostTime <= 0 || theSampleRate < 1.0),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::SetClockSource: Invalid timestamp");
+
+    SInt64 theLatency = 0;
+    bool hasLatency = RDC_GetClockSourceNumber(inClockSource,
+                                               CFSTR(kRDCClockSourceKey_Latency),
+                                               kCFNumberSInt64Type,
+                                               &theLatency);
+
+    ThrowIf(hasLatency && (theLatency < 0 || theLatency > UINT32_MAX),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::SetClockSource: Invalid latency");
+
+    UInt32 theOldLatency = mClockSource.GetClockLatency();
+
+    mClockSource.SetClockDeviceUID(static_cast<CFStringRef>(theDeviceUID));
+
+    // The anchor is only used by GetZeroTimeStamp, so while no clients are doing IO there's no
+    // point updating it. StartIO resets it, so the first zero timestamp after that starts a new
+    // epoch instead of being compared with one from before the device went idle.
+    if(hasSampleTime && mClients.ClientsRunningIO())
+    {
+        mClockSource.AddClockZeroTimeStamp(theSampleTime,
+                                           static_cast<UInt64>(theHostTime),
+                                           theSampleRate);
+    }
+
+    if(hasLatency)
+    {
+        mClockSource.SetClockLatency(static_cast<UInt32>(theLatency));
+    }
+
+    // The output latency is the followed device's, so it changes when a different device is
+    // followed as well.
+    if(mClockSource.GetClockLatency() != theOldLatency)
+    {
+        SendLatencyNotifications(false);
+    }
+}
+
+// The kRDCLatencyOverridesKey_* key for each LatencyOverride, in the same order.
+static const CFStringRef sLatencyOverridesKeys[] = {
+    CFSTR(kRDCLatencyOverridesKey_InputLatency),
+    CFSTR(kRDCLatencyOverridesKey_OutputLatency),
+    CFSTR(kRDCLatencyOverridesKey_InputSafetyOffset),
+    CFSTR(kRDCLatencyOverridesKey_OutputSafetyOffset)
+};
+
+UInt32	RDC_Device::GetLatency(bool inIsInput) const
+{
+    SInt64 theOverride =
+            mLatencyOverrides[inIsInput ? kLatencyOverride_InputLatency :
+                                          kLatencyOverride_OutputLatency].load(std::memory_order_relaxed);
+    if(theOverride >= 0)
+    {
+        return static_cast<UInt32>(theOverride);
+    }
+
+    return inIsInput ? 0 : mClockSource.GetClockLatency();
+}
+
+UInt32	RDC_Device::GetSafetyOffset(bool inIsInput) const
+{
+    SInt64 theInputOverride =
+            mLatencyOverrides[kLatencyOverride_InputSafetyOffset].load(std::memory_order_relaxed);
+    SInt64 theOutputOverride =
+            mLatencyOverrides[kLatencyOverride_OutputSafetyOffset].load(std::memory_order_relaxed);
+
+    UInt64 theInputSafetyOffset =
+            (theInputOverride >= 0) ? static_cast<UInt64>(theInputOverride) :
+            mDriftCompensator.IsEnabledRT() ? RDC_DriftCompensator::kLookAheadFrames : 0;
+    UInt64 theOutputSafetyOffset =
+            (theOutputOverride >= 0) ? static_cast<UInt64>(theOutputOverride) : 0;
+
+    // A reader is the input safety offset, the output safety offset and both IO buffers behind the
+    // end of the data, so those all have to fit in the loopback buffer. The output safety offset
+    // takes priority, since it's a promise to the writer.
+    UInt64 theRingFrameSize = GetLoopbackBufferFrameSize();
+    UInt64 theIOBufferFrameSize = mMaxIOBufferFrameSize.load(std::memory_order_relaxed);
+    UInt64 theMaxSafetyOffsets =
+            (theRingFrameSize > 2 * theIOBufferFrameSize) ? theRingFrameSize - 2 * theIOBufferFrameSize : 0;
+
+    theOutputSafetyOffset = std::min(theOutputSafetyOffset, theMaxSafetyOffsets);
+    theInputSafetyOffset = std::min(theInputSafetyOffset, theMaxSafetyOffsets - theOutputSafetyOffset);
+
+    return static_cast<UInt32>(inIsInput ? theInputSafetyOffset : theOutputSafetyOffset);
+}
+
+AudioValueRange	RDC_Device::GetIOBufferFrameSizeRange() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    // The HAL expects at least one zero timestamp per IO buffer, and the reader and writer's
+    // buffers both have to fit in the loopback buffer (see GetSafetyOffset).
+    UInt32 theMaximum = std::min(mZeroTimeStampPeriod, mLoopbackRingBufferFrameSize / 2);
+
+    AudioValueRange theRange;
+    theRange.mMinimum = kRDCMinIOBufferFrameSize;
+    theRange.mMaximum = std::max(theMaximum, kRDCMinIOBufferFrameSize);
+    return theRange;
+}
+
+CFDictionaryRef	RDC_Device::CopyLatencyOverrides() const
+{
+    CFMutableDictionaryRef theOverrides =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      kLatencyOverrideCount,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theOverrides,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_Device::CopyLatencyOverrides: failed to create the dictionary");
+
+    for(UInt32 i = 0; i < kLatencyOverrideCount; i++)
+    {
+        SInt64 theOverride = mLatencyOverrides[i].load(std::memory_order_relaxed);
+        if(theOverride >= 0)
+        {
+            CFNumberRef theOverrideRef =
+                    CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &theOverride);
+            if(theOverrideRef != nullptr)
+            {
+                CFDictionarySetValue(theOverrides, sLatencyOverridesKeys[i], theOverrideRef);
+                CFRelease(theOverrideRef);
+            }
+        }
+    }
+
+    return theOverrides;
+}
+
+void	RDC_Device::SetLatencyOverrides(CFDictionaryRef inOverrides)
+{
+    static_assert(sizeof(sLatencyOverridesKeys) / sizeof(sLatencyOverridesKeys[0]) == kLatencyOverrideCount,
+                  "RDC_Device: sLatencyOverridesKeys is missing a key");
+
+    // Check all of the values before changing any of them.
+    SInt64 theOverrides[kLatencyOverrideCount];
+
+    for(UInt32 i = 0; i < kLatencyOverrideCount; i++)
+    {
+        theOverrides[i] = -1;
+
+        CFTypeRef theValue = CFDictionaryGetValue(inOverrides, sLatencyOverridesKeys[i]);
+        if(theValue != nullptr)
+        {
+            ThrowIf(CFGetTypeID(theValue) != CFNumberGetTypeID() ||
+                    !CFNumberGetValue(static_cast<CFNumberRef>(theValue),
+                                      kCFNumberSInt64Type,
+                                      &theOverrides[i]) ||
+                    theOverrides[i] < 0 ||
+                    theOverrides[i] > UINT32_MAX,
+                    CAException(kAudioHardwareIllegalOperationError),
+                    "RDC_Device::SetLatencyOverrides: A value wasn't a valid number of frames");
+        }
+    }
+
+    for(UInt32 i = 0; i < kLatencyOverrideCount; i++)
+    {
+        mLatencyOverrides[i].store(theOverrides[i], std::memory_order_relaxed);
+    }
+}
+
+void	RDC_Device::LoadLatencyOverrides()
+{
+    CFBundleRef theBundle = CFBundleGetBundleWithIdentifier(RDC_PlugIn::GetInstance().GetBundleID());
+    CFTypeRef theValue =
+            (theBundle == nullptr) ? nullptr :
+                CFBundleGetValueForInfoDictionaryKey(theBundle, CFSTR(kRDCLatencyOverridesInfoKey));
+
+    // The value is owned by the bundle, so we don't release it.
+    if(theValue == nullptr)
+    {
+        return;
+    }
+
+    if(CFGetTypeID(theValue) != CFDictionaryGetTypeID())
+    {
+        LogWarning("RDC_Device::LoadLatencyOverrides: %s isn't a dictionary",
+                   kRDCLatencyOverridesInfoKey);
+        return;
+    }
+
+    try
+    {
+        SetLatencyOverrides(static_cast<CFDictionaryRef>(theValue));
+    }
+    catch(const CAException& e)
+    {
+        LogWarning("RDC_Device::LoadLatencyOverrides: Ignoring invalid overrides (%d)", e.GetError());
+    }
+}
+
+void	RDC_Device::LoadClientSettings()
+{
+    RDC_ClientSettingsMap theSettings = RDC_ClientSettingsCache::Load(mDeviceUID);
+
+    if(theSettings.empty())
+    {
+        return;
+    }
+
+    std::vector<RDC_Client> thePastClients;
+    std::map<SInt32, CACFString> theTaps;
+    std::vector<CACFString> theBuses[kRDCMaxClientBuses];
+
+    for(const auto& theEntry : theSettings)
+    {
+        const CACFString& theBundleID = theEntry.first;
+        const RDC_ClientSettings& theClientSettings = theEntry.second;
+
+        // The empty bundle ID only holds the mix's buses.
+        if(CFStringGetLength(theBundleID.GetCFString()) > 0)
+        {
+            RDC_Client thePastClient;
+            thePastClient.mClientID = 0;
+            thePastClient.mProcessID = 0;
+            thePastClient.mBundleID = theBundleID;
+            thePastClient.mRelativeVolume = theClientSettings.mRelativeVolume;
+            thePastClient.mPanPosition = theClientSettings.mPanPosition;
+            thePastClients.push_back(thePastClient);
+
+            if(theClientSettings.mTapIndex >= 0)
+            {
+                theTaps[theClientSettings.mTapIndex] = theBundleID;
+            }
+        }
+
+        for(UInt32 theBus = 0; theBus < kRDCMaxClientBuses; theBus++)
+        {
+            if((theClientSettings.mBusMask & (1U << theBus)) != 0)
+            {
+                theBuses[theBus].push_back(theBundleID);
+            }
+        }
+    }
+
+    DebugMsg("RDC_Device::LoadClientSettings: Restoring the settings of %zu apps", thePastClients.size());
+
+    mClients.AddPastClientRelativeVolumes(thePastClients);
+
+    // The buses and taps are stored per bundle ID, so put them back in order. Any gaps (from data
+    // written with more of them than are allowed now) are closed up.
+    std::vector<CACFString> theTappedBundleIDs;
+
+    for(const auto& theTap : theTaps)
+    {
+        theTappedBundleIDs.push_back(theTap.second);
+    }
+
+    std::vector<CACFString> theBusBundleIDs;
+
+    for(UInt32 theBus = 0; theBus < kRDCMaxClientBuses && theBusBundleIDs.size() * 2 < mChannelCount; theBus++)
+    {
+        // A bus has exactly one bundle ID, unless the data is inconsistent.
+        if(theBuses[theBus].size() == 1)
+        {
+            theBusBundleIDs.push_back(theBuses[theBus][0]);
+        }
+    }
+
+    try
+    {
+        if(!theTappedBundleIDs.empty())
+        {
+            SetTappedBundleIDs(theTappedBundleIDs);
+        }
+
+        if(!theBusBundleIDs.empty())
+        {
+            SetBusBundleIDs(theBusBundleIDs);
+        }
+    }
+    catch(const CAException& e)
+    {
+        LogWarning("RDC_Device::LoadClientSettings: Failed to restore the taps and buses (%d)", e.GetError());
+    }
+}
+
+void	RDC_Device::SaveClientSettingsSoon()
+{
+    if(mClientSettingsSaveIsPending.exchange(true))
+    {
+        return;
+    }
+
+    AudioObjectID theDeviceObjectID = GetObjectID();
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(static_cast<UInt64>(kClientSettingsSaveDelayMilliseconds) * NSEC_PER_MSEC, ^{
+        RDC_Device* theDevice = LookUpInstance(theDeviceObjectID);
+
+        if(theDevice != nullptr)
+        {
+            // Clear it first, so changes made while saving schedule another save.
+            theDevice->mClientSettingsSaveIsPending.store(false);
+
+            try
+            {
+                theDevice->SaveClientSettings();
+            }
+            catch(...)
+            {
+                LogError("RDC_Device::SaveClientSettingsSoon: Failed to save the settings");
+            }
+        }
+    });
+}
+
+void	RDC_Device::SaveClientSettings()
+{
+    RDC_ClientSettingsMap theSettings;
+
+    // Apps with the default settings are left out, to keep the data small.
+    for(const RDC_Client& thePastClient : mClients.GetPastClientRelativeVolumes())
+    {
+        if(thePastClient.mRelativeVolume != 1.0f || thePastClient.mPanPosition != kRDCAppPanCenterRawValue)
+        {
+            RDC_ClientSettings& theClientSettings = theSettings[thePastClient.mBundleID];
+            theClientSettings.mRelativeVolume = thePastClient.mRelativeVolume;
+            theClientSettings.mPanPosition = thePastClient.mPanPosition;
+        }
+    }
+
+    // Add the taps and buses to the apps' entries, making entries for them if they don't have any.
+    auto forEachBundleID = [&theSettings](CFArrayRef inBundleIDs,
+                                          const std::function<void(RDC_ClientSettings&, UInt32)>& inUpdate) {
+        CACFArray theBundleIDs(inBundleIDs, true);
+
+        for(UInt32 i = 0; i < theBundleIDs.GetNumberItems(); i++)
+        {
+            CFStringRef theBundleIDRef = nullptr;
+
+            if(theBundleIDs.GetString(i, theBundleIDRef) && theBundleIDRef != nullptr)
+            {
+                CACFString theBundleID;
+                theBundleID = theBundleIDRef;  // Retains it.
+                inUpdate(theSettings[theBundleID], i);
+            }
+        }
+    };
+
+    forEachBundleID(mClientTaps.CopyTappedBundleIDs(), [](RDC_ClientSettings& ioClientSettings, UInt32 inIndex) {
+        ioClientSettings.mTapIndex = static_cast<SInt32>(inIndex);
+    });
+
+    forEachBundleID(mClientBuses.CopyBusBundleIDs(), [](RDC_ClientSettings& ioClientSettings, UInt32 inIndex) {
+        ioClientSettings.mBusMask |= static_cast<UInt16>(1U << inIndex);
+    });
+
+    DebugMsg("RDC_Device::SaveClientSettings: Saving the settings of %zu apps", theSettings.size());
+
+    RDC_ClientSettingsCache::Save(mDeviceUID, theSettings);
+}
+
+void	RDC_Device::SendLatencyNotifications(bool inOverridesChanged) const
+{
+    AudioObjectID theDeviceObjectID = GetObjectID();
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        AudioObjectPropertyAddress theChangedProperties[] = {
+            { kAudioDevicePropertyLatency, kAudioObjectPropertyScopeInput, kAudioObjectPropertyElementMaster },
+            { kAudioDevicePropertyLatency, kAudioObjectPropertyScopeOutput, kAudioObjectPropertyElementMaster },
+            { kAudioDevicePropertySafetyOffset, kAudioObjectPropertyScopeInput, kAudioObjectPropertyElementMaster },
+            { kAudioDevicePropertySafetyOffset, kAudioObjectPropertyScopeOutput, kAudioObjectPropertyElementMaster },
+            kRDCLatencyOverridesAddress
+        };
+        UInt32 theNumberOfChangedProperties = inOverridesChanged ? 5 : 4;
+        RDC_PlugIn::Host_PropertiesChanged(theDeviceObjectID,
+                                           theNumberOfChangedProperties,
+                                           theChangedProperties);
+    });
+}
+
+void	RDC_Device::RequestSampleFormat(RDC_SampleFormat inRequestedFormat)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(inRequestedFormat != mSampleFormat)
+    {
+        DebugMsg("RDC_Device::RequestSampleFormat: Sample format change requested: %u bits",
+                 RDC_SampleConversion::BitsPerSample(inRequestedFormat));
+
+        mPendingSampleFormat = inRequestedFormat;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetSampleFormat);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+UInt32	RDC_Device::GetLoopbackStorageBitDepth() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return RDC_SampleConversion::BitsPerSample(mLoopbackStorageFormat);
+}
+
+void	RDC_Device::RequestLoopbackStorageBitDepth(UInt32 inRequestedBitDepth)
+{
+    RDC_SampleFormat theFormat;
+    ThrowIf(!RDC_SampleConversion::GetFormatForBitsPerSample(inRequestedBitDepth, theFormat),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::RequestLoopbackStorageBitDepth: unsupported bit depth");
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(theFormat != mLoopbackStorageFormat)
+    {
+        DebugMsg("RDC_Device::RequestLoopbackStorageBitDepth: Storage format change requested: "
+                 "%u bits",
+                 inRequestedBitDepth);
+
+        mPendingLoopbackStorageFormat = theFormat;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetLoopbackStorageFormat);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+bool	RDC_Device::IsLoopbackStoragePlanar() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return mLoopbackStoragePlanar;
+}
+
+void	RDC_Device::RequestLoopbackStoragePlanar(bool inPlanar)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(inPlanar != mLoopbackStoragePlanar)
+    {
+        DebugMsg("RDC_Device::RequestLoopbackStoragePlanar: Storage layout change requested: %s",
+                 inPlanar ? "planar" : "interleaved");
+
+        mPendingLoopbackStoragePlanar = inPlanar;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetLoopbackStoragePlanar);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+CFDictionaryRef	RDC_Device::CopyReadDelays() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    CFMutableDictionaryRef theReadDelays =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      static_cast<CFIndex>(mReadDelays.size()),
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theReadDelays,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_Device::CopyReadDelays: failed to create the dictionary");
+
+    for(const auto& theReadDelay : mReadDelays)
+    {
+        SInt64 theFrames = theReadDelay.second;
+        CFNumberRef theFramesRef = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &theFrames);
+        if(theFramesRef != nullptr)
+        {
+            CFDictionarySetValue(theReadDelays, theReadDelay.first.GetCFString(), theFramesRef);
+            CFRelease(theFramesRef);
+        }
+    }
+
+    return theReadDelays;
+}
+
+void	RDC_Device::SetReadDelays(CFDictionaryRef inReadDelays)
+{
+    CFIndex theCount = CFDictionaryGetCount(inReadDelays);
+    std::vector<const void*> theKeys(static_cast<size_t>(theCount));
+    std::vector<const void*> theValues(static_cast<size_t>(theCount));
+    CFDictionaryGetKeysAndValues(inReadDelays, theKeys.data(), theValues.data());
+
+    // Check all of the delays before changing any of them.
+    std::map<CACFString, UInt32> theReadDelays;
+    UInt32 theLargestDelay = 0;
+
+    for(CFIndex i = 0; i < theCount; i++)
+    {
+        CFTypeRef theKey = theKeys[static_cast<size_t>(i)];
+        CFTypeRef theValue = theValues[static_cast<size_t>(i)];
+
+        ThrowIf(CFGetTypeID(theKey) != CFStringGetTypeID() ||
+                CFStringGetLength(static_cast<CFStringRef>(theKey)) == 0,
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_Device::SetReadDelays: A key was not a bundle ID");
+
+        SInt64 theFrames = -1;
+        ThrowIf(CFGetTypeID(theValue) != CFNumberGetTypeID() ||
+                !CFNumberGetValue(static_cast<CFNumberRef>(theValue), kCFNumberSInt64Type, &theFrames) ||
+                theFrames < 0 ||
+                theFrames > kRDCMaxReadDelayFrames,
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_Device::SetReadDelays: A delay was not a number of frames in "
+                "[0, kRDCMaxReadDelayFrames]");
+
+        // Retain it, since the map keeps it.
+        CFRetain(theKey);
+        theReadDelays[CACFString(static_cast<CFStringRef>(theKey))] = static_cast<UInt32>(theFrames);
+        theLargestDelay = std::max(theLargestDelay, static_cast<UInt32>(theFrames));
+    }
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    // Stop delaying the apps that were removed.
+    for(const auto& theOldReadDelay : mReadDelays)
+    {
+        if(theReadDelays.count(theOldReadDelay.first) == 0)
+        {
+            mClients.SetClientsReadDelay(theOldReadDelay.first.GetCFString(), 0);
+        }
+    }
+
+    for(const auto& theReadDelay : theReadDelays)
+    {
+        mClients.SetClientsReadDelay(theReadDelay.first.GetCFString(), theReadDelay.second);
+    }
+
+    mReadDelays = theReadDelays;
+
+    // Resize the buffers if the largest delay changed. Until then, ReadInputData shortens the delays
+    // that don't fit.
+    if(theLargestDelay != mReadDelayHeadroomFrames)
+    {
+        DebugMsg("RDC_Device::SetReadDelays: Read delay headroom change requested: %u frames",
+                 theLargestDelay);
+
+        mPendingReadDelayHeadroomFrames = theLargestDelay;
+
+        AudioObjectID theDeviceObjectID = GetObjectID();
+        UInt64 action = static_cast<UInt64>(ChangeAction::SetReadDelayHeadroom);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+        });
+    }
+}
+
+bool	RDC_Device::IsLoopbackBufferWired() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return mLoopbackRingBuffer.IsWired();
+}
+
+void	RDC_Device::SetLoopbackBufferWired(bool inWired)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    DebugMsg("RDC_Device::SetLoopbackBufferWired: %s the loopback buffer",
+             inWired ? "Wiring" : "Unwiring");
+
+    // Locking the pages doesn't move them, so this is safe while IO is running.
+    ThrowIf(!mLoopbackRingBuffer.SetWired(inWired),
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_Device::SetLoopbackBufferWired: Failed to change whether the loopback buffer is "
+            "wired");
+}
+
+UInt32	RDC_Device::GetLoopbackIdleTimeout() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    return mLoopbackIdleTimeoutSeconds;
+}
+
+void	RDC_Device::SetLoopbackIdleTimeout(UInt32 inSeconds)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    DebugMsg("RDC_Device::SetLoopbackIdleTimeout: %u s", inSeconds);
+
+    mLoopbackIdleTimeoutSeconds = inSeconds;
+
+    // Restart the countdown with the new timeout if IO is stopped.
+    if(!mClients.ClientsRunningIO())
+    {
+        ScheduleLoopbackRelease();
+    }
+}
+
+UInt32	RDC_Device::GetRetroCaptureSeconds() const
+{
+    return mRetroBuffer.GetWindowSeconds();
+}
+
+void	RDC_Device::SetRetroCaptureSeconds(UInt32 inSeconds)
+{
+    // Hold the state mutex so the format can't change before the window is allocated.
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    mRetroBuffer.SetWindowSecondsNonRT(inSeconds, mLoopbackSampleRate, mChannelCount);
+}
+
+CFStringRef	RDC_Device::CopyRetroCaptureSavePath() const
+{
+    return mRetroBuffer.CopyLastSavedPath();
+}
+
+void	RDC_Device::SaveRetroCapture(CFStringRef inPath)
+{
+    mRetroBuffer.SaveNonRT(inPath);
+}
+
+UInt32	RDC_Device::GetRetroCaptureSaveSeconds() const
+{
+    return mRetroBuffer.GetSaveSeconds();
+}
+
+void	RDC_Device::SetRetroCaptureSaveSeconds(UInt32 inSeconds)
+{
+    mRetroBuffer.SetSaveSecondsNonRT(inSeconds);
+}
+
+CFArrayRef	RDC_Device::CopyReducedInputChannels() const
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    CACFArray theChannels(mNumberOfReducedInputChannels, true);
+
+    for(UInt32 i = 0; i < mNumberOfReducedInputChannels; i++)
+    {
+        theChannels.AppendSInt32(mReducedInputChannels[i]);
+    }
+
+    return theChannels.CopyCFArray();
+}
+
+void	RDC_Device::RequestReducedInputChannels(CFArrayRef inChannels)
+{
+    CACFArray theChannelsArray(inChannels, false);
+
+    ThrowIf(theChannelsArray.GetNumberItems() > kRDCMaxChannelCount,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Device::RequestReducedInputChannels: Too many channels");
+
+    SInt32 theChannels[kRDCMaxChannelCount];
+    UInt32 theNumberOfChannels = theChannelsArray.GetNumberItems();
+
+    for(UInt32 i = 0; i < theNumberOfChannels; i++)
+    {
+        SInt32 theChannel = -1;
+        bool didGetNumber = theChannelsArray.GetSInt32(i, theChannel);
+        ThrowIf(!didGetNumber ||
+                    theChannel < kRDCReducedInputChannel_Mix ||
+                    theChannel > static_cast<SInt32>(kRDCMaxChannelCount),
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_Device::RequestReducedInputChannels: Expected an array of channel numbers");
+
+        theChannels[i] = theChannel;
+    }
+
+    CAMutex::Locker theStateLocker(mStateMutex);
 
-    // Handle errors.
-    switch (err)
+    std::copy(theChannels, theChannels + theNumberOfChannels, mPendingReducedInputChannels);
+    mPendingNumberOfReducedInputChannels = theNumberOfChannels;
+
+    AudioObjectID theDeviceObjectID = GetObjectID();
+    UInt64 action = static_cast<UInt64>(ChangeAction::SetReducedInputChannels);
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+    });
+}
+
+RDC_Object&  RDC_Device::GetOwnedObjectByID(AudioObjectID inObjectID)
+{
+	// C++ is weird. See "Avoid Duplication in const and Non-const Member Functions" in Item 3 of Effective C++.
+	return const_cast<RDC_Object&>(static_cast<const RDC_Device&>(*this).GetOwnedObjectByID(inObjectID));
+}
+
+const RDC_Object&  RDC_Device::GetOwnedObjectByID(AudioObjectID inObjectID) const
+{
+	if(inObjectID == mInputStream.GetObjectID())
+	{
+		return mInputStream;
+	}
+	else if(inObjectID == mReducedInputStream.GetObjectID())
+	{
+		return mReducedInputStream;
+	}
+	else if(inObjectID == mOutputStream.GetObjectID())
+	{
+		return mOutputStream;
+	}
+	else if(inObjectID == mVolumeControl.GetObjectID())
+	{
+		return mVolumeControl;
+	}
+	else if(inObjectID == mMuteControl.GetObjectID())
+	{
+		return mMuteControl;
+	}
+	else
+	{
+		LogError("RDC_Device::GetOwnedObjectByID: Unknown object ID. inObjectID = %u", inObjectID);
+		Throw(CAException(kAudioHardwareBadObjectError));
+	}
+}
+
+UInt32	RDC_Device::GetNumberOfSubObjects() const
+{
+	AudioObjectID theInputStreamIDs[2];
+	return GetInputStreamIDs(theInputStreamIDs) + GetNumberOfOutputSubObjects();
+}
+
+UInt32	RDC_Device::GetNumberOfOutputSubObjects() const
+{
+	return kNumberOfOutputStreams + GetNumberOfOutputControls();
+}
+
+UInt32	RDC_Device::GetNumberOfOutputControls() const
+{
+	bool theVolumeEnabled, theMuteEnabled;
+	GetEnabledOutputControls(theVolumeEnabled, theMuteEnabled);
+
+	UInt32 theAnswer = 0;
+
+	if(theVolumeEnabled)
+	{
+		theAnswer++;
+	}
+
+	if(theMuteEnabled)
+	{
+		theAnswer++;
+	}
+
+    return theAnswer;
+}
+
+UInt32	RDC_Device::GetInputStreamIDs(AudioObjectID outIDs[2]) const
+{
+    outIDs[0] = mInputStream.GetObjectID();
+
+    if(mPublishedHasReducedInputStream.load(std::memory_order_acquire))
     {
-        case kCARingBufferError_CPUOverload:
-            // Write silence to the buffer.
-            memset(outBuffer, 0, abl.mBuffers[0].mDataByteSize);
-            break;
-        case kCARingBufferError_TooMuch:
-            // Should be impossible, but handle it just in case. Write silence to the buffer and
-            // return an error code.
-            memset(outBuffer, 0, abl.mBuffers[0].mDataByteSize);
-            Throw(CAException(kAudioHardwareIllegalOperationError));
-        case kCARingBufferError_OK:
-            break;
-        default:
-            throw CAException(kAudioHardwareUnspecifiedError);
+        outIDs[1] = mReducedInputStream.GetObjectID();
+        return 2;
     }
+
+    return 1;
 }
 
-void	RDC_Device::WriteOutputData(UInt32 inIOBufferFrameSize, Float64 inSampleTime, const void* inBuffer)
+void	RDC_Device::GetEnabledOutputControls(bool& outVolumeEnabled, bool& outMuteEnabled) const
 {
-    // Wrap the provided buffer in an AudioBufferList.
-    AudioBufferList abl = {
-        .mNumberBuffers = 1,
-        .mBuffers[0] = {
-            .mNumberChannels = 2,
-            // Each frame is 2 Float32 samples (one per channel). The number of frames * the number
-            // of bytes per frame = the size of inBuffer in bytes.
-            .mDataByteSize = static_cast<UInt32>(inIOBufferFrameSize * sizeof(Float32) * 2),
-            .mData = const_cast<void *>(inBuffer)
+    // Both flags are in one word so callers never see a mix of two different configurations.
+    UInt32 theEnabledControls = mPublishedEnabledOutputControls.load(std::memory_order_acquire);
+
+    outVolumeEnabled = (theEnabledControls & kEnabledOutputControl_Volume) != 0;
+    outMuteEnabled = (theEnabledControls & kEnabledOutputControl_Mute) != 0;
+}
+
+CFArrayRef	RDC_Device::CopyEnabledOutputControls() const
+{
+    bool theVolumeEnabled, theMuteEnabled;
+    GetEnabledOutputControls(theVolumeEnabled, theMuteEnabled);
+
+    CACFArray theEnabledControls(2, true);
+    theEnabledControls.AppendCFType(theVolumeEnabled ? kCFBooleanTrue : kCFBooleanFalse);
+    theEnabledControls.AppendCFType(theMuteEnabled ? kCFBooleanTrue : kCFBooleanFalse);
+
+    return theEnabledControls.CopyCFArray();
+}
+
+CFDictionaryRef	RDC_Device::CopyLoopbackStats() const
+{
+    CFMutableDictionaryRef theStats =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      0,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theStats,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_Device::CopyLoopbackStats: failed to create the dictionary");
+
+    auto addStat = [theStats](CFStringRef inKey, UInt64 inValue) {
+        SInt64 theValue = static_cast<SInt64>(inValue);
+        CFNumberRef theNumber = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt64Type, &theValue);
+        if(theNumber != nullptr)
+        {
+            CFDictionarySetValue(theStats, inKey, theNumber);
+            CFRelease(theNumber);
         }
     };
 
-    // Copy the audio data from the provided buffer into our ring buffer.
-    CARingBufferError err =
-            mLoopbackRingBuffer.Store(&abl,
-                                      inIOBufferFrameSize,
-                                      static_cast<CARingBuffer::SampleTime>(inSampleTime));
+    addStat(CFSTR(kRDCLoopbackStatsKey_SilentFetches), mLoopbackStats.silentFetches);
+    addStat(CFSTR(kRDCLoopbackStatsKey_RecoveredFetches), mLoopbackStats.recoveredFetches);
+    addStat(CFSTR(kRDCLoopbackStatsKey_ConcealedFetches), mLoopbackStats.concealedFetches);
+    addStat(CFSTR(kRDCLoopbackStatsKey_Underruns), mLoopbackStats.underruns);
+    addStat(CFSTR(kRDCLoopbackStatsKey_StoreErrors), mLoopbackStats.storeErrors);
+    addStat(CFSTR(kRDCLoopbackStatsKey_GapFramesZeroFilled), mLoopbackStats.gapFramesZeroFilled);
+    addStat(CFSTR(kRDCLoopbackStatsKey_MaxReadWriteDistance), mLoopbackStats.maxReadWriteDistance);
+    addStat(CFSTR(kRDCLoopbackStatsKey_SilentFramesSkipped), mLoopbackStats.silentFramesSkipped);
+    addStat(CFSTR(kRDCLoopbackStatsKey_UnreadFramesSkipped), mLoopbackStats.unreadFramesSkipped);
+    addStat(CFSTR(kRDCLoopbackStatsKey_RealTimeTasksHighWaterMark),
+            mTaskQueue.GetRealTimeThreadTasksHighWaterMark());
+    addStat(CFSTR(kRDCLoopbackStatsKey_NonRealTimeTasksHighWaterMark),
+            mTaskQueue.GetNonRealTimeThreadTasksHighWaterMark());
+    addStat(CFSTR(kRDCLoopbackStatsKey_TaskPoolSize), mTaskQueue.GetTaskPoolSize());
+    addStat(CFSTR(kRDCLoopbackStatsKey_TaskPoolHighWaterMark), mTaskQueue.GetTaskPoolHighWaterMark());
+    addStat(CFSTR(kRDCLoopbackStatsKey_DroppedTasks), mTaskQueue.GetDroppedTaskCount());
+    addStat(CFSTR(kRDCLoopbackStatsKey_DriftCorrectionPPM),
+            static_cast<UInt64>(static_cast<SInt64>(mDriftCompensator.GetCorrectionPPM())));
+    addStat(CFSTR(kRDCLoopbackStatsKey_RecordingDroppedFrames), mRecorder.GetDroppedFrames());
+    addStat(CFSTR(kRDCLoopbackStatsKey_RetroCaptureDroppedFrames), mRetroBuffer.GetDroppedFrames());
+    addStat(CFSTR(kRDCLoopbackStatsKey_RetroCaptureEncodedBytes), mRetroBuffer.GetEncodedBytes());
+    addStat(CFSTR(kRDCLoopbackStatsKey_RTPPacketsSent), mRTPSender.GetPacketsSent());
+    addStat(CFSTR(kRDCLoopbackStatsKey_RTPFramesSkipped), mRTPSender.GetFramesSkipped());
+    addStat(CFSTR(kRDCLoopbackStatsKey_IOCycles), mLoopbackStats.ioCycles);
+    addStat(CFSTR(kRDCLoopbackStatsKey_SlowestIOCycleNanos),
+            CAHostTimeBase::ConvertToNanos(mLoopbackStats.slowestIOCycleTicks));
+    addStat(CFSTR(kRDCLoopbackStatsKey_Overruns), mLoopbackStats.overruns);
+    addStat(CFSTR(kRDCLoopbackStatsKey_Gaps), mLoopbackStats.gaps);
+    addStat(CFSTR(kRDCLoopbackStatsKey_RealTimeTasksQueued), mTaskQueue.GetRealTimeThreadTaskCount());
+    addStat(CFSTR(kRDCLoopbackStatsKey_NonRealTimeTasksQueued), mTaskQueue.GetNonRealTimeThreadTaskCount());
+    addStat(CFSTR(kRDCLoopbackStatsKey_TaskPoolTasksInUse), mTaskQueue.GetTaskPoolTasksInUse());
+    addStat(CFSTR(kRDCLoopbackStatsKey_ClientSnapshotsPublished), mClients.GetSnapshotPublishCount());
+    addStat(CFSTR(kRDCLoopbackStatsKey_PropertyNotifications), RDC_PlugIn::GetPropertiesChangedCount());
+    addStat(CFSTR(kRDCLoopbackStatsKey_ReadWriteDistance),
+            static_cast<UInt64>(mLoopbackStats.readWriteDistance.load(std::memory_order_relaxed)));
+
+    return theStats;
+}
 
-    // Return an error code if we failed to store the data. (But ignore CPU overload, which would be
-    // temporary.)
-    if (err != kCARingBufferError_OK && err != kCARingBufferError_CPUOverload)
+void    RDC_Device::SetEnabledControls(bool inVolumeEnabled, bool inMuteEnabled)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(mVolumeControl.IsActive() != inVolumeEnabled)
+    {
+        DebugMsg("RDC_Device::SetEnabledControls: %s the volume control",
+                 inVolumeEnabled ? "Enabling" : "Disabling");
+
+        if(inVolumeEnabled)
+		{
+			mVolumeControl.Activate();
+		}
+		else
+		{
+			mVolumeControl.Deactivate();
+		}
+    }
+
+    if(mMuteControl.IsActive() != inMuteEnabled)
+    {
+        DebugMsg("RDC_Device::SetEnabledControls: %s the mute control",
+                 inMuteEnabled ? "Enabling" : "Disabling");
+
+        if(inMuteEnabled)
+		{
+			mMuteControl.Activate();
+		}
+		else
+		{
+			mMuteControl.Deactivate();
+		}
+    }
+
+    PublishState();
+}
+
+void    RDC_Device::PublishState()
+{
+    UInt32 theEnabledControls = 0;
+
+    if(mVolumeControl.IsActive())
     {
-        Throw(CAException(err));
+        theEnabledControls |= kEnabledOutputControl_Volume;
     }
+
+    if(mMuteControl.IsActive())
+    {
+        theEnabledControls |= kEnabledOutputControl_Mute;
+    }
+
+    mPublishedSampleRate.store(mLoopbackSampleRate, std::memory_order_release);
+    mPublishedEnabledOutputControls.store(theEnabledControls, std::memory_order_release);
+    mPublishedHasReducedInputStream.store(mReducedInputStream.IsActive(), std::memory_order_release);
 }
 
-#pragma mark Accessors
+void RDC_Device::SetSampleRate(Float64 inSampleRate, bool force)
+{
+    // We try to support any sample rate a real output device might.
+    ThrowIf(inSampleRate < 1.0,
+            CAException(kAudioDeviceUnsupportedFormatError),
+            "RDC_Device::SetSampleRate: unsupported sample rate");
 
-void    RDC_Device::RequestEnabledControls(bool inVolumeEnabled, bool inMuteEnabled)
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    Float64 theCurrentSampleRate = GetSampleRate();
+
+    if((inSampleRate != theCurrentSampleRate) || force)  // Check whether we need to change it.
+    {
+        DebugMsg("RDC_Device::SetSampleRate: Changing the sample rate from %f to %f",
+                 theCurrentSampleRate,
+                 inSampleRate);
+
+        // Update the sample rate on the wrapped device if we have one.
+        if(mWrappedAudioEngine != nullptr)
+        {
+            kern_return_t theError = _HW_SetSampleRate(inSampleRate);
+            ThrowIfKernelError(theError,
+                               CAException(kAudioHardwareUnspecifiedError),
+                               "RDC_Device::SetSampleRate: Error setting the sample rate on the "
+                               "wrapped audio device.");
+        }
+
+        // Update the sample rate for loopback. If the loopback buffer is sized by duration, it has
+        // to be reallocated for the new rate. Otherwise, the buffers hold frames, so they can stay
+        // allocated, but the frames in them are at the old rate. The clock restarts when IO does.
+        mLoopbackSampleRate = inSampleRate;
+
+        if(UpdateLoopbackSizes())
+        {
+            InitLoopback();
+        }
+        else
+        {
+            InitLoopbackClock();
+        }
+
+        if(mLoopbackIsAllocated)
+        {
+            mRTPSender.DetachSource();
+            RDC_LoopbackRouter::GetInstance().DetachSourceNonRT(mInstanceIndex);
+            mLoopbackRingBuffer.Clear();
+            mRTPSender.AttachSource(mLoopbackRingBuffer,
+                                    mLoopbackStorageFormat,
+                                    mLoopbackStoragePlanar,
+                                    inSampleRate,
+                                    mChannelCount);
+            RDC_LoopbackRouter::GetInstance().AttachSourceNonRT(mInstanceIndex,
+                                                                mLoopbackRingBuffer,
+                                                                mLoopbackStorageFormat == kRDCSampleFormat_Float32 &&
+                                                                    !mLoopbackStoragePlanar,
+                                                                inSampleRate,
+                                                                mChannelCount);
+        }
+        mClientTaps.Clear();
+        mClientBuses.Clear();
+        mSharedLoopbackBuffer.SetSampleRate(inSampleRate);
+
+        if(mRecorder.SetFormatNonRT(inSampleRate, mChannelCount))
+        {
+            SendRecordingStoppedNotification();
+        }
+
+        mRetroBuffer.SetFormatNonRT(inSampleRate, mChannelCount);
+
+        // Update the streams.
+        mInputStream.SetSampleRate(inSampleRate);
+        mReducedInputStream.SetSampleRate(inSampleRate);
+        mOutputStream.SetSampleRate(inSampleRate);
+
+        PublishState();
+    }
+    else
+    {
+        DebugMsg("RDC_Device::SetSampleRate: The sample rate is already set to %f", inSampleRate);
+    }
+}
+
+void    RDC_Device::SetChannelCount(UInt32 inNewChannelCount)
 {
+    ThrowIf(inNewChannelCount < 1 || inNewChannelCount > kRDCMaxChannelCount,
+            CAException(kAudioDeviceUnsupportedFormatError),
+            "RDC_Device::SetChannelCount: unsupported channel count");
+
     CAMutex::Locker theStateLocker(mStateMutex);
 
-    bool changeVolume = (mVolumeControl.IsActive() != inVolumeEnabled);
-    bool changeMute = (mMuteControl.IsActive() != inMuteEnabled);
+    if(inNewChannelCount != mChannelCount)
+    {
+        DebugMsg("RDC_Device::SetChannelCount: Changing the channel count from %u to %u",
+                 mChannelCount,
+                 inNewChannelCount);
 
-    if(changeVolume)
+        mChannelCount = inNewChannelCount;
+
+        // The loopback buffer stores interleaved frames, so it has to be reallocated for the new
+        // frame size. Any buffered audio is dropped, which is fine because IO is stopped.
+        InitLoopback();
+
+        mInputStream.SetChannelsPerFrame(inNewChannelCount);
+        mOutputStream.SetChannelsPerFrame(inNewChannelCount);
+
+        // The reduced input stream's channels are numbered after the main stream's. InitLoopback
+        // has already resized the buffers it reads through.
+        mReducedInputStream.SetStartingChannel(inNewChannelCount + 1);
+    }
+}
+
+void    RDC_Device::SetAvailableSampleRates(const Float64* inRates, UInt32 inNumberOfRates)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    std::copy(inRates, inRates + inNumberOfRates, mAvailableSampleRates);
+    mNumberOfAvailableSampleRates = inNumberOfRates;
+
+    mInputStream.SetAvailableSampleRates(inRates, inNumberOfRates);
+    mReducedInputStream.SetAvailableSampleRates(inRates, inNumberOfRates);
+    mOutputStream.SetAvailableSampleRates(inRates, inNumberOfRates);
+
+    // Clients only offer the advertised rates, so don't leave the device at one they can't select.
+    Float64 theSampleRate = GetSampleRate();
+
+    if(std::find(inRates, inRates + inNumberOfRates, theSampleRate) == inRates + inNumberOfRates)
     {
-        DebugMsg("RDC_Device::RequestEnabledControls: %s volume control",
-                 (inVolumeEnabled ? "Enabling" : "Disabling"));
-        mPendingOutputVolumeControlEnabled = inVolumeEnabled;
+        Float64 theNearestRate = *std::min_element(inRates,
+                                                   inRates + inNumberOfRates,
+                                                   [theSampleRate](Float64 inA, Float64 inB) {
+                                                       return std::abs(inA - theSampleRate) <
+                                                              std::abs(inB - theSampleRate);
+                                                   });
+
+        SetSampleRate(theNearestRate);
+    }
+}
+
+void    RDC_Device::SetLoopbackBufferFrameSize(UInt32 inNewFrameSize)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    // The capacity is fixed from now on, rather than following the sample rate.
+    mLoopbackBufferMilliseconds = 0;
+
+    if(inNewFrameSize != mLoopbackRingBufferFrameSize)
+    {
+        DebugMsg("RDC_Device::SetLoopbackBufferFrameSize: Changing the loopback buffer size from "
+                 "%u to %u frames",
+                 mLoopbackRingBufferFrameSize,
+                 inNewFrameSize);
+
+        mLoopbackRingBufferFrameSize = inNewFrameSize;
+
+        // Reallocate the buffer. The clock doesn't depend on the buffer's size, but the buffered
+        // audio is gone, so restart it from now anyway. (_HW_StartIO will do this again when IO
+        // restarts, but GetZeroTimeStamp could be called before that.)
+        InitLoopback();
+
+        CAMutex::Locker theIOLocker(mIOMutex);
+        RestartLoopbackClock();
+    }
+}
+
+void    RDC_Device::SetLoopbackBufferMilliseconds(UInt32 inNewMilliseconds)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(inNewMilliseconds != mLoopbackBufferMilliseconds)
+    {
+        DebugMsg("RDC_Device::SetLoopbackBufferMilliseconds: Changing the loopback buffer duration "
+                 "from %u to %u ms",
+                 mLoopbackBufferMilliseconds,
+                 inNewMilliseconds);
+
+        mLoopbackBufferMilliseconds = inNewMilliseconds;
+
+        // InitLoopback recalculates the capacity in frames before reallocating the buffer.
+        InitLoopback();
+
+        CAMutex::Locker theIOLocker(mIOMutex);
+        RestartLoopbackClock();
+    }
+}
+
+bool    RDC_Device::UpdateLoopbackSizes()
+{
+    bool theFrameSizeChanged = false;
+
+    if(mLoopbackBufferMilliseconds != 0)
+    {
+        // Round up so the buffer holds at least the whole duration. CARingBuffer would round the
+        // capacity up to a power of two anyway.
+        Float64 theFrames = std::ceil(mLoopbackSampleRate * mLoopbackBufferMilliseconds / 1000.0);
+        UInt32 theFrameSize =
+            static_cast<UInt32>(std::min(std::max(theFrames,
+                                                  static_cast<Float64>(kRDCMinLoopbackBufferFrameSize)),
+                                         static_cast<Float64>(kRDCMaxLoopbackBufferFrameSize)));
+        theFrameSize = NextPowerOfTwo(theFrameSize);
+
+        theFrameSizeChanged = (theFrameSize != mLoopbackRingBufferFrameSize);
+        mLoopbackRingBufferFrameSize = theFrameSize;
+    }
+
+    if(mZeroTimeStampPeriodIsDerived)
+    {
+        // A period from a fixed capacity could be shorter than the clients' IO buffers, so only
+        // scale it with the duration, which starts out at kRDCDefaultZeroTimeStampPeriod at 44.1 kHz.
+        UInt32 thePeriod = kRDCDefaultZeroTimeStampPeriod;
+
+        if(mLoopbackBufferMilliseconds != 0)
+        {
+            thePeriod = std::min(std::max(mLoopbackRingBufferFrameSize / kZeroTimeStampsPerLoopbackBuffer,
+                                          kRDCMinZeroTimeStampPeriod),
+                                 kRDCMaxZeroTimeStampPeriod);
+        }
+
+        // GetZeroTimeStamp reads the period while holding the IO mutex.
+        CAMutex::Locker theIOLocker(mIOMutex);
+        mZeroTimeStampPeriod = thePeriod;
     }
 
-    if(changeMute)
+    return theFrameSizeChanged;
+}
+
+void    RDC_Device::SetZeroTimeStampPeriod(UInt32 inNewPeriod)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    // The period no longer follows the loopback buffer's capacity.
+    mZeroTimeStampPeriodIsDerived = false;
+
+    if(inNewPeriod != mZeroTimeStampPeriod)
     {
-        DebugMsg("RDC_Device::RequestEnabledControls: %s mute control",
-                 (inMuteEnabled ? "Enabling" : "Disabling"));
-        mPendingOutputMuteControlEnabled = inMuteEnabled;
+        DebugMsg("RDC_Device::SetZeroTimeStampPeriod: Changing the zero timestamp period from %u "
+                 "to %u frames",
+                 mZeroTimeStampPeriod,
+                 inNewPeriod);
+
+        // GetZeroTimeStamp reads the period while holding the IO mutex. The timestamps it returned
+        // before were counted in the old period, so restart the clock as well.
+        CAMutex::Locker theIOLocker(mIOMutex);
+        mZeroTimeStampPeriod = inNewPeriod;
+        RestartLoopbackClock();
     }
+}
 
-    if(changeVolume || changeMute)
+void    RDC_Device::SetTappedBundleIDs(const std::vector<CACFString>& inBundleIDs)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    // Stop the input stream reading from the taps while they're reallocated.
+    mInputTapIndex.store(-1, std::memory_order_release);
+
+    mClientTaps.SetTappedBundleIDs(inBundleIDs,
+                                   mChannelCount * sizeof(Float32),
+                                   GetLoopbackAllocationFrameSize());
+
+    // Keep reading the same app's tap if it's still tapped. Otherwise, fall back to the mix.
+    SInt32 theTapIndex = mClientTaps.GetTapIndex(mInputTapBundleID.GetCFString());
+
+    if(theTapIndex < 0)
     {
-        // Ask the host to stop IO (and whatever else) so we can safely update the device's list of
-        // controls. See RequestDeviceConfigurationChange in AudioServerPlugIn.h.
-        AudioObjectID theDeviceObjectID = GetObjectID();
-        UInt64 action = static_cast<UInt64>(ChangeAction::SetEnabledControls);
-        
-        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
-            RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
-        });
+        mInputTapBundleID = CACFString();
     }
+
+    mInputTapIndex.store(theTapIndex, std::memory_order_release);
 }
 
-Float64	RDC_Device::GetSampleRate() const
+void    RDC_Device::SetBusBundleIDs(const std::vector<CACFString>& inBundleIDs)
 {
-    // The sample rate is guarded by the state lock. Note that we don't need to take the IO lock.
     CAMutex::Locker theStateLocker(mStateMutex);
 
-    Float64 theSampleRate;
+    mClientBuses.SetBusBundleIDs(inBundleIDs, mChannelCount, GetLoopbackAllocationFrameSize());
+}
 
-    // Report the sample rate from the wrapped device if we have one. Note that _HW_GetSampleRate
-    // the device's nominal sample rate, not one calculated from its timestamps.
-    if(mWrappedAudioEngine == nullptr)
+void    RDC_Device::SetReducedInputChannels(const SInt32* inChannels, UInt32 inNumberOfChannels)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    DebugMsg("RDC_Device::SetReducedInputChannels: Setting the reduced input stream to %u channels",
+             inNumberOfChannels);
+
+    // The IO functions read these without locking, which is safe because IO is stopped.
+    std::copy(inChannels, inChannels + inNumberOfChannels, mReducedInputChannels);
+    mNumberOfReducedInputChannels = inNumberOfChannels;
+
+    if(inNumberOfChannels > 0)
     {
-        theSampleRate = mLoopbackSampleRate;
+        mReducedInputStream.SetChannelsPerFrame(inNumberOfChannels);
+
+        if(!mReducedInputStream.IsActive())
+        {
+            mReducedInputStream.Activate();
+        }
     }
-    else
+    else if(mReducedInputStream.IsActive())
     {
-        theSampleRate = _HW_GetSampleRate();
+        mReducedInputStream.Deactivate();
     }
 
-    return theSampleRate;
+    AllocateReducedInputBuffers();
+    PublishState();
 }
 
-void	RDC_Device::RequestSampleRate(Float64 inRequestedSampleRate)
+void    RDC_Device::SetSampleFormat(RDC_SampleFormat inNewFormat)
 {
-    // Changing the sample rate needs to be handled via the RequestConfigChange/PerformConfigChange
-    // machinery. See RequestDeviceConfigurationChange in AudioServerPlugIn.h.
+    CAMutex::Locker theStateLocker(mStateMutex);
 
-	// We try to support any sample rate a real output device might.
-    ThrowIf(inRequestedSampleRate < 1.0,
-            CAException(kAudioDeviceUnsupportedFormatError),
-            "RDC_Device::RequestSampleRate: unsupported sample rate");
+    if(inNewFormat != mSampleFormat)
+    {
+        DebugMsg("RDC_Device::SetSampleFormat: Changing the streams' format from %u to %u bits",
+                 RDC_SampleConversion::BitsPerSample(mSampleFormat),
+                 RDC_SampleConversion::BitsPerSample(inNewFormat));
 
-    DebugMsg("RDC_Device::RequestSampleRate: Sample rate change requested: %f",
-             inRequestedSampleRate);
+        // The loopback buffer's format is separate, so it doesn't need to be reallocated.
+        mSampleFormat = inNewFormat;
+
+        mInputStream.SetSampleFormat(inNewFormat);
+        mReducedInputStream.SetSampleFormat(inNewFormat);
+        mOutputStream.SetSampleFormat(inNewFormat);
+    }
+}
 
+void    RDC_Device::SetLoopbackStorageFormat(RDC_SampleFormat inNewFormat)
+{
     CAMutex::Locker theStateLocker(mStateMutex);
 
-    if(inRequestedSampleRate != GetSampleRate())  // Check the sample rate will actually be changed.
+    if(inNewFormat != mLoopbackStorageFormat)
     {
-        mPendingSampleRate = inRequestedSampleRate;
+        DebugMsg("RDC_Device::SetLoopbackStorageFormat: Changing the loopback buffer's format from "
+                 "%u to %u bits",
+                 RDC_SampleConversion::BitsPerSample(mLoopbackStorageFormat),
+                 RDC_SampleConversion::BitsPerSample(inNewFormat));
 
-        // Dispatch this so the change can happen asynchronously.
-        auto requestSampleRate = ^{
-			UInt64 action = static_cast<UInt64>(ChangeAction::SetSampleRate);
-            RDC_PlugIn::Host_RequestDeviceConfigurationChange(GetObjectID(), action, nullptr);
-        };
+        mLoopbackStorageFormat = inNewFormat;
 
-        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, requestSampleRate);
+        // The frames are a different size now, so the buffer has to be reallocated. Any buffered
+        // audio is dropped.
+        InitLoopback();
     }
 }
 
-RDC_Object&  RDC_Device::GetOwnedObjectByID(AudioObjectID inObjectID)
+void    RDC_Device::SetLoopbackStoragePlanar(bool inPlanar)
 {
-	// C++ is weird. See "Avoid Duplication in const and Non-const Member Functions" in Item 3 of Effective C++.
-	return const_cast<RDC_Object&>(static_cast<const RDC_Device&>(*this).GetOwnedObjectByID(inObjectID));
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(inPlanar != mLoopbackStoragePlanar)
+    {
+        DebugMsg("RDC_Device::SetLoopbackStoragePlanar: Changing the loopback buffer to %s",
+                 inPlanar ? "planar" : "interleaved");
+
+        mLoopbackStoragePlanar = inPlanar;
+
+        // The buffer has a different number of channels now, so it has to be reallocated. Any
+        // buffered audio is dropped.
+        InitLoopback();
+    }
 }
 
-const RDC_Object&  RDC_Device::GetOwnedObjectByID(AudioObjectID inObjectID) const
+void    RDC_Device::SetReadDelayHeadroom(UInt32 inHeadroomFrames)
 {
-	if(inObjectID == mInputStream.GetObjectID())
-	{
-		return mInputStream;
-	}
-	else if(inObjectID == mOutputStream.GetObjectID())
-	{
-		return mOutputStream;
-	}
-	else if(inObjectID == mVolumeControl.GetObjectID())
-	{
-		return mVolumeControl;
-	}
-	else if(inObjectID == mMuteControl.GetObjectID())
-	{
-		return mMuteControl;
-	}
-	else
-	{
-		LogError("RDC_Device::GetOwnedObjectByID: Unknown object ID. inObjectID = %u", inObjectID);
-		Throw(CAException(kAudioHardwareBadObjectError));
-	}
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    if(inHeadroomFrames != mReadDelayHeadroomFrames)
+    {
+        DebugMsg("RDC_Device::SetReadDelayHeadroom: Changing the read delay headroom from %u to %u "
+                 "frames",
+                 mReadDelayHeadroomFrames,
+                 inHeadroomFrames);
+
+        mReadDelayHeadroomFrames = inHeadroomFrames;
+
+        // Reallocates the taps and buses as well.
+        InitLoopback();
+    }
 }
 
-UInt32	RDC_Device::GetNumberOfSubObjects() const
+void    RDC_Device::SetSharedLoopbackName(CFStringRef inName)
 {
-	return kNumberOfInputSubObjects + GetNumberOfOutputSubObjects();
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    mSharedLoopbackBuffer.SetName(inName,
+                                  mLoopbackSampleRate,
+                                  mChannelCount,
+                                  mLoopbackRingBufferFrameSize);
 }
 
-UInt32	RDC_Device::GetNumberOfOutputSubObjects() const
+bool	RDC_Device::IsSharedLoopbackWorldReadable() const
 {
-	return kNumberOfOutputStreams + GetNumberOfOutputControls();
+    CAMutex::Locker theStateLocker(mStateMutex);
+
+    return mSharedLoopbackBuffer.IsWorldReadable();
 }
 
-UInt32	RDC_Device::GetNumberOfOutputControls() const
+void	RDC_Device::RequestSharedLoopbackWorldReadable(bool inWorldReadable)
 {
-	CAMutex::Locker theStateLocker(mStateMutex);
+    CAMutex::Locker theStateLocker(mStateMutex);
 
-	UInt32 theAnswer = 0;
+    DebugMsg("RDC_Device::RequestSharedLoopbackWorldReadable: Shared loopback permissions change "
+             "requested");
 
-	if(mVolumeControl.IsActive())
-	{
-		theAnswer++;
-	}
+    mPendingSharedLoopbackWorldReadable = inWorldReadable;
 
-	if(mMuteControl.IsActive())
-	{
-		theAnswer++;
-	}
+    AudioObjectID theDeviceObjectID = GetObjectID();
+    UInt64 action = static_cast<UInt64>(ChangeAction::SetSharedLoopbackWorldReadable);
 
-    return theAnswer;
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        RDC_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, action, nullptr);
+    });
 }
 
-void    RDC_Device::SetEnabledControls(bool inVolumeEnabled, bool inMuteEnabled)
+void    RDC_Device::SetSharedLoopbackWorldReadable(bool inWorldReadable)
 {
     CAMutex::Locker theStateLocker(mStateMutex);
 
-    if(mVolumeControl.IsActive() != inVolumeEnabled)
-    {
-        DebugMsg("RDC_Device::SetEnabledControls: %s the volume control",
-                 inVolumeEnabled ? "Enabling" : "Disabling");
-
-        if(inVolumeEnabled)
-		{
-			mVolumeControl.Activate();
-		}
-		else
-		{
-			mVolumeControl.Deactivate();
-		}
-    }
-
-    if(mMuteControl.IsActive() != inMuteEnabled)
-    {
-        DebugMsg("RDC_Device::SetEnabledControls: %s the mute control",
-                 inMuteEnabled ? "Enabling" : "Disabling");
-
-        if(inMuteEnabled)
-		{
-			mMuteControl.Activate();
-		}
-		else
-		{
-			mMuteControl.Deactivate();
-		}
-    }
+    mSharedLoopbackBuffer.SetWorldReadable(inWorldReadable,
+                                           mLoopbackSampleRate,
+                                           mChannelCount,
+                                           mLoopbackRingBufferFrameSize);
 }
 
-void RDC_Device::SetSampleRate(Float64 inSampleRate, bool force)
+CFStringRef	RDC_Device::CopyRecordingPath() const
 {
-    // We try to support any sample rate a real output device might.
-    ThrowIf(inSampleRate < 1.0,
-            CAException(kAudioDeviceUnsupportedFormatError),
-            "RDC_Device::SetSampleRate: unsupported sample rate");
+    return mRecorder.CopyPath();
+}
 
+void    RDC_Device::SetRecordingPath(CFStringRef inPath)
+{
+    // Hold the state mutex so the format can't change before the recording starts.
     CAMutex::Locker theStateLocker(mStateMutex);
 
-    Float64 theCurrentSampleRate = GetSampleRate();
+    mRecorder.SetPathNonRT(inPath, mLoopbackSampleRate, mChannelCount);
+}
 
-    if((inSampleRate != theCurrentSampleRate) || force)  // Check whether we need to change it.
-    {
-        DebugMsg("RDC_Device::SetSampleRate: Changing the sample rate from %f to %f",
-                 theCurrentSampleRate,
-                 inSampleRate);
+void    RDC_Device::SendRecordingStoppedNotification() const
+{
+    AudioObjectID theDeviceObjectID = GetObjectID();
 
-        // Update the sample rate on the wrapped device if we have one.
-        if(mWrappedAudioEngine != nullptr)
-        {
-            kern_return_t theError = _HW_SetSampleRate(inSampleRate);
-            ThrowIfKernelError(theError,
-                               CAException(kAudioHardwareUnspecifiedError),
-                               "RDC_Device::SetSampleRate: Error setting the sample rate on the "
-                               "wrapped audio device.");
-        }
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        AudioObjectPropertyAddress theChangedProperties[] = { kRDCRecordingPathAddress };
+        RDC_PlugIn::Host_PropertiesChanged(theDeviceObjectID, 1, theChangedProperties);
+    });
+}
 
-        // Update the sample rate for loopback.
-        mLoopbackSampleRate = inSampleRate;
-        InitLoopback();
+void    RDC_Device::InitLoopbackClock()
+{
+    // Calculate the number of host clock ticks per frame for our loopback clock.
+    mLoopbackTime.clock.SetSampleRate(mLoopbackSampleRate);
+}
 
-        // Update the streams.
-        mInputStream.SetSampleRate(inSampleRate);
-        mOutputStream.SetSampleRate(inSampleRate);
-    }
-    else
-    {
-        DebugMsg("RDC_Device::SetSampleRate: The sample rate is already set to %f", inSampleRate);
-    }
+void    RDC_Device::RestartLoopbackClock()
+{
+    mLoopbackTime.numberTimeStamps = 0;
+    mLoopbackTime.clock.SetAnchor(0, CAHostTimeBase::GetTheCurrentTime());
+    mLoopbackTime.lastSampleTime = 0;
+    mLoopbackTime.lastHostTime = mLoopbackTime.clock.GetAnchorHostTime();
+    // GetZeroTimeStamp ties the new timeline to the followed device's clock, if there is one, the
+    // next time it's called.
+    mLoopbackTime.isFollowing = false;
 }
 
 bool    RDC_Device::IsStreamID(AudioObjectID inObjectID) const noexcept
 {
-    return (inObjectID == mInputStream.GetObjectID()) || (inObjectID == mOutputStream.GetObjectID());
+    return (inObjectID == mInputStream.GetObjectID()) ||
+           (inObjectID == mReducedInputStream.GetObjectID()) ||
+           (inObjectID == mOutputStream.GetObjectID());
+}
+
+bool    RDC_Device::IsOwnObjectID(AudioObjectID inObjectID) const noexcept
+{
+    return (inObjectID == GetObjectID()) ||
+           IsStreamID(inObjectID) ||
+           (inObjectID == mVolumeControl.GetObjectID()) ||
+           (inObjectID == mMuteControl.GetObjectID());
 }
 
 #pragma mark Hardware Accessors
@@ -1443,8 +5639,7 @@ kern_return_t	RDC_Device::_HW_StartIO()
     }
     
     // Reset the loopback timing values
-    mLoopbackTime.numberTimeStamps = 0;
-    mLoopbackTime.anchorHostTime = CAHostTimeBase::GetTheCurrentTime();
+    RestartLoopbackClock();
 	RDCAssert(mIOMutex.IsFree(), "RDC_Device::_HW_StartIO: IO mutex taken before starting IO");
     
     return KERN_SUCCESS;
@@ -1494,7 +5689,11 @@ void	RDC_Device::AddClient(const AudioServerPlugInClientInfo* inClientInfo)
     
     CAMutex::Locker theStateLocker(mStateMutex);
 
+    OpenClientBatch();
+
     mClients.AddClient(inClientInfo);
+    mClientTaps.AddClient(inClientInfo->mClientID, inClientInfo->mBundleID);
+    mClientBuses.AddClient(inClientInfo->mClientID, inClientInfo->mBundleID);
 }
 
 void	RDC_Device::RemoveClient(const AudioServerPlugInClientInfo* inClientInfo)
@@ -1505,7 +5704,47 @@ void	RDC_Device::RemoveClient(const AudioServerPlugInClientInfo* inClientInfo)
     
     CAMutex::Locker theStateLocker(mStateMutex);
 
+    OpenClientBatch();
+
     mClients.RemoveClient(inClientInfo->mClientID);
+    mClientTaps.RemoveClient(inClientInfo->mClientID);
+    mClientBuses.RemoveClient(inClientInfo->mClientID);
+}
+
+void    RDC_Device::OpenClientBatch()
+{
+    RDCAssert(mStateMutex.IsOwnedByCurrentThread(),
+              "RDC_Device::OpenClientBatch: Called without taking the state mutex");
+
+    if(mClientBatchIsOpen)
+    {
+        return;
+    }
+
+    mClients.BeginBatch();
+    mClientBatchIsOpen = true;
+
+    AudioObjectID theDeviceObjectID = GetObjectID();
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(static_cast<UInt64>(kClientBatchWindowMilliseconds) * NSEC_PER_MSEC, ^{
+        RDC_Device* theDevice = LookUpInstance(theDeviceObjectID);
+
+        if(theDevice != nullptr)
+        {
+            CAMutex::Locker theStateLocker(theDevice->mStateMutex);
+
+            theDevice->mClientBatchIsOpen = false;
+
+            try
+            {
+                theDevice->mClients.EndBatch();
+            }
+            catch(...)
+            {
+                LogError("RDC_Device::OpenClientBatch: Failed to end the batch");
+            }
+        }
+    });
 }
 
 void	RDC_Device::PerformConfigChange(UInt64 inChangeAction, void* inChangeInfo)
@@ -1526,6 +5765,64 @@ void	RDC_Device::PerformConfigChange(UInt64 inChangeAction, void* inChangeInfo)
             SetEnabledControls(mPendingOutputVolumeControlEnabled,
                                mPendingOutputMuteControlEnabled);
             break;
+
+        case ChangeAction::SetChannelCount:
+            SetChannelCount(mPendingChannelCount);
+            break;
+
+        case ChangeAction::SetLoopbackBufferFrameSize:
+            SetLoopbackBufferFrameSize(mPendingLoopbackRingBufferFrameSize);
+            break;
+
+        case ChangeAction::SetLoopbackBufferMilliseconds:
+            SetLoopbackBufferMilliseconds(mPendingLoopbackBufferMilliseconds);
+            break;
+
+        case ChangeAction::SetZeroTimeStampPeriod:
+            SetZeroTimeStampPeriod(mPendingZeroTimeStampPeriod);
+            break;
+
+        case ChangeAction::SetTappedBundleIDs:
+            SetTappedBundleIDs(mPendingTappedBundleIDs);
+            SaveClientSettingsSoon();
+            break;
+
+        case ChangeAction::SetSharedLoopbackName:
+            SetSharedLoopbackName(mPendingSharedLoopbackName.GetCFString());
+            break;
+
+        case ChangeAction::SetSharedLoopbackWorldReadable:
+            SetSharedLoopbackWorldReadable(mPendingSharedLoopbackWorldReadable);
+            break;
+
+        case ChangeAction::SetSampleFormat:
+            SetSampleFormat(mPendingSampleFormat);
+            break;
+
+        case ChangeAction::SetLoopbackStorageFormat:
+            SetLoopbackStorageFormat(mPendingLoopbackStorageFormat);
+            break;
+
+        case ChangeAction::SetLoopbackStoragePlanar:
+            SetLoopbackStoragePlanar(mPendingLoopbackStoragePlanar);
+            break;
+
+        case ChangeAction::SetBusBundleIDs:
+            SetBusBundleIDs(mPendingBusBundleIDs);
+            SaveClientSettingsSoon();
+            break;
+
+        case ChangeAction::SetReadDelayHeadroom:
+            SetReadDelayHeadroom(mPendingReadDelayHeadroomFrames);
+            break;
+
+        case ChangeAction::SetAvailableSampleRates:
+            SetAvailableSampleRates(mPendingAvailableSampleRates, mPendingNumberOfAvailableSampleRates);
+            break;
+
+        case ChangeAction::SetReducedInputChannels:
+            SetReducedInputChannels(mPendingReducedInputChannels, mPendingNumberOfReducedInputChannels);
+            break;
     }
 }
 
@@ -1537,8 +5834,58 @@ void	RDC_Device::AbortConfigChange(UInt64 inChangeAction, void* inChangeInfo)
 }
 
 
-void    RDC_Device::ApplyVolume(UInt32 inClientID, UInt32 inIOBufferFrameSize, void* ioBuffer) const
+void    RDC_Device::ApplyClientRelativeVolume(UInt32 inClientID,
+                                              UInt32 inIOBufferFrameSize,
+                                              void* ioBuffer) const
 {
-    mVolumeControl.ApplyVolumeToAudioRT(reinterpret_cast<Float32*>(ioBuffer),
-                                        inIOBufferFrameSize);
+    Float32 theRelativeVolume = 1.0f;
+    SInt32 thePanPositionRaw = kRDCAppPanCenterRawValue;
+
+    if(!mClients.GetClientRelativeVolumeAndPanRT(inClientID, theRelativeVolume, thePanPositionRaw))
+    {
+        // The client has been removed since the HAL started this cycle.
+        return;
+    }
+
+    Float32* theBuffer = reinterpret_cast<Float32*>(ioBuffer);
+
+    // Panning only makes sense for stereo.
+    if((mChannelCount == 2) && (thePanPositionRaw != kRDCAppPanCenterRawValue))
+    {
+        Float32 thePanPosition = static_cast<Float32>(thePanPositionRaw) /
+                static_cast<Float32>(kRDCAppPanRightRawValue);
+
+        // Pan with crossfeed, so panning fully to one side moves all of the other channel into it,
+        // and fold the gain into the same matrix so both are applied in one pass:
+        //
+        //     L' = theLL * L + theRL * R
+        //     R' = theLR * L + theRR * R
+        Float32 theRightwards = std::max(thePanPosition, 0.0f);
+        Float32 theLeftwards = std::max(-thePanPosition, 0.0f);
+
+        const Float32 theLL = theRelativeVolume * (1.0f - theRightwards);
+        const Float32 theRL = theRelativeVolume * theLeftwards;
+        const Float32 theLR = theRelativeVolume * theRightwards;
+        const Float32 theRR = theRelativeVolume * (1.0f - theLeftwards);
+
+        // The loop has no dependencies between frames, so the compiler vectorises it, loading and
+        // deinterleaving several frames at a time.
+        for(UInt32 i = 0; i < inIOBufferFrameSize; i++)
+        {
+            Float32 theLeft = theBuffer[2 * i];
+            Float32 theRight = theBuffer[2 * i + 1];
+
+            theBuffer[2 * i] = theLL * theLeft + theRL * theRight;
+            theBuffer[2 * i + 1] = theLR * theLeft + theRR * theRight;
+        }
+    }
+    else if(theRelativeVolume != 1.0f)
+    {
+        vDSP_vsmul(theBuffer,
+                   1,
+                   &theRelativeVolume,
+                   theBuffer,
+                   1,
+                   inIOBufferFrameSize * mChannelCount);
+    }
 }
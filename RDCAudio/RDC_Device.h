@@ -34,7 +34,18 @@
 // Local Includes
 #include "RDC_Types.h"
 #include "RDC_WrappedAudioEngine.h"
+#include "RDC_LoopbackClock.h"
 #include "RDC_Clients.h"
+#include "RDC_ClientTaps.h"
+#include "RDC_ClientBuses.h"
+#include "RDC_SharedLoopbackBuffer.h"
+#include "RDC_Recorder.h"
+#include "RDC_RetroBuffer.h"
+#include "RDC_RTPSender.h"
+#include "RDC_LevelMeter.h"
+#include "RDC_DriftCompensator.h"
+#include "RDC_IOTrace.h"
+#include "RDC_LoopbackTimeStamps.h"
 #include "RDC_TaskQueue.h"
 #include "RDC_Stream.h"
 #include "RDC_VolumeControl.h"
@@ -45,6 +56,11 @@
 #include "CAVolumeCurve.h"
 #include "CARingBuffer.h"
 
+// STL Includes
+#include <atomic>
+#include <map>
+#include <vector>
+
 // System Includes
 #include <CoreFoundation/CoreFoundation.h>
 #include <pthread.h>
@@ -58,10 +74,48 @@ class RDC_Device
 #pragma mark Construction/Destruction
     
 public:
+    /*! @return The main instance, which always has the fixed object IDs in RDC_Types.h. */
     static RDC_Device&			GetInstance();
+    /*!
+     @return The number of RDC_Device instances the driver publishes. Starts at the value from the
+             driver's config and only changes with SetNumberOfInstances. See kRDCDeviceCountInfoKey.
+     */
+    static UInt32               GetNumberOfInstances();
+    /*!
+     Publish inNumberOfInstances instances, creating any that haven't been created yet. Instances past
+     the new count are hidden but never destroyed, so they can be republished as they were. An
+     instance can't be hidden while clients are doing IO with it, and a hidden instance refuses to
+     start IO. The caller has to notify the host that the plug-in's device list changed and must
+     serialise calls.
+
+     @throws CAException If inNumberOfInstances isn't in [1, kRDCMaxDeviceCount], an instance that
+                         would be hidden is doing IO or an instance couldn't be created. The
+                         instances are left as they were in each case.
+     */
+    static void                 SetNumberOfInstances(UInt32 inNumberOfInstances);
+    /*! @return The instance at inIndex, which must be less than GetNumberOfInstances(). */
+    static RDC_Device&          GetInstanceAtIndex(UInt32 inIndex);
+    /*! @return The instance with the object ID inDeviceID, or null if there isn't one. */
+    static RDC_Device* __nullable LookUpInstance(AudioObjectID inDeviceID);
+    /*!
+     @return The instance that either has the object ID inObjectID or owns the audio object (e.g. a
+             stream or control) with that ID. Null if there isn't one.
+     */
+    static RDC_Device* __nullable LookUpOwnerOfObject(AudioObjectID inObjectID);
+    /*! @return The instance with the UID inDeviceUID, or null if there isn't one. */
+    static RDC_Device* __nullable LookUpInstanceByUID(CFStringRef __nonnull inDeviceUID);
+    /*! @return This instance's index, for GetInstanceAtIndex. The main instance's is 0. */
+    UInt32                      GetInstanceIndex() const { return mInstanceIndex; }
     
 private:
     static void					StaticInitializer();
+    // Create and activate the instance for inIndex, without adding it to sInstances. Returns null if
+    // it couldn't be created.
+    static RDC_Device* __nullable CreateAndActivateInstance(UInt32 inIndex);
+    static RDC_Device* __nonnull CreateInstance(UInt32 inIndex);
+    // Add an instance from CreateAndActivateInstance to sInstances and sOwnersByObjectID, after the
+    // last one created. It isn't published until sNumberOfInstances is raised to include it.
+    static void                 AddCreatedInstance(RDC_Device* __nonnull inDevice);
 
 protected:
                                 RDC_Device(AudioObjectID inObjectID,
@@ -69,6 +123,7 @@ protected:
                                            const CFStringRef __nonnull inDeviceUID,
 										   const CFStringRef __nonnull inDeviceModelUID,
                                            AudioObjectID inInputStreamID,
+                                           AudioObjectID inReducedInputStreamID,
                                            AudioObjectID inOutputStreamID,
                                            AudioObjectID inOutputVolumeControlID,
 										   AudioObjectID inOutputMuteControlID);
@@ -78,7 +133,20 @@ protected:
     virtual void				Deactivate();
     
 private:
+    // Set up the loopback clock and reallocate the loopback buffer, if it's allocated, for the
+    // current format. Must be called with the state mutex held while IO is stopped.
     void                        InitLoopback();
+    // Allocate the loopback buffer and the buffers the IO functions use with it.
+    void                        AllocateLoopback();
+    // Free them until IO starts again. See kAudioDeviceCustomPropertyLoopbackIdleTimeout.
+    void                        ReleaseLoopback();
+    // Call ReleaseLoopback after the idle timeout, unless IO starts or this is called again first.
+    // The state mutex must be held.
+    void                        ScheduleLoopbackRelease();
+    void                        InitLoopbackClock();
+    // Restart the loopback clock's timeline at sample time 0 now. Must be called with the IO mutex
+    // held, or before IO starts.
+    void                        RestartLoopbackClock();
 	
 #pragma mark Property Operations
     
@@ -98,6 +166,23 @@ private:
 	void						Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* __nullable inQualifierData, UInt32 inDataSize, UInt32& outDataSize, void* __nonnull outData) const;
 	void						Device_SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* __nullable inQualifierData, UInt32 inDataSize, const void* __nonnull inData);
 
+    // Describes one of the device's custom properties, so the property functions can handle them all
+    // with one lookup instead of a case each. Setting them still goes through Device_SetPropertyData's
+    // switch, since each one validates its value differently.
+    struct RDC_CustomProperty
+    {
+        AudioObjectPropertySelector mSelector;
+        bool                        mIsSettable;
+        // Returns the property's value. The caller is responsible for releasing it.
+        CFPropertyListRef __nonnull (* __nonnull mCopyValue)(const RDC_Device& inDevice);
+    };
+    
+    static const RDC_CustomProperty sCustomProperties[];
+    static const UInt32         kNumberOfCustomProperties;
+    
+    /*! @return The description of the custom property, or null if the device has no custom property with that selector. */
+    static const RDC_CustomProperty* __nullable FindCustomProperty(AudioObjectPropertySelector inSelector);
+
 #pragma mark IO Operations
     
 public:
@@ -112,8 +197,62 @@ public:
 	void						EndIOOperation(UInt32 inOperationID, UInt32 inIOBufferFrameSize, const AudioServerPlugInIOCycleInfo& inIOCycleInfo, UInt32 inClientID);
 
 private:
-	void						ReadInputData(UInt32 inIOBufferFrameSize, Float64 inSampleTime, void* __nonnull outBuffer);
+	void						ReadInputData(UInt32 inClientID, UInt32 inIOBufferFrameSize, Float64 inSampleTime, UInt64 inHostTime, void* __nonnull outBuffer);
+    // Read the frames for ReadInputData. Returns false if they couldn't be read, even after
+    // retrying, in which case ReadInputData conceals the gap. The reduced input stream passes false
+    // for inAllowDriftCompensation, since the compensator follows the main stream's reads.
+    bool						FetchInputData(UInt32 inClientID, UInt32 inIOBufferFrameSize, Float64 inSampleTime, void* __nonnull outBuffer, bool inAllowDriftCompensation = true);
+    // Like ReadInputData, but for the reduced input stream. Failed reads are silent rather than
+    // concealed. See kAudioDeviceCustomPropertyReducedInputChannels.
+    void						ReadReducedInputData(UInt32 inClientID, UInt32 inIOBufferFrameSize, Float64 inSampleTime, UInt64 inHostTime, void* __nonnull outBuffer);
+    // Downmix interleaved Float32 frames for the reduced input stream straight from the ring
+    // buffer's memory into outBuffer, like ConvertLoopbackDataInPlace.
+    bool						ReduceLoopbackDataInPlace(CARingBuffer& inRingBuffer, Float32* __nonnull outBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inStartTime, bool& outSucceeded);
+    // The ring buffer the input streams read, for the current tap and bus settings, and its format.
+    // Only the mix can be planar.
+    CARingBuffer&				GetInputRingBufferRT(RDC_SampleFormat& outFormat, bool& outIsPlanar);
+    // How many frames behind the HAL's sample time the client reads, clamped to what the buffer
+    // has room for. See kAudioDeviceCustomPropertyReadDelays.
+    UInt32						GetReadDelayRT(UInt32 inClientID) const;
+    // Return the index in mReadConcealments of the client's concealment state, which is reset if
+    // it last belonged to another client.
+    UInt32						GetReadConcealmentRT(UInt32 inClientID);
+    // Fill a block that couldn't be read with silence, faded into from the last frame read if the
+    // block follows straight on from it.
+    void						ConcealFailedRead(UInt32 inConcealment, void* __nonnull outBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inStartTime);
+    // Fade in the start of the first block read after ConcealFailedRead.
+    void						FadeInAfterConcealment(void* __nonnull ioBuffer, UInt32 inFrameSize);
+    // Keep the last frame of a block that was read, for ConcealFailedRead.
+    void						RememberLastReadFrame(UInt32 inConcealment, const void* __nonnull inBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inStartTime);
     void						WriteOutputData(UInt32 inIOBufferFrameSize, Float64 inSampleTime, const void* __nonnull inBuffer);
+    // Fetch from/store to a ring buffer without converting the samples, and handle the errors.
+    // FetchLoopbackData returns false, after writing silence, if the frames couldn't be read
+    // consistently even after retrying.
+    bool						FetchLoopbackData(CARingBuffer& inRingBuffer, RDC_SampleFormat inRingFormat, void* __nonnull outBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inStartTime);
+    // Fetch from the loopback buffer when it's planar, interleaving the frames into outBuffer.
+    CARingBufferError			FetchPlanarLoopbackData(void* __nonnull outBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inStartTime);
+    // Convert interleaved frames from the ring buffer's format to the streams' straight from the
+    // ring buffer's memory into outBuffer, and handle the errors. Returns false if the frames have
+    // to be fetched instead. Otherwise, sets outSucceeded to false, after writing silence, if they
+    // couldn't be read consistently even after retrying.
+    bool						ConvertLoopbackDataInPlace(CARingBuffer& inRingBuffer, RDC_SampleFormat inRingFormat, void* __nonnull outBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inStartTime, bool& outSucceeded);
+    void						StoreLoopbackData(const void* __nonnull inBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime);
+    // Store Float32 frames in the loopback buffer's storage format, converting them straight into
+    // the buffer unless it's planar.
+    void						StoreConvertedLoopbackData(const Float32* __nonnull inBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime);
+    // Store Float32 frames, applying a gain ramp as they're copied into the ring buffer. See
+    // RDC_VolumeControl::GetGainRampRT.
+    void						StoreLoopbackDataWithGain(const Float32* __nonnull inBuffer, UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime, Float32 inStartGain, Float32 inGainStep);
+    // Mark frames silent in the loopback buffer without copying anything into it.
+    void						StoreLoopbackSilence(UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime);
+    // True if an input client, the RTP sender or another instance's input is reading the loopback
+    // buffer. If not, WriteOutputData skips copying the mix into it.
+    bool						LoopbackBufferHasReadersRT() const;
+    // Move the loopback buffer's time bounds on for frames nothing will read. A reader that starts
+    // later reads silence until it reaches frames that were stored.
+    void						SkipLoopbackStore(UInt32 inFrameSize, CARingBuffer::SampleTime inSampleTime);
+    void						HandleLoopbackStoreResult(CARingBufferError inError, UInt32 inGapFrames);
+    void						TapClientOutputData(UInt32 inClientID, UInt32 inIOBufferFrameSize, Float64 inSampleTime, const void* __nonnull inBuffer);
 
 #pragma mark Accessors
 
@@ -129,6 +268,290 @@ public:
     Float64						GetSampleRate() const;
     void                        RequestSampleRate(Float64 inRequestedSampleRate);
 
+    /*! @return The number of interleaved channels in each of the device's streams. */
+    UInt32                      GetChannelCount() const;
+    /*!
+     Change the number of channels in the device's streams and loopback buffer. Async for the same
+     reason as RequestSampleRate.
+
+     @throws CAException if inRequestedChannelCount is 0 or greater than kRDCMaxChannelCount.
+     */
+    void                        RequestChannelCount(UInt32 inRequestedChannelCount);
+
+    /*!
+     Copy the nominal sample rates the device advertises into outRates.
+
+     @return The number of rates copied, in [1, kRDCMaxAvailableSampleRates].
+     */
+    UInt32                      GetAvailableSampleRates(Float64 outRates[__nonnull kRDCMaxAvailableSampleRates]) const;
+    /*!
+     Change the nominal sample rates the device advertises. Async for the same reason as
+     RequestSampleRate. If the current sample rate isn't one of them, the device changes to the
+     nearest one at the same time. See kRDCConfigurationKey_SampleRates.
+
+     @throws CAException if inNumberOfRates isn't in [1, kRDCMaxAvailableSampleRates] or a rate is
+                         less than 1.
+     */
+    void                        RequestAvailableSampleRates(const Float64* __nonnull inRates,
+                                                            UInt32 inNumberOfRates);
+
+    /*! @return The capacity of the loopback ring buffer in frames. */
+    UInt32                      GetLoopbackBufferFrameSize() const;
+    /*!
+     Change the capacity of the loopback ring buffer. Async because the buffer can only be
+     reallocated while the host has IO stopped.
+
+     @param inRequestedFrameSize The new capacity. Clamped to [kRDCMinLoopbackBufferFrameSize,
+                                 kRDCMaxLoopbackBufferFrameSize] and rounded up to a power of two.
+     */
+    void                        RequestLoopbackBufferFrameSize(UInt32 inRequestedFrameSize);
+
+    /*!
+     @return The capacity of the loopback ring buffer in milliseconds, or 0 if it was fixed in frames
+             by RequestLoopbackBufferFrameSize.
+     */
+    UInt32                      GetLoopbackBufferMilliseconds() const;
+    /*!
+     Size the loopback ring buffer by duration, so its capacity in frames follows the sample rate.
+     Async for the same reason as RequestLoopbackBufferFrameSize.
+
+     @param inRequestedMilliseconds The new capacity. Clamped to [kRDCMinLoopbackBufferMilliseconds,
+                                    kRDCMaxLoopbackBufferMilliseconds].
+     */
+    void                        RequestLoopbackBufferMilliseconds(UInt32 inRequestedMilliseconds);
+
+    /*! @return The number of frames between the zero timestamps returned by GetZeroTimeStamp. */
+    UInt32                      GetZeroTimeStampPeriod() const;
+    /*!
+     Change the zero timestamp period. Async for the same reason as RequestSampleRate.
+
+     @param inRequestedPeriod The new period in frames. Clamped to [kRDCMinZeroTimeStampPeriod,
+                              kRDCMaxZeroTimeStampPeriod].
+     */
+    void                        RequestZeroTimeStampPeriod(UInt32 inRequestedPeriod);
+
+    /*!
+     @return A new CFArray of the bundle IDs whose output is being captured separately. The caller
+             is responsible for releasing it. See kAudioDeviceCustomPropertyTappedBundleIDs.
+     */
+    CFArrayRef __nonnull        CopyTappedBundleIDs() const;
+    /*!
+     Change the bundle IDs whose output is captured separately. Async because the taps' ring
+     buffers can only be allocated while the host has IO stopped.
+
+     @throws CAException if the array has more than kRDCMaxClientTaps elements or any of them
+             isn't a CFString.
+     */
+    void                        RequestTappedBundleIDs(CFArrayRef __nonnull inBundleIDs);
+
+    /*!
+     @return The bundle ID of the tap the input stream reads from, or the empty string if it reads
+             the mix. The caller is responsible for releasing it.
+     */
+    CFStringRef __nonnull       CopyInputTapBundleID() const;
+    /*!
+     Make the input stream read from the tap for inBundleID, or from the mix if inBundleID is the
+     empty string. Takes effect immediately.
+
+     @throws CAException if inBundleID isn't empty and isn't one of the tapped bundle IDs.
+     */
+    void                        SetInputTapBundleID(CFStringRef __nonnull inBundleID);
+
+    /*!
+     @return A new CFArray of the bundle IDs routed to each stereo bus of the input stream. The
+             caller is responsible for releasing it. See kAudioDeviceCustomPropertyBusBundleIDs.
+     */
+    CFArrayRef __nonnull        CopyBusBundleIDs() const;
+    /*!
+     Change the bundle IDs routed to the input stream's buses. Async because the buses' buffers can
+     only be allocated while the host has IO stopped.
+
+     @throws CAException if the array has more than kRDCMaxClientBuses elements, needs more
+             channels than the device has or any of its elements isn't a CFString.
+     */
+    void                        RequestBusBundleIDs(CFArrayRef __nonnull inBundleIDs);
+
+    /*!
+     @return The name of the shared memory region the loopback audio is exported through, or the
+             empty string if it isn't being exported. The caller is responsible for releasing it.
+             See kAudioDeviceCustomPropertySharedLoopbackName.
+     */
+    CFStringRef __nonnull       CopySharedLoopbackName() const;
+    /*!
+     Start exporting the loopback audio through the shared memory region inName, or stop if inName
+     is the empty string. Async because the region can only be created while the host has IO
+     stopped.
+
+     @throws CAException if inName isn't empty and doesn't start with a slash or is longer than
+             kRDCSharedLoopbackMaxNameLength bytes.
+     */
+    void                        RequestSharedLoopbackName(CFStringRef __nonnull inName);
+
+    /*! @return See kAudioDeviceCustomPropertySharedLoopbackWorldReadable. */
+    bool                        IsSharedLoopbackWorldReadable() const;
+    /*!
+     Set whether the shared memory region is readable by every user. Async because the region has
+     to be recreated, which can only be done while the host has IO stopped.
+     */
+    void                        RequestSharedLoopbackWorldReadable(bool inWorldReadable);
+
+    /*!
+     @return The path of the file the loopback audio is being recorded to, or the empty string. The
+             caller is responsible for releasing it. See kAudioDeviceCustomPropertyRecordingPath.
+     */
+    CFStringRef __nonnull       CopyRecordingPath() const;
+    /*!
+     Start recording the loopback audio to a new file at inPath, or stop if inPath is the empty
+     string. Takes effect immediately, even while IO is running.
+
+     @throws CAException if the file couldn't be created.
+     */
+    void                        SetRecordingPath(CFStringRef __nonnull inPath);
+
+    /*!
+     @return A new CFDictionary with the UID of the device the loopback clock follows and its
+             measured sample rate. The caller is responsible for releasing it. See
+             kAudioDeviceCustomPropertyClockSource.
+     */
+    CFDictionaryRef __nonnull   CopyClockSource() const;
+    /*!
+     Choose the device the loopback clock follows and/or pass in one of its zero timestamps. Takes
+     effect immediately. GetZeroTimeStamp moves between clocks without jumping.
+
+     @param inClockSource A CFDictionary with the kRDCClockSourceKey_* keys.
+     @throws CAException if inClockSource is missing the device UID or has an invalid timestamp.
+     */
+    void                        SetClockSource(CFDictionaryRef __nonnull inClockSource);
+
+    /*!
+     @return The latency to report for the input or output scope, in frames. Unless it's been
+             overridden, the output latency is the followed device's (see kRDCClockSourceKey_Latency)
+             and the input latency is 0, since the input stream reads the frames that were written
+             for the same sample times.
+     */
+    UInt32                      GetLatency(bool inIsInput) const;
+    /*!
+     @return The safety offset to report for the input or output scope, in frames. Unless it's been
+             overridden, the input safety offset is how far past the requested frames drift
+             compensation can read, if it's enabled, and the output safety offset is 0, since
+             output is stored as soon as it's written. Clamped so the reader can't fall off the
+             back of the loopback buffer.
+     */
+    UInt32                      GetSafetyOffset(bool inIsInput) const;
+    /*!
+     @return The range of IO buffer sizes the HAL can use with the device, in frames. See
+             kRDCMinIOBufferFrameSize.
+     */
+    AudioValueRange             GetIOBufferFrameSizeRange() const;
+
+    /*!
+     @return A new CFDictionary with the overridden latencies and safety offsets. The caller is
+             responsible for releasing it. See kAudioDeviceCustomPropertyLatencyOverrides.
+     */
+    CFDictionaryRef __nonnull   CopyLatencyOverrides() const;
+    /*!
+     Replace the overridden latencies and safety offsets. Takes effect immediately.
+
+     @param inOverrides A CFDictionary with any of the kRDCLatencyOverridesKey_* keys.
+     @throws CAException if one of the values isn't a CFNumber or is negative.
+     */
+    void                        SetLatencyOverrides(CFDictionaryRef __nonnull inOverrides);
+
+    /*!
+     Change the sample format of the device's streams. Async for the same reason as
+     RequestSampleRate.
+     */
+    void                        RequestSampleFormat(RDC_SampleFormat inRequestedFormat);
+
+    /*! @return The bits per sample of the loopback buffer's storage format. */
+    UInt32                      GetLoopbackStorageBitDepth() const;
+    /*!
+     Change the format the loopback buffer stores samples in. Async because the buffer has to be
+     reallocated. See kAudioDeviceCustomPropertyLoopbackStorageBitDepth.
+
+     @throws CAException if inRequestedBitDepth isn't 32, 24 or 16.
+     */
+    void                        RequestLoopbackStorageBitDepth(UInt32 inRequestedBitDepth);
+
+    /*! @return True if the loopback buffer stores each channel separately. */
+    bool                        IsLoopbackStoragePlanar() const;
+    /*!
+     Change whether the loopback buffer stores each channel separately. Async because the buffer
+     has to be reallocated. See kAudioDeviceCustomPropertyLoopbackStoragePlanar.
+     */
+    void                        RequestLoopbackStoragePlanar(bool inPlanar);
+
+    /*!
+     @return A new CFDictionary of the read delays, in the format of
+             kAudioDeviceCustomPropertyReadDelays. The caller is responsible for releasing it.
+     */
+    CFDictionaryRef __nonnull   CopyReadDelays() const;
+    /*!
+     Replace the read delays. Apps that aren't in inReadDelays stop being delayed. If the largest
+     delay changes, this asks the host to stop IO so the loopback buffer can be resized.
+
+     @throws CAException if a key isn't a bundle ID or a value isn't a number of frames in
+                         [0, kRDCMaxReadDelayFrames]. Nothing is changed.
+     */
+    void                        SetReadDelays(CFDictionaryRef __nonnull inReadDelays);
+
+    /*! @return True if the loopback buffer's pages are locked in memory. */
+    bool                        IsLoopbackBufferWired() const;
+    /*!
+     Lock or unlock the loopback buffer's pages. See kAudioDeviceCustomPropertyLoopbackBufferWired.
+
+     @throws CAException if the pages couldn't be locked or unlocked.
+     */
+    void                        SetLoopbackBufferWired(bool inWired);
+
+    /*! @return See kAudioDeviceCustomPropertyLoopbackIdleTimeout. */
+    UInt32                      GetLoopbackIdleTimeout() const;
+    /*!
+     Set how many seconds after IO stops the loopback buffer is freed. 0 keeps it. If IO is already
+     stopped, the countdown restarts with the new timeout.
+     */
+    void                        SetLoopbackIdleTimeout(UInt32 inSeconds);
+
+    /*! @return See kAudioDeviceCustomPropertyRetroCaptureSeconds. */
+    UInt32                      GetRetroCaptureSeconds() const;
+    /*!
+     Set how many seconds of the loopback audio to keep for saving later, emptying the window. 0
+     frees it. Takes effect immediately, even while IO is running.
+
+     @throws CAException if the window couldn't be allocated.
+     */
+    void                        SetRetroCaptureSeconds(UInt32 inSeconds);
+    /*!
+     @return The path the retroactive capture window was last saved to, or the empty string. The
+             caller is responsible for releasing it.
+     */
+    CFStringRef __nonnull       CopyRetroCaptureSavePath() const;
+    /*!
+     Write the retroactive capture window, or its last GetRetroCaptureSaveSeconds seconds, to a new
+     CAF file at inPath.
+
+     @throws CAException if the window is disabled or the file couldn't be written.
+     */
+    void                        SaveRetroCapture(CFStringRef __nonnull inPath);
+    /*! @return See kAudioDeviceCustomPropertyRetroCaptureSaveSeconds. */
+    UInt32                      GetRetroCaptureSaveSeconds() const;
+    void                        SetRetroCaptureSaveSeconds(UInt32 inSeconds);
+
+    /*!
+     @return A new CFArray of the reduced input stream's channels, in the format of
+             kAudioDeviceCustomPropertyReducedInputChannels. The caller is responsible for
+             releasing it.
+     */
+    CFArrayRef __nonnull        CopyReducedInputChannels() const;
+    /*!
+     Add, change or remove the reduced input stream. Async because the stream list and the
+     stream's format can only change while the host has IO stopped.
+
+     @throws CAException if inChannels has more than kRDCMaxChannelCount elements or one of them
+                         isn't a channel number or kRDCReducedInputChannel_Mix.
+     */
+    void                        RequestReducedInputChannels(CFArrayRef __nonnull inChannels);
+
 private:
 	/*!
      @return The Audio Object that has the ID inObjectID and belongs to this device.
@@ -146,6 +569,43 @@ private:
 	         output volume and mute controls.
 	 */
     UInt32 						GetNumberOfOutputControls() const;
+    /*! Set the latency overrides from the driver's Info.plist, if it has any. */
+    void                        LoadLatencyOverrides();
+    /*!
+     Restore the per-app settings saved by SaveClientSettings before coreaudiod last restarted. Only
+     called while the device is being created, since it sets the taps and buses directly.
+     */
+    void                        LoadClientSettings();
+    /*!
+     Schedule SaveClientSettings to be called kClientSettingsSaveDelayMilliseconds from now, unless
+     it already is, so a burst of changes is only saved once.
+     */
+    void                        SaveClientSettingsSoon();
+    /*! Save the apps' relative volumes, pan positions, taps and buses with RDC_ClientSettingsCache. */
+    void                        SaveClientSettings();
+    /*! Tell the host the latencies and safety offsets might have changed. */
+    void                        SendLatencyNotifications(bool inOverridesChanged) const;
+
+    /*!
+     Copy the IDs of the published input streams into outIDs, the main one first, without taking
+     the state mutex.
+
+     @return The number of IDs copied.
+     */
+    UInt32                      GetInputStreamIDs(AudioObjectID outIDs[__nonnull 2]) const;
+    /*! Read the published enabled states of the output controls, without taking the state mutex. */
+    void                        GetEnabledOutputControls(bool& outVolumeEnabled,
+                                                         bool& outMuteEnabled) const;
+    /*!
+     @return A new CFDictionary with the current values of the loopback counters. The caller is
+             responsible for releasing it. See kAudioDeviceCustomPropertyLoopbackStats.
+     */
+    CFDictionaryRef __nonnull   CopyLoopbackStats() const;
+    /*!
+     @return A new CFArray of two CFBooleans, whether the volume and mute controls are enabled. The
+             caller is responsible for releasing it. See kAudioDeviceCustomPropertyEnabledOutputControls.
+     */
+    CFArrayRef __nonnull        CopyEnabledOutputControls() const;
     /*!
      Enable or disable the device's volume and/or mute controls.
 
@@ -154,6 +614,11 @@ private:
      RequestDeviceConfigurationChange in AudioServerPlugIn.h.
      */
     void                        SetEnabledControls(bool inVolumeEnabled, bool inMuteEnabled);
+    /*!
+     Copy the sample rate and the enabled controls to mPublishedSampleRate and
+     mPublishedEnabledOutputControls. Must be called with the state mutex held.
+     */
+    void                        PublishState();
     /*!
      Set the device's sample rate.
 
@@ -168,9 +633,135 @@ private:
              fails.
      */
     void                        SetSampleRate(Float64 inNewSampleRate, bool force = false);
+    /*!
+     Set the number of channels in the device's streams and reallocate the loopback buffer to fit.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestChannelCount and RDC_Device::PerformConfigChange.
+     */
+    void                        SetChannelCount(UInt32 inNewChannelCount);
+    /*!
+     Set the nominal sample rates the device and its streams advertise, changing the sample rate if
+     it isn't one of them.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestAvailableSampleRates.
+     */
+    void                        SetAvailableSampleRates(const Float64* __nonnull inRates,
+                                                        UInt32 inNumberOfRates);
+    /*!
+     Reallocate the loopback ring buffer with a new capacity and restart the loopback clock.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestLoopbackBufferFrameSize.
+     */
+    void                        SetLoopbackBufferFrameSize(UInt32 inNewFrameSize);
+    /*!
+     Size the loopback ring buffer by duration, reallocate it and restart the loopback clock.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestLoopbackBufferMilliseconds.
+     */
+    void                        SetLoopbackBufferMilliseconds(UInt32 inNewMilliseconds);
+    /*!
+     Recalculate mLoopbackRingBufferFrameSize for the sample rate, if the buffer is sized by
+     duration, and mZeroTimeStampPeriod, if it hasn't been set. The state mutex must be held and IO
+     must be stopped.
+
+     @return True if the ring buffer's capacity changed, in which case it needs to be reallocated.
+     */
+    bool                        UpdateLoopbackSizes();
+    /*!
+     Set the zero timestamp period and restart the loopback clock.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestZeroTimeStampPeriod.
+     */
+    void                        SetZeroTimeStampPeriod(UInt32 inNewPeriod);
+    /*!
+     Replace the tapped bundle IDs and allocate their ring buffers.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestTappedBundleIDs.
+     */
+    void                        SetTappedBundleIDs(const std::vector<CACFString>& inBundleIDs);
+    /*!
+     Replace the bundle IDs routed to the buses and allocate their buffers.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestBusBundleIDs.
+     */
+    void                        SetBusBundleIDs(const std::vector<CACFString>& inBundleIDs);
+    /*!
+     Create, replace or remove the shared memory region the loopback audio is exported through.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestSharedLoopbackName.
+     */
+    void                        SetSharedLoopbackName(CFStringRef __nonnull inName);
+    /*!
+     Recreate the shared memory region, if there is one, with or without read permission for every
+     user.
+
+     Private because this can only be called after asking the host to stop IO for the device. See
+     RDC_Device::RequestSharedLoopbackWorldReadable.
+     */
+    void                        SetSharedLoopbackWorldReadable(bool inWorldReadable);
+    // Tell the host kAudioDeviceCustomPropertyRecordingPath changed because a format change stopped
+    // the recording.
+    void                        SendRecordingStoppedNotification() const;
+    /*!
+     Set the sample format of the streams.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestSampleFormat.
+     */
+    void                        SetSampleFormat(RDC_SampleFormat inNewFormat);
+    /*!
+     Set the loopback buffer's storage format and reallocate it.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestLoopbackStorageBitDepth.
+     */
+    void                        SetLoopbackStorageFormat(RDC_SampleFormat inNewFormat);
+    /*!
+     Set whether the loopback buffer is planar and reallocate it.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestLoopbackStoragePlanar.
+     */
+    void                        SetLoopbackStoragePlanar(bool inPlanar);
+    /*!
+     Set how many frames the loopback buffer, the taps and the buses hold beyond their capacity, so
+     delayed readers can read that far behind the others, and reallocate them.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::SetReadDelays.
+     */
+    void                        SetReadDelayHeadroom(UInt32 inHeadroomFrames);
+    /*!
+     Set the reduced input stream's channels, publishing or removing it, and allocate the buffers
+     it reads through.
+
+     Private because (after initialisation) this can only be called after asking the host to stop IO
+     for the device. See RDC_Device::RequestReducedInputChannels.
+     */
+    void                        SetReducedInputChannels(const SInt32* __nonnull inChannels,
+                                                        UInt32 inNumberOfChannels);
+    // Size the buffers ReadReducedInputData fetches and converts through. Empties them if the
+    // loopback buffer isn't allocated or there's no reduced input stream.
+    void                        AllocateReducedInputBuffers();
+    /*!
+     @return The number of frames to allocate the loopback buffer, the taps and the buses with. The
+             state mutex must be held, or IO must be stopped.
+     */
+    UInt32                      GetLoopbackAllocationFrameSize() const
+                                    { return mLoopbackRingBufferFrameSize + mReadDelayHeadroomFrames; }
 
     /*! @return True if inObjectID is the ID of one of this device's streams. */
     inline bool                 IsStreamID(AudioObjectID inObjectID) const noexcept;
+    /*! @return True if inObjectID is the ID of this device or one of its streams or controls. */
+    bool                        IsOwnObjectID(AudioObjectID inObjectID) const noexcept;
 
 #pragma mark Hardware Accessors
     
@@ -189,6 +780,14 @@ public:
     CFStringRef __nonnull		CopyDeviceUID() const { return mDeviceUID; }
     void                        AddClient(const AudioServerPlugInClientInfo* __nonnull inClientInfo);
     void                        RemoveClient(const AudioServerPlugInClientInfo* __nonnull inClientInfo);
+
+private:
+    // Open a batch in mClients, if one isn't open, and schedule it to be ended
+    // kClientBatchWindowMilliseconds later, so the clients the HAL adds and removes in a burst (e.g.
+    // at login) are handed to the IO thread together. The state mutex must be held.
+    void                        OpenClientBatch();
+
+public:
     /*!
      Apply a change requested with RDC_PlugIn::Host_RequestDeviceConfigurationChange. See
      PerformDeviceConfigurationChange in AudioServerPlugIn.h.
@@ -197,58 +796,323 @@ public:
     /*! Cancel a change requested with RDC_PlugIn::Host_RequestDeviceConfigurationChange. */
 	void						AbortConfigChange(UInt64 inChangeAction, void* __nullable inChangeInfo);
 
-    void                        ApplyVolume(UInt32 inClientID, UInt32 inIOBufferFrameSize, void* __nonnull inBuffer) const;
+    // Apply the relative volume and pan position set for the client with
+    // kAudioDeviceCustomPropertyAppVolumes. The master volume is applied later, to the mix, in
+    // WriteOutputData.
+    void                        ApplyClientRelativeVolume(UInt32 inClientID, UInt32 inIOBufferFrameSize, void* __nonnull ioBuffer) const;
 
 private:
     static pthread_once_t		sStaticInitializer;
-    static RDC_Device* __nonnull    sInstance;
+    // Fixed-size so the IO functions can look instances up without allocating. Only written by
+    // AddCreatedInstance, once for each index, before the instance is published. The stores are
+    // releases and the loads acquires, so a thread that finds an instance sees it fully constructed.
+    static std::atomic<RDC_Device*> sInstances[kRDCMaxDeviceCount];
+    // The number of instances published, which can be less than the number created. Raised with a
+    // release store after the instances are added.
+    static std::atomic<UInt32>  sNumberOfInstances;
+    // Only used by threads that serialise creating instances.
+    static UInt32               sNumberOfCreatedInstances;
+    // The device, its three streams and its two controls.
+    static const UInt32         kNumberOfObjectIDsPerInstance = 6;
+    // No object ID at or above this is ever allocated.
+    static const AudioObjectID  kMaxObjectID = kObjectID_FirstDynamic + kRDCMaxDeviceCount * kNumberOfObjectIDsPerInstance;
+    // The instance that owns each object ID, or null, so lookups don't have to ask every instance.
+    // Only written by AddCreatedInstance, like sInstances. Hidden instances are still found, since
+    // their objects can be in use until the host sees that they've gone.
+    static std::atomic<RDC_Device*> sOwnersByObjectID[kMaxObjectID];
     
 	const CFStringRef __nonnull	mDeviceName;
 	const CFStringRef __nonnull mDeviceUID;
 	const CFStringRef __nonnull mDeviceModelUID;
+    // This instance's index in sInstances. Only written by CreateAndActivateInstance.
+    UInt32                      mInstanceIndex = 0;
 
 	enum
 	{
-		// The number of global/output sub-objects varies because the controls can be disabled.
-								kNumberOfInputSubObjects			= 1,
-
-								kNumberOfStreams					= 2,
-								kNumberOfInputStreams				= 1,
+		// The number of output sub-objects varies because the controls can be disabled, and the
+		// number of input streams because the reduced input stream is optional.
 								kNumberOfOutputStreams				= 1
 	};
 
-    CAMutex                     mStateMutex;
-    CAMutex						mIOMutex;
+    CAUnfairMutex               mStateMutex;
+    CAUnfairMutex				mIOMutex;
     
     const Float64               kSampleRateDefault = 44100.0;
+
+    // Copies of the state that's read far more often than it changes, so the property getters
+    // don't have to wait for the state mutex while a config change holds it. Only written with the
+    // state mutex held, by PublishState, after the state they copy has changed.
+    enum : UInt32
+    {
+                                kEnabledOutputControl_Volume = 1 << 0,
+                                kEnabledOutputControl_Mute = 1 << 1
+    };
+    std::atomic<Float64>        mPublishedSampleRate { kSampleRateDefault };
+    std::atomic<UInt32>         mPublishedEnabledOutputControls { 0 };
+    // True if the reduced input stream is in the device's stream list.
+    std::atomic<bool>           mPublishedHasReducedInputStream { false };
     // Before we can change sample rate, the host has to stop the device. The new sample rate is
     // stored here while it does.
     Float64                     mPendingSampleRate = kSampleRateDefault;
+
+    // The number of interleaved channels in the streams and the loopback buffer. Guarded by the
+    // state mutex, but only ever changed while the host has IO stopped, so the IO functions can
+    // read it without taking a lock.
+    UInt32                      mChannelCount = kRDCDefaultChannelCount;
+    UInt32                      mPendingChannelCount = kRDCDefaultChannelCount;
+    // The nominal sample rates in kAudioDevicePropertyAvailableNominalSampleRates. Guarded by the
+    // state mutex.
+    Float64                     mAvailableSampleRates[kRDCMaxAvailableSampleRates] = {};
+    UInt32                      mNumberOfAvailableSampleRates = 0;
+    Float64                     mPendingAvailableSampleRates[kRDCMaxAvailableSampleRates] = {};
+    UInt32                      mPendingNumberOfAvailableSampleRates = 0;
+    // The format of the samples in both streams, and the one mLoopbackRingBuffer stores them in.
+    // Only changed while IO is stopped, like mChannelCount. The IO functions convert between them.
+    RDC_SampleFormat            mSampleFormat = kRDCSampleFormat_Float32;
+    RDC_SampleFormat            mPendingSampleFormat = kRDCSampleFormat_Float32;
+    RDC_SampleFormat            mLoopbackStorageFormat = kRDCSampleFormat_Float32;
+    RDC_SampleFormat            mPendingLoopbackStorageFormat = kRDCSampleFormat_Float32;
+    // True if mLoopbackRingBuffer has a buffer for each channel. Only changed while IO is stopped.
+    bool                        mLoopbackStoragePlanar = false;
+    bool                        mPendingLoopbackStoragePlanar = false;
     
     RDC_WrappedAudioEngine* __nullable mWrappedAudioEngine;
+    // The device the loopback clock follows, if one has been chosen. Not the same as
+    // mWrappedAudioEngine, since it only provides the clock.
+    RDC_WrappedAudioEngine      mClockSource;
+
+    // The values set through kAudioDeviceCustomPropertyLatencyOverrides, or -1 if not overridden.
+    // Atomic so they can be replaced without taking the state mutex.
+    enum LatencyOverride : UInt32
+    {
+        kLatencyOverride_InputLatency,
+        kLatencyOverride_OutputLatency,
+        kLatencyOverride_InputSafetyOffset,
+        kLatencyOverride_OutputSafetyOffset,
+        kLatencyOverrideCount
+    };
+    std::atomic<SInt64>         mLatencyOverrides[kLatencyOverrideCount] = { { -1 }, { -1 }, { -1 }, { -1 } };
+    // The largest IO buffer size a client has used, for clamping the safety offsets.
+    std::atomic<UInt32>         mMaxIOBufferFrameSize { 0 };
+    
+    // Records the loopback audio to a file. Filled by WriteOutputData and written by the task
+    // queue's non-realtime thread, so it's declared first to outlive the queue's threads. See
+    // kAudioDeviceCustomPropertyRecordingPath.
+    RDC_Recorder                mRecorder;
+    // Keeps the last kAudioDeviceCustomPropertyRetroCaptureSeconds of the loopback audio. Filled
+    // and drained the same way as mRecorder, so it's also declared before the queue.
+    RDC_RetroBuffer             mRetroBuffer;
     
     RDC_TaskQueue               mTaskQueue;
     
     RDC_Clients                 mClients;
     
-    #define kLoopbackRingBufferFrameSize    16384
+    // The capacity of mLoopbackRingBuffer in frames, not counting mReadDelayHeadroomFrames. Always
+    // a power of two. Only changed while IO is stopped, like mChannelCount.
+    UInt32                      mLoopbackRingBufferFrameSize = kRDCLoopbackBufferFrameSizeDefault;
+    UInt32                      mPendingLoopbackRingBufferFrameSize = kRDCLoopbackBufferFrameSizeDefault;
+    // The capacity of mLoopbackRingBuffer in milliseconds, which mLoopbackRingBufferFrameSize is
+    // recalculated from when the sample rate changes. 0 if the capacity is fixed in frames. Guarded
+    // by the state mutex.
+    UInt32                      mLoopbackBufferMilliseconds = kRDCDefaultLoopbackBufferMilliseconds;
+    UInt32                      mPendingLoopbackBufferMilliseconds = kRDCDefaultLoopbackBufferMilliseconds;
+    // The largest of the read delays, which the loopback buffer is allocated with enough extra room
+    // for. A delay is clamped to this in ReadInputData until the buffer has been resized for it.
+    // Only changed while IO is stopped. See kAudioDeviceCustomPropertyReadDelays.
+    UInt32                      mReadDelayHeadroomFrames = 0;
+    // False until IO first starts, and after the loopback buffer is freed for being idle. Only
+    // changed with the state mutex held while IO is stopped.
+    bool                        mLoopbackIsAllocated = false;
+    UInt32                      mLoopbackIdleTimeoutSeconds = kRDCDefaultLoopbackIdleTimeoutSeconds;
+    // Incremented to cancel a release scheduled by ScheduleLoopbackRelease. Guarded by the state
+    // mutex.
+    UInt64                      mLoopbackIdleGeneration = 0;
+    // True while AddClient and RemoveClient are batching their changes to mClients. See
+    // OpenClientBatch. Guarded by the state mutex.
+    bool                        mClientBatchIsOpen = false;
+    // Long enough for a registration storm to fit in a few batches, short enough that a client
+    // isn't kept out of the snapshot for noticeably long. Starting IO doesn't wait for it.
+    static const UInt32         kClientBatchWindowMilliseconds = 20;
+    // True while a call to SaveClientSettings is scheduled. See SaveClientSettingsSoon.
+    std::atomic<bool>           mClientSettingsSaveIsPending { false };
+    // Long enough to cover dragging an app's volume slider, which sets the volume many times.
+    static const UInt32         kClientSettingsSaveDelayMilliseconds = 1000;
+    UInt32                      mPendingReadDelayHeadroomFrames = 0;
+    // The read delays by bundle ID, for CopyReadDelays. Guarded by the state mutex. The IO thread
+    // gets them from mClients instead.
+    std::map<CACFString, UInt32> mReadDelays;
+    // The reduced input stream's channel map, one kAudioDeviceCustomPropertyReducedInputChannels
+    // element per channel. The stream is only published while there's at least one. Only changed
+    // while IO is stopped, like mChannelCount.
+    SInt32                      mReducedInputChannels[kRDCMaxChannelCount] = {};
+    UInt32                      mNumberOfReducedInputChannels = 0;
+    SInt32                      mPendingReducedInputChannels[kRDCMaxChannelCount] = {};
+    UInt32                      mPendingNumberOfReducedInputChannels = 0;
+    // The number of frames between zero timestamps. Shorter than the ring buffer's capacity so the
+    // HAL can get clock anchors more often than once per buffer.
+    UInt32                      mZeroTimeStampPeriod = kRDCDefaultZeroTimeStampPeriod;
+    UInt32                      mPendingZeroTimeStampPeriod = kRDCDefaultZeroTimeStampPeriod;
+    // True until the period is set explicitly. Until then, UpdateLoopbackSizes keeps it at
+    // 1/kZeroTimeStampsPerLoopbackBuffer of the capacity while the buffer is sized by duration.
+    // Guarded by the state mutex.
+    bool                        mZeroTimeStampPeriodIsDerived = true;
+    static const UInt32         kZeroTimeStampsPerLoopbackBuffer = 4;
     Float64                     mLoopbackSampleRate;
     CARingBuffer                mLoopbackRingBuffer;
+    // Reads mLoopbackRingBuffer on its own thread, so it's declared after it and detached whenever
+    // the ring is reallocated or cleared. See kAudioDeviceCustomPropertyRTPSender.
+    RDC_RTPSender               mRTPSender;
+
+    // The IO functions convert samples in chunks of this many frames, so the buffers below can be
+    // allocated ahead of time. ReadInputData and WriteOutputData can run at the same time, so they
+    // each have their own. Sized by InitLoopback.
+    static const UInt32         kLoopbackConversionChunkFrameSize = 512;
+    std::vector<Float32>        mReadConversionBuffer;
+    std::vector<Float32>        mReadScratchBuffer;
+    std::vector<Byte>           mReadStorageBuffer;
+    // How many times the reads try again when the writer gets in the way before giving up.
+    static const UInt32         kLoopbackFetchAttempts = 3;
+    // The state ConcealFailedRead needs, only used by ReadInputData. The HAL calls ReadInputData
+    // once per input client each cycle, so each client has its own, indexed by its IO state slot.
+    // The last one is shared by clients without a slot. Slots are reused, so clientID is the client
+    // the state belongs to. lastEndTime is the sample time after the last block read. Sized by
+    // AllocateLoopback.
+    struct RDC_ReadConcealment
+    {
+        UInt32                      clientID     = 0;
+        CARingBuffer::SampleTime    lastEndTime  = 0;
+        bool                        hasLastFrame = false;
+        bool                        needsFadeIn  = false;
+    };
+    std::vector<RDC_ReadConcealment> mReadConcealments;
+    // The last frame of the last block read for each of mReadConcealments, in Float32.
+    std::vector<Float32>        mReadConcealmentLastFrames;
+    // The number of IO cycles since ReadInputData was last called, up to
+    // kLoopbackInputIdleCycles. Input clients read every cycle, so once it reaches the limit nothing
+    // is reading the loopback buffer through the input stream. Used by the IO threads only, but the
+    // HAL can call ReadInput and WriteMix on different ones, so it's atomic. Relaxed, since it's
+    // only a hint: a stale value just copies or skips the mix for one more cycle.
+    std::atomic<UInt32>         mCyclesSinceInputRead { 0 };
+    static const UInt32         kLoopbackInputIdleCycles = 8;
+    // ~1.5 ms at 44.1 kHz, long enough to avoid a click. At most kLoopbackConversionChunkFrameSize.
+    static const UInt32         kReadConcealmentFadeFrames = 64;
+    std::vector<Float32>        mWriteConversionBuffer;
+    std::vector<Float32>        mWriteScratchBuffer;
+    std::vector<Byte>           mWriteStorageBuffer;
+    // The channels FetchPlanarLoopbackData fetches into, one after the other, and the
+    // AudioBufferList that points to them. Empty unless the loopback buffer is planar.
+    std::vector<Byte>           mReadPlanarBuffer;
+    std::vector<Byte>           mReadPlanarBufferList;
+    // The buffers ReadReducedInputData reads through when it can't downmix in place: the full
+    // frames in the streams' format, the same frames in Float32 and the reduced frames in Float32.
+    // The second is also the scratch space for converting the last. Sized by
+    // AllocateReducedInputBuffers.
+    std::vector<Byte>           mReducedReadFetchBuffer;
+    std::vector<Float32>        mReducedReadConversionBuffer;
+    std::vector<Float32>        mReducedReadOutputBuffer;
+
+    // Adjusts the rate ReadInputData reads the loopback buffer at, if it's enabled. See
+    // kAudioDeviceCustomPropertyDriftCompensation.
+    RDC_DriftCompensator        mDriftCompensator;
+
+    // Records each call to BeginIOOperation, DoIOOperation and EndIOOperation. See
+    // kAudioDeviceCustomPropertyIOTrace.
+    RDC_IOTrace                 mIOTrace;
+
+    // The host time of each block of the mix, recorded in WriteMix. Emptied in StartIO. See
+    // kAudioDeviceCustomPropertyLoopbackTimeStamps.
+    RDC_LoopbackTimeStampTable  mLoopbackTimeStamps {};
+
+    // The per-app loopback buffers, filled in ProcessOutput. See kAudioDeviceCustomPropertyTappedBundleIDs.
+    RDC_ClientTaps              mClientTaps;
+    std::vector<CACFString>     mPendingTappedBundleIDs;
+    // The bundle ID of the tap the input stream reads, or an invalid string for the mix. Guarded by
+    // the state mutex.
+    CACFString                  mInputTapBundleID;
+    // The index in mClientTaps of the tap the input stream reads, or -1 for the mix. Read by
+    // ReadInputData, so it's atomic.
+    std::atomic<SInt32>         mInputTapIndex { -1 };
+
+    // The sub-mixes the input stream reads when they're enabled, filled in ProcessOutput and
+    // WriteMix. See kAudioDeviceCustomPropertyBusBundleIDs.
+    RDC_ClientBuses             mClientBuses;
+    std::vector<CACFString>     mPendingBusBundleIDs;
+
+    // A copy of the loopback audio in shared memory, for readers in other processes. Written by
+    // WriteOutputData. See kAudioDeviceCustomPropertySharedLoopbackName.
+    RDC_SharedLoopbackBuffer    mSharedLoopbackBuffer;
+    CACFString                  mPendingSharedLoopbackName;
+    bool                        mPendingSharedLoopbackWorldReadable = false;
+
+    // Measures the audio WriteOutputData stores. See kAudioDeviceCustomPropertyLoopbackLevels.
+    // Mutable because reading the levels resets the peaks.
+    mutable RDC_LevelMeter      mLoopbackLevelMeter;
+
+    // Counters for kAudioDeviceCustomPropertyLoopbackStats. Updated by the IO functions, so they're
+    // atomics rather than being guarded by a mutex. Relaxed ordering is fine because they're only
+    // used for reporting.
+    struct {
+        std::atomic<UInt64>     silentFetches        { 0 };
+        std::atomic<UInt64>     recoveredFetches     { 0 };
+        std::atomic<UInt64>     concealedFetches     { 0 };
+        std::atomic<UInt64>     underruns            { 0 };
+        std::atomic<UInt64>     storeErrors          { 0 };
+        std::atomic<UInt64>     gapFramesZeroFilled  { 0 };
+        std::atomic<UInt64>     maxReadWriteDistance { 0 };
+        std::atomic<UInt64>     silentFramesSkipped  { 0 };
+        std::atomic<UInt64>     unreadFramesSkipped  { 0 };
+        std::atomic<UInt64>     ioCycles             { 0 };
+        std::atomic<UInt64>     slowestIOCycleTicks  { 0 };
+        std::atomic<UInt64>     overruns             { 0 };
+        std::atomic<UInt64>     gaps                 { 0 };
+        std::atomic<SInt64>     readWriteDistance    { 0 };
+        // The host ticks spent in DoIOOperation since the last WriteMix finished.
+        std::atomic<UInt64>     currentIOCycleTicks  { 0 };
+    }                           mLoopbackStats;
 
     // TODO: a comment explaining why we need a clock for loopback-only mode
+    //
+    // Guarded by the IO mutex. The clock runs at the host clock's rate unless mClockSource is
+    // following a device, in which case it's tied to that device's timeline.
     struct {
-        Float64					hostTicksPerFrame = 0.0;
+        // Converts sample times to host times while the clock isn't following a device.
+        RDC_LoopbackClock       clock;
         UInt64					numberTimeStamps  = 0;
-        UInt64					anchorHostTime    = 0;
+        // The last zero timestamp given to the HAL. The timeline is re-anchored at it when the clock
+        // starts or stops following a device, so it doesn't jump.
+        UInt64                  lastSampleTime    = 0;
+        UInt64                  lastHostTime      = 0;
+        // Whether the timeline is tied to a followed device's clock, the epoch of the anchor it was
+        // tied to and the sample time on the followed device's clock of our sample time 0.
+        bool                    isFollowing       = false;
+        UInt64                  followedEpoch     = 0;
+        Float64                 followedStartTime = 0.0;
     }                           mLoopbackTime;
 	
     RDC_Stream                  mInputStream;
+    // Carries a subset or downmix of the input stream's channels. See
+    // kAudioDeviceCustomPropertyReducedInputChannels.
+    RDC_Stream                  mReducedInputStream;
     RDC_Stream                  mOutputStream;
 
     enum class ChangeAction : UInt64
     {
         SetSampleRate,
-        SetEnabledControls
+        SetEnabledControls,
+        SetChannelCount,
+        SetLoopbackBufferFrameSize,
+        SetZeroTimeStampPeriod,
+        SetTappedBundleIDs,
+        SetSharedLoopbackName,
+        SetSampleFormat,
+        SetLoopbackStorageFormat,
+        SetLoopbackStoragePlanar,
+        SetBusBundleIDs,
+        SetReadDelayHeadroom,
+        SetLoopbackBufferMilliseconds,
+        SetAvailableSampleRates,
+        SetReducedInputChannels,
+        SetSharedLoopbackWorldReadable
     };
 
     RDC_VolumeControl			mVolumeControl;
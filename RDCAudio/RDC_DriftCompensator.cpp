@@ -0,0 +1,242 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+//
+//  RDC_DriftCompensator.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_DriftCompensator.h"
+
+// PublicUtility Includes
+#include "CADebugMacros.h"
+
+// STL Includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// System Includes
+#include <Accelerate/Accelerate.h>
+
+
+#pragma clang assume_nonnull begin
+
+RDC_DriftCompensator::RDC_DriftCompensator()
+:
+    mKernel(kPhases * kTaps)
+{
+    static_assert(kTaps % 2 == 0, "RDC_DriftCompensator::kTaps must be even");
+
+    // Tabulate a Blackman-windowed sinc for each phase. Tap k is for the input frame
+    // k - (kTaps / 2 - 1) frames from the one before the output position.
+    const Float64 theHalfWidth = kTaps / 2;
+
+    for(UInt32 thePhase = 0; thePhase < kPhases; thePhase++)
+    {
+        Float32* theCoefficients = &mKernel[thePhase * kTaps];
+        Float64 theFraction = static_cast<Float64>(thePhase) / kPhases;
+        Float64 theSum = 0.0;
+
+        for(UInt32 theTap = 0; theTap < kTaps; theTap++)
+        {
+            Float64 x = static_cast<Float64>(theTap) - (theHalfWidth - 1.0) - theFraction;
+            Float64 theSinc = (x == 0.0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+            Float64 u = x / theHalfWidth;
+            Float64 theWindow = 0.42 + 0.5 * std::cos(M_PI * u) + 0.08 * std::cos(2.0 * M_PI * u);
+
+            theCoefficients[theTap] = static_cast<Float32>(theSinc * theWindow);
+            theSum += theCoefficients[theTap];
+        }
+
+        // Normalise for unity gain at DC.
+        for(UInt32 theTap = 0; theTap < kTaps; theTap++)
+        {
+            theCoefficients[theTap] = static_cast<Float32>(theCoefficients[theTap] / theSum);
+        }
+    }
+
+    // Make phase 0 exactly copy its frame, rather than nearly.
+    std::fill_n(mKernel.begin(), kTaps, 0.0f);
+    mKernel[kTaps / 2 - 1] = 1.0f;
+}
+
+void    RDC_DriftCompensator::Allocate(UInt32 inChannelCount)
+{
+    mChannelCount = inChannelCount;
+    mInputBuffer.assign(kMaxInputFrameSize * inChannelCount, 0.0f);
+    mIsRunning = false;
+}
+
+void    RDC_DriftCompensator::SetEnabled(bool inEnabled)
+{
+    DebugMsg("RDC_DriftCompensator::SetEnabled: %s drift compensation",
+             inEnabled ? "Enabling" : "Disabling");
+
+    // The reader restarts when it next runs, since the sample times it skipped won't follow on.
+    mEnabled.store(inEnabled, std::memory_order_relaxed);
+}
+
+SInt32  RDC_DriftCompensator::GetCorrectionPPM() const
+{
+    return static_cast<SInt32>(std::lround(mCorrection.load(std::memory_order_relaxed) * 1.0e6));
+}
+
+CARingBufferError   RDC_DriftCompensator::ReadRT(CARingBuffer& inRingBuffer,
+                                                 Float32* outFrames,
+                                                 UInt32 inFrameSize,
+                                                 CARingBuffer::SampleTime inSampleTime)
+{
+    if(!mIsRunning || inSampleTime != mNextSampleTime)
+    {
+        RestartRT(inSampleTime);
+    }
+
+    mNextSampleTime = inSampleTime + inFrameSize;
+
+    CARingBuffer::SampleTime theStartTime, theEndTime;
+    if(inRingBuffer.GetTimeBounds(theStartTime, theEndTime) == kCARingBufferError_OK)
+    {
+        UpdateCorrectionRT(static_cast<Float64>(theEndTime - mReadFrame) - mReadFraction);
+    }
+
+    CARingBufferError theError = kCARingBufferError_OK;
+
+    for(UInt32 theOffset = 0; theOffset < inFrameSize; theOffset += kChunkFrameSize)
+    {
+        UInt32 theFrames = std::min(kChunkFrameSize, inFrameSize - theOffset);
+        CARingBufferError theChunkError =
+                ResampleChunkRT(inRingBuffer, outFrames + theOffset * mChannelCount, theFrames);
+
+        if(theError == kCARingBufferError_OK)
+        {
+            theError = theChunkError;
+        }
+    }
+
+    return theError;
+}
+
+void    RDC_DriftCompensator::RestartRT(CARingBuffer::SampleTime inSampleTime)
+{
+    mIsRunning = true;
+    mReadFrame = inSampleTime;
+    mReadFraction = 0.0;
+    mReadsSinceRestart = 0;
+    mSmoothedDistance = 0.0;
+    mTargetDistance = 0.0;
+    mCorrection.store(0.0, std::memory_order_relaxed);
+}
+
+void    RDC_DriftCompensator::UpdateCorrectionRT(Float64 inDistance)
+{
+    if(mReadsSinceRestart == 0)
+    {
+        mSmoothedDistance = inDistance;
+    }
+    else
+    {
+        mSmoothedDistance += (inDistance - mSmoothedDistance) * kDistanceSmoothing;
+    }
+
+    if(mReadsSinceRestart < kWarmUpReads)
+    {
+        mReadsSinceRestart++;
+        mTargetDistance = mSmoothedDistance;
+        return;
+    }
+
+    // A positive error means the reader has fallen behind, so it should read faster.
+    Float64 theError = mSmoothedDistance - mTargetDistance;
+    Float64 theCorrection = 0.0;
+
+    if(std::fabs(theError) > kDeadbandFrames)
+    {
+        theCorrection = (theError - std::copysign(kDeadbandFrames, theError)) * kCorrectionPerFrame;
+        theCorrection = std::max(-kMaxCorrection, std::min(kMaxCorrection, theCorrection));
+    }
+
+    mCorrection.store(theCorrection, std::memory_order_relaxed);
+}
+
+CARingBufferError   RDC_DriftCompensator::ResampleChunkRT(CARingBuffer& inRingBuffer,
+                                                          Float32* outFrames,
+                                                          UInt32 inFrameSize)
+{
+    Float64 theRatio = 1.0 + mCorrection.load(std::memory_order_relaxed);
+    UInt32 theBytesPerFrame = mChannelCount * sizeof(Float32);
+
+    // Without a correction, and while the position is on a whole frame, the kernel would just copy
+    // the frames, so fetch them straight into the output instead.
+    bool theCopiesFrames = (theRatio == 1.0) && (mReadFraction == 0.0);
+
+    // The output position of the last frame, relative to mReadFrame, decides how many input frames
+    // the chunk needs.
+    Float64 theEndPosition = mReadFraction + inFrameSize * theRatio;
+    UInt32 theInputFrameSize =
+            theCopiesFrames ? inFrameSize : static_cast<UInt32>(theEndPosition) + kTaps + 1;
+    CARingBuffer::SampleTime theFirstInputFrame =
+            theCopiesFrames ? mReadFrame : mReadFrame - (kTaps / 2 - 1);
+    Float32* theInput = theCopiesFrames ? outFrames : mInputBuffer.data();
+
+    CARingBufferError theError = inRingBuffer.FetchInterleaved(theInput, theInputFrameSize, theFirstInputFrame);
+
+    if(theError != kCARingBufferError_OK)
+    {
+        memset(outFrames, 0, inFrameSize * theBytesPerFrame);
+    }
+    else if(!theCopiesFrames)
+    {
+        for(UInt32 theFrame = 0; theFrame < inFrameSize; theFrame++)
+        {
+            // Calculated from the chunk's start each time, so rounding errors don't accumulate.
+            Float64 thePosition = mReadFraction + theFrame * theRatio;
+            UInt32 theWholeFrames = static_cast<UInt32>(thePosition);
+            UInt32 thePhase = static_cast<UInt32>(std::lround((thePosition - theWholeFrames) * kPhases));
+
+            if(thePhase == kPhases)
+            {
+                theWholeFrames++;
+                thePhase = 0;
+            }
+
+            // The first tap's frame is theWholeFrames frames into the input, since the input starts
+            // kTaps / 2 - 1 frames before mReadFrame.
+            const Float32* theTapFrames = mInputBuffer.data() + theWholeFrames * mChannelCount;
+            const Float32* theCoefficients = &mKernel[thePhase * kTaps];
+            Float32* theOutputFrame = outFrames + theFrame * mChannelCount;
+
+            for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+            {
+                vDSP_dotpr(theTapFrames + theChannel,
+                           static_cast<vDSP_Stride>(mChannelCount),
+                           theCoefficients,
+                           1,
+                           theOutputFrame + theChannel,
+                           kTaps);
+            }
+        }
+    }
+
+    // Move the read position past the chunk, whether or not the fetch worked.
+    Float64 theWholeEndFrames = std::floor(theEndPosition);
+    mReadFrame += static_cast<CARingBuffer::SampleTime>(theWholeEndFrames);
+    mReadFraction = theEndPosition - theWholeEndFrames;
+
+    return theError;
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,148 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+//
+//  RDC_DriftCompensator.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_DriftCompensator__
+#define __RDCDriver__RDC_DriftCompensator__
+
+// PublicUtility Includes
+#include "CARingBuffer.h"
+
+// STL Includes
+#include <atomic>
+#include <vector>
+
+// System Includes
+#include <MacTypes.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_DriftCompensator
+//
+//  Reads interleaved Float32 frames from a ring buffer at a slightly adjusted rate, so a reader
+//  whose timeline drifts against the writer's stays the same distance behind it, instead of
+//  eventually reading past either end of the data and getting silence.
+//
+//  Each read measures how far the reader is behind the end of the data. After a short warm-up the
+//  distance at that point becomes the target. While the smoothed distance is within a deadband of
+//  the target, frames are copied as they are. Outside it, the read rate is corrected in proportion
+//  to the error, by at most kMaxCorrection. Corrected frames are interpolated with a windowed-sinc
+//  polyphase kernel, one vDSP dot product per output sample.
+//
+//  Methods whose names end with "RT" should only be called from the reader's real-time thread.
+//==================================================================================================
+
+class RDC_DriftCompensator
+{
+
+public:
+                                        RDC_DriftCompensator();
+                                        // Disallow copying
+                                        RDC_DriftCompensator(const RDC_DriftCompensator&) = delete;
+                                        RDC_DriftCompensator& operator=(const RDC_DriftCompensator&) = delete;
+
+    /*! Allocate the buffers for a channel count. Must only be called while IO is stopped. */
+    void                                Allocate(UInt32 inChannelCount);
+
+    void                                SetEnabled(bool inEnabled);
+    bool                                IsEnabledRT() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    /*!
+     Fill outFrames with the frames for inSampleTime to inSampleTime + inFrameSize on the reader's
+     timeline. The reader's timeline restarts, and the distance target is measured again, if
+     inSampleTime doesn't follow on from the last read.
+
+     @return The first error CARingBuffer::Fetch returned, if any. The frames it couldn't fetch are
+             silent.
+     */
+    CARingBufferError                   ReadRT(CARingBuffer& inRingBuffer,
+                                               Float32* outFrames,
+                                               UInt32 inFrameSize,
+                                               CARingBuffer::SampleTime inSampleTime);
+
+    /*! @return The current rate correction in parts per million. Positive when reading faster. */
+    SInt32                              GetCorrectionPPM() const;
+
+private:
+    void                                RestartRT(CARingBuffer::SampleTime inSampleTime);
+    void                                UpdateCorrectionRT(Float64 inDistance);
+    CARingBufferError                   ResampleChunkRT(CARingBuffer& inRingBuffer,
+                                                        Float32* outFrames,
+                                                        UInt32 inFrameSize);
+
+public:
+    // The number of input frames each output sample is interpolated from. Even.
+    static const UInt32                 kTaps = 16;
+    // The fractional positions between input frames the kernel is tabulated for. The nearest is used.
+    static const UInt32                 kPhases = 128;
+    // Frames are resampled this many at a time, so the input buffer can be allocated in advance.
+    static const UInt32                 kChunkFrameSize = 512;
+
+private:
+    // The number of reads before the distance target is set, so it's measured from the smoothed
+    // distance rather than wherever the writer happened to be for the first read.
+    static const UInt32                 kWarmUpReads = 64;
+    static constexpr Float64            kDistanceSmoothing = 0.02;
+    // Errors smaller than this, in frames, are left alone. The distance naturally varies by up to
+    // the writer's IO buffer size, which the smoothing mostly removes.
+    static constexpr Float64            kDeadbandFrames = 32.0;
+    // The correction for each frame of error outside the deadband.
+    static constexpr Float64            kCorrectionPerFrame = 1.0e-6;
+    // 1000 ppm, far more than real clocks drift, but small enough not to be audible.
+    static constexpr Float64            kMaxCorrection = 1.0e-3;
+    // The most input frames a chunk can need: the output frames at the fastest rate, rounded up,
+    // and the kernel's width, plus one in case the last position rounds up to the next frame.
+    static constexpr UInt32             kMaxInputFrameSize =
+            kChunkFrameSize + static_cast<UInt32>(kChunkFrameSize * kMaxCorrection) + 1 + kTaps + 1;
+
+public:
+    // How many frames past the end of the requested ones a read can need. The kernel reaches
+    // kTaps / 2 + 2 frames past the read position, and the reader can drift up to the deadband closer
+    // to the writer before it's corrected.
+    static const UInt32                 kLookAheadFrames = kTaps / 2 + 2 + static_cast<UInt32>(kDeadbandFrames);
+
+private:
+    std::atomic<bool>                   mEnabled { false };
+    std::atomic<Float64>                mCorrection { 0.0 };
+
+    UInt32                              mChannelCount = 0;
+    // The kernel for each phase, kTaps coefficients each. Phase p is for positions p / kPhases of a
+    // frame after an input frame.
+    std::vector<Float32>                mKernel;
+    // The input frames for one chunk.
+    std::vector<Float32>                mInputBuffer;
+
+    // The reader's state. Only used by ReadRT's thread.
+    bool                                mIsRunning = false;
+    // The sample time on the reader's timeline the next read should start at.
+    CARingBuffer::SampleTime            mNextSampleTime = 0;
+    // The position in the ring buffer of the next output frame, as a whole frame and a fraction.
+    CARingBuffer::SampleTime            mReadFrame = 0;
+    Float64                             mReadFraction = 0.0;
+    UInt32                              mReadsSinceRestart = 0;
+    Float64                             mSmoothedDistance = 0.0;
+    Float64                             mTargetDistance = 0.0;
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_DriftCompensator__ */
+
@@ -0,0 +1,121 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_IOTrace.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_IOTrace.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+
+// STL Includes
+#include <algorithm>
+#include <vector>
+
+
+#pragma clang assume_nonnull begin
+
+static_assert((RDC_IOTrace::kCapacity & (RDC_IOTrace::kCapacity - 1)) == 0,
+              "RDC_IOTrace::kCapacity must be a power of two");
+
+RDC_IOTrace::RDC_IOTrace()
+:
+    // Value-initialised, so every page is written now rather than on the IO thread.
+    mSlots(new Slot[kCapacity]())
+{
+}
+
+void    RDC_IOTrace::RecordRT(const RDC_IOTraceEntry& inEntry)
+{
+    UInt64 thePosition = mNextPosition.fetch_add(1, std::memory_order_relaxed);
+    Slot& theSlot = mSlots[thePosition & (kCapacity - 1)];
+
+    // Make the counter odd so CopySnapshot knows the entry is changing.
+    theSlot.mSequence.store(2 * thePosition + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    theSlot.mEntry = inEntry;
+
+    theSlot.mSequence.store(2 * thePosition + 2, std::memory_order_release);
+}
+
+CFDataRef   RDC_IOTrace::CopySnapshot(UInt64 inSinceHostTime) const
+{
+    UInt64 theEndPosition = mNextPosition.load(std::memory_order_acquire);
+    UInt64 theStartPosition = (theEndPosition > kCapacity) ? theEndPosition - kCapacity : 0;
+
+    std::vector<RDC_IOTraceEntry> theEntries;
+    theEntries.reserve(static_cast<size_t>(theEndPosition - theStartPosition));
+
+    for(UInt64 thePosition = theStartPosition; thePosition < theEndPosition; thePosition++)
+    {
+        const Slot& theSlot = mSlots[thePosition & (kCapacity - 1)];
+
+        // Skip the entry unless the slot holds it, and not a newer one, both before and after it's
+        // copied.
+        UInt64 theSequence = theSlot.mSequence.load(std::memory_order_acquire);
+        RDC_IOTraceEntry theEntry = theSlot.mEntry;
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if(theSequence == 2 * thePosition + 2 &&
+           theSlot.mSequence.load(std::memory_order_relaxed) == theSequence &&
+           theEntry.mBeginHostTime >= inSinceHostTime)
+        {
+            theEntries.push_back(theEntry);
+        }
+    }
+
+    // Entries are recorded when their functions return, so a long call can be recorded after
+    // shorter ones that started later.
+    std::stable_sort(theEntries.begin(),
+                     theEntries.end(),
+                     [](const RDC_IOTraceEntry& inA, const RDC_IOTraceEntry& inB) {
+                         return inA.mBeginHostTime < inB.mBeginHostTime;
+                     });
+
+    CFDataRef theSnapshot =
+            CFDataCreate(kCFAllocatorDefault,
+                         reinterpret_cast<const UInt8*>(theEntries.data()),
+                         static_cast<CFIndex>(theEntries.size() * sizeof(RDC_IOTraceEntry)));
+    ThrowIfNULL(theSnapshot,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_IOTrace::CopySnapshot: failed to create the CFData");
+
+    return theSnapshot;
+}
+
+RDC_IOTrace::Scope::~Scope()
+{
+    CARingBuffer::SampleTime theStartTime, theEndTime;
+    if(mRingBuffer.GetTimeBounds(theStartTime, theEndTime) != kCARingBufferError_OK)
+    {
+        theStartTime = 0;
+        theEndTime = 0;
+    }
+
+    mEntry.mRingStartTime = theStartTime;
+    mEntry.mRingEndTime = theEndTime;
+    mEntry.mEndHostTime = mach_absolute_time();
+
+    mTrace.RecordRT(mEntry);
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,130 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_IOTrace.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_IOTrace__
+#define __RDCDriver__RDC_IOTrace__
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CARingBuffer.h"
+
+// STL Includes
+#include <atomic>
+#include <memory>
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+#include <mach/mach_time.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_IOTrace
+//
+//  A record of the last kCapacity calls to RDCDevice's IO functions, for working out which IO
+//  operation was slow after the host reports an overload. See kAudioDeviceCustomPropertyIOTrace.
+//
+//  Any number of IO threads can record entries at the same time without locking. Each one claims
+//  the next slot by incrementing mNextPosition and writes its entry between two updates of the
+//  slot's sequence counter, which is odd while the entry is being written. CopySnapshot copies the
+//  entries without locking and drops any whose sequence counter changed while it was copying them.
+//  The slots are allocated and touched up front, so recording never allocates or page faults.
+//==================================================================================================
+
+class RDC_IOTrace
+{
+
+public:
+                                        RDC_IOTrace();
+                                        // Disallow copying
+                                        RDC_IOTrace(const RDC_IOTrace&) = delete;
+                                        RDC_IOTrace& operator=(const RDC_IOTrace&) = delete;
+
+    /*! Store an entry, overwriting the oldest. Real-time safe. */
+    void                                RecordRT(const RDC_IOTraceEntry& inEntry);
+
+    /*!
+     @return A new CFData with the entries that began at or after inSinceHostTime, oldest first. The
+             caller is responsible for releasing it.
+     @throws CAException if the CFData couldn't be created.
+     */
+    CFDataRef                           CopySnapshot(UInt64 inSinceHostTime) const;
+
+    // Records an entry for the scope it's declared in, with the host times it was constructed and
+    // destroyed at.
+    class Scope
+    {
+
+    public:
+                                        Scope(RDC_IOTrace& inTrace,
+                                              CARingBuffer& inRingBuffer,
+                                              UInt32 inCall,
+                                              UInt32 inOperationID,
+                                              UInt32 inClientID,
+                                              UInt32 inFrameSize,
+                                              Float64 inSampleTime)
+                                        :
+                                            mTrace(inTrace),
+                                            mRingBuffer(inRingBuffer)
+                                        {
+                                            mEntry.mBeginHostTime = mach_absolute_time();
+                                            mEntry.mSampleTime = inSampleTime;
+                                            mEntry.mOperationID = inOperationID;
+                                            mEntry.mClientID = inClientID;
+                                            mEntry.mFrameSize = inFrameSize;
+                                            mEntry.mCall = inCall;
+                                        }
+                                        ~Scope();
+                                        Scope(const Scope&) = delete;
+                                        Scope& operator=(const Scope&) = delete;
+
+    private:
+        RDC_IOTrace&                    mTrace;
+        CARingBuffer&                   mRingBuffer;
+        RDC_IOTraceEntry                mEntry;
+
+    };
+
+public:
+    // Enough for about 20 seconds of a single client with 512-frame buffers at 48 kHz. Must be a
+    // power of two.
+    static const UInt32                 kCapacity = 8192;
+
+private:
+    struct Slot
+    {
+        // Twice the position of the entry in the slot, plus one while it's being written. Zero if
+        // the slot hasn't been used.
+        std::atomic<UInt64>             mSequence;
+        RDC_IOTraceEntry                mEntry;
+    };
+
+    std::unique_ptr<Slot[]>             mSlots;
+    std::atomic<UInt64>                 mNextPosition { 0 };
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_IOTrace__ */
+
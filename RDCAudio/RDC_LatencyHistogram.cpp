@@ -0,0 +1,65 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LatencyHistogram.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_LatencyHistogram.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+#include "CACFArray.h"
+
+// STL Includes
+#include <algorithm>
+
+
+#pragma clang assume_nonnull begin
+
+void    RDC_LatencyHistogram::RecordRT(UInt64 inNanos)
+{
+    // The index of the highest set bit, i.e. floor(log2(inNanos)).
+    UInt32 theBucket = (inNanos == 0) ? 0 : static_cast<UInt32>(63 - __builtin_clzll(inNanos));
+    theBucket = std::min(theBucket, kBucketCount - 1);
+
+    mBuckets[theBucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void    RDC_LatencyHistogram::Reset()
+{
+    for(UInt32 i = 0; i < kBucketCount; i++)
+    {
+        mBuckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+CFArrayRef  RDC_LatencyHistogram::CopyBuckets() const
+{
+    CACFArray theBuckets(kBucketCount, true);
+
+    for(UInt32 i = 0; i < kBucketCount; i++)
+    {
+        theBuckets.AppendSInt64(static_cast<SInt64>(mBuckets[i].load(std::memory_order_relaxed)));
+    }
+
+    return theBuckets.CopyCFArray();
+}
+
+#pragma clang assume_nonnull end
+
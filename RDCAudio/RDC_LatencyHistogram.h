@@ -0,0 +1,75 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LatencyHistogram.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_LatencyHistogram__
+#define __RDCDriver__RDC_LatencyHistogram__
+
+// STL Includes
+#include <atomic>
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_LatencyHistogram
+//
+//  Counts durations in power-of-two buckets: bucket i counts the durations in [2^i, 2^(i + 1))
+//  nanoseconds, except that bucket 0 also counts durations under a nanosecond and the last bucket
+//  counts everything too long for the others. The counters are atomics, so recording is real-time
+//  safe and readers never block the thread recording. A reset that races with a record can lose
+//  that one sample, which is fine for statistics.
+//
+//  Methods whose names end with "RT" are real-time safe.
+//==================================================================================================
+
+class RDC_LatencyHistogram
+{
+
+public:
+    // Enough for durations of up to about 2 seconds to get their own bucket.
+    static const UInt32                 kBucketCount = 32;
+
+                                        RDC_LatencyHistogram() { Reset(); }
+                                        // Disallow copying
+                                        RDC_LatencyHistogram(const RDC_LatencyHistogram&) = delete;
+                                        RDC_LatencyHistogram& operator=(const RDC_LatencyHistogram&) = delete;
+
+    void                                RecordRT(UInt64 inNanos);
+
+    void                                Reset();
+
+    /*!
+     @return A new CFArray of kBucketCount CFNumbers (SInt64), the count in each bucket. The caller
+             is responsible for releasing it.
+     */
+    CFArrayRef                          CopyBuckets() const;
+
+private:
+    std::atomic<UInt64>                 mBuckets[kBucketCount];
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_LatencyHistogram__ */
+
@@ -0,0 +1,127 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LevelMeter.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_LevelMeter.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+#include "CACFArray.h"
+
+// STL Includes
+#include <algorithm>
+
+// System Includes
+#include <Accelerate/Accelerate.h>
+
+
+#pragma clang assume_nonnull begin
+
+RDC_LevelMeter::RDC_LevelMeter()
+:
+    mChannelCount(0)
+{
+    SetChannelCount(0);
+}
+
+void    RDC_LevelMeter::SetChannelCount(UInt32 inChannelCount)
+{
+    Assert(inChannelCount <= kRDCMaxChannelCount, "RDC_LevelMeter::SetChannelCount: Too many channels");
+
+    mChannelCount = std::min(inChannelCount, kRDCMaxChannelCount);
+
+    for(UInt32 i = 0; i < kRDCMaxChannelCount; i++)
+    {
+        mPeaks[i].store(0.0f, std::memory_order_relaxed);
+        mRMSLevels[i].store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+void    RDC_LevelMeter::MeasureRT(const Float32* inFrames, UInt32 inFrameSize, Float32 inGain)
+{
+    if(inFrameSize == 0)
+    {
+        return;
+    }
+
+    // Measure each channel in place, with a stride of the number of channels, so nothing needs to
+    // be copied or deinterleaved.
+    for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+    {
+        Float32 thePeak = 0.0f;
+        vDSP_maxmgv(inFrames + theChannel, mChannelCount, &thePeak, inFrameSize);
+
+        Float32 theRMS = 0.0f;
+        vDSP_rmsqv(inFrames + theChannel, mChannelCount, &theRMS, inFrameSize);
+
+        thePeak *= inGain;
+        theRMS *= inGain;
+
+        mRMSLevels[theChannel].store(theRMS, std::memory_order_relaxed);
+
+        // Raise the peak, unless CopyLevels reset it or we raised it higher in the meantime. Only
+        // CopyLevels can make this loop again, so it won't spin.
+        Float32 thePublishedPeak = mPeaks[theChannel].load(std::memory_order_relaxed);
+        while(thePeak > thePublishedPeak &&
+              !mPeaks[theChannel].compare_exchange_weak(thePublishedPeak,
+                                                        thePeak,
+                                                        std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+void    RDC_LevelMeter::MeasureSilenceRT()
+{
+    for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+    {
+        mRMSLevels[theChannel].store(0.0f, std::memory_order_relaxed);
+    }
+}
+
+CFDictionaryRef RDC_LevelMeter::CopyLevels()
+{
+    CACFArray thePeaks(mChannelCount, true);
+    CACFArray theRMSLevels(mChannelCount, true);
+
+    for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+    {
+        thePeaks.AppendFloat32(mPeaks[theChannel].exchange(0.0f, std::memory_order_relaxed));
+        theRMSLevels.AppendFloat32(mRMSLevels[theChannel].load(std::memory_order_relaxed));
+    }
+
+    CFMutableDictionaryRef theLevels =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      2,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theLevels,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_LevelMeter::CopyLevels: failed to create the dictionary");
+
+    CFDictionarySetValue(theLevels, CFSTR(kRDCLoopbackLevelsKey_Peak), thePeaks.GetCFArray());
+    CFDictionarySetValue(theLevels, CFSTR(kRDCLoopbackLevelsKey_RMS), theRMSLevels.GetCFArray());
+
+    return theLevels;
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,94 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LevelMeter.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_LevelMeter__
+#define __RDCDriver__RDC_LevelMeter__
+
+// Local Includes
+#include "RDC_Types.h"
+
+// STL Includes
+#include <atomic>
+
+// System Includes
+#include <CoreAudio/AudioServerPlugIn.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_LevelMeter
+//
+//  Measures the per-channel peak and RMS levels of interleaved Float32 audio as it's written, so
+//  clients can draw meters without reading the audio themselves. The levels are linear amplitudes
+//  published through atomics, so the IO thread never waits for a reader.
+//
+//  Methods whose names end with "RT" should only be called from real-time threads.
+//==================================================================================================
+
+class RDC_LevelMeter
+{
+
+public:
+                                        RDC_LevelMeter();
+                                        // Disallow copying
+                                        RDC_LevelMeter(const RDC_LevelMeter&) = delete;
+                                        RDC_LevelMeter& operator=(const RDC_LevelMeter&) = delete;
+
+    /*! Set the number of channels to measure and reset the levels. Must only be called while IO is stopped. */
+    void                                SetChannelCount(UInt32 inChannelCount);
+
+    /*!
+     Measure inFrameSize frames. The RMS levels are replaced with the RMS of these frames and the
+     peak levels are raised to their peaks if they're higher.
+
+     @param inGain The levels are multiplied by this, so callers that apply a gain while copying the
+                   frames somewhere can measure them before it's applied.
+     */
+    void                                MeasureRT(const Float32* inFrames,
+                                                  UInt32 inFrameSize,
+                                                  Float32 inGain = 1.0f);
+
+    /*!
+     Record that the audio is silent, for callers that know it is without reading it. The RMS
+     levels go to zero and the peak levels are left as they are.
+     */
+    void                                MeasureSilenceRT();
+
+    /*!
+     @return A new CFDictionary in the format of kAudioDeviceCustomPropertyLoopbackLevels. The
+             caller is responsible for releasing it. Resets the peak levels, so each read gets the
+             peaks since the last one.
+     */
+    CFDictionaryRef                     CopyLevels();
+
+private:
+    // Only changed while IO is stopped.
+    UInt32                              mChannelCount;
+
+    std::atomic<Float32>                mPeaks[kRDCMaxChannelCount];
+    std::atomic<Float32>                mRMSLevels[kRDCMaxChannelCount];
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_LevelMeter__ */
+
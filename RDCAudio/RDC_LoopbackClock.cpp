@@ -0,0 +1,118 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+//
+//  RDC_LoopbackClock.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_LoopbackClock.h"
+
+// PublicUtility Includes
+#include "CADebugMacros.h"
+
+// STL Includes
+#include <cmath>
+
+// System Includes
+#include <mach/mach_time.h>
+
+
+#pragma clang assume_nonnull begin
+
+static UInt64 RDC_GreatestCommonDivisor(UInt64 inA, UInt64 inB)
+{
+    while(inB != 0)
+    {
+        UInt64 theRemainder = inA % inB;
+        inA = inB;
+        inB = theRemainder;
+    }
+
+    return inA;
+}
+
+void    RDC_LoopbackClock::SetSampleRate(Float64 inSampleRate)
+{
+    Assert(inSampleRate >= 1.0, "RDC_LoopbackClock::SetSampleRate: Invalid sample rate");
+
+    // Host ticks convert to nanoseconds as ticks * numer / denom.
+    mach_timebase_info_data_t theTimebaseInfo;
+    mach_timebase_info(&theTimebaseInfo);
+
+    // Keep the rate as an integer fraction, which is exact for whole-number rates.
+    UInt64 theSampleRateNumerator = static_cast<UInt64>(std::llround(inSampleRate));
+    UInt64 theSampleRateDenominator = 1;
+
+    if(static_cast<Float64>(theSampleRateNumerator) != inSampleRate)
+    {
+        theSampleRateNumerator = static_cast<UInt64>(std::llround(inSampleRate * kSampleRateScale));
+        theSampleRateDenominator = kSampleRateScale;
+    }
+
+    // ticks/frame = (ticks/second) / (frames/second)
+    //             = (NSEC_PER_SEC * denom / numer) / (rate numerator / rate denominator)
+    UInt64 theNumerator = NSEC_PER_SEC * theTimebaseInfo.denom * theSampleRateDenominator;
+    UInt64 theDenominator = static_cast<UInt64>(theTimebaseInfo.numer) * theSampleRateNumerator;
+    UInt64 theDivisor = RDC_GreatestCommonDivisor(theNumerator, theDenominator);
+
+    mTicksNumerator = theNumerator / theDivisor;
+    mTicksDenominator = theDenominator / theDivisor;
+}
+
+void    RDC_LoopbackClock::SetAnchor(UInt64 inSampleTime, UInt64 inHostTime)
+{
+    // The anchor is sample time 0's host time, so GetHostTimeForSampleTime(inSampleTime) will
+    // return exactly inHostTime.
+    mAnchorHostTime = inHostTime - FramesToHostTicks(inSampleTime);
+}
+
+UInt64  RDC_LoopbackClock::GetHostTimeForSampleTime(UInt64 inSampleTime) const
+{
+    return mAnchorHostTime + FramesToHostTicks(inSampleTime);
+}
+
+UInt64  RDC_LoopbackClock::GetSampleTimeForHostTime(UInt64 inHostTime) const
+{
+    if(inHostTime < mAnchorHostTime)
+    {
+        return 0;
+    }
+
+    return HostTicksToFrames(inHostTime - mAnchorHostTime);
+}
+
+UInt64  RDC_LoopbackClock::FramesToHostTicks(UInt64 inFrames) const
+{
+    // The product can be larger than 64 bits after a few days at high sample rates.
+    unsigned __int128 theTicks = static_cast<unsigned __int128>(inFrames) * mTicksNumerator;
+    return static_cast<UInt64>(theTicks / mTicksDenominator);
+}
+
+UInt64  RDC_LoopbackClock::HostTicksToFrames(UInt64 inHostTicks) const
+{
+    // FramesToHostTicks rounds down, so frame n is at inHostTicks or earlier iff
+    // n * numerator < (inHostTicks + 1) * denominator. This is the largest n for which that holds.
+    unsigned __int128 theLimit = (static_cast<unsigned __int128>(inHostTicks) + 1) * mTicksDenominator;
+    return static_cast<UInt64>((theLimit - 1) / mTicksNumerator);
+}
+
+Float64 RDC_LoopbackClock::GetHostTicksPerFrame() const
+{
+    return static_cast<Float64>(mTicksNumerator) / static_cast<Float64>(mTicksDenominator);
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,91 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+//
+//  RDC_LoopbackClock.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_LoopbackClock__
+#define __RDCDriver__RDC_LoopbackClock__
+
+// System Includes
+#include <MacTypes.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_LoopbackClock
+//
+//  Converts the sample times of a clock that runs at a fixed sample rate, relative to the host
+//  clock, to host times. The number of host ticks per frame is kept as an exact fraction built from
+//  mach_timebase_info and the sample rate, and each host time is calculated from the anchor with
+//  integer arithmetic. So, unlike adding up a Float64 ticks-per-frame ratio, the error never grows
+//  with the sample time: every host time is the exact one rounded down to a whole tick, however
+//  long the clock has been running.
+//
+//  Sample rates that aren't whole numbers are rounded to the nearest kSampleRateScale-th of a Hz.
+//
+//  Not thread safe. RDC_Device guards its clock with its IO mutex. RDC_NullDevice only changes its
+//  clock while it's inactive and keeps the anchor separately, so it can read the clock without
+//  locking.
+//==================================================================================================
+
+class RDC_LoopbackClock
+{
+
+public:
+    static const UInt64         kSampleRateScale = 1000;
+
+    /*!
+     Set the clock's sample rate. Sample time 0 stays at the anchor's host time, so the clock should
+     normally be restarted afterwards.
+     */
+    void                        SetSampleRate(Float64 inSampleRate);
+
+    /*! Set the anchor so that inSampleTime is at inHostTime. */
+    void                        SetAnchor(UInt64 inSampleTime, UInt64 inHostTime);
+
+    /*! @return The host time of inSampleTime. Real-time safe. */
+    UInt64                      GetHostTimeForSampleTime(UInt64 inSampleTime) const;
+
+    /*!
+     The inverse of GetHostTimeForSampleTime. Real-time safe.
+     @return The last sample time whose host time is at or before inHostTime, or 0 if inHostTime is
+             before the anchor.
+     */
+    UInt64                      GetSampleTimeForHostTime(UInt64 inHostTime) const;
+
+    /*! @return The host time of sample time 0. */
+    UInt64                      GetAnchorHostTime() const { return mAnchorHostTime; }
+
+    /*! @return The number of host ticks per frame, for callers that only need it approximately. */
+    Float64                     GetHostTicksPerFrame() const;
+
+private:
+    UInt64                      FramesToHostTicks(UInt64 inFrames) const;
+    UInt64                      HostTicksToFrames(UInt64 inHostTicks) const;
+
+    // The number of host ticks per frame is mTicksNumerator / mTicksDenominator, in lowest terms.
+    UInt64                      mTicksNumerator = 1;
+    UInt64                      mTicksDenominator = 1;
+    UInt64                      mAnchorHostTime = 0;
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_LoopbackClock__ */
+
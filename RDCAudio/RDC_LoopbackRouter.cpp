@@ -0,0 +1,302 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LoopbackRouter.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_LoopbackRouter.h"
+
+// Local Includes
+#include "RDC_Device.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+#include "CAHostTimeBase.h"
+
+// STL Includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// System Includes
+#include <Accelerate/Accelerate.h>
+#include <sched.h>
+
+
+#pragma clang assume_nonnull begin
+
+pthread_once_t          RDC_LoopbackRouter::sStaticInitializer = PTHREAD_ONCE_INIT;
+RDC_LoopbackRouter*     RDC_LoopbackRouter::sInstance = nullptr;
+
+RDC_LoopbackRouter&     RDC_LoopbackRouter::GetInstance()
+{
+    pthread_once(&sStaticInitializer, StaticInitializer);
+    return *sInstance;
+}
+
+void    RDC_LoopbackRouter::StaticInitializer()
+{
+    sInstance = new RDC_LoopbackRouter;
+}
+
+// Look up the instance with the UID for inKey in inRoute.
+static UInt32 RDC_GetLoopbackRouteInstanceIndex(CFDictionaryRef inRoute, CFStringRef inKey)
+{
+    CFTypeRef theUID = CFDictionaryGetValue(inRoute, inKey);
+    ThrowIf(theUID == nullptr || CFGetTypeID(theUID) != CFStringGetTypeID(),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_LoopbackRouter::SetRoutesNonRT: A route's UID is missing or isn't a CFString");
+
+    RDC_Device* theDevice = RDC_Device::LookUpInstanceByUID(static_cast<CFStringRef>(theUID));
+    ThrowIfNULL(theDevice,
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_LoopbackRouter::SetRoutesNonRT: A route's UID doesn't match an instance");
+
+    return theDevice->GetInstanceIndex();
+}
+
+void    RDC_LoopbackRouter::SetRoutesNonRT(CFArrayRef inRoutes)
+{
+    // Check all of the routes before changing anything.
+    UInt32 theSourcesByDestination[kRDCMaxDeviceCount] = {};
+    UInt32 theRoutedSources = 0;
+
+    for(CFIndex theIndex = 0; theIndex < CFArrayGetCount(inRoutes); theIndex++)
+    {
+        CFTypeRef theRoute = CFArrayGetValueAtIndex(inRoutes, theIndex);
+        ThrowIf(theRoute == nullptr || CFGetTypeID(theRoute) != CFDictionaryGetTypeID(),
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_LoopbackRouter::SetRoutesNonRT: A route isn't a CFDictionary");
+
+        UInt32 theSource =
+            RDC_GetLoopbackRouteInstanceIndex(static_cast<CFDictionaryRef>(theRoute),
+                                              CFSTR(kRDCLoopbackRouteKey_Source));
+        UInt32 theDestination =
+            RDC_GetLoopbackRouteInstanceIndex(static_cast<CFDictionaryRef>(theRoute),
+                                              CFSTR(kRDCLoopbackRouteKey_Destination));
+        ThrowIf(theSource == theDestination,
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_LoopbackRouter::SetRoutesNonRT: A route's source and destination are the same");
+
+        theSourcesByDestination[theDestination] |= (1U << theSource);
+        theRoutedSources |= (1U << theSource);
+    }
+
+    CAMutex::Locker theLocker(mMutex);
+
+    for(UInt32 theDestination = 0; theDestination < kRDCMaxDeviceCount; theDestination++)
+    {
+        mSourcesByDestination[theDestination].store(theSourcesByDestination[theDestination],
+                                                    std::memory_order_relaxed);
+    }
+
+    mRoutedSources.store(theRoutedSources, std::memory_order_relaxed);
+}
+
+CFArrayRef  RDC_LoopbackRouter::CopyRoutesNonRT() const
+{
+    CFMutableArrayRef theRoutes = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+    ThrowIfNULL(theRoutes,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_LoopbackRouter::CopyRoutesNonRT: Failed to create the array");
+
+    for(UInt32 theDestination = 0; theDestination < RDC_Device::GetNumberOfInstances(); theDestination++)
+    {
+        UInt32 theSources = GetSourcesRT(theDestination);
+
+        for(UInt32 theSource = 0; theSource < RDC_Device::GetNumberOfInstances(); theSource++)
+        {
+            if((theSources & (1U << theSource)) != 0)
+            {
+                const void* theKeys[] = {
+                    CFSTR(kRDCLoopbackRouteKey_Source),
+                    CFSTR(kRDCLoopbackRouteKey_Destination)
+                };
+                const void* theValues[] = {
+                    RDC_Device::GetInstanceAtIndex(theSource).CopyDeviceUID(),
+                    RDC_Device::GetInstanceAtIndex(theDestination).CopyDeviceUID()
+                };
+
+                CFDictionaryRef theRoute = CFDictionaryCreate(kCFAllocatorDefault,
+                                                              theKeys,
+                                                              theValues,
+                                                              2,
+                                                              &kCFTypeDictionaryKeyCallBacks,
+                                                              &kCFTypeDictionaryValueCallBacks);
+                if(theRoute != nullptr)
+                {
+                    CFArrayAppendValue(theRoutes, theRoute);
+                    CFRelease(theRoute);
+                }
+            }
+        }
+    }
+
+    return theRoutes;
+}
+
+void    RDC_LoopbackRouter::RemoveInstancesNonRT(UInt32 inFirstInstance)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    UInt32 theRemainingInstances = (1U << inFirstInstance) - 1;
+    UInt32 theRoutedSources = 0;
+
+    for(UInt32 theDestination = 0; theDestination < kRDCMaxDeviceCount; theDestination++)
+    {
+        UInt32 theSources = (theDestination < inFirstInstance) ?
+                (mSourcesByDestination[theDestination].load(std::memory_order_relaxed) & theRemainingInstances) :
+                0;
+
+        mSourcesByDestination[theDestination].store(theSources, std::memory_order_relaxed);
+        theRoutedSources |= theSources;
+    }
+
+    mRoutedSources.store(theRoutedSources, std::memory_order_relaxed);
+}
+
+void    RDC_LoopbackRouter::AttachSourceNonRT(UInt32 inSource,
+                                              CARingBuffer& inRingBuffer,
+                                              bool inIsFloat32Interleaved,
+                                              Float64 inSampleRate,
+                                              UInt32 inChannelCount)
+{
+    CAMutex::Locker theLocker(mMutex);
+    Source& theSource = mSources[inSource];
+
+    Assert(theSource.ringBuffer.load() == nullptr,
+           "RDC_LoopbackRouter::AttachSourceNonRT: The source is already attached");
+
+    if(inIsFloat32Interleaved)
+    {
+        theSource.sampleRate = inSampleRate;
+        theSource.channelCount = inChannelCount;
+        theSource.hasTimeline.store(false);
+        theSource.ringBuffer.store(&inRingBuffer);
+    }
+}
+
+void    RDC_LoopbackRouter::DetachSourceNonRT(UInt32 inSource)
+{
+    CAMutex::Locker theLocker(mMutex);
+    Source& theSource = mSources[inSource];
+
+    theSource.ringBuffer.store(nullptr);
+
+    // A destination that loaded the ring buffer before we cleared it will have incremented readers
+    // first, so once readers is zero none of them are still using it.
+    while(theSource.readers.load() != 0)
+    {
+        sched_yield();
+    }
+}
+
+void    RDC_LoopbackRouter::PublishSourceTimeRT(UInt32 inSource,
+                                                Float64 inSampleTime,
+                                                UInt64 inHostTime)
+{
+    Source& theSource = mSources[inSource];
+
+    // Sources are only detached while their IO is stopped, so this doesn't need to register as a
+    // reader to read sampleRate.
+    if(theSource.ringBuffer.load(std::memory_order_relaxed) != nullptr)
+    {
+        Float64 theHostFrames =
+            static_cast<Float64>(inHostTime) * theSource.sampleRate / CAHostTimeBase::GetFrequency();
+
+        theSource.timelineOffset.store(inSampleTime - theHostFrames, std::memory_order_relaxed);
+        theSource.hasTimeline.store(true, std::memory_order_release);
+    }
+}
+
+bool    RDC_LoopbackRouter::MixSourcesRT(UInt32 inDestination,
+                                         UInt32 inSources,
+                                         Float64 inSampleRate,
+                                         UInt32 inChannelCount,
+                                         UInt64 inHostTime,
+                                         Float32* outFrames,
+                                         UInt32 inFrameSize,
+                                         Float32* ioScratch,
+                                         UInt32 inScratchFrameSize)
+{
+    memset(outFrames, 0, inFrameSize * inChannelCount * sizeof(Float32));
+
+    if(inScratchFrameSize == 0)
+    {
+        return false;
+    }
+
+    Float64 theHostFrames = static_cast<Float64>(inHostTime) * inSampleRate / CAHostTimeBase::GetFrequency();
+    bool theSucceeded = true;
+
+    for(UInt32 theSourceIndex = 0; theSourceIndex < kRDCMaxDeviceCount; theSourceIndex++)
+    {
+        if((inSources & (1U << theSourceIndex)) == 0)
+        {
+            continue;
+        }
+
+        Source& theSource = mSources[theSourceIndex];
+
+        // Register as a reader before loading the ring buffer. See DetachSourceNonRT.
+        theSource.readers.fetch_add(1);
+        CARingBuffer* theRingBuffer = theSource.ringBuffer.load();
+
+        if(theRingBuffer != nullptr &&
+           theSource.sampleRate == inSampleRate &&
+           theSource.channelCount == inChannelCount &&
+           theSource.hasTimeline.load(std::memory_order_acquire))
+        {
+            CARingBuffer::SampleTime theStartTime =
+                llround(theHostFrames + theSource.timelineOffset.load(std::memory_order_relaxed));
+
+            SInt64& theNextSourceTime = mNextSourceTimes[inDestination][theSourceIndex];
+            if(std::abs(theStartTime - theNextSourceTime) <= kMaxTimelineJitterFrames)
+            {
+                theStartTime = theNextSourceTime;
+            }
+            theNextSourceTime = theStartTime + inFrameSize;
+
+            // Fetch a chunk at a time into the scratch buffer and add it to the sum.
+            for(UInt32 theOffset = 0; theOffset < inFrameSize; theOffset += inScratchFrameSize)
+            {
+                UInt32 theChunkFrames = std::min(inScratchFrameSize, inFrameSize - theOffset);
+
+                if(theRingBuffer->FetchInterleaved(ioScratch, theChunkFrames, theStartTime + theOffset) ==
+                   kCARingBufferError_OK)
+                {
+                    Float32* theSum = outFrames + theOffset * inChannelCount;
+                    vDSP_vadd(theSum, 1, ioScratch, 1, theSum, 1, theChunkFrames * inChannelCount);
+                }
+                else
+                {
+                    theSucceeded = false;
+                }
+            }
+        }
+
+        theSource.readers.fetch_sub(1);
+    }
+
+    return theSucceeded;
+}
+
+#pragma clang assume_nonnull end
+
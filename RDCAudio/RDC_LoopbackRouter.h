@@ -0,0 +1,180 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LoopbackRouter.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_LoopbackRouter__
+#define __RDCDriver__RDC_LoopbackRouter__
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CAMutex.h"
+#include "CARingBuffer.h"
+
+// STL Includes
+#include <atomic>
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+#include <MacTypes.h>
+#include <pthread.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_LoopbackRouter
+//
+//  Routes the output of RDCDevice instances to the inputs of other instances. See
+//  kAudioPlugInCustomPropertyLoopbackRoutes.
+//
+//  The routes are a fixed matrix with a bitmask of source instances for each destination, so
+//  changing them never allocates and the IO threads can read them without locking. The sources'
+//  own loopback ring buffers hold their audio, so a route doesn't need a buffer of its own. When a
+//  destination reads its input, MixSourcesRT sums the frames each of its sources wrote at the same
+//  host time into the destination's buffer.
+//
+//  The instances have separate clocks, so each source publishes the offset between its sample
+//  times and the host time every time it writes its mix, and the destinations use that to find the
+//  source frames for their own sample times.
+//
+//  Methods whose names end with "RT" are real-time safe and those ending with "NonRT" should never
+//  be called from a real-time thread.
+//==================================================================================================
+
+class RDC_LoopbackRouter
+{
+
+public:
+    static RDC_LoopbackRouter&          GetInstance();
+
+                                        // Disallow copying
+                                        RDC_LoopbackRouter(const RDC_LoopbackRouter&) = delete;
+                                        RDC_LoopbackRouter& operator=(const RDC_LoopbackRouter&) = delete;
+
+private:
+                                        RDC_LoopbackRouter() = default;
+    static void                         StaticInitializer();
+
+public:
+    /*!
+     Replace the routes.
+
+     @param inRoutes A CFArray of CFDictionaries with the kRDCLoopbackRouteKey_* keys.
+     @throws CAException If a route is invalid or refers to an instance that doesn't exist, in
+                         which case the routes are left unchanged.
+     */
+    void                                SetRoutesNonRT(CFArrayRef inRoutes);
+    /*! @return A new CFArray in the format SetRoutesNonRT takes. The caller must release it. */
+    CFArrayRef                          CopyRoutesNonRT() const;
+    /*! Drop the routes from and to the instances from inFirstInstance on, which are being hidden. */
+    void                                RemoveInstancesNonRT(UInt32 inFirstInstance);
+
+    /*! @return A bitmask of the instances routed to inDestination's input, by instance index. */
+    UInt32                              GetSourcesRT(UInt32 inDestination) const
+                                        {
+                                            return mSourcesByDestination[inDestination].load(std::memory_order_relaxed);
+                                        }
+
+    /*! @return True if any instance's input is routed from inSource's output. */
+    bool                                IsSourceRoutedRT(UInt32 inSource) const
+                                        {
+                                            return (mRoutedSources.load(std::memory_order_relaxed) & (1U << inSource)) != 0;
+                                        }
+
+    /*!
+     Let destinations read inRingBuffer, which is inSource's loopback buffer, after
+     DetachSourceNonRT. Sources that don't store interleaved Float32 are left detached and routes
+     from them read silence.
+     */
+    void                                AttachSourceNonRT(UInt32 inSource,
+                                                          CARingBuffer& inRingBuffer,
+                                                          bool inIsFloat32Interleaved,
+                                                          Float64 inSampleRate,
+                                                          UInt32 inChannelCount);
+    /*!
+     Stop the destinations reading inSource's loopback buffer. Blocks until any that are reading it
+     have finished. Must be called before the buffer is reallocated or cleared.
+     */
+    void                                DetachSourceNonRT(UInt32 inSource);
+
+    /*! Record the host time of one of inSource's sample times. Called from its WriteMix. */
+    void                                PublishSourceTimeRT(UInt32 inSource,
+                                                            Float64 inSampleTime,
+                                                            UInt64 inHostTime);
+
+    /*!
+     Sum the frames inDestination's sources wrote at the host time of its input into outFrames.
+
+     @param inSources The bitmask GetSourcesRT returned.
+     @param inHostTime The host time of the first frame.
+     @param ioScratch A buffer for inScratchFrameSize frames to fetch each source into.
+     @return False if one of the sources couldn't be read. Its frames are left out of the sum.
+     */
+    bool                                MixSourcesRT(UInt32 inDestination,
+                                                     UInt32 inSources,
+                                                     Float64 inSampleRate,
+                                                     UInt32 inChannelCount,
+                                                     UInt64 inHostTime,
+                                                     Float32* outFrames,
+                                                     UInt32 inFrameSize,
+                                                     Float32* ioScratch,
+                                                     UInt32 inScratchFrameSize);
+
+private:
+    struct Source
+    {
+        // Null while detached.
+        std::atomic<CARingBuffer*>      ringBuffer { nullptr };
+        // Only changed while detached.
+        Float64                         sampleRate = 0.0;
+        UInt32                          channelCount = 0;
+        // The number of destinations reading ringBuffer, so DetachSourceNonRT can wait for them.
+        std::atomic<UInt32>             readers { 0 };
+        // The source's sample time minus the host time in frames. Only valid once the source has
+        // written its mix since it was attached.
+        std::atomic<Float64>            timelineOffset { 0.0 };
+        std::atomic<bool>               hasTimeline { false };
+    };
+
+    // If a destination's next read from a source starts within this many frames of where its last
+    // one ended, it continues from there, so jitter in the host times doesn't skip or repeat frames.
+    static const SInt64                 kMaxTimelineJitterFrames = 2;
+
+    static pthread_once_t               sStaticInitializer;
+    static RDC_LoopbackRouter*          sInstance;
+
+    // Serialises changing the routes and attaching and detaching sources.
+    CAMutex                             mMutex { "Loopback Router" };
+
+    std::atomic<UInt32>                 mSourcesByDestination[kRDCMaxDeviceCount] = {};
+    // The union of mSourcesByDestination, so sources can tell whether they're being read.
+    std::atomic<UInt32>                 mRoutedSources { 0 };
+    Source                              mSources[kRDCMaxDeviceCount];
+    // The source sample time each destination's next read from each source is expected to start
+    // at, by destination and then source. Only used by the destinations' IO threads.
+    SInt64                              mNextSourceTimes[kRDCMaxDeviceCount][kRDCMaxDeviceCount] = {};
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_LoopbackRouter__ */
+
@@ -0,0 +1,107 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LoopbackTimeStamps.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_LoopbackTimeStamps.h"
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+
+
+#pragma clang assume_nonnull begin
+
+static_assert((kRDCLoopbackTimeStampCount & (kRDCLoopbackTimeStampCount - 1)) == 0,
+              "kRDCLoopbackTimeStampCount must be a power of two");
+
+void    RDC_LoopbackTimeStamps::RecordRT(RDC_LoopbackTimeStampTable& ioTable,
+                                         SInt64 inSampleTime,
+                                         UInt64 inHostTime)
+{
+    // We're the only writer, so the position doesn't need to be claimed atomically.
+    UInt64 thePosition = ioTable.mNextPosition.load(std::memory_order_relaxed);
+    RDC_LoopbackTimeStampSlot& theSlot = ioTable.mSlots[thePosition & (kRDCLoopbackTimeStampCount - 1)];
+
+    // Make the counter odd so readers know the entry is changing.
+    theSlot.mSequence.store(2 * thePosition + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    theSlot.mSampleTime.store(inSampleTime, std::memory_order_relaxed);
+    theSlot.mHostTime.store(inHostTime, std::memory_order_relaxed);
+
+    theSlot.mSequence.store(2 * thePosition + 2, std::memory_order_release);
+    ioTable.mNextPosition.store(thePosition + 1, std::memory_order_release);
+}
+
+void    RDC_LoopbackTimeStamps::Clear(RDC_LoopbackTimeStampTable& ioTable)
+{
+    // Leave mNextPosition alone, so a reader that loaded it before this can't mistake a newer
+    // entry for the one it was looking for.
+    for(RDC_LoopbackTimeStampSlot& theSlot : ioTable.mSlots)
+    {
+        theSlot.mSequence.store(0, std::memory_order_release);
+    }
+}
+
+CFDataRef   RDC_LoopbackTimeStamps::CopyEntries(const RDC_LoopbackTimeStampTable& inTable)
+{
+    UInt64 theEndPosition = inTable.mNextPosition.load(std::memory_order_acquire);
+    UInt64 theStartPosition =
+            (theEndPosition > kRDCLoopbackTimeStampCount) ? theEndPosition - kRDCLoopbackTimeStampCount : 0;
+
+    RDC_LoopbackTimeStamp theEntries[kRDCLoopbackTimeStampCount];
+    UInt32 theEntryCount = 0;
+
+    for(UInt64 thePosition = theStartPosition; thePosition < theEndPosition; thePosition++)
+    {
+        const RDC_LoopbackTimeStampSlot& theSlot =
+                inTable.mSlots[thePosition & (kRDCLoopbackTimeStampCount - 1)];
+
+        // Skip the entry unless the slot holds it, and not a newer one, both before and after it's
+        // copied.
+        UInt64 theSequence = theSlot.mSequence.load(std::memory_order_acquire);
+        RDC_LoopbackTimeStamp theEntry;
+        theEntry.mSampleTime = theSlot.mSampleTime.load(std::memory_order_relaxed);
+        theEntry.mHostTime = theSlot.mHostTime.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if(theSequence == 2 * thePosition + 2 &&
+           theSlot.mSequence.load(std::memory_order_relaxed) == theSequence)
+        {
+            theEntries[theEntryCount++] = theEntry;
+        }
+    }
+
+    CFDataRef theData =
+            CFDataCreate(kCFAllocatorDefault,
+                         reinterpret_cast<const UInt8*>(theEntries),
+                         static_cast<CFIndex>(theEntryCount * sizeof(RDC_LoopbackTimeStamp)));
+    ThrowIfNULL(theData,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_LoopbackTimeStamps::CopyEntries: failed to create the CFData");
+
+    return theData;
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,64 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LoopbackTimeStamps.h
+//  RDCDriver
+//
+//  The writer's side of RDC_LoopbackTimeStampTable, which maps the sample times of the blocks of
+//  the mix to the host times the HAL gave for them. RDCDevice keeps one table for
+//  kAudioDeviceCustomPropertyLoopbackTimeStamps and RDC_SharedLoopbackBuffer keeps another in the
+//  shared memory region. See RDC_SharedLoopback.h for the read protocol.
+//
+//  There's a single writer, the IO thread that does WriteMix. Readers don't lock, so recording
+//  never blocks.
+//
+
+#ifndef RDCDriver__RDC_LoopbackTimeStamps
+#define RDCDriver__RDC_LoopbackTimeStamps
+
+// Local Includes
+#include "RDC_SharedLoopback.h"
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+
+
+#pragma clang assume_nonnull begin
+
+namespace RDC_LoopbackTimeStamps
+{
+    /*! Store the timestamp of a block, overwriting the oldest entry. Real-time safe. */
+    void        RecordRT(RDC_LoopbackTimeStampTable& ioTable, SInt64 inSampleTime, UInt64 inHostTime);
+
+    /*!
+     Empty the table, e.g. because the sample times are about to start again. Must not be called
+     while the table's writer might be recording. Readers can keep reading.
+     */
+    void        Clear(RDC_LoopbackTimeStampTable& ioTable);
+
+    /*!
+     @return A new CFData with the table's entries as RDC_LoopbackTimeStamps, oldest first. Entries
+             that were being written while they were copied are left out. The caller is
+             responsible for releasing it.
+     @throws CAException if the CFData couldn't be created.
+     */
+    CFDataRef   CopyEntries(const RDC_LoopbackTimeStampTable& inTable);
+}
+
+#pragma clang assume_nonnull end
+
+#endif /* RDCDriver__RDC_LoopbackTimeStamps */
+
@@ -0,0 +1,541 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LosslessCodec.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_LosslessCodec.h"
+
+// STL Includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+#pragma clang assume_nonnull begin
+
+enum : Byte
+{
+    kRDCLosslessBlockType_Silent   = 0,
+    kRDCLosslessBlockType_Verbatim = 1,
+    kRDCLosslessBlockType_Integer  = 2
+};
+
+// The integer samples are 32-bit, so no more than this many fractional bits are kept.
+static const UInt32 kMaxShift = 31;
+static const UInt32 kMaxRiceParameter = 40;
+// The type and the shift.
+static const size_t kIntegerBlockHeaderSize = 2;
+// The predictor order and the Rice parameter.
+static const size_t kChannelHeaderSize = 2;
+
+// Writes bits MSB first.
+class RDC_BitWriter
+{
+public:
+    explicit RDC_BitWriter(Byte* outBytes) : mNext(outBytes) { }
+
+    // inCount must be at most 32.
+    void Write(UInt64 inValue, UInt32 inCount)
+    {
+        mAccumulator = (mAccumulator << inCount) | (inValue & ((1ULL << inCount) - 1));
+        mBitCount += inCount;
+
+        while(mBitCount >= 8)
+        {
+            mBitCount -= 8;
+            *mNext++ = static_cast<Byte>(mAccumulator >> mBitCount);
+        }
+    }
+
+    void WriteRice(UInt64 inValue, UInt32 inParameter)
+    {
+        // The quotient in unary, as zeros ended by a one.
+        for(UInt64 theQuotient = inValue >> inParameter; theQuotient > 0; )
+        {
+            UInt32 theZeros = static_cast<UInt32>(std::min<UInt64>(theQuotient, 32));
+            Write(0, theZeros);
+            theQuotient -= theZeros;
+        }
+        Write(1, 1);
+
+        if(inParameter > 32)
+        {
+            Write(inValue >> 32, inParameter - 32);
+            Write(inValue, 32);
+        }
+        else if(inParameter > 0)
+        {
+            Write(inValue, inParameter);
+        }
+    }
+
+    // Pad the last byte with zeros.
+    Byte* Finish()
+    {
+        if(mBitCount > 0)
+        {
+            Write(0, 8 - mBitCount);
+        }
+
+        return mNext;
+    }
+
+private:
+    Byte*   mNext;
+    UInt64  mAccumulator = 0;
+    UInt32  mBitCount = 0;
+};
+
+// Reads what RDC_BitWriter wrote. Reading past the end sets mOverran and returns zeros.
+class RDC_BitReader
+{
+public:
+    RDC_BitReader(const Byte* inBytes, const Byte* inEnd) : mNext(inBytes), mEnd(inEnd) { }
+
+    UInt32 ReadBit()
+    {
+        if(mBitCount == 0)
+        {
+            if(mNext == mEnd)
+            {
+                mOverran = true;
+                return 0;
+            }
+
+            mByte = *mNext++;
+            mBitCount = 8;
+        }
+
+        mBitCount--;
+        return (mByte >> mBitCount) & 1;
+    }
+
+    UInt64 Read(UInt32 inCount)
+    {
+        UInt64 theValue = 0;
+        for(UInt32 i = 0; i < inCount; i++)
+        {
+            theValue = (theValue << 1) | ReadBit();
+        }
+        return theValue;
+    }
+
+    UInt64 ReadRice(UInt32 inParameter)
+    {
+        UInt64 theQuotient = 0;
+        while(ReadBit() == 0 && !mOverran)
+        {
+            theQuotient++;
+        }
+
+        return (theQuotient << inParameter) | Read(inParameter);
+    }
+
+    // Skip to the start of the next byte.
+    const Byte* Finish()
+    {
+        mBitCount = 0;
+        return mNext;
+    }
+
+    bool Overran() const { return mOverran; }
+
+private:
+    const Byte* mNext;
+    const Byte* mEnd;
+    Byte        mByte = 0;
+    UInt32      mBitCount = 0;
+    bool        mOverran = false;
+};
+
+static inline UInt64 RDC_ZigZag(SInt64 inValue)
+{
+    return (static_cast<UInt64>(inValue) << 1) ^ static_cast<UInt64>(inValue >> 63);
+}
+
+static inline SInt64 RDC_UnZigZag(UInt64 inValue)
+{
+    return static_cast<SInt64>(inValue >> 1) ^ -static_cast<SInt64>(inValue & 1);
+}
+
+// Computes the residuals of the fixed predictors one sample at a time. The residual of order k is
+// the kth difference of the samples, so each order's residual is the difference between the
+// previous order's residual and what it was for the sample before. A residual of order k is only
+// valid from the kth sample of the block (counting from 0). The samples before that are stored as
+// they are.
+struct RDC_FixedResiduals
+{
+    void Add(SInt32 inSample)
+    {
+        SInt64 theDifference = inSample;
+
+        for(UInt32 theOrder = 0; theOrder <= RDC_LosslessCodec::kMaxPredictorOrder; theOrder++)
+        {
+            SInt64 theLast = mLastResiduals[theOrder];
+            mLastResiduals[theOrder] = theDifference;
+            theDifference -= theLast;
+        }
+    }
+
+    SInt64 Get(UInt32 inOrder) const { return mLastResiduals[inOrder]; }
+
+    SInt64  mLastResiduals[RDC_LosslessCodec::kMaxPredictorOrder + 1] = {};
+};
+
+// Predicts a sample from the ones before it with a fixed predictor.
+static inline SInt64 RDC_FixedPrediction(const SInt64* inHistory, UInt32 inOrder)
+{
+    // inHistory[0] is the previous sample, inHistory[1] the one before it and so on.
+    const SInt64* h = inHistory;
+
+    switch(inOrder)
+    {
+        case 0:  return 0;
+        case 1:  return h[0];
+        case 2:  return 2 * h[0] - h[1];
+        case 3:  return 3 * h[0] - 3 * h[1] + h[2];
+        default: return 4 * h[0] - 6 * h[1] + 4 * h[2] - h[3];
+    }
+}
+
+// The number of fractional bits inSample needs to be stored as an integer, or a number greater than
+// kMaxShift if it can't be. Also raises ioMaxExponent to the sample's exponent.
+static inline UInt32 RDC_FractionalBits(Float32 inSample, SInt32& ioMaxExponent)
+{
+    UInt32 theBits;
+    memcpy(&theBits, &inSample, sizeof(theBits));
+
+    if(theBits == 0)
+    {
+        return 0;
+    }
+
+    SInt32 theExponent = static_cast<SInt32>((theBits >> 23) & 0xFF);
+
+    // -0.0, subnormals, infinities and NaNs.
+    if((theBits & 0x7FFFFFFF) == 0 || theExponent == 0 || theExponent == 0xFF)
+    {
+        return kMaxShift + 1;
+    }
+
+    ioMaxExponent = std::max(ioMaxExponent, theExponent);
+
+    // The sample is (2^23 + mantissa) * 2^(exponent - 150). The mantissa's trailing zeros don't
+    // need fractional bits.
+    UInt32 theSignificand = (theBits & 0x7FFFFF) | 0x800000;
+    SInt32 theFractionalBits = 150 - theExponent - __builtin_ctz(theSignificand);
+
+    return static_cast<UInt32>(std::max(theFractionalBits, 0));
+}
+
+size_t  RDC_LosslessCodec::GetMaxEncodedSize(UInt32 inFrameSize, UInt32 inChannelCount)
+{
+    // A verbatim block, which integer blocks are only used when they're smaller than.
+    return 1 + static_cast<size_t>(inFrameSize) * inChannelCount * sizeof(Float32);
+}
+
+// Sample inIndex of inChannel as an integer. Only valid if inFrames fit the shift.
+static inline SInt32 RDC_IntegerSample(const Float32* inFrames,
+                                       UInt32 inChannelCount,
+                                       UInt32 inChannel,
+                                       UInt32 inIndex,
+                                       UInt32 inShift)
+{
+    return static_cast<SInt32>(std::ldexp(inFrames[inIndex * inChannelCount + inChannel],
+                                          static_cast<int>(inShift)));
+}
+
+// The bits it takes to Rice code inCount residuals whose zigzag encodings shifted right by
+// inParameter add up to inQuotients.
+static inline UInt64 RDC_RiceBits(UInt64 inCount, UInt64 inQuotients, UInt32 inParameter)
+{
+    return inCount * (inParameter + 1) + inQuotients;
+}
+
+// Plan how to encode a channel. Returns the number of bytes it will take.
+static size_t RDC_PlanIntegerChannel(const Float32* inFrames,
+                                     UInt32 inFrameSize,
+                                     UInt32 inChannelCount,
+                                     UInt32 inChannel,
+                                     UInt32 inShift,
+                                     UInt32& outOrder,
+                                     UInt32& outParameter)
+{
+    static const UInt32 kOrders = RDC_LosslessCodec::kMaxPredictorOrder + 1;
+
+    // Choose the order with the smallest residuals, like FLAC does, ignoring the samples where
+    // the higher orders aren't valid yet.
+    UInt64 theResidualSums[kOrders] = {};
+    RDC_FixedResiduals theResiduals;
+
+    for(UInt32 i = 0; i < inFrameSize; i++)
+    {
+        theResiduals.Add(RDC_IntegerSample(inFrames, inChannelCount, inChannel, i, inShift));
+
+        if(i >= RDC_LosslessCodec::kMaxPredictorOrder)
+        {
+            for(UInt32 theOrder = 0; theOrder < kOrders; theOrder++)
+            {
+                SInt64 theResidual = theResiduals.Get(theOrder);
+                theResidualSums[theOrder] += static_cast<UInt64>(theResidual < 0 ? -theResidual : theResidual);
+            }
+        }
+    }
+
+    UInt32 theOrder = 0;
+    if(inFrameSize > RDC_LosslessCodec::kMaxPredictorOrder)
+    {
+        theOrder = static_cast<UInt32>(std::min_element(theResidualSums, theResidualSums + kOrders) -
+                                       theResidualSums);
+    }
+
+    // Estimate the Rice parameter from the mean residual, then find the exact cost of it and its
+    // neighbours. The zigzag encodings are about twice the residuals' magnitudes.
+    UInt64 theCount = inFrameSize - theOrder;
+    UInt64 theMean = (theCount > 0 && inFrameSize > RDC_LosslessCodec::kMaxPredictorOrder) ?
+                     2 * theResidualSums[theOrder] / (inFrameSize - RDC_LosslessCodec::kMaxPredictorOrder) : 0;
+    UInt32 theEstimate = (theMean > 0) ? static_cast<UInt32>(63 - __builtin_clzll(theMean)) : 0;
+    UInt32 theFirstCandidate = (theEstimate > 0) ? theEstimate - 1 : 0;
+
+    static const UInt32 kCandidates = 3;
+    UInt64 theQuotients[kCandidates] = {};
+    theResiduals = RDC_FixedResiduals();
+
+    for(UInt32 i = 0; i < inFrameSize; i++)
+    {
+        theResiduals.Add(RDC_IntegerSample(inFrames, inChannelCount, inChannel, i, inShift));
+
+        if(i >= theOrder)
+        {
+            UInt64 theZigZag = RDC_ZigZag(theResiduals.Get(theOrder));
+
+            for(UInt32 theCandidate = 0; theCandidate < kCandidates; theCandidate++)
+            {
+                theQuotients[theCandidate] += theZigZag >> (theFirstCandidate + theCandidate);
+            }
+        }
+    }
+
+    UInt64 theBestBits = UINT64_MAX;
+    for(UInt32 theCandidate = 0; theCandidate < kCandidates; theCandidate++)
+    {
+        UInt32 theParameter = std::min(theFirstCandidate + theCandidate, kMaxRiceParameter);
+        UInt64 theBits = RDC_RiceBits(theCount, theQuotients[theCandidate], theParameter);
+
+        if(theBits < theBestBits)
+        {
+            theBestBits = theBits;
+            outParameter = theParameter;
+        }
+    }
+
+    outOrder = theOrder;
+
+    // The warm-up samples are stored in 32 bits each, before the residuals.
+    return kChannelHeaderSize + static_cast<size_t>((theOrder * 32 + theBestBits + 7) / 8);
+}
+
+size_t  RDC_LosslessCodec::EncodeBlock(const Float32* inFrames,
+                                       UInt32 inFrameSize,
+                                       UInt32 inChannelCount,
+                                       Byte* outBytes)
+{
+    UInt32 theSampleCount = inFrameSize * inChannelCount;
+
+    // Find the shift that makes every sample an integer, checking for silence along the way.
+    UInt32 theShift = 0;
+    SInt32 theMaxExponent = 0;
+    bool theIsSilent = true;
+
+    for(UInt32 i = 0; i < theSampleCount && theShift <= kMaxShift; i++)
+    {
+        theShift = std::max(theShift, RDC_FractionalBits(inFrames[i], theMaxExponent));
+        theIsSilent = theIsSilent && (theMaxExponent == 0);
+    }
+
+    if(theIsSilent && theShift == 0)
+    {
+        outBytes[0] = kRDCLosslessBlockType_Silent;
+        return 1;
+    }
+
+    size_t theVerbatimSize = GetMaxEncodedSize(inFrameSize, inChannelCount);
+
+    // The largest magnitude is less than 2^(theMaxExponent - 126), so shifting it by theShift
+    // bits has to leave it less than 2^31.
+    bool theFitsIntegers = (theShift <= kMaxShift) &&
+                           (theMaxExponent - 126 + static_cast<SInt32>(theShift) <= 31);
+
+    if(theFitsIntegers)
+    {
+        outBytes[0] = kRDCLosslessBlockType_Integer;
+        outBytes[1] = static_cast<Byte>(theShift);
+        Byte* theNext = outBytes + kIntegerBlockHeaderSize;
+
+        for(UInt32 theChannel = 0; theChannel < inChannelCount; theChannel++)
+        {
+            UInt32 theOrder = 0;
+            UInt32 theParameter = 0;
+            size_t theChannelSize = RDC_PlanIntegerChannel(inFrames,
+                                                           inFrameSize,
+                                                           inChannelCount,
+                                                           theChannel,
+                                                           theShift,
+                                                           theOrder,
+                                                           theParameter);
+
+            // Give up if the block wouldn't be smaller than a verbatim one. This also makes sure
+            // it fits in outBytes.
+            if(static_cast<size_t>(theNext - outBytes) + theChannelSize >= theVerbatimSize)
+            {
+                theFitsIntegers = false;
+                break;
+            }
+
+            *theNext++ = static_cast<Byte>(theOrder);
+            *theNext++ = static_cast<Byte>(theParameter);
+
+            RDC_BitWriter theWriter(theNext);
+            RDC_FixedResiduals theResiduals;
+
+            for(UInt32 i = 0; i < inFrameSize; i++)
+            {
+                SInt32 theSample = RDC_IntegerSample(inFrames, inChannelCount, theChannel, i, theShift);
+                theResiduals.Add(theSample);
+
+                if(i < theOrder)
+                {
+                    theWriter.Write(static_cast<UInt32>(theSample), 32);
+                }
+                else
+                {
+                    theWriter.WriteRice(RDC_ZigZag(theResiduals.Get(theOrder)), theParameter);
+                }
+            }
+
+            theNext = theWriter.Finish();
+        }
+
+        if(theFitsIntegers)
+        {
+            return static_cast<size_t>(theNext - outBytes);
+        }
+    }
+
+    outBytes[0] = kRDCLosslessBlockType_Verbatim;
+    memcpy(outBytes + 1, inFrames, theSampleCount * sizeof(Float32));
+    return theVerbatimSize;
+}
+
+bool    RDC_LosslessCodec::DecodeBlock(const Byte* inBytes,
+                                       size_t inByteSize,
+                                       UInt32 inFrameSize,
+                                       UInt32 inChannelCount,
+                                       Float32* outFrames)
+{
+    UInt32 theSampleCount = inFrameSize * inChannelCount;
+
+    if(inByteSize < 1)
+    {
+        return false;
+    }
+
+    switch(inBytes[0])
+    {
+        case kRDCLosslessBlockType_Silent:
+            memset(outFrames, 0, theSampleCount * sizeof(Float32));
+            return true;
+
+        case kRDCLosslessBlockType_Verbatim:
+            if(inByteSize != GetMaxEncodedSize(inFrameSize, inChannelCount))
+            {
+                return false;
+            }
+
+            memcpy(outFrames, inBytes + 1, theSampleCount * sizeof(Float32));
+            return true;
+
+        case kRDCLosslessBlockType_Integer:
+            break;
+
+        default:
+            return false;
+    }
+
+    if(inByteSize < kIntegerBlockHeaderSize || inBytes[1] > kMaxShift)
+    {
+        return false;
+    }
+
+    int theShift = static_cast<int>(inBytes[1]);
+    const Byte* theNext = inBytes + kIntegerBlockHeaderSize;
+    const Byte* theEnd = inBytes + inByteSize;
+
+    for(UInt32 theChannel = 0; theChannel < inChannelCount; theChannel++)
+    {
+        if(theEnd - theNext < static_cast<ptrdiff_t>(kChannelHeaderSize))
+        {
+            return false;
+        }
+
+        UInt32 theOrder = *theNext++;
+        UInt32 theParameter = *theNext++;
+
+        if(theOrder > kMaxPredictorOrder || theParameter > kMaxRiceParameter)
+        {
+            return false;
+        }
+
+        RDC_BitReader theReader(theNext, theEnd);
+        // The previous samples, newest first.
+        SInt64 theHistory[kMaxPredictorOrder] = {};
+
+        for(UInt32 i = 0; i < inFrameSize; i++)
+        {
+            SInt64 theSample;
+
+            if(i < theOrder)
+            {
+                theSample = static_cast<SInt32>(static_cast<UInt32>(theReader.Read(32)));
+            }
+            else
+            {
+                theSample = RDC_FixedPrediction(theHistory, theOrder) +
+                            RDC_UnZigZag(theReader.ReadRice(theParameter));
+            }
+
+            if(theReader.Overran() || theSample < INT32_MIN || theSample > INT32_MAX)
+            {
+                return false;
+            }
+
+            std::copy_backward(theHistory, theHistory + kMaxPredictorOrder - 1, theHistory + kMaxPredictorOrder);
+            theHistory[0] = theSample;
+
+            outFrames[i * inChannelCount + theChannel] =
+                std::ldexp(static_cast<Float32>(theSample), -theShift);
+        }
+
+        theNext = theReader.Finish();
+    }
+
+    return (theNext == theEnd);
+}
+
+#pragma clang assume_nonnull end
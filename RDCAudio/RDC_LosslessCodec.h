@@ -0,0 +1,89 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_LosslessCodec.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_LosslessCodec__
+#define __RDCDriver__RDC_LosslessCodec__
+
+// System Includes
+#include <MacTypes.h>
+#include <stddef.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_LosslessCodec
+//
+//  Compresses blocks of interleaved Float32 frames without losing anything, for keeping long
+//  stretches of the loopback audio. Each block is encoded on its own, so a block can be decoded
+//  without the ones before it.
+//
+//  A block is stored in one of three ways:
+//    - Silent, if every sample is +0.0. Just the block's type.
+//    - Integer, if every sample is an integer divided by the same power of two, which is the case
+//      when the audio came from integer PCM and hasn't been mixed or had its volume changed. Each
+//      channel is predicted with the best of FLAC's fixed polynomial predictors (orders 0 to 4) and
+//      the residuals are Rice coded, like a FLAC subframe with a single partition.
+//    - Verbatim, the samples as they are, if the block isn't silent or integer or if it wouldn't
+//      get any smaller.
+//
+//  Everything is native-endian, since the blocks never leave the machine they were encoded on.
+//  Not real-time safe: encoding makes several passes over the block.
+//==================================================================================================
+
+class RDC_LosslessCodec
+{
+
+public:
+    /*! @return The most bytes EncodeBlock will write for a block with these dimensions. */
+    static size_t                       GetMaxEncodedSize(UInt32 inFrameSize, UInt32 inChannelCount);
+
+    /*!
+     Encode a block.
+
+     @param outBytes At least GetMaxEncodedSize bytes.
+     @return The number of bytes written to outBytes.
+     */
+    static size_t                       EncodeBlock(const Float32* inFrames,
+                                                    UInt32 inFrameSize,
+                                                    UInt32 inChannelCount,
+                                                    Byte* outBytes);
+
+    /*!
+     Decode a block EncodeBlock wrote with the same dimensions.
+
+     @param outFrames Room for inFrameSize frames.
+     @return False if the block is corrupt, in which case outFrames is left partly written.
+     */
+    static bool                         DecodeBlock(const Byte* inBytes,
+                                                    size_t inByteSize,
+                                                    UInt32 inFrameSize,
+                                                    UInt32 inChannelCount,
+                                                    Float32* outFrames);
+
+    // The highest order of the fixed predictors.
+    static const UInt32                 kMaxPredictorOrder = 4;
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_LosslessCodec__ */
+
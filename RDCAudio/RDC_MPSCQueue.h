@@ -0,0 +1,192 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_MPSCQueue.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_MPSCQueue__
+#define __RDCDriver__RDC_MPSCQueue__
+
+// STL Includes
+#include <atomic>
+
+// System Includes
+#include <MacTypes.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_MPSCQueue
+//
+//  A bounded, lock-free FIFO queue for any number of producer threads and a single consumer
+//  thread. Push and Pop are real-time safe: they never allocate, lock or block, and Push only
+//  retries if another producer claims the same slot first.
+//
+//  Each slot has a sequence number that says whose turn it is to use it. Producers claim a
+//  position by incrementing mEnqueuePosition and publish the element by setting the slot's
+//  sequence to position + 1. The consumer takes it and sets the sequence to position + kCapacity,
+//  which frees the slot for the producer that will claim that position next time around. This is
+//  Dmitry Vyukov's bounded MPMC queue, simplified for a single consumer.
+//
+//  The positions are kept on separate cache lines from each other and from the slots, so the
+//  producers and the consumer don't keep invalidating each other's caches. kCapacity must be a power
+//  of two.
+//==================================================================================================
+
+template <typename T, UInt32 kCapacity>
+class RDC_MPSCQueue
+{
+
+    static_assert(kCapacity >= 2 && (kCapacity & (kCapacity - 1)) == 0,
+                  "RDC_MPSCQueue's capacity must be a power of two");
+
+public:
+                                RDC_MPSCQueue()
+                                {
+                                    for(UInt32 i = 0; i < kCapacity; i++)
+                                    {
+                                        mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+                                    }
+                                }
+                                // Disallow copying
+                                RDC_MPSCQueue(const RDC_MPSCQueue&) = delete;
+                                RDC_MPSCQueue& operator=(const RDC_MPSCQueue&) = delete;
+
+    /*!
+     Add an element to the back of the queue. Can be called from any thread.
+
+     @return False if the queue was full, in which case the element wasn't added.
+     */
+    bool                        Push(T inElement)
+                                {
+                                    UInt64 thePosition = mEnqueuePosition.load(std::memory_order_relaxed);
+                                    Slot* theSlot;
+
+                                    while(true)
+                                    {
+                                        theSlot = &mSlots[thePosition & (kCapacity - 1)];
+                                        UInt64 theSequence = theSlot->mSequence.load(std::memory_order_acquire);
+                                        SInt64 theDifference = static_cast<SInt64>(theSequence - thePosition);
+
+                                        if(theDifference == 0)
+                                        {
+                                            // The slot is free. Claim it, unless another producer just did.
+                                            if(mEnqueuePosition.compare_exchange_weak(thePosition,
+                                                                                      thePosition + 1,
+                                                                                      std::memory_order_relaxed))
+                                            {
+                                                break;
+                                            }
+                                        }
+                                        else if(theDifference < 0)
+                                        {
+                                            // The consumer hasn't taken the element from a full lap ago yet.
+                                            return false;
+                                        }
+                                        else
+                                        {
+                                            // Another producer claimed this position first.
+                                            thePosition = mEnqueuePosition.load(std::memory_order_relaxed);
+                                        }
+                                    }
+
+                                    theSlot->mElement = inElement;
+                                    theSlot->mSequence.store(thePosition + 1, std::memory_order_release);
+
+                                    // Stats only, so it doesn't matter that this is approximate.
+                                    UInt64 theDepth = thePosition + 1 - mDequeuePosition.load(std::memory_order_relaxed);
+                                    UInt64 theHighWaterMark = mHighWaterMark.load(std::memory_order_relaxed);
+                                    while(theDepth > theHighWaterMark &&
+                                          !mHighWaterMark.compare_exchange_weak(theHighWaterMark,
+                                                                                theDepth,
+                                                                                std::memory_order_relaxed))
+                                    {
+                                    }
+
+                                    return true;
+                                }
+
+    /*!
+     Remove the element at the front of the queue. Must only be called from the consumer thread.
+
+     @return False if the queue was empty. An element pushed concurrently might not be returned
+             until the next call.
+     */
+    bool                        Pop(T& outElement)
+                                {
+                                    UInt64 thePosition = mDequeuePosition.load(std::memory_order_relaxed);
+                                    Slot& theSlot = mSlots[thePosition & (kCapacity - 1)];
+
+                                    if(theSlot.mSequence.load(std::memory_order_acquire) != thePosition + 1)
+                                    {
+                                        return false;
+                                    }
+
+                                    outElement = theSlot.mElement;
+                                    theSlot.mSequence.store(thePosition + kCapacity, std::memory_order_release);
+                                    mDequeuePosition.store(thePosition + 1, std::memory_order_relaxed);
+
+                                    return true;
+                                }
+
+    /*!
+     @return The number of elements in the queue. Only approximate if it's called while elements are
+             being pushed or popped, so it's only useful for stats.
+     */
+    UInt64                      GetSize() const
+                                {
+                                    UInt64 theDequeuePosition = mDequeuePosition.load(std::memory_order_relaxed);
+                                    UInt64 theEnqueuePosition = mEnqueuePosition.load(std::memory_order_relaxed);
+
+                                    return (theEnqueuePosition > theDequeuePosition) ?
+                                           (theEnqueuePosition - theDequeuePosition) : 0;
+                                }
+
+    /*! @return The most elements that have been in the queue at once, for sizing it. */
+    UInt64                      GetHighWaterMark() const
+                                {
+                                    return mHighWaterMark.load(std::memory_order_relaxed);
+                                }
+
+    static constexpr UInt32     GetCapacity() { return kCapacity; }
+
+private:
+    static const size_t         kCacheLineSize = 64;
+
+    struct Slot
+    {
+        std::atomic<UInt64>     mSequence;
+        T                       mElement;
+    };
+
+    // Written by producers.
+    std::atomic<UInt64>         mEnqueuePosition { 0 };
+    std::atomic<UInt64>         mHighWaterMark { 0 };
+    Byte                        mPadding1[kCacheLineSize - 2 * sizeof(std::atomic<UInt64>)];
+    // Only written by the consumer.
+    std::atomic<UInt64>         mDequeuePosition { 0 };
+    Byte                        mPadding2[kCacheLineSize - sizeof(std::atomic<UInt64>)];
+
+    Slot                        mSlots[kCapacity];
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_MPSCQueue__ */
+
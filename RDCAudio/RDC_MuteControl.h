@@ -29,6 +29,9 @@
 // PublicUtility Includes
 #include "CAMutex.h"
 
+// STL Includes
+#include <atomic>
+
 // System Includes
 #include <MacTypes.h>
 #include <CoreAudio/CoreAudio.h>
@@ -84,11 +87,20 @@ public:
                                               UInt32 inDataSize,
                                               const void* inData);
 
+#pragma mark IO Operations
+
+    /*!
+     @return True if the control is muting the device's output. Real-time safe, so the IO functions
+             can skip storing the audio.
+     */
+    bool                      IsMutedRT() const { return mMuted.load(std::memory_order_relaxed); }
+
 #pragma mark Implementation
 
 private:
-    CAMutex                   mMutex;
-    bool                      mMuted;
+    CAUnfairMutex             mMutex;
+    // Only changed while holding mMutex, but read by IsMutedRT without it.
+    std::atomic<bool>         mMuted;
 
 };
 
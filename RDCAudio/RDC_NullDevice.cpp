@@ -69,7 +69,6 @@ RDC_NullDevice::RDC_NullDevice()
 :
     RDC_AbstractDevice(kObjectID_Device_Null, kAudioObjectPlugInObject),
     mStateMutex("Null Device State"),
-    mIOMutex("Null Device IO"),
     mStream(kObjectID_Stream_Null, kObjectID_Device_Null, false, kSampleRate)
 {
 }
@@ -88,7 +87,7 @@ void    RDC_NullDevice::Activate()
         RDC_AbstractDevice::Activate();
 
         // Calculate the number of host clock ticks per frame for this device's clock.
-        mHostTicksPerFrame = CAHostTimeBase::GetFrequency() / kSampleRate;
+        mClock.SetSampleRate(kSampleRate);
 
         SendDeviceIsAlivePropertyNotifications();
     }
@@ -100,8 +99,6 @@ void    RDC_NullDevice::Deactivate()
 
     if(IsActive())
     {
-        CAMutex::Locker theIOLocker(mIOMutex);
-
         // Mark the object inactive by calling the super-class.
         RDC_AbstractDevice::Deactivate();
 
@@ -403,8 +400,7 @@ void    RDC_NullDevice::StartIO(UInt32 inClientID)
     if(mClientsDoingIO == 0)
     {
         // Reset the clock.
-        mNumberTimeStamps = 0;
-        mAnchorHostTime = CAHostTimeBase::GetTheCurrentTime();
+        mAnchorHostTime.store(CAHostTimeBase::GetTheCurrentTime(), std::memory_order_release);
 
         // Send notifications.
         DebugMsg("RDC_NullDevice::StartIO: Sending kAudioDevicePropertyDeviceIsRunning");
@@ -448,31 +444,26 @@ void    RDC_NullDevice::GetZeroTimeStamp(Float64& outSampleTime,
                                          UInt64& outHostTime,
                                          UInt64& outSeed)
 {
-    CAMutex::Locker theIOLocker(mIOMutex);
-
     // Not sure whether there's actually any point to implementing this. The documentation says that
     // clockless devices don't need to, but if the device doesn't have
     // kAudioDevicePropertyZeroTimeStampPeriod the HAL seems to reject it. So we give it a simple
     // clock similar to the loopback clock in RDC_Device.
+    //
+    // Rather than counting periods, which would need a lock, work out which period the current time
+    // is in from the anchor. This isn't the same as the old behaviour: counting advanced the
+    // timestamp by at most one period per call, so it lagged behind if the HAL called less than
+    // once a period. Now each call returns the start of the period containing the current host
+    // time, skipping any periods in between, and only reads shared state.
+    UInt64 theAnchorHostTime = mAnchorHostTime.load(std::memory_order_acquire);
     UInt64 theCurrentHostTime = CAHostTimeBase::GetTheCurrentTime();
+    UInt64 theElapsedTicks =
+            (theCurrentHostTime > theAnchorHostTime) ? theCurrentHostTime - theAnchorHostTime : 0;
 
-    // Calculate the next host time.
-    Float64 theHostTicksPerPeriod = mHostTicksPerFrame * static_cast<Float64>(kZeroTimeStampPeriod);
-    Float64 theHostTickOffset = static_cast<Float64>(mNumberTimeStamps + 1) * theHostTicksPerPeriod;
-    UInt64 theNextHostTime = mAnchorHostTime + static_cast<UInt64>(theHostTickOffset);
-
-    // Go to the next period if the next host time is less than the current time.
-    if(theNextHostTime <= theCurrentHostTime)
-    {
-        mNumberTimeStamps++;
-    }
-
-    Float64 theHostTicksSinceAnchor =
-        (static_cast<Float64>(mNumberTimeStamps) * theHostTicksPerPeriod);
+    UInt64 thePeriods = mClock.GetSampleTimeForHostTime(theElapsedTicks) / kZeroTimeStampPeriod;
 
     // Set the return values.
-    outSampleTime = mNumberTimeStamps * kZeroTimeStampPeriod;
-    outHostTime = static_cast<UInt64>(mAnchorHostTime + theHostTicksSinceAnchor);
+    outSampleTime = thePeriods * kZeroTimeStampPeriod;
+    outHostTime = theAnchorHostTime + mClock.GetHostTimeForSampleTime(thePeriods * kZeroTimeStampPeriod);
     outSeed = 1;
 }
 
@@ -480,19 +471,13 @@ void    RDC_NullDevice::WillDoIOOperation(UInt32 inOperationID,
                                           bool& outWillDo,
                                           bool& outWillDoInPlace) const
 {
-    switch(inOperationID)
-    {
-        case kAudioServerPlugInIOOperationWriteMix:
-            outWillDo = true;
-            outWillDoInPlace = true;
-            break;
+    #pragma unused (inOperationID)
 
-        default:
-            outWillDo = false;
-            outWillDoInPlace = true;
-            break;
-            
-    };
+    // The audio is ignored anyway, so don't have the HAL call DoIOOperation, or BeginIOOperation
+    // and EndIOOperation, for any operation. Not doing WriteMix also means the HAL doesn't copy the
+    // mix into a buffer for us.
+    outWillDo = false;
+    outWillDoInPlace = true;
 }
 
 void    RDC_NullDevice::DoIOOperation(AudioObjectID inStreamObjectID,
@@ -505,7 +490,7 @@ void    RDC_NullDevice::DoIOOperation(AudioObjectID inStreamObjectID,
 {
     #pragma unused (inStreamObjectID, inClientID, inOperationID, inIOCycleInfo, inIOBufferFrameSize)
     #pragma unused (ioMainBuffer, ioSecondaryBuffer)
-    // Ignore the audio data.
+    // Never called, since WillDoIOOperation opts out of every operation.
 }
 
 #pragma clang assume_nonnull end
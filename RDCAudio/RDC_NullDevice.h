@@ -35,6 +35,10 @@
 //  It might be worth eventually having a virtual device for each real output device, but this is
 //  simpler and seems to work well enough for now.
 //
+//  Apps can also be parked on this device to silence them, so IO should cost as little as possible.
+//  The device opts out of every IO operation, so the HAL never calls into it during IO cycles, and
+//  GetZeroTimeStamp doesn't lock.
+//
 
 #ifndef RDCDriver__RDC_NullDevice
 #define RDCDriver__RDC_NullDevice
@@ -45,10 +49,14 @@
 // Local Includes
 #include "RDC_Types.h"
 #include "RDC_Stream.h"
+#include "RDC_LoopbackClock.h"
 
 // PublicUtility Includes
 #include "CAMutex.h"
 
+// STL Includes
+#include <atomic>
+
 // System Includes
 #include <pthread.h>
 
@@ -167,16 +175,17 @@ private:
     #define kNullDeviceManufacturerName \
                                 "Background Music contributors"
 
-    CAMutex                     mStateMutex;
-    CAMutex                     mIOMutex;
+    CAUnfairMutex               mStateMutex;
 
     RDC_Stream                  mStream;
 
     UInt32                      mClientsDoingIO    = 0;
 
-    Float64                     mHostTicksPerFrame = 0.0;
-    UInt64                      mNumberTimeStamps  = 0;
-    UInt64                      mAnchorHostTime    = 0;
+    // Anchored at host time 0, so it gives the host ticks since mAnchorHostTime. Only changed while
+    // the device is inactive.
+    RDC_LoopbackClock           mClock;
+    // The host time of sample time 0. Set by StartIO and read by GetZeroTimeStamp without locking.
+    std::atomic<UInt64>         mAnchorHostTime    { 0 };
 
 };
 
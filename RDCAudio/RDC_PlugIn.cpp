@@ -30,6 +30,7 @@
 //  Local Includes
 #include "RDC_Device.h"
 #include "RDC_NullDevice.h"
+#include "RDC_LoopbackRouter.h"
 
 //  PublicUtility Includes
 #include "CAException.h"
@@ -37,12 +38,17 @@
 #include "CAPropertyAddress.h"
 #include "CADispatchQueue.h"
 
+//  STL Includes
+#include <algorithm>
+
 
 #pragma mark Construction/Destruction
 
 pthread_once_t				RDC_PlugIn::sStaticInitializer = PTHREAD_ONCE_INIT;
 RDC_PlugIn*					RDC_PlugIn::sInstance = NULL;
 AudioServerPlugInHostRef	RDC_PlugIn::sHost = NULL;
+std::atomic<UInt64>			RDC_PlugIn::sPropertiesChangedCount(0);
+std::atomic<AudioObjectID>	RDC_PlugIn::sNextObjectID(kObjectID_FirstDynamic);
 
 RDC_PlugIn& RDC_PlugIn::GetInstance()
 {
@@ -84,6 +90,257 @@ void	RDC_PlugIn::Deactivate()
 	//_RemoveAllDevices();
 }
 
+AudioObjectID	RDC_PlugIn::AllocateObjectIDs(UInt32 inNumberOfIDs)
+{
+    return sNextObjectID.fetch_add(inNumberOfIDs);
+}
+
+UInt32	RDC_PlugIn::GetConfiguredDeviceCount()
+{
+    SInt32 theDeviceCount = 1;
+
+    CFBundleRef theBundle = CFBundleGetBundleWithIdentifier(CFSTR(kRDCDriverBundleID));
+    CFTypeRef theValue =
+        (theBundle == NULL) ? NULL :
+            CFBundleGetValueForInfoDictionaryKey(theBundle, CFSTR(kRDCDeviceCountInfoKey));
+
+    // The value is owned by the bundle, so we don't release it.
+    if(theValue != NULL && CFGetTypeID(theValue) == CFNumberGetTypeID())
+    {
+        CFNumberGetValue(static_cast<CFNumberRef>(theValue), kCFNumberSInt32Type, &theDeviceCount);
+    }
+    else if(theValue != NULL && CFGetTypeID(theValue) == CFStringGetTypeID())
+    {
+        // Allow a string as well, so the count can come from a build setting.
+        theDeviceCount = CFStringGetIntValue(static_cast<CFStringRef>(theValue));
+    }
+
+    if(theDeviceCount < 1 || theDeviceCount > static_cast<SInt32>(kRDCMaxDeviceCount))
+    {
+        LogWarning("RDC_PlugIn::GetConfiguredDeviceCount: Invalid device count (%d). Clamping to "
+                   "[1, %u].", theDeviceCount, kRDCMaxDeviceCount);
+        theDeviceCount = std::min(std::max(theDeviceCount, 1),
+                                  static_cast<SInt32>(kRDCMaxDeviceCount));
+    }
+
+    return static_cast<UInt32>(theDeviceCount);
+}
+
+// Gets a number from a kAudioPlugInCustomPropertyConfiguration dictionary. Returns false if the key
+// is missing and throws if its value isn't a CFNumber in [inMin, inMax].
+static bool RDC_GetConfigurationNumber(CFDictionaryRef inConfiguration,
+                                       CFStringRef inKey,
+                                       UInt32 inMin,
+                                       UInt32 inMax,
+                                       UInt32& outNumber)
+{
+    CFTypeRef theValue = CFDictionaryGetValue(inConfiguration, inKey);
+
+    if(theValue == nullptr)
+    {
+        return false;
+    }
+
+    SInt64 theNumber = 0;
+    ThrowIf(CFGetTypeID(theValue) != CFNumberGetTypeID() ||
+            !CFNumberGetValue(static_cast<CFNumberRef>(theValue), kCFNumberSInt64Type, &theNumber) ||
+            theNumber < inMin ||
+            theNumber > inMax,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_PlugIn::SetConfiguration: A number was invalid or out of range");
+
+    outNumber = static_cast<UInt32>(theNumber);
+    return true;
+}
+
+static void RDC_AddConfigurationNumber(CFMutableDictionaryRef ioConfiguration,
+                                       CFStringRef inKey,
+                                       CFNumberType inType,
+                                       const void* inNumber)
+{
+    CFNumberRef theNumberRef = CFNumberCreate(kCFAllocatorDefault, inType, inNumber);
+    if(theNumberRef != nullptr)
+    {
+        CFDictionarySetValue(ioConfiguration, inKey, theNumberRef);
+        CFRelease(theNumberRef);
+    }
+}
+
+CFDictionaryRef	RDC_PlugIn::CopyConfiguration() const
+{
+    CFMutableDictionaryRef theConfiguration =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      5,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theConfiguration,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_PlugIn::CopyConfiguration: failed to create the dictionary");
+
+    const RDC_Device& theMainInstance = RDC_Device::GetInstance();
+
+    UInt32 theDeviceCount = RDC_Device::GetNumberOfInstances();
+    UInt32 theChannelCount = theMainInstance.GetChannelCount();
+    UInt32 theFrameSize = theMainInstance.GetLoopbackBufferFrameSize();
+    UInt32 theMilliseconds = theMainInstance.GetLoopbackBufferMilliseconds();
+
+    RDC_AddConfigurationNumber(theConfiguration,
+                               CFSTR(kRDCConfigurationKey_DeviceCount),
+                               kCFNumberSInt32Type,
+                               &theDeviceCount);
+    RDC_AddConfigurationNumber(theConfiguration,
+                               CFSTR(kRDCConfigurationKey_ChannelCount),
+                               kCFNumberSInt32Type,
+                               &theChannelCount);
+    RDC_AddConfigurationNumber(theConfiguration,
+                               CFSTR(kRDCConfigurationKey_LoopbackBufferFrameSize),
+                               kCFNumberSInt32Type,
+                               &theFrameSize);
+    RDC_AddConfigurationNumber(theConfiguration,
+                               CFSTR(kRDCConfigurationKey_LoopbackBufferMilliseconds),
+                               kCFNumberSInt32Type,
+                               &theMilliseconds);
+
+    Float64 theSampleRates[kRDCMaxAvailableSampleRates];
+    UInt32 theNumberOfSampleRates = theMainInstance.GetAvailableSampleRates(theSampleRates);
+
+    CFMutableArrayRef theSampleRatesRef =
+            CFArrayCreateMutable(kCFAllocatorDefault, theNumberOfSampleRates, &kCFTypeArrayCallBacks);
+    if(theSampleRatesRef != nullptr)
+    {
+        for(UInt32 theIndex = 0; theIndex < theNumberOfSampleRates; theIndex++)
+        {
+            CFNumberRef theRateRef =
+                    CFNumberCreate(kCFAllocatorDefault, kCFNumberFloat64Type, &theSampleRates[theIndex]);
+            if(theRateRef != nullptr)
+            {
+                CFArrayAppendValue(theSampleRatesRef, theRateRef);
+                CFRelease(theRateRef);
+            }
+        }
+
+        CFDictionarySetValue(theConfiguration, CFSTR(kRDCConfigurationKey_SampleRates), theSampleRatesRef);
+        CFRelease(theSampleRatesRef);
+    }
+
+    return theConfiguration;
+}
+
+void	RDC_PlugIn::SetConfiguration(CFDictionaryRef inConfiguration)
+{
+    // Check everything before changing anything.
+    UInt32 theDeviceCount = 0;
+    bool theHasDeviceCount = RDC_GetConfigurationNumber(inConfiguration,
+                                                        CFSTR(kRDCConfigurationKey_DeviceCount),
+                                                        1,
+                                                        kRDCMaxDeviceCount,
+                                                        theDeviceCount);
+    UInt32 theChannelCount = 0;
+    bool theHasChannelCount = RDC_GetConfigurationNumber(inConfiguration,
+                                                         CFSTR(kRDCConfigurationKey_ChannelCount),
+                                                         1,
+                                                         kRDCMaxChannelCount,
+                                                         theChannelCount);
+    // The buffer sizes are clamped rather than checked, like their device properties.
+    UInt32 theFrameSize = 0;
+    bool theHasFrameSize = RDC_GetConfigurationNumber(inConfiguration,
+                                                      CFSTR(kRDCConfigurationKey_LoopbackBufferFrameSize),
+                                                      0,
+                                                      UINT32_MAX,
+                                                      theFrameSize);
+    UInt32 theMilliseconds = 0;
+    bool theHasMilliseconds = RDC_GetConfigurationNumber(inConfiguration,
+                                                         CFSTR(kRDCConfigurationKey_LoopbackBufferMilliseconds),
+                                                         0,
+                                                         UINT32_MAX,
+                                                         theMilliseconds);
+    ThrowIf(theHasFrameSize && theHasMilliseconds,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_PlugIn::SetConfiguration: The loopback buffer can't be sized in frames and by duration");
+
+    Float64 theSampleRates[kRDCMaxAvailableSampleRates];
+    UInt32 theNumberOfSampleRates = 0;
+    CFTypeRef theSampleRatesRef = CFDictionaryGetValue(inConfiguration, CFSTR(kRDCConfigurationKey_SampleRates));
+
+    if(theSampleRatesRef != nullptr)
+    {
+        ThrowIf(CFGetTypeID(theSampleRatesRef) != CFArrayGetTypeID(),
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_PlugIn::SetConfiguration: The sample rates weren't a CFArray");
+
+        CFArrayRef theSampleRatesArray = static_cast<CFArrayRef>(theSampleRatesRef);
+        CFIndex theCount = CFArrayGetCount(theSampleRatesArray);
+        ThrowIf(theCount < 1 || theCount > static_cast<CFIndex>(kRDCMaxAvailableSampleRates),
+                CAException(kAudioHardwareIllegalOperationError),
+                "RDC_PlugIn::SetConfiguration: Invalid number of sample rates");
+
+        for(CFIndex theIndex = 0; theIndex < theCount; theIndex++)
+        {
+            CFTypeRef theRate = CFArrayGetValueAtIndex(theSampleRatesArray, theIndex);
+            Float64 theValue = 0.0;
+            ThrowIf(theRate == nullptr ||
+                    CFGetTypeID(theRate) != CFNumberGetTypeID() ||
+                    !CFNumberGetValue(static_cast<CFNumberRef>(theRate), kCFNumberFloat64Type, &theValue) ||
+                    !(theValue >= 1.0),
+                    CAException(kAudioHardwareIllegalOperationError),
+                    "RDC_PlugIn::SetConfiguration: A sample rate was invalid");
+
+            theSampleRates[theNumberOfSampleRates++] = theValue;
+        }
+    }
+
+    CAMutex::Locker theLocker(mMutex);
+
+    if(theHasDeviceCount && theDeviceCount != RDC_Device::GetNumberOfInstances())
+    {
+        // Publish the new instances first, so the other settings apply to them as well.
+        RDC_Device::SetNumberOfInstances(theDeviceCount);
+
+        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+            AudioObjectPropertyAddress theChangedProperties[] = {
+                CAPropertyAddress(kAudioObjectPropertyOwnedObjects),
+                CAPropertyAddress(kAudioPlugInPropertyDeviceList)
+            };
+
+            Host_PropertiesChanged(GetObjectID(), 2, theChangedProperties);
+        });
+    }
+
+    // Each of these only asks the host to reconfigure the instances whose settings change.
+    for(UInt32 theIndex = 0; theIndex < RDC_Device::GetNumberOfInstances(); theIndex++)
+    {
+        RDC_Device& theDevice = RDC_Device::GetInstanceAtIndex(theIndex);
+
+        if(theHasChannelCount)
+        {
+            theDevice.RequestChannelCount(theChannelCount);
+        }
+
+        if(theNumberOfSampleRates > 0)
+        {
+            theDevice.RequestAvailableSampleRates(theSampleRates, theNumberOfSampleRates);
+        }
+
+        if(theHasFrameSize)
+        {
+            theDevice.RequestLoopbackBufferFrameSize(theFrameSize);
+        }
+
+        if(theHasMilliseconds)
+        {
+            theDevice.RequestLoopbackBufferMilliseconds(theMilliseconds);
+        }
+    }
+
+    CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+        AudioObjectPropertyAddress theChangedProperties[] = {
+            CAPropertyAddress(kAudioPlugInCustomPropertyConfiguration)
+        };
+
+        Host_PropertiesChanged(GetObjectID(), 1, theChangedProperties);
+    });
+}
+
 #pragma mark Property Operations
 
 bool	RDC_PlugIn::HasProperty(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress) const
@@ -97,6 +354,8 @@ bool	RDC_PlugIn::HasProperty(AudioObjectID inObjectID, pid_t inClientPID, const
         case kAudioPlugInPropertyResourceBundle:
         case kAudioObjectPropertyCustomPropertyInfoList:
         case kAudioPlugInCustomPropertyNullDeviceActive:
+        case kAudioPlugInCustomPropertyLoopbackRoutes:
+        case kAudioPlugInCustomPropertyConfiguration:
 			theAnswer = true;
 			break;
 		
@@ -120,6 +379,8 @@ bool	RDC_PlugIn::IsPropertySettable(AudioObjectID inObjectID, pid_t inClientPID,
 			break;
 
         case kAudioPlugInCustomPropertyNullDeviceActive:
+        case kAudioPlugInCustomPropertyLoopbackRoutes:
+        case kAudioPlugInCustomPropertyConfiguration:
             theAnswer = true;
             break;
 		
@@ -140,9 +401,9 @@ UInt32	RDC_PlugIn::GetPropertyDataSize(AudioObjectID inObjectID, pid_t inClientP
 			
 		case kAudioObjectPropertyOwnedObjects:
 		case kAudioPlugInPropertyDeviceList:
-            // The plug-in owns the main RDC_Device, the instance of RDC_Device that handles UI
-            // sounds and, if it's enabled, the null device.
-            theAnswer = (RDC_NullDevice::GetInstance().IsActive() ? 3 : 2) * sizeof(AudioObjectID);
+            // The plug-in owns the RDC_Device instances and, if it's enabled, the null device.
+            theAnswer = (RDC_Device::GetNumberOfInstances() +
+                         (RDC_NullDevice::GetInstance().IsActive() ? 1 : 0)) * sizeof(AudioObjectID);
 			break;
 			
 		case kAudioPlugInPropertyTranslateUIDToDevice:
@@ -154,12 +415,20 @@ UInt32	RDC_PlugIn::GetPropertyDataSize(AudioObjectID inObjectID, pid_t inClientP
 			break;
 
         case kAudioObjectPropertyCustomPropertyInfoList:
-            theAnswer = sizeof(AudioServerPlugInCustomPropertyInfo);
+            theAnswer = 3 * sizeof(AudioServerPlugInCustomPropertyInfo);
             break;
 
         case kAudioPlugInCustomPropertyNullDeviceActive:
             theAnswer = sizeof(CFBooleanRef);
             break;
+
+        case kAudioPlugInCustomPropertyLoopbackRoutes:
+            theAnswer = sizeof(CFArrayRef);
+            break;
+
+        case kAudioPlugInCustomPropertyConfiguration:
+            theAnswer = sizeof(CFDictionaryRef);
+            break;
 		
 		default:
 			theAnswer = RDC_Object::GetPropertyDataSize(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData);
@@ -183,33 +452,28 @@ void	RDC_PlugIn::GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, co
 		case kAudioPlugInPropertyDeviceList:
             {
     			AudioObjectID* theReturnedDeviceList = reinterpret_cast<AudioObjectID*>(outData);
-                if(inDataSize >= 2 * sizeof(AudioObjectID))
-                {
-                    if(RDC_NullDevice::GetInstance().IsActive())
-                    {
-                        theReturnedDeviceList[0] = kObjectID_Device;
-                        theReturnedDeviceList[1] = kObjectID_Device_Null;
-                        
-                        //	say how much we returned
-                        outDataSize = 2 * sizeof(AudioObjectID);
-                    }
-                    else
-                    {
-                        theReturnedDeviceList[0] = kObjectID_Device;
-
-                        //	say how much we returned
-                        outDataSize = 1 * sizeof(AudioObjectID);
-                    }
-                }
-                else if(inDataSize >= sizeof(AudioObjectID))
+                UInt32 theNumberItemsToFetch = inDataSize / sizeof(AudioObjectID);
+                UInt32 theNumberItemsFetched = 0;
+
+                // The RDCDevice instances come first, in the order they were created, so the main
+                // instance is always at the start of the list.
+                for(UInt32 theIndex = 0;
+                    theIndex < RDC_Device::GetNumberOfInstances() &&
+                        theNumberItemsFetched < theNumberItemsToFetch;
+                    theIndex++)
                 {
-                    theReturnedDeviceList[0] = kObjectID_Device;
-                    outDataSize = sizeof(AudioObjectID);
+                    theReturnedDeviceList[theNumberItemsFetched++] =
+                        RDC_Device::GetInstanceAtIndex(theIndex).GetObjectID();
                 }
-                else
+
+                if(RDC_NullDevice::GetInstance().IsActive() &&
+                   theNumberItemsFetched < theNumberItemsToFetch)
                 {
-                    outDataSize = 0;
+                    theReturnedDeviceList[theNumberItemsFetched++] = kObjectID_Device_Null;
                 }
+
+                //	say how much we returned
+                outDataSize = theNumberItemsFetched * sizeof(AudioObjectID);
             }
 			break;
 			
@@ -224,11 +488,13 @@ void	RDC_PlugIn::GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, co
                 CFStringRef theUID = *reinterpret_cast<const CFStringRef*>(inQualifierData);
                 AudioObjectID* outID = reinterpret_cast<AudioObjectID*>(outData);
 
-                if(CFEqual(theUID, RDC_Device::GetInstance().CopyDeviceUID()))
+                RDC_Device* theDevice = RDC_Device::LookUpInstanceByUID(theUID);
+
+                if(theDevice != nullptr)
                 {
-                    DebugMsg("RDC_PlugIn::GetPropertyData: Returning RDCDevice for "
-                             "kAudioPlugInPropertyTranslateUIDToDevice");
-                    *outID = kObjectID_Device;
+                    DebugMsg("RDC_PlugIn::GetPropertyData: Returning RDCDevice %u for "
+                             "kAudioPlugInPropertyTranslateUIDToDevice", theDevice->GetObjectID());
+                    *outID = theDevice->GetObjectID();
                 }
                 else if(RDC_NullDevice::GetInstance().IsActive() &&
                         CFEqual(theUID, RDC_NullDevice::GetInstance().CopyDeviceUID()))
@@ -258,22 +524,30 @@ void	RDC_PlugIn::GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, co
 			break;
 
         case kAudioObjectPropertyCustomPropertyInfoList:
-            if(inDataSize >= sizeof(AudioServerPlugInCustomPropertyInfo))
             {
+                static const AudioObjectPropertySelector kCustomProperties[] = {
+                    kAudioPlugInCustomPropertyNullDeviceActive,
+                    kAudioPlugInCustomPropertyLoopbackRoutes,
+                    kAudioPlugInCustomPropertyConfiguration
+                };
+                static const UInt32 kNumberOfCustomProperties =
+                    sizeof(kCustomProperties) / sizeof(kCustomProperties[0]);
+
                 AudioServerPlugInCustomPropertyInfo* outCustomProperties =
                     reinterpret_cast<AudioServerPlugInCustomPropertyInfo*>(outData);
+                UInt32 theNumberItemsToFetch = std::min(inDataSize / static_cast<UInt32>(sizeof(AudioServerPlugInCustomPropertyInfo)),
+                                                        kNumberOfCustomProperties);
 
-                outCustomProperties[0].mSelector = kAudioPlugInCustomPropertyNullDeviceActive;
-                outCustomProperties[0].mPropertyDataType =
-                    kAudioServerPlugInCustomPropertyDataTypeCFPropertyList;
-                outCustomProperties[0].mQualifierDataType =
-                    kAudioServerPlugInCustomPropertyDataTypeNone;
+                for(UInt32 theIndex = 0; theIndex < theNumberItemsToFetch; theIndex++)
+                {
+                    outCustomProperties[theIndex].mSelector = kCustomProperties[theIndex];
+                    outCustomProperties[theIndex].mPropertyDataType =
+                        kAudioServerPlugInCustomPropertyDataTypeCFPropertyList;
+                    outCustomProperties[theIndex].mQualifierDataType =
+                        kAudioServerPlugInCustomPropertyDataTypeNone;
+                }
 
-                outDataSize = sizeof(AudioServerPlugInCustomPropertyInfo);
-            }
-            else
-            {
-                outDataSize = 0;
+                outDataSize = theNumberItemsToFetch * sizeof(AudioServerPlugInCustomPropertyInfo);
             }
             break;
 
@@ -287,6 +561,24 @@ void	RDC_PlugIn::GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, co
             outDataSize = sizeof(CFBooleanRef);
             break;
 
+        case kAudioPlugInCustomPropertyLoopbackRoutes:
+            ThrowIf(inDataSize < sizeof(CFArrayRef),
+                    CAException(kAudioHardwareBadPropertySizeError),
+                    "RDC_PlugIn::GetPropertyData: not enough space for the return value of "
+                    "kAudioPlugInCustomPropertyLoopbackRoutes");
+            *reinterpret_cast<CFArrayRef*>(outData) = RDC_LoopbackRouter::GetInstance().CopyRoutesNonRT();
+            outDataSize = sizeof(CFArrayRef);
+            break;
+
+        case kAudioPlugInCustomPropertyConfiguration:
+            ThrowIf(inDataSize < sizeof(CFDictionaryRef),
+                    CAException(kAudioHardwareBadPropertySizeError),
+                    "RDC_PlugIn::GetPropertyData: not enough space for the return value of "
+                    "kAudioPlugInCustomPropertyConfiguration");
+            *reinterpret_cast<CFDictionaryRef*>(outData) = CopyConfiguration();
+            outDataSize = sizeof(CFDictionaryRef);
+            break;
+
 		default:
 			RDC_Object::GetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, outDataSize, outData);
 			break;
@@ -345,6 +637,58 @@ void	RDC_PlugIn::SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, co
                 }
             }
             break;
+
+        case kAudioPlugInCustomPropertyLoopbackRoutes:
+            {
+                ThrowIf(inDataSize < sizeof(CFArrayRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_PlugIn::SetPropertyData: wrong size for the data for "
+                        "kAudioPlugInCustomPropertyLoopbackRoutes");
+
+                CFArrayRef theRoutes = *reinterpret_cast<const CFArrayRef*>(inData);
+
+                ThrowIfNULL(theRoutes,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_PlugIn::SetPropertyData: null reference given for "
+                            "kAudioPlugInCustomPropertyLoopbackRoutes");
+                ThrowIf(CFGetTypeID(theRoutes) != CFArrayGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_PlugIn::SetPropertyData: CFType given for "
+                        "kAudioPlugInCustomPropertyLoopbackRoutes was not a CFArray");
+
+                RDC_LoopbackRouter::GetInstance().SetRoutesNonRT(theRoutes);
+
+                CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                    AudioObjectPropertyAddress theChangedProperties[] = {
+                        CAPropertyAddress(kAudioPlugInCustomPropertyLoopbackRoutes)
+                    };
+
+                    Host_PropertiesChanged(GetObjectID(), 1, theChangedProperties);
+                });
+            }
+            break;
+
+        case kAudioPlugInCustomPropertyConfiguration:
+            {
+                ThrowIf(inDataSize < sizeof(CFDictionaryRef),
+                        CAException(kAudioHardwareBadPropertySizeError),
+                        "RDC_PlugIn::SetPropertyData: wrong size for the data for "
+                        "kAudioPlugInCustomPropertyConfiguration");
+
+                CFDictionaryRef theConfiguration = *reinterpret_cast<const CFDictionaryRef*>(inData);
+
+                ThrowIfNULL(theConfiguration,
+                            CAException(kAudioHardwareIllegalOperationError),
+                            "RDC_PlugIn::SetPropertyData: null reference given for "
+                            "kAudioPlugInCustomPropertyConfiguration");
+                ThrowIf(CFGetTypeID(theConfiguration) != CFDictionaryGetTypeID(),
+                        CAException(kAudioHardwareIllegalOperationError),
+                        "RDC_PlugIn::SetPropertyData: CFType given for "
+                        "kAudioPlugInCustomPropertyConfiguration was not a CFDictionary");
+
+                SetConfiguration(theConfiguration);
+            }
+            break;
             
 		default:
 			RDC_Object::SetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, inData);
@@ -36,6 +36,9 @@
 // PublicUtility Includes
 #include "CAMutex.h"
 
+// STL Includes
+#include <atomic>
+
 
 class RDC_PlugIn
 :
@@ -60,8 +63,13 @@ private:
 public:
 	static void						SetHost(AudioServerPlugInHostRef inHost)	{ sHost = inHost; }
 	
-	static void						Host_PropertiesChanged(AudioObjectID inObjectID, UInt32 inNumberAddresses, const AudioObjectPropertyAddress inAddresses[])	{ if(sHost != NULL) { sHost->PropertiesChanged(sHost, inObjectID, inNumberAddresses, inAddresses); } }
+	static void						Host_PropertiesChanged(AudioObjectID inObjectID, UInt32 inNumberAddresses, const AudioObjectPropertyAddress inAddresses[])	{ if(sHost != NULL) { sPropertiesChangedCount.fetch_add(1, std::memory_order_relaxed); sHost->PropertiesChanged(sHost, inObjectID, inNumberAddresses, inAddresses); } }
 	static void						Host_RequestDeviceConfigurationChange(AudioObjectID inDeviceObjectID, UInt64 inChangeAction, void* inChangeInfo)			{ if(sHost != NULL) { sHost->RequestDeviceConfigurationChange(sHost, inDeviceObjectID, inChangeAction, inChangeInfo); } }
+	static OSStatus					Host_CopyFromStorage(CFStringRef inKey, CFPropertyListRef* outData)	{ return (sHost != NULL) ? sHost->CopyFromStorage(sHost, inKey, outData) : kAudioHardwareNotRunningError; }
+	static OSStatus					Host_WriteToStorage(CFStringRef inKey, CFPropertyListRef inData)	{ return (sHost != NULL) ? sHost->WriteToStorage(sHost, inKey, inData) : kAudioHardwareNotRunningError; }
+
+    // The number of times Host_PropertiesChanged has notified the host, for all of the driver's objects.
+    static UInt64                   GetPropertiesChangedCount() { return sPropertiesChangedCount.load(std::memory_order_relaxed); }
 
 #pragma mark Property Operations
     
@@ -76,13 +84,43 @@ public:
     
 public:
     const CFStringRef               GetBundleID() const { return CFSTR(kRDCDriverBundleID); }
+
+    /*!
+     Reserve a block of consecutive object IDs for the audio objects of an additional device
+     instance. The IDs are never reused.
+
+     @param inNumberOfIDs The number of IDs to reserve.
+     @return The first ID in the block. The rest follow it sequentially.
+     */
+    static AudioObjectID            AllocateObjectIDs(UInt32 inNumberOfIDs);
+    /*! @return The first ID the next call to AllocateObjectIDs would reserve. */
+    static AudioObjectID            GetNextObjectID() { return sNextObjectID.load(); }
+    /*!
+     @return The number of RDCDevice instances to publish, read from kRDCDeviceCountInfoKey in the
+             driver's Info.plist. Always in [1, kRDCMaxDeviceCount].
+     */
+    static UInt32                   GetConfiguredDeviceCount();
+
+private:
+    /*! @return See kAudioPlugInCustomPropertyConfiguration. The caller must release it. */
+    CFDictionaryRef                 CopyConfiguration() const;
+    /*!
+     Apply a kAudioPlugInCustomPropertyConfiguration dictionary.
+
+     @throws CAException If a value is invalid, in which case nothing is changed, or if the
+                         instances couldn't be created.
+     */
+    void                            SetConfiguration(CFDictionaryRef inConfiguration);
     
 private:
     CAMutex							mMutex;
+
+    static std::atomic<AudioObjectID> sNextObjectID;
     
     static pthread_once_t			sStaticInitializer;
     static RDC_PlugIn*				sInstance;
 	static AudioServerPlugInHostRef	sHost;
+    static std::atomic<UInt64>      sPropertiesChangedCount;
 
 };
 
@@ -105,38 +105,60 @@ static RDC_Object& RDC_LookUpOwnerObject(AudioObjectID inObjectID)
     {
         case kObjectID_PlugIn:
             return RDC_PlugIn::GetInstance();
-            
-        case kObjectID_Device:
-        case kObjectID_Stream_Input:
-        case kObjectID_Stream_Output:
-        case kObjectID_Volume_Output_Master:
-        case kObjectID_Mute_Output_Master:
-            return RDC_Device::GetInstance();
 
         case kObjectID_Device_Null:
         case kObjectID_Stream_Null:
             return RDC_NullDevice::GetInstance();
     }
+
+    // The RDC_Device instances' object IDs are allocated at runtime, so ask them.
+    RDC_Device* theDevice = RDC_Device::LookUpOwnerOfObject(inObjectID);
+
+    if(theDevice != nullptr)
+    {
+        return *theDevice;
+    }
     
     DebugMsg("RDC_LookUpOwnerObject: unknown object");
     Throw(CAException(kAudioHardwareBadObjectError));
 }
 
+static bool RDC_IsDeviceID(AudioObjectID inObjectID)
+{
+    return (inObjectID == kObjectID_Device_Null) ||
+           (RDC_Device::LookUpInstance(inObjectID) != nullptr);
+}
+
 static RDC_AbstractDevice& RDC_LookUpDevice(AudioObjectID inObjectID)
 {
-    switch(inObjectID)
+    if(inObjectID == kObjectID_Device_Null)
     {
-        case kObjectID_Device:
-            return RDC_Device::GetInstance();
+        return RDC_NullDevice::GetInstance();
+    }
 
-        case kObjectID_Device_Null:
-            return RDC_NullDevice::GetInstance();
+    RDC_Device* theDevice = RDC_Device::LookUpInstance(inObjectID);
+
+    if(theDevice != nullptr)
+    {
+        return *theDevice;
     }
 
     DebugMsg("RDC_LookUpDevice: unknown device");
     Throw(CAException(kAudioHardwareBadDeviceError));
 }
 
+// RDC_IsDeviceID and RDC_LookUpDevice in one lookup, for the IO functions, which the HAL calls
+// several times per IO cycle. Returns null if inObjectID isn't a device.
+static RDC_AbstractDevice* __nullable RDC_LookUpIODevice(AudioObjectID inObjectID)
+{
+    if(inObjectID == kObjectID_Device_Null)
+    {
+        return &RDC_NullDevice::GetInstance();
+    }
+
+    return RDC_Device::LookUpInstance(inObjectID);
+}
+
 #pragma mark Factory
 
 extern "C"
@@ -275,7 +297,7 @@ static OSStatus	RDC_Initialize(AudioServerPlugInDriverRef inDriver, AudioServerP
 		// Store the AudioServerPlugInHostRef.
 		RDC_PlugIn::GetInstance().SetHost(inHost);
         
-        // Init/activate the devices.
+        // Init/activate the devices. This creates every RDC_Device instance, not just the main one.
         RDC_Device::GetInstance();
         RDC_NullDevice::GetInstance();
 	}
@@ -326,7 +348,7 @@ static OSStatus	RDC_AddDeviceClient(AudioServerPlugInDriverRef inDriver, AudioOb
 		ThrowIf(inDriver != gAudioServerPlugInDriverRef,
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_AddDeviceClient: bad driver reference");
-		ThrowIf(inDeviceObjectID != kObjectID_Device && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_AddDeviceClient: unknown device");
 		
@@ -362,7 +384,7 @@ static OSStatus	RDC_RemoveDeviceClient(AudioServerPlugInDriverRef inDriver, Audi
 		ThrowIf(inDriver != gAudioServerPlugInDriverRef,
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_RemoveDeviceClient: bad driver reference");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_RemoveDeviceClient: unknown device");
 		
@@ -405,7 +427,7 @@ static OSStatus	RDC_PerformDeviceConfigurationChange(AudioServerPlugInDriverRef
 		ThrowIf(inDriver != gAudioServerPlugInDriverRef,
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_PerformDeviceConfigurationChange: bad driver reference");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadDeviceError),
                 "RDC_PerformDeviceConfigurationChange: unknown device");
 		
@@ -437,7 +459,7 @@ static OSStatus	RDC_AbortDeviceConfigurationChange(AudioServerPlugInDriverRef in
 		ThrowIf(inDriver != gAudioServerPlugInDriverRef,
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_PerformDeviceConfigurationChange: bad driver reference");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadDeviceError),
                 "RDC_PerformDeviceConfigurationChange: unknown device");
 		
@@ -668,7 +690,7 @@ static OSStatus	RDC_StartIO(AudioServerPlugInDriverRef inDriver,
 		ThrowIf(inDriver != gAudioServerPlugInDriverRef,
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_StartIO: bad driver reference");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadDeviceError),
                 "RDC_StartIO: unknown device");
 		
@@ -702,7 +724,7 @@ static OSStatus	RDC_StopIO(AudioServerPlugInDriverRef inDriver,
 		ThrowIf(inDriver != gAudioServerPlugInDriverRef,
                 CAException(kAudioHardwareBadObjectError),
                 "RDC_StopIO: bad driver reference");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadDeviceError),
                 "RDC_StopIO: unknown device");
 		
@@ -752,7 +774,7 @@ static OSStatus	RDC_GetZeroTimeStamp(AudioServerPlugInDriverRef inDriver,
 		ThrowIfNULL(outSeed,
                     CAException(kAudioHardwareIllegalOperationError),
                     "RDC_GetZeroTimeStamp: no place to put the seed");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadDeviceError),
                 "RDC_GetZeroTimeStamp: unknown device");
 		
@@ -795,7 +817,7 @@ static OSStatus	RDC_WillDoIOOperation(AudioServerPlugInDriverRef inDriver,
 		ThrowIfNULL(outWillDoInPlace,
                     CAException(kAudioHardwareIllegalOperationError),
                     "RDC_WillDoIOOperation: no place to put the in-place return value");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
+		ThrowIf(!RDC_IsDeviceID(inDeviceObjectID),
                 CAException(kAudioHardwareBadDeviceError),
                 "RDC_WillDoIOOperation: unknown device");
 		
@@ -840,15 +862,16 @@ static OSStatus	RDC_BeginIOOperation(AudioServerPlugInDriverRef inDriver,
 		ThrowIfNULL(inIOCycleInfo,
                     CAException(kAudioHardwareIllegalOperationError),
                     "RDC_BeginIOOperation: no cycle info");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
-                CAException(kAudioHardwareBadDeviceError),
-                "RDC_BeginIOOperation: unknown device");
+		RDC_AbstractDevice* theDevice = RDC_LookUpIODevice(inDeviceObjectID);
+		ThrowIfNULL(theDevice,
+                    CAException(kAudioHardwareBadDeviceError),
+                    "RDC_BeginIOOperation: unknown device");
 		
 		//	tell the device to do the work
-		RDC_LookUpDevice(inDeviceObjectID).BeginIOOperation(inOperationID,
-                                                            inIOBufferFrameSize,
-                                                            *inIOCycleInfo,
-                                                            inClientID);
+		theDevice->BeginIOOperation(inOperationID,
+                                    inIOBufferFrameSize,
+                                    *inIOCycleInfo,
+                                    inClientID);
 	}
 	catch(const CAException& inException)
 	{
@@ -857,7 +880,7 @@ static OSStatus	RDC_BeginIOOperation(AudioServerPlugInDriverRef inDriver,
 	catch(...)
 	{
 		DebugMsg("RDC_PlugInInterface::RDC_BeginIOOperation: unknown exception. (device: %s, operation: %u)",
-				 (inDeviceObjectID == kObjectID_Device ? "RDCDevice" : "other"),
+				 (RDC_Device::LookUpInstance(inDeviceObjectID) != nullptr ? "RDCDevice" : "other"),
 				 inOperationID);
 		theAnswer = kAudioHardwareUnspecifiedError;
 	}
@@ -888,18 +911,19 @@ static OSStatus	RDC_DoIOOperation(AudioServerPlugInDriverRef inDriver,
 		ThrowIfNULL(inIOCycleInfo,
                     CAException(kAudioHardwareIllegalOperationError),
                     "RDC_EndIOOperation: no cycle info");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
-                CAException(kAudioHardwareBadDeviceError),
-                "RDC_EndIOOperation: unknown device");
+		RDC_AbstractDevice* theDevice = RDC_LookUpIODevice(inDeviceObjectID);
+		ThrowIfNULL(theDevice,
+                    CAException(kAudioHardwareBadDeviceError),
+                    "RDC_DoIOOperation: unknown device");
 		
 		//	tell the device to do the work
-		RDC_LookUpDevice(inDeviceObjectID).DoIOOperation(inStreamObjectID,
-                                                         inClientID,
-                                                         inOperationID,
-                                                         inIOBufferFrameSize,
-                                                         *inIOCycleInfo,
-                                                         ioMainBuffer,
-                                                         ioSecondaryBuffer);
+		theDevice->DoIOOperation(inStreamObjectID,
+                                 inClientID,
+                                 inOperationID,
+                                 inIOBufferFrameSize,
+                                 *inIOCycleInfo,
+                                 ioMainBuffer,
+                                 ioSecondaryBuffer);
 	}
 	catch(const CAException& inException)
 	{
@@ -908,7 +932,7 @@ static OSStatus	RDC_DoIOOperation(AudioServerPlugInDriverRef inDriver,
 	catch(...)
 	{
 		DebugMsg("RDC_PlugInInterface::RDC_DoIOOperation: unknown exception. (device: %s, operation: %u)",
-				 (inDeviceObjectID == kObjectID_Device ? "RDCDevice" : "other"),
+				 (RDC_Device::LookUpInstance(inDeviceObjectID) != nullptr ? "RDCDevice" : "other"),
 				 inOperationID);
 		theAnswer = kAudioHardwareUnspecifiedError;
 	}
@@ -936,15 +960,16 @@ static OSStatus	RDC_EndIOOperation(AudioServerPlugInDriverRef inDriver,
 		ThrowIfNULL(inIOCycleInfo,
                     CAException(kAudioHardwareIllegalOperationError),
                     "RDC_EndIOOperation: no cycle info");
-		ThrowIf(inDeviceObjectID != kObjectID_Device  && inDeviceObjectID != kObjectID_Device_Null,
-                CAException(kAudioHardwareBadDeviceError),
-                "RDC_EndIOOperation: unknown device");
+		RDC_AbstractDevice* theDevice = RDC_LookUpIODevice(inDeviceObjectID);
+		ThrowIfNULL(theDevice,
+                    CAException(kAudioHardwareBadDeviceError),
+                    "RDC_EndIOOperation: unknown device");
 		
 		//	tell the device to do the work
-		RDC_LookUpDevice(inDeviceObjectID).EndIOOperation(inOperationID,
-                                                          inIOBufferFrameSize,
-                                                          *inIOCycleInfo,
-                                                          inClientID);
+		theDevice->EndIOOperation(inOperationID,
+                                  inIOBufferFrameSize,
+                                  *inIOCycleInfo,
+                                  inClientID);
 	}
 	catch(const CAException& inException)
 	{
@@ -953,7 +978,7 @@ static OSStatus	RDC_EndIOOperation(AudioServerPlugInDriverRef inDriver,
 	catch(...)
 	{
 		DebugMsg("RDC_PlugInInterface::RDC_EndIOOperation: unknown exception. (device: %s, operation: %u)",
-				 (inDeviceObjectID == kObjectID_Device ? "RDCDevice" : "other"),
+				 (RDC_Device::LookUpInstance(inDeviceObjectID) != nullptr ? "RDCDevice" : "other"),
 				 inOperationID);
 		theAnswer = kAudioHardwareUnspecifiedError;
 	}
@@ -0,0 +1,623 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_RTPSender.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_RTPSender.h"
+
+// Local Includes
+#include "RDC_SampleConversion.h"
+#include "RDC_Utils.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+#include "CAHostTimeBase.h"
+
+// STL Includes
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+// System Includes
+#include <fcntl.h>
+#include <mach/mach.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+#pragma clang assume_nonnull begin
+
+// The DSCP value AES67 recommends for media packets (AF41), shifted into the TOS byte.
+static const int kRDCRTPTrafficClass = 34 << 2;
+
+static UInt32 RDC_GetRTPFramesPerPacket(Float64 inSampleRate, UInt32 inPacketTimeMicros)
+{
+    return std::max(1U, static_cast<UInt32>(std::lround(inSampleRate * inPacketTimeMicros / 1000000.0)));
+}
+
+// Returns the CFNumber for inKey in inConfiguration, or inDefault if it's missing.
+static UInt32 RDC_GetRTPSenderConfigurationNumber(CFDictionaryRef inConfiguration,
+                                                  CFStringRef inKey,
+                                                  UInt32 inDefault,
+                                                  UInt32 inMin,
+                                                  UInt32 inMax)
+{
+    CFTypeRef theValue = CFDictionaryGetValue(inConfiguration, inKey);
+
+    if(theValue == nullptr)
+    {
+        return inDefault;
+    }
+
+    SInt64 theNumber = 0;
+    ThrowIf(CFGetTypeID(theValue) != CFNumberGetTypeID() ||
+            !CFNumberGetValue(static_cast<CFNumberRef>(theValue), kCFNumberSInt64Type, &theNumber) ||
+            theNumber < inMin ||
+            theNumber > inMax,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_RTPSender::SetConfiguration: A number was invalid or out of range");
+
+    return static_cast<UInt32>(theNumber);
+}
+
+static void RDC_AddRTPSenderConfigurationNumber(CFMutableDictionaryRef ioConfiguration,
+                                                CFStringRef inKey,
+                                                UInt32 inNumber)
+{
+    CFNumberRef theNumberRef = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &inNumber);
+    if(theNumberRef != nullptr)
+    {
+        CFDictionarySetValue(ioConfiguration, inKey, theNumberRef);
+        CFRelease(theNumberRef);
+    }
+}
+
+RDC_RTPSender::RDC_RTPSender()
+:
+    mThread(&RDC_RTPSender::ThreadProc,
+            this,
+            kThreadPriority,
+            /* inFixedPriority = */ true,
+            /* inAutoDelete = */ false,
+            "RDC RTP Sender")
+{
+    kern_return_t theError = semaphore_create(mach_task_self(), &mWakeSemaphore, SYNC_POLICY_FIFO, 0);
+    RDC_Utils::ThrowIfMachError("RDC_RTPSender::RDC_RTPSender", "semaphore_create", theError);
+}
+
+RDC_RTPSender::~RDC_RTPSender()
+{
+    if(mThread.IsRunning())
+    {
+        mThreadShouldStop = true;
+        semaphore_signal(mWakeSemaphore);
+
+        // The thread is detached, so wait for it to return instead of joining it. It only blocks
+        // on the semaphore and mMutex, so this won't take long.
+        while(mThread.IsRunning())
+        {
+            usleep(1000);
+        }
+    }
+
+    CloseSocket();
+
+    kern_return_t theError = semaphore_destroy(mach_task_self(), mWakeSemaphore);
+    RDC_Utils::LogIfMachError("RDC_RTPSender::~RDC_RTPSender", "semaphore_destroy", theError);
+}
+
+void    RDC_RTPSender::SetConfiguration(CFDictionaryRef inConfiguration)
+{
+    if(CFDictionaryGetCount(inConfiguration) == 0)
+    {
+        DebugMsg("RDC_RTPSender::SetConfiguration: Stopping");
+
+        CAMutex::Locker theLocker(mMutex);
+        CloseSocket();
+        return;
+    }
+
+    // Check the configuration before changing anything.
+    CFTypeRef theAddressRef = CFDictionaryGetValue(inConfiguration, CFSTR(kRDCRTPSenderKey_Address));
+    ThrowIf(theAddressRef == nullptr || CFGetTypeID(theAddressRef) != CFStringGetTypeID(),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_RTPSender::SetConfiguration: The address is missing or isn't a CFString");
+
+    char theAddress[INET6_ADDRSTRLEN + IF_NAMESIZE + 1];
+    ThrowIf(!CFStringGetCString(static_cast<CFStringRef>(theAddressRef),
+                                theAddress,
+                                sizeof(theAddress),
+                                kCFStringEncodingUTF8),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_RTPSender::SetConfiguration: The address is too long");
+
+    UInt32 thePort = RDC_GetRTPSenderConfigurationNumber(inConfiguration,
+                                                         CFSTR(kRDCRTPSenderKey_Port),
+                                                         kRDCRTPSenderDefaultPort,
+                                                         1,
+                                                         UINT16_MAX);
+    UInt32 thePacketTimeMicros =
+            RDC_GetRTPSenderConfigurationNumber(inConfiguration,
+                                                CFSTR(kRDCRTPSenderKey_PacketTime),
+                                                kRDCRTPSenderDefaultPacketTimeMicros,
+                                                kRDCRTPSenderMinPacketTimeMicros,
+                                                kRDCRTPSenderMaxPacketTimeMicros);
+    // Only the dynamic payload types make sense for L24.
+    UInt32 thePayloadType = RDC_GetRTPSenderConfigurationNumber(inConfiguration,
+                                                                CFSTR(kRDCRTPSenderKey_PayloadType),
+                                                                kRDCRTPSenderDefaultPayloadType,
+                                                                96,
+                                                                127);
+    UInt32 theTTL = RDC_GetRTPSenderConfigurationNumber(inConfiguration,
+                                                        CFSTR(kRDCRTPSenderKey_TTL),
+                                                        kRDCRTPSenderDefaultTTL,
+                                                        1,
+                                                        UINT8_MAX);
+
+    char thePortString[8];
+    snprintf(thePortString, sizeof(thePortString), "%u", thePort);
+
+    addrinfo theHints = {};
+    theHints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    theHints.ai_family = AF_UNSPEC;
+    theHints.ai_socktype = SOCK_DGRAM;
+    theHints.ai_protocol = IPPROTO_UDP;
+
+    addrinfo* theAddressInfo = nullptr;
+    ThrowIf(getaddrinfo(theAddress, thePortString, &theHints, &theAddressInfo) != 0 ||
+            theAddressInfo == nullptr,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_RTPSender::SetConfiguration: The address isn't a numeric IPv4 or IPv6 address");
+
+    sockaddr_storage theDestination = {};
+    socklen_t theDestinationLength = theAddressInfo->ai_addrlen;
+    memcpy(&theDestination, theAddressInfo->ai_addr, theDestinationLength);
+    freeaddrinfo(theAddressInfo);
+
+    int theSocket = socket(theDestination.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    ThrowIf(theSocket < 0,
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_RTPSender::SetConfiguration: Couldn't create the socket");
+
+    // Drop packets rather than block the sender thread if the socket's buffer is full.
+    fcntl(theSocket, F_SETFL, fcntl(theSocket, F_GETFL) | O_NONBLOCK);
+
+    // These are only hints to the network, so it doesn't matter much if they fail.
+    if(theDestination.ss_family == AF_INET6)
+    {
+        int theHops = static_cast<int>(theTTL);
+        setsockopt(theSocket, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &theHops, sizeof(theHops));
+        setsockopt(theSocket, IPPROTO_IPV6, IPV6_TCLASS, &kRDCRTPTrafficClass, sizeof(kRDCRTPTrafficClass));
+    }
+    else
+    {
+        u_char theMulticastTTL = static_cast<u_char>(theTTL);
+        setsockopt(theSocket, IPPROTO_IP, IP_MULTICAST_TTL, &theMulticastTTL, sizeof(theMulticastTTL));
+        setsockopt(theSocket, IPPROTO_IP, IP_TOS, &kRDCRTPTrafficClass, sizeof(kRDCRTPTrafficClass));
+    }
+
+    CAMutex::Locker theLocker(mMutex);
+
+    if(mRingBuffer != nullptr &&
+       RDC_GetRTPFramesPerPacket(mSampleRate, thePacketTimeMicros) * mChannelCount * 3 > kRDCRTPSenderMaxPayloadBytes)
+    {
+        close(theSocket);
+        Throw(CAException(kAudioHardwareIllegalOperationError));
+    }
+
+    CloseSocket();
+
+    DebugMsg("RDC_RTPSender::SetConfiguration: Sending to %s port %u every %u us",
+             theAddress,
+             thePort,
+             thePacketTimeMicros);
+
+    mSocket = theSocket;
+    mIsSending = true;
+    mDestination = theDestination;
+    mDestinationLength = theDestinationLength;
+    mAddress = static_cast<CFStringRef>(theAddressRef);
+    mPort = static_cast<UInt16>(thePort);
+    mPacketTimeMicros = thePacketTimeMicros;
+    mPayloadType = static_cast<UInt8>(thePayloadType);
+    mTTL = static_cast<UInt8>(theTTL);
+    mDidLogSendError = false;
+
+    // A new stream, so a new source identifier and a random first sequence number (RFC 3550).
+    mSSRC = arc4random();
+    mSequenceNumber = static_cast<UInt16>(arc4random());
+
+    if(mRingBuffer != nullptr)
+    {
+        PrepareToSend();
+    }
+
+    if(!mThread.IsRunning())
+    {
+        mThread.Start();
+    }
+
+    semaphore_signal(mWakeSemaphore);
+}
+
+CFDictionaryRef RDC_RTPSender::CopyConfiguration() const
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    CFMutableDictionaryRef theConfiguration =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      0,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theConfiguration,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_RTPSender::CopyConfiguration: failed to create the dictionary");
+
+    if(mSocket >= 0)
+    {
+        CFDictionarySetValue(theConfiguration, CFSTR(kRDCRTPSenderKey_Address), mAddress.GetCFString());
+        RDC_AddRTPSenderConfigurationNumber(theConfiguration, CFSTR(kRDCRTPSenderKey_Port), mPort);
+        RDC_AddRTPSenderConfigurationNumber(theConfiguration, CFSTR(kRDCRTPSenderKey_PacketTime), mPacketTimeMicros);
+        RDC_AddRTPSenderConfigurationNumber(theConfiguration, CFSTR(kRDCRTPSenderKey_PayloadType), mPayloadType);
+        RDC_AddRTPSenderConfigurationNumber(theConfiguration, CFSTR(kRDCRTPSenderKey_TTL), mTTL);
+    }
+
+    return theConfiguration;
+}
+
+void    RDC_RTPSender::DetachSource()
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    mRingBuffer = nullptr;
+}
+
+void    RDC_RTPSender::AttachSource(CARingBuffer& inRingBuffer,
+                                    RDC_SampleFormat inFormat,
+                                    bool inIsPlanar,
+                                    Float64 inSampleRate,
+                                    UInt32 inChannelCount)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    mRingBuffer = &inRingBuffer;
+    mRingFormat = inFormat;
+    mRingIsPlanar = inIsPlanar;
+    mSampleRate = inSampleRate;
+    mChannelCount = inChannelCount;
+
+    if(mSocket >= 0)
+    {
+        if(RDC_GetRTPFramesPerPacket(mSampleRate, mPacketTimeMicros) * mChannelCount * 3 > kRDCRTPSenderMaxPayloadBytes)
+        {
+            LogError("RDC_RTPSender::AttachSource: Stopping because the packets would be too large for "
+                     "%u channels",
+                     mChannelCount);
+            CloseSocket();
+        }
+        else
+        {
+            PrepareToSend();
+        }
+    }
+}
+
+void    RDC_RTPSender::SetSourceIsRunning(bool inIsRunning)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    mSourceIsRunning = inIsRunning;
+
+    // Wake the thread so it goes back to waking every packet time or, if IO stopped, sends the
+    // packets that are left and then waits.
+    if(mThread.IsRunning())
+    {
+        semaphore_signal(mWakeSemaphore);
+    }
+}
+
+// static
+void* __nullable    RDC_RTPSender::ThreadProc(void* inRefCon)
+{
+    DebugMsg("RDC_RTPSender::ThreadProc: The sender thread has started");
+
+    RDC_RTPSender* refCon = static_cast<RDC_RTPSender*>(inRefCon);
+
+    while(!refCon->mThreadShouldStop)
+    {
+        UInt32 thePacketTimeMicros = 0;
+
+        {
+            CAMutex::Locker theLocker(refCon->mMutex);
+
+            if(refCon->mSocket >= 0)
+            {
+                if(refCon->mRingBuffer != nullptr)
+                {
+                    refCon->SendAvailablePackets();
+                }
+
+                // Nothing is written to the ring buffer while the source is stopped, so there's no
+                // reason to wake up until it starts again.
+                if(refCon->mSourceIsRunning)
+                {
+                    thePacketTimeMicros = refCon->mPacketTimeMicros;
+                }
+            }
+        }
+
+        // Wake up after one packet time, or wait to be started if the sender or its source is
+        // stopped. Waking late
+        // only delays packets. Their timestamps come from the ring buffer's sample times.
+        kern_return_t theError;
+
+        if(thePacketTimeMicros == 0)
+        {
+            theError = semaphore_wait(refCon->mWakeSemaphore);
+        }
+        else
+        {
+            theError = semaphore_timedwait(refCon->mWakeSemaphore,
+                                           (mach_timespec_t){ 0, static_cast<clock_res_t>(thePacketTimeMicros * NSEC_PER_USEC) });
+        }
+
+        if(theError != KERN_OPERATION_TIMED_OUT &&
+           !RDC_Utils::LogIfMachError("RDC_RTPSender::ThreadProc", "semaphore_wait", theError))
+        {
+            break;
+        }
+    }
+
+    DebugMsg("RDC_RTPSender::ThreadProc: The sender thread is stopping");
+
+    return nullptr;
+}
+
+void    RDC_RTPSender::SendAvailablePackets()
+{
+    CARingBuffer::SampleTime theStartTime, theEndTime;
+    if(mRingBuffer->GetTimeBounds(theStartTime, theEndTime) != kCARingBufferError_OK)
+    {
+        return;
+    }
+
+    CARingBuffer::SampleTime theMaxBacklog =
+            std::max(static_cast<CARingBuffer::SampleTime>(mFramesPerPacket),
+                     static_cast<CARingBuffer::SampleTime>(mSampleRate * kMaxBacklogMs / 1000));
+
+    if(mIsStreaming)
+    {
+        if(mNextSampleTime < theStartTime || theEndTime - mNextSampleTime > theMaxBacklog)
+        {
+            // Too far behind the writer, so skip to the newest frames.
+            CARingBuffer::SampleTime theSkippedFrames = theEndTime - mFramesPerPacket - mNextSampleTime;
+            mFramesSkipped.fetch_add(static_cast<UInt64>(std::max(theSkippedFrames, CARingBuffer::SampleTime(0))),
+                                     std::memory_order_relaxed);
+            mIsStreaming = false;
+        }
+        else if(mNextSampleTime > theEndTime)
+        {
+            // The sample times went backwards, e.g. because IO restarted.
+            mIsStreaming = false;
+        }
+    }
+
+    if(!mIsStreaming)
+    {
+        if(theEndTime - theStartTime < mFramesPerPacket)
+        {
+            return;
+        }
+
+        // Start with the newest whole packet, and base the RTP timestamps on the current host time
+        // in frames.
+        mNextSampleTime = theEndTime - mFramesPerPacket;
+
+        UInt64 theHostTimeFrames =
+                static_cast<UInt64>(CAHostTimeBase::ConvertToNanos(CAHostTimeBase::GetTheCurrentTime()) *
+                                    (mSampleRate / NSEC_PER_SEC));
+        // Only the low 32 bits are sent, so it's fine that this wraps.
+        mTimestampOffset = static_cast<UInt32>(theHostTimeFrames - static_cast<UInt64>(mNextSampleTime));
+
+        mMarksNextPacket = true;
+        mIsStreaming = true;
+    }
+
+    while(mNextSampleTime + mFramesPerPacket <= theEndTime)
+    {
+        SendPacket(mNextSampleTime);
+        mNextSampleTime += mFramesPerPacket;
+    }
+}
+
+void    RDC_RTPSender::SendPacket(CARingBuffer::SampleTime inSampleTime)
+{
+    UInt32 theSamples = mFramesPerPacket * mChannelCount;
+    Byte* thePacket = mPacket.data();
+    Byte* thePayload = thePacket + kRTPHeaderBytes;
+
+    if(mRingIsPlanar)
+    {
+        FetchPlanar(inSampleTime);
+    }
+    else
+    {
+        if(mRingBuffer->FetchInterleaved(mFetchBuffer.data(), mFramesPerPacket, inSampleTime) !=
+           kCARingBufferError_OK)
+        {
+            // The writer overwrote the frames while they were being read. Send silence.
+            memset(mFetchBuffer.data(), 0, mFetchBuffer.size());
+        }
+    }
+
+    // Convert to native-endian Int24 in the payload, unless they're already in that format.
+    if(mRingFormat == kRDCSampleFormat_Int24)
+    {
+        memcpy(thePayload, mFetchBuffer.data(), theSamples * 3);
+    }
+    else
+    {
+        const Float32* theFloatSamples = reinterpret_cast<const Float32*>(mFetchBuffer.data());
+
+        if(mRingFormat != kRDCSampleFormat_Float32)
+        {
+            RDC_SampleConversion::ConvertToFloat32(mRingFormat,
+                                                   mFetchBuffer.data(),
+                                                   mConversionBuffer.data(),
+                                                   theSamples);
+            theFloatSamples = mConversionBuffer.data();
+        }
+
+        RDC_SampleConversion::ConvertFromFloat32(theFloatSamples,
+                                                 kRDCSampleFormat_Int24,
+                                                 thePayload,
+                                                 theSamples,
+                                                 mScratchBuffer.data());
+    }
+
+#if TARGET_RT_LITTLE_ENDIAN
+    // L24 is big-endian.
+    for(UInt32 i = 0; i < theSamples; i++)
+    {
+        std::swap(thePayload[i * 3], thePayload[i * 3 + 2]);
+    }
+#endif
+
+    // The fixed RTP header: version 2, no padding, extensions or CSRCs.
+    UInt16 theSequenceNumber = CFSwapInt16HostToBig(mSequenceNumber++);
+    UInt32 theTimestamp = CFSwapInt32HostToBig(static_cast<UInt32>(inSampleTime) + mTimestampOffset);
+    UInt32 theSSRC = CFSwapInt32HostToBig(mSSRC);
+
+    thePacket[0] = 0x80;
+    thePacket[1] = static_cast<Byte>((mMarksNextPacket ? 0x80 : 0) | mPayloadType);
+    memcpy(thePacket + 2, &theSequenceNumber, sizeof(theSequenceNumber));
+    memcpy(thePacket + 4, &theTimestamp, sizeof(theTimestamp));
+    memcpy(thePacket + 8, &theSSRC, sizeof(theSSRC));
+
+    mMarksNextPacket = false;
+
+    ssize_t theSentBytes = sendto(mSocket,
+                                  thePacket,
+                                  mPacket.size(),
+                                  0,
+                                  reinterpret_cast<const sockaddr*>(&mDestination),
+                                  mDestinationLength);
+
+    if(theSentBytes < 0)
+    {
+        // Usually because the network is down, so only log the first one.
+        if(!mDidLogSendError)
+        {
+            LogWarning("RDC_RTPSender::SendPacket: sendto failed (%d)", errno);
+            mDidLogSendError = true;
+        }
+    }
+    else
+    {
+        mPacketsSent.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void    RDC_RTPSender::FetchPlanar(CARingBuffer::SampleTime inSampleTime)
+{
+    UInt32 theChannelBytes = mFramesPerPacket * RDC_SampleConversion::BytesPerSample(mRingFormat);
+    AudioBufferList* theBufferList = reinterpret_cast<AudioBufferList*>(mPlanarBufferList.data());
+
+    // Fetch changes the sizes, so they have to be reset every time.
+    for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+    {
+        theBufferList->mBuffers[theChannel].mDataByteSize = theChannelBytes;
+    }
+
+    if(mRingBuffer->Fetch(theBufferList, mFramesPerPacket, inSampleTime) != kCARingBufferError_OK)
+    {
+        // The writer overwrote the frames while they were being read. Send silence.
+        memset(mFetchBuffer.data(), 0, mFetchBuffer.size());
+        return;
+    }
+
+    for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+    {
+        RDC_SampleConversion::InterleaveChannel(mRingFormat,
+                                                theBufferList->mBuffers[theChannel].mData,
+                                                theChannel,
+                                                mChannelCount,
+                                                mFetchBuffer.data(),
+                                                mFramesPerPacket);
+    }
+}
+
+void    RDC_RTPSender::PrepareToSend()
+{
+    mFramesPerPacket = RDC_GetRTPFramesPerPacket(mSampleRate, mPacketTimeMicros);
+
+    UInt32 theSamples = mFramesPerPacket * mChannelCount;
+    mFetchBuffer.resize(theSamples * RDC_SampleConversion::BytesPerSample(mRingFormat));
+
+    if(mRingIsPlanar)
+    {
+        UInt32 theChannelBytes = mFramesPerPacket * RDC_SampleConversion::BytesPerSample(mRingFormat);
+
+        mPlanarBuffer.resize(mChannelCount * theChannelBytes);
+        mPlanarBufferList.resize(offsetof(AudioBufferList, mBuffers) + mChannelCount * sizeof(AudioBuffer));
+
+        AudioBufferList* theBufferList = reinterpret_cast<AudioBufferList*>(mPlanarBufferList.data());
+        theBufferList->mNumberBuffers = mChannelCount;
+
+        for(UInt32 theChannel = 0; theChannel < mChannelCount; theChannel++)
+        {
+            theBufferList->mBuffers[theChannel].mNumberChannels = 1;
+            theBufferList->mBuffers[theChannel].mDataByteSize = theChannelBytes;
+            theBufferList->mBuffers[theChannel].mData = mPlanarBuffer.data() + theChannel * theChannelBytes;
+        }
+    }
+    else
+    {
+        mPlanarBuffer.clear();
+        mPlanarBufferList.clear();
+    }
+    mConversionBuffer.resize(theSamples);
+    mScratchBuffer.resize(theSamples);
+    mPacket.resize(kRTPHeaderBytes + theSamples * 3);
+
+    mIsStreaming = false;
+}
+
+void    RDC_RTPSender::CloseSocket()
+{
+    if(mSocket >= 0)
+    {
+        close(mSocket);
+        mSocket = -1;
+    }
+
+    mIsSending = false;
+    mIsStreaming = false;
+}
+
+#pragma clang assume_nonnull end
+
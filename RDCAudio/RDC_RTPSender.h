@@ -0,0 +1,201 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_RTPSender.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_RTPSender__
+#define __RDCDriver__RDC_RTPSender__
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CACFString.h"
+#include "CAMutex.h"
+#include "CAPThread.h"
+#include "CARingBuffer.h"
+
+// STL Includes
+#include <atomic>
+#include <vector>
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+#include <mach/semaphore.h>
+#include <sys/socket.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_RTPSender
+//
+//  Sends the loopback audio over the network as RTP, in the AES67 format: L24 (big-endian, 24-bit
+//  PCM) at the device's sample rate, one packet every packet time. See
+//  kAudioDeviceCustomPropertyRTPSender.
+//
+//  The sender has its own thread, which reads the loopback ring buffer directly, so the audio
+//  doesn't have to go through the input stream and a HAL client first. It wakes once per packet
+//  time and sends every whole packet that's been written to the ring since it last woke. The IO
+//  threads aren't involved at all. While the device's IO is stopped, the thread doesn't wake at
+//  all.
+//
+//  The RTP timestamps are the ring's sample times plus an offset chosen when the stream starts, so
+//  the media clock follows the loopback clock's sample times and starts at the host time, in
+//  frames, when the first packet was sent. There's no PTP, so receivers that need AES67's PTP
+//  alignment have to be synchronised some other way.
+//==================================================================================================
+
+class RDC_RTPSender
+{
+
+public:
+                                        RDC_RTPSender();
+                                        ~RDC_RTPSender();
+                                        // Disallow copying
+                                        RDC_RTPSender(const RDC_RTPSender&) = delete;
+                                        RDC_RTPSender& operator=(const RDC_RTPSender&) = delete;
+
+    /*!
+     Start sending to the destination in inConfiguration, replacing the current one, or stop
+     sending if inConfiguration is empty. Takes effect immediately.
+
+     @param inConfiguration A CFDictionary with the kRDCRTPSenderKey_* keys.
+     @throws CAException If one of the values is invalid, the packets would be too large or the
+                         socket couldn't be created.
+     */
+    void                                SetConfiguration(CFDictionaryRef inConfiguration);
+    /*!
+     @return A new CFDictionary with the kRDCRTPSenderKey_* keys, or an empty one if the sender is
+             stopped. The caller is responsible for releasing it.
+     */
+    CFDictionaryRef                     CopyConfiguration() const;
+
+    /*!
+     Stop reading the ring buffer. Blocks until the sender thread has finished with it. Must be
+     called before the ring buffer is reallocated or cleared. The sender keeps its configuration.
+     */
+    void                                DetachSource();
+    /*!
+     Start reading inRingBuffer, which stores frames in inFormat, after DetachSource. The stream
+     restarts from the newest frames in the ring buffer.
+
+     @param inIsPlanar True if inRingBuffer has a buffer for each channel, rather than one buffer
+                       of interleaved frames.
+     */
+    void                                AttachSource(CARingBuffer& inRingBuffer,
+                                                     RDC_SampleFormat inFormat,
+                                                     bool inIsPlanar,
+                                                     Float64 inSampleRate,
+                                                     UInt32 inChannelCount);
+
+    /*!
+     Tell the sender whether the device is doing IO, i.e. whether frames are being written to the
+     ring buffer. While they aren't, the sender thread sleeps until this is called again instead of
+     waking every packet time. False initially.
+     */
+    void                                SetSourceIsRunning(bool inIsRunning);
+
+    /*! @return True if the sender has a destination, i.e. it's reading the ring buffer. Real-time safe. */
+    bool                                IsSendingRT() const { return mIsSending.load(std::memory_order_relaxed); }
+
+    UInt64                              GetPacketsSent() const { return mPacketsSent.load(std::memory_order_relaxed); }
+    /*! @return The number of frames skipped because the sender fell too far behind the writer. */
+    UInt64                              GetFramesSkipped() const { return mFramesSkipped.load(std::memory_order_relaxed); }
+
+private:
+    static void* __nullable             ThreadProc(void* inRefCon);
+    // mMutex must be held by the caller for these.
+    // Sends every whole packet in the ring buffer that hasn't been sent.
+    void                                SendAvailablePackets();
+    // Fetch a packet's frames from a planar ring buffer and interleave them into mFetchBuffer.
+    void                                FetchPlanar(CARingBuffer::SampleTime inSampleTime);
+    void                                SendPacket(CARingBuffer::SampleTime inSampleTime);
+    // Sizes the buffers and the packet for the current format and packet time, and restarts the
+    // stream.
+    void                                PrepareToSend();
+    void                                CloseSocket();
+
+public:
+    static const UInt32                 kRTPHeaderBytes = 12;
+    // If more than this much audio is waiting, the sender restarts the stream at the newest frames
+    // instead of sending it all, to keep the latency low.
+    static const UInt32                 kMaxBacklogMs = 50;
+
+private:
+    static const UInt32                 kThreadPriority = 47;
+
+    CAPThread                           mThread;
+    // Signalled to wake the thread early, when the sender is started or destroyed.
+    semaphore_t                         mWakeSemaphore;
+    std::atomic<bool>                   mThreadShouldStop { false };
+
+    // Guards everything below. Held by the thread while it's sending, so DetachSource can wait for
+    // it to stop reading the ring buffer.
+    mutable CAMutex                     mMutex { "RTP Sender" };
+
+    // The configuration. mSocket is -1 while the sender is stopped.
+    int                                 mSocket = -1;
+    sockaddr_storage                    mDestination = {};
+    socklen_t                           mDestinationLength = 0;
+    CACFString                          mAddress;
+    UInt16                              mPort = 0;
+    UInt32                              mPacketTimeMicros = 0;
+    UInt8                               mPayloadType = 0;
+    UInt8                               mTTL = 0;
+
+    // The source, or null while it's detached.
+    CARingBuffer* __nullable            mRingBuffer = nullptr;
+    RDC_SampleFormat                    mRingFormat = kRDCSampleFormat_Float32;
+    bool                                mRingIsPlanar = false;
+    Float64                             mSampleRate = 0.0;
+    UInt32                              mChannelCount = 0;
+    bool                                mSourceIsRunning = false;
+
+    // The stream.
+    UInt32                              mFramesPerPacket = 0;
+    bool                                mIsStreaming = false;
+    CARingBuffer::SampleTime            mNextSampleTime = 0;
+    UInt32                              mTimestampOffset = 0;
+    UInt16                              mSequenceNumber = 0;
+    // Set for the first packet after the stream (re)starts, which has the RTP marker bit.
+    bool                                mMarksNextPacket = false;
+    UInt32                              mSSRC = 0;
+    bool                                mDidLogSendError = false;
+
+    std::vector<Byte>                   mFetchBuffer;
+    // The channels, one after the other, and the AudioBufferList that points to them, if the ring
+    // buffer is planar. The frames are interleaved into mFetchBuffer after they're fetched.
+    std::vector<Byte>                   mPlanarBuffer;
+    std::vector<Byte>                   mPlanarBufferList;
+    std::vector<Float32>                mConversionBuffer;
+    std::vector<Float32>                mScratchBuffer;
+    std::vector<Byte>                   mPacket;
+
+    // True while mSocket is open, for reading without mMutex.
+    std::atomic<bool>                   mIsSending { false };
+
+    std::atomic<UInt64>                 mPacketsSent { 0 };
+    std::atomic<UInt64>                 mFramesSkipped { 0 };
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_RTPSender__ */
+
@@ -0,0 +1,249 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  RDC_RTSafety.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_RTSafety.h"
+
+#if RDC_RT_SAFETY_CHECKS
+
+// PublicUtility Includes
+#include "CADebugMacros.h"
+#include "CAMutex.h"
+#include "CACFString.h"
+
+// System Includes
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+#include <pthread.h>
+
+
+#pragma clang assume_nonnull begin
+
+// The number of Scopes the current thread is in, and whether it's reporting a violation, so the
+// logging can't report itself. Thread-specific data rather than thread_locals, because the malloc
+// hooks read them on every thread and the first access to a thread_local can allocate.
+static pthread_key_t        sScopeDepthKey;
+static pthread_key_t        sIsReportingKey;
+
+static UInt32 RDC_RTSafety_GetScopeDepth()
+{
+    return static_cast<UInt32>(reinterpret_cast<uintptr_t>(pthread_getspecific(sScopeDepthKey)));
+}
+
+static void RDC_RTSafety_SetScopeDepth(UInt32 inDepth)
+{
+    pthread_setspecific(sScopeDepthKey, reinterpret_cast<void*>(static_cast<uintptr_t>(inDepth)));
+}
+
+#pragma mark Allocation
+
+// The default malloc zone's functions are swapped for these once, when the driver is loaded, and
+// left in place. Every allocation in the process goes through them, but they only report the ones
+// made by threads in a Scope, which costs one pthread_getspecific per call. That covers operator
+// new/delete, the STL and most system libraries, which all allocate from the default zone.
+static malloc_zone_t        sOriginalZone;
+
+static void* __nullable RDC_RTSafety_Malloc(malloc_zone_t* inZone, size_t inSize)
+{
+    RDC_RTSafety::CheckForViolation("Heap allocation");
+    return sOriginalZone.malloc(inZone, inSize);
+}
+
+static void* __nullable RDC_RTSafety_Calloc(malloc_zone_t* inZone, size_t inCount, size_t inSize)
+{
+    RDC_RTSafety::CheckForViolation("Heap allocation");
+    return sOriginalZone.calloc(inZone, inCount, inSize);
+}
+
+static void* __nullable RDC_RTSafety_Valloc(malloc_zone_t* inZone, size_t inSize)
+{
+    RDC_RTSafety::CheckForViolation("Heap allocation");
+    return sOriginalZone.valloc(inZone, inSize);
+}
+
+static void* __nullable RDC_RTSafety_Realloc(malloc_zone_t* inZone, void* __nullable inPointer, size_t inSize)
+{
+    RDC_RTSafety::CheckForViolation("Heap reallocation");
+    return sOriginalZone.realloc(inZone, inPointer, inSize);
+}
+
+static void* __nullable RDC_RTSafety_Memalign(malloc_zone_t* inZone, size_t inAlignment, size_t inSize)
+{
+    RDC_RTSafety::CheckForViolation("Heap allocation");
+    return sOriginalZone.memalign(inZone, inAlignment, inSize);
+}
+
+static void RDC_RTSafety_Free(malloc_zone_t* inZone, void* __nullable inPointer)
+{
+    if(inPointer != nullptr)
+    {
+        RDC_RTSafety::CheckForViolation("Heap deallocation");
+    }
+
+    sOriginalZone.free(inZone, inPointer);
+}
+
+static void RDC_RTSafety_FreeDefiniteSize(malloc_zone_t* inZone, void* inPointer, size_t inSize)
+{
+    RDC_RTSafety::CheckForViolation("Heap deallocation");
+    sOriginalZone.free_definite_size(inZone, inPointer, inSize);
+}
+
+// Copies inFunctions' allocation functions into the zone. The zone's memory is usually read-only, so
+// it's made writable while they're changed and then given its original protection back.
+static void RDC_RTSafety_SetZoneFunctions(malloc_zone_t* inZone, const malloc_zone_t& inFunctions)
+{
+    vm_address_t theAddress = reinterpret_cast<vm_address_t>(inZone);
+
+    // Find the zone's current protection. vm_region returns the region containing theAddress, or
+    // the next one if no region contains it.
+    vm_address_t theRegionAddress = theAddress;
+    vm_size_t theRegionSize = 0;
+    vm_region_basic_info_data_64_t theRegionInfo;
+    mach_msg_type_number_t theInfoCount = VM_REGION_BASIC_INFO_COUNT_64;
+    mach_port_t theObjectName = MACH_PORT_NULL;
+    kern_return_t theError = vm_region_64(mach_task_self(),
+                                          &theRegionAddress,
+                                          &theRegionSize,
+                                          VM_REGION_BASIC_INFO_64,
+                                          reinterpret_cast<vm_region_info_t>(&theRegionInfo),
+                                          &theInfoCount,
+                                          &theObjectName);
+
+    if(theError != KERN_SUCCESS || theRegionAddress > theAddress)
+    {
+        DebugMsg("RDC_RTSafety_SetZoneFunctions: vm_region_64 failed (%d). Not checking allocations.",
+                 theError);
+        return;
+    }
+
+    theError = vm_protect(mach_task_self(),
+                          theAddress,
+                          sizeof(malloc_zone_t),
+                          false,
+                          theRegionInfo.protection | VM_PROT_WRITE);
+
+    if(theError != KERN_SUCCESS)
+    {
+        DebugMsg("RDC_RTSafety_SetZoneFunctions: vm_protect failed (%d). Not checking allocations.",
+                 theError);
+        return;
+    }
+
+    inZone->malloc = inFunctions.malloc;
+    inZone->calloc = inFunctions.calloc;
+    inZone->valloc = inFunctions.valloc;
+    inZone->realloc = inFunctions.realloc;
+    inZone->free = inFunctions.free;
+
+    if(inZone->version >= 5)
+    {
+        inZone->memalign = inFunctions.memalign;
+    }
+
+    if(inZone->version >= 6)
+    {
+        inZone->free_definite_size = inFunctions.free_definite_size;
+    }
+
+    vm_protect(mach_task_self(), theAddress, sizeof(malloc_zone_t), false, theRegionInfo.protection);
+}
+
+static void RDC_RTSafety_InstallZoneHooks()
+{
+    malloc_zone_t* theZone = malloc_default_zone();
+
+    // The zone's own functions, which the hooks call. Copied before the hooks are installed, since
+    // other threads can allocate as soon as they are.
+    sOriginalZone = *theZone;
+
+    malloc_zone_t theHooks = sOriginalZone;
+    theHooks.malloc = RDC_RTSafety_Malloc;
+    theHooks.calloc = RDC_RTSafety_Calloc;
+    theHooks.valloc = RDC_RTSafety_Valloc;
+    theHooks.realloc = RDC_RTSafety_Realloc;
+    theHooks.free = RDC_RTSafety_Free;
+    theHooks.memalign = (theZone->version >= 5) ? RDC_RTSafety_Memalign : nullptr;
+    theHooks.free_definite_size = (theZone->version >= 6) ? RDC_RTSafety_FreeDefiniteSize : nullptr;
+
+    RDC_RTSafety_SetZoneFunctions(theZone, theHooks);
+}
+
+#pragma mark Scopes
+
+// Entering and leaving a Scope only changes thread-specific data, so it takes no locks and makes no
+// system calls on the IO thread.
+RDC_RTSafety::Scope::Scope()
+{
+    RDC_RTSafety_SetScopeDepth(RDC_RTSafety_GetScopeDepth() + 1);
+}
+
+RDC_RTSafety::Scope::~Scope()
+{
+    RDC_RTSafety_SetScopeDepth(RDC_RTSafety_GetScopeDepth() - 1);
+}
+
+bool    RDC_RTSafety::IsCurrentThreadInScope()
+{
+    return RDC_RTSafety_GetScopeDepth() > 0;
+}
+
+void    RDC_RTSafety::CheckForViolation(const char* inWhat, const char* __nullable inDetail)
+{
+    if(RDC_RTSafety_GetScopeDepth() > 0 && pthread_getspecific(sIsReportingKey) == nullptr)
+    {
+        pthread_setspecific(sIsReportingKey, reinterpret_cast<void*>(1));
+        LogError("RDC_RTSafety::CheckForViolation: %s on a real-time thread%s%s",
+                 inWhat,
+                 (inDetail != nullptr ? ": " : ""),
+                 (inDetail != nullptr ? inDetail : ""));
+        __ASSERT_STOP;
+        pthread_setspecific(sIsReportingKey, nullptr);
+    }
+}
+
+static void RDC_RTSafety_MutexWouldBlock(const char* inName)
+{
+    RDC_RTSafety::CheckForViolation("Blocking on a CAMutex", inName);
+}
+
+static void RDC_RTSafety_CFStringRetainOrRelease(const char* inOperation)
+{
+    RDC_RTSafety::CheckForViolation("CACFString", inOperation);
+}
+
+// Install the hooks while the bundle is being loaded, before the driver starts any threads.
+__attribute__((constructor))
+static void RDC_RTSafety_InstallHooks()
+{
+    pthread_key_create(&sScopeDepthKey, nullptr);
+    pthread_key_create(&sIsReportingKey, nullptr);
+
+    RDC_RTSafety_InstallZoneHooks();
+
+    CAMutex::SetWouldBlockHandler(RDC_RTSafety_MutexWouldBlock);
+    CACFString::SetRetainHandler(RDC_RTSafety_CFStringRetainOrRelease);
+}
+
+#pragma clang assume_nonnull end
+
+#endif /* RDC_RT_SAFETY_CHECKS */
+
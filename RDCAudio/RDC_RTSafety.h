@@ -0,0 +1,100 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+
+//
+//  RDC_RTSafety.h
+//  RDCDriver
+//
+//  Debug checks for code that has to be real-time safe. The IO functions and the realtime worker
+//  thread mark themselves with an RDC_RTSafety::Scope, and while a thread is in one, these are
+//  reported as violations:
+//
+//    - Allocating or freeing from the default malloc zone, which operator new/delete, the STL
+//      containers and most system libraries use. The zone's functions are hooked once, when the
+//      driver is loaded, and the hooks check whether the calling thread is in a Scope. Entering
+//      and leaving a Scope only updates thread-specific data.
+//    - Locking a CAMutex another thread holds, i.e. a lock that actually blocks. (Taking a free
+//      mutex isn't reported, since it can't be told apart from an uncontended lock elsewhere.)
+//    - Retaining or releasing a CFString through CACFString, which is how the driver holds the CF
+//      objects (mostly bundle IDs) that could otherwise end up on the IO thread.
+//
+//  A violation is logged with the name of what happened and, if CoreAudio_StopOnAssert is set,
+//  stops in the debugger, the same as RDCAssert. Allocations from other malloc zones, and CF calls
+//  that don't go through CACFString, aren't caught.
+//
+//  Only compiled in when RDC_RT_SAFETY_CHECKS is true, which it is for debug builds. Otherwise a
+//  Scope is empty and everything here compiles away.
+//
+
+#ifndef __RDCDriver__RDC_RTSafety__
+#define __RDCDriver__RDC_RTSafety__
+
+// System Includes
+#include <MacTypes.h>
+
+
+#ifndef RDC_RT_SAFETY_CHECKS
+    #if DEBUG
+        #define RDC_RT_SAFETY_CHECKS 1
+    #else
+        #define RDC_RT_SAFETY_CHECKS 0
+    #endif
+#endif
+
+#pragma clang assume_nonnull begin
+
+class RDC_RTSafety
+{
+
+public:
+    /*!
+     Marks the current thread as running real-time code for as long as it exists. Scopes can be
+     nested.
+     */
+    class Scope
+    {
+    public:
+#if RDC_RT_SAFETY_CHECKS
+                                        Scope();
+                                        ~Scope();
+#else
+                                        Scope() {}
+#endif
+                                        // Disallow copying
+                                        Scope(const Scope&) = delete;
+                                        Scope& operator=(const Scope&) = delete;
+    };
+
+#if RDC_RT_SAFETY_CHECKS
+    /*! @return True if the current thread is in a Scope. */
+    static bool                         IsCurrentThreadInScope();
+
+    /*!
+     Report something that isn't real-time safe, if the current thread is in a Scope.
+
+     @param inWhat What happened, e.g. "Heap allocation".
+     @param inDetail Logged after inWhat, e.g. the name of the mutex. Can be null.
+     */
+    static void                         CheckForViolation(const char* inWhat,
+                                                          const char* __nullable inDetail = nullptr);
+#endif
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_RTSafety__ */
+
@@ -0,0 +1,415 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_Recorder.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_Recorder.h"
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+
+// STL Includes
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// System Includes
+#include <CoreAudio/AudioHardwareBase.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#pragma clang assume_nonnull begin
+
+// The CAF header is padded with a free chunk so the audio starts on a page boundary. The layout is
+// the file header (8 bytes), the desc chunk (12 + 32), the free chunk (12 + padding) and the data
+// chunk's header (12) and edit count (4).
+static const UInt32 kCAFHeaderSize = RDC_Recorder::kCAFHeaderSize;
+static const UInt32 kCAFDescChunkSize = 32;
+static const UInt32 kCAFFreeChunkSize = kCAFHeaderSize - (8 + 12 + kCAFDescChunkSize + 12 + 12 + 4);
+// Where the data chunk's size is, so it can be filled in when the recording stops.
+static const off_t kCAFDataChunkSizeOffset = 8 + 12 + kCAFDescChunkSize + 12 + kCAFFreeChunkSize + 4;
+
+// From CoreAudioTypes' CAF definitions.
+static const UInt32 kRDCCAFLinearPCMFormatFlagIsFloat        = (1L << 0);
+static const UInt32 kRDCCAFLinearPCMFormatFlagIsLittleEndian = (1L << 1);
+
+// All of the fields are big-endian.
+void    RDC_Recorder::CreateCAFHeader(Byte* outHeader,
+                                      Float64 inSampleRate,
+                                      UInt32 inChannelCount,
+                                      UInt64 inAudioBytes)
+{
+    Byte* theNext = outHeader;
+
+    auto append32 = [&theNext](UInt32 inValue) {
+        UInt32 theValue = CFSwapInt32HostToBig(inValue);
+        memcpy(theNext, &theValue, sizeof(theValue));
+        theNext += sizeof(theValue);
+    };
+    auto append64 = [&theNext](UInt64 inValue) {
+        UInt64 theValue = CFSwapInt64HostToBig(inValue);
+        memcpy(theNext, &theValue, sizeof(theValue));
+        theNext += sizeof(theValue);
+    };
+
+    // The file header: the file type, version 1 and no flags.
+    append32('caff');
+    append32(1 << 16);
+
+    UInt64 theSampleRateBits;
+    memcpy(&theSampleRateBits, &inSampleRate, sizeof(theSampleRateBits));
+
+    UInt32 theFormatFlags = kRDCCAFLinearPCMFormatFlagIsFloat;
+#if TARGET_RT_LITTLE_ENDIAN
+    theFormatFlags |= kRDCCAFLinearPCMFormatFlagIsLittleEndian;
+#endif
+
+    append32('desc');
+    append64(kCAFDescChunkSize);
+    append64(theSampleRateBits);
+    append32('lpcm');
+    append32(theFormatFlags);
+    append32(inChannelCount * sizeof(Float32));  // Bytes per packet
+    append32(1);                                 // Frames per packet
+    append32(inChannelCount);
+    append32(32);                                // Bits per channel
+
+    append32('free');
+    append64(kCAFFreeChunkSize);
+    memset(theNext, 0, kCAFFreeChunkSize);
+    theNext += kCAFFreeChunkSize;
+
+    // -1 means the size isn't known yet. The size includes the edit count.
+    append32('data');
+    append64(inAudioBytes == kCAFUnknownSize ? static_cast<UInt64>(-1) : inAudioBytes + 4);
+    append32(0);  // The edit count
+
+    Assert(theNext == outHeader + kCAFHeaderSize, "RDC_Recorder::CreateCAFHeader: Wrong header size");
+}
+
+RDC_Recorder::~RDC_Recorder()
+{
+    CAMutex::Locker theLocker(mFileMutex);
+    StopNonRT();
+}
+
+void    RDC_Recorder::SetPathNonRT(CFStringRef inPath, Float64 inSampleRate, UInt32 inChannelCount)
+{
+    CAMutex::Locker theLocker(mFileMutex);
+
+    StopNonRT();
+
+    if(CFStringGetLength(inPath) == 0)
+    {
+        return;
+    }
+
+    char thePath[MAXPATHLEN];
+    ThrowIf(!CFStringGetFileSystemRepresentation(inPath, thePath, sizeof(thePath)),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Recorder::SetPathNonRT: Invalid path");
+
+    // Size the FIFO for the format, in whole write blocks so each block is contiguous.
+    UInt64 theBytesPerSecond = static_cast<UInt64>(inSampleRate) * inChannelCount * sizeof(Float32);
+    UInt64 theFIFOSize = (theBytesPerSecond * kFIFOSeconds + kWriteSize - 1) / kWriteSize * kWriteSize;
+
+    if(theFIFOSize != mFIFOSize)
+    {
+        void* theFIFO = nullptr;
+        ThrowIf(posix_memalign(&theFIFO, static_cast<size_t>(getpagesize()), theFIFOSize) != 0,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_Recorder::SetPathNonRT: Couldn't allocate the FIFO");
+
+        // Touch every page now so StoreRT never page faults.
+        memset(theFIFO, 0, theFIFOSize);
+
+        mFIFO.reset(static_cast<Byte*>(theFIFO));
+        mFIFOSize = theFIFOSize;
+    }
+
+    int theFD = CreateOutputFile(thePath);
+
+    // The file is only written once and read later, so there's no point caching it.
+    fcntl(theFD, F_NOCACHE, 1);
+
+    Byte theHeader[kCAFHeaderSize];
+    // StopNonRT fills in the size.
+    CreateCAFHeader(theHeader, inSampleRate, inChannelCount, kCAFUnknownSize);
+
+    if(write(theFD, theHeader, kCAFHeaderSize) != kCAFHeaderSize)
+    {
+        close(theFD);
+        unlink(thePath);
+        Throw(CAException(kAudioHardwareUnspecifiedError));
+    }
+
+    DebugMsg("RDC_Recorder::SetPathNonRT: Recording to %s", thePath);
+
+    mPath = inPath;
+    mFileDescriptor = theFD;
+    mAudioBytesWritten = 0;
+    mSampleRate = inSampleRate;
+    mChannelCount = inChannelCount;
+
+    mWritePosition.store(0, std::memory_order_relaxed);
+    mReadPosition.store(0, std::memory_order_relaxed);
+    mDrainRequested.store(false, std::memory_order_relaxed);
+
+    // Release, so the IO thread sees the FIFO and positions before it starts storing.
+    mIsRecording.store(true, std::memory_order_release);
+}
+
+int     RDC_Recorder::CreateOutputFile(const char* inPath)
+{
+    // Only allow a plain file name after the directory, so the path can't leave it.
+    const size_t theDirectoryLength = strlen(kRDCOutputFileDirectory);
+    bool isInDirectory = strncmp(inPath, kRDCOutputFileDirectory, theDirectoryLength) == 0 &&
+                         inPath[theDirectoryLength] == '/';
+    const char* theName = isInDirectory ? inPath + theDirectoryLength + 1 : "";
+    ThrowIf(theName[0] == '\0' ||
+            strchr(theName, '/') != nullptr ||
+            strcmp(theName, ".") == 0 ||
+            strcmp(theName, "..") == 0,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Recorder::CreateOutputFile: The file must be directly in kRDCOutputFileDirectory");
+
+    // Create the directory if it doesn't exist yet. This usually fails, since its parent is owned by
+    // root, in which case it has to have been created when the driver was installed.
+    mkdir(kRDCOutputFileDirectory, S_IRWXU);
+
+    int theDirectoryFD = open(kRDCOutputFileDirectory, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    ThrowIf(theDirectoryFD < 0,
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_Recorder::CreateOutputFile: Couldn't open kRDCOutputFileDirectory");
+
+    // Check the directory is ours and no one else can add, remove or rename files in it. Otherwise
+    // they could replace the file with a link to another one between it being created and written.
+    struct stat theDirectoryInfo;
+    bool theDirectoryIsSafe = fstat(theDirectoryFD, &theDirectoryInfo) == 0 &&
+                              theDirectoryInfo.st_uid == geteuid() &&
+                              (theDirectoryInfo.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+
+    int theFD = -1;
+
+    if(theDirectoryIsSafe)
+    {
+        theFD = openat(theDirectoryFD,
+                       theName,
+                       O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,
+                       S_IRUSR | S_IWUSR);
+    }
+
+    close(theDirectoryFD);
+
+    ThrowIf(!theDirectoryIsSafe,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Recorder::CreateOutputFile: kRDCOutputFileDirectory must be owned by coreaudiod's "
+            "user and not writable by others");
+    ThrowIf(theFD < 0,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_Recorder::CreateOutputFile: Couldn't create the file");
+
+    return theFD;
+}
+
+CFStringRef RDC_Recorder::CopyPath() const
+{
+    CAMutex::Locker theLocker(mFileMutex);
+
+    if(mPath.IsValid())
+    {
+        return static_cast<CFStringRef>(CFRetain(mPath.GetCFString()));
+    }
+
+    return CFSTR("");
+}
+
+bool    RDC_Recorder::SetFormatNonRT(Float64 inSampleRate, UInt32 inChannelCount)
+{
+    CAMutex::Locker theLocker(mFileMutex);
+
+    if(!mIsRecording.load(std::memory_order_relaxed) ||
+       (inSampleRate == mSampleRate && inChannelCount == mChannelCount))
+    {
+        return false;
+    }
+
+    LogWarning("RDC_Recorder::SetFormatNonRT: Stopping the recording because the format changed");
+    StopNonRT();
+
+    return true;
+}
+
+bool    RDC_Recorder::StoreRT(const Float32* __nullable inFrames, UInt32 inFrameSize)
+{
+    // Register before checking the flag, so StopNonRT either sees this thread or this thread sees
+    // the flag cleared. Both need sequential consistency.
+    mStoringCount.fetch_add(1);
+
+    if(!mIsRecording.load())
+    {
+        mStoringCount.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    UInt64 theBytes = static_cast<UInt64>(inFrameSize) * mChannelCount * sizeof(Float32);
+    UInt64 theWritePosition = mWritePosition.load(std::memory_order_relaxed);
+    UInt64 theReadPosition = mReadPosition.load(std::memory_order_acquire);
+
+    if(theBytes > mFIFOSize - (theWritePosition - theReadPosition))
+    {
+        // The disk is behind, so drop the buffer rather than wait for it.
+        mDroppedFrames.fetch_add(inFrameSize, std::memory_order_relaxed);
+    }
+    else
+    {
+        UInt64 theOffset = theWritePosition % mFIFOSize;
+        UInt64 theFirstPartBytes = std::min(theBytes, mFIFOSize - theOffset);
+        Byte* theFIFO = mFIFO.get();
+
+        if(inFrames == nullptr)
+        {
+            memset(theFIFO + theOffset, 0, theFirstPartBytes);
+            memset(theFIFO, 0, theBytes - theFirstPartBytes);
+        }
+        else
+        {
+            const Byte* theFrames = reinterpret_cast<const Byte*>(inFrames);
+            memcpy(theFIFO + theOffset, theFrames, theFirstPartBytes);
+            memcpy(theFIFO, theFrames + theFirstPartBytes, theBytes - theFirstPartBytes);
+        }
+
+        theWritePosition += theBytes;
+        mWritePosition.store(theWritePosition, std::memory_order_release);
+    }
+
+    bool theNeedsDrain = (theWritePosition - theReadPosition >= kWriteSize) &&
+                         !mDrainRequested.exchange(true, std::memory_order_relaxed);
+
+    mStoringCount.fetch_sub(1, std::memory_order_release);
+
+    return theNeedsDrain;
+}
+
+void    RDC_Recorder::DrainNonRT()
+{
+    CAMutex::Locker theLocker(mFileMutex);
+
+    // Clear it first, so frames stored during the write can ask for another drain.
+    mDrainRequested.store(false, std::memory_order_relaxed);
+
+    // The recording might have been stopped after the drain was requested.
+    if(!mIsRecording.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    UInt64 theWaitingBytes = mWritePosition.load(std::memory_order_acquire) -
+                             mReadPosition.load(std::memory_order_relaxed);
+
+    if(!WriteFromFIFO(theWaitingBytes / kWriteSize * kWriteSize))
+    {
+        LogError("RDC_Recorder::DrainNonRT: Stopping the recording because a write failed (%d)", errno);
+        StopNonRT();
+    }
+}
+
+void    RDC_Recorder::StopNonRT()
+{
+    Assert(mFileMutex.IsOwnedByCurrentThread(), "RDC_Recorder::StopNonRT: The file mutex must be held");
+
+    if(mFileDescriptor < 0)
+    {
+        return;
+    }
+
+    mIsRecording.store(false);
+
+    // Wait for the IO thread to finish storing, so the frames it stored are written and the FIFO
+    // can be reused. It never blocks in StoreRT, so this is short.
+    while(mStoringCount.load() != 0)
+    {
+        sched_yield();
+    }
+
+    if(!WriteFromFIFO(UINT64_MAX))
+    {
+        LogError("RDC_Recorder::StopNonRT: Couldn't write the end of the recording (%d)", errno);
+    }
+
+    // Fill in the data chunk's size, which includes the edit count.
+    UInt64 theDataChunkSize = CFSwapInt64HostToBig(mAudioBytesWritten + 4);
+    if(pwrite(mFileDescriptor, &theDataChunkSize, sizeof(theDataChunkSize), kCAFDataChunkSizeOffset) !=
+       sizeof(theDataChunkSize))
+    {
+        LogError("RDC_Recorder::StopNonRT: Couldn't finish the file's header (%d)", errno);
+    }
+
+    close(mFileDescriptor);
+
+    DebugMsg("RDC_Recorder::StopNonRT: Stopped recording after %llu bytes", mAudioBytesWritten);
+
+    mFileDescriptor = -1;
+    mPath = CACFString();
+}
+
+bool    RDC_Recorder::WriteFromFIFO(UInt64 inMaxBytes)
+{
+    UInt64 theReadPosition = mReadPosition.load(std::memory_order_relaxed);
+    UInt64 theWritePosition = mWritePosition.load(std::memory_order_acquire);
+    UInt64 theBytes = std::min(theWritePosition - theReadPosition, inMaxBytes);
+
+    while(theBytes > 0)
+    {
+        UInt64 theOffset = theReadPosition % mFIFOSize;
+        size_t theChunkBytes = static_cast<size_t>(std::min(theBytes, mFIFOSize - theOffset));
+
+        ssize_t theWrittenBytes = write(mFileDescriptor, mFIFO.get() + theOffset, theChunkBytes);
+
+        if(theWrittenBytes < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        theReadPosition += static_cast<UInt64>(theWrittenBytes);
+        theBytes -= static_cast<UInt64>(theWrittenBytes);
+        mAudioBytesWritten += static_cast<UInt64>(theWrittenBytes);
+
+        // Let StoreRT reuse the space.
+        mReadPosition.store(theReadPosition, std::memory_order_release);
+    }
+
+    return true;
+}
+
+#pragma clang assume_nonnull end
+
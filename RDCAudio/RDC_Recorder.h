@@ -0,0 +1,182 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_Recorder.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_Recorder__
+#define __RDCDriver__RDC_Recorder__
+
+// PublicUtility Includes
+#include "CACFString.h"
+#include "CAMutex.h"
+
+// STL Includes
+#include <atomic>
+#include <memory>
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+#include <MacTypes.h>
+#include <stdlib.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_Recorder
+//
+//  Records the loopback audio to a CAF file without a HAL client. See
+//  kAudioDeviceCustomPropertyRecordingPath.
+//
+//  The IO thread copies each buffer into a preallocated FIFO with StoreRT, which never blocks, and
+//  asks for the FIFO to be drained once enough is waiting to write. DrainNonRT, which RDC_Device
+//  runs on its task queue's non-realtime thread, writes the FIFO to the file in large blocks.
+//  The file is written with F_NOCACHE, from page-aligned memory, at page-aligned offsets. The
+//  samples are interleaved, native-endian Float32.
+//
+//  If the FIFO fills up because the disk couldn't keep up, the frames that didn't fit are dropped
+//  and counted, so the recording stays real-time safe.
+//
+//  Methods whose names end with "RT" should only be called from the IO thread that writes the mix,
+//  and those ending with "NonRT" should never be called from a real-time thread.
+//==================================================================================================
+
+class RDC_Recorder
+{
+
+public:
+                                        RDC_Recorder() = default;
+                                        ~RDC_Recorder();
+                                        // Disallow copying
+                                        RDC_Recorder(const RDC_Recorder&) = delete;
+                                        RDC_Recorder& operator=(const RDC_Recorder&) = delete;
+
+    /*!
+     Start recording to a new file at inPath and stop the current recording, if there is one. Can be
+     called while IO is running.
+
+     @param inPath The path of the file. Must be directly in kRDCOutputFileDirectory and not exist.
+                   The empty string just stops recording.
+     @throws CAException If the file couldn't be created.
+     */
+    void                                SetPathNonRT(CFStringRef inPath,
+                                                     Float64 inSampleRate,
+                                                     UInt32 inChannelCount);
+    /*! @return The path being recorded to, or the empty string. The caller must release it. */
+    CFStringRef                         CopyPath() const;
+
+    /*!
+     Stop recording, if the new format isn't the one being recorded. A file only has one format.
+
+     @return True if the recording was stopped.
+     */
+    bool                                SetFormatNonRT(Float64 inSampleRate, UInt32 inChannelCount);
+
+    bool                                IsRecordingRT() const { return mIsRecording.load(std::memory_order_relaxed); }
+
+    /*!
+     Add frames to the recording. Does nothing if it isn't recording.
+
+     @param inFrames The interleaved Float32 frames, or null for silence.
+     @return True if the caller should have DrainNonRT called. Only returned once until DrainNonRT
+             has been called.
+     */
+    bool                                StoreRT(const Float32* __nullable inFrames, UInt32 inFrameSize);
+
+    /*! Write the frames waiting in the FIFO to the file, in multiples of kWriteSize. */
+    void                                DrainNonRT();
+
+    /*! @return The number of frames dropped because the FIFO was full, since the driver loaded. */
+    UInt64                              GetDroppedFrames() const { return mDroppedFrames.load(std::memory_order_relaxed); }
+
+    /*!
+     Fill outHeader, which must be kCAFHeaderSize bytes, with the header of a CAF file of
+     interleaved, native-endian Float32 frames. The header is padded so the audio starts on a page
+     boundary.
+
+     @param inAudioBytes The size of the audio that will follow the header, or kCAFUnknownSize if it
+                         isn't known yet.
+     */
+    static void                         CreateCAFHeader(Byte* outHeader,
+                                                        Float64 inSampleRate,
+                                                        UInt32 inChannelCount,
+                                                        UInt64 inAudioBytes);
+
+    /*!
+     Create a new file for writing, with mode 0600, at inPath, which must be directly in
+     kRDCOutputFileDirectory. Fails rather than replace a file or follow a symlink. Also used by
+     RDC_RetroBuffer.
+
+     @return The file's descriptor.
+     @throws CAException If inPath isn't in the directory, the directory isn't owned by this process's
+                         user or is writable by others, or the file couldn't be created.
+     */
+    static int                          CreateOutputFile(const char* inPath);
+
+private:
+    // Write the rest of the FIFO, finish the file's header and close it. mFileMutex must be held.
+    void                                StopNonRT();
+    // Write up to inMaxBytes from the FIFO. Returns false if the write failed. mFileMutex must be
+    // held.
+    bool                                WriteFromFIFO(UInt64 inMaxBytes);
+
+    struct FreeDeleter
+    {
+        void operator()(void* inPointer) const { free(inPointer); }
+    };
+
+public:
+    static const UInt32                 kCAFHeaderSize = 4096;
+    static const UInt64                 kCAFUnknownSize = UINT64_MAX;
+
+    // The FIFO is drained in blocks of this many bytes, except for the last one.
+    static const UInt32                 kWriteSize = 256 * 1024;
+    // The FIFO holds at least this many seconds of audio, for when the disk is slow.
+    static const UInt32                 kFIFOSeconds = 4;
+
+private:
+    // Guards the file and serialises starting, stopping and draining.
+    CAMutex                             mFileMutex { "Recorder File" };
+    // Invalid while not recording.
+    CACFString                          mPath;
+    int                                 mFileDescriptor = -1;
+    UInt64                              mAudioBytesWritten = 0;
+    Float64                             mSampleRate = 0.0;
+    UInt32                              mChannelCount = 0;
+
+    // The FIFO. Only reallocated while not recording and no IO thread is in StoreRT.
+    std::unique_ptr<Byte, FreeDeleter>  mFIFO;
+    UInt64                              mFIFOSize = 0;
+    // Byte positions. mWritePosition is only changed by StoreRT and mReadPosition only by
+    // DrainNonRT and StopNonRT.
+    std::atomic<UInt64>                 mWritePosition { 0 };
+    std::atomic<UInt64>                 mReadPosition { 0 };
+
+    std::atomic<bool>                   mIsRecording { false };
+    // The number of IO threads in StoreRT, so StopNonRT can wait for them before the FIFO is reused.
+    std::atomic<UInt32>                 mStoringCount { 0 };
+    // True from when StoreRT asks for a drain until DrainNonRT runs.
+    std::atomic<bool>                   mDrainRequested { false };
+    std::atomic<UInt64>                 mDroppedFrames { 0 };
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_Recorder__ */
+
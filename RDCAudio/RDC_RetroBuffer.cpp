@@ -0,0 +1,544 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_RetroBuffer.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_RetroBuffer.h"
+
+// Local Includes
+#include "RDC_LosslessCodec.h"
+#include "RDC_Recorder.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+
+// STL Includes
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// System Includes
+#include <CoreAudio/AudioHardwareBase.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <unistd.h>
+
+
+#pragma clang assume_nonnull begin
+
+// Writes all of inBytes to inFD, retrying if it's interrupted.
+static bool RDC_WriteAll(int inFD, const Byte* inBytes, size_t inSize)
+{
+    while(inSize > 0)
+    {
+        ssize_t theWrittenBytes = write(inFD, inBytes, inSize);
+
+        if(theWrittenBytes < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        inBytes += theWrittenBytes;
+        inSize -= static_cast<size_t>(theWrittenBytes);
+    }
+
+    return true;
+}
+
+RDC_RetroBuffer::~RDC_RetroBuffer()
+{
+    CAMutex::Locker theLocker(mMutex);
+    FreeNonRT();
+}
+
+void    RDC_RetroBuffer::SetWindowSecondsNonRT(UInt32 inSeconds,
+                                               Float64 inSampleRate,
+                                               UInt32 inChannelCount)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    FreeNonRT();
+
+    mWindowSeconds = inSeconds;
+    mSampleRate = inSampleRate;
+    mChannelCount = inChannelCount;
+
+    if(inSeconds > 0)
+    {
+        try
+        {
+            AllocateNonRT();
+        }
+        catch(...)
+        {
+            mWindowSeconds = 0;
+            throw;
+        }
+    }
+}
+
+UInt32  RDC_RetroBuffer::GetWindowSeconds() const
+{
+    CAMutex::Locker theLocker(mMutex);
+    return mWindowSeconds;
+}
+
+void    RDC_RetroBuffer::SetFormatNonRT(Float64 inSampleRate, UInt32 inChannelCount)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    if(inSampleRate == mSampleRate && inChannelCount == mChannelCount)
+    {
+        return;
+    }
+
+    FreeNonRT();
+
+    mSampleRate = inSampleRate;
+    mChannelCount = inChannelCount;
+
+    if(mWindowSeconds > 0)
+    {
+        try
+        {
+            AllocateNonRT();
+        }
+        catch(const CAException& e)
+        {
+            LogError("RDC_RetroBuffer::SetFormatNonRT: Couldn't reallocate the window (%d)",
+                     e.GetError());
+            mWindowSeconds = 0;
+        }
+    }
+}
+
+bool    RDC_RetroBuffer::StoreRT(const Float32* __nullable inFrames, UInt32 inFrameSize)
+{
+    // Register before checking the flag, so FreeNonRT either sees this thread or this thread sees
+    // the flag cleared. Both need sequential consistency.
+    mStoringCount.fetch_add(1);
+
+    if(!mIsEnabled.load())
+    {
+        mStoringCount.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    UInt64 theBytes = static_cast<UInt64>(inFrameSize) * mChannelCount * sizeof(Float32);
+    UInt64 theWritePosition = mWritePosition.load(std::memory_order_relaxed);
+    UInt64 theReadPosition = mReadPosition.load(std::memory_order_acquire);
+
+    if(theBytes > mFIFOSize - (theWritePosition - theReadPosition))
+    {
+        // The drains are behind, so drop the buffer rather than wait for them.
+        mDroppedFrames.fetch_add(inFrameSize, std::memory_order_relaxed);
+    }
+    else
+    {
+        UInt64 theOffset = theWritePosition % mFIFOSize;
+        UInt64 theFirstPartBytes = std::min(theBytes, mFIFOSize - theOffset);
+        Byte* theFIFO = mFIFO.get();
+
+        if(inFrames == nullptr)
+        {
+            memset(theFIFO + theOffset, 0, theFirstPartBytes);
+            memset(theFIFO, 0, theBytes - theFirstPartBytes);
+        }
+        else
+        {
+            const Byte* theFrames = reinterpret_cast<const Byte*>(inFrames);
+            memcpy(theFIFO + theOffset, theFrames, theFirstPartBytes);
+            memcpy(theFIFO, theFrames + theFirstPartBytes, theBytes - theFirstPartBytes);
+        }
+
+        theWritePosition += theBytes;
+        mWritePosition.store(theWritePosition, std::memory_order_release);
+    }
+
+    bool theNeedsDrain = (theWritePosition - theReadPosition >= kDrainSize) &&
+                         !mDrainRequested.exchange(true, std::memory_order_relaxed);
+
+    mStoringCount.fetch_sub(1, std::memory_order_release);
+
+    return theNeedsDrain;
+}
+
+void    RDC_RetroBuffer::DrainNonRT()
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    // Clear it first, so frames stored during the copy can ask for another drain.
+    mDrainRequested.store(false, std::memory_order_relaxed);
+
+    // The window might have been freed after the drain was requested.
+    if(mWindow == nullptr)
+    {
+        return;
+    }
+
+    UInt64 theWaitingBytes = mWritePosition.load(std::memory_order_acquire) -
+                             mReadPosition.load(std::memory_order_relaxed);
+
+    MoveFromFIFO(theWaitingBytes);
+}
+
+void    RDC_RetroBuffer::SaveNonRT(CFStringRef inPath)
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    ThrowIf(mWindow == nullptr,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_RetroBuffer::SaveNonRT: The retroactive capture window is disabled");
+
+    char thePath[MAXPATHLEN];
+    ThrowIf(!CFStringGetFileSystemRepresentation(inPath, thePath, sizeof(thePath)),
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_RetroBuffer::SaveNonRT: Invalid path");
+
+    // Encode the whole blocks stored so far. The frames after them stay in the FIFO and are copied
+    // after the blocks, without freeing them, so they're still encoded with the frames that follow.
+    MoveFromFIFO(UINT64_MAX);
+
+    UInt64 theBytesPerFrame = static_cast<UInt64>(mChannelCount) * sizeof(Float32);
+    UInt64 theReadPosition = mReadPosition.load(std::memory_order_relaxed);
+    // StoreRT only publishes whole frames. It might have stored another block since the FIFO was
+    // drained, but the frames after the first block's worth are left out, like the ones stored
+    // after this.
+    UInt64 theTailFrames = std::min<UInt64>(
+            (mWritePosition.load(std::memory_order_acquire) - theReadPosition) / theBytesPerFrame,
+            kBlockFrameSize - 1);
+    UInt64 theWindowFrames = mBlockCount * kBlockFrameSize + theTailFrames;
+    UInt64 theAudioFrames = theWindowFrames;
+
+    if(mSaveSeconds > 0)
+    {
+        theAudioFrames = std::min(theAudioFrames, static_cast<UInt64>(mSampleRate) * mSaveSeconds);
+    }
+
+    // The blocks before the saved frames are skipped without being decoded.
+    UInt64 theSkippedFrames = theWindowFrames - theAudioFrames;
+    UInt64 theFirstBlock = theSkippedFrames / kBlockFrameSize;
+    UInt64 theFirstFrame = theSkippedFrames % kBlockFrameSize;
+    UInt64 theAudioBytes = theAudioFrames * theBytesPerFrame;
+
+    int theFD = RDC_Recorder::CreateOutputFile(thePath);
+
+    // The file is only written once, so don't cache it.
+    fcntl(theFD, F_NOCACHE, 1);
+
+    Byte theHeader[RDC_Recorder::kCAFHeaderSize];
+    RDC_Recorder::CreateCAFHeader(theHeader, mSampleRate, mChannelCount, theAudioBytes);
+
+    bool theSucceeded = RDC_WriteAll(theFD, theHeader, sizeof(theHeader));
+    bool theDecoded = true;
+    Float32* theFrames = mBlockFrames.data();
+
+    for(UInt64 theIndex = theFirstBlock; theSucceeded && theDecoded && theIndex < mBlockCount; theIndex++)
+    {
+        const Block& theBlock = mBlocks[(mFirstBlock + theIndex) % mMaxBlocks];
+
+        theDecoded = RDC_LosslessCodec::DecodeBlock(mWindow + theBlock.mOffset,
+                                                    static_cast<size_t>(theBlock.mSize),
+                                                    kBlockFrameSize,
+                                                    mChannelCount,
+                                                    theFrames);
+
+        theSucceeded = theDecoded &&
+                RDC_WriteAll(theFD,
+                             reinterpret_cast<const Byte*>(theFrames + theFirstFrame * mChannelCount),
+                             static_cast<size_t>((kBlockFrameSize - theFirstFrame) * theBytesPerFrame));
+        theFirstFrame = 0;
+    }
+
+    if(theSucceeded && theDecoded)
+    {
+        // If every block was skipped, so are some of the tail's frames.
+        UInt64 theSkippedTailFrames = (theFirstBlock == mBlockCount) ? theFirstFrame : 0;
+
+        CopyFromFIFO(theReadPosition, theTailFrames * theBytesPerFrame, theFrames);
+        theSucceeded = RDC_WriteAll(theFD,
+                                    reinterpret_cast<const Byte*>(theFrames + theSkippedTailFrames * mChannelCount),
+                                    static_cast<size_t>((theTailFrames - theSkippedTailFrames) * theBytesPerFrame));
+    }
+
+    close(theFD);
+
+    if(!theSucceeded)
+    {
+        LogError("RDC_RetroBuffer::SaveNonRT: Couldn't %s %s (%d)",
+                 theDecoded ? "write" : "decode the window for",
+                 thePath,
+                 errno);
+        unlink(thePath);
+        Throw(CAException(kAudioHardwareUnspecifiedError));
+    }
+
+    DebugMsg("RDC_RetroBuffer::SaveNonRT: Saved %llu bytes to %s", theAudioBytes, thePath);
+
+    mLastSavedPath = inPath;
+}
+
+void    RDC_RetroBuffer::SetSaveSecondsNonRT(UInt32 inSeconds)
+{
+    CAMutex::Locker theLocker(mMutex);
+    mSaveSeconds = inSeconds;
+}
+
+UInt32  RDC_RetroBuffer::GetSaveSeconds() const
+{
+    CAMutex::Locker theLocker(mMutex);
+    return mSaveSeconds;
+}
+
+CFStringRef RDC_RetroBuffer::CopyLastSavedPath() const
+{
+    CAMutex::Locker theLocker(mMutex);
+
+    if(mLastSavedPath.IsValid())
+    {
+        return static_cast<CFStringRef>(CFRetain(mLastSavedPath.GetCFString()));
+    }
+
+    return CFSTR("");
+}
+
+void    RDC_RetroBuffer::AllocateNonRT()
+{
+    Assert(mMutex.IsOwnedByCurrentThread(), "RDC_RetroBuffer::AllocateNonRT: The mutex must be held");
+    Assert(mWindow == nullptr, "RDC_RetroBuffer::AllocateNonRT: The window is already allocated");
+
+    UInt64 theBytesPerFrame = static_cast<UInt64>(mChannelCount) * sizeof(Float32);
+    UInt64 theBytesPerSecond = static_cast<UInt64>(mSampleRate) * theBytesPerFrame;
+    UInt64 theWindowFrames = static_cast<UInt64>(mSampleRate) * mWindowSeconds;
+    UInt64 theFIFOSize = (theBytesPerSecond * kFIFOSeconds + kDrainSize - 1) / kDrainSize * kDrainSize;
+
+    ThrowIf(theWindowFrames == 0 || mChannelCount == 0,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_RetroBuffer::AllocateNonRT: No format");
+
+    // Leave room for an extra block, so there's always space for a new one after dropping the
+    // oldest, however the blocks' sizes vary. Pages past the end of the blocks are never touched,
+    // so they don't use any disk space or memory.
+    UInt64 theMaxBlocks = (theWindowFrames + kBlockFrameSize - 1) / kBlockFrameSize;
+    UInt64 theMaxBlockSize = RDC_LosslessCodec::GetMaxEncodedSize(kBlockFrameSize, mChannelCount);
+    UInt64 thePageSize = static_cast<UInt64>(getpagesize());
+    UInt64 theWindowSize = ((theMaxBlocks + 1) * theMaxBlockSize + thePageSize - 1) / thePageSize * thePageSize;
+
+    // The FIFO has to be able to hold a whole block.
+    theFIFOSize = std::max(theFIFOSize, (kBlockFrameSize * theBytesPerFrame + kDrainSize - 1) / kDrainSize * kDrainSize);
+
+    mBlocks.assign(static_cast<size_t>(theMaxBlocks), Block());
+    mBlockFrames.resize(static_cast<size_t>(kBlockFrameSize) * mChannelCount);
+
+    if(theFIFOSize != mFIFOSize)
+    {
+        void* theFIFO = nullptr;
+        ThrowIf(posix_memalign(&theFIFO, static_cast<size_t>(getpagesize()), theFIFOSize) != 0,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_RetroBuffer::AllocateNonRT: Couldn't allocate the FIFO");
+
+        // Touch every page now so StoreRT never page faults.
+        memset(theFIFO, 0, theFIFOSize);
+
+        mFIFO.reset(static_cast<Byte*>(theFIFO));
+        mFIFOSize = theFIFOSize;
+    }
+
+    // Back the window with a file in coreaudiod's temporary directory.
+    char theTemplate[MAXPATHLEN];
+    size_t theDirLength = confstr(_CS_DARWIN_USER_TEMP_DIR, theTemplate, sizeof(theTemplate));
+    if(theDirLength == 0 || theDirLength > sizeof(theTemplate))
+    {
+        strlcpy(theTemplate, "/tmp/", sizeof(theTemplate));
+    }
+    strlcat(theTemplate, "RDCRetroBuffer.XXXXXX", sizeof(theTemplate));
+
+    int theFD = mkstemp(theTemplate);
+    ThrowIf(theFD < 0,
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_RetroBuffer::AllocateNonRT: Couldn't create the backing file");
+
+    // Nothing else needs to open it, and this way it's deleted even if coreaudiod crashes.
+    unlink(theTemplate);
+
+    void* theWindow = MAP_FAILED;
+    if(ftruncate(theFD, static_cast<off_t>(theWindowSize)) == 0)
+    {
+        theWindow = mmap(nullptr,
+                         static_cast<size_t>(theWindowSize),
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED,
+                         theFD,
+                         0);
+    }
+
+    // The mapping keeps the file alive.
+    close(theFD);
+
+    ThrowIf(theWindow == MAP_FAILED,
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_RetroBuffer::AllocateNonRT: Couldn't map the backing file");
+
+    DebugMsg("RDC_RetroBuffer::AllocateNonRT: Mapped a %llu byte window", theWindowSize);
+
+    mWindow = static_cast<Byte*>(theWindow);
+    mWindowSize = theWindowSize;
+    mMaxBlockSize = theMaxBlockSize;
+    mMaxBlocks = theMaxBlocks;
+    mFirstBlock = 0;
+    mBlockCount = 0;
+    mWriteOffset = 0;
+    mEncodedBytes.store(0, std::memory_order_relaxed);
+
+    mWritePosition.store(0, std::memory_order_relaxed);
+    mReadPosition.store(0, std::memory_order_relaxed);
+    mDrainRequested.store(false, std::memory_order_relaxed);
+
+    // Release, so the IO thread sees the FIFO and positions before it starts storing.
+    mIsEnabled.store(true, std::memory_order_release);
+}
+
+void    RDC_RetroBuffer::FreeNonRT()
+{
+    Assert(mMutex.IsOwnedByCurrentThread(), "RDC_RetroBuffer::FreeNonRT: The mutex must be held");
+
+    if(mWindow == nullptr)
+    {
+        return;
+    }
+
+    mIsEnabled.store(false);
+
+    // Wait for the IO thread to finish storing, so the FIFO can be reused. It never blocks in
+    // StoreRT, so this is short.
+    while(mStoringCount.load() != 0)
+    {
+        sched_yield();
+    }
+
+    munmap(mWindow, static_cast<size_t>(mWindowSize));
+
+    mWindow = nullptr;
+    mWindowSize = 0;
+    mBlockCount = 0;
+    mEncodedBytes.store(0, std::memory_order_relaxed);
+}
+
+void    RDC_RetroBuffer::MoveFromFIFO(UInt64 inMaxBytes)
+{
+    UInt64 theBlockBytes = static_cast<UInt64>(kBlockFrameSize) * mChannelCount * sizeof(Float32);
+    UInt64 theReadPosition = mReadPosition.load(std::memory_order_relaxed);
+    UInt64 theWritePosition = mWritePosition.load(std::memory_order_acquire);
+    UInt64 theBlocks = std::min(theWritePosition - theReadPosition, inMaxBytes) / theBlockBytes;
+    uintptr_t thePageMask = static_cast<uintptr_t>(getpagesize()) - 1;
+
+    for(UInt64 theIndex = 0; theIndex < theBlocks; theIndex++)
+    {
+        // Copy the block out first, since it can wrap around the end of the FIFO.
+        CopyFromFIFO(theReadPosition, theBlockBytes, mBlockFrames.data());
+
+        // Let StoreRT reuse the space.
+        theReadPosition += theBlockBytes;
+        mReadPosition.store(theReadPosition, std::memory_order_release);
+
+        UInt64 theOffset = ReserveBlock();
+        Byte* theDestination = mWindow + theOffset;
+        size_t theSize = RDC_LosslessCodec::EncodeBlock(mBlockFrames.data(),
+                                                        kBlockFrameSize,
+                                                        mChannelCount,
+                                                        theDestination);
+
+        mBlocks[(mFirstBlock + mBlockCount) % mMaxBlocks] = { theOffset, theSize };
+        mBlockCount++;
+        mWriteOffset = theOffset + theSize;
+        mEncodedBytes.fetch_add(theSize, std::memory_order_relaxed);
+
+        // Start writing the pages back now, so they're clean by the time the kernel wants to reclaim
+        // them and it can just drop them.
+        uintptr_t theSyncStart = reinterpret_cast<uintptr_t>(theDestination) & ~thePageMask;
+        uintptr_t theSyncEnd = reinterpret_cast<uintptr_t>(theDestination) + theSize;
+        msync(reinterpret_cast<void*>(theSyncStart), theSyncEnd - theSyncStart, MS_ASYNC);
+    }
+}
+
+void    RDC_RetroBuffer::CopyFromFIFO(UInt64 inPosition, UInt64 inBytes, void* outBytes) const
+{
+    UInt64 theOffset = inPosition % mFIFOSize;
+    UInt64 theFirstPartBytes = std::min(inBytes, mFIFOSize - theOffset);
+
+    memcpy(outBytes, mFIFO.get() + theOffset, static_cast<size_t>(theFirstPartBytes));
+    memcpy(static_cast<Byte*>(outBytes) + theFirstPartBytes,
+           mFIFO.get(),
+           static_cast<size_t>(inBytes - theFirstPartBytes));
+}
+
+UInt64  RDC_RetroBuffer::ReserveBlock()
+{
+    if(mBlockCount == mMaxBlocks)
+    {
+        DropOldestBlock();
+    }
+
+    while(mBlockCount > 0)
+    {
+        UInt64 theOldestOffset = mBlocks[mFirstBlock].mOffset;
+
+        if(theOldestOffset < mWriteOffset)
+        {
+            // The blocks are together. Go back to the start as soon as dropping blocks has left room
+            // there, rather than when the end of the window is reached, so they stay near the start.
+            if(theOldestOffset >= mMaxBlockSize)
+            {
+                return 0;
+            }
+
+            if(mWriteOffset + mMaxBlockSize <= mWindowSize)
+            {
+                return mWriteOffset;
+            }
+        }
+        else if(mWriteOffset + mMaxBlockSize <= theOldestOffset)
+        {
+            // The blocks have wrapped and there's room before the oldest.
+            return mWriteOffset;
+        }
+
+        DropOldestBlock();
+    }
+
+    return 0;
+}
+
+void    RDC_RetroBuffer::DropOldestBlock()
+{
+    mEncodedBytes.fetch_sub(mBlocks[mFirstBlock].mSize, std::memory_order_relaxed);
+    mFirstBlock = (mFirstBlock + 1) % mMaxBlocks;
+    mBlockCount--;
+}
+
+#pragma clang assume_nonnull end
+
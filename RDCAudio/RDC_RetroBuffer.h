@@ -0,0 +1,211 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_RetroBuffer.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_RetroBuffer__
+#define __RDCDriver__RDC_RetroBuffer__
+
+// PublicUtility Includes
+#include "CACFString.h"
+#include "CAMutex.h"
+
+// STL Includes
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// System Includes
+#include <CoreFoundation/CoreFoundation.h>
+#include <MacTypes.h>
+#include <stdlib.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_RetroBuffer
+//
+//  Keeps the last few minutes of the loopback audio, so they can be saved to a file after
+//  something has happened. See kAudioDeviceCustomPropertyRetroCaptureSeconds.
+//
+//  The window is a ring in a memory-mapped temporary file, which is unlinked as soon as it's
+//  created. The IO thread never touches it. StoreRT copies each buffer into a small preallocated
+//  FIFO, the same way RDC_Recorder does, and DrainNonRT, which RDC_Device runs on its task queue's
+//  non-realtime thread, moves the FIFO into the window and starts writing the pages it changed back
+//  to the file. Since the kernel can evict clean file-backed pages without compressing or swapping
+//  them, the window only uses a little more resident memory than the pages being written.
+//
+//  The audio is moved into the window in blocks of kBlockFrameSize frames, each compressed by
+//  RDC_LosslessCodec. The window is large enough for every block to be stored uncompressed, but the
+//  blocks are kept together at the start of the file when they're smaller, so the file only grows
+//  to about their total size. An index of where each block starts lets SaveNonRT decode only the
+//  blocks it saves.
+//
+//  Methods whose names end with "RT" should only be called from the IO thread that writes the mix,
+//  and those ending with "NonRT" should never be called from a real-time thread.
+//==================================================================================================
+
+class RDC_RetroBuffer
+{
+
+public:
+                                        RDC_RetroBuffer() = default;
+                                        ~RDC_RetroBuffer();
+                                        // Disallow copying
+                                        RDC_RetroBuffer(const RDC_RetroBuffer&) = delete;
+                                        RDC_RetroBuffer& operator=(const RDC_RetroBuffer&) = delete;
+
+    /*!
+     Set how many seconds of audio the window holds, emptying it. Can be called while IO is
+     running.
+
+     @param inSeconds The length of the window. 0 frees it.
+     @throws CAException If the window couldn't be allocated, in which case it's left freed.
+     */
+    void                                SetWindowSecondsNonRT(UInt32 inSeconds,
+                                                              Float64 inSampleRate,
+                                                              UInt32 inChannelCount);
+    UInt32                              GetWindowSeconds() const;
+
+    /*! Empty and reallocate the window for a new format, if it's enabled and the format changed. */
+    void                                SetFormatNonRT(Float64 inSampleRate, UInt32 inChannelCount);
+
+    bool                                IsEnabledRT() const { return mIsEnabled.load(std::memory_order_relaxed); }
+
+    /*!
+     Add frames to the window. Does nothing if the window is disabled.
+
+     @param inFrames The interleaved Float32 frames, or null for silence.
+     @return True if the caller should have DrainNonRT called. Only returned once until DrainNonRT
+             has been called.
+     */
+    bool                                StoreRT(const Float32* __nullable inFrames, UInt32 inFrameSize);
+
+    /*! Move the frames waiting in the FIFO into the window, in multiples of kDrainSize. */
+    void                                DrainNonRT();
+
+    /*!
+     Write the audio in the window, oldest first, to a new CAF file at inPath, which must be
+     directly in kRDCOutputFileDirectory and not exist. See RDC_Recorder::CreateOutputFile. The
+     window keeps filling while the file is written, but the frames stored in the meantime aren't
+     included. Only the last GetSaveSeconds seconds are written, if it isn't 0.
+
+     @throws CAException If the window is disabled, a block couldn't be decoded or the file
+                         couldn't be created or written.
+     */
+    void                                SaveNonRT(CFStringRef inPath);
+    /*!
+     Set how many seconds from the end of the window SaveNonRT writes. 0, the default, writes the
+     whole window. See kAudioDeviceCustomPropertyRetroCaptureSaveSeconds.
+     */
+    void                                SetSaveSecondsNonRT(UInt32 inSeconds);
+    UInt32                              GetSaveSeconds() const;
+    /*! @return The path last saved to, or the empty string. The caller must release it. */
+    CFStringRef                         CopyLastSavedPath() const;
+
+    /*! @return The number of frames dropped because the FIFO was full, since the driver loaded. */
+    UInt64                              GetDroppedFrames() const { return mDroppedFrames.load(std::memory_order_relaxed); }
+    /*! @return The number of bytes the compressed blocks in the window take. */
+    UInt64                              GetEncodedBytes() const { return mEncodedBytes.load(std::memory_order_relaxed); }
+
+private:
+    // Allocate the FIFO and map the window for the current format and mWindowSeconds. mMutex must
+    // be held and storing must be disabled.
+    void                                AllocateNonRT();
+    // Stop storing, wait for StoreRT to return and unmap the window. mMutex must be held.
+    void                                FreeNonRT();
+    // Move the whole blocks in the first inMaxBytes of the FIFO into the window. mMutex must be
+    // held.
+    void                                MoveFromFIFO(UInt64 inMaxBytes);
+    // Copy inBytes from the FIFO, starting at the byte position inPosition, without freeing them.
+    void                                CopyFromFIFO(UInt64 inPosition, UInt64 inBytes, void* outBytes) const;
+    // Find space in the window for a block, dropping the oldest blocks if there isn't any or the
+    // window is full. Returns the block's offset. mMutex must be held.
+    UInt64                              ReserveBlock();
+    void                                DropOldestBlock();
+
+    // Where a compressed block is in the window.
+    struct Block
+    {
+        UInt64                          mOffset = 0;
+        UInt64                          mSize = 0;
+    };
+
+    struct FreeDeleter
+    {
+        void operator()(void* inPointer) const { free(inPointer); }
+    };
+
+public:
+    // The FIFO is drained once at least this many bytes are waiting.
+    static const UInt32                 kDrainSize = 256 * 1024;
+    // The number of frames in each compressed block. RDC_LosslessCodec codes each block's residuals
+    // with a single Rice parameter, so longer blocks don't adapt as well.
+    static const UInt32                 kBlockFrameSize = 4096;
+    // The FIFO holds at least this many seconds of audio, for when the drains are held up.
+    static const UInt32                 kFIFOSeconds = 4;
+
+private:
+    // Guards the window and serialises reconfiguring, draining and saving.
+    CAMutex                             mMutex { "Retro Buffer" };
+    UInt32                              mWindowSeconds = 0;
+    Float64                             mSampleRate = 0.0;
+    UInt32                              mChannelCount = 0;
+    UInt32                              mSaveSeconds = 0;
+    CACFString                          mLastSavedPath;
+
+    // The mapped window, or null while disabled.
+    Byte* __nullable                    mWindow = nullptr;
+    UInt64                              mWindowSize = 0;
+    // The most bytes a block can take, which is its uncompressed size plus a byte.
+    UInt64                              mMaxBlockSize = 0;
+    // The index of the blocks in the window, a ring of mMaxBlocks entries starting at mFirstBlock,
+    // oldest first. The blocks are only together in the window if mWriteOffset, the end of the
+    // newest block, is after the start of the oldest.
+    std::vector<Block>                  mBlocks;
+    UInt64                              mMaxBlocks = 0;
+    UInt64                              mFirstBlock = 0;
+    UInt64                              mBlockCount = 0;
+    UInt64                              mWriteOffset = 0;
+    // The uncompressed frames of the block being encoded or decoded.
+    std::vector<Float32>                mBlockFrames;
+
+    // The FIFO. Only reallocated while storing is disabled.
+    std::unique_ptr<Byte, FreeDeleter>  mFIFO;
+    UInt64                              mFIFOSize = 0;
+    // Byte positions. mWritePosition is only changed by StoreRT and mReadPosition only by
+    // MoveFromFIFO.
+    std::atomic<UInt64>                 mWritePosition { 0 };
+    std::atomic<UInt64>                 mReadPosition { 0 };
+
+    std::atomic<bool>                   mIsEnabled { false };
+    // The number of IO threads in StoreRT, so FreeNonRT can wait for them before the FIFO is reused.
+    std::atomic<UInt32>                 mStoringCount { 0 };
+    // True from when StoreRT asks for a drain until DrainNonRT runs.
+    std::atomic<bool>                   mDrainRequested { false };
+    std::atomic<UInt64>                 mDroppedFrames { 0 };
+    // The total size of the blocks in mBlocks, for the stats.
+    std::atomic<UInt64>                 mEncodedBytes { 0 };
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_RetroBuffer__ */
+
@@ -0,0 +1,389 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_SampleConversion.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_SampleConversion.h"
+
+// STL Includes
+#include <cstring>
+
+// System Includes
+#include <Accelerate/Accelerate.h>
+
+
+#pragma clang assume_nonnull begin
+
+// The integer formats are scaled so full scale is [-1, 1), the same as CoreAudio's converters.
+static const Float32 kInt16Scale = 32768.0f;
+static const Float32 kInt24Scale = 8388608.0f;
+
+namespace RDC_SampleConversion
+{
+
+UInt32  BytesPerSample(RDC_SampleFormat inFormat)
+{
+    switch(inFormat)
+    {
+        case kRDCSampleFormat_Int16:
+            return 2;
+        case kRDCSampleFormat_Int24:
+            return 3;
+        case kRDCSampleFormat_Float32:
+        default:
+            return 4;
+    }
+}
+
+UInt32  BitsPerSample(RDC_SampleFormat inFormat)
+{
+    switch(inFormat)
+    {
+        case kRDCSampleFormat_Int16:
+            return 16;
+        case kRDCSampleFormat_Int24:
+            return 24;
+        case kRDCSampleFormat_Float32:
+        default:
+            return 32;
+    }
+}
+
+bool    GetFormatForBitsPerSample(UInt32 inBitsPerSample, RDC_SampleFormat& outFormat)
+{
+    switch(inBitsPerSample)
+    {
+        case 16:
+            outFormat = kRDCSampleFormat_Int16;
+            return true;
+        case 24:
+            outFormat = kRDCSampleFormat_Int24;
+            return true;
+        case 32:
+            outFormat = kRDCSampleFormat_Float32;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void    FillStreamDescription(RDC_SampleFormat inFormat,
+                              Float64 inSampleRate,
+                              UInt32 inChannelsPerFrame,
+                              AudioStreamBasicDescription& outDescription)
+{
+    outDescription.mSampleRate = inSampleRate;
+    outDescription.mFormatID = kAudioFormatLinearPCM;
+    outDescription.mFormatFlags =
+        ((inFormat == kRDCSampleFormat_Float32) ? kAudioFormatFlagIsFloat
+                                                : kAudioFormatFlagIsSignedInteger) |
+        kAudioFormatFlagsNativeEndian |
+        kAudioFormatFlagIsPacked;
+    outDescription.mBytesPerPacket = inChannelsPerFrame * BytesPerSample(inFormat);
+    outDescription.mFramesPerPacket = 1;
+    outDescription.mBytesPerFrame = inChannelsPerFrame * BytesPerSample(inFormat);
+    outDescription.mChannelsPerFrame = inChannelsPerFrame;
+    outDescription.mBitsPerChannel = BitsPerSample(inFormat);
+    outDescription.mReserved = 0;
+}
+
+bool    GetFormatOfStreamDescription(const AudioStreamBasicDescription& inDescription,
+                                     RDC_SampleFormat& outFormat)
+{
+    RDC_SampleFormat theFormat;
+
+    if(inDescription.mFormatID != kAudioFormatLinearPCM ||
+       !GetFormatForBitsPerSample(inDescription.mBitsPerChannel, theFormat))
+    {
+        return false;
+    }
+
+    // Compare everything else to the description we'd give for that format.
+    AudioStreamBasicDescription theExpected;
+    FillStreamDescription(theFormat,
+                          inDescription.mSampleRate,
+                          inDescription.mChannelsPerFrame,
+                          theExpected);
+
+    if(inDescription.mFormatFlags != theExpected.mFormatFlags ||
+       inDescription.mBytesPerPacket != theExpected.mBytesPerPacket ||
+       inDescription.mFramesPerPacket != theExpected.mFramesPerPacket ||
+       inDescription.mBytesPerFrame != theExpected.mBytesPerFrame)
+    {
+        return false;
+    }
+
+    outFormat = theFormat;
+    return true;
+}
+
+bool    IsSilent(RDC_SampleFormat inFormat,
+                 const void* inSamples,
+                 UInt32 inNumberSamples)
+{
+    // Zero is all zero bytes in every format, so compare a word at a time and then the remaining
+    // bytes.
+    size_t theByteSize = static_cast<size_t>(inNumberSamples) * BytesPerSample(inFormat);
+    const Byte* theBytes = static_cast<const Byte*>(inSamples);
+    size_t theWordCount = theByteSize / sizeof(UInt64);
+
+    for(size_t i = 0; i < theWordCount; i++)
+    {
+        UInt64 theWord;
+        memcpy(&theWord, theBytes + i * sizeof(UInt64), sizeof(UInt64));
+
+        if(theWord != 0)
+        {
+            return false;
+        }
+    }
+
+    for(size_t i = theWordCount * sizeof(UInt64); i < theByteSize; i++)
+    {
+        if(theBytes[i] != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void    ConvertToFloat32(RDC_SampleFormat inFormat,
+                         const void* inSamples,
+                         Float32* outSamples,
+                         UInt32 inNumberSamples)
+{
+    switch(inFormat)
+    {
+        case kRDCSampleFormat_Float32:
+            memcpy(outSamples, inSamples, inNumberSamples * sizeof(Float32));
+            break;
+
+        case kRDCSampleFormat_Int16:
+            {
+                const Float32 theScale = 1.0f / kInt16Scale;
+                vDSP_vflt16(static_cast<const SInt16*>(inSamples), 1, outSamples, 1, inNumberSamples);
+                vDSP_vsmul(outSamples, 1, &theScale, outSamples, 1, inNumberSamples);
+            }
+            break;
+
+        case kRDCSampleFormat_Int24:
+            {
+                // vDSP doesn't have a 24-bit type, so unpack the samples into SInt32s first. They're
+                // the same size as Float32s, so we can unpack them into outSamples and convert them
+                // in place. Shifting the sample into the top three bytes and back sign-extends it. (Native
+                // endian is always little endian on the Macs we support.)
+                const Byte* theBytes = static_cast<const Byte*>(inSamples);
+                SInt32* theInts = reinterpret_cast<SInt32*>(outSamples);
+
+                for(UInt32 i = 0; i < inNumberSamples; i++)
+                {
+                    UInt32 theSample = static_cast<UInt32>(theBytes[3 * i]) << 8 |
+                                       static_cast<UInt32>(theBytes[3 * i + 1]) << 16 |
+                                       static_cast<UInt32>(theBytes[3 * i + 2]) << 24;
+                    theInts[i] = static_cast<SInt32>(theSample) >> 8;
+                }
+
+                const Float32 theScale = 1.0f / kInt24Scale;
+                vDSP_vflt32(theInts, 1, outSamples, 1, inNumberSamples);
+                vDSP_vsmul(outSamples, 1, &theScale, outSamples, 1, inNumberSamples);
+            }
+            break;
+    }
+}
+
+void    ConvertFromFloat32(const Float32* inSamples,
+                           RDC_SampleFormat outFormat,
+                           void* outSamples,
+                           UInt32 inNumberSamples,
+                           Float32* ioScratch)
+{
+    switch(outFormat)
+    {
+        case kRDCSampleFormat_Float32:
+            memcpy(outSamples, inSamples, inNumberSamples * sizeof(Float32));
+            break;
+
+        case kRDCSampleFormat_Int16:
+            {
+                // Scale, clip to the integer range and round.
+                const Float32 theMin = -kInt16Scale;
+                const Float32 theMax = kInt16Scale - 1.0f;
+                vDSP_vsmul(inSamples, 1, &kInt16Scale, ioScratch, 1, inNumberSamples);
+                vDSP_vclip(ioScratch, 1, &theMin, &theMax, ioScratch, 1, inNumberSamples);
+                vDSP_vfixr16(ioScratch, 1, static_cast<SInt16*>(outSamples), 1, inNumberSamples);
+            }
+            break;
+
+        case kRDCSampleFormat_Int24:
+            {
+                const Float32 theMin = -kInt24Scale;
+                const Float32 theMax = kInt24Scale - 1.0f;
+                vDSP_vsmul(inSamples, 1, &kInt24Scale, ioScratch, 1, inNumberSamples);
+                vDSP_vclip(ioScratch, 1, &theMin, &theMax, ioScratch, 1, inNumberSamples);
+
+                // Round to SInt32s in place, then pack the low three bytes of each.
+                SInt32* theInts = reinterpret_cast<SInt32*>(ioScratch);
+                vDSP_vfixr32(ioScratch, 1, theInts, 1, inNumberSamples);
+
+                Byte* theBytes = static_cast<Byte*>(outSamples);
+
+                for(UInt32 i = 0; i < inNumberSamples; i++)
+                {
+                    UInt32 theSample = static_cast<UInt32>(theInts[i]);
+                    theBytes[3 * i]     = static_cast<Byte>(theSample);
+                    theBytes[3 * i + 1] = static_cast<Byte>(theSample >> 8);
+                    theBytes[3 * i + 2] = static_cast<Byte>(theSample >> 16);
+                }
+            }
+            break;
+    }
+}
+
+// Copy samples from every inInStride'th sample of inSamples to every inOutStride'th of outSamples.
+static void CopySamplesWithStrides(RDC_SampleFormat inFormat,
+                                   const void* inSamples,
+                                   UInt32 inInStride,
+                                   void* outSamples,
+                                   UInt32 inOutStride,
+                                   UInt32 inNumberSamples)
+{
+    switch(inFormat)
+    {
+        case kRDCSampleFormat_Int16:
+            {
+                const SInt16* theIn = static_cast<const SInt16*>(inSamples);
+                SInt16* theOut = static_cast<SInt16*>(outSamples);
+
+                for(UInt32 i = 0; i < inNumberSamples; i++)
+                {
+                    theOut[i * inOutStride] = theIn[i * inInStride];
+                }
+            }
+            break;
+
+        case kRDCSampleFormat_Int24:
+            {
+                const Byte* theIn = static_cast<const Byte*>(inSamples);
+                Byte* theOut = static_cast<Byte*>(outSamples);
+
+                for(UInt32 i = 0; i < inNumberSamples; i++)
+                {
+                    memcpy(theOut + 3 * i * inOutStride, theIn + 3 * i * inInStride, 3);
+                }
+            }
+            break;
+
+        case kRDCSampleFormat_Float32:
+        default:
+            cblas_scopy(static_cast<int>(inNumberSamples),
+                        static_cast<const Float32*>(inSamples),
+                        static_cast<int>(inInStride),
+                        static_cast<Float32*>(outSamples),
+                        static_cast<int>(inOutStride));
+            break;
+    }
+}
+
+void    DeinterleaveChannel(RDC_SampleFormat inFormat,
+                            const void* inFrames,
+                            UInt32 inChannel,
+                            UInt32 inChannelCount,
+                            void* outSamples,
+                            UInt32 inNumberFrames)
+{
+    const Byte* theFirstSample = static_cast<const Byte*>(inFrames) + inChannel * BytesPerSample(inFormat);
+    CopySamplesWithStrides(inFormat, theFirstSample, inChannelCount, outSamples, 1, inNumberFrames);
+}
+
+void    InterleaveChannel(RDC_SampleFormat inFormat,
+                          const void* inSamples,
+                          UInt32 inChannel,
+                          UInt32 inChannelCount,
+                          void* outFrames,
+                          UInt32 inNumberFrames)
+{
+    Byte* theFirstSample = static_cast<Byte*>(outFrames) + inChannel * BytesPerSample(inFormat);
+    CopySamplesWithStrides(inFormat, inSamples, 1, theFirstSample, inChannelCount, inNumberFrames);
+}
+
+void    ReduceChannels(const Float32* inFrames,
+                       UInt32 inChannelCount,
+                       const SInt32* inChannelMap,
+                       UInt32 inOutChannelCount,
+                       Float32* outFrames,
+                       UInt32 inNumberFrames)
+{
+    vDSP_Stride theInStride = static_cast<vDSP_Stride>(inChannelCount);
+    vDSP_Stride theOutStride = static_cast<vDSP_Stride>(inOutChannelCount);
+    vDSP_Length theFrames = inNumberFrames;
+
+    for(UInt32 theOutChannel = 0; theOutChannel < inOutChannelCount; theOutChannel++)
+    {
+        SInt32 theInChannel = inChannelMap[theOutChannel];
+        Float32* theOut = outFrames + theOutChannel;
+
+        if(theInChannel == kRDCReducedInputChannel_Mix && inChannelCount > 1)
+        {
+            // Sum and scale the first two channels in the same pass, which is the whole downmix
+            // for stereo, and add any others to that.
+            Float32 theScale = 1.0f / static_cast<Float32>(inChannelCount);
+
+            if(inChannelCount == 2)
+            {
+                vDSP_vasm(inFrames, theInStride, inFrames + 1, theInStride, &theScale, theOut, theOutStride, theFrames);
+            }
+            else
+            {
+                vDSP_vadd(inFrames, theInStride, inFrames + 1, theInStride, theOut, theOutStride, theFrames);
+
+                for(UInt32 theChannel = 2; theChannel < inChannelCount; theChannel++)
+                {
+                    vDSP_vadd(inFrames + theChannel, theInStride, theOut, theOutStride, theOut, theOutStride, theFrames);
+                }
+
+                vDSP_vsmul(theOut, theOutStride, &theScale, theOut, theOutStride, theFrames);
+            }
+        }
+        else if(theInChannel == kRDCReducedInputChannel_Mix)
+        {
+            // The average of one channel is just that channel.
+            CopySamplesWithStrides(kRDCSampleFormat_Float32, inFrames, 1, theOut, inOutChannelCount, inNumberFrames);
+        }
+        else if(theInChannel > 0 && static_cast<UInt32>(theInChannel) <= inChannelCount)
+        {
+            CopySamplesWithStrides(kRDCSampleFormat_Float32,
+                                   inFrames + theInChannel - 1,
+                                   inChannelCount,
+                                   theOut,
+                                   inOutChannelCount,
+                                   inNumberFrames);
+        }
+        else
+        {
+            vDSP_vclr(theOut, theOutStride, theFrames);
+        }
+    }
+}
+
+}
+
+#pragma clang assume_nonnull end
+
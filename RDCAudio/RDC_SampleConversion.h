@@ -0,0 +1,129 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_SampleConversion.h
+//  RDCDriver
+//
+//  Helpers for the sample formats in RDC_SampleFormat. The conversion functions use vDSP, so
+//  they're vectorised on both Intel and Apple silicon, and don't allocate, so they're safe to call
+//  from IO threads.
+//
+
+#ifndef RDCDriver__RDC_SampleConversion
+#define RDCDriver__RDC_SampleConversion
+
+// Local Includes
+#include "RDC_Types.h"
+
+// System Includes
+#include <CoreAudio/CoreAudioTypes.h>
+
+
+#pragma clang assume_nonnull begin
+
+namespace RDC_SampleConversion
+{
+    UInt32  BytesPerSample(RDC_SampleFormat inFormat);
+    UInt32  BitsPerSample(RDC_SampleFormat inFormat);
+
+    /*!
+     @param inBitsPerSample 32, 24 or 16.
+     @param outFormat Set to the format with that many bits per sample.
+     @return False if none of the formats has inBitsPerSample bits.
+     */
+    bool    GetFormatForBitsPerSample(UInt32 inBitsPerSample, RDC_SampleFormat& outFormat);
+
+    /*! Fill in outDescription for a linear PCM stream with the given format. */
+    void    FillStreamDescription(RDC_SampleFormat inFormat,
+                                  Float64 inSampleRate,
+                                  UInt32 inChannelsPerFrame,
+                                  AudioStreamBasicDescription& outDescription);
+    /*!
+     Check the format ID, flags and sizes in inDescription. Doesn't check the sample rate or the
+     number of channels.
+
+     @return False if inDescription isn't one of the formats.
+     */
+    bool    GetFormatOfStreamDescription(const AudioStreamBasicDescription& inDescription,
+                                         RDC_SampleFormat& outFormat);
+
+    /*!
+     @return True if all the samples are zero. Stops at the first sample that isn't, so it only
+             reads the whole buffer if it's silent. A negative zero Float32 counts as not silent.
+     */
+    bool    IsSilent(RDC_SampleFormat inFormat,
+                     const void* inSamples,
+                     UInt32 inNumberSamples);
+
+    /*!
+     Convert samples in inFormat to Float32 in [-1, 1). inSamples and outSamples must not overlap.
+     */
+    void    ConvertToFloat32(RDC_SampleFormat inFormat,
+                             const void* inSamples,
+                             Float32* outSamples,
+                             UInt32 inNumberSamples);
+    /*!
+     Convert Float32 samples to outFormat, clipping them to its range.
+
+     @param ioScratch Space for inNumberSamples Float32s. Overwritten. Unused if outFormat is
+                      Float32.
+     */
+    void    ConvertFromFloat32(const Float32* inSamples,
+                               RDC_SampleFormat outFormat,
+                               void* outSamples,
+                               UInt32 inNumberSamples,
+                               Float32* ioScratch);
+
+    /*!
+     Copy one channel of interleaved frames into a buffer of that channel's samples, without
+     converting them.
+
+     @param inChannel The index of the channel in each frame, from 0 to inChannelCount - 1.
+     */
+    void    DeinterleaveChannel(RDC_SampleFormat inFormat,
+                                const void* inFrames,
+                                UInt32 inChannel,
+                                UInt32 inChannelCount,
+                                void* outSamples,
+                                UInt32 inNumberFrames);
+    /*! The reverse of DeinterleaveChannel. The other channels of outFrames aren't changed. */
+    void    InterleaveChannel(RDC_SampleFormat inFormat,
+                              const void* inSamples,
+                              UInt32 inChannel,
+                              UInt32 inChannelCount,
+                              void* outFrames,
+                              UInt32 inNumberFrames);
+
+    /*!
+     Make interleaved Float32 frames with inOutChannelCount channels from frames with inChannelCount
+     channels. See kAudioDeviceCustomPropertyReducedInputChannels.
+
+     @param inChannelMap For each output channel, the number of the input channel to copy, from 1,
+                         or kRDCReducedInputChannel_Mix for the average of all of them. Numbers past
+                         inChannelCount give silence.
+     */
+    void    ReduceChannels(const Float32* inFrames,
+                           UInt32 inChannelCount,
+                           const SInt32* inChannelMap,
+                           UInt32 inOutChannelCount,
+                           Float32* outFrames,
+                           UInt32 inNumberFrames);
+}
+
+#pragma clang assume_nonnull end
+
+#endif /* RDCDriver__RDC_SampleConversion */
+
@@ -0,0 +1,369 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_SharedLoopbackBuffer.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_SharedLoopbackBuffer.h"
+
+// Local Includes
+#include "RDC_LoopbackTimeStamps.h"
+
+// PublicUtility Includes
+#include "CAException.h"
+#include "CADebugMacros.h"
+#include "CABitOperations.h"
+
+// STL Includes
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+// System Includes
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+#pragma clang assume_nonnull begin
+
+RDC_SharedLoopbackBuffer::~RDC_SharedLoopbackBuffer()
+{
+    Close();
+}
+
+void    RDC_SharedLoopbackBuffer::SetName(CFStringRef inName,
+                                          Float64 inSampleRate,
+                                          UInt32 inChannelCount,
+                                          UInt32 inFrameSize)
+{
+    if(CFStringGetLength(inName) == 0)
+    {
+        DebugMsg("RDC_SharedLoopbackBuffer::SetName: Disabling the shared loopback buffer");
+        Close();
+        mName = CACFString();
+        return;
+    }
+
+    char theName[kRDCSharedLoopbackMaxNameLength + 1];
+    bool didGetName = CFStringGetCString(inName, theName, sizeof(theName), kCFStringEncodingUTF8);
+    ThrowIf(!didGetName || theName[0] != '/',
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_SharedLoopbackBuffer::SetName: The name must start with a slash and be at most "
+            "31 bytes");
+
+    Close();
+
+    mName = inName;
+    memcpy(mCName, theName, sizeof(mCName));
+
+    try
+    {
+        Create(inSampleRate, inChannelCount, inFrameSize);
+    }
+    catch(...)
+    {
+        mName = CACFString();
+        throw;
+    }
+}
+
+CFStringRef RDC_SharedLoopbackBuffer::CopyName() const
+{
+    if(mName.IsValid())
+    {
+        return static_cast<CFStringRef>(CFRetain(mName.GetCFString()));
+    }
+
+    return CFSTR("");
+}
+
+void    RDC_SharedLoopbackBuffer::SetWorldReadable(bool inWorldReadable,
+                                                   Float64 inSampleRate,
+                                                   UInt32 inChannelCount,
+                                                   UInt32 inFrameSize)
+{
+    if(inWorldReadable == mWorldReadable)
+    {
+        return;
+    }
+
+    DebugMsg("RDC_SharedLoopbackBuffer::SetWorldReadable: %s",
+             inWorldReadable ? "Letting every user read the region"
+                             : "Restricting the region to its owner");
+
+    mWorldReadable = inWorldReadable;
+
+    // The permissions can only be given when the region is created.
+    if(mName.IsValid())
+    {
+        Close();
+        Create(inSampleRate, inChannelCount, inFrameSize);
+    }
+}
+
+void    RDC_SharedLoopbackBuffer::Reallocate(Float64 inSampleRate,
+                                             UInt32 inChannelCount,
+                                             UInt32 inFrameSize)
+{
+    if(mName.IsValid())
+    {
+        Close();
+
+        // Don't let the export stop the loopback buffer being reallocated. If this fails, the
+        // region just stays closed until the name is set again.
+        try
+        {
+            Create(inSampleRate, inChannelCount, inFrameSize);
+        }
+        catch(const CAException& e)
+        {
+            LogError("RDC_SharedLoopbackBuffer::Reallocate: Failed to recreate %s (%d)",
+                     mCName,
+                     e.GetError());
+        }
+    }
+}
+
+void    RDC_SharedLoopbackBuffer::SetSampleRate(Float64 inSampleRate)
+{
+    if(mHeader == nullptr)
+    {
+        return;
+    }
+
+    // Empty the ring before changing the rate, so readers never see frames at the old rate with the
+    // new one. The next store restarts the ring.
+    SInt64 theEndTime = mHeader->mEndTime.load(std::memory_order_relaxed);
+    SetTimeBoundsRT(theEndTime, theEndTime);
+
+    mHeader->mSampleRate.store(inSampleRate, std::memory_order_release);
+
+    // The timestamps are for the frames that were just removed.
+    RDC_LoopbackTimeStamps::Clear(mHeader->mTimeStamps);
+}
+
+void    RDC_SharedLoopbackBuffer::StoreRT(const void* __nullable inFrames,
+                                          UInt32 inFrameSize,
+                                          SInt64 inSampleTime)
+{
+    if(mHeader == nullptr)
+    {
+        return;
+    }
+
+    // Only the last mCapacityFrames frames of a larger buffer would survive anyway.
+    if(inFrameSize > mCapacityFrames)
+    {
+        UInt32 theSkippedFrames = inFrameSize - mCapacityFrames;
+        if(inFrames != nullptr)
+        {
+            inFrames = static_cast<const Byte*>(inFrames) + theSkippedFrames * mBytesPerFrame;
+        }
+        inSampleTime += theSkippedFrames;
+        inFrameSize = mCapacityFrames;
+    }
+
+    // We're the only writer, so we can read the bounds without the sequence counter.
+    SInt64 theStartTime = mHeader->mStartTime.load(std::memory_order_relaxed);
+    SInt64 theEndTime = mHeader->mEndTime.load(std::memory_order_relaxed);
+
+    // Restart the ring if the new frames don't follow on from the ones already in it. Small gaps
+    // are filled with silence instead.
+    if(theStartTime == theEndTime ||
+       inSampleTime < theEndTime ||
+       inSampleTime - theEndTime >= mCapacityFrames)
+    {
+        theStartTime = inSampleTime;
+        theEndTime = inSampleTime;
+    }
+
+    SInt64 theNewEndTime = inSampleTime + inFrameSize;
+    SInt64 theNewStartTime = std::max(theStartTime, theNewEndTime - mCapacityFrames);
+
+    // Remove the frames we're about to overwrite from the bounds before overwriting them. If all of
+    // them are going to be overwritten, publish an empty range.
+    SetTimeBoundsRT(theNewStartTime, std::max(theNewStartTime, theEndTime));
+
+    // Readers check the bounds after reading the frames, so the new bounds have to be visible before
+    // any of the frames change.
+    std::atomic_thread_fence(std::memory_order_release);
+
+    SInt64 theGapStartTime = std::max(theEndTime, theNewStartTime);
+    if(theGapStartTime < inSampleTime)
+    {
+        CopyToRingRT(nullptr, static_cast<UInt32>(inSampleTime - theGapStartTime), theGapStartTime);
+    }
+
+    CopyToRingRT(inFrames, inFrameSize, inSampleTime);
+
+    SetTimeBoundsRT(theNewStartTime, theNewEndTime);
+}
+
+void    RDC_SharedLoopbackBuffer::StoreTimeStampRT(SInt64 inSampleTime, UInt64 inHostTime)
+{
+    if(mHeader != nullptr)
+    {
+        RDC_LoopbackTimeStamps::RecordRT(mHeader->mTimeStamps, inSampleTime, inHostTime);
+    }
+}
+
+void    RDC_SharedLoopbackBuffer::ClearTimeStamps()
+{
+    if(mHeader != nullptr)
+    {
+        RDC_LoopbackTimeStamps::Clear(mHeader->mTimeStamps);
+    }
+}
+
+void    RDC_SharedLoopbackBuffer::Create(Float64 inSampleRate,
+                                         UInt32 inChannelCount,
+                                         UInt32 inFrameSize)
+{
+    Assert(mHeader == nullptr, "RDC_SharedLoopbackBuffer::Create: The region already exists");
+
+    const char* theName = mCName;
+
+    UInt32 theBytesPerFrame = inChannelCount * sizeof(Float32);
+    UInt32 theCapacityFrames = NextPowerOfTwo(inFrameSize);
+    size_t thePageSize = static_cast<size_t>(getpagesize());
+    size_t theDataOffset = (sizeof(RDC_SharedLoopbackHeader) + thePageSize - 1) / thePageSize * thePageSize;
+    size_t theRegionSize = theDataOffset + static_cast<size_t>(theCapacityFrames) * theBytesPerFrame;
+
+    // Remove any region left behind by a previous instance of the driver, since ftruncate can only
+    // set the size of a new one.
+    shm_unlink(theName);
+
+    // Only the owner, coreaudiod's user, can open the region unless the export has been made world
+    // readable, since reading it bypasses the HAL's access control.
+    mode_t theMode = S_IRUSR | S_IWUSR | (mWorldReadable ? (S_IRGRP | S_IROTH) : 0);
+    int theFD = shm_open(theName, O_RDWR | O_CREAT | O_EXCL, theMode);
+    ThrowIf(theFD < 0,
+            CAException(kAudioHardwareUnspecifiedError),
+            "RDC_SharedLoopbackBuffer::Create: shm_open failed");
+
+    if(ftruncate(theFD, static_cast<off_t>(theRegionSize)) != 0)
+    {
+        close(theFD);
+        shm_unlink(theName);
+        Throw(CAException(kAudioHardwareUnspecifiedError));
+    }
+
+    void* theRegion = mmap(nullptr, theRegionSize, PROT_READ | PROT_WRITE, MAP_SHARED, theFD, 0);
+
+    // The mapping keeps the region alive, so we don't need the file descriptor anymore.
+    close(theFD);
+
+    if(theRegion == MAP_FAILED)
+    {
+        shm_unlink(theName);
+        Throw(CAException(kAudioHardwareUnspecifiedError));
+    }
+
+    // Touch every page now so the IO thread never page faults on the region.
+    memset(theRegion, 0, theRegionSize);
+
+    mHeader = new (theRegion) RDC_SharedLoopbackHeader;
+    mHeader->mMagic = kRDCSharedLoopbackMagic;
+    mHeader->mVersion = kRDCSharedLoopbackVersion;
+    mHeader->mRegionSize = theRegionSize;
+    mHeader->mDataOffset = theDataOffset;
+    mHeader->mSampleRate.store(inSampleRate, std::memory_order_relaxed);
+    mHeader->mChannelCount = inChannelCount;
+    mHeader->mBytesPerFrame = theBytesPerFrame;
+    mHeader->mCapacityFrames = theCapacityFrames;
+    mHeader->mSequence.store(0, std::memory_order_relaxed);
+    mHeader->mStartTime.store(0, std::memory_order_relaxed);
+    mHeader->mEndTime.store(0, std::memory_order_relaxed);
+    // The slots were zeroed by the memset, which leaves them empty.
+    mHeader->mTimeStamps.mNextPosition.store(0, std::memory_order_relaxed);
+    mHeader->mState.store(kRDCSharedLoopbackState_Live, std::memory_order_release);
+
+    mData = static_cast<Byte*>(theRegion) + theDataOffset;
+    mRegionSize = theRegionSize;
+    mBytesPerFrame = theBytesPerFrame;
+    mCapacityFrames = theCapacityFrames;
+
+    DebugMsg("RDC_SharedLoopbackBuffer::Create: Created %s (%zu bytes, %u frames)",
+             theName,
+             theRegionSize,
+             theCapacityFrames);
+}
+
+void    RDC_SharedLoopbackBuffer::Close()
+{
+    if(mHeader == nullptr)
+    {
+        return;
+    }
+
+    // Tell readers that still have the region mapped to stop using it.
+    mHeader->mState.store(kRDCSharedLoopbackState_Closed, std::memory_order_release);
+
+    munmap(mHeader, mRegionSize);
+
+    shm_unlink(mCName);
+
+    mHeader = nullptr;
+    mData = nullptr;
+    mRegionSize = 0;
+    mBytesPerFrame = 0;
+    mCapacityFrames = 0;
+}
+
+void    RDC_SharedLoopbackBuffer::SetTimeBoundsRT(SInt64 inStartTime, SInt64 inEndTime)
+{
+    UInt64 theSequence = mHeader->mSequence.load(std::memory_order_relaxed);
+
+    // Make the counter odd so readers know the bounds are changing.
+    mHeader->mSequence.store(theSequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    mHeader->mStartTime.store(inStartTime, std::memory_order_relaxed);
+    mHeader->mEndTime.store(inEndTime, std::memory_order_relaxed);
+
+    mHeader->mSequence.store(theSequence + 2, std::memory_order_release);
+}
+
+void    RDC_SharedLoopbackBuffer::CopyToRingRT(const void* __nullable inFrames,
+                                               UInt32 inFrameSize,
+                                               SInt64 inSampleTime)
+{
+    UInt32 theOffsetFrames = static_cast<UInt32>(inSampleTime & (mCapacityFrames - 1));
+    UInt32 theFirstPartFrames = std::min(inFrameSize, mCapacityFrames - theOffsetFrames);
+    UInt32 theSecondPartFrames = inFrameSize - theFirstPartFrames;
+
+    Byte* theFirstPart = mData + theOffsetFrames * mBytesPerFrame;
+
+    if(inFrames == nullptr)
+    {
+        memset(theFirstPart, 0, theFirstPartFrames * mBytesPerFrame);
+        memset(mData, 0, theSecondPartFrames * mBytesPerFrame);
+    }
+    else
+    {
+        const Byte* theFrames = static_cast<const Byte*>(inFrames);
+        memcpy(theFirstPart, theFrames, theFirstPartFrames * mBytesPerFrame);
+        memcpy(mData,
+               theFrames + theFirstPartFrames * mBytesPerFrame,
+               theSecondPartFrames * mBytesPerFrame);
+    }
+}
+
+#pragma clang assume_nonnull end
+
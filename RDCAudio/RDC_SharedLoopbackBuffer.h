@@ -0,0 +1,160 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_SharedLoopbackBuffer.h
+//  RDCDriver
+//
+
+#ifndef __RDCDriver__RDC_SharedLoopbackBuffer__
+#define __RDCDriver__RDC_SharedLoopbackBuffer__
+
+// Local Includes
+#include "RDC_SharedLoopback.h"
+
+// PublicUtility Includes
+#include "CACFString.h"
+
+// System Includes
+#include <CoreAudio/AudioServerPlugIn.h>
+
+
+#pragma clang assume_nonnull begin
+
+//==================================================================================================
+//	RDC_SharedLoopbackBuffer
+//
+//  The writer's side of the shared memory loopback ring described in RDC_SharedLoopback.h. The
+//  region is created, resized and removed only while IO is stopped. StoreRT is real-time safe:
+//  every page of the region is touched when it's created, so storing doesn't page fault.
+//
+//  Methods whose names end with "RT" should only be called from real-time threads.
+//==================================================================================================
+
+class RDC_SharedLoopbackBuffer
+{
+
+public:
+                                        RDC_SharedLoopbackBuffer() = default;
+                                        ~RDC_SharedLoopbackBuffer();
+                                        // Disallow copying
+                                        RDC_SharedLoopbackBuffer(const RDC_SharedLoopbackBuffer&) = delete;
+                                        RDC_SharedLoopbackBuffer& operator=(const RDC_SharedLoopbackBuffer&) = delete;
+
+    /*!
+     Set the name of the shared memory region and create it, replacing the current one if there is
+     one. Must only be called while IO is stopped.
+
+     @param inName The name to pass to shm_open, e.g. "/RDCLoopback". Must start with a slash and be
+                   at most kRDCSharedLoopbackMaxNameLength bytes. The empty string removes the
+                   region.
+     @throws CAException If the name is invalid or the region couldn't be created.
+     */
+    void                                SetName(CFStringRef inName,
+                                                Float64 inSampleRate,
+                                                UInt32 inChannelCount,
+                                                UInt32 inFrameSize);
+    /*! @return The name of the region, or the empty string. The caller must release it. */
+    CFStringRef                         CopyName() const;
+
+    /*!
+     Set whether the region is created readable by every user instead of only its owner, and
+     recreate it if there is one. Must only be called while IO is stopped. See
+     kAudioDeviceCustomPropertySharedLoopbackWorldReadable.
+
+     @throws CAException If the region couldn't be recreated. It's left closed.
+     */
+    void                                SetWorldReadable(bool inWorldReadable,
+                                                         Float64 inSampleRate,
+                                                         UInt32 inChannelCount,
+                                                         UInt32 inFrameSize);
+    /*! @return True if the region is created readable by every user. */
+    bool                                IsWorldReadable() const { return mWorldReadable; }
+
+    /*!
+     Recreate the region for a new format or capacity, if there is one. Readers see the old region
+     closed and have to remap. Must only be called while IO is stopped.
+     */
+    void                                Reallocate(Float64 inSampleRate,
+                                                   UInt32 inChannelCount,
+                                                   UInt32 inFrameSize);
+
+    /*!
+     Empty the ring and publish a new sample rate, without recreating the region. Must only be
+     called while IO is stopped.
+     */
+    void                                SetSampleRate(Float64 inSampleRate);
+
+    /*! @return True if there's a region, i.e. StoreRT will store frames. */
+    bool                                IsEnabled() const { return mHeader != nullptr; }
+
+    /*!
+     Store interleaved Float32 frames at inSampleTime, following the writer's side of the protocol.
+     Does nothing if there's no region.
+
+     @param inFrames The frames, or null to store silence. Readers map the ring directly, so silence
+                     still has to be written to it.
+     */
+    void                                StoreRT(const void* __nullable inFrames,
+                                                UInt32 inFrameSize,
+                                                SInt64 inSampleTime);
+
+    /*!
+     Record the host time of the block of the mix starting at inSampleTime in the region's timestamp
+     table. Does nothing if there's no region.
+     */
+    void                                StoreTimeStampRT(SInt64 inSampleTime, UInt64 inHostTime);
+
+    /*!
+     Empty the region's timestamp table, e.g. because IO is starting and the sample times will start
+     again. Must only be called while IO is stopped.
+     */
+    void                                ClearTimeStamps();
+
+private:
+    void                                Create(Float64 inSampleRate,
+                                               UInt32 inChannelCount,
+                                               UInt32 inFrameSize);
+    // Mark the region closed, unmap it and unlink it.
+    void                                Close();
+
+    // Publish new bounds using the header's sequence counter.
+    void                                SetTimeBoundsRT(SInt64 inStartTime, SInt64 inEndTime);
+    // Copy frames into the ring, wrapping at the end. Doesn't touch the bounds.
+    void                                CopyToRingRT(const void* __nullable inFrames,
+                                                     UInt32 inFrameSize,
+                                                     SInt64 inSampleTime);
+
+private:
+    // The region's name, or invalid if the export is disabled. Only changed while IO is stopped.
+    CACFString                          mName;
+    // mName as a C string, for shm_open and shm_unlink.
+    char                                mCName[kRDCSharedLoopbackMaxNameLength + 1] = {};
+    // Whether the region is created with read permission for other users. Only changed while IO is
+    // stopped.
+    bool                                mWorldReadable = false;
+
+    RDC_SharedLoopbackHeader* __nullable mHeader = nullptr;
+    Byte* __nullable                    mData = nullptr;
+    size_t                              mRegionSize = 0;
+    UInt32                              mBytesPerFrame = 0;
+    UInt32                              mCapacityFrames = 0;
+
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_SharedLoopbackBuffer__ */
+
@@ -0,0 +1,56 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_Signposts.cpp
+//  RDCDriver
+//
+
+// Self Include
+#include "RDC_Signposts.h"
+
+// PublicUtility Includes
+#include "CADebugMacros.h"
+
+
+#pragma clang assume_nonnull begin
+
+std::atomic<bool> RDC_Signposts::sEnabled { false };
+
+void    RDC_Signposts::SetEnabled(bool inEnabled)
+{
+    if(__builtin_available(macOS 10.14, *))
+    {
+        if(inEnabled)
+        {
+            GetLog();
+        }
+
+        DebugMsg("RDC_Signposts::SetEnabled: %s signposts", inEnabled ? "Enabling" : "Disabling");
+
+        // Release, so an IO thread that sees the flag also sees the log.
+        sEnabled.store(inEnabled, std::memory_order_release);
+    }
+}
+
+os_log_t    RDC_Signposts::GetLog()
+{
+    // Created by the first call, from SetEnabled, so IO threads only ever read it.
+    static os_log_t sLog = os_log_create(kRDCDriverBundleID, OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+    return sLog;
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,93 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_Signposts.h
+//  RDCDriver
+//
+//  Signpost intervals for the IO and task queue paths, so coreaudiod can be profiled with
+//  Instruments. They're logged to the Points of Interest category under the driver's bundle ID.
+//
+//  They're off by default and turned on at runtime with kAudioDeviceCustomPropertySignposts. While
+//  they're off, each RDCSignpostBegin or RDCSignpostEnd costs a single load and branch.
+//  The interval names must be string literals.
+//
+
+#ifndef __RDCDriver__RDC_Signposts__
+#define __RDCDriver__RDC_Signposts__
+
+// STL Includes
+#include <atomic>
+
+// System Includes
+#include <MacTypes.h>
+#include <os/log.h>
+#include <os/signpost.h>
+
+
+#pragma clang assume_nonnull begin
+
+class RDC_Signposts
+{
+
+public:
+    /*!
+     Turn the signposts on or off for the whole driver. Turning them on creates the log, so it's
+     never created on an IO thread. Does nothing before macOS 10.14.
+     */
+    static void                         SetEnabled(bool inEnabled);
+    static bool                         IsEnabled() { return sEnabled.load(std::memory_order_acquire); }
+
+    static os_log_t                     GetLog() API_AVAILABLE(macos(10.14));
+
+    /*!
+     @return A signpost ID for inValue, e.g. a client ID. Intervals with the same name and ID must
+             not overlap.
+     */
+    static os_signpost_id_t             MakeID(UInt64 inValue) { return static_cast<os_signpost_id_t>(inValue + 1); }
+
+private:
+    static std::atomic<bool>            sEnabled;
+
+};
+
+#define RDCSignpostBegin(inName, inID)                                                          \
+    do                                                                                          \
+    {                                                                                           \
+        if(RDC_Signposts::IsEnabled())                                                          \
+        {                                                                                       \
+            if(__builtin_available(macOS 10.14, *))                                             \
+            {                                                                                   \
+                os_signpost_interval_begin(RDC_Signposts::GetLog(), (inID), inName);            \
+            }                                                                                   \
+        }                                                                                       \
+    } while(0)
+
+#define RDCSignpostEnd(inName, inID)                                                            \
+    do                                                                                          \
+    {                                                                                           \
+        if(RDC_Signposts::IsEnabled())                                                          \
+        {                                                                                       \
+            if(__builtin_available(macOS 10.14, *))                                             \
+            {                                                                                   \
+                os_signpost_interval_end(RDC_Signposts::GetLog(), (inID), inName);              \
+            }                                                                                   \
+        }                                                                                       \
+    } while(0)
+
+#pragma clang assume_nonnull end
+
+#endif /* __RDCDriver__RDC_Signposts__ */
+
@@ -28,6 +28,7 @@
 #include "RDC_Utils.h"
 #include "RDC_Device.h"
 #include "RDC_PlugIn.h"
+#include "RDC_SampleConversion.h"
 
 // PublicUtility Includes
 #include "CADebugMacros.h"
@@ -35,6 +36,9 @@
 #include "CAPropertyAddress.h"
 #include "CADispatchQueue.h"
 
+// STL Includes
+#include <algorithm>
+
 
 #pragma clang assume_nonnull begin
 
@@ -49,8 +53,14 @@ RDC_Stream::RDC_Stream(AudioObjectID inObjectID,
     mIsInput(inIsInput),
     mIsStreamActive(false),
     mSampleRate(inSampleRate),
+    mChannelsPerFrame(kRDCDefaultChannelCount),
+    mSampleFormat(kRDCSampleFormat_Float32),
+    mNumberOfAvailableSampleRates(kRDCNumberOfAvailableSampleRates),
     mStartingChannel(inStartingChannel)
 {
+    std::copy(kRDCAvailableSampleRates,
+              kRDCAvailableSampleRates + kRDCNumberOfAvailableSampleRates,
+              mAvailableSampleRates);
 }
 
 RDC_Stream::~RDC_Stream()
@@ -165,7 +175,12 @@ UInt32    RDC_Stream::GetPropertyDataSize(AudioObjectID inObjectID,
             
         case kAudioStreamPropertyAvailableVirtualFormats:
         case kAudioStreamPropertyAvailablePhysicalFormats:
-            theAnswer = 1 * sizeof(AudioStreamRangedDescription);
+            {
+                CAMutex::Locker theStateLocker(mStateMutex);
+                theAnswer = kRDCNumberOfSampleFormats *
+                            mNumberOfAvailableSampleRates *
+                            sizeof(AudioStreamRangedDescription);
+            }
             break;
             
         default:
@@ -307,20 +322,13 @@ void    RDC_Stream::GetPropertyData(AudioObjectID inObjectID,
                         "RDC_Stream::GetPropertyData: not enough space for the return "
                         "value of kAudioStreamPropertyVirtualFormat for the stream");
 
-                // This particular device always vends 32-bit native endian floats
-                AudioStreamBasicDescription* outASBD =
-                    reinterpret_cast<AudioStreamBasicDescription*>(outData);
-
-                // Our streams have the same sample rate as the device they belong to.
-                outASBD->mSampleRate = mSampleRate;
-                outASBD->mFormatID = kAudioFormatLinearPCM;
-                outASBD->mFormatFlags =
-                    kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
-                outASBD->mBytesPerPacket = 8;
-                outASBD->mFramesPerPacket = 1;
-                outASBD->mBytesPerFrame = 8;
-                outASBD->mChannelsPerFrame = 2;
-                outASBD->mBitsPerChannel = 32;
+                // Native endian, packed samples in one of the RDC_SampleFormat formats. Our
+                // streams have the same sample rate as the device they belong to.
+                RDC_SampleConversion::FillStreamDescription(
+                        mSampleFormat,
+                        mSampleRate,
+                        mChannelsPerFrame,
+                        *reinterpret_cast<AudioStreamBasicDescription*>(outData));
 
                 outDataSize = sizeof(AudioStreamBasicDescription);
             }
@@ -330,30 +338,35 @@ void    RDC_Stream::GetPropertyData(AudioObjectID inObjectID,
         case kAudioStreamPropertyAvailablePhysicalFormats:
             // This returns an array of AudioStreamRangedDescriptions that describe what
             // formats are supported.
-            if((inDataSize / sizeof(AudioStreamRangedDescription)) >= 1)
+            // formats are supported: each sample format at each of the device's nominal sample
+            // rates. Float32 comes first, as it's the default.
             {
+                CAMutex::Locker theStateLocker(mStateMutex);
+
+                UInt32 theNumberItems = std::min(
+                        static_cast<UInt32>(inDataSize / sizeof(AudioStreamRangedDescription)),
+                        kRDCNumberOfSampleFormats * mNumberOfAvailableSampleRates);
+
                 AudioStreamRangedDescription* outASRD =
                     reinterpret_cast<AudioStreamRangedDescription*>(outData);
 
-                outASRD[0].mFormat.mSampleRate = mSampleRate;
-                outASRD[0].mFormat.mFormatID = kAudioFormatLinearPCM;
-                outASRD[0].mFormat.mFormatFlags =
-                    kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
-                outASRD[0].mFormat.mBytesPerPacket = 8;
-                outASRD[0].mFormat.mFramesPerPacket = 1;
-                outASRD[0].mFormat.mBytesPerFrame = 8;
-                outASRD[0].mFormat.mChannelsPerFrame = 2;
-                outASRD[0].mFormat.mBitsPerChannel = 32;
-                // These match kAudioDevicePropertyAvailableNominalSampleRates.
-                outASRD[0].mSampleRateRange.mMinimum = 44100.0;
-                outASRD[0].mSampleRateRange.mMaximum = 192000.0;
+                for(UInt32 i = 0; i < theNumberItems; i++)
+                {
+                    Float64 theSampleRate =
+                        mAvailableSampleRates[i % mNumberOfAvailableSampleRates];
+
+                    RDC_SampleConversion::FillStreamDescription(
+                            static_cast<RDC_SampleFormat>(i / mNumberOfAvailableSampleRates),
+                            theSampleRate,
+                            mChannelsPerFrame,
+                            outASRD[i].mFormat);
+                    // These match kAudioDevicePropertyAvailableNominalSampleRates.
+                    outASRD[i].mSampleRateRange.mMinimum = theSampleRate;
+                    outASRD[i].mSampleRateRange.mMaximum = theSampleRate;
+                }
 
                 // Report how much we wrote.
-                outDataSize = sizeof(AudioStreamRangedDescription);
-            }
-            else
-            {
-                outDataSize = 0;
+                outDataSize = theNumberItems * sizeof(AudioStreamRangedDescription);
             }
             break;
 
@@ -416,8 +429,7 @@ void    RDC_Stream::SetPropertyData(AudioObjectID inObjectID,
                 // to be handled via the RequestConfigChange/PerformConfigChange machinery. The
                 // stream only needs to validate the format at this point.
                 //
-                // Note that because our devices only supports 2 channel 32 bit float data, the only
-                // thing that can change is the sample rate.
+                // The sample rate, the number of channels and the sample format can change.
                 ThrowIf(inDataSize != sizeof(AudioStreamBasicDescription),
                         CAException(kAudioHardwareBadPropertySizeError),
                         "RDC_Stream::SetPropertyData: wrong size for the data for "
@@ -426,36 +438,18 @@ void    RDC_Stream::SetPropertyData(AudioObjectID inObjectID,
                 const AudioStreamBasicDescription* theNewFormat =
                     reinterpret_cast<const AudioStreamBasicDescription*>(inData);
 
-                ThrowIf(theNewFormat->mFormatID != kAudioFormatLinearPCM,
-                        CAException(kAudioDeviceUnsupportedFormatError),
-                        "RDC_Stream::SetPropertyData: unsupported format ID for "
-                        "kAudioStreamPropertyPhysicalFormat");
-                ThrowIf(theNewFormat->mFormatFlags !=
-                            (kAudioFormatFlagIsFloat |
-                             kAudioFormatFlagsNativeEndian |
-                             kAudioFormatFlagIsPacked),
-                        CAException(kAudioDeviceUnsupportedFormatError),
-                        "RDC_Stream::SetPropertyData: unsupported format flags for "
-                        "kAudioStreamPropertyPhysicalFormat");
-                ThrowIf(theNewFormat->mBytesPerPacket != 8,
-                        CAException(kAudioDeviceUnsupportedFormatError),
-                        "RDC_Stream::SetPropertyData: unsupported bytes per packet for "
-                        "kAudioStreamPropertyPhysicalFormat");
-                ThrowIf(theNewFormat->mFramesPerPacket != 1,
-                        CAException(kAudioDeviceUnsupportedFormatError),
-                        "RDC_Stream::SetPropertyData: unsupported frames per packet for "
-                        "kAudioStreamPropertyPhysicalFormat");
-                ThrowIf(theNewFormat->mBytesPerFrame != 8,
-                        CAException(kAudioDeviceUnsupportedFormatError),
-                        "RDC_Stream::SetPropertyData: unsupported bytes per frame for "
-                        "kAudioStreamPropertyPhysicalFormat");
-                ThrowIf(theNewFormat->mChannelsPerFrame != 2,
+                ThrowIf(theNewFormat->mChannelsPerFrame < 1 ||
+                            theNewFormat->mChannelsPerFrame > kRDCMaxChannelCount,
                         CAException(kAudioDeviceUnsupportedFormatError),
                         "RDC_Stream::SetPropertyData: unsupported channels per frame for "
                         "kAudioStreamPropertyPhysicalFormat");
-                ThrowIf(theNewFormat->mBitsPerChannel != 32,
+
+                // Checks the format ID, flags, bits per channel and sizes.
+                RDC_SampleFormat theSampleFormat;
+                ThrowIf(!RDC_SampleConversion::GetFormatOfStreamDescription(*theNewFormat,
+                                                                            theSampleFormat),
                         CAException(kAudioDeviceUnsupportedFormatError),
-                        "RDC_Stream::SetPropertyData: unsupported bits per channel for "
+                        "RDC_Stream::SetPropertyData: unsupported sample format for "
                         "kAudioStreamPropertyPhysicalFormat");
                 ThrowIf(theNewFormat->mSampleRate < 1.0,
                         CAException(kAudioDeviceUnsupportedFormatError),
@@ -484,5 +478,33 @@ void    RDC_Stream::SetSampleRate(Float64 inSampleRate)
     mSampleRate = inSampleRate;
 }
 
+void    RDC_Stream::SetChannelsPerFrame(UInt32 inChannelsPerFrame)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    mChannelsPerFrame = inChannelsPerFrame;
+}
+
+void    RDC_Stream::SetSampleFormat(RDC_SampleFormat inSampleFormat)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    mSampleFormat = inSampleFormat;
+}
+
+void    RDC_Stream::SetAvailableSampleRates(const Float64* inRates, UInt32 inNumberOfRates)
+{
+    Assert(inNumberOfRates >= 1 && inNumberOfRates <= kRDCMaxAvailableSampleRates,
+           "RDC_Stream::SetAvailableSampleRates: Invalid number of rates");
+
+    CAMutex::Locker theStateLocker(mStateMutex);
+    std::copy(inRates, inRates + inNumberOfRates, mAvailableSampleRates);
+    mNumberOfAvailableSampleRates = inNumberOfRates;
+}
+
+void    RDC_Stream::SetStartingChannel(UInt32 inStartingChannel)
+{
+    CAMutex::Locker theStateLocker(mStateMutex);
+    mStartingChannel = inStartingChannel;
+}
+
 #pragma clang assume_nonnull end
 
@@ -31,6 +31,9 @@
 // SuperClass Includes
 #include "RDC_Object.h"
 
+// Local Includes
+#include "RDC_Types.h"
+
 // PublicUtility Includes
 #include "CAMutex.h"
 
@@ -88,12 +91,40 @@ public:
 #pragma mark Accessors
 
     void                        SetSampleRate(Float64 inSampleRate);
+    /*!
+     Set the number of interleaved channels in the stream's format. Like the sample rate, this
+     should only be changed by the owning device after the host has stopped IO.
+     */
+    void                        SetChannelsPerFrame(UInt32 inChannelsPerFrame);
+    /*!
+     Set the sample format of the stream's virtual and physical formats. Also only changed by the
+     owning device while IO is stopped.
+     */
+    void                        SetSampleFormat(RDC_SampleFormat inSampleFormat);
+    /*!
+     Set the sample rates of the stream's available formats, which should match the owning device's
+     kAudioDevicePropertyAvailableNominalSampleRates. Also only changed while IO is stopped.
+     inNumberOfRates must be in [1, kRDCMaxAvailableSampleRates].
+     */
+    void                        SetAvailableSampleRates(const Float64* inRates, UInt32 inNumberOfRates);
+    /*!
+     Set the absolute channel number of the stream's first channel, e.g. when the channel count of
+     a stream before it on the same device changes. Also only changed while IO is stopped.
+     */
+    void                        SetStartingChannel(UInt32 inStartingChannel);
 
 private:
     CAMutex                     mStateMutex;
 
     bool                        mIsInput;
     Float64                     mSampleRate;
+    /*! The number of interleaved channels in each frame. */
+    UInt32                      mChannelsPerFrame;
+    /*! The format of each sample. The virtual and physical formats are always the same. */
+    RDC_SampleFormat            mSampleFormat;
+    /*! The sample rates of the available formats. */
+    Float64                     mAvailableSampleRates[kRDCMaxAvailableSampleRates];
+    UInt32                      mNumberOfAvailableSampleRates;
     /*! True if the stream is enabled and doing IO. See kAudioStreamPropertyIsActive. */
     bool                        mIsStreamActive;
     /*! 
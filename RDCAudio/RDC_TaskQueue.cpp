@@ -28,41 +28,55 @@
 #include "RDC_Utils.h"
 #include "RDC_PlugIn.h"
 #include "RDC_Clients.h"
-#include "RDC_ClientMap.h"
 #include "RDC_ClientTasks.h"
+#include "RDC_Recorder.h"
+#include "RDC_RetroBuffer.h"
+#include "RDC_Signposts.h"
+#include "RDC_RTSafety.h"
 
 // PublicUtility Includes
 #include "CAException.h"
 #include "CADebugMacros.h"
+#include "CAHostTimeBase.h"
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wsign-conversion"
 #include "CAAtomic.h"
 #pragma clang diagnostic pop
 
+// STL Includes
+#include <algorithm>
+
 // System Includes
 #include <mach/mach_init.h>
 #include <mach/mach_time.h>
 #include <mach/task.h>
+#include <sched.h>
 
 
 #pragma clang assume_nonnull begin
 
 #pragma mark Construction/destruction
 
-RDC_TaskQueue::RDC_TaskQueue()
+RDC_TaskQueue::RDC_TaskQueue(UInt32 inNonRealTimeThreadTaskPoolSize)
 :
     // The inline documentation for thread_time_constraint_policy.period says "A value of 0 indicates that there is no
     // inherent periodicity in the computation". So I figure setting the period to 0 means the scheduler will take as long
     // as it wants to wake our real-time thread, which is fine for us, but once it has only other real-time threads can
     // preempt us. (And that's only if they won't make our computation take longer than kRealTimeThreadMaximumComputationNs).
+    // Once IO starts, UpdateRealTimeThreadTimeConstraints replaces these with constraints based on the IO period.
     mRealTimeThread(&RDC_TaskQueue::RealTimeThreadProc,
                     this,
                     /* inPeriod = */ 0,
                     NanosToAbsoluteTime(kRealTimeThreadNominalComputationNs),
                     NanosToAbsoluteTime(kRealTimeThreadMaximumComputationNs),
                     /* inIsPreemptible = */ true),
-    mNonRealTimeThread(&RDC_TaskQueue::NonRealTimeThreadProc, this)
+    mNonRealTimeThread(&RDC_TaskQueue::NonRealTimeThreadProc, this),
+    mNonRealTimeThreadTaskPoolSize(inNonRealTimeThreadTaskPoolSize)
 {
+    ThrowIf(inNonRealTimeThreadTaskPoolSize == 0 || inNonRealTimeThreadTaskPoolSize > kMaxNonRealTimeThreadTaskPoolSize,
+            CAException(kAudioHardwareIllegalOperationError),
+            "RDC_TaskQueue::RDC_TaskQueue: Task pool size out of range");
+    
     // Init the semaphores
     auto createSemaphore = [] () {
         semaphore_t theSemaphore;
@@ -82,12 +96,12 @@ RDC_TaskQueue::RDC_TaskQueue()
     mRealTimeThreadSyncTaskCompletedSemaphore = createSemaphore();
     mNonRealTimeThreadSyncTaskCompletedSemaphore = createSemaphore();
     
-    // Pre-allocate enough tasks in mNonRealTimeThreadTasksFreeList that the real-time threads should never have to
-    // allocate memory when adding a task to the non-realtime queue.
-    for(UInt32 i = 0; i < kNonRealTimeThreadTaskBufferSize; i++)
+    // Pre-allocate the pool of async tasks, so queueing one never has to allocate memory.
+    mNonRealTimeThreadTaskPool.reset(new RDC_Task[mNonRealTimeThreadTaskPoolSize]);
+    
+    for(UInt32 i = 0; i < mNonRealTimeThreadTaskPoolSize; i++)
     {
-        RDC_Task* theTask = new RDC_Task;
-        mNonRealTimeThreadTasksFreeList.push_NA(theTask);
+        mNonRealTimeThreadTasksFreeList.push_NA(&mNonRealTimeThreadTaskPool[i]);
     }
     
     // Start the worker threads
@@ -115,22 +129,16 @@ RDC_TaskQueue::~RDC_TaskQueue()
     destroySemaphore(mRealTimeThreadSyncTaskCompletedSemaphore);
     destroySemaphore(mNonRealTimeThreadSyncTaskCompletedSemaphore);
     
-    RDC_Task* theTask;
-    
-    // Delete the tasks in the non-realtime tasks free list
-    while((theTask = mNonRealTimeThreadTasksFreeList.pop_atomic()) != NULL)
-    {
-        delete theTask;
-    }
-    
-    // Delete any tasks left on the non-realtime queue that need to be
-    while((theTask = mNonRealTimeThreadTasks.pop_atomic()) != NULL)
-    {
-        if(!theTask->IsSync())
-        {
-            delete theTask;
-        }
-    }
+    // Any tasks left in the queues belong to the pool or to the threads that queued them, so they don't need to be freed.
+    DebugMsg("RDC_TaskQueue::~RDC_TaskQueue: Task queue high-water marks: realtime=%llu/%u non-realtime=%llu/%u. "
+             "Task pool: %llu/%u used, %llu dropped",
+             mRealTimeThreadTasks.GetHighWaterMark(),
+             RDC_RealTimeTaskFIFO::GetCapacity(),
+             mNonRealTimeThreadTasks.GetHighWaterMark(),
+             RDC_NonRealTimeTaskFIFO::GetCapacity(),
+             GetTaskPoolHighWaterMark(),
+             mNonRealTimeThreadTaskPoolSize,
+             GetDroppedTaskCount());
 }
 
 //static
@@ -146,25 +154,86 @@ UInt32  RDC_TaskQueue::NanosToAbsoluteTime(UInt32 inNanos)
     return static_cast<UInt32>(inNanos * theTicksPerNs);
 }
 
-#pragma mark Task queueing
+#pragma mark Real-time thread scheduling
 
-void    RDC_TaskQueue::QueueSync_SwapClientShadowMaps(RDC_ClientMap* inClientMap)
+void    RDC_TaskQueue::SetRealTimeThreadIOCycleRT(UInt32 inIOBufferFrameSize, Float64 inHostTicksPerFrame)
 {
-    // TODO: Is there any reason to use uintptr_t when we pass pointers to tasks like this? I can't think of any
-    //       reason for a system to have (non-function) pointers larger than 64-bit, so I figure they should fit.
-    //
-    //       From http://en.cppreference.com/w/cpp/language/reinterpret_cast:
-    //       "A pointer converted to an integer of sufficient size and back to the same pointer type is guaranteed
-    //        to have its original value [...]"
-    QueueSync(kRDCTaskSwapClientShadowMaps, /* inRunOnRealtimeThread = */ true, reinterpret_cast<UInt64>(inClientMap));
+    UInt64 thePeriod = static_cast<UInt64>(inIOBufferFrameSize * inHostTicksPerFrame);
+    
+    if(thePeriod != mRealTimeThreadIOPeriod.load(std::memory_order_relaxed))
+    {
+        mRealTimeThreadIOPeriod.store(thePeriod, std::memory_order_relaxed);
+        
+        // Wake the worker thread so it updates its constraints before it's next given a task. If it wakes to find no tasks,
+        // it just goes back to waiting.
+        semaphore_signal(mRealTimeThreadWorkQueuedSemaphore);
+    }
 }
 
-void    RDC_TaskQueue::QueueAsync_SendPropertyNotification(AudioObjectPropertySelector inProperty, AudioObjectID inDeviceID)
+void    RDC_TaskQueue::UpdateRealTimeThreadTimeConstraints()
 {
-    DebugMsg("RDC_TaskQueue::QueueAsync_SendPropertyNotification: Queueing property notification. inProperty=%u inDeviceID=%u",
+    UInt64 theIOPeriod = mRealTimeThreadIOPeriod.load(std::memory_order_relaxed);
+    
+    if(theIOPeriod == 0 || theIOPeriod == mAppliedRealTimeThreadIOPeriod)
+    {
+        return;
+    }
+    
+    mAppliedRealTimeThreadIOPeriod = theIOPeriod;
+    
+    // The policy's fields are 32-bit. A period that doesn't fit would be longer than any IO cycle, so just cap it.
+    UInt32 thePeriod = static_cast<UInt32>(std::min(theIOPeriod, static_cast<UInt64>(UINT32_MAX)));
+    UInt32 theComputation = std::max(NanosToAbsoluteTime(kRealTimeThreadNominalComputationNs),
+                                     thePeriod / kRealTimeThreadIOPeriodComputationDivisor);
+    UInt32 theConstraint = std::max({ NanosToAbsoluteTime(kRealTimeThreadMaximumComputationNs),
+                                      thePeriod / 2,
+                                      theComputation });
+    
+    // The constraint can't be longer than the period, which could only happen with a tiny IO buffer. Fall back to saying the
+    // work isn't periodic, as we did before the period was known.
+    if(theConstraint > thePeriod)
+    {
+        thePeriod = 0;
+    }
+    
+    DebugMsg("RDC_TaskQueue::UpdateRealTimeThreadTimeConstraints: period=%u computation=%u constraint=%u",
+             thePeriod,
+             theComputation,
+             theConstraint);
+    
+    mRealTimeThread.SetTimeConstraints(thePeriod, theComputation, theConstraint, /* inIsPreemptible = */ true);
+}
+
+#pragma mark Task queueing
+
+void    RDC_TaskQueue::QueueAsync_SendPropertyNotification(AudioObjectPropertySelector inProperty,
+                                                           AudioObjectID inObjectID,
+                                                           AudioObjectPropertyScope inScope,
+                                                           AudioObjectPropertyElement inElement)
+{
+    DebugMsg("RDC_TaskQueue::QueueAsync_SendPropertyNotification: Queueing property notification. inProperty=%u inObjectID=%u",
              inProperty,
-             inDeviceID);
-    RDC_Task theTask(kRDCTaskSendPropertyNotification, /* inIsSync = */ false, inProperty, inDeviceID);
+             inObjectID);
+    
+    // Pack the address and object ID into the task's two args.
+    UInt64 thePropertyArg = (static_cast<UInt64>(inScope) << 32) | inProperty;
+    UInt64 theObjectArg = (static_cast<UInt64>(inElement) << 32) | inObjectID;
+    
+    RDC_Task theTask(kRDCTaskSendPropertyNotification, /* inIsSync = */ false, thePropertyArg, theObjectArg);
+    QueueOnNonRealtimeThread(theTask);
+}
+
+void    RDC_TaskQueue::QueueAsync_DrainRecorder(RDC_Recorder* inRecorder)
+{
+    // No DebugMsg, since this is called from the IO thread.
+    RDC_Task theTask(kRDCTaskDrainRecorder, /* inIsSync = */ false, reinterpret_cast<UInt64>(inRecorder));
+    QueueOnNonRealtimeThread(theTask);
+}
+
+void    RDC_TaskQueue::QueueAsync_DrainRetroBuffer(RDC_RetroBuffer* inRetroBuffer)
+{
+    // No DebugMsg, since this is called from the IO thread.
+    RDC_Task theTask(kRDCTaskDrainRetroBuffer, /* inIsSync = */ false, reinterpret_cast<UInt64>(inRetroBuffer));
     QueueOnNonRealtimeThread(theTask);
 }
 
@@ -185,10 +254,8 @@ bool    RDC_TaskQueue::Queue_UpdateClientIOState(bool inSync, RDC_Clients* inCli
     else
     {
         RDC_Task theTask(theTaskID, /* inIsSync = */ false, theClientsPtrArg, theClientIDTaskArg);
-        QueueOnNonRealtimeThread(theTask);
-        
-        // This method's return value isn't used when queueing async, because we can't know what it should be yet.
-        return false;
+        // We can't know what the task will return yet, so when queueing async this only reports whether it was queued.
+        return QueueOnNonRealtimeThread(theTask);
     }
 }
 
@@ -203,13 +270,30 @@ UInt64    RDC_TaskQueue::QueueSync(RDC_TaskID inTaskID, bool inRunOnRealtimeThre
     // Create the task
     RDC_Task theTask(inTaskID, /* inIsSync = */ true, inTaskArg1, inTaskArg2);
     
-    // Add the task to the queue
-    TAtomicStack<RDC_Task>& theTasks = (inRunOnRealtimeThread ? mRealTimeThreadTasks : mNonRealTimeThreadTasks);
-    theTasks.push_atomic(&theTask);
+    // Add the task to the queue and wake the worker thread so it'll process the task
+    if(inRunOnRealtimeThread)
+    {
+        // Tasks for the realtime thread are queued from the IO path, so they're dropped rather than waiting for room in a full
+        // queue. Stopping the thread is the exception, since the destructor can't continue until it's done.
+        bool theMayWait = (inTaskID == kRDCTaskStopWorkerThread);
+        
+        if(!PushTask(mRealTimeThreadTasks, &theTask, mRealTimeThreadWorkQueuedSemaphore, theMayWait, "RDC_TaskQueue::QueueSync"))
+        {
+            // theTask was never added to the queue, so it's safe to let it go out of scope.
+            mDroppedTaskCount++;
+            return kTaskDroppedReturnValue;
+        }
+    }
+    else
+    {
+        PushTask(mNonRealTimeThreadTasks,
+                 &theTask,
+                 mNonRealTimeThreadWorkQueuedSemaphore,
+                 /* inMayWait = */ true,
+                 "RDC_TaskQueue::QueueSync");
+    }
     
-    // Wake the worker thread so it'll process the task. (Note that semaphore_signal has an implicit barrier.)
-    kern_return_t theError = semaphore_signal(inRunOnRealtimeThread ? mRealTimeThreadWorkQueuedSemaphore : mNonRealTimeThreadWorkQueuedSemaphore);
-    RDC_Utils::ThrowIfMachError("RDC_TaskQueue::QueueSync", "semaphore_signal", theError);
+    kern_return_t theError;
     
     // Wait until the task has been processed.
     //
@@ -254,24 +338,102 @@ UInt64    RDC_TaskQueue::QueueSync(RDC_TaskID inTaskID, bool inRunOnRealtimeThre
     return theTask.GetReturnValue();
 }
 
-void   RDC_TaskQueue::QueueOnNonRealtimeThread(RDC_Task inTask)
+bool   RDC_TaskQueue::QueueOnNonRealtimeThread(RDC_Task inTask)
 {
     // Add the task to our task list
-    RDC_Task* freeTask = mNonRealTimeThreadTasksFreeList.pop_atomic();
+    RDC_Task* freeTask = AcquirePooledTask();
     
     if(freeTask == NULL)
     {
-        LogWarning("RDC_TaskQueue::QueueOnNonRealtimeThread: No pre-allocated tasks left in the free list. Allocating new task.");
-        freeTask = new RDC_Task;
+        // Allocating a task here wouldn't be real-time safe, so drop it. The count is reported in the loopback stats.
+        mDroppedTaskCount++;
+        return false;
     }
     
     *freeTask = inTask;
     
-    mNonRealTimeThreadTasks.push_atomic(freeTask);
+    // Async tasks are usually queued on IO threads, which can't wait for the worker thread to make room.
+    if(!PushTask(mNonRealTimeThreadTasks,
+                 freeTask,
+                 mNonRealTimeThreadWorkQueuedSemaphore,
+                 /* inMayWait = */ false,
+                 "RDC_TaskQueue::QueueOnNonRealtimeThread"))
+    {
+        ReleasePooledTask(freeTask);
+        mDroppedTaskCount++;
+        return false;
+    }
+    
+    return true;
+}
+
+template <typename TFIFO>
+bool    RDC_TaskQueue::PushTask(TFIFO& inTasks,
+                                RDC_Task* inTask,
+                                semaphore_t inWorkQueuedSemaphore,
+                                bool inMayWait,
+                                const char* inCallerName)
+{
+    bool didLogFullMessage = false;
+    
+    inTask->SetEnqueueTime(mach_absolute_time());
+    
+    while(!inTasks.Push(inTask))
+    {
+        if(!inMayWait)
+        {
+            // Still wake the worker thread, since it must be behind, but leave logging the drop to the caller's counter.
+            // (Logging isn't real-time safe.)
+            semaphore_signal(inWorkQueuedSemaphore);
+            return false;
+        }
+        
+        // The queue is sized so this shouldn't happen, but if it does the worker thread must be behind, so make sure it's
+        // awake and give it a chance to run.
+        if(!didLogFullMessage)
+        {
+            LogWarning("%s: The task queue is full (%u tasks). Waiting for the worker thread.", inCallerName, TFIFO::GetCapacity());
+            didLogFullMessage = true;
+        }
+        
+        semaphore_signal(inWorkQueuedSemaphore);
+        sched_yield();
+    }
     
     // Signal the worker thread to process the task. (Note that semaphore_signal has an implicit barrier.)
-    kern_return_t theError = semaphore_signal(mNonRealTimeThreadWorkQueuedSemaphore);
-    RDC_Utils::ThrowIfMachError("RDC_TaskQueue::QueueOnNonRealtimeThread", "semaphore_signal", theError);
+    kern_return_t theError = semaphore_signal(inWorkQueuedSemaphore);
+    RDC_Utils::ThrowIfMachError(inCallerName, "semaphore_signal", theError);
+    
+    return true;
+}
+
+RDC_TaskQueue::RDC_Task* __nullable RDC_TaskQueue::AcquirePooledTask()
+{
+    RDC_Task* theTask = mNonRealTimeThreadTasksFreeList.pop_atomic();
+    
+    if(theTask != NULL)
+    {
+        UInt64 theInUse = ++mTaskPoolTasksInUse;
+        UInt64 theHighWaterMark = mTaskPoolHighWaterMark.load(std::memory_order_relaxed);
+        
+        while(theInUse > theHighWaterMark &&
+              !mTaskPoolHighWaterMark.compare_exchange_weak(theHighWaterMark, theInUse, std::memory_order_relaxed))
+        {
+        }
+    }
+    
+    return theTask;
+}
+
+void    RDC_TaskQueue::ReleasePooledTask(RDC_Task* inTask)
+{
+    RDCAssert(inTask >= &mNonRealTimeThreadTaskPool[0] &&
+              inTask < &mNonRealTimeThreadTaskPool[mNonRealTimeThreadTaskPoolSize],
+              "RDC_TaskQueue::ReleasePooledTask: Task %p isn't from the pool",
+              inTask);
+    
+    mTaskPoolTasksInUse--;
+    mNonRealTimeThreadTasksFreeList.push_atomic(inTask);
 }
 
 #pragma mark Worker threads
@@ -299,8 +461,10 @@ void* __nullable    RDC_TaskQueue::RealTimeThreadProc(void* inRefCon)
     RDC_TaskQueue* refCon = static_cast<RDC_TaskQueue*>(inRefCon);
     refCon->WorkerThreadProc(refCon->mRealTimeThreadWorkQueuedSemaphore,
                              refCon->mRealTimeThreadSyncTaskCompletedSemaphore,
-                             &refCon->mRealTimeThreadTasks,
-                             NULL,
+                             [&] () -> RDC_Task* __nullable {
+                                 RDC_Task* theTask;
+                                 return refCon->mRealTimeThreadTasks.Pop(theTask) ? theTask : NULL;
+                             },
                              [&] (RDC_Task* inTask) { return refCon->ProcessRealTimeThreadTask(inTask); });
     
     return NULL;
@@ -314,16 +478,19 @@ void* __nullable    RDC_TaskQueue::NonRealTimeThreadProc(void* inRefCon)
     RDC_TaskQueue* refCon = static_cast<RDC_TaskQueue*>(inRefCon);
     refCon->WorkerThreadProc(refCon->mNonRealTimeThreadWorkQueuedSemaphore,
                              refCon->mNonRealTimeThreadSyncTaskCompletedSemaphore,
-                             &refCon->mNonRealTimeThreadTasks,
-                             &refCon->mNonRealTimeThreadTasksFreeList,
+                             [&] () -> RDC_Task* __nullable {
+                                 RDC_Task* theTask;
+                                 return refCon->mNonRealTimeThreadTasks.Pop(theTask) ? theTask : NULL;
+                             },
                              [&] (RDC_Task* inTask) { return refCon->ProcessNonRealTimeThreadTask(inTask); });
     
     return NULL;
 }
 
-void    RDC_TaskQueue::WorkerThreadProc(semaphore_t inWorkQueuedSemaphore, semaphore_t inSyncTaskCompletedSemaphore, TAtomicStack<RDC_Task>* inTasks, TAtomicStack2<RDC_Task>* __nullable inFreeList, std::function<bool(RDC_Task*)> inProcessTask)
+void    RDC_TaskQueue::WorkerThreadProc(semaphore_t inWorkQueuedSemaphore, semaphore_t inSyncTaskCompletedSemaphore, std::function<RDC_Task* __nullable()> inPopTask, std::function<bool(RDC_Task*)> inProcessTask)
 {
     bool theThreadShouldStop = false;
+    bool isNonRealTimeThread = (inWorkQueuedSemaphore == mNonRealTimeThreadWorkQueuedSemaphore);
     
     while(!theThreadShouldStop)
     {
@@ -331,35 +498,62 @@ void    RDC_TaskQueue::WorkerThreadProc(semaphore_t inWorkQueuedSemaphore, semap
         //
         // Note that we don't have to hold any lock before waiting. If the semaphore is signalled before we begin waiting we'll
         // still get the signal after we do.
-        kern_return_t theError = semaphore_wait(inWorkQueuedSemaphore);
-        RDC_Utils::ThrowIfMachError("RDC_TaskQueue::WorkerThreadProc", "semaphore_wait", theError);
-        
-        // Fetch the tasks from the queue.
         //
-        // The tasks need to be processed in the order they were added to the queue. Since pop_all_reversed is atomic, other threads
-        // can't add new tasks while we're reading, which would mix up the order.
-        RDC_Task* theTask = inTasks->pop_all_reversed();
+        // The only timed wait is for coalesced property notifications, which are only pending for a short window after
+        // something changed. Otherwise the worker threads never wake up by themselves, so they cost nothing while no clients
+        // are doing IO.
+        kern_return_t theError;
         
-        while(theTask != NULL &&
-              !theThreadShouldStop)  // Stop processing tasks if we're shutting down
+        if(isNonRealTimeThread && mPendingPropertyNotificationCount > 0)
         {
-            RDC_Task* theNextTask = theTask->mNext;
+            // There are coalesced property notifications waiting, so only wait until they're due.
+            UInt64 theNow = CAHostTimeBase::GetTheCurrentTime();
+            UInt64 theRemainingNs = 0;
             
+            if(mPendingPropertyNotificationsDeadline > theNow)
+            {
+                theRemainingNs = CAHostTimeBase::ConvertToNanos(mPendingPropertyNotificationsDeadline - theNow);
+            }
+            
+            mach_timespec_t theTimeout = { static_cast<unsigned int>(theRemainingNs / NSEC_PER_SEC),
+                                           static_cast<clock_res_t>(theRemainingNs % NSEC_PER_SEC) };
+            theError = semaphore_timedwait(inWorkQueuedSemaphore, theTimeout);
+            
+            if(theError == KERN_OPERATION_TIMED_OUT)
+            {
+                theError = KERN_SUCCESS;
+            }
+        }
+        else
+        {
+            theError = semaphore_wait(inWorkQueuedSemaphore);
+        }
+        
+        RDC_Utils::ThrowIfMachError("RDC_TaskQueue::WorkerThreadProc", "semaphore_wait", theError);
+        
+        if(!isNonRealTimeThread)
+        {
+            UpdateRealTimeThreadTimeConstraints();
+        }
+        
+        // Process the tasks in the queue, in the order they were added. Tasks added while we're doing this are processed as
+        // well, and the extra signals they sent just make the next wait return straight away.
+        RDC_Task* theTask;
+        
+        while(!theThreadShouldStop &&  // Stop processing tasks if we're shutting down
+              (theTask = inPopTask()) != NULL)
+        {
             RDCAssert(!theTask->IsComplete(),
                       "RDC_TaskQueue::WorkerThreadProc: Cannot process already completed task (ID %d)",
                       theTask->GetTaskID());
             
-            RDCAssert(theTask != theNextTask,
-                      "RDC_TaskQueue::WorkerThreadProc: RDC_Task %p (ID %d) was added to %s multiple times. arg1=%llu arg2=%llu",
-                      theTask,
-                      theTask->GetTaskID(),
-                      (inTasks == &mRealTimeThreadTasks ? "mRealTimeThreadTasks" : "mNonRealTimeThreadTasks"),
-                      theTask->GetArg1(),
-                      theTask->GetArg2());
-            
             // Process the task
+            UInt64 theStartTime = mach_absolute_time();
             theThreadShouldStop = inProcessTask(theTask);
             
+            // This has to be done before a sync task is marked completed, since it could be freed after that.
+            RecordTaskLatencies(theTask, theStartTime, mach_absolute_time());
+            
             // If the task was queued synchronously, let the thread that queued it know we're finished
             if(theTask->IsSync())
             {
@@ -378,14 +572,97 @@ void    RDC_TaskQueue::WorkerThreadProc(semaphore_t inWorkQueuedSemaphore, semap
                 theError = semaphore_signal_all(inSyncTaskCompletedSemaphore);
                 RDC_Utils::ThrowIfMachError("RDC_TaskQueue::WorkerThreadProc", "semaphore_signal_all", theError);
             }
-            else if(inFreeList != NULL)
+            else
             {
-                // After completing an async task, move it to the free list so the memory can be reused
-                inFreeList->push_atomic(theTask);
+                // After completing an async task, return it to the pool so it can be reused
+                ReleasePooledTask(theTask);
             }
-            
-            theTask = theNextTask;
         }
+        
+        // Send the coalesced property notifications once their window has passed. (When the thread is stopping, the host is
+        // being torn down, so they're just dropped.)
+        if(isNonRealTimeThread &&
+           !theThreadShouldStop &&
+           mPendingPropertyNotificationCount > 0 &&
+           CAHostTimeBase::GetTheCurrentTime() >= mPendingPropertyNotificationsDeadline)
+        {
+            SendPendingPropertyNotifications();
+        }
+    }
+}
+
+void    RDC_TaskQueue::RecordTaskLatencies(RDC_Task* inTask, UInt64 inStartTime, UInt64 inEndTime)
+{
+    RDC_TaskID theTaskID = inTask->GetTaskID();
+    UInt64 theEnqueueTime = inTask->GetEnqueueTime();
+    
+    if(theTaskID < kRDCTaskIDCount && theEnqueueTime <= inStartTime)
+    {
+        mTaskWaitLatencies[theTaskID].RecordRT(CAHostTimeBase::ConvertToNanos(inStartTime - theEnqueueTime));
+        mTaskTotalLatencies[theTaskID].RecordRT(CAHostTimeBase::ConvertToNanos(inEndTime - theEnqueueTime));
+    }
+}
+
+//static
+CFStringRef RDC_TaskQueue::GetTaskName(RDC_TaskID inTaskID)
+{
+    switch(inTaskID)
+    {
+        case kRDCTaskStopWorkerThread: return CFSTR("StopWorkerThread");
+        case kRDCTaskStartClientIO: return CFSTR("StartClientIO");
+        case kRDCTaskStopClientIO: return CFSTR("StopClientIO");
+        case kRDCTaskSendPropertyNotification: return CFSTR("SendPropertyNotification");
+        case kRDCTaskDrainRecorder: return CFSTR("DrainRecorder");
+        case kRDCTaskDrainRetroBuffer: return CFSTR("DrainRetroBuffer");
+        default: return CFSTR("Unknown");
+    }
+}
+
+CFDictionaryRef RDC_TaskQueue::CopyTaskLatencies() const
+{
+    CFMutableDictionaryRef theLatencies =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      0,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(theLatencies,
+                CAException(kAudioHardwareUnspecifiedError),
+                "RDC_TaskQueue::CopyTaskLatencies: failed to create the dictionary");
+    
+    // Skip kRDCTaskUninitialized, which is never queued.
+    for(UInt32 theTaskID = kRDCTaskUninitialized + 1; theTaskID < kRDCTaskIDCount; theTaskID++)
+    {
+        CFMutableDictionaryRef theHistograms =
+                CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                          2,
+                                          &kCFTypeDictionaryKeyCallBacks,
+                                          &kCFTypeDictionaryValueCallBacks);
+        if(theHistograms == nullptr)
+        {
+            continue;
+        }
+        
+        CFArrayRef theWaitLatencies = mTaskWaitLatencies[theTaskID].CopyBuckets();
+        CFArrayRef theTotalLatencies = mTaskTotalLatencies[theTaskID].CopyBuckets();
+        
+        CFDictionarySetValue(theHistograms, CFSTR(kRDCTaskLatenciesKey_Wait), theWaitLatencies);
+        CFDictionarySetValue(theHistograms, CFSTR(kRDCTaskLatenciesKey_Total), theTotalLatencies);
+        CFDictionarySetValue(theLatencies, GetTaskName(static_cast<RDC_TaskID>(theTaskID)), theHistograms);
+        
+        CFRelease(theWaitLatencies);
+        CFRelease(theTotalLatencies);
+        CFRelease(theHistograms);
+    }
+    
+    return theLatencies;
+}
+
+void    RDC_TaskQueue::ResetTaskLatencies()
+{
+    for(UInt32 theTaskID = 0; theTaskID < kRDCTaskIDCount; theTaskID++)
+    {
+        mTaskWaitLatencies[theTaskID].Reset();
+        mTaskTotalLatencies[theTaskID].Reset();
     }
 }
 
@@ -393,21 +670,17 @@ bool    RDC_TaskQueue::ProcessRealTimeThreadTask(RDC_Task* inTask)
 {
     AssertCurrentThreadIsRTWorkerThread("RDC_TaskQueue::ProcessRealTimeThreadTask");
     
+    // The realtime worker thread does work for the IO thread, so it has to be just as careful.
+    RDC_RTSafety::Scope theRTSafetyScope;
+    
     switch(inTask->GetTaskID())
     {
         case kRDCTaskStopWorkerThread:
             DebugMsg("RDC_TaskQueue::ProcessRealTimeThreadTask: Stopping");
+            
             // Return that the thread should stop itself
             return true;
             
-        case kRDCTaskSwapClientShadowMaps:
-            {
-                DebugMsg("RDC_TaskQueue::ProcessRealTimeThreadTask: Swapping the shadow maps in RDC_ClientMap");
-                RDC_ClientMap* theClientMap = reinterpret_cast<RDC_ClientMap*>(inTask->GetArg1());
-                RDC_ClientTasks::SwapInShadowMapsRT(theClientMap);
-            }
-            break;
-            
         default:
             Assert(false, "RDC_TaskQueue::ProcessRealTimeThreadTask: Unexpected task ID");
             break;
@@ -432,6 +705,7 @@ bool    RDC_TaskQueue::ProcessNonRealTimeThreadTask(RDC_Task* inTask)
             
         case kRDCTaskStartClientIO:
             DebugMsg("RDC_TaskQueue::ProcessNonRealTimeThreadTask: Processing kRDCTaskStartClientIO");
+            RDCSignpostBegin("StartClientIO", RDC_Signposts::MakeID(inTask->GetArg2()));
             try
             {
                 RDC_Clients* theClients = reinterpret_cast<RDC_Clients*>(inTask->GetArg1());
@@ -450,10 +724,12 @@ bool    RDC_TaskQueue::ProcessNonRealTimeThreadTask(RDC_Task* inTask)
                 DebugMsg("RDC_TaskQueue::ProcessNonRealTimeThreadTask: Ignoring RDC_InvalidClientException thrown by StartIONonRT. %s",
                          "It's possible the client was removed before this task was processed.");
             }
+            RDCSignpostEnd("StartClientIO", RDC_Signposts::MakeID(inTask->GetArg2()));
             break;
 
         case kRDCTaskStopClientIO:
             DebugMsg("RDC_TaskQueue::ProcessNonRealTimeThreadTask: Processing kRDCTaskStopClientIO");
+            RDCSignpostBegin("StopClientIO", RDC_Signposts::MakeID(inTask->GetArg2()));
             try
             {
                 RDC_Clients* theClients = reinterpret_cast<RDC_Clients*>(inTask->GetArg1());
@@ -465,17 +741,39 @@ bool    RDC_TaskQueue::ProcessNonRealTimeThreadTask(RDC_Task* inTask)
                 DebugMsg("RDC_TaskQueue::ProcessNonRealTimeThreadTask: Ignoring RDC_InvalidClientException thrown by StopIONonRT. %s",
                          "It's possible the client was removed before this task was processed.");
             }
+            RDCSignpostEnd("StopClientIO", RDC_Signposts::MakeID(inTask->GetArg2()));
             break;
             
         case kRDCTaskSendPropertyNotification:
             DebugMsg("RDC_TaskQueue::ProcessNonRealTimeThreadTask: Processing kRDCTaskSendPropertyNotification");
             {
-                AudioObjectPropertyAddress thePropertyAddress[] = {
-                    { static_cast<UInt32>(inTask->GetArg1()), kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster } };
-                RDC_PlugIn::Host_PropertiesChanged(static_cast<AudioObjectID>(inTask->GetArg2()), 1, thePropertyAddress);
+                AudioObjectPropertyAddress thePropertyAddress = {
+                    static_cast<AudioObjectPropertySelector>(inTask->GetArg1() & 0xFFFFFFFF),
+                    static_cast<AudioObjectPropertyScope>(inTask->GetArg1() >> 32),
+                    static_cast<AudioObjectPropertyElement>(inTask->GetArg2() >> 32)
+                };
+                AddPendingPropertyNotification(static_cast<AudioObjectID>(inTask->GetArg2() & 0xFFFFFFFF), thePropertyAddress);
+                
+                // With no window, don't wait for WorkerThreadProc to send it.
+                if(mPropertyNotificationWindowNs == 0)
+                {
+                    SendPendingPropertyNotifications();
+                }
             }
             break;
             
+        case kRDCTaskDrainRecorder:
+            RDCSignpostBegin("DrainRecorder", RDC_Signposts::MakeID(inTask->GetArg1()));
+            reinterpret_cast<RDC_Recorder*>(inTask->GetArg1())->DrainNonRT();
+            RDCSignpostEnd("DrainRecorder", RDC_Signposts::MakeID(inTask->GetArg1()));
+            break;
+            
+        case kRDCTaskDrainRetroBuffer:
+            RDCSignpostBegin("DrainRetroBuffer", RDC_Signposts::MakeID(inTask->GetArg1()));
+            reinterpret_cast<RDC_RetroBuffer*>(inTask->GetArg1())->DrainNonRT();
+            RDCSignpostEnd("DrainRetroBuffer", RDC_Signposts::MakeID(inTask->GetArg1()));
+            break;
+            
         default:
             Assert(false, "RDC_TaskQueue::ProcessNonRealTimeThreadTask: Unexpected task ID");
             break;
@@ -484,5 +782,76 @@ bool    RDC_TaskQueue::ProcessNonRealTimeThreadTask(RDC_Task* inTask)
     return false;
 }
 
+#pragma mark Property notifications
+
+void    RDC_TaskQueue::AddPendingPropertyNotification(AudioObjectID inObjectID, const AudioObjectPropertyAddress& inAddress)
+{
+    // If the same notification is already waiting to be sent, the host doesn't need another one.
+    for(UInt32 i = 0; i < mPendingPropertyNotificationCount; i++)
+    {
+        const RDC_PendingPropertyNotification& thePending = mPendingPropertyNotifications[i];
+        
+        if(thePending.mObjectID == inObjectID &&
+           thePending.mAddress.mSelector == inAddress.mSelector &&
+           thePending.mAddress.mScope == inAddress.mScope &&
+           thePending.mAddress.mElement == inAddress.mElement)
+        {
+            return;
+        }
+    }
+    
+    if(mPendingPropertyNotificationCount == kMaxPendingPropertyNotifications)
+    {
+        SendPendingPropertyNotifications();
+    }
+    
+    if(mPendingPropertyNotificationCount == 0)
+    {
+        mPendingPropertyNotificationsDeadline =
+            CAHostTimeBase::GetTheCurrentTime() + CAHostTimeBase::ConvertFromNanos(mPropertyNotificationWindowNs);
+    }
+    
+    mPendingPropertyNotifications[mPendingPropertyNotificationCount++] = { inObjectID, inAddress };
+}
+
+void    RDC_TaskQueue::SendPendingPropertyNotifications()
+{
+    // Each task queue has its own non-realtime thread, so its intervals can't overlap.
+    RDCSignpostBegin("SendPropertyNotifications", RDC_Signposts::MakeID(reinterpret_cast<uintptr_t>(this)));
+
+    // Send one PropertiesChanged call per object, with all of its notifications.
+    bool theSent[kMaxPendingPropertyNotifications] = {};
+    AudioObjectPropertyAddress theAddresses[kMaxPendingPropertyNotifications];
+    
+    for(UInt32 i = 0; i < mPendingPropertyNotificationCount; i++)
+    {
+        if(theSent[i])
+        {
+            continue;
+        }
+        
+        AudioObjectID theObjectID = mPendingPropertyNotifications[i].mObjectID;
+        UInt32 theAddressCount = 0;
+        
+        for(UInt32 j = i; j < mPendingPropertyNotificationCount; j++)
+        {
+            if(!theSent[j] && mPendingPropertyNotifications[j].mObjectID == theObjectID)
+            {
+                theAddresses[theAddressCount++] = mPendingPropertyNotifications[j].mAddress;
+                theSent[j] = true;
+            }
+        }
+        
+        DebugMsg("RDC_TaskQueue::SendPendingPropertyNotifications: Sending %u notification(s) for object %u",
+                 theAddressCount,
+                 theObjectID);
+        RDC_PlugIn::Host_PropertiesChanged(theObjectID, theAddressCount, theAddresses);
+    }
+    
+    mPendingPropertyNotificationCount = 0;
+
+    RDCSignpostEnd("SendPropertyNotifications", RDC_Signposts::MakeID(reinterpret_cast<uintptr_t>(this)));
+}
+
 #pragma clang assume_nonnull end
 
@@ -23,6 +23,10 @@
 #ifndef __RDCDriver__RDC_TaskQueue__
 #define __RDCDriver__RDC_TaskQueue__
 
+// Local Includes
+#include "RDC_MPSCQueue.h"
+#include "RDC_LatencyHistogram.h"
+
 // PublicUtility Includes
 #include "CAPThread.h"
 #pragma clang diagnostic push
@@ -31,7 +35,9 @@
 #pragma clang diagnostic pop
 
 // STL Includes
+#include <atomic>
 #include <functional>
+#include <memory>
 
 // System Includes
 #include <mach/semaphore.h>
@@ -40,7 +46,8 @@
 
 // Forward declarations
 class RDC_Clients;
-class RDC_ClientMap;
+class RDC_Recorder;
+class RDC_RetroBuffer;
 
 
 #pragma clang assume_nonnull begin
@@ -62,13 +69,15 @@ private:
         kRDCTaskUninitialized,
         kRDCTaskStopWorkerThread,
         
-        // Realtime thread only
-        kRDCTaskSwapClientShadowMaps,
-        
         // Non-realtime thread only
         kRDCTaskStartClientIO,
         kRDCTaskStopClientIO,
-        kRDCTaskSendPropertyNotification
+        kRDCTaskSendPropertyNotification,
+        kRDCTaskDrainRecorder,
+        kRDCTaskDrainRetroBuffer,
+        
+        // The number of task IDs, for arrays indexed by them
+        kRDCTaskIDCount
     };
     
     class RDC_Task
@@ -90,7 +99,11 @@ private:
         bool                            IsComplete() { return mIsComplete; }
         void                            MarkCompleted() { mIsComplete = true; }
         
-        // Used by TAtomicStack
+        // The host time the task was added to a worker thread's queue, for the latency histograms
+        UInt64                          GetEnqueueTime() { return mEnqueueTime; }
+        void                            SetEnqueueTime(UInt64 inEnqueueTime) { mEnqueueTime = inEnqueueTime; }
+        
+        // Used by TAtomicStack2, for the free list
         RDC_Task* __nullable &          next() { return mNext; }
         RDC_Task* __nullable            mNext;
         
@@ -101,10 +114,27 @@ private:
         UInt64                          mArg2;
         UInt64                          mReturnValue = INT64_MAX;
         bool                            mIsComplete = false;
+        UInt64                          mEnqueueTime = 0;
     };
     
+    // Big enough for every pre-allocated task, plus the sync tasks of any threads blocked in QueueSync. (The real-time
+    // thread only gets sync tasks.)
+    typedef RDC_MPSCQueue<RDC_Task*, 64>    RDC_RealTimeTaskFIFO;
+    typedef RDC_MPSCQueue<RDC_Task*, 1024>  RDC_NonRealTimeTaskFIFO;
+    
 public:
-                                        RDC_TaskQueue();
+    // The default number of tasks in the pool async tasks are taken from.
+    static const UInt32                 kDefaultNonRealTimeThreadTaskPoolSize = 512;
+    // Leaves room in mNonRealTimeThreadTasks for the sync tasks of threads blocked in QueueSync.
+    static const UInt32                 kMaxNonRealTimeThreadTaskPoolSize = RDC_NonRealTimeTaskFIFO::GetCapacity() - 64;
+    
+    /*!
+     @param inNonRealTimeThreadTaskPoolSize The number of async tasks that can be waiting at once. Queueing more than that
+                                            drops the new tasks, since they can't be allocated on real-time threads. At most
+                                            kMaxNonRealTimeThreadTaskPoolSize.
+     @throws CAException If the pool size is out of range or the worker threads couldn't be set up.
+     */
+                                        RDC_TaskQueue(UInt32 inNonRealTimeThreadTaskPoolSize = kDefaultNonRealTimeThreadTaskPoolSize);
                                         ~RDC_TaskQueue();
                                         // Disallow copying
                                         RDC_TaskQueue(const RDC_TaskQueue&) = delete;
@@ -114,26 +144,86 @@ private:
     static UInt32                       NanosToAbsoluteTime(UInt32 inNanos);
     
 public:
-    void                                QueueSync_SwapClientShadowMaps(RDC_ClientMap* inClientMap);
+    // Sends a property changed notification to the RDCDevice host. Notifications are coalesced: the non-realtime worker thread
+    // holds them for up to the coalescing window (see SetPropertyNotificationWindow), drops duplicates and then sends all the
+    // ones for each object in a single PropertiesChanged call.
+    void                                QueueAsync_SendPropertyNotification(AudioObjectPropertySelector inProperty,
+                                                                            AudioObjectID inObjectID,
+                                                                            AudioObjectPropertyScope inScope = kAudioObjectPropertyScopeGlobal,
+                                                                            AudioObjectPropertyElement inElement = kAudioObjectPropertyElementMaster);
+    
+    // Sets how long a queued property notification can wait to be merged with later ones. Zero sends each notification as soon
+    // as it's processed. Safe to call from any thread. Takes effect from the next notification that isn't merged.
+    void                                SetPropertyNotificationWindow(UInt64 inWindowNs) { mPropertyNotificationWindowNs = inWindowNs; }
     
-    // Sends a property changed notification to the RDCDevice host. Assumes the scope and element are kAudioObjectPropertyScopeGlobal and
-    // kAudioObjectPropertyElementMaster because currently those are the only ones we use.
-    void                                QueueAsync_SendPropertyNotification(AudioObjectPropertySelector inProperty, AudioObjectID inDeviceID);
+    /*!
+     Schedule the real-time worker thread for the IO cycle it's serving. The thread's time constraint policy is derived from
+     the cycle's period and updated the next time the thread wakes, so the scheduler gives it a core fast enough to finish
+     within the cycle. Real-time safe and cheap when nothing has changed, so it can be called every IO cycle.
+
+     @param inIOBufferFrameSize The IO buffer size, in frames.
+     @param inHostTicksPerFrame The host time per frame, i.e. the IO sample rate in host ticks, e.g. from
+                                AudioServerPlugInIOCycleInfo::mMasterHostTicksPerFrame.
+     */
+    void                                SetRealTimeThreadIOCycleRT(UInt32 inIOBufferFrameSize, Float64 inHostTicksPerFrame);
     
     // Set/unset a client's is-doing-IO flag
     
     inline bool                         QueueSync_StartClientIO(RDC_Clients* inClients, UInt32 inClientID) { return Queue_UpdateClientIOState(true, inClients, inClientID, true); }
     inline bool                         QueueSync_StopClientIO(RDC_Clients* inClients, UInt32 inClientID) { return Queue_UpdateClientIOState(true, inClients, inClientID, false); }
     
-    inline void                         QueueAsync_StartClientIO(RDC_Clients* inClients, UInt32 inClientID) { Queue_UpdateClientIOState(false, inClients, inClientID, true); }
-    inline void                         QueueAsync_StopClientIO(RDC_Clients* inClients, UInt32 inClientID) { Queue_UpdateClientIOState(false, inClients, inClientID, false); }
+    // The async versions return false if the task had to be dropped because the queue was full.
+    inline bool                         QueueAsync_StartClientIO(RDC_Clients* inClients, UInt32 inClientID) { return Queue_UpdateClientIOState(false, inClients, inClientID, true); }
+    inline bool                         QueueAsync_StopClientIO(RDC_Clients* inClients, UInt32 inClientID) { return Queue_UpdateClientIOState(false, inClients, inClientID, false); }
+    
+    // Write the frames waiting in the recorder's FIFO to its file. Real-time safe, so the IO thread can call it when
+    // RDC_Recorder::StoreRT asks for a drain.
+    void                                QueueAsync_DrainRecorder(RDC_Recorder* inRecorder);
+    // Move the frames waiting in the retroactive capture FIFO into its window. Real-time safe, like
+    // QueueAsync_DrainRecorder.
+    void                                QueueAsync_DrainRetroBuffer(RDC_RetroBuffer* inRetroBuffer);
     
 private:
     bool                                Queue_UpdateClientIOState(bool inSync, RDC_Clients* inClients, UInt32 inClientID, bool inDoingIO);
     
+    // Returns the task's return value, or kTaskDroppedReturnValue if it was for the realtime thread and its queue was full. The
+    // drop is counted in mDroppedTaskCount.
     UInt64                              QueueSync(RDC_TaskID inTaskID, bool inRunOnRealtimeThread, UInt64 inTaskArg1 = 0, UInt64 inTaskArg2 = 0);
+    static const UInt64                 kTaskDroppedReturnValue = UINT64_MAX;
+    
+    // Returns false if the task was dropped because the queue was full. The drop is counted in mDroppedTaskCount.
+    bool                                QueueOnNonRealtimeThread(RDC_Task inTask);
+    
+    // Adds a task to a worker thread's queue and signals the thread. If the queue is full and inMayWait is true, keeps waking
+    // the thread until it makes room. Otherwise, returns false without adding the task, which is real-time safe.
+    template <typename TFIFO>
+    bool                                PushTask(TFIFO& inTasks,
+                                                 RDC_Task* inTask,
+                                                 semaphore_t inWorkQueuedSemaphore,
+                                                 bool inMayWait,
+                                                 const char* inCallerName);
+    
+public:
+    /*! @return The most tasks that have been waiting for each worker thread at once. */
+    UInt64                              GetRealTimeThreadTasksHighWaterMark() const { return mRealTimeThreadTasks.GetHighWaterMark(); }
+    UInt64                              GetNonRealTimeThreadTasksHighWaterMark() const { return mNonRealTimeThreadTasks.GetHighWaterMark(); }
+    /*! @return Roughly how many tasks are waiting for each worker thread. */
+    UInt64                              GetRealTimeThreadTaskCount() const { return mRealTimeThreadTasks.GetSize(); }
+    UInt64                              GetNonRealTimeThreadTaskCount() const { return mNonRealTimeThreadTasks.GetSize(); }
+    
+    /*! @return The size of the async task pool, the number of its tasks in use, the most that have been in use at once and
+                the number of tasks dropped because it was empty or a worker thread's queue was full. */
+    UInt32                              GetTaskPoolSize() const { return mNonRealTimeThreadTaskPoolSize; }
+    UInt32                              GetTaskPoolTasksInUse() const { return mTaskPoolTasksInUse.load(std::memory_order_relaxed); }
+    UInt64                              GetTaskPoolHighWaterMark() const { return mTaskPoolHighWaterMark; }
+    UInt64                              GetDroppedTaskCount() const { return mDroppedTaskCount; }
     
-    void                                QueueOnNonRealtimeThread(RDC_Task inTask);
+    /*!
+     @return A new CFDictionary in the format of kAudioDeviceCustomPropertyTaskLatencies, with the latency histograms of each
+             type of task that has been queued. The caller is responsible for releasing it.
+     */
+    CFDictionaryRef                     CopyTaskLatencies() const;
+    void                                ResetTaskLatencies();
     
 public:
     void                                AssertCurrentThreadIsRTWorkerThread(const char* inCallerMethodName);
@@ -142,27 +232,49 @@ private:
     static void* __nullable             RealTimeThreadProc(void* inRefCon);
     static void* __nullable             NonRealTimeThreadProc(void* inRefCon);
     
-    void                                WorkerThreadProc(semaphore_t inWorkQueuedSemaphore, semaphore_t inSyncTaskCompletedSemaphore, TAtomicStack<RDC_Task>* inTasks, TAtomicStack2<RDC_Task>* __nullable inFreeList, std::function<bool(RDC_Task*)> inProcessTask);
+    void                                WorkerThreadProc(semaphore_t inWorkQueuedSemaphore, semaphore_t inSyncTaskCompletedSemaphore, std::function<RDC_Task* __nullable()> inPopTask, std::function<bool(RDC_Task*)> inProcessTask);
+    
+    // Take a task from the pool, or return null if it's empty. Real-time safe.
+    RDC_Task* __nullable                AcquirePooledTask();
+    // Return an async task to the pool after it's been processed.
+    void                                ReleasePooledTask(RDC_Task* inTask);
     
     // These return true when the thread should be stopped
     bool                                ProcessRealTimeThreadTask(RDC_Task* inTask);
     bool                                ProcessNonRealTimeThreadTask(RDC_Task* inTask);
     
+    // Called on the worker threads after each task. inStartTime and inEndTime are host times.
+    void                                RecordTaskLatencies(RDC_Task* inTask, UInt64 inStartTime, UInt64 inEndTime);
+    static CFStringRef                  GetTaskName(RDC_TaskID inTaskID);
+    
+    // Only called on the realtime worker thread.
+    void                                UpdateRealTimeThreadTimeConstraints();
+    
+    // Only called on the non-realtime worker thread.
+    void                                AddPendingPropertyNotification(AudioObjectID inObjectID, const AudioObjectPropertyAddress& inAddress);
+    void                                SendPendingPropertyNotifications();
+    
 private:
     // The worker threads that perform the queued tasks
     CAPThread                           mRealTimeThread;
     CAPThread                           mNonRealTimeThread;
     
-    // The approximate amount of time we'll need whenever our real-time thread is scheduled. This is currently just
-    // set to the minimum (see sched_prim.c) because our real-time tasks do very little work.
-    //
-    // TODO: Would it be better to specify these in absolute time, which would make them relative to the system's bus
-    //       speed? Or even calculate them from the system's CPU/RAM speed? Note that none of our tasks actually have
-    //       a deadline (though that might change). They just have to run with real-time priority to avoid causing
-    //       priority inversions on the IO thread.
+    // The approximate amount of time we'll need whenever our real-time thread is scheduled, until we know the IO period.
+    // This is just set to the minimum (see sched_prim.c) because our real-time tasks do very little work. They don't have a
+    // deadline of their own, they just have to run with real-time priority to avoid causing priority inversions on the IO
+    // thread, so the values are also used as lower bounds once the constraints are derived from the IO period.
     static const UInt32                 kRealTimeThreadNominalComputationNs = 50 * NSEC_PER_USEC;
     // The maximum amount of time the real-time thread can take to finish its computation after being scheduled.
     static const UInt32                 kRealTimeThreadMaximumComputationNs = 60 * NSEC_PER_USEC;
+    // Once the IO period is known, the real-time thread asks for this fraction of it as computation time and has to finish
+    // within half of it. Asking for a share of the cycle, like the IO thread does, is what tells the scheduler the thread
+    // needs a performance core.
+    static const UInt32                 kRealTimeThreadIOPeriodComputationDivisor = 8;
+    
+    // The IO period in host ticks, set by SetRealTimeThreadIOCycleRT. Zero until IO has started.
+    std::atomic<UInt64>                 mRealTimeThreadIOPeriod { 0 };
+    // The period the real-time thread's time constraints were last derived from. Only used by that thread.
+    UInt64                              mAppliedRealTimeThreadIOPeriod = 0;
     
     // We use Mach semaphores for communication with the worker threads because signalling them is real-time safe.
     
@@ -173,26 +285,49 @@ private:
     semaphore_t                         mRealTimeThreadSyncTaskCompletedSemaphore;
     semaphore_t                         mNonRealTimeThreadSyncTaskCompletedSemaphore;
     
-    // When a task is queued we add it to one of these, depending on which worker thread it will run on. Using
-    // TAtomicStack lets us safely add and remove tasks on real-time threads.
-    //
-    // We use TAtomicStack rather than TAtomicStack2 because we need pop_all_reversed() to make sure we process the
-    // tasks in order. (It might have been better to use OSAtomicFifoEnqueue/OSAtomicFifoDequeue, but I only
-    // recently found out about them.)
-    TAtomicStack<RDC_Task>              mRealTimeThreadTasks;
-    TAtomicStack<RDC_Task>              mNonRealTimeThreadTasks;
-    
-    // The number of tasks to pre-allocate and add to the non-realtime task free list. Should be large enough that
-    // the free list is never emptied. (At least not while IO could be running.)
-    static const UInt32                 kNonRealTimeThreadTaskBufferSize = 512;
-    // Realtime threads can't safely allocate memory, so when they queue a task the memory for it comes from this
-    // free list. We pre-allocate as many tasks as they should ever need in the constructor. (But if the free list
-    // runs out of tasks somehow the realtime thread will allocate a new one.)
+    // When a task is queued we add it to one of these, depending on which worker thread it will run on. They're lock-free
+    // FIFOs, so tasks can be safely added on real-time threads and the worker threads take them in the order they were
+    // added, one at a time.
+    RDC_RealTimeTaskFIFO                mRealTimeThreadTasks;
+    RDC_NonRealTimeTaskFIFO             mNonRealTimeThreadTasks;
+    
+    // Realtime threads can't safely allocate memory, so async tasks (which always run on the non-realtime thread) come
+    // from this pool, allocated in the constructor. If it's empty, or the worker thread's queue is full, the new task is
+    // dropped and counted in mDroppedTaskCount. The pool should be large enough that this never happens, at least while IO
+    // could be running. Sync tasks live on the stack of the thread waiting for them, so they don't need one.
     //
     // There's a similar free list used in Apple's CAThreadSafeList.h.
     //
     // We can use TAtomicStack2 instead of TAtomicStack because we never call pop_all on the free list.
+    const UInt32                        mNonRealTimeThreadTaskPoolSize;
+    std::unique_ptr<RDC_Task[]>         mNonRealTimeThreadTaskPool;
     TAtomicStack2<RDC_Task>             mNonRealTimeThreadTasksFreeList;
+    std::atomic<UInt32>                 mTaskPoolTasksInUse { 0 };
+    std::atomic<UInt64>                 mTaskPoolHighWaterMark { 0 };
+    std::atomic<UInt64>                 mDroppedTaskCount { 0 };
+    
+    // How long each type of task waited to be started and took to finish, counting from when it was queued. The worker
+    // threads record into these and any thread can read them.
+    RDC_LatencyHistogram                mTaskWaitLatencies[kRDCTaskIDCount];
+    RDC_LatencyHistogram                mTaskTotalLatencies[kRDCTaskIDCount];
+    
+    // Property notifications waiting to be sent, which only the non-realtime worker thread touches. When this fills up, the
+    // pending notifications are sent early.
+    struct RDC_PendingPropertyNotification
+    {
+        AudioObjectID                   mObjectID;
+        AudioObjectPropertyAddress      mAddress;
+    };
+    static const UInt32                 kMaxPendingPropertyNotifications = 32;
+    RDC_PendingPropertyNotification     mPendingPropertyNotifications[kMaxPendingPropertyNotifications];
+    UInt32                              mPendingPropertyNotificationCount = 0;
+    // The host time the pending notifications have to be sent by, i.e. the window after the first of them was queued.
+    UInt64                              mPendingPropertyNotificationsDeadline = 0;
+    
+    // Long enough to merge the notifications from a volume slider being dragged or automated, short enough that listeners
+    // don't visibly lag behind.
+    static const UInt64                 kDefaultPropertyNotificationWindowNs = 10 * NSEC_PER_MSEC;
+    std::atomic<UInt64>                 mPropertyNotificationWindowNs { kDefaultPropertyNotificationWindowNs };
     
 };
 
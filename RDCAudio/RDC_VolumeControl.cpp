@@ -26,6 +26,7 @@
 
 // Local Includes
 #include "RDC_PlugIn.h"
+#include "RDC_TaskQueue.h"
 
 // PublicUtility Includes
 #include "CAException.h"
@@ -35,6 +36,7 @@
 
 // STL Includes
 #include <algorithm>
+#include <cstring>
 
 // System Includes
 #include <CoreAudio/AudioHardwareBase.h>
@@ -63,7 +65,11 @@ RDC_VolumeControl::RDC_VolumeControl(AudioObjectID inObjectID,
     mMaxVolumeRaw(kDefaultMaxRawVolume),
     mMinVolumeDb(kDefaultMinDbVolume),
     mMaxVolumeDb(kDefaultMaxDbVolume),
-    mWillApplyVolumeToAudio(false)
+    mWillApplyVolumeToAudio(false),
+    mRampsVolumeChanges(true),
+    mRampSampleTime(-1.0),
+    mRampStartGain(0.0f),
+    mRampEndGain(0.0f)
 {
     // Setup the volume curve with the one range
     mVolumeCurve.AddRange(mMinVolumeRaw, mMaxVolumeRaw, mMinVolumeDb, mMaxVolumeDb);
@@ -362,6 +368,11 @@ void    RDC_VolumeControl::SetWillApplyVolumeToAudio(bool inWillApplyVolumeToAud
     mWillApplyVolumeToAudio = inWillApplyVolumeToAudio;
 }
 
+void    RDC_VolumeControl::SetRampsVolumeChanges(bool inRampsVolumeChanges)
+{
+    mRampsVolumeChanges = inRampsVolumeChanges;
+}
+
 #pragma mark IO Operations
 
 bool    RDC_VolumeControl::WillApplyVolumeToAudioRT() const
@@ -369,32 +380,123 @@ bool    RDC_VolumeControl::WillApplyVolumeToAudioRT() const
     return mWillApplyVolumeToAudio;
 }
 
-void    RDC_VolumeControl::ApplyVolumeToAudioRT(Float32* ioBuffer, UInt32 inBufferFrameSize) const
+void    RDC_VolumeControl::ApplyVolumeToAudioRT(Float32* ioBuffer,
+                                                UInt32 inBufferFrameSize,
+                                                UInt32 inChannelsPerFrame,
+                                                Float64 inSampleTime) const
+{
+    ApplyVolumeToAudioRT(ioBuffer, ioBuffer, inBufferFrameSize, inChannelsPerFrame, inSampleTime);
+}
+
+void    RDC_VolumeControl::ApplyVolumeToAudioRT(const Float32* inBuffer,
+                                                Float32* outBuffer,
+                                                UInt32 inBufferFrameSize,
+                                                UInt32 inChannelsPerFrame,
+                                                Float64 inSampleTime) const
+{
+    Float32 theStartGain;
+    Float32 theGainStep;
+    GetGainRampRT(inBufferFrameSize, inSampleTime, theStartGain, theGainStep);
+
+    ApplyGainRT(inBuffer,
+                outBuffer,
+                inBufferFrameSize,
+                inChannelsPerFrame,
+                theStartGain,
+                theGainStep);
+}
+
+void    RDC_VolumeControl::GetGainRampRT(UInt32 inBufferFrameSize,
+                                         Float64 inSampleTime,
+                                         Float32& outStartGain,
+                                         Float32& outGainStep) const
 {
     ThrowIf(!mWillApplyVolumeToAudio,
             CAException(kAudioHardwareIllegalOperationError),
-            "RDC_VolumeControl::ApplyVolumeToAudioRT: This control doesn't process audio data");
+            "RDC_VolumeControl::GetGainRampRT: This control doesn't process audio data");
+
+    // Start a new ramp for each buffer, from where the last one ended to the current volume. If
+    // this is another client's output for the same buffer, use the same ramp again.
+    if(inSampleTime != mRampSampleTime)
+    {
+        mRampSampleTime = inSampleTime;
+        Float32 theTargetGain = mAmplitudeGain.load(std::memory_order_relaxed);
+        mRampStartGain = mRampsVolumeChanges ? mRampEndGain : theTargetGain;
+        mRampEndGain = theTargetGain;
+    }
 
+    outStartGain = mRampStartGain;
+    outGainStep = (inBufferFrameSize > 0) ?
+            (mRampEndGain - mRampStartGain) / inBufferFrameSize :
+            0.0f;
+}
+
+// static
+void    RDC_VolumeControl::ApplyGainRT(const Float32* inBuffer,
+                                       Float32* outBuffer,
+                                       UInt32 inBufferFrameSize,
+                                       UInt32 inChannelsPerFrame,
+                                       Float32 inStartGain,
+                                       Float32 inGainStep)
+{
+    if(inGainStep != 0.0f)
+    {
+        // Ramp the gain linearly across the frames of the buffer. vDSP_vrampmul updates theGain as
+        // it goes, so each channel needs its own copy. The ramp is per frame, so each channel is
+        // processed with a stride of the number of channels, which still only touches each sample
+        // once. Stereo, the common case, can do both channels in a single call.
+        if(inChannelsPerFrame == 2)
+        {
+            Float32 theGain = inStartGain;
+            vDSP_vrampmul2(inBuffer,
+                           inBuffer + 1,
+                           2,
+                           &theGain,
+                           &inGainStep,
+                           outBuffer,
+                           outBuffer + 1,
+                           2,
+                           inBufferFrameSize);
+        }
+        else
+        {
+            for(UInt32 theChannel = 0; theChannel < inChannelsPerFrame; theChannel++)
+            {
+                Float32 theGain = inStartGain;
+                vDSP_vrampmul(inBuffer + theChannel,
+                              inChannelsPerFrame,
+                              &theGain,
+                              &inGainStep,
+                              outBuffer + theChannel,
+                              inChannelsPerFrame,
+                              inBufferFrameSize);
+            }
+        }
+    }
     // Don't bother if the change is very unlikely to be perceptible.
-    if((mAmplitudeGain < 0.99f) || (mAmplitudeGain > 1.01f))
+    else if((inStartGain < 0.99f) || (inStartGain > 1.01f))
     {
         // Apply the amount of gain/loss for the current volume to the audio signal by multiplying
         // each sample. This call to vDSP_vsmul is equivalent to
         //
-        // for(UInt32 i = 0; i < inBufferFrameSize * 2; i++)
+        // for(UInt32 i = 0; i < inBufferFrameSize * inChannelsPerFrame; i++)
         // {
-        //     ioBuffer[i] *= mAmplitudeGain;
+        //     outBuffer[i] = inBuffer[i] * inStartGain;
         // }
         //
         // but a bit faster on processors with newer SIMD instructions. However, it shouldn't take
         // more than a few microseconds either way. (Unless some of the samples were subnormal
         // numbers for some reason.)
         //
-        // It would be a tiny bit faster still to not do this in-place, i.e. use separate input and
-        // output buffers, but then we'd have to copy the data into the output buffer when the
-        // volume is at 1.0. With our current use of this class, most people will leave the volume
-        // at 1.0, so it wouldn't be worth it.
-        vDSP_vsmul(ioBuffer, 1, &mAmplitudeGain, ioBuffer, 1, inBufferFrameSize * 2);
+        // The samples are interleaved, so the number of channels doesn't matter here beyond the
+        // total number of samples to process.
+        vDSP_vsmul(inBuffer, 1, &inStartGain, outBuffer, 1, inBufferFrameSize * inChannelsPerFrame);
+    }
+    else if(inBuffer != outBuffer)
+    {
+        // Most people leave the volume at 1.0, so this is the usual case when the caller is
+        // copying the audio anyway.
+        memcpy(outBuffer, inBuffer, inBufferFrameSize * inChannelsPerFrame * sizeof(Float32));
     }
 }
 
@@ -443,18 +545,31 @@ void    RDC_VolumeControl::SetVolumeRaw(SInt32 inNewVolumeRaw)
         SInt32 theSliderPositionInRawSteps = static_cast<SInt32>(theSliderPosition * theRawRange);
         theSliderPositionInRawSteps += mMinVolumeRaw;
 
-        mAmplitudeGain = mVolumeCurve.ConvertRawToScalar(theSliderPositionInRawSteps);
+        Float32 theAmplitudeGain = mVolumeCurve.ConvertRawToScalar(theSliderPositionInRawSteps);
 
-        RDCAssert((mAmplitudeGain >= 0.0f) && (mAmplitudeGain <= 1.0f), "Gain not in [0,1]");
+        RDCAssert((theAmplitudeGain >= 0.0f) && (theAmplitudeGain <= 1.0f), "Gain not in [0,1]");
 
-        // Send notifications.
-        CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
-            AudioObjectPropertyAddress theChangedProperties[2];
-            theChangedProperties[0] = { kAudioLevelControlPropertyScalarValue, mScope, mElement };
-            theChangedProperties[1] = { kAudioLevelControlPropertyDecibelValue, mScope, mElement };
+        // The IO thread picks this up at the start of its next buffer.
+        mAmplitudeGain.store(theAmplitudeGain, std::memory_order_relaxed);
 
-            RDC_PlugIn::Host_PropertiesChanged(GetObjectID(), 2, theChangedProperties);
-        });
+        // Send notifications.
+        if(mNotificationTaskQueue != nullptr)
+        {
+            mNotificationTaskQueue->QueueAsync_SendPropertyNotification(
+                    kAudioLevelControlPropertyScalarValue, GetObjectID(), mScope, mElement);
+            mNotificationTaskQueue->QueueAsync_SendPropertyNotification(
+                    kAudioLevelControlPropertyDecibelValue, GetObjectID(), mScope, mElement);
+        }
+        else
+        {
+            CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{
+                AudioObjectPropertyAddress theChangedProperties[2];
+                theChangedProperties[0] = { kAudioLevelControlPropertyScalarValue, mScope, mElement };
+                theChangedProperties[1] = { kAudioLevelControlPropertyDecibelValue, mScope, mElement };
+
+                RDC_PlugIn::Host_PropertiesChanged(GetObjectID(), 2, theChangedProperties);
+            });
+        }
     }
 }
 
@@ -30,6 +30,13 @@
 #include "CAVolumeCurve.h"
 #include "CAMutex.h"
 
+// STL Includes
+#include <atomic>
+
+
+// Forward declarations
+class RDC_TaskQueue;
+
 
 #pragma clang assume_nonnull begin
 
@@ -114,6 +121,20 @@ public:
      */
     void                SetWillApplyVolumeToAudio(bool inWillApplyVolumeToAudio);
 
+    /*!
+     Set whether ApplyVolumeToAudioRT ramps the gain from the previous volume to the new one over a
+     buffer when the volume changes, rather than stepping straight to it, which can be heard as a
+     click or "zipper noise". True initially.
+     */
+    void                SetRampsVolumeChanges(bool inRampsVolumeChanges);
+
+    /*!
+     Send this control's property notifications through a task queue, which coalesces them, rather
+     than dispatching one for every change. Dragging or automating the volume changes it many times
+     a second. Null (the default) dispatches them directly.
+     */
+    void                SetNotificationTaskQueue(RDC_TaskQueue* __nullable inTaskQueue) { mNotificationTaskQueue = inTaskQueue; }
+
 #pragma mark IO Operations
 
     /*!
@@ -125,14 +146,60 @@ public:
      Apply this volume control's volume to the samples in ioBuffer. That is, increase/decrease the
      volumes of the samples by the current volume of this control.
 
+     If the volume has changed since the last buffer and ramping is enabled (see
+     SetRampsVolumeChanges), the gain is ramped linearly across the buffer from the old volume to
+     the new one. Calls with the same sample time, e.g. one for each client's output in an IO
+     cycle, all get the same ramp. This should only be called from one thread at a time.
+
      @param ioBuffer The audio sample buffer to process.
-     @param inBufferFrameSize The number of sample frames in ioBuffer. The audio is assumed to be in
-                              stereo, i.e. two samples per frame. (Though, hopefully we'll support
-                              more at some point.)
+     @param inBufferFrameSize The number of sample frames in ioBuffer.
+     @param inChannelsPerFrame The number of interleaved samples in each frame.
+     @param inSampleTime The sample time of the first frame in ioBuffer.
      @throws CAException If SetWillApplyVolumeToAudio hasn't been used to set this control to apply
                          its volume to audio data.
      */
-    void                ApplyVolumeToAudioRT(Float32* ioBuffer, UInt32 inBufferFrameSize) const;
+    void                ApplyVolumeToAudioRT(Float32* ioBuffer,
+                                             UInt32 inBufferFrameSize,
+                                             UInt32 inChannelsPerFrame,
+                                             Float64 inSampleTime) const;
+    /*!
+     Like ApplyVolumeToAudioRT, but reads the samples from inBuffer and writes them to outBuffer, so
+     a caller that has to copy the audio anyway can apply the volume in the same pass. inBuffer and
+     outBuffer can be the same buffer.
+     */
+    void                ApplyVolumeToAudioRT(const Float32* inBuffer,
+                                             Float32* outBuffer,
+                                             UInt32 inBufferFrameSize,
+                                             UInt32 inChannelsPerFrame,
+                                             Float64 inSampleTime) const;
+    /*!
+     Get the gain ramp ApplyVolumeToAudioRT would apply to a buffer, for callers that apply it
+     themselves with ApplyGainRT, e.g. while storing the audio somewhere. Shares its ramp state with
+     ApplyVolumeToAudioRT.
+
+     @param inBufferFrameSize The number of sample frames in the buffer.
+     @param inSampleTime The sample time of the first frame in the buffer.
+     @param outStartGain The gain to apply to the first frame.
+     @param outGainStep The amount the gain changes by for each frame after the first. 0.0 if the
+                        volume isn't changing.
+     @throws CAException If SetWillApplyVolumeToAudio hasn't been used to set this control to apply
+                         its volume to audio data.
+     */
+    void                GetGainRampRT(UInt32 inBufferFrameSize,
+                                      Float64 inSampleTime,
+                                      Float32& outStartGain,
+                                      Float32& outGainStep) const;
+    /*!
+     Multiply interleaved samples by a gain that starts at inStartGain and changes by inGainStep each
+     frame, in one pass. Gains very close to 1.0 are skipped (or just copied). inBuffer and outBuffer
+     can be the same buffer.
+     */
+    static void         ApplyGainRT(const Float32* inBuffer,
+                                    Float32* outBuffer,
+                                    UInt32 inBufferFrameSize,
+                                    UInt32 inChannelsPerFrame,
+                                    Float32 inStartGain,
+                                    Float32 inGainStep);
 
 #pragma mark Implementation
 
@@ -145,7 +212,7 @@ private:
     const Float32       kDefaultMinDbVolume  = -96.0f;
     const Float32       kDefaultMaxDbVolume  = 0.0f;
 
-    CAMutex             mMutex;
+    CAUnfairMutex       mMutex;
 
     SInt32              mVolumeRaw;
     SInt32              mMinVolumeRaw;
@@ -155,10 +222,19 @@ private:
 
     CAVolumeCurve       mVolumeCurve;
     // The gain (or loss) to apply to an audio signal to increase/decrease its volume by the current
-    // volume of this control.
-    Float32             mAmplitudeGain;
+    // volume of this control. Written under mMutex, but read by the IO thread without it.
+    std::atomic<Float32> mAmplitudeGain;
 
     bool                mWillApplyVolumeToAudio;
+    std::atomic<bool>   mRampsVolumeChanges;
+
+    // The gain ramp for the current buffer. Only used by ApplyVolumeToAudioRT, so they don't need
+    // to be atomic.
+    mutable Float64     mRampSampleTime;
+    mutable Float32     mRampStartGain;
+    mutable Float32     mRampEndGain;
+
+    RDC_TaskQueue* __nullable mNotificationTaskQueue = nullptr;
 
 };
 
@@ -23,6 +23,13 @@
 // Self Include
 #include "RDC_WrappedAudioEngine.h"
 
+// PublicUtility Includes
+#include "CADebugMacros.h"
+#include "CAHostTimeBase.h"
+
+// STL Includes
+#include <cmath>
+
 
 // TODO: Register to be notified when the IO Registry values for these change so we can cache them
 
@@ -43,3 +50,189 @@ UInt32 RDC_WrappedAudioEngine::GetSampleBufferFrameSize() const
     return 0;
 }
 
+#pragma mark Clock Source
+
+#pragma clang assume_nonnull begin
+
+void    RDC_WrappedAudioEngine::SetClockDeviceUID(CFStringRef inDeviceUID)
+{
+    CAMutex::Locker theLocker(mClockMutex);
+
+    bool isFollowing = CFStringGetLength(inDeviceUID) > 0;
+
+    if(isFollowing == mClockDeviceUID.IsValid() && (!isFollowing || mClockDeviceUID.IsEqualTo(inDeviceUID)))
+    {
+        return;
+    }
+
+    DebugMsg("RDC_WrappedAudioEngine::SetClockDeviceUID: %s",
+             isFollowing ? "Following a new device's clock" : "No longer following a device's clock");
+
+    if(isFollowing)
+    {
+        mClockDeviceUID = inDeviceUID;
+    }
+    else
+    {
+        mClockDeviceUID = CACFString();
+    }
+
+    // The latency was the old device's as well.
+    mClockLatency.store(0, std::memory_order_relaxed);
+
+    // Invalidate the anchor, since it came from the old device. The new device's first zero
+    // timestamp will start a new epoch.
+    InvalidateClockAnchor();
+}
+
+void    RDC_WrappedAudioEngine::ResetClockAnchor()
+{
+    CAMutex::Locker theLocker(mClockMutex);
+    InvalidateClockAnchor();
+}
+
+void    RDC_WrappedAudioEngine::InvalidateClockAnchor()
+{
+    UInt64 theSequence = mClockSequence.load(std::memory_order_relaxed);
+    mClockSequence.store(theSequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    mClockIsValid.store(false, std::memory_order_relaxed);
+    mClockSequence.store(theSequence + 2, std::memory_order_release);
+}
+
+bool    RDC_WrappedAudioEngine::SetClockLatency(UInt32 inLatencyFrames)
+{
+    CAMutex::Locker theLocker(mClockMutex);
+
+    if(!mClockDeviceUID.IsValid())
+    {
+        return false;
+    }
+
+    return mClockLatency.exchange(inLatencyFrames, std::memory_order_relaxed) != inLatencyFrames;
+}
+
+CFStringRef RDC_WrappedAudioEngine::CopyClockDeviceUID() const
+{
+    CAMutex::Locker theLocker(mClockMutex);
+
+    if(mClockDeviceUID.IsValid())
+    {
+        return mClockDeviceUID.CopyCFString();
+    }
+
+    return CFSTR("");
+}
+
+void    RDC_WrappedAudioEngine::AddClockZeroTimeStamp(Float64 inSampleTime,
+                                                      UInt64 inHostTime,
+                                                      Float64 inSampleRate)
+{
+    CAMutex::Locker theLocker(mClockMutex);
+
+    if(!mClockDeviceUID.IsValid())
+    {
+        return;
+    }
+
+    bool wasValid = mClockIsValid.load(std::memory_order_relaxed);
+    Float64 thePreviousSampleTime = mClockSampleTime.load(std::memory_order_relaxed);
+    UInt64 thePreviousHostTime = mClockHostTime.load(std::memory_order_relaxed);
+
+    // The same zero timestamp is usually passed in more than once.
+    if(wasValid && inSampleTime == thePreviousSampleTime && inHostTime == thePreviousHostTime)
+    {
+        return;
+    }
+
+    Float64 theNominalHostTicksPerFrame = CAHostTimeBase::GetFrequency() / inSampleRate;
+    Float64 theHostTicksPerFrame = theNominalHostTicksPerFrame;
+    UInt64 theEpoch = mClockEpoch.load(std::memory_order_relaxed);
+    bool isContinuous = false;
+
+    if(wasValid &&
+       inSampleRate == mClockSampleRate.load(std::memory_order_relaxed) &&
+       inSampleTime > thePreviousSampleTime &&
+       inHostTime > thePreviousHostTime)
+    {
+        Float64 theMeasuredHostTicksPerFrame =
+                static_cast<Float64>(inHostTime - thePreviousHostTime) /
+                (inSampleTime - thePreviousSampleTime);
+
+        // Real clocks are within a few hundred ppm of their nominal rates, so a rate further out than
+        // this means the device's timeline jumped, e.g. because it restarted IO.
+        if(std::fabs(theMeasuredHostTicksPerFrame / theNominalHostTicksPerFrame - 1.0) < kMaxClockRateDeviation)
+        {
+            // Smooth the measurement, since the zero timestamps the HAL gives us are slightly jittery.
+            Float64 thePreviousHostTicksPerFrame = mClockHostTicksPerFrame.load(std::memory_order_relaxed);
+            theHostTicksPerFrame = thePreviousHostTicksPerFrame +
+                    (theMeasuredHostTicksPerFrame - thePreviousHostTicksPerFrame) * kClockRateSmoothing;
+            isContinuous = true;
+        }
+    }
+
+    if(!isContinuous)
+    {
+        theEpoch++;
+    }
+
+    // Make the counter odd so the IO thread knows the anchor is changing.
+    UInt64 theSequence = mClockSequence.load(std::memory_order_relaxed);
+    mClockSequence.store(theSequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    mClockSampleTime.store(inSampleTime, std::memory_order_relaxed);
+    mClockHostTime.store(inHostTime, std::memory_order_relaxed);
+    mClockSampleRate.store(inSampleRate, std::memory_order_relaxed);
+    mClockHostTicksPerFrame.store(theHostTicksPerFrame, std::memory_order_relaxed);
+    mClockEpoch.store(theEpoch, std::memory_order_relaxed);
+    mClockIsValid.store(true, std::memory_order_relaxed);
+
+    mClockSequence.store(theSequence + 2, std::memory_order_release);
+}
+
+bool    RDC_WrappedAudioEngine::GetClockAnchorRT(ClockAnchor& outAnchor) const
+{
+    for(UInt32 theAttempt = 0; theAttempt < kMaxClockReadAttempts; theAttempt++)
+    {
+        UInt64 theSequence = mClockSequence.load(std::memory_order_acquire);
+
+        if((theSequence & 1) != 0)
+        {
+            // The anchor is being written.
+            continue;
+        }
+
+        bool isValid = mClockIsValid.load(std::memory_order_relaxed);
+        outAnchor.mSampleTime = mClockSampleTime.load(std::memory_order_relaxed);
+        outAnchor.mHostTime = mClockHostTime.load(std::memory_order_relaxed);
+        outAnchor.mSampleRate = mClockSampleRate.load(std::memory_order_relaxed);
+        outAnchor.mHostTicksPerFrame = mClockHostTicksPerFrame.load(std::memory_order_relaxed);
+        outAnchor.mEpoch = mClockEpoch.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if(mClockSequence.load(std::memory_order_relaxed) == theSequence)
+        {
+            return isValid;
+        }
+    }
+
+    // The writer kept changing it. The caller falls back to the host clock until the next call.
+    return false;
+}
+
+Float64 RDC_WrappedAudioEngine::GetClockActualSampleRate() const
+{
+    CAMutex::Locker theLocker(mClockMutex);
+
+    if(!mClockIsValid.load(std::memory_order_relaxed))
+    {
+        return 0.0;
+    }
+
+    return CAHostTimeBase::GetFrequency() / mClockHostTicksPerFrame.load(std::memory_order_relaxed);
+}
+
+#pragma clang assume_nonnull end
+
@@ -26,14 +26,29 @@
 //  a very experimental version that mostly works but the code needs a lot of clean up so I haven't
 //  added it to this project yet.
 //
+//  For now, it can follow the clock of the output device audio is actually played on, so RDCDevice's
+//  zero timestamps can track that device instead of free running against the host clock. The driver
+//  can't use the HAL's client API, so whichever process does IO on the real device (usually RDCApp)
+//  passes that device's zero timestamps in. See kAudioDeviceCustomPropertyClockSource.
+//
 
 #ifndef __RDCDriver__RDC_WrappedAudioEngine__
 #define __RDCDriver__RDC_WrappedAudioEngine__
 
+// PublicUtility Includes
+#include "CACFString.h"
+#include "CAMutex.h"
+
+// STL Includes
+#include <atomic>
+
+// System Includes
 #include <CoreAudio/CoreAudioTypes.h>
 #include <mach/kern_return.h>
 
 
+#pragma clang assume_nonnull begin
+
 class RDC_WrappedAudioEngine
 {
     
@@ -41,8 +56,95 @@ public:
     UInt64          GetSampleRate() const;
     kern_return_t   SetSampleRate(Float64 inNewSampleRate);
     UInt32          GetSampleBufferFrameSize() const;
+
+#pragma mark Clock Source
+
+    // A zero timestamp of the followed device, i.e. a point on its clock, and the rate its clock is
+    // measured to run at.
+    struct ClockAnchor
+    {
+        Float64     mSampleTime;
+        UInt64      mHostTime;
+        // The followed device's nominal sample rate.
+        Float64     mSampleRate;
+        // Measured from the zero timestamps. Starts at the nominal rate.
+        Float64     mHostTicksPerFrame;
+        // Incremented whenever the followed device's clock is discontinuous, e.g. it restarted IO or
+        // a different device is being followed, so the anchor can't be compared with older ones.
+        UInt64      mEpoch;
+    };
+
+    /*!
+     Set the UID of the device whose clock to follow. Its zero timestamps have to be passed to
+     AddClockZeroTimeStamp as they change. The empty string stops following a device.
+     */
+    void            SetClockDeviceUID(CFStringRef inDeviceUID);
+    /*! @return The UID of the followed device, or the empty string. The caller must release it. */
+    CFStringRef     CopyClockDeviceUID() const;
+
+    /*!
+     Record a zero timestamp of the followed device and update the measured rate of its clock.
+     Ignored if no device is being followed.
+     */
+    void            AddClockZeroTimeStamp(Float64 inSampleTime, UInt64 inHostTime, Float64 inSampleRate);
+
+    /*!
+     Get the most recent zero timestamp of the followed device. Real-time safe. Never blocks, but
+     may spin briefly if AddClockZeroTimeStamp is storing a new one.
+
+     @return False if no device is being followed or it hasn't been given a zero timestamp yet.
+     */
+    bool            GetClockAnchorRT(ClockAnchor& outAnchor) const;
+
+    /*!
+     Forget the followed device's last zero timestamp, e.g. because RDCDevice stopped taking them
+     while it was idle and the anchor is out of date. The next one starts a new epoch.
+     */
+    void            ResetClockAnchor();
+
+    /*! @return The measured sample rate of the followed device's clock, or 0 if there isn't one. */
+    Float64         GetClockActualSampleRate() const;
+
+    /*!
+     Set the number of frames between a sample being written to RDCDevice and it being heard on the
+     followed device. Ignored if no device is being followed. Reset to 0 when it changes.
+
+     @return True if the latency changed.
+     */
+    bool            SetClockLatency(UInt32 inLatencyFrames);
+    /*! @return The followed device's latency, or 0 if no device is being followed. */
+    UInt32          GetClockLatency() const { return mClockLatency.load(std::memory_order_relaxed); }
+
+private:
+    // Mark the anchor invalid so GetClockAnchorRT returns false. mClockMutex must be held.
+    void            InvalidateClockAnchor();
+
+    // Zero timestamps that imply a rate this far from nominal, as a fraction, start a new epoch.
+    static constexpr Float64 kMaxClockRateDeviation = 0.01;
+    // How much of the difference between the measured and the current rate is applied each time.
+    static constexpr Float64 kClockRateSmoothing = 0.25;
+    static const UInt32     kMaxClockReadAttempts = 64;
+
+    // Guards mClockDeviceUID and serialises the writers of the anchor.
+    CAMutex                 mClockMutex { "Wrapped Engine Clock" };
+    // Invalid if no device is being followed.
+    CACFString              mClockDeviceUID;
+
+    // The anchor, published with a sequence counter that's odd while it's being written, so the
+    // IO thread can read it without locking.
+    std::atomic<UInt64>     mClockSequence { 0 };
+    std::atomic<bool>       mClockIsValid { false };
+    std::atomic<Float64>    mClockSampleTime { 0.0 };
+    std::atomic<UInt64>     mClockHostTime { 0 };
+    std::atomic<Float64>    mClockSampleRate { 0.0 };
+    std::atomic<Float64>    mClockHostTicksPerFrame { 0.0 };
+    std::atomic<UInt64>     mClockEpoch { 0 };
+
+    std::atomic<UInt32>     mClockLatency { 0 };
     
 };
 
+#pragma clang assume_nonnull end
+
 #endif /* __RDCDriver__RDC_WrappedAudioEngine__ */
 
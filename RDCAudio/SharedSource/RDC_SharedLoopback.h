@@ -0,0 +1,162 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  RDC_SharedLoopback.h
+//  SharedSource
+//
+//  The layout of the shared memory region RDCDevice exports its loopback audio through when
+//  kAudioDeviceCustomPropertySharedLoopbackName is set. Consumers map the region read-only (see
+//  shm_open(2) and mmap(2)) and read the audio directly, without opening the device through the
+//  HAL. The region is created with mode 0600, owned by coreaudiod's user, so other users' processes
+//  can only open it if kAudioDeviceCustomPropertySharedLoopbackWorldReadable is set.
+//
+//  The region is a RDC_SharedLoopbackHeader followed, at mDataOffset, by a ring of mCapacityFrames
+//  interleaved frames of mBytesPerFrame bytes each. Frame number t is stored at byte
+//  mDataOffset + (t & (mCapacityFrames - 1)) * mBytesPerFrame. Frames are native-endian Float32.
+//
+//  There's a single writer, RDCDevice's IO thread, and any number of readers. Neither side takes a
+//  lock. The valid frames are [mStartTime, mEndTime), published with a sequence counter:
+//
+//  The writer, for each buffer of N frames it stores at sample time T:
+//      1. If T isn't mEndTime, it either zero-fills the gap between them or, if T is before
+//         mEndTime or too far after it, restarts the ring at T.
+//      2. Increments mSequence (making it odd), moves mStartTime forward so the frames it's about
+//         to overwrite are no longer in [mStartTime, mEndTime), and increments mSequence again
+//         (making it even) with release ordering.
+//      3. Copies the frames into the ring.
+//      4. Publishes mEndTime = T + N in the same way as step 2.
+//
+//  A reader that wants the frames [t, t + n):
+//      1. Loads mSequence with acquire ordering. If it's odd, the writer is updating the bounds, so
+//         it tries again.
+//      2. Loads mStartTime and mEndTime, then loads mSequence again. If it changed, it goes back
+//         to step 1.
+//      3. Clips [t, t + n) to [mStartTime, mEndTime). Frames outside it aren't available (too old
+//         or not written yet).
+//      4. Reads the frames in place or copies them out.
+//      5. Reads the bounds again as in steps 1 and 2. Any frames now before mStartTime were
+//         overwritten while the reader was using them and must be discarded. Frames after that
+//         are valid.
+//
+//  The header also has a table of timestamps, mTimeStamps, for the blocks of the mix the writer
+//  stored most recently. Each entry maps the sample time of the first frame of a block to the host
+//  time the HAL gave for it, so a reader can find the host time of any frame in the ring by looking
+//  up the nearest entry instead of estimating it. The entries have their own lock-free protocol,
+//  described in RDC_LoopbackTimeStampTable below. Sample times start again when IO restarts, which
+//  empties the table.
+//
+//  A reader should check mMagic and mVersion before anything else and check mState each time it
+//  reads the bounds. The writer sets mState to kRDCSharedLoopbackState_Closed before it unmaps the
+//  region, i.e. when the device's channel count or buffer size changes or the export is turned
+//  off. The region is unlinked at the same time, so readers should unmap it and call shm_open
+//  again, which will find the new region if there is one.
+//
+
+#ifndef SharedSource__RDC_SharedLoopback
+#define SharedSource__RDC_SharedLoopback
+
+// STL Includes
+#include <atomic>
+
+// System Includes
+#include <MacTypes.h>
+
+
+#pragma clang assume_nonnull begin
+
+// "RDCL"
+static const UInt32 kRDCSharedLoopbackMagic          = 0x5244434C;
+// Incremented when the layout of RDC_SharedLoopbackHeader or the read protocol changes.
+static const UInt32 kRDCSharedLoopbackVersion        = 2;
+
+// The longest name shm_open accepts on macOS (PSHMNAMLEN), including the leading slash.
+static const UInt32 kRDCSharedLoopbackMaxNameLength  = 31;
+
+enum : UInt32
+{
+    // The writer is storing frames into the region.
+    kRDCSharedLoopbackState_Live    = 1,
+    // The writer has stopped using the region and unlinked it. Readers should remap.
+    kRDCSharedLoopbackState_Closed  = 2
+};
+
+// The atomics are read from other processes, so they have to be address-free.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "The shared loopback header needs lock-free atomics");
+
+// The number of entries in a RDC_LoopbackTimeStampTable. About three seconds of 512-frame blocks at
+// 48 kHz. A power of two.
+static const UInt32 kRDCLoopbackTimeStampCount       = 256;
+
+struct RDC_LoopbackTimeStampSlot
+{
+    // Twice the position of the entry in the slot plus two, or plus one while it's being written.
+    // Zero if the slot is empty.
+    std::atomic<UInt64>     mSequence;
+    // The sample time of the first frame of the block.
+    std::atomic<SInt64>     mSampleTime;
+    // The host time the HAL gave for that frame, in mach_absolute_time units.
+    std::atomic<UInt64>     mHostTime;
+};
+
+// The timestamps of the last kRDCLoopbackTimeStampCount blocks the writer stored. Entry number p is
+// in mSlots[p & (kRDCLoopbackTimeStampCount - 1)]. To read the entries:
+//     1. Load mNextPosition with acquire ordering. The newest entry is the one before it.
+//     2. For each position p from mNextPosition - kRDCLoopbackTimeStampCount (or zero) up to the
+//        newest, load the slot's mSequence with acquire ordering, then its mSampleTime and
+//        mHostTime, then, after an acquire fence, its mSequence again.
+//     3. Use the entry only if both loads of mSequence returned 2p + 2. Otherwise the slot was
+//        empty, still being written or overwritten with a newer entry.
+// The valid entries are in order of sample time.
+struct RDC_LoopbackTimeStampTable
+{
+    std::atomic<UInt64>         mNextPosition;
+    RDC_LoopbackTimeStampSlot   mSlots[kRDCLoopbackTimeStampCount];
+};
+
+struct RDC_SharedLoopbackHeader
+{
+    // These are set when the region is created and don't change after that.
+    UInt32                  mMagic;
+    UInt32                  mVersion;
+    // The size of the whole region in bytes.
+    UInt64                  mRegionSize;
+    // The offset of the first frame of the ring from the start of the region. Page-aligned.
+    UInt64                  mDataOffset;
+    UInt32                  mChannelCount;
+    UInt32                  mBytesPerFrame;
+    // Always a power of two.
+    UInt32                  mCapacityFrames;
+
+    // The nominal sample rate of the frames. Unlike the format, this can change without the region
+    // being recreated. When it does, the writer empties the ring first, so a reader that reads it
+    // after getting consistent bounds gets the rate of the frames in those bounds.
+    std::atomic<Float64>    mSampleRate;
+    // One of the kRDCSharedLoopbackState_* values.
+    std::atomic<UInt32>     mState;
+    // Even when mStartTime and mEndTime are consistent. See the protocol above.
+    std::atomic<UInt64>     mSequence;
+    std::atomic<SInt64>     mStartTime;
+    std::atomic<SInt64>     mEndTime;
+
+    // The timestamps of the blocks of the mix stored most recently. Added in version 2.
+    RDC_LoopbackTimeStampTable mTimeStamps;
+};
+
+#pragma clang assume_nonnull end
+
+#endif /* SharedSource__RDC_SharedLoopback */
+
@@ -43,9 +43,11 @@
 
 // The object IDs for the audio objects this driver implements.
 //
-// RDCDevice always publishes this fixed set of objects (except when RDCDevice's volume or mute
-// controls are disabled). We might need to change that at some point, but so far it hasn't caused
-// any problems and it makes the driver much simpler.
+// The first RDCDevice instance always publishes this fixed set of objects (except when its volume
+// or mute controls are disabled, or it has no reduced input stream), so clients that hardcode them
+// keep working. Any additional
+// instances (see kRDCDeviceCountInfoKey) get their IDs from RDC_PlugIn::AllocateObjectIDs, which
+// hands them out sequentially from kObjectID_FirstDynamic.
 enum
 {
 	kObjectID_PlugIn                            = kAudioObjectPlugInObject,
@@ -58,8 +60,23 @@ enum
     // Null Device
     kObjectID_Device_Null                       = 7,   // Belongs to kObjectID_PlugIn
     kObjectID_Stream_Null                       = 8,   // Belongs to kObjectID_Device_Null
+    // RDCDevice again. See kAudioDeviceCustomPropertyReducedInputChannels.
+    kObjectID_Stream_Input_Reduced              = 9,   // Belongs to kObjectID_Device
+    // Additional RDCDevice instances
+    kObjectID_FirstDynamic                      = 10
 };
 
+// The key in the driver's Info.plist for the number of RDCDevice instances to publish. Each
+// instance has its own loopback buffer, clock, streams, controls and task queue. Optional. If the
+// key is missing or invalid, the driver publishes a single instance.
+#define kRDCDeviceCountInfoKey       "RDCDeviceCount"
+// The maximum number of RDCDevice instances the driver will publish.
+static const UInt32 kRDCMaxDeviceCount = 16;
+// The key in the driver's Info.plist for the initial value of
+// kAudioDeviceCustomPropertyLatencyOverrides, for deployments that need to calibrate the reported
+// latencies once. A dictionary in the same format. Optional.
+#define kRDCLatencyOverridesInfoKey  "RDCLatencyOverrides"
+
 // AudioObjectPropertyElement docs: "Elements are numbered sequentially where 0 represents the
 // master element."
 static const AudioObjectPropertyElement kMasterChannel = kAudioObjectPropertyElementMaster;
@@ -69,7 +86,25 @@ static const AudioObjectPropertyElement kMasterChannel = kAudioObjectPropertyEle
 enum
 {
     // A CFBoolean. True if the null device is enabled. Settable, false by default.
-    kAudioPlugInCustomPropertyNullDeviceActive = 'nuld'
+    kAudioPlugInCustomPropertyNullDeviceActive = 'nuld',
+    // A CFArray of CFDictionaries, one for each route from an RDCDevice instance's output to
+    // another instance's input. See the kRDCLoopbackRouteKey_* keys below. An instance with routes
+    // to its input reads the sum of their sources' output instead of its own. A source can feed
+    // several inputs and several sources can feed one input. Settable. Empty by default. Takes
+    // effect immediately.
+    //
+    // The sources are summed when the destination reads its input, so only sources with the same
+    // sample rate and channel count as the destination, which store their loopback audio as
+    // interleaved Float32 (the default), are mixed. The others are skipped, as are routes whose
+    // destination doesn't use Float32 streams.
+    kAudioPlugInCustomPropertyLoopbackRoutes   = 'lrts',
+    // A CFDictionary with the kRDCConfigurationKey_* keys below, for reconfiguring the driver
+    // without restarting coreaudiod. Settable. Setting it only changes the settings whose keys are
+    // in the dictionary, and checks all of them before changing any. The device settings are
+    // applied to every RDCDevice instance, through the same config changes as their own custom
+    // properties, so only the instances whose settings actually change stop IO, and only while
+    // the change is applied. Returns the number of instances and the main instance's settings.
+    kAudioPlugInCustomPropertyConfiguration    = 'cnfg'
 };
 
 #pragma mark RDCDevice Custom Properties
@@ -78,7 +113,567 @@ enum
 {
     // A CFArray of CFBooleans indicating which of RDCDevice's controls are enabled. All controls are enabled
     // by default. This property is settable. See the array indices below for more info.
-    kAudioDeviceCustomPropertyEnabledOutputControls                   = 'bgct'
+    kAudioDeviceCustomPropertyEnabledOutputControls                   = 'bgct',
+    // A CFNumber (SInt32). The number of channels in each of RDCDevice's streams. Settable. Because
+    // the streams and the loopback buffer have to be rebuilt, the change is applied asynchronously
+    // after the host has stopped IO. Must be in [1, kRDCMaxChannelCount].
+    kAudioDeviceCustomPropertyChannelCount                            = 'bgcc',
+    // A CFNumber (SInt32). The capacity of RDCDevice's loopback buffer in frames, which bounds how far
+    // apart the writer and the readers can be. Settable. The value is clamped to
+    // [kRDCMinLoopbackBufferFrameSize, kRDCMaxLoopbackBufferFrameSize] and rounded up to a power of
+    // two, and is applied asynchronously after the host has stopped IO. See the profiles below.
+    // Setting it fixes the capacity, so it no longer follows the sample rate. See
+    // kAudioDeviceCustomPropertyLoopbackBufferDuration.
+    kAudioDeviceCustomPropertyLoopbackBufferFrameSize                 = 'bgbf',
+    // A CFNumber (SInt32). The capacity of RDCDevice's loopback buffer in milliseconds, or 0 if it was
+    // fixed in frames with kAudioDeviceCustomPropertyLoopbackBufferFrameSize. Settable. While it's
+    // non-zero, the capacity in frames is recalculated whenever the sample rate changes, rounded up
+    // to a power of two and clamped in the same way, so the buffer covers at least this long at any
+    // rate. The value set is clamped to [kRDCMinLoopbackBufferMilliseconds,
+    // kRDCMaxLoopbackBufferMilliseconds] and applied asynchronously after the host has stopped IO.
+    kAudioDeviceCustomPropertyLoopbackBufferDuration                  = 'bgbd',
+    // A CFNumber (SInt32). The number of frames between the zero timestamps RDCDevice gives the HAL,
+    // i.e. kAudioDevicePropertyZeroTimeStampPeriod. Until it's set, it's a quarter of the loopback
+    // buffer's capacity while that's set by duration, and kRDCDefaultZeroTimeStampPeriod otherwise.
+    // Settable. Clamped to [kRDCMinZeroTimeStampPeriod, kRDCMaxZeroTimeStampPeriod] and applied
+    // asynchronously after the host has stopped IO. Shorter periods let the HAL's clock model
+    // converge faster, but the period should stay larger than any IO buffer size clients will use.
+    kAudioDeviceCustomPropertyZeroTimeStampPeriod                     = 'bgzp',
+    // A CFDictionary of CFNumbers (SInt64) with RDCDevice's statistics, mostly counting its IO cycles
+    // and problems with its loopback audio since the driver was loaded, so it can be monitored by
+    // polling a single property. Read-only. The counters are updated with relaxed atomics, so the
+    // values can be slightly inconsistent with each other. See the kRDCLoopbackStatsKey_* keys
+    // below.
+    kAudioDeviceCustomPropertyLoopbackStats                           = 'bgls',
+    // A CFArray of CFStrings. The bundle IDs of the apps whose output RDCDevice captures separately,
+    // before the HAL mixes it, so a single app can be recorded. Settable. At most kRDCMaxClientTaps
+    // bundle IDs. Applied asynchronously after the host has stopped IO because each tap gets its own
+    // loopback buffer. Empty by default.
+    kAudioDeviceCustomPropertyTappedBundleIDs                         = 'bgtp',
+    // A CFString. The bundle ID of the tap RDCDevice's input stream reads from, which must be one of
+    // the bundle IDs in kAudioDeviceCustomPropertyTappedBundleIDs, or the empty string for the mix
+    // of all clients. Settable. The empty string by default.
+    kAudioDeviceCustomPropertyInputTapBundleID                        = 'bgti',
+    // A CFString. The name of a POSIX shared memory region RDCDevice also writes its loopback audio
+    // to, so other processes can read it without going through the HAL, or the empty string if
+    // it's disabled. Settable. The name must start with a slash and be at most
+    // kRDCSharedLoopbackMaxNameLength bytes. Applied asynchronously after the host has stopped IO.
+    // See RDC_SharedLoopback.h for the layout and the read protocol. The empty string by default.
+    // The region is only readable by coreaudiod's user unless
+    // kAudioDeviceCustomPropertySharedLoopbackWorldReadable is set.
+    kAudioDeviceCustomPropertySharedLoopbackName                      = 'bgsh',
+    // A CFNumber (SInt32). The number of bits per sample RDCDevice's loopback buffer stores audio
+    // with: 32 for Float32 (the default), or 24 or 16 for signed integers. Storing fewer bits
+    // reduces the memory the buffer uses and the bandwidth reading and writing it, at the cost of
+    // converting samples in the IO functions. Independent of the streams' format. Settable. Applied
+    // asynchronously after the host has stopped IO.
+    kAudioDeviceCustomPropertyLoopbackStorageBitDepth                 = 'bgsb',
+    // A CFArray of CFDictionaries that each contain an app's PID and/or bundle ID, and its volume
+    // relative to other apps and/or pan position. See the kRDCAppVolumesKey_* keys below. Settable.
+    // Setting it only changes the apps in the array. The gain and pan are applied to each client's
+    // output before it's mixed, so they affect the loopback audio as well. The settings of apps with
+    // bundle IDs are saved, along with kAudioDeviceCustomPropertyTappedBundleIDs and
+    // kAudioDeviceCustomPropertyBusBundleIDs, and restored when coreaudiod restarts.
+    kAudioDeviceCustomPropertyAppVolumes                              = 'apvs',
+    // A CFDictionary of the levels of the audio written to RDCDevice's loopback buffer, measured as
+    // it's written. See the kRDCLoopbackLevelsKey_* keys below. Read-only. Reading it resets the
+    // peak levels.
+    kAudioDeviceCustomPropertyLoopbackLevels                          = 'bglv',
+    // A CFArray of CFStrings that routes apps to stereo pairs of RDCDevice's input stream. The
+    // bundle ID at index i is summed into input channels 2i + 1 and 2i + 2, and the empty string
+    // puts the mix of all clients on that pair instead. For example, with 6 channels (see
+    // kAudioDeviceCustomPropertyChannelCount), ["us.zoom.xos", "com.apple.Safari", ""] puts Zoom on
+    // 1-2, Safari on 3-4 and the mix on 5-6. Each app's first two output channels are used, before
+    // the master volume. Settable. At most kRDCMaxClientBuses bundle IDs, and at most half the
+    // channel count. While it isn't empty, the input stream reads the buses instead of the mix,
+    // unless kAudioDeviceCustomPropertyInputTapBundleID selects a tap. Only filled while the streams
+    // are Float32. Applied asynchronously after the host has stopped IO. Empty by default.
+    kAudioDeviceCustomPropertyBusBundleIDs                            = 'bgbu',
+    // A CFDictionary of histograms of how long the tasks RDCDevice queues for its worker threads
+    // took, since the driver was loaded or they were last reset. The keys are the names of the
+    // task types, e.g. "StartClientIO", and each value is a CFDictionary with the
+    // kRDCTaskLatenciesKey_* keys below. Each histogram is a CFArray of CFNumbers (SInt64), where
+    // the number at index i counts the tasks that took [2^i, 2^(i + 1)) nanoseconds. Settable:
+    // setting it to kCFBooleanTrue resets the histograms.
+    kAudioDeviceCustomPropertyTaskLatencies                           = 'bgtq',
+    // A CFDictionary that makes RDCDevice's clock follow another device's, usually the output
+    // device the loopback audio is played on, so its zero timestamps track that device instead of
+    // drifting against it. See the kRDCClockSourceKey_* keys below. Settable: the process doing IO
+    // on the followed device sets the device's UID once, and then its zero timestamps as they
+    // change. Setting an empty UID makes the clock free run again. Takes effect immediately.
+    kAudioDeviceCustomPropertyClockSource                             = 'bgcs',
+    // A CFBoolean. True if RDCDevice's input stream adjusts the rate it reads the loopback buffer
+    // at, by up to 1000 ppm, to stay the same distance behind the writer, so a reader whose sample
+    // times drift against the writer's never reads past the data and gets silence. Adjusted frames
+    // are interpolated. Only used while the streams and the loopback buffer are Float32. Settable.
+    // Takes effect immediately. False by default. See kRDCLoopbackStatsKey_DriftCorrectionPPM.
+    kAudioDeviceCustomPropertyDriftCompensation                       = 'bgdc',
+    // A CFDictionary of values that replace the ones RDCDevice calculates for
+    // kAudioDevicePropertyLatency and kAudioDevicePropertySafetyOffset. See the
+    // kRDCLatencyOverridesKey_* keys below. Only the values in the dictionary are overridden.
+    // Settable. Setting it replaces all of the overrides, so an empty dictionary removes them. Takes
+    // effect immediately. Initially read from the driver's Info.plist. See
+    // kRDCLatencyOverridesInfoKey.
+    kAudioDeviceCustomPropertyLatencyOverrides                        = 'bglo',
+    // A CFData with the RDC_IOTraceEntry for each IO operation RDCDevice was called for in roughly
+    // the last kRDCIOTraceSnapshotSeconds seconds, oldest first, for finding out which operation
+    // was slow after an IO overload. Entries that were being recorded while the snapshot was taken
+    // are left out. Read only.
+    kAudioDeviceCustomPropertyIOTrace                                 = 'bgit',
+    // A CFBoolean. True if the driver logs os_signpost intervals for the IO operations, the client
+    // IO state tasks, client map updates and property notifications, for profiling coreaudiod with
+    // Instruments' Points of Interest instrument. Shared by all RDCDevice instances. Settable. Takes
+    // effect immediately. False by default. Ignored before macOS 10.14.
+    kAudioDeviceCustomPropertySignposts                               = 'bgsp',
+    // A CFString. The path of a CAF file the loopback audio is being recorded to, as interleaved
+    // Float32 frames at the device's sample rate. Settable. Setting it starts a new recording and
+    // the empty string stops recording. The file must be directly in kRDCOutputFileDirectory and
+    // not exist yet. Takes effect immediately. Recording stops if the device's format changes. The
+    // empty string by default. See kRDCLoopbackStatsKey_RecordingDroppedFrames.
+    kAudioDeviceCustomPropertyRecordingPath                           = 'bgrc',
+    // A CFDictionary with the destination RDCDevice sends the loopback audio to as RTP, in the
+    // AES67 format (L24 at the device's sample rate), and how often it sends packets. See the
+    // kRDCRTPSenderKey_* keys below. The packets are sent from a thread that reads the loopback
+    // buffer directly, so no HAL client is needed. Settable. An empty dictionary stops sending, and
+    // is the default. Takes effect immediately. See kRDCLoopbackStatsKey_RTPPacketsSent.
+    kAudioDeviceCustomPropertyRTPSender                               = 'bgrt',
+    // A CFBoolean. True if RDCDevice's loopback buffer stores each channel in its own buffer,
+    // aligned to a cache line, instead of storing interleaved frames. The IO functions deinterleave
+    // the mix as it's stored, so readers inside the driver can process each channel with aligned
+    // vector loads, and interleave it again for the input stream. Independent of
+    // kAudioDeviceCustomPropertyLoopbackStorageBitDepth and of the streams' format, which stays
+    // interleaved. Settable. Applied asynchronously after the host has stopped IO. False by
+    // default.
+    kAudioDeviceCustomPropertyLoopbackStoragePlanar                   = 'bgpl',
+    // A CFDictionary that delays what apps read from RDCDevice's input stream. The keys are bundle
+    // IDs and the values are CFNumbers, the number of frames to delay that app's reads by. Each
+    // client reads the loopback buffer that far behind the sample time the HAL gives it, so a
+    // delayed reader costs no extra copies. The loopback buffer is made larger by the largest
+    // delay, so the delayed readers don't reduce how far behind the writer the others can be.
+    // Settable. At most kRDCMaxReadDelayFrames per app. New delays apply immediately if they fit in
+    // the buffer, and the buffer is resized asynchronously after the host has stopped IO. Empty by
+    // default.
+    kAudioDeviceCustomPropertyReadDelays                              = 'bgrd',
+    // A CFBoolean. True if RDCDevice's loopback buffer is wired (mlock'd), so the IO thread never
+    // page faults on it, even after the system has been under memory pressure. The buffer is
+    // always prefaulted when it's allocated, but that doesn't stop its pages being compressed or
+    // swapped out later. Settable. Takes effect immediately and is kept when the buffer is
+    // reallocated. Setting it fails if the pages can't be locked. False by default, since the
+    // buffer can be hundreds of megabytes with many channels and a deep buffer.
+    kAudioDeviceCustomPropertyLoopbackBufferWired                     = 'bgwr',
+    // A CFNumber (UInt32). How many seconds after IO stops RDCDevice frees its loopback buffer.
+    // The buffer is allocated when IO first starts, rather than when the driver is loaded, and
+    // reallocated when IO starts again after it's been freed, which makes that StartIO slower. 0
+    // keeps the buffer allocated once IO has started. Settable. At most
+    // kRDCMaxLoopbackIdleTimeoutSeconds. kRDCDefaultLoopbackIdleTimeoutSeconds by default.
+    kAudioDeviceCustomPropertyLoopbackIdleTimeout                     = 'bgid',
+    // A CFArray with a CFDictionary for each registered client, with the kRDCClientIOTimesKey_*
+    // keys below, of how much time the IO thread has spent in DoIOOperation for it, i.e. reading
+    // its input and processing its output, since it was added or the times were last reset. For
+    // finding the app whose buffers push the IO cycle past its deadline. The mix is written once
+    // per cycle for all clients, so WriteMix isn't included. Settable: setting it to kCFBooleanTrue
+    // resets the times.
+    kAudioDeviceCustomPropertyClientIOTimes                           = 'bgci',
+    // A CFNumber (UInt32). How many seconds of the loopback audio RDCDevice keeps so it can be saved
+    // after the fact with kAudioDeviceCustomPropertyRetroCaptureSavePath. The audio is kept in a
+    // memory-mapped temporary file, filled from a non-realtime thread, so a long window uses little
+    // resident memory and needs no HAL client. It's compressed losslessly, which only makes it
+    // smaller while the audio is unmixed integer PCM at full volume. See
+    // kRDCLoopbackStatsKey_RetroCaptureEncodedBytes. 0 disables it. Settable. Takes effect immediately
+    // and empties the window, which is also emptied when the device's format changes. At most
+    // kRDCMaxRetroCaptureSeconds. 0 by default. See kRDCLoopbackStatsKey_RetroCaptureDroppedFrames.
+    kAudioDeviceCustomPropertyRetroCaptureSeconds                     = 'bgrw',
+    // A CFString. Setting it writes the audio kept by kAudioDeviceCustomPropertyRetroCaptureSeconds
+    // to a CAF file at that path, oldest first, as interleaved Float32 frames at the device's
+    // sample rate. The file must be directly in kRDCOutputFileDirectory and not exist yet. Fails if
+    // the window is disabled. The window keeps filling, so it can be saved again later. Returns the
+    // path last saved to, or the empty string.
+    kAudioDeviceCustomPropertyRetroCaptureSavePath                    = 'bgrs',
+    // A CFNumber (UInt32). How many seconds from the end of the retroactive capture window
+    // kAudioDeviceCustomPropertyRetroCaptureSavePath saves, or 0 to save the whole window. The
+    // window is kept in separately compressed blocks, so saving part of it only decodes that part.
+    // Settable. At most kRDCMaxRetroCaptureSeconds. 0 by default.
+    kAudioDeviceCustomPropertyRetroCaptureSaveSeconds                 = 'bgrl',
+    // A CFArray of CFNumbers (SInt32) that adds a second input stream to RDCDevice, with one channel
+    // for each element. An element is the number of the device channel to copy, from 1, or
+    // kRDCReducedInputChannel_Mix for the average of all of them. For example, [0] is a mono
+    // downmix and [1, 2] is the first two channels. Channels past the device's channel count are
+    // silent. The stream reads the same audio as the main input stream, downmixing straight out of
+    // the loopback buffer when it can, so a reader that only needs a few channels copies less.
+    // Such a reader should turn the main input stream off for its IO proc with
+    // kAudioDevicePropertyIOProcStreamUsage, so the HAL doesn't read both. The reduced stream
+    // doesn't use drift compensation. Settable. At most kRDCMaxChannelCount elements. An empty
+    // array removes the stream, and is the default. Applied asynchronously after the host has
+    // stopped IO.
+    kAudioDeviceCustomPropertyReducedInputChannels                    = 'bgri',
+    // A CFData with a RDC_LoopbackTimeStamp for each of the last kRDCLoopbackTimeStampCount blocks
+    // of the mix RDCDevice stored in the loopback buffer, oldest first. Each one has the host time
+    // the HAL gave for the first frame of the block, so a client can find the host time of the
+    // frames it reads, e.g. to line them up with video, by looking up the nearest entry rather
+    // than estimating it from the device's timestamps. The input stream uses the same sample times.
+    // Emptied when IO starts, since the sample times start again. The shared memory export has the
+    // same table. See RDC_SharedLoopback.h. Read only.
+    kAudioDeviceCustomPropertyLoopbackTimeStamps                      = 'bgts',
+    // A CFBoolean. True if the shared memory region named by
+    // kAudioDeviceCustomPropertySharedLoopbackName is created readable by every user, rather than
+    // only by coreaudiod's user. Setting it bypasses the HAL's access control for the loopback
+    // audio: any process on the machine, in any user's session and without microphone
+    // permission, can then map the region and read everything played through the device. Only set
+    // it if every local user may hear that audio. Settable. Applied asynchronously after the host
+    // has stopped IO, by recreating the region. False by default.
+    kAudioDeviceCustomPropertySharedLoopbackWorldReadable             = 'bgsw'
+};
+
+// kAudioDeviceCustomPropertyLoopbackStats keys
+//
+// The number of times a reader got silence because it couldn't read the loopback buffer
+// consistently, even after retrying, e.g. because the writer overwrote the frames while they were
+// being read.
+#define kRDCLoopbackStatsKey_SilentFetches          "SilentFetches"
+// The number of reads that only succeeded after retrying.
+#define kRDCLoopbackStatsKey_RecoveredFetches       "RecoveredFetches"
+// The number of the SilentFetches that faded out from the previous block instead of cutting to
+// silence. The rest didn't follow on from a block that was read.
+#define kRDCLoopbackStatsKey_ConcealedFetches       "ConcealedFetches"
+// The number of times a reader asked for frames that weren't (or weren't all) in the buffer, i.e.
+// it was too far ahead of or behind the writer. The missing frames are read as silence.
+#define kRDCLoopbackStatsKey_Underruns              "Underruns"
+// The number of times writing to the loopback buffer failed.
+#define kRDCLoopbackStatsKey_StoreErrors            "StoreErrors"
+// The total number of frames of silence inserted into the buffer to fill gaps between writes.
+#define kRDCLoopbackStatsKey_GapFramesZeroFilled    "GapFramesZeroFilled"
+// The largest distance, in frames, seen between the sample time a reader asked for and the end of
+// the data in the buffer.
+#define kRDCLoopbackStatsKey_MaxReadWriteDistance   "MaxReadWriteDistance"
+// The total number of frames that were silent, either because they were all zero or because the
+// device was muted, so they were marked silent in the buffer instead of being copied into it.
+#define kRDCLoopbackStatsKey_SilentFramesSkipped    "SilentFramesSkipped"
+// The total number of frames that weren't copied into the buffer because nothing was reading it:
+// no input client had read it recently, the RTP sender was stopped and no routes read it.
+#define kRDCLoopbackStatsKey_UnreadFramesSkipped    "UnreadFramesSkipped"
+// The most tasks that have been waiting at once for RDCDevice's realtime and non-realtime worker
+// threads. For checking the task queues are big enough.
+#define kRDCLoopbackStatsKey_RealTimeTasksHighWaterMark     "RealTimeTasksHighWaterMark"
+#define kRDCLoopbackStatsKey_NonRealTimeTasksHighWaterMark  "NonRealTimeTasksHighWaterMark"
+// The number of tasks in the pool RDCDevice's async tasks come from, the most of them that have
+// been in use at once, and the number of tasks dropped because the pool was empty. Dropped tasks
+// are lost notifications or client IO state changes, so the last should always be zero.
+#define kRDCLoopbackStatsKey_TaskPoolSize                   "TaskPoolSize"
+#define kRDCLoopbackStatsKey_TaskPoolHighWaterMark          "TaskPoolHighWaterMark"
+#define kRDCLoopbackStatsKey_DroppedTasks                   "DroppedTasks"
+// The rate correction kAudioDeviceCustomPropertyDriftCompensation is currently applying, in parts
+// per million. Positive when the input stream is reading faster than the writer. Not a counter.
+#define kRDCLoopbackStatsKey_DriftCorrectionPPM             "DriftCorrectionPPM"
+// The number of frames left out of kAudioDeviceCustomPropertyRecordingPath's recordings because the
+// disk couldn't keep up.
+#define kRDCLoopbackStatsKey_RecordingDroppedFrames         "RecordingDroppedFrames"
+// The number of frames left out of kAudioDeviceCustomPropertyRetroCaptureSeconds's window because
+// the non-realtime thread couldn't keep up.
+#define kRDCLoopbackStatsKey_RetroCaptureDroppedFrames      "RetroCaptureDroppedFrames"
+// The number of bytes the audio in kAudioDeviceCustomPropertyRetroCaptureSeconds's window takes
+// after compressing it, not including the frames that haven't been moved into it yet. Not a counter.
+#define kRDCLoopbackStatsKey_RetroCaptureEncodedBytes       "RetroCaptureEncodedBytes"
+// The number of packets kAudioDeviceCustomPropertyRTPSender has sent.
+#define kRDCLoopbackStatsKey_RTPPacketsSent                 "RTPPacketsSent"
+// The number of frames kAudioDeviceCustomPropertyRTPSender skipped because it fell too far behind
+// the loopback buffer's writer.
+#define kRDCLoopbackStatsKey_RTPFramesSkipped               "RTPFramesSkipped"
+// The number of IO cycles RDCDevice has written the mix for, and the most time the driver has spent
+// in the IO operations of one cycle, in nanoseconds. The time is only approximate if the input and
+// output IO run on different threads.
+#define kRDCLoopbackStatsKey_IOCycles                       "IOCycles"
+#define kRDCLoopbackStatsKey_SlowestIOCycleNanos            "SlowestIOCycleNanos"
+// The number of the reads counted in kRDCLoopbackStatsKey_Underruns that started before the
+// oldest frame in the buffer, i.e. the writer had overwritten frames before the reader got to them.
+#define kRDCLoopbackStatsKey_Overruns                       "Overruns"
+// The number of gaps between writes, whose frames are counted in
+// kRDCLoopbackStatsKey_GapFramesZeroFilled.
+#define kRDCLoopbackStatsKey_Gaps                           "Gaps"
+// The number of tasks currently waiting for RDCDevice's realtime and non-realtime worker threads,
+// and the number of tasks from the pool currently in use. Not counters.
+#define kRDCLoopbackStatsKey_RealTimeTasksQueued            "RealTimeTasksQueued"
+#define kRDCLoopbackStatsKey_NonRealTimeTasksQueued         "NonRealTimeTasksQueued"
+#define kRDCLoopbackStatsKey_TaskPoolTasksInUse             "TaskPoolTasksInUse"
+// The number of times the list of clients the IO thread reads has been replaced, which happens
+// when clients are added or removed (in batches), start or stop IO or their settings change.
+#define kRDCLoopbackStatsKey_ClientSnapshotsPublished       "ClientSnapshotsPublished"
+// The number of property change notifications the driver has sent the host, for all of its
+// objects, not just this device.
+#define kRDCLoopbackStatsKey_PropertyNotifications          "PropertyNotifications"
+// How many frames the last read of the loopback buffer started behind the end of the data in the
+// buffer. Negative if it was ahead of the writer. Not a counter.
+#define kRDCLoopbackStatsKey_ReadWriteDistance              "ReadWriteDistance"
+
+// kAudioDeviceCustomPropertyLoopbackLevels keys
+//
+// Both are CFArrays with a CFNumber (Float32) for each channel. The levels are linear amplitudes,
+// where 1.0 is full scale.
+//
+// The highest absolute sample value since the property was last read.
+#define kRDCLoopbackLevelsKey_Peak                  "Peak"
+// The RMS level of the most recent buffer.
+#define kRDCLoopbackLevelsKey_RMS                   "RMS"
+
+// kAudioDeviceCustomPropertyTaskLatencies keys
+//
+// The time from a task being queued until its worker thread started it.
+#define kRDCTaskLatenciesKey_Wait                   "Wait"
+// The time from a task being queued until it was finished, which is how long a thread that queued
+// it synchronously was blocked for.
+#define kRDCTaskLatenciesKey_Total                  "Total"
+
+// kAudioDeviceCustomPropertyClockSource keys
+//
+// A CFString with the UID of the followed device, or the empty string if the clock free runs.
+#define kRDCClockSourceKey_DeviceUID                "DeviceUID"
+// A zero timestamp of the followed device, e.g. from AudioDeviceGetCurrentTime or an IOProc's
+// timestamps: a CFNumber (Float64) sample time, a CFNumber (SInt64) host time and a CFNumber
+// (Float64) with the device's nominal sample rate. Only set, and optional, but all or none of them
+// have to be given. Ignored while no clients are doing IO on RDCDevice, so the process only needs to
+// send them while RDCDevice's kAudioDevicePropertyDeviceIsRunning is true.
+#define kRDCClockSourceKey_SampleTime               "SampleTime"
+#define kRDCClockSourceKey_HostTime                 "HostTime"
+#define kRDCClockSourceKey_SampleRate               "SampleRate"
+// Only read. A CFNumber (Float64) with the followed device's sample rate as measured from its zero
+// timestamps, or 0 if it hasn't been given any yet.
+#define kRDCClockSourceKey_ActualSampleRate         "ActualSampleRate"
+// Optional. A CFNumber (UInt32) with the number of frames between a sample being written to
+// RDCDevice and it being heard on the followed device, i.e. that device's latency and safety offset
+// plus however far behind RDCDevice the process playing the audio reads. RDCDevice reports it as
+// its output latency. Reset to 0 when a different device is followed.
+#define kRDCClockSourceKey_Latency                  "Latency"
+
+// kAudioDeviceCustomPropertyLatencyOverrides keys
+//
+// Each is a CFNumber (UInt32) with a number of frames. The safety offsets are clamped so the reader
+// of the loopback buffer can't fall off the back of it.
+#define kRDCLatencyOverridesKey_InputLatency        "InputLatency"
+#define kRDCLatencyOverridesKey_OutputLatency       "OutputLatency"
+#define kRDCLatencyOverridesKey_InputSafetyOffset   "InputSafetyOffset"
+#define kRDCLatencyOverridesKey_OutputSafetyOffset  "OutputSafetyOffset"
+
+// kAudioDeviceCustomPropertyRTPSender keys
+//
+// A CFString with the numeric IPv4 or IPv6 address to send to, unicast or multicast. Required.
+#define kRDCRTPSenderKey_Address                    "Address"
+// A CFNumber (UInt32) with the UDP port. kRDCRTPSenderDefaultPort by default.
+#define kRDCRTPSenderKey_Port                       "Port"
+// A CFNumber (UInt32) with the packet time (ptime) in microseconds, from
+// kRDCRTPSenderMinPacketTimeMicros to kRDCRTPSenderMaxPacketTimeMicros. 1 ms by default, which is
+// AES67's default. Each packet must fit in kRDCRTPSenderMaxPayloadBytes.
+#define kRDCRTPSenderKey_PacketTime                 "PacketTime"
+// A CFNumber (UInt32) with the RTP payload type, from 96 to 127. 96 by default.
+#define kRDCRTPSenderKey_PayloadType                "PayloadType"
+// A CFNumber (UInt32) with the TTL (or hop limit) of multicast packets. 32 by default.
+#define kRDCRTPSenderKey_TTL                        "TTL"
+
+// kAudioPlugInCustomPropertyLoopbackRoutes keys
+//
+// CFStrings with the UIDs of the RDCDevice instances whose output the route reads and whose input
+// it feeds. Required. They have to be different instances.
+#define kRDCLoopbackRouteKey_Source                 "Source"
+#define kRDCLoopbackRouteKey_Destination            "Destination"
+
+// kAudioPlugInCustomPropertyConfiguration keys
+//
+// A CFNumber (UInt32). The number of RDCDevice instances to publish, in [1, kRDCMaxDeviceCount].
+// Starts at kRDCDeviceCountInfoKey's value. New instances are created as needed. Instances that are
+// removed, which are always the last ones, are hidden rather than destroyed, so they keep their
+// object IDs and settings if they're published again, and their loopback routes are dropped. The
+// configuration isn't applied, and kAudioHardwareIllegalOperationError is returned, if an instance
+// that would be removed is doing IO.
+#define kRDCConfigurationKey_DeviceCount                "DeviceCount"
+// A CFNumber (UInt32). See kAudioDeviceCustomPropertyChannelCount.
+#define kRDCConfigurationKey_ChannelCount               "ChannelCount"
+// A CFArray of CFNumbers (Float64), the nominal sample rates RDCDevice advertises in
+// kAudioDevicePropertyAvailableNominalSampleRates and its streams' available formats. At most
+// kRDCMaxAvailableSampleRates rates, each at least 1 Hz. kRDCAvailableSampleRates by default. The
+// device still accepts other rates. If an instance's current rate isn't in the new set, it changes
+// to the nearest one in it.
+#define kRDCConfigurationKey_SampleRates                "SampleRates"
+// CFNumbers (UInt32). See kAudioDeviceCustomPropertyLoopbackBufferFrameSize and
+// kAudioDeviceCustomPropertyLoopbackBufferDuration. A dictionary can't set both.
+#define kRDCConfigurationKey_LoopbackBufferFrameSize    "LoopbackBufferFrameSize"
+#define kRDCConfigurationKey_LoopbackBufferMilliseconds "LoopbackBufferMilliseconds"
+
+// kAudioDeviceCustomPropertyClientIOTimes keys
+//
+// CFNumbers (UInt32 and pid_t) with the client's ID and its process's PID.
+#define kRDCClientIOTimesKey_ClientID               "ClientID"
+#define kRDCClientIOTimesKey_ProcessID              "ProcessID"
+// A CFString with the client's bundle ID. Missing if it doesn't have one.
+#define kRDCClientIOTimesKey_BundleID               "BundleID"
+// CFNumbers (SInt64). The total and longest time its IO operations took, in nanoseconds, and how
+// many there were.
+#define kRDCClientIOTimesKey_TotalTime              "TotalTime"
+#define kRDCClientIOTimesKey_MaxTime                "MaxTime"
+#define kRDCClientIOTimesKey_Operations             "Operations"
+
+// kAudioDeviceCustomPropertyAppVolumes keys
+//
+// A CFNumber (pid_t) with the app's PID.
+#define kRDCAppVolumesKey_ProcessID                 "pid"
+// A CFString with the app's bundle ID. Settings for a bundle ID are remembered and applied to
+// clients with that bundle ID that are added later.
+#define kRDCAppVolumesKey_BundleID                  "bid"
+// A CFNumber (SInt32) from kRDCAppRelativeVolumeMinRawValue to kRDCAppRelativeVolumeMaxRawValue.
+// The midpoint leaves the app's volume unchanged, values above it boost the app and values below
+// it cut it. Optional.
+#define kRDCAppVolumesKey_RelativeVolume            "rvol"
+// A CFNumber (SInt32) from kRDCAppPanLeftRawValue to kRDCAppPanRightRawValue. Negative values move
+// the app's audio towards the left channel and positive values towards the right. Only applied
+// when RDCDevice has two channels. Optional.
+#define kRDCAppVolumesKey_PanPosition               "ppos"
+
+// The range and volume curve of kRDCAppVolumesKey_RelativeVolume.
+static const SInt32 kRDCAppRelativeVolumeMinRawValue      = 0;
+static const SInt32 kRDCAppRelativeVolumeMaxRawValue      = 100;
+static const Float32 kRDCAppRelativeVolumeMinDbValue      = -96.0f;
+static const Float32 kRDCAppRelativeVolumeMaxDbValue      = 0.0f;
+
+// The range of kRDCAppVolumesKey_PanPosition.
+static const SInt32 kRDCAppPanLeftRawValue                = -100;
+static const SInt32 kRDCAppPanCenterRawValue              = 0;
+static const SInt32 kRDCAppPanRightRawValue               = 100;
+
+// The nominal sample rates RDCDevice reports in kAudioDevicePropertyAvailableNominalSampleRates and
+// its streams' available formats, until kRDCConfigurationKey_SampleRates changes them. Changing
+// between them doesn't reallocate the loopback buffer,
+// since its capacity is in frames.
+static const Float64 kRDCAvailableSampleRates[] = {
+    44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0
+};
+static const UInt32 kRDCNumberOfAvailableSampleRates =
+        sizeof(kRDCAvailableSampleRates) / sizeof(kRDCAvailableSampleRates[0]);
+// The most nominal sample rates kRDCConfigurationKey_SampleRates can set.
+static const UInt32 kRDCMaxAvailableSampleRates = 16;
+
+// The default and maximum values for kAudioDeviceCustomPropertyChannelCount.
+static const UInt32 kRDCDefaultChannelCount = 2;
+static const UInt32 kRDCMaxChannelCount     = 64;
+
+// Suggested values for kAudioDeviceCustomPropertyLoopbackBufferFrameSize.
+//
+// Low latency, for monitoring. Readers have to stay within ~46 ms at 44.1 kHz of the writer.
+static const UInt32 kRDCLoopbackBufferFrameSizeLowLatency = 2048;
+// The default.
+static const UInt32 kRDCLoopbackBufferFrameSizeDefault    = 16384;
+// Deep buffer, for long captures with bursty readers. ~5.9 s at 44.1 kHz.
+static const UInt32 kRDCLoopbackBufferFrameSizeDeep       = 262144;
+
+static const UInt32 kRDCMinLoopbackBufferFrameSize        = 1024;
+static const UInt32 kRDCMaxLoopbackBufferFrameSize        = 1048576;
+
+// The default and limits for kAudioDeviceCustomPropertyLoopbackBufferDuration. The default comes to
+// kRDCLoopbackBufferFrameSizeDefault frames at 44.1 kHz and 131072 frames at 192 kHz.
+static const UInt32 kRDCDefaultLoopbackBufferMilliseconds = 370;
+static const UInt32 kRDCMinLoopbackBufferMilliseconds     = 10;
+static const UInt32 kRDCMaxLoopbackBufferMilliseconds     = 20000;
+
+// The smallest IO buffer size RDCDevice advertises in kAudioDevicePropertyBufferFrameSizeRange, so
+// it can be used for live monitoring. ~0.7 ms at 44.1 kHz. The largest is its zero timestamp
+// period, or half the loopback buffer's capacity if that's smaller.
+static const UInt32 kRDCMinIOBufferFrameSize              = 32;
+
+// The default and limits for kAudioDeviceCustomPropertyZeroTimeStampPeriod. The default is ~93 ms
+// at 44.1 kHz.
+static const UInt32 kRDCDefaultZeroTimeStampPeriod        = 4096;
+static const UInt32 kRDCMinZeroTimeStampPeriod            = 512;
+static const UInt32 kRDCMaxZeroTimeStampPeriod            = 1048576;
+
+// The sample formats RDCDevice's streams and loopback buffer support. The streams use the same
+// format for their virtual and physical formats. All of them are native-endian, packed and
+// interleaved. Int24 samples take three bytes.
+enum RDC_SampleFormat : UInt32
+{
+    kRDCSampleFormat_Float32 = 0,
+    kRDCSampleFormat_Int16   = 1,
+    kRDCSampleFormat_Int24   = 2
+};
+
+static const UInt32 kRDCNumberOfSampleFormats = 3;
+
+// The maximum number of bundle IDs in kAudioDeviceCustomPropertyTappedBundleIDs.
+static const UInt32 kRDCMaxClientTaps                     = 8;
+
+// The maximum number of stereo buses in kAudioDeviceCustomPropertyBusBundleIDs.
+static const UInt32 kRDCMaxClientBuses                    = 16;
+
+// The largest delay kAudioDeviceCustomPropertyReadDelays allows. ~23.8 s at 44.1 kHz.
+static const UInt32 kRDCMaxReadDelayFrames                = 1048576;
+
+// The element of kAudioDeviceCustomPropertyReducedInputChannels for the average of all channels.
+static const SInt32 kRDCReducedInputChannel_Mix           = 0;
+
+// The default and maximum values for kAudioDeviceCustomPropertyLoopbackIdleTimeout.
+static const UInt32 kRDCDefaultLoopbackIdleTimeoutSeconds = 60;
+static const UInt32 kRDCMaxLoopbackIdleTimeoutSeconds     = 86400;
+
+// The directory kAudioDeviceCustomPropertyRecordingPath's and
+// kAudioDeviceCustomPropertyRetroCaptureSavePath's files are written to. The driver creates it if
+// it can, but coreaudiod usually can't write to its parent, so it has to be created when the driver
+// is installed (see README.md). It must be owned by coreaudiod's user and not writable by
+// anyone else, or nothing is written to it. Files are created in it with mode 0600, never replace
+// an existing file and never follow a symlink, so a client can't use the driver to overwrite or
+// expose files it couldn't write itself.
+#define kRDCOutputFileDirectory                             "/Library/Application Support/RDCAudio"
+
+// The longest window kAudioDeviceCustomPropertyRetroCaptureSeconds allows. An hour of two channels
+// at 48 kHz is about 1.4 GB of disk uncompressed, and about half that compressed if it's from 16-bit
+// sources.
+static const UInt32 kRDCMaxRetroCaptureSeconds            = 3600;
+
+// kAudioDeviceCustomPropertyIOTrace returns the entries from this many seconds before it's read, or
+// as many as the trace holds, if that's fewer.
+static const UInt32 kRDCIOTraceSnapshotSeconds            = 10;
+
+// The defaults and limits for the kRDCRTPSenderKey_* keys.
+static const UInt32 kRDCRTPSenderDefaultPort              = 5004;
+static const UInt32 kRDCRTPSenderDefaultPacketTimeMicros  = 1000;
+static const UInt32 kRDCRTPSenderMinPacketTimeMicros      = 125;
+static const UInt32 kRDCRTPSenderMaxPacketTimeMicros      = 20000;
+static const UInt32 kRDCRTPSenderDefaultPayloadType       = 96;
+static const UInt32 kRDCRTPSenderDefaultTTL               = 32;
+// So a packet fits in one Ethernet frame.
+static const UInt32 kRDCRTPSenderMaxPayloadBytes          = 1440;
+
+// Which of RDCDevice's IO functions an RDC_IOTraceEntry is for.
+enum : UInt32
+{
+    kRDCIOTraceCall_BeginIOOperation = 0,
+    kRDCIOTraceCall_DoIOOperation    = 1,
+    kRDCIOTraceCall_EndIOOperation   = 2
+};
+
+// One call to one of RDCDevice's IO functions, as returned by kAudioDeviceCustomPropertyIOTrace.
+// Native-endian.
+struct RDC_IOTraceEntry
+{
+    // The host times the function was entered and returned at.
+    UInt64      mBeginHostTime;
+    UInt64      mEndHostTime;
+    // The time bounds of the loopback buffer when the function returned. Both zero if it's empty.
+    SInt64      mRingStartTime;
+    SInt64      mRingEndTime;
+    // The input sample time for kAudioServerPlugInIOOperationReadInput, the output sample time
+    // for the operations that write, and the current sample time otherwise.
+    Float64     mSampleTime;
+    // One of the kAudioServerPlugInIOOperation* IDs.
+    UInt32      mOperationID;
+    UInt32      mClientID;
+    UInt32      mFrameSize;
+    // One of the kRDCIOTraceCall_* values.
+    UInt32      mCall;
+};
+
+// The start of one block of the mix, as returned by kAudioDeviceCustomPropertyLoopbackTimeStamps.
+// Native-endian.
+struct RDC_LoopbackTimeStamp
+{
+    // The sample time of the first frame of the block.
+    SInt64      mSampleTime;
+    // The host time the HAL gave for that frame, in mach_absolute_time units.
+    UInt64      mHostTime;
 };
 
 
@@ -99,6 +694,192 @@ static const AudioObjectPropertyAddress kRDCEnabledOutputControlsAddress = {
     kAudioObjectPropertyElementMaster
 };
 
+static const AudioObjectPropertyAddress kRDCChannelCountAddress = {
+    kAudioDeviceCustomPropertyChannelCount,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackBufferFrameSizeAddress = {
+    kAudioDeviceCustomPropertyLoopbackBufferFrameSize,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackBufferDurationAddress = {
+    kAudioDeviceCustomPropertyLoopbackBufferDuration,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCZeroTimeStampPeriodAddress = {
+    kAudioDeviceCustomPropertyZeroTimeStampPeriod,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackStatsAddress = {
+    kAudioDeviceCustomPropertyLoopbackStats,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCTappedBundleIDsAddress = {
+    kAudioDeviceCustomPropertyTappedBundleIDs,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCInputTapBundleIDAddress = {
+    kAudioDeviceCustomPropertyInputTapBundleID,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCSharedLoopbackNameAddress = {
+    kAudioDeviceCustomPropertySharedLoopbackName,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackStorageBitDepthAddress = {
+    kAudioDeviceCustomPropertyLoopbackStorageBitDepth,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackLevelsAddress = {
+    kAudioDeviceCustomPropertyLoopbackLevels,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCAppVolumesAddress = {
+    kAudioDeviceCustomPropertyAppVolumes,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCBusBundleIDsAddress = {
+    kAudioDeviceCustomPropertyBusBundleIDs,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCTaskLatenciesAddress = {
+    kAudioDeviceCustomPropertyTaskLatencies,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCClockSourceAddress = {
+    kAudioDeviceCustomPropertyClockSource,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCDriftCompensationAddress = {
+    kAudioDeviceCustomPropertyDriftCompensation,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLatencyOverridesAddress = {
+    kAudioDeviceCustomPropertyLatencyOverrides,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCIOTraceAddress = {
+    kAudioDeviceCustomPropertyIOTrace,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCSignpostsAddress = {
+    kAudioDeviceCustomPropertySignposts,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCRecordingPathAddress = {
+    kAudioDeviceCustomPropertyRecordingPath,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCRTPSenderAddress = {
+    kAudioDeviceCustomPropertyRTPSender,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackStoragePlanarAddress = {
+    kAudioDeviceCustomPropertyLoopbackStoragePlanar,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCReadDelaysAddress = {
+    kAudioDeviceCustomPropertyReadDelays,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackBufferWiredAddress = {
+    kAudioDeviceCustomPropertyLoopbackBufferWired,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackIdleTimeoutAddress = {
+    kAudioDeviceCustomPropertyLoopbackIdleTimeout,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCClientIOTimesAddress = {
+    kAudioDeviceCustomPropertyClientIOTimes,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCRetroCaptureSecondsAddress = {
+    kAudioDeviceCustomPropertyRetroCaptureSeconds,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCRetroCaptureSavePathAddress = {
+    kAudioDeviceCustomPropertyRetroCaptureSavePath,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCRetroCaptureSaveSecondsAddress = {
+    kAudioDeviceCustomPropertyRetroCaptureSaveSeconds,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCReducedInputChannelsAddress = {
+    kAudioDeviceCustomPropertyReducedInputChannels,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCLoopbackTimeStampsAddress = {
+    kAudioDeviceCustomPropertyLoopbackTimeStamps,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress kRDCSharedLoopbackWorldReadableAddress = {
+    kAudioDeviceCustomPropertySharedLoopbackWorldReadable,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
 
 #pragma mark Exceptions
 
@@ -0,0 +1,247 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  main.cpp
+//  RDCClockDriftTest
+//
+//  Checks that RDC_LoopbackClock doesn't drift. For each sample rate, it runs the clock for a
+//  number of frames, at least 10^9 (a little over five hours at 48 kHz), and then samples it out to
+//  months of frames. At each sample time it checks that:
+//    - GetHostTimeForSampleTime is exactly the host time worked out independently from
+//      mach_timebase_info, i.e. the accumulated drift is zero ticks.
+//    - The host times only increase.
+//    - GetSampleTimeForHostTime maps the host time back to the same sample time, and the tick
+//      before it to the previous sample time, so the inverse is exact and also only increases.
+//    - Re-anchoring the clock at the sample time, as RDC_Device does when it starts or stops
+//      following another device, doesn't move it.
+//  For comparison, it also reports how far the old approach, adding up a Float64 ticks-per-frame
+//  ratio, would have drifted over the same frames.
+//
+//  Usage: RDCClockDriftTest [-f frames] [-s step frames]
+//
+//  Exits with status 1 if any check fails.
+//
+
+// Local Includes
+#include "RDC_LoopbackClock.h"
+
+// STL Includes
+#include <algorithm>
+#include <cmath>
+
+// System Includes
+#include <getopt.h>
+#include <mach/mach_time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#pragma clang assume_nonnull begin
+
+static const Float64 kSampleRates[]         = { 44100.0, 48000.0, 96000.0 };
+static const UInt64 kMinFrames              = 1000000000;
+// Every frame at the start and end of the run is checked, not just every step frames, so rounding
+// at each frame boundary is covered after the clock has been running for a long time.
+static const UInt64 kDenseFrames            = 1 << 20;
+// How far the clock is sampled after the run, and at how many sample times.
+static const UInt64 kLongRunDays            = 180;
+static const UInt64 kLongRunSamples         = 1000000;
+
+struct RDC_DriftResult
+{
+    UInt64                  mChecks = 0;
+    UInt64                  mFailures = 0;
+    // The largest difference between the clock and the exact host time.
+    UInt64                  mMaxDriftTicks = 0;
+    // The same for a Float64 ticks-per-frame ratio.
+    Float64                 mMaxFloat64DriftTicks = 0.0;
+};
+
+// The host time of inSampleTime, calculated from scratch rather than with the clock's reduced
+// fraction: sample time * NSEC_PER_SEC * denom / (rate * numer), rounded down.
+static UInt64 RDC_GetExactHostTime(UInt64 inAnchorHostTime,
+                                   UInt64 inSampleTime,
+                                   UInt64 inSampleRate,
+                                   const mach_timebase_info_data_t& inTimebaseInfo)
+{
+    unsigned __int128 theNumerator =
+            static_cast<unsigned __int128>(inSampleTime) * NSEC_PER_SEC * inTimebaseInfo.denom;
+    unsigned __int128 theDenominator = static_cast<unsigned __int128>(inSampleRate) * inTimebaseInfo.numer;
+    return inAnchorHostTime + static_cast<UInt64>(theNumerator / theDenominator);
+}
+
+static void RDC_Check(RDC_LoopbackClock& ioClock,
+                      UInt64 inSampleTime,
+                      UInt64 inSampleRate,
+                      const mach_timebase_info_data_t& inTimebaseInfo,
+                      UInt64& ioLastHostTime,
+                      RDC_DriftResult& ioResult)
+{
+    UInt64 theAnchorHostTime = ioClock.GetAnchorHostTime();
+    UInt64 theHostTime = ioClock.GetHostTimeForSampleTime(inSampleTime);
+    UInt64 theExactHostTime = RDC_GetExactHostTime(theAnchorHostTime, inSampleTime, inSampleRate, inTimebaseInfo);
+    UInt64 theDrift = (theHostTime > theExactHostTime) ? theHostTime - theExactHostTime : theExactHostTime - theHostTime;
+
+    Float64 theFloat64HostTime = static_cast<Float64>(theAnchorHostTime) +
+                                 static_cast<Float64>(inSampleTime) * ioClock.GetHostTicksPerFrame();
+    Float64 theFloat64Drift = std::fabs(theFloat64HostTime - static_cast<Float64>(theExactHostTime));
+
+    bool isIncreasing = (ioLastHostTime == 0) || (theHostTime > ioLastHostTime);
+    bool isInverseExact = (ioClock.GetSampleTimeForHostTime(theHostTime) == inSampleTime) &&
+                          (inSampleTime == 0 || ioClock.GetSampleTimeForHostTime(theHostTime - 1) == inSampleTime - 1);
+
+    ioClock.SetAnchor(inSampleTime, theHostTime);
+    bool isAnchorStable = (ioClock.GetAnchorHostTime() == theAnchorHostTime);
+
+    if((theDrift != 0 || !isIncreasing || !isInverseExact || !isAnchorStable) && ioResult.mFailures++ == 0)
+    {
+        fprintf(stderr,
+                "RDCClockDriftTest: Sample time %llu at %llu Hz: host time %llu, expected %llu%s%s%s\n",
+                inSampleTime,
+                inSampleRate,
+                theHostTime,
+                theExactHostTime,
+                isIncreasing ? "" : ", not increasing",
+                isInverseExact ? "" : ", inverse doesn't match",
+                isAnchorStable ? "" : ", re-anchoring moved the clock");
+    }
+
+    ioLastHostTime = theHostTime;
+    ioResult.mChecks++;
+    ioResult.mMaxDriftTicks = std::max(ioResult.mMaxDriftTicks, theDrift);
+    ioResult.mMaxFloat64DriftTicks = std::max(ioResult.mMaxFloat64DriftTicks, theFloat64Drift);
+}
+
+static RDC_DriftResult RDC_TestSampleRate(Float64 inSampleRate, UInt64 inFrames, UInt64 inStepFrames)
+{
+    mach_timebase_info_data_t theTimebaseInfo;
+    mach_timebase_info(&theTimebaseInfo);
+
+    UInt64 theSampleRate = static_cast<UInt64>(inSampleRate);
+
+    RDC_LoopbackClock theClock;
+    theClock.SetSampleRate(inSampleRate);
+    // Start from the current host time, as the devices do, so the host times are realistic.
+    theClock.SetAnchor(0, mach_absolute_time());
+
+    RDC_DriftResult theResult;
+    UInt64 theLastHostTime = 0;
+
+    // The first frames, every frame.
+    for(UInt64 theSampleTime = 0; theSampleTime < kDenseFrames; theSampleTime++)
+    {
+        RDC_Check(theClock, theSampleTime, theSampleRate, theTimebaseInfo, theLastHostTime, theResult);
+    }
+
+    // The rest of the run, every step frames, as if the HAL were asking for an IO cycle's times.
+    for(UInt64 theSampleTime = kDenseFrames; theSampleTime + kDenseFrames < inFrames; theSampleTime += inStepFrames)
+    {
+        RDC_Check(theClock, theSampleTime, theSampleRate, theTimebaseInfo, theLastHostTime, theResult);
+    }
+
+    // The last frames, every frame.
+    for(UInt64 theSampleTime = inFrames - kDenseFrames; theSampleTime <= inFrames; theSampleTime++)
+    {
+        // The step loop may have already gone past the start of this range.
+        if(theClock.GetHostTimeForSampleTime(theSampleTime) > theLastHostTime)
+        {
+            RDC_Check(theClock, theSampleTime, theSampleRate, theTimebaseInfo, theLastHostTime, theResult);
+        }
+    }
+
+    // Then out to months. The stride is odd so the sample times don't all fall on the same
+    // rounding.
+    UInt64 theLongRunFrames = kLongRunDays * 24 * 60 * 60 * theSampleRate;
+    UInt64 theStride = (theLongRunFrames / kLongRunSamples) | 1;
+
+    for(UInt64 theSampleTime = inFrames + theStride; theSampleTime <= theLongRunFrames; theSampleTime += theStride)
+    {
+        RDC_Check(theClock, theSampleTime, theSampleRate, theTimebaseInfo, theLastHostTime, theResult);
+    }
+
+    return theResult;
+}
+
+static void RDC_PrintUsage()
+{
+    fprintf(stderr,
+            "Usage: RDCClockDriftTest [-f frames] [-s step frames]\n"
+            "  -f  The number of frames to run the clock for at each sample rate. At least and by\n"
+            "      default %llu.\n"
+            "  -s  How many frames apart the sample times checked during the run are, apart from\n"
+            "      the first and last %llu frames, which are all checked. 512 by default.\n",
+            kMinFrames,
+            kDenseFrames);
+}
+
+int main(int argc, char* __nullable argv[])
+{
+    UInt64 theFrames = kMinFrames;
+    UInt64 theStepFrames = 512;
+
+    int theOption;
+    while((theOption = getopt(argc, argv, "f:s:h")) != -1)
+    {
+        switch(theOption)
+        {
+            case 'f': theFrames = strtoull(optarg, nullptr, 10); break;
+            case 's': theStepFrames = strtoull(optarg, nullptr, 10); break;
+            default:
+                RDC_PrintUsage();
+                return (theOption == 'h') ? 0 : 2;
+        }
+    }
+
+    if(theFrames < kMinFrames || theStepFrames == 0)
+    {
+        RDC_PrintUsage();
+        return 2;
+    }
+
+    mach_timebase_info_data_t theTimebaseInfo;
+    mach_timebase_info(&theTimebaseInfo);
+
+    printf("Timebase:               %u/%u ns per tick\n", theTimebaseInfo.numer, theTimebaseInfo.denom);
+    printf("Frames:                 %llu, then sampled out to %llu days\n\n", theFrames, kLongRunDays);
+
+    bool hasFailed = false;
+
+    for(Float64 theSampleRate : kSampleRates)
+    {
+        RDC_DriftResult theResult = RDC_TestSampleRate(theSampleRate, theFrames, theStepFrames);
+
+        printf("%6.0f Hz: %llu checks, max drift %llu ticks (Float64 ratio: %.0f ticks), %llu failures\n",
+               theSampleRate,
+               theResult.mChecks,
+               theResult.mMaxDriftTicks,
+               theResult.mMaxFloat64DriftTicks,
+               theResult.mFailures);
+
+        hasFailed = hasFailed || theResult.mFailures != 0;
+    }
+
+    if(hasFailed)
+    {
+        printf("\nFAILED: The clock drifted or wasn't monotonic.\n");
+        return 1;
+    }
+
+    printf("\nOK: No drift, and the host and sample times only increase.\n");
+    return 0;
+}
+
+#pragma clang assume_nonnull end
+
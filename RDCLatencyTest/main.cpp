@@ -0,0 +1,591 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  main.cpp
+//  RDCLatencyTest
+//
+//  Measures the real output-to-input latency through RDCDevice. It plays a maximum length sequence
+//  (or a single impulse) into the device's output from an IOProc, captures the device's input in
+//  the same IOProc, and cross-correlates the two to find where the sequence came back. That's
+//  repeated for a number of runs and the latency and jitter are reported, along with whether they
+//  match the Latency and SafetyOffset values the device reports.
+//
+//  The measurement has two parts:
+//    - The offset: how many frames after the output sample time it was written at the sequence
+//      appears at on the input timeline. If the device's reported latencies are right, this is the
+//      output latency plus the input latency, since a frame presented at T + output latency is
+//      captured at T + output latency and stamped with that time plus the input latency.
+//    - The IO cycle span: how far apart the HAL puts the input and output times of an IO cycle,
+//      which should be both safety offsets plus the input and output buffers.
+//  The round trip an app doing both input and output sees is their sum.
+//
+//  Usage: RDCLatencyTest [-d device UID] [-b IO buffer frames] [-r loopback buffer frames]
+//                        [-n runs] [-i] [-t tolerance frames]
+//
+//  Exits with status 1 if the measured offset doesn't match the reported latencies to within the
+//  tolerance, or the sequence wasn't found.
+//
+
+// Local Includes
+#include "RDC_Types.h"
+
+// STL Includes
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// System Includes
+#include <Accelerate/Accelerate.h>
+#include <CoreAudio/CoreAudio.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+#pragma clang assume_nonnull begin
+
+// The MLS is 2^12 - 1 frames, about 85 ms at 48 kHz, which is long enough to be found under other
+// audio but short enough that the runs don't take long.
+static const UInt32 kMLSOrder               = 12;
+// The feedback taps of a Galois LFSR for x^12 + x^6 + x^4 + x + 1, a primitive polynomial.
+static const UInt32 kMLSFeedbackMask        = 0x829;
+// Loud enough to stand out, quiet enough not to clip if something else is playing.
+static const Float32 kSignalAmplitude       = 0.5f;
+// The longest latency that can be measured.
+static const Float64 kMaxLatencySeconds     = 1.0;
+// How much higher than the RMS of the rest of the cross-correlation its peak has to be.
+static const Float32 kMinPeakToRMSRatio     = 8.0f;
+static const useconds_t kRunIntervalMicros  = 50000;
+static const useconds_t kRunTimeoutMicros   = 5000000;
+static const useconds_t kPollIntervalMicros = 1000;
+
+enum RDC_RunPhase : int
+{
+    // Waiting for the next run.
+    kRDCRunPhase_Idle,
+    // The IOProc starts the run in its next cycle.
+    kRDCRunPhase_Armed,
+    kRDCRunPhase_Running,
+    kRDCRunPhase_Done,
+    // The input skipped, e.g. because of an overload, so the capture can't be used.
+    kRDCRunPhase_Failed
+};
+
+// Shared by the main thread and the IOProc. The main thread only touches the other members while
+// mPhase is Idle, Done or Failed, and the IOProc only while it's Armed or Running.
+struct RDC_Measurement
+{
+    std::atomic<int>        mPhase { kRDCRunPhase_Idle };
+
+    std::vector<Float32>    mSignal;
+    std::vector<Float32>    mCapture;
+
+    // The output sample time the first frame of the signal was written at.
+    Float64                 mOutputStartTime = 0.0;
+    // The input sample time of the first captured frame.
+    Float64                 mCaptureStartTime = 0.0;
+    // The input sample time the next captured frame should have.
+    Float64                 mNextCaptureTime = 0.0;
+    // The output time minus the input time of the cycle the run started in.
+    Float64                 mCycleSpan = 0.0;
+    size_t                  mFramesPlayed = 0;
+    size_t                  mFramesCaptured = 0;
+};
+
+static void RDC_CheckError(OSStatus inError, const char* inOperation)
+{
+    if(inError != kAudioHardwareNoError)
+    {
+        fprintf(stderr, "RDCLatencyTest: %s failed (%d)\n", inOperation, static_cast<int>(inError));
+        exit(2);
+    }
+}
+
+template <typename T>
+static T RDC_GetProperty(AudioObjectID inObjectID,
+                         AudioObjectPropertySelector inSelector,
+                         AudioObjectPropertyScope inScope = kAudioObjectPropertyScopeGlobal)
+{
+    AudioObjectPropertyAddress theAddress = { inSelector, inScope, kAudioObjectPropertyElementMaster };
+    T theValue = T();
+    UInt32 theSize = sizeof(T);
+    RDC_CheckError(AudioObjectGetPropertyData(inObjectID, &theAddress, 0, nullptr, &theSize, &theValue),
+                   "AudioObjectGetPropertyData");
+    return theValue;
+}
+
+template <typename T>
+static void RDC_SetProperty(AudioObjectID inObjectID, AudioObjectPropertySelector inSelector, T inValue)
+{
+    AudioObjectPropertyAddress theAddress = { inSelector, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster };
+    RDC_CheckError(AudioObjectSetPropertyData(inObjectID, &theAddress, 0, nullptr, sizeof(T), &inValue),
+                   "AudioObjectSetPropertyData");
+}
+
+static AudioObjectID RDC_FindDevice(const char* inUID)
+{
+    CFStringRef theUID = CFStringCreateWithCString(kCFAllocatorDefault, inUID, kCFStringEncodingUTF8);
+    AudioObjectID theDeviceID = kAudioObjectUnknown;
+
+    AudioValueTranslation theTranslation = { &theUID, sizeof(CFStringRef), &theDeviceID, sizeof(AudioObjectID) };
+    AudioObjectPropertyAddress theAddress = {
+        kAudioHardwarePropertyDeviceForUID,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMaster
+    };
+    UInt32 theSize = sizeof(theTranslation);
+    RDC_CheckError(AudioObjectGetPropertyData(kAudioObjectSystemObject, &theAddress, 0, nullptr, &theSize, &theTranslation),
+                   "kAudioHardwarePropertyDeviceForUID");
+
+    CFRelease(theUID);
+    return theDeviceID;
+}
+
+// The latency of the device's first stream in inScope, which the HAL adds to the device's.
+static UInt32 RDC_GetFirstStreamLatency(AudioObjectID inDeviceID, AudioObjectPropertyScope inScope)
+{
+    AudioObjectPropertyAddress theAddress = { kAudioDevicePropertyStreams, inScope, kAudioObjectPropertyElementMaster };
+    AudioObjectID theStreams[4] = {};
+    UInt32 theSize = sizeof(theStreams);
+    RDC_CheckError(AudioObjectGetPropertyData(inDeviceID, &theAddress, 0, nullptr, &theSize, theStreams),
+                   "kAudioDevicePropertyStreams");
+
+    return (theSize >= sizeof(AudioObjectID)) ? RDC_GetProperty<UInt32>(theStreams[0], kAudioStreamPropertyLatency) : 0;
+}
+
+static UInt32 RDC_GetLoopbackBufferFrameSize(AudioObjectID inDeviceID)
+{
+    CFNumberRef theNumber = RDC_GetProperty<CFNumberRef>(inDeviceID, kAudioDeviceCustomPropertyLoopbackBufferFrameSize);
+    SInt32 theFrameSize = 0;
+    CFNumberGetValue(theNumber, kCFNumberSInt32Type, &theFrameSize);
+    CFRelease(theNumber);
+    return static_cast<UInt32>(theFrameSize);
+}
+
+static void RDC_SetLoopbackBufferFrameSize(AudioObjectID inDeviceID, UInt32 inFrameSize)
+{
+    SInt32 theFrameSize = static_cast<SInt32>(inFrameSize);
+    CFNumberRef theNumber = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &theFrameSize);
+    RDC_SetProperty<CFNumberRef>(inDeviceID, kAudioDeviceCustomPropertyLoopbackBufferFrameSize, theNumber);
+    CFRelease(theNumber);
+
+    // The device applies it asynchronously, so wait for it.
+    for(useconds_t theWaited = 0; theWaited < kRunTimeoutMicros; theWaited += kPollIntervalMicros)
+    {
+        if(RDC_GetLoopbackBufferFrameSize(inDeviceID) == inFrameSize)
+        {
+            return;
+        }
+
+        usleep(kPollIntervalMicros);
+    }
+
+    fprintf(stderr, "RDCLatencyTest: The device didn't apply the loopback buffer frame size\n");
+    exit(2);
+}
+
+static std::vector<Float32> RDC_MakeMLS()
+{
+    std::vector<Float32> theSequence((1U << kMLSOrder) - 1);
+    UInt32 theState = 1;
+
+    for(Float32& theFrame : theSequence)
+    {
+        theFrame = (theState & 1) ? kSignalAmplitude : -kSignalAmplitude;
+        theState = (theState >> 1) ^ ((theState & 1) ? kMLSFeedbackMask : 0);
+    }
+
+    return theSequence;
+}
+
+static OSStatus RDC_IOProc(AudioObjectID inDevice,
+                           const AudioTimeStamp* inNow,
+                           const AudioBufferList* inInputData,
+                           const AudioTimeStamp* inInputTime,
+                           AudioBufferList* outOutputData,
+                           const AudioTimeStamp* inOutputTime,
+                           void* __nullable inClientData)
+{
+    #pragma unused (inDevice, inNow)
+
+    RDC_Measurement& theMeasurement = *static_cast<RDC_Measurement*>(inClientData);
+
+    for(UInt32 i = 0; i < outOutputData->mNumberBuffers; i++)
+    {
+        memset(outOutputData->mBuffers[i].mData, 0, outOutputData->mBuffers[i].mDataByteSize);
+    }
+
+    int thePhase = theMeasurement.mPhase.load(std::memory_order_acquire);
+
+    if(thePhase == kRDCRunPhase_Armed)
+    {
+        theMeasurement.mOutputStartTime = inOutputTime->mSampleTime;
+        theMeasurement.mCaptureStartTime = inInputTime->mSampleTime;
+        theMeasurement.mNextCaptureTime = inInputTime->mSampleTime;
+        theMeasurement.mCycleSpan = inOutputTime->mSampleTime - inInputTime->mSampleTime;
+        theMeasurement.mFramesPlayed = 0;
+        theMeasurement.mFramesCaptured = 0;
+        thePhase = kRDCRunPhase_Running;
+        theMeasurement.mPhase.store(thePhase, std::memory_order_relaxed);
+    }
+
+    if(thePhase != kRDCRunPhase_Running ||
+       inInputData->mNumberBuffers == 0 ||
+       outOutputData->mNumberBuffers == 0)
+    {
+        return kAudioHardwareNoError;
+    }
+
+    // Write the next part of the signal to every channel of the output.
+    const AudioBuffer& theOutput = outOutputData->mBuffers[0];
+    UInt32 theOutputChannels = std::max(theOutput.mNumberChannels, 1U);
+    UInt32 theOutputFrames = theOutput.mDataByteSize / (theOutputChannels * sizeof(Float32));
+    size_t theFramesToPlay = std::min(static_cast<size_t>(theOutputFrames),
+                                      theMeasurement.mSignal.size() - theMeasurement.mFramesPlayed);
+
+    for(UInt32 i = 0; i < outOutputData->mNumberBuffers; i++)
+    {
+        Float32* theFrames = static_cast<Float32*>(outOutputData->mBuffers[i].mData);
+        UInt32 theChannels = std::max(outOutputData->mBuffers[i].mNumberChannels, 1U);
+
+        for(size_t theFrame = 0; theFrame < theFramesToPlay; theFrame++)
+        {
+            std::fill_n(theFrames + theFrame * theChannels,
+                        theChannels,
+                        theMeasurement.mSignal[theMeasurement.mFramesPlayed + theFrame]);
+        }
+    }
+
+    theMeasurement.mFramesPlayed += theFramesToPlay;
+
+    // Capture the first channel of the input.
+    if(inInputTime->mSampleTime != theMeasurement.mNextCaptureTime)
+    {
+        theMeasurement.mPhase.store(kRDCRunPhase_Failed, std::memory_order_release);
+        return kAudioHardwareNoError;
+    }
+
+    const AudioBuffer& theInput = inInputData->mBuffers[0];
+    UInt32 theInputChannels = std::max(theInput.mNumberChannels, 1U);
+    UInt32 theInputFrames = theInput.mDataByteSize / (theInputChannels * sizeof(Float32));
+    size_t theFramesToCapture = std::min(static_cast<size_t>(theInputFrames),
+                                         theMeasurement.mCapture.size() - theMeasurement.mFramesCaptured);
+
+    cblas_scopy(static_cast<int>(theFramesToCapture),
+                static_cast<const Float32*>(theInput.mData),
+                static_cast<int>(theInputChannels),
+                theMeasurement.mCapture.data() + theMeasurement.mFramesCaptured,
+                1);
+
+    theMeasurement.mFramesCaptured += theFramesToCapture;
+    theMeasurement.mNextCaptureTime += theInputFrames;
+
+    if(theMeasurement.mFramesCaptured == theMeasurement.mCapture.size())
+    {
+        theMeasurement.mPhase.store(kRDCRunPhase_Done, std::memory_order_release);
+    }
+
+    return kAudioHardwareNoError;
+}
+
+// Cross-correlate the capture with the signal. Returns the lag of the peak in frames, or -1 if
+// there's no clear peak.
+static SInt64 RDC_FindSignal(const RDC_Measurement& inMeasurement)
+{
+    size_t theLags = inMeasurement.mCapture.size() - inMeasurement.mSignal.size() + 1;
+    std::vector<Float32> theCorrelation(theLags);
+
+    // vDSP_conv correlates when the filter stride is positive.
+    vDSP_conv(inMeasurement.mCapture.data(),
+              1,
+              inMeasurement.mSignal.data(),
+              1,
+              theCorrelation.data(),
+              1,
+              theLags,
+              inMeasurement.mSignal.size());
+
+    Float32 thePeak = 0.0f;
+    vDSP_Length thePeakIndex = 0;
+    vDSP_maxmgvi(theCorrelation.data(), 1, &thePeak, &thePeakIndex, theLags);
+
+    Float32 theRMS = 0.0f;
+    vDSP_rmsqv(theCorrelation.data(), 1, &theRMS, theLags);
+
+    if(thePeak == 0.0f || thePeak < theRMS * kMinPeakToRMSRatio)
+    {
+        return -1;
+    }
+
+    return static_cast<SInt64>(thePeakIndex);
+}
+
+struct RDC_Stats
+{
+    Float64 mMin;
+    Float64 mMax;
+    Float64 mMean;
+    Float64 mStdDev;
+};
+
+static RDC_Stats RDC_GetStats(const std::vector<Float64>& inValues)
+{
+    RDC_Stats theStats = { inValues[0], inValues[0], 0.0, 0.0 };
+
+    for(Float64 theValue : inValues)
+    {
+        theStats.mMin = std::min(theStats.mMin, theValue);
+        theStats.mMax = std::max(theStats.mMax, theValue);
+        theStats.mMean += theValue / inValues.size();
+    }
+
+    for(Float64 theValue : inValues)
+    {
+        theStats.mStdDev += (theValue - theStats.mMean) * (theValue - theStats.mMean) / inValues.size();
+    }
+
+    theStats.mStdDev = std::sqrt(theStats.mStdDev);
+
+    return theStats;
+}
+
+static void RDC_PrintStats(const char* inName, const std::vector<Float64>& inValues, Float64 inSampleRate)
+{
+    RDC_Stats theStats = RDC_GetStats(inValues);
+    printf("%-22s mean %9.2f  min %7.0f  max %7.0f  stddev %7.2f frames  (mean %.3f ms, jitter %.3f ms)\n",
+           inName,
+           theStats.mMean,
+           theStats.mMin,
+           theStats.mMax,
+           theStats.mStdDev,
+           theStats.mMean * 1000.0 / inSampleRate,
+           (theStats.mMax - theStats.mMin) * 1000.0 / inSampleRate);
+}
+
+static void RDC_PrintUsage()
+{
+    fprintf(stderr,
+            "Usage: RDCLatencyTest [-d device UID] [-b IO buffer frames] [-r loopback buffer frames]\n"
+            "                      [-n runs] [-i] [-t tolerance frames]\n"
+            "  -d  The UID of the device to measure. \"%s\" by default.\n"
+            "  -b  Set the device's IO buffer frame size first.\n"
+            "  -r  Set the device's loopback buffer frame size first.\n"
+            "  -n  The number of runs. 100 by default.\n"
+            "  -i  Play a single impulse instead of a maximum length sequence.\n"
+            "  -t  How far the measured offset can be from the reported latencies. 1 frame by default.\n",
+            kRDCDeviceUID);
+}
+
+int main(int argc, char* __nullable argv[])
+{
+    const char* theDeviceUID = kRDCDeviceUID;
+    UInt32 theIOBufferFrameSize = 0;
+    UInt32 theLoopbackBufferFrameSize = 0;
+    UInt32 theRuns = 100;
+    bool usesImpulse = false;
+    Float64 theTolerance = 1.0;
+
+    int theOption;
+    while((theOption = getopt(argc, argv, "d:b:r:n:it:h")) != -1)
+    {
+        switch(theOption)
+        {
+            case 'd': theDeviceUID = optarg; break;
+            case 'b': theIOBufferFrameSize = static_cast<UInt32>(strtoul(optarg, nullptr, 10)); break;
+            case 'r': theLoopbackBufferFrameSize = static_cast<UInt32>(strtoul(optarg, nullptr, 10)); break;
+            case 'n': theRuns = static_cast<UInt32>(strtoul(optarg, nullptr, 10)); break;
+            case 'i': usesImpulse = true; break;
+            case 't': theTolerance = strtod(optarg, nullptr); break;
+            default:
+                RDC_PrintUsage();
+                return (theOption == 'h') ? 0 : 2;
+        }
+    }
+
+    if(theRuns == 0)
+    {
+        RDC_PrintUsage();
+        return 2;
+    }
+
+    AudioObjectID theDeviceID = RDC_FindDevice(theDeviceUID);
+
+    if(theDeviceID == kAudioObjectUnknown)
+    {
+        fprintf(stderr, "RDCLatencyTest: No device with UID \"%s\"\n", theDeviceUID);
+        return 2;
+    }
+
+    // Set these first, since they can change the latencies the device reports.
+    if(theIOBufferFrameSize != 0)
+    {
+        RDC_SetProperty<UInt32>(theDeviceID, kAudioDevicePropertyBufferFrameSize, theIOBufferFrameSize);
+    }
+
+    if(theLoopbackBufferFrameSize != 0)
+    {
+        RDC_SetLoopbackBufferFrameSize(theDeviceID, theLoopbackBufferFrameSize);
+    }
+
+    Float64 theSampleRate = RDC_GetProperty<Float64>(theDeviceID, kAudioDevicePropertyNominalSampleRate);
+    UInt32 theBufferFrameSize = RDC_GetProperty<UInt32>(theDeviceID, kAudioDevicePropertyBufferFrameSize);
+    UInt32 theOutputLatency = RDC_GetProperty<UInt32>(theDeviceID, kAudioDevicePropertyLatency, kAudioObjectPropertyScopeOutput) +
+                              RDC_GetFirstStreamLatency(theDeviceID, kAudioObjectPropertyScopeOutput);
+    UInt32 theInputLatency = RDC_GetProperty<UInt32>(theDeviceID, kAudioDevicePropertyLatency, kAudioObjectPropertyScopeInput) +
+                             RDC_GetFirstStreamLatency(theDeviceID, kAudioObjectPropertyScopeInput);
+    UInt32 theOutputSafetyOffset = RDC_GetProperty<UInt32>(theDeviceID, kAudioDevicePropertySafetyOffset, kAudioObjectPropertyScopeOutput);
+    UInt32 theInputSafetyOffset = RDC_GetProperty<UInt32>(theDeviceID, kAudioDevicePropertySafetyOffset, kAudioObjectPropertyScopeInput);
+
+    printf("Device:                 %s (%.0f Hz)\n", theDeviceUID, theSampleRate);
+    printf("IO buffer:              %u frames\n", theBufferFrameSize);
+    printf("Loopback buffer:        %u frames\n", RDC_GetLoopbackBufferFrameSize(theDeviceID));
+    printf("Reported latency:       output %u, input %u frames\n", theOutputLatency, theInputLatency);
+    printf("Reported safety offset: output %u, input %u frames\n", theOutputSafetyOffset, theInputSafetyOffset);
+    printf("Signal:                 %s, %u runs\n\n", usesImpulse ? "impulse" : "MLS", theRuns);
+
+    RDC_Measurement theMeasurement;
+
+    if(usesImpulse)
+    {
+        theMeasurement.mSignal.assign(1, kSignalAmplitude);
+    }
+    else
+    {
+        theMeasurement.mSignal = RDC_MakeMLS();
+    }
+
+    // The capture starts at the input time of the cycle the signal starts playing in, so it has to
+    // cover that cycle's span as well as the latency.
+    theMeasurement.mCapture.resize(theMeasurement.mSignal.size() +
+                                   static_cast<size_t>(theSampleRate * kMaxLatencySeconds));
+
+    AudioDeviceIOProcID theIOProcID = nullptr;
+    RDC_CheckError(AudioDeviceCreateIOProcID(theDeviceID, RDC_IOProc, &theMeasurement, &theIOProcID),
+                   "AudioDeviceCreateIOProcID");
+    RDC_CheckError(AudioDeviceStart(theDeviceID, theIOProcID), "AudioDeviceStart");
+
+    // Let IO settle before the first run.
+    usleep(kRunIntervalMicros * 10);
+
+    std::vector<Float64> theOffsets;
+    std::vector<Float64> theCycleSpans;
+    std::vector<Float64> theRoundTrips;
+    UInt32 theMissedRuns = 0;
+    UInt32 theFailedRuns = 0;
+
+    for(UInt32 theRun = 0; theRun < theRuns; theRun++)
+    {
+        theMeasurement.mPhase.store(kRDCRunPhase_Armed, std::memory_order_release);
+
+        int thePhase = kRDCRunPhase_Armed;
+        for(useconds_t theWaited = 0;
+            theWaited < kRunTimeoutMicros &&
+                (thePhase == kRDCRunPhase_Armed || thePhase == kRDCRunPhase_Running);
+            theWaited += kPollIntervalMicros)
+        {
+            usleep(kPollIntervalMicros);
+            thePhase = theMeasurement.mPhase.load(std::memory_order_acquire);
+        }
+
+        if(thePhase != kRDCRunPhase_Done)
+        {
+            if(thePhase != kRDCRunPhase_Failed)
+            {
+                fprintf(stderr, "RDCLatencyTest: Timed out waiting for IO\n");
+                AudioDeviceStop(theDeviceID, theIOProcID);
+                AudioDeviceDestroyIOProcID(theDeviceID, theIOProcID);
+                return 2;
+            }
+
+            theFailedRuns++;
+        }
+        else
+        {
+            SInt64 theLag = RDC_FindSignal(theMeasurement);
+
+            if(theLag < 0)
+            {
+                theMissedRuns++;
+            }
+            else
+            {
+                Float64 theOffset =
+                        theMeasurement.mCaptureStartTime + theLag - theMeasurement.mOutputStartTime;
+                theOffsets.push_back(theOffset);
+                theCycleSpans.push_back(theMeasurement.mCycleSpan);
+                theRoundTrips.push_back(theOffset + theMeasurement.mCycleSpan);
+            }
+        }
+
+        theMeasurement.mPhase.store(kRDCRunPhase_Idle, std::memory_order_release);
+        usleep(kRunIntervalMicros);
+    }
+
+    AudioDeviceStop(theDeviceID, theIOProcID);
+    AudioDeviceDestroyIOProcID(theDeviceID, theIOProcID);
+
+    if(theFailedRuns > 0)
+    {
+        printf("%u runs were discarded because the input skipped.\n", theFailedRuns);
+    }
+
+    if(theMissedRuns > 0)
+    {
+        printf("The signal wasn't found in %u runs. Is the device muted or its volume down?\n", theMissedRuns);
+    }
+
+    if(theOffsets.empty())
+    {
+        fprintf(stderr, "RDCLatencyTest: No successful runs\n");
+        return 1;
+    }
+
+    RDC_PrintStats("Offset:", theOffsets, theSampleRate);
+    RDC_PrintStats("IO cycle span:", theCycleSpans, theSampleRate);
+    RDC_PrintStats("Round trip:", theRoundTrips, theSampleRate);
+
+    Float64 theExpectedOffset = theOutputLatency + theInputLatency;
+    Float64 theExpectedCycleSpan = theOutputSafetyOffset + theInputSafetyOffset + 2.0 * theBufferFrameSize;
+    Float64 theMeanOffset = RDC_GetStats(theOffsets).mMean;
+    Float64 theMeanCycleSpan = RDC_GetStats(theCycleSpans).mMean;
+
+    printf("\nExpected offset:        %.0f frames (output latency + input latency)\n", theExpectedOffset);
+    printf("Expected IO cycle span: %.0f frames (safety offsets + 2 * IO buffer)\n", theExpectedCycleSpan);
+
+    // The HAL can add to the cycle span, e.g. for its IO cycle usage setting, so it's only reported.
+    if(theMeanCycleSpan < theExpectedCycleSpan)
+    {
+        printf("Warning: The IO cycle span is shorter than the safety offsets and buffers add up to.\n");
+    }
+
+    if(std::fabs(theMeanOffset - theExpectedOffset) > theTolerance)
+    {
+        printf("MISMATCH: The measured offset is %.2f frames %s the reported latencies.\n",
+               std::fabs(theMeanOffset - theExpectedOffset),
+               (theMeanOffset > theExpectedOffset) ? "more than" : "less than");
+        return 1;
+    }
+
+    printf("OK: The measured offset matches the reported latencies.\n");
+    return 0;
+}
+
+#pragma clang assume_nonnull end
+
@@ -0,0 +1,569 @@
+// This file is part of Background Music.
+//
+// Background Music is free software: you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation, either version 2 of the
+// License, or (at your option) any later version.
+//
+// Background Music is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Background Music. If not, see <http://www.gnu.org/licenses/>.
+
+//
+//  main.cpp
+//  RDCRingBufferBenchmark
+//
+//  Times CARingBuffer's operations the way RDC_Device uses them: Float32 frames, interleaved in a
+//  buffer allocated with one channel. Each operation is timed on its own, so the tail latencies are
+//  reported along with the mean, for each IO buffer size from 16 to 4096 frames and each channel
+//  count. The cases are:
+//    - store, fetch:             Store and Fetch through an AudioBufferList.
+//    - write_region, read_region: BeginWrite/EndWrite and BeginRead/EndRead, copying the frames to
+//                                or from the regions in place, which is what the device does.
+//  Each is run with the frames at the start of the buffer ("aligned") and straddling its end
+//  ("wrapped"), so every operation is split into two ranges. The buffer holds exactly one
+//  operation's frames, which is the smallest it can be and makes every operation wrap, or not.
+//    - store, gap:               Store after a gap of the same number of frames, which records a
+//                                hole instead of zeroing the gap.
+//    - fetch, hole:              Fetch half from the hole and half from stored frames, so half is
+//                                zero-filled.
+//    - store/fetch/write_region/read_region, concurrent:
+//                                Fetch (or BeginRead) on one thread while another Stores (or
+//                                BeginWrites) as fast as it can, both timed. A read the writer
+//                                overwrote fails with kCARingBufferError_CPUOverload and is
+//                                counted in the errors column.
+//
+//  The output is CSV, one line per case, with the times in nanoseconds. Timing each operation adds
+//  the cost of reading the host clock twice, tens of nanoseconds at most, to it.
+//
+//  With -m, only the cases for the smallest IO buffer size RDCDevice allows, kRDCMinIOBufferFrameSize,
+//  are run, and each one's cost is shown as a share of an IO cycle of that size instead.
+//
+//  Usage: RDCRingBufferBenchmark [-n operations] [-b frames] [-c channels] [-m]
+//
+//  Exits with status 1 if an operation that shouldn't fail does.
+//
+
+// Local Includes
+#include "RDC_Types.h"
+
+// PublicUtility Includes
+#include "CARingBuffer.h"
+
+// STL Includes
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// System Includes
+#include <getopt.h>
+#include <mach/mach_time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#pragma clang assume_nonnull begin
+
+static const UInt32 kFrameSizes[]           = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+static const UInt32 kChannelCounts[]        = { 1, 2, 8 };
+// Operations not timed before each case, so it starts with warm caches.
+static const UInt32 kWarmUpOperations       = 1000;
+// Big enough for four operations of the largest size, so the concurrent reader can stay clear of
+// the frames being written.
+static const UInt32 kConcurrentCapacityFrames = 16384;
+
+struct RDC_Timings
+{
+    std::vector<UInt64>     mTicks;
+    UInt64                  mErrors = 0;
+};
+
+// Reads the operations' frames from and writes them to the buffer. The contents don't matter.
+struct RDC_Case
+{
+    CARingBuffer            mRingBuffer;
+    UInt32                  mFrames = 0;
+    UInt32                  mBytesPerFrame = 0;
+    std::vector<Float32>    mSource;
+    std::vector<Float32>    mDestination;
+    // Separate, since the writer and reader can be on different threads.
+    AudioBufferList         mSourceList;
+    AudioBufferList         mDestinationList;
+
+    RDC_Case(UInt32 inChannels, UInt32 inFrames, UInt32 inCapacityFrames)
+    :
+        mFrames(inFrames),
+        mBytesPerFrame(inChannels * sizeof(Float32)),
+        mSource(inChannels * inFrames, 0.25f),
+        mDestination(inChannels * inFrames)
+    {
+        mRingBuffer.Allocate(1, mBytesPerFrame, inCapacityFrames);
+
+        for(AudioBufferList* theList : { &mSourceList, &mDestinationList })
+        {
+            theList->mNumberBuffers = 1;
+            theList->mBuffers[0].mNumberChannels = inChannels;
+        }
+
+        mSourceList.mBuffers[0].mData = mSource.data();
+        mDestinationList.mBuffers[0].mData = mDestination.data();
+    }
+
+    CARingBufferError Store(CARingBuffer::SampleTime inTime)
+    {
+        mSourceList.mBuffers[0].mDataByteSize = mFrames * mBytesPerFrame;
+        return mRingBuffer.Store(&mSourceList, mFrames, inTime);
+    }
+
+    CARingBufferError Fetch(CARingBuffer::SampleTime inTime)
+    {
+        // Fetch changes mDataByteSize, so it's set each time.
+        mDestinationList.mBuffers[0].mDataByteSize = mFrames * mBytesPerFrame;
+        return mRingBuffer.Fetch(&mDestinationList, mFrames, inTime);
+    }
+
+    CARingBufferError WriteRegions(CARingBuffer::SampleTime inTime)
+    {
+        CARingBuffer::Regions theRegions;
+        CARingBufferError err = mRingBuffer.BeginWrite(mFrames, inTime, theRegions);
+
+        if(err == kCARingBufferError_OK)
+        {
+            const Byte* theIn = reinterpret_cast<const Byte*>(mSource.data());
+
+            for(int theRegion = 0; theRegion < 2; theRegion++)
+            {
+                UInt32 theBytes = theRegions.nFrames[theRegion] * mBytesPerFrame;
+                memcpy(mRingBuffer.RegionData(theRegions, theRegion, 0), theIn, theBytes);
+                theIn += theBytes;
+            }
+
+            mRingBuffer.EndWrite(theRegions);
+        }
+
+        return err;
+    }
+
+    CARingBufferError ReadRegions(CARingBuffer::SampleTime inTime)
+    {
+        CARingBuffer::Regions theRegions;
+        CARingBufferError err = mRingBuffer.BeginRead(mFrames, inTime, theRegions);
+
+        if(err == kCARingBufferError_OK)
+        {
+            Byte* theOut = reinterpret_cast<Byte*>(mDestination.data());
+
+            memset(theOut, 0, theRegions.leadingFrames * mBytesPerFrame);
+            theOut += theRegions.leadingFrames * mBytesPerFrame;
+
+            for(int theRegion = 0; theRegion < 2; theRegion++)
+            {
+                UInt32 theBytes = theRegions.nFrames[theRegion] * mBytesPerFrame;
+                memcpy(theOut, mRingBuffer.RegionData(theRegions, theRegion, 0), theBytes);
+                theOut += theBytes;
+            }
+
+            memset(theOut, 0, theRegions.trailingFrames * mBytesPerFrame);
+            err = mRingBuffer.EndRead(theRegions);
+        }
+
+        return err;
+    }
+};
+
+// Runs inOperation(i) for i = 0 to inOperations - 1 after warming up, timing each call.
+template <typename Operation>
+static RDC_Timings RDC_Time(UInt32 inOperations, const Operation& inOperation)
+{
+    RDC_Timings theTimings;
+    theTimings.mTicks.reserve(inOperations);
+
+    for(UInt32 i = 0; i < kWarmUpOperations; i++)
+    {
+        inOperation(i);
+    }
+
+    for(UInt32 i = kWarmUpOperations; i < kWarmUpOperations + inOperations; i++)
+    {
+        UInt64 theStartTime = mach_absolute_time();
+        CARingBufferError err = inOperation(i);
+        theTimings.mTicks.push_back(mach_absolute_time() - theStartTime);
+
+        if(err != kCARingBufferError_OK)
+        {
+            theTimings.mErrors++;
+        }
+    }
+
+    return theTimings;
+}
+
+static Float64 RDC_TicksToNanos(Float64 inTicks)
+{
+    static mach_timebase_info_data_t sTimebaseInfo = []
+    {
+        mach_timebase_info_data_t theTimebaseInfo;
+        mach_timebase_info(&theTimebaseInfo);
+        return theTimebaseInfo;
+    }();
+
+    return inTicks * sTimebaseInfo.numer / sTimebaseInfo.denom;
+}
+
+// One case's times, in nanoseconds.
+struct RDC_Result
+{
+    const char*             mOperation;
+    const char*             mPosition;
+    UInt32                  mChannels;
+    UInt32                  mFrames;
+    size_t                  mOperations;
+    Float64                 mMean;
+    Float64                 mMedian;
+    Float64                 mP99;
+    Float64                 mP999;
+    Float64                 mMax;
+    UInt64                  mErrors;
+};
+
+static void RDC_AddResult(const char* inOperation,
+                          const char* inPosition,
+                          UInt32 inChannels,
+                          UInt32 inFrames,
+                          RDC_Timings& ioTimings,
+                          std::vector<RDC_Result>& ioResults)
+{
+    std::vector<UInt64>& theTicks = ioTimings.mTicks;
+    std::sort(theTicks.begin(), theTicks.end());
+
+    UInt64 theTotalTicks = 0;
+
+    for(UInt64 theOperationTicks : theTicks)
+    {
+        theTotalTicks += theOperationTicks;
+    }
+
+    auto thePercentile = [&theTicks](Float64 inFraction)
+    {
+        size_t theIndex = static_cast<size_t>(inFraction * (theTicks.size() - 1));
+        return RDC_TicksToNanos(theTicks[theIndex]);
+    };
+
+    ioResults.push_back({ inOperation,
+                          inPosition,
+                          inChannels,
+                          inFrames,
+                          theTicks.size(),
+                          RDC_TicksToNanos(static_cast<Float64>(theTotalTicks) / theTicks.size()),
+                          thePercentile(0.5),
+                          thePercentile(0.99),
+                          thePercentile(0.999),
+                          thePercentile(1.0),
+                          ioTimings.mErrors });
+}
+
+static void RDC_PrintCSV(const std::vector<RDC_Result>& inResults)
+{
+    printf("operation,position,channels,frames,operations,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,"
+           "frames_per_second,errors\n");
+
+    for(const RDC_Result& theResult : inResults)
+    {
+        printf("%s,%s,%u,%u,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f,%llu\n",
+               theResult.mOperation,
+               theResult.mPosition,
+               theResult.mChannels,
+               theResult.mFrames,
+               theResult.mOperations,
+               theResult.mMean,
+               theResult.mMedian,
+               theResult.mP99,
+               theResult.mP999,
+               theResult.mMax,
+               (theResult.mMean > 0.0) ? theResult.mFrames * 1e9 / theResult.mMean : 0.0,
+               theResult.mErrors);
+    }
+}
+
+// The store, fetch and region cases, with the frames either at the start of the buffer or split
+// across its end. Returns false if any operation failed.
+static bool RDC_BenchmarkPositions(UInt32 inChannels,
+                                   UInt32 inFrames,
+                                   UInt32 inOperations,
+                                   std::vector<RDC_Result>& ioResults)
+{
+    bool theSucceeded = true;
+
+    for(bool isWrapped : { false, true })
+    {
+        const char* thePosition = isWrapped ? "wrapped" : "aligned";
+        // The buffer holds exactly inFrames frames, so each operation starting half way through it
+        // wraps around its end.
+        CARingBuffer::SampleTime theOffset = isWrapped ? inFrames / 2 : 0;
+
+        {
+            RDC_Case theCase(inChannels, inFrames, inFrames);
+            RDC_Timings theTimings = RDC_Time(inOperations, [&](UInt32 i) {
+                return theCase.Store(theOffset + static_cast<CARingBuffer::SampleTime>(i) * inFrames);
+            });
+            RDC_AddResult("store", thePosition, inChannels, inFrames, theTimings, ioResults);
+            theSucceeded = theSucceeded && theTimings.mErrors == 0;
+        }
+
+        {
+            RDC_Case theCase(inChannels, inFrames, inFrames);
+            RDC_Timings theTimings = RDC_Time(inOperations, [&](UInt32 i) {
+                return theCase.WriteRegions(theOffset + static_cast<CARingBuffer::SampleTime>(i) * inFrames);
+            });
+            RDC_AddResult("write_region", thePosition, inChannels, inFrames, theTimings, ioResults);
+            theSucceeded = theSucceeded && theTimings.mErrors == 0;
+        }
+
+        {
+            // The same frames are read each time.
+            RDC_Case theCase(inChannels, inFrames, inFrames);
+            theCase.Store(theOffset);
+            RDC_Timings theTimings = RDC_Time(inOperations, [&](UInt32) { return theCase.Fetch(theOffset); });
+            RDC_AddResult("fetch", thePosition, inChannels, inFrames, theTimings, ioResults);
+            theSucceeded = theSucceeded && theTimings.mErrors == 0;
+        }
+
+        {
+            RDC_Case theCase(inChannels, inFrames, inFrames);
+            theCase.Store(theOffset);
+            RDC_Timings theTimings = RDC_Time(inOperations, [&](UInt32) { return theCase.ReadRegions(theOffset); });
+            RDC_AddResult("read_region", thePosition, inChannels, inFrames, theTimings, ioResults);
+            theSucceeded = theSucceeded && theTimings.mErrors == 0;
+        }
+    }
+
+    return theSucceeded;
+}
+
+// Storing after a gap and fetching frames in the hole it leaves.
+static bool RDC_BenchmarkGaps(UInt32 inChannels,
+                              UInt32 inFrames,
+                              UInt32 inOperations,
+                              std::vector<RDC_Result>& ioResults)
+{
+    bool theSucceeded = true;
+
+    {
+        RDC_Case theCase(inChannels, inFrames, 4 * inFrames);
+        RDC_Timings theTimings = RDC_Time(inOperations, [&](UInt32 i) {
+            return theCase.Store(static_cast<CARingBuffer::SampleTime>(i) * 2 * inFrames);
+        });
+        RDC_AddResult("store", "gap", inChannels, inFrames, theTimings, ioResults);
+        theSucceeded = theSucceeded && theTimings.mErrors == 0;
+    }
+
+    {
+        // Frames at [0, inFrames) and [2 * inFrames, 3 * inFrames), with the hole between them.
+        RDC_Case theCase(inChannels, inFrames, 4 * inFrames);
+        theCase.Store(0);
+        theCase.Store(2 * inFrames);
+        RDC_Timings theTimings = RDC_Time(inOperations, [&](UInt32) { return theCase.Fetch(inFrames / 2); });
+        RDC_AddResult("fetch", "hole", inChannels, inFrames, theTimings, ioResults);
+        theSucceeded = theSucceeded && theTimings.mErrors == 0;
+    }
+
+    return theSucceeded;
+}
+
+// One thread writing while another reads. The reader stays half a buffer behind the writer, like
+// the device's input, so it only fails if it's preempted for that long. Those failures aren't
+// treated as errors, since the real reader retries them.
+static void RDC_BenchmarkConcurrency(UInt32 inChannels,
+                                     UInt32 inFrames,
+                                     UInt32 inOperations,
+                                     bool inUsesRegions,
+                                     std::vector<RDC_Result>& ioResults)
+{
+    RDC_Case theCase(inChannels, inFrames, kConcurrentCapacityFrames);
+    std::atomic<CARingBuffer::SampleTime> theWriteTime { 0 };
+
+    // Fill the buffer first, so the reader always has frames to read.
+    CARingBuffer::SampleTime theTime = 0;
+
+    for(; theTime < kConcurrentCapacityFrames; theTime += inFrames)
+    {
+        theCase.Store(theTime);
+    }
+
+    theWriteTime = theTime;
+
+    RDC_Timings theWriterTimings;
+
+    std::thread theWriter([&] {
+        // The writer and reader share the case's buffer but not its source and destination.
+        theWriterTimings = RDC_Time(inOperations, [&](UInt32) {
+            CARingBuffer::SampleTime theNextTime = theWriteTime.load(std::memory_order_relaxed);
+            CARingBufferError err = inUsesRegions ? theCase.WriteRegions(theNextTime) : theCase.Store(theNextTime);
+            theWriteTime.store(theNextTime + inFrames, std::memory_order_relaxed);
+            return err;
+        });
+    });
+
+    RDC_Timings theReaderTimings = RDC_Time(inOperations, [&](UInt32) {
+        CARingBuffer::SampleTime theReadTime = theWriteTime.load(std::memory_order_relaxed) - kConcurrentCapacityFrames / 2;
+        return inUsesRegions ? theCase.ReadRegions(theReadTime) : theCase.Fetch(theReadTime);
+    });
+
+    theWriter.join();
+
+    RDC_AddResult(inUsesRegions ? "write_region" : "store", "concurrent", inChannels, inFrames, theWriterTimings, ioResults);
+    RDC_AddResult(inUsesRegions ? "read_region" : "fetch", "concurrent", inChannels, inFrames, theReaderTimings, ioResults);
+}
+
+// How much of an IO cycle at the smallest IO buffer size each operation takes, at the highest
+// sample rate, where the cycle is shortest. The device does a write_region in WriteMix and a
+// read_region in ReadInput, so an IO cycle costs about the sum of the two.
+static void RDC_PrintMinimumBufferSummary(const std::vector<RDC_Result>& inResults)
+{
+    Float64 theSampleRate = *std::max_element(std::begin(kRDCAvailableSampleRates), std::end(kRDCAvailableSampleRates));
+    Float64 theCycleNanos = kRDCMinIOBufferFrameSize * 1e9 / theSampleRate;
+
+    printf("IO buffer:              %u frames (kRDCMinIOBufferFrameSize)\n", kRDCMinIOBufferFrameSize);
+    printf("IO cycle:               %.0f ns at %.0f Hz\n\n", theCycleNanos, theSampleRate);
+    printf("%-14s%-12s%10s%10s%10s%10s%16s\n",
+           "operation", "position", "channels", "mean ns", "p99.9 ns", "max ns", "p99.9 % cycle");
+
+    for(const RDC_Result& theResult : inResults)
+    {
+        printf("%-14s%-12s%10u%10.1f%10.1f%10.1f%16.3f\n",
+               theResult.mOperation,
+               theResult.mPosition,
+               theResult.mChannels,
+               theResult.mMean,
+               theResult.mP999,
+               theResult.mMax,
+               100.0 * theResult.mP999 / theCycleNanos);
+    }
+
+    printf("\n");
+
+    std::vector<UInt32> theChannelCounts;
+
+    for(const RDC_Result& theResult : inResults)
+    {
+        if(std::find(theChannelCounts.begin(), theChannelCounts.end(), theResult.mChannels) == theChannelCounts.end())
+        {
+            theChannelCounts.push_back(theResult.mChannels);
+        }
+    }
+
+    // An IO cycle's total, from the wrapped cases since they're the more expensive.
+    for(UInt32 theChannels : theChannelCounts)
+    {
+        Float64 theMean = 0.0;
+        Float64 theP999 = 0.0;
+
+        for(const RDC_Result& theResult : inResults)
+        {
+            if(theResult.mChannels == theChannels &&
+               strcmp(theResult.mPosition, "wrapped") == 0 &&
+               (strcmp(theResult.mOperation, "write_region") == 0 || strcmp(theResult.mOperation, "read_region") == 0))
+            {
+                theMean += theResult.mMean;
+                theP999 += theResult.mP999;
+            }
+        }
+
+        printf("%u-channel IO cycle:    write_region + read_region (wrapped) %.1f ns mean, %.1f ns p99.9, "
+               "%.3f%% of the cycle\n",
+               theChannels,
+               theMean,
+               theP999,
+               100.0 * theP999 / theCycleNanos);
+    }
+}
+
+static void RDC_PrintUsage()
+{
+    fprintf(stderr,
+            "Usage: RDCRingBufferBenchmark [-n operations] [-b frames] [-c channels] [-m]\n"
+            "  -n  The number of operations timed in each case. 100000 by default.\n"
+            "  -b  Only run the cases for this many frames per operation, which must be a power of\n"
+            "      two. 16 to 4096 by default.\n"
+            "  -c  Only run the cases for this many channels. 1, 2 and 8 by default.\n"
+            "  -m  Only run the cases for the smallest IO buffer size the device allows,\n"
+            "      kRDCMinIOBufferFrameSize, and show how much of an IO cycle each takes instead of\n"
+            "      writing CSV.\n");
+}
+
+int main(int argc, char* __nullable argv[])
+{
+    UInt32 theOperations = 100000;
+    std::vector<UInt32> theFrameSizes(std::begin(kFrameSizes), std::end(kFrameSizes));
+    std::vector<UInt32> theChannelCounts(std::begin(kChannelCounts), std::end(kChannelCounts));
+    bool showsMinimumBufferSummary = false;
+
+    int theOption;
+    while((theOption = getopt(argc, argv, "n:b:c:mh")) != -1)
+    {
+        switch(theOption)
+        {
+            case 'n': theOperations = static_cast<UInt32>(strtoul(optarg, nullptr, 10)); break;
+            case 'b': theFrameSizes = { static_cast<UInt32>(strtoul(optarg, nullptr, 10)) }; break;
+            case 'c': theChannelCounts = { static_cast<UInt32>(strtoul(optarg, nullptr, 10)) }; break;
+            case 'm': showsMinimumBufferSummary = true; break;
+            default:
+                RDC_PrintUsage();
+                return (theOption == 'h') ? 0 : 2;
+        }
+    }
+
+    if(showsMinimumBufferSummary)
+    {
+        theFrameSizes = { kRDCMinIOBufferFrameSize };
+    }
+
+    bool theFrameSizesAreValid = std::all_of(theFrameSizes.begin(), theFrameSizes.end(), [](UInt32 inFrames) {
+        return inFrames >= 2 && inFrames <= kConcurrentCapacityFrames / 4 && (inFrames & (inFrames - 1)) == 0;
+    });
+
+    if(theOperations == 0 || !theFrameSizesAreValid || theChannelCounts[0] == 0)
+    {
+        RDC_PrintUsage();
+        return 2;
+    }
+
+    std::vector<RDC_Result> theResults;
+    bool theSucceeded = true;
+
+    for(UInt32 theChannels : theChannelCounts)
+    {
+        for(UInt32 theFrames : theFrameSizes)
+        {
+            theSucceeded = RDC_BenchmarkPositions(theChannels, theFrames, theOperations, theResults) && theSucceeded;
+            theSucceeded = RDC_BenchmarkGaps(theChannels, theFrames, theOperations, theResults) && theSucceeded;
+            RDC_BenchmarkConcurrency(theChannels, theFrames, theOperations, false, theResults);
+            RDC_BenchmarkConcurrency(theChannels, theFrames, theOperations, true, theResults);
+        }
+    }
+
+    if(showsMinimumBufferSummary)
+    {
+        RDC_PrintMinimumBufferSummary(theResults);
+    }
+    else
+    {
+        RDC_PrintCSV(theResults);
+    }
+
+    if(!theSucceeded)
+    {
+        fprintf(stderr, "RDCRingBufferBenchmark: Some operations failed\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+#pragma clang assume_nonnull end